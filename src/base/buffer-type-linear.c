@@ -157,6 +157,10 @@ static int _buffer_linear_reset(struct sid_buffer *buf)
 	if (buf->stat.spec.mode == SID_BUFFER_MODE_SIZE_PREFIX)
 		needed += SID_BUFFER_SIZE_PREFIX_LEN;
 
+	/* keep the memory if the buffer did not grow, e.g. a pre-sized buffer for messages */
+	if (buf->stat.usage.allocated == needed)
+		return 0;
+
 	return _buffer_linear_realloc(buf, needed, 1);
 }
 
@@ -356,11 +360,17 @@ static ssize_t _buffer_linear_read_plain(struct sid_buffer *buf, int fd)
 	return n;
 }
 
+/*
+ * Until the size prefix is received, read as much as fits into already allocated
+ * space so that a message which fits is received with a single read. Once the size
+ * is known, grow the buffer to it directly and never read past the message end.
+ */
 static ssize_t _buffer_linear_read_with_size_prefix(struct sid_buffer *buf, int fd)
 {
 	ssize_t n;
 	size_t  previous_used;
 	size_t  expected;
+	size_t  count;
 	int     r;
 
 	if (_buffer_linear_is_complete(buf, &r)) {
@@ -368,7 +378,12 @@ static ssize_t _buffer_linear_read_with_size_prefix(struct sid_buffer *buf, int
 	} else if (r < 0)
 		return r;
 
-	n = read(fd, buf->mem + buf->stat.usage.used, buf->stat.usage.allocated - buf->stat.usage.used);
+	if ((expected = EXPECTED(buf)))
+		count = expected - buf->stat.usage.used;
+	else
+		count = buf->stat.usage.allocated - buf->stat.usage.used;
+
+	n = read(fd, buf->mem + buf->stat.usage.used, count);
 
 	if (n > 0) {
 		previous_used        = buf->stat.usage.used;
@@ -377,6 +392,9 @@ static ssize_t _buffer_linear_read_with_size_prefix(struct sid_buffer *buf, int
 			/* Message must start with a prefix that is SID_BUFFER_SIZE_PREFIX_LEN bytes! */
 			if (expected < SID_BUFFER_SIZE_PREFIX_LEN)
 				return -EBADE;
+			/* More data than announced in the prefix - the peer did not wait for the reply. */
+			if (buf->stat.usage.used > expected)
+				return -EBADMSG;
 			if (previous_used < SID_BUFFER_SIZE_PREFIX_LEN) {
 				if ((r = _buffer_linear_realloc(buf, expected, 0)) < 0)
 					return r;
@@ -21,6 +21,7 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -105,6 +106,52 @@ fail:
 	return r;
 }
 
+/*
+ * Create an epoll instance watching listening socket_fd for incoming connections.
+ * The socket is registered with EPOLLEXCLUSIVE so if several processes watch the
+ * same socket this way, only one of them is woken up for each new connection.
+ * The returned fd can be polled for readability by any event loop.
+ */
+int sid_comms_unix_accept_watch(int socket_fd)
+{
+	struct epoll_event ev = {.events = EPOLLIN | EPOLLEXCLUSIVE};
+	int                watch_fd;
+	int                r;
+
+	if ((watch_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		return -errno;
+
+	ev.data.fd = socket_fd;
+
+	if (epoll_ctl(watch_fd, EPOLL_CTL_ADD, socket_fd, &ev) < 0) {
+		r = -errno;
+		(void) close(watch_fd);
+		return r;
+	}
+
+	return watch_fd;
+}
+
+/*
+ * Accept new connection on listening socket_fd. If watch_fd created by
+ * sid_comms_unix_accept_watch is defined, its pending events are consumed first.
+ * Returns the connection fd or -EAGAIN if there's no connection waiting, which
+ * is normal if another process watching the same socket was faster.
+ */
+int sid_comms_unix_accept(int socket_fd, int watch_fd)
+{
+	struct epoll_event ev;
+	int                fd;
+
+	if (watch_fd >= 0)
+		(void) epoll_wait(watch_fd, &ev, 1, 0);
+
+	if ((fd = accept4(socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0)
+		return -errno;
+
+	return fd;
+}
+
 static ssize_t _do_comms_unix_send(int socket_fd, struct iovec *iov, size_t iov_len, int fd_to_send)
 {
 	struct msghdr   msg = {0};
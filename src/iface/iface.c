@@ -49,12 +49,16 @@ static const char * const _cmd_names[] = {
 	[SID_CMD_DBSTATS]    = "dbstats",
 	[SID_CMD_RESOURCES]  = "resources",
 	[SID_CMD_DEVICES]    = "devices",
+	[SID_CMD_KV_VIEW]    = "kvview",
+	[SID_CMD_PARAM_GET]  = "get",
+	[SID_CMD_PARAM_SET]  = "set",
 };
 
 struct sid_result {
 	struct sid_buffer *buf;
 	const char        *shm;
 	size_t             shm_len;
+	int                fd;
 };
 
 static inline bool _needs_mem_fd(sid_cmd_t cmd)
@@ -62,6 +66,11 @@ static inline bool _needs_mem_fd(sid_cmd_t cmd)
 	return (cmd == SID_CMD_DBDUMP);
 }
 
+static inline bool _keeps_fd(sid_cmd_t cmd)
+{
+	return (cmd == SID_CMD_KV_VIEW);
+}
+
 void sid_result_free(struct sid_result *res)
 {
 	if (!res)
@@ -70,9 +79,46 @@ void sid_result_free(struct sid_result *res)
 		sid_buffer_destroy(res->buf);
 	if (res->shm != MAP_FAILED)
 		munmap((void *) res->shm, res->shm_len);
+	if (res->fd >= 0)
+		close(res->fd);
 	free(res);
 }
 
+int sid_socket_path_get(char *buf, size_t *len)
+{
+	const char *val;
+	size_t      val_len;
+
+	if (!(val = getenv(SID_KEY_SOCKET)) || !*val) {
+		memcpy(buf, SID_SOCKET_PATH, SID_SOCKET_PATH_LEN);
+		*len = SID_SOCKET_PATH_LEN;
+		return 0;
+	}
+
+	if ((val_len = strlen(val)) >= SID_SOCKET_PATH_MAX)
+		return -ENAMETOOLONG;
+
+	memcpy(buf, val, val_len);
+	if (buf[0] == '@')
+		buf[0] = '\0';
+
+	*len = val_len;
+	return 0;
+}
+
+int sid_result_take_fd(struct sid_result *res)
+{
+	int fd;
+
+	if (!res)
+		return -EINVAL;
+
+	fd      = res->fd;
+	res->fd = -1;
+
+	return fd;
+}
+
 int sid_result_status(struct sid_result *res, uint64_t *status)
 {
 	size_t                       size;
@@ -200,6 +246,36 @@ out:
 	return r;
 }
 
+static int _add_resources_env_to_buf(struct sid_buffer *buf, struct sid_resources_data *data)
+{
+	int r;
+
+	if (data->max_depth &&
+	    (r = sid_buffer_fmt_add(buf, NULL, NULL, "%s=%u", SID_RESOURCES_KEY_MAX_DEPTH, data->max_depth)) < 0)
+		return r;
+
+	if (data->type && (r = sid_buffer_fmt_add(buf, NULL, NULL, "%s=%s", SID_RESOURCES_KEY_TYPE, data->type)) < 0)
+		return r;
+
+	return 0;
+}
+
+static int _add_params_to_buf(struct sid_buffer *buf, struct sid_params_data *data)
+{
+	unsigned int i;
+	int          r;
+
+	if (data->nr_params && !data->params)
+		return -EINVAL;
+
+	for (i = 0; i < data->nr_params; i++) {
+		if ((r = sid_buffer_add(buf, data->params[i], strlen(data->params[i]) + 1, NULL, NULL)) < 0)
+			return r;
+	}
+
+	return 0;
+}
+
 static int _add_scan_env_to_buf(struct sid_buffer *buf)
 {
 	extern char **environ;
@@ -224,6 +300,8 @@ int sid_req(struct sid_request *req, struct sid_result **res_p)
 	int                r         = -1;
 	struct sid_result *res       = NULL;
 	int                export_fd = -1;
+	char               socket_path[SID_SOCKET_PATH_MAX];
+	size_t             socket_path_len;
 
 	if (!res_p)
 		return -EINVAL;
@@ -238,6 +316,7 @@ int sid_req(struct sid_request *req, struct sid_result **res_p)
 	res->buf     = NULL;
 	res->shm     = MAP_FAILED;
 	res->shm_len = 0;
+	res->fd      = -1;
 
 	if (!(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
 	                                                          .type    = SID_BUFFER_TYPE_LINEAR,
@@ -273,13 +352,25 @@ int sid_req(struct sid_request *req, struct sid_result **res_p)
 				if ((r = _add_checkpoint_env_to_buf(buf, &req->data.checkpoint)) < 0)
 					goto out;
 				break;
+			case SID_CMD_RESOURCES:
+				if ((r = _add_resources_env_to_buf(buf, &req->data.resources)) < 0)
+					goto out;
+				break;
+			case SID_CMD_PARAM_GET:
+			case SID_CMD_PARAM_SET:
+				if ((r = _add_params_to_buf(buf, &req->data.params)) < 0)
+					goto out;
+				break;
 			default:
 				/* no extra data to add for other commands */
 				break;
 		}
 	}
 
-	if ((socket_fd = sid_comms_unix_init(SID_SOCKET_PATH, SID_SOCKET_PATH_LEN, SOCK_STREAM | SOCK_CLOEXEC)) < 0) {
+	if ((r = sid_socket_path_get(socket_path, &socket_path_len)) < 0)
+		goto out;
+
+	if ((socket_fd = sid_comms_unix_init(socket_path, socket_path_len, SOCK_STREAM | SOCK_CLOEXEC)) < 0) {
 		r = socket_fd;
 		goto out;
 	}
@@ -315,9 +406,14 @@ int sid_req(struct sid_request *req, struct sid_result **res_p)
 		r = -EBADMSG;
 		goto out;
 	}
-	if (_needs_mem_fd(req->cmd)) {
+	if (_needs_mem_fd(req->cmd) || _keeps_fd(req->cmd)) {
 		unsigned char               byte;
 		SID_BUFFER_SIZE_PREFIX_TYPE msg_size;
+		uint64_t                    status;
+
+		/* no fd is sent with a failed reply */
+		if (_keeps_fd(req->cmd) && (sid_result_status(res, &status) < 0 || (status & SID_CMD_STATUS_FAILURE)))
+			goto out;
 
 		for (;;) {
 			n = sid_comms_unix_recv(socket_fd, &byte, sizeof(byte), &export_fd);
@@ -328,6 +424,13 @@ int sid_req(struct sid_request *req, struct sid_result **res_p)
 			r = n;
 			goto out;
 		}
+
+		/* the fd is passed to the caller as it is, see sid_result_take_fd */
+		if (_keeps_fd(req->cmd)) {
+			res->fd   = export_fd;
+			export_fd = -1;
+			goto out;
+		}
 		if ((n = sid_util_fd_read_all(export_fd, &msg_size, SID_BUFFER_SIZE_PREFIX_LEN)) != SID_BUFFER_SIZE_PREFIX_LEN) {
 			if (n < 0)
 				r = n;
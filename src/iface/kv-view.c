@@ -0,0 +1,360 @@
+/*
+ * This file is part of SID.
+ *
+ * Copyright (C) 2024 Red Hat, Inc. All rights reserved.
+ *
+ * SID is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SID is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SID.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "iface/iface_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define KV_VIEW_HEADER_SIZE sizeof(struct sid_kv_view_header)
+#define KV_VIEW_ENTRY_SIZE  sizeof(struct sid_kv_view_entry)
+
+struct sid_kv_view {
+	const char *mem;
+	size_t      size;
+};
+
+static int _item_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct sid_kv_view_item *) a)->key, ((const struct sid_kv_view_item *) b)->key);
+}
+
+size_t sid_kv_view_size(const struct sid_kv_view_item *items, size_t nr_items)
+{
+	size_t size = KV_VIEW_HEADER_SIZE + nr_items * KV_VIEW_ENTRY_SIZE;
+	size_t i;
+
+	for (i = 0; i < nr_items; i++)
+		size += strlen(items[i].key) + items[i].value_size;
+
+	return size;
+}
+
+int sid_kv_view_writer_init(struct sid_kv_view_writer *writer, size_t size)
+{
+	char fd_path[PATH_MAX];
+	int  r;
+
+	if (!writer || size < KV_VIEW_HEADER_SIZE)
+		return -EINVAL;
+
+	*writer = (struct sid_kv_view_writer) {.fd = -1, .rdonly_fd = -1, .size = size, .hdr = MAP_FAILED};
+
+	if ((writer->fd = memfd_create("kv_view", MFD_CLOEXEC | MFD_ALLOW_SEALING)) < 0 || ftruncate(writer->fd, size) < 0) {
+		r = -errno;
+		goto fail;
+	}
+
+	if ((writer->hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0)) == MAP_FAILED) {
+		r = -errno;
+		goto fail;
+	}
+
+	/* Readers rely on the size they see when mapping the view. */
+	if (fcntl(writer->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+		r = -errno;
+		goto fail;
+	}
+
+	/* Readers get a separate read-only open file description so they can not map the view writable. */
+	snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", writer->fd);
+	if ((writer->rdonly_fd = open(fd_path, O_RDONLY | O_CLOEXEC)) < 0) {
+		r = -errno;
+		goto fail;
+	}
+
+	*writer->hdr = (struct sid_kv_view_header) {.magic = SID_KV_VIEW_MAGIC, .version = SID_KV_VIEW_VERSION, .size = size};
+
+	return 0;
+fail:
+	sid_kv_view_writer_destroy(writer, false);
+	return r;
+}
+
+static void _writer_begin(struct sid_kv_view_header *hdr)
+{
+	__atomic_store_n(&hdr->seq, hdr->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void _writer_end(struct sid_kv_view_header *hdr)
+{
+	__atomic_store_n(&hdr->seq, hdr->seq + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Replace view content with 'items'. The 'items' array is sorted in place.
+ * Returns -ENOSPC if the view is too small, the view is left intact then.
+ */
+int sid_kv_view_writer_update(struct sid_kv_view_writer *writer, struct sid_kv_view_item *items, size_t nr_items)
+{
+	struct sid_kv_view_entry *entry;
+	char                     *mem;
+	uint64_t                  heap;
+	size_t                    key_size, i;
+
+	if (!writer || writer->hdr == MAP_FAILED || (nr_items && !items))
+		return -EINVAL;
+
+	if (sid_kv_view_size(items, nr_items) > writer->size)
+		return -ENOSPC;
+
+	for (i = 0; i < nr_items; i++) {
+		if (strlen(items[i].key) > UINT32_MAX || items[i].value_size > UINT32_MAX)
+			return -EOVERFLOW;
+	}
+
+	qsort(items, nr_items, sizeof(*items), _item_cmp);
+
+	mem   = (char *) writer->hdr;
+	entry = (struct sid_kv_view_entry *) (mem + KV_VIEW_HEADER_SIZE);
+	heap  = KV_VIEW_HEADER_SIZE + nr_items * KV_VIEW_ENTRY_SIZE;
+
+	_writer_begin(writer->hdr);
+
+	for (i = 0; i < nr_items; i++, entry++) {
+		key_size            = strlen(items[i].key);
+
+		entry->key_offset   = heap;
+		entry->key_size     = key_size;
+		memcpy(mem + heap, items[i].key, key_size);
+		heap                += key_size;
+
+		entry->value_offset = heap;
+		entry->value_size   = items[i].value_size;
+		if (items[i].value_size)
+			memcpy(mem + heap, items[i].value, items[i].value_size);
+		heap += items[i].value_size;
+	}
+
+	writer->hdr->nr_entries = nr_items;
+
+	_writer_end(writer->hdr);
+
+	return 0;
+}
+
+void sid_kv_view_writer_destroy(struct sid_kv_view_writer *writer, bool mark_stale)
+{
+	if (!writer)
+		return;
+
+	if (writer->hdr != MAP_FAILED) {
+		if (mark_stale) {
+			_writer_begin(writer->hdr);
+			writer->hdr->flags |= SID_KV_VIEW_FLAG_STALE;
+			_writer_end(writer->hdr);
+		}
+		(void) munmap(writer->hdr, writer->size);
+		writer->hdr = MAP_FAILED;
+	}
+
+	if (writer->rdonly_fd >= 0) {
+		(void) close(writer->rdonly_fd);
+		writer->rdonly_fd = -1;
+	}
+
+	if (writer->fd >= 0) {
+		(void) close(writer->fd);
+		writer->fd = -1;
+	}
+}
+
+int sid_kv_view_map(int fd, struct sid_kv_view **view)
+{
+	struct sid_kv_view_header hdr;
+	struct sid_kv_view       *v;
+	struct stat               st;
+	void                     *mem;
+
+	if (!view)
+		return -EINVAL;
+	*view = NULL;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if (st.st_size < (off_t) KV_VIEW_HEADER_SIZE)
+		return -EBADMSG;
+
+	if ((mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		return -errno;
+
+	memcpy(&hdr, mem, sizeof(hdr));
+
+	if (hdr.magic != SID_KV_VIEW_MAGIC || hdr.version != SID_KV_VIEW_VERSION || hdr.size != (uint64_t) st.st_size) {
+		(void) munmap(mem, st.st_size);
+		return -EBADMSG;
+	}
+
+	if (!(v = malloc(sizeof(*v)))) {
+		(void) munmap(mem, st.st_size);
+		return -ENOMEM;
+	}
+
+	v->mem  = mem;
+	v->size = st.st_size;
+	*view   = v;
+
+	return 0;
+}
+
+int sid_kv_view_open(struct sid_kv_view **view)
+{
+	struct sid_request req = {.cmd = SID_CMD_KV_VIEW};
+	struct sid_result *res = NULL;
+	uint64_t           status;
+	int                fd = -1;
+	int                r;
+
+	if (!view)
+		return -EINVAL;
+	*view = NULL;
+
+	if ((r = sid_req(&req, &res)) < 0)
+		return r;
+
+	if ((r = sid_result_status(res, &status)) < 0)
+		goto out;
+
+	if ((status & SID_CMD_STATUS_FAILURE) || (fd = sid_result_take_fd(res)) < 0) {
+		r = -ENODATA;
+		goto out;
+	}
+
+	r = sid_kv_view_map(fd, view);
+out:
+	if (fd >= 0)
+		(void) close(fd);
+	sid_result_free(res);
+	return r;
+}
+
+void sid_kv_view_close(struct sid_kv_view *view)
+{
+	if (!view)
+		return;
+
+	(void) munmap((void *) view->mem, view->size);
+	free(view);
+}
+
+/*
+ * Look up the key in a consistent snapshot. The writer may change the memory while
+ * we are reading so every offset is checked against the view size before it is used
+ * and the result is only trusted if the sequence number has not changed meanwhile.
+ */
+static int _lookup(const struct sid_kv_view *view,
+                   const char               *key,
+                   size_t                    key_size,
+                   void                     *buf,
+                   size_t                    buf_size,
+                   size_t                   *value_size)
+{
+	const struct sid_kv_view_header *hdr = (const struct sid_kv_view_header *) view->mem;
+	const struct sid_kv_view_entry  *entries, *entry;
+	uint64_t                         nr_entries, lo, hi, mid;
+	size_t                           cmp_size;
+	int                              cmp;
+
+	if (hdr->flags & SID_KV_VIEW_FLAG_STALE)
+		return -ESTALE;
+
+	nr_entries = hdr->nr_entries;
+	if (nr_entries > (view->size - KV_VIEW_HEADER_SIZE) / KV_VIEW_ENTRY_SIZE)
+		return -EBADMSG;
+
+	entries = (const struct sid_kv_view_entry *) (view->mem + KV_VIEW_HEADER_SIZE);
+	lo      = 0;
+	hi      = nr_entries;
+
+	while (lo < hi) {
+		mid   = lo + (hi - lo) / 2;
+		entry = &entries[mid];
+
+		if (entry->key_offset > view->size || entry->key_size > view->size - entry->key_offset)
+			return -EBADMSG;
+
+		cmp_size = key_size < entry->key_size ? key_size : entry->key_size;
+
+		if (!(cmp = memcmp(key, view->mem + entry->key_offset, cmp_size)))
+			cmp = (key_size > entry->key_size) - (key_size < entry->key_size);
+
+		if (cmp < 0)
+			hi = mid;
+		else if (cmp > 0)
+			lo = mid + 1;
+		else {
+			if (entry->value_offset > view->size || entry->value_size > view->size - entry->value_offset)
+				return -EBADMSG;
+
+			*value_size = entry->value_size;
+			if (entry->value_size > buf_size)
+				return -ENOBUFS;
+
+			memcpy(buf, view->mem + entry->value_offset, entry->value_size);
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+int sid_kv_view_lookup(struct sid_kv_view *view, const char *key, void *buf, size_t buf_size, size_t *value_size)
+{
+	struct sid_kv_view_header *hdr;
+	uint32_t                   seq;
+	size_t                     key_size, size = 0;
+	int                        r;
+
+	if (!view || !key || (buf_size && !buf))
+		return -EINVAL;
+
+	hdr      = (struct sid_kv_view_header *) view->mem;
+	key_size = strlen(key);
+
+	for (;;) {
+		seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+
+		r = _lookup(view, key, key_size, buf, buf_size, &size);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+
+	if (value_size)
+		*value_size = size;
+
+	return r;
+}
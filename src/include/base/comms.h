@@ -31,6 +31,9 @@ extern "C" {
 int sid_comms_unix_create(const char *path, size_t path_len, int type);
 int sid_comms_unix_init(const char *path, size_t path_len, int type);
 
+int sid_comms_unix_accept_watch(int socket_fd);
+int sid_comms_unix_accept(int socket_fd, int watch_fd);
+
 ssize_t sid_comms_unix_send(int socket_fd, void *buf, ssize_t buf_len, int fd_to_send);
 ssize_t sid_comms_unix_send_iovec(int socket_fd, struct iovec *iov, size_t iov_len, int fd_to_send);
 
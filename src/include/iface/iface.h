@@ -43,7 +43,10 @@ typedef enum {
 	SID_CMD_DBSTATS    = 8,
 	SID_CMD_RESOURCES  = 9,
 	SID_CMD_DEVICES    = 10,
-	_SID_CMD_END       = SID_CMD_DEVICES,
+	SID_CMD_KV_VIEW    = 11,
+	SID_CMD_PARAM_GET  = 12,
+	SID_CMD_PARAM_SET  = 13,
+	_SID_CMD_END       = SID_CMD_PARAM_SET,
 } sid_cmd_t;
 
 #define SID_CMD_STATUS_MASK_OVERALL   UINT64_C(0x0000000000000001)
@@ -67,6 +70,23 @@ struct sid_unmodified_data {
 	size_t size;
 };
 
+#define SID_RESOURCES_KEY_MAX_DEPTH "SID_RESOURCES_MAX_DEPTH"
+#define SID_RESOURCES_KEY_TYPE      "SID_RESOURCES_TYPE"
+
+struct sid_resources_data {
+	unsigned int max_depth; /* write only resources up to this depth (0 = unlimited) */
+	const char  *type;      /* write only resources of this type (NULL = all) */
+};
+
+/*
+ * Runtime tuning parameters: NAME items to get (all parameters if there are none)
+ * or NAME=VALUE items to set. All items to set are applied at once or not at all.
+ */
+struct sid_params_data {
+	char       **params;
+	unsigned int nr_params;
+};
+
 struct sid_request {
 	sid_cmd_t cmd;
 	uint64_t  flags;
@@ -75,6 +95,8 @@ struct sid_request {
 	union {
 		struct sid_checkpoint_data checkpoint;
 		struct sid_unmodified_data unmodified;
+		struct sid_resources_data  resources;
+		struct sid_params_data     params;
 	} data;
 };
 
@@ -87,6 +109,23 @@ void        sid_result_free(struct sid_result *res);
 int         sid_result_status(struct sid_result *res, uint64_t *status);
 int         sid_result_protocol(struct sid_result *res, uint8_t *prot);
 const char *sid_result_data(struct sid_result *res, size_t *size_p);
+
+/*
+ * Read-only view of selected records from main KV store (device ready and reserved
+ * states and aliases). The view is fetched from SID once and then it is read without
+ * any further communication with SID. Lookups never block the writer.
+ *
+ * sid_kv_view_lookup returns:
+ *   0        value copied to 'buf', its size set in 'value_size'
+ *   -ENOENT  no record for the key
+ *   -ENOBUFS 'buf' too small, the size needed is set in 'value_size'
+ *   -ESTALE  view replaced by a new one, it needs to be closed and opened again
+ */
+struct sid_kv_view;
+
+int  sid_kv_view_open(struct sid_kv_view **view);
+void sid_kv_view_close(struct sid_kv_view *view);
+int  sid_kv_view_lookup(struct sid_kv_view *view, const char *key, void *buf, size_t buf_size, size_t *value_size);
 #ifdef __cplusplus
 }
 #endif
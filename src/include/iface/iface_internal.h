@@ -38,6 +38,64 @@ struct sid_msg_header {
 #define SID_SOCKET_PATH     "\0sid-ubridge.socket"
 #define SID_SOCKET_PATH_LEN (sizeof(SID_SOCKET_PATH) - 1)
 
+/*
+ * SID_SOCKET_PATH can be overridden by SID_KEY_SOCKET in environment, e.g. to run
+ * a separate SID instance for testing. Leading '@' stands for abstract socket.
+ * The 'buf' must be at least SID_SOCKET_PATH_MAX bytes long.
+ */
+#define SID_KEY_SOCKET      "SID_SOCKET"
+#define SID_SOCKET_PATH_MAX 108
+
+int sid_socket_path_get(char *buf, size_t *len);
+int sid_result_take_fd(struct sid_result *res);
+
+/*
+ * KV view layout in shared memory:
+ *   header | entries sorted by key | keys and values
+ *
+ * Offsets in entries are relative to the start of the shared memory. The 'seq'
+ * field is a sequence lock: it is odd while the writer updates the view.
+ */
+#define SID_KV_VIEW_MAGIC      UINT32_C(0x5349444b) /* "SIDK" */
+#define SID_KV_VIEW_VERSION    UINT32_C(1)
+
+#define SID_KV_VIEW_FLAG_STALE UINT32_C(0x00000001) /* view replaced, readers need to reopen */
+
+struct sid_kv_view_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t seq;
+	uint32_t flags;
+	uint64_t size;
+	uint64_t nr_entries;
+};
+
+struct sid_kv_view_entry {
+	uint64_t key_offset;
+	uint64_t value_offset;
+	uint32_t key_size;
+	uint32_t value_size;
+};
+
+struct sid_kv_view_item {
+	const char *key;
+	const void *value;
+	size_t      value_size;
+};
+
+struct sid_kv_view_writer {
+	int                        fd;        /* memfd with the view */
+	int                        rdonly_fd; /* read-only fd for the same memfd to pass to readers */
+	size_t                     size;      /* size of the view */
+	struct sid_kv_view_header *hdr;       /* mapped view */
+};
+
+size_t sid_kv_view_size(const struct sid_kv_view_item *items, size_t nr_items);
+int    sid_kv_view_writer_init(struct sid_kv_view_writer *writer, size_t size);
+int    sid_kv_view_writer_update(struct sid_kv_view_writer *writer, struct sid_kv_view_item *items, size_t nr_items);
+void   sid_kv_view_writer_destroy(struct sid_kv_view_writer *writer, bool mark_stale);
+int    sid_kv_view_map(int fd, struct sid_kv_view **view);
+
 #ifdef __cplusplus
 }
 #endif
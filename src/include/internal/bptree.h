@@ -29,8 +29,9 @@
 extern "C" {
 #endif
 
-typedef struct bptree      bptree_t;
-typedef struct bptree_iter bptree_iter_t;
+typedef struct bptree        bptree_t;
+typedef struct bptree_iter   bptree_iter_t;
+typedef struct bptree_reader bptree_reader_t;
 
 typedef enum {
 	BPTREE_UPDATE_SKIP,   /* skip new value (keep old value) */
@@ -56,6 +57,11 @@ typedef void (
 	*bptree_iterate_fn_t)(const char *key, void *data, size_t data_size, unsigned data_ref_count, void *bptree_iterate_fn_arg);
 
 bptree_t *bptree_create(int order);
+int       bptree_set_merge_threshold(bptree_t *bptree, unsigned percent);
+void      bptree_set_lazy_remove(bptree_t *bptree, bool lazy);
+int       bptree_set_concurrent(bptree_t *bptree, bool concurrent);
+void      bptree_free_deferred(bptree_t *bptree, void *data);
+int       bptree_compact(bptree_t *bptree);
 int       bptree_insert(bptree_t *bptree, const char *key, void *data, size_t data_size);
 int       bptree_insert_alias(bptree_t *bptree, const char *key, const char *alias, bool force);
 int       bptree_update(bptree_t             *bptree,
@@ -69,18 +75,36 @@ void     *bptree_lookup(bptree_t *bptree, const char *key, size_t *data_size, un
 int       bptree_get_height(bptree_t *bptree);
 size_t    bptree_get_size(bptree_t *bptree, size_t *meta_size, size_t *data_size);
 size_t    bptree_get_num_entries(bptree_t *bptree);
+size_t    bptree_get_num_tombstones(bptree_t *bptree);
 int       bptree_destroy(bptree_t *bptree);
 int       bptree_destroy_with_fn(bptree_t *bptree, bptree_iterate_fn_t fn, void *fn_arg);
 
 void bptree_iter(bptree_t *bptree, const char *key_start, const char *key_end, bptree_iterate_fn_t fn, void *fn_arg);
 
 bptree_iter_t *bptree_iter_create(bptree_t *bptree, const char *key_start, const char *key_end);
+bptree_iter_t *bptree_iter_create_prefix(bptree_t *bptree, const char *prefix, size_t prefix_len);
 void          *bptree_iter_current(bptree_iter_t *iter, const char **key, size_t *data_size, unsigned *data_ref_count);
 const char    *bptree_iter_current_key(bptree_iter_t *iter);
 void          *bptree_iter_next(bptree_iter_t *iter, const char **key, size_t *data_size, unsigned *data_ref_count);
 void           bptree_iter_reset(bptree_iter_t *iter, const char *key_start, const char *key_end);
+void           bptree_iter_reset_prefix(bptree_iter_t *iter, const char *prefix, size_t prefix_len);
 void           bptree_iter_destroy(bptree_iter_t *iter);
 
+/*
+ * Readers in concurrent mode, each used by one thread. The data and keys
+ * returned can only be used until bptree_read_end.
+ */
+bptree_reader_t *bptree_reader_create(bptree_t *bptree);
+void             bptree_reader_destroy(bptree_reader_t *reader);
+void             bptree_read_begin(bptree_reader_t *reader);
+void             bptree_read_end(bptree_reader_t *reader);
+void *bptree_reader_lookup(bptree_reader_t *reader, const char *key, size_t *data_size, unsigned *data_ref_count);
+void  bptree_reader_iter(bptree_reader_t    *reader,
+                         const char         *key_start,
+                         const char         *key_end,
+                         bptree_iterate_fn_t fn,
+                         void               *fn_arg);
+
 #ifdef __cplusplus
 }
 #endif
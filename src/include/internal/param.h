@@ -0,0 +1,139 @@
+/*
+ * This file is part of SID.
+ *
+ * Copyright (C) 2024 Red Hat, Inc. All rights reserved.
+ *
+ * SID is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SID is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SID.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SID_PARAM_H
+#define _SID_PARAM_H
+
+#include "base/buffer.h"
+#include "internal/formatter.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Registry of typed runtime parameters.
+ *
+ * Each parameter has a name, type, range, default value and flags. Values are
+ * loaded from environment (sid.sysconfig) at start. Once the registry is marked
+ * as running, only parameters flagged with PARAM_FL_HOT can be changed and each
+ * change is propagated to the owning subsystem through its apply callback.
+ */
+
+typedef enum {
+	PARAM_TYPE_BOOL,
+	PARAM_TYPE_UINT,
+	PARAM_TYPE_STR,
+} param_type_t;
+
+#define PARAM_FL_NONE UINT32_C(0x00000000)
+#define PARAM_FL_HOT  UINT32_C(0x00000001) /* can be changed while running */
+
+/*
+ * Apply callback is called with the new value if it changes while the registry
+ * is running, before the new value is visible through param_get. If it returns
+ * a negative value, the value is not changed and any changes already applied
+ * within the same batch are rolled back by calling apply callbacks with the
+ * original values again. The 'str' is the value of PARAM_TYPE_STR parameter, NULL
+ * for other types.
+ */
+typedef int (*param_apply_fn_t)(const char *name, uint64_t value, const char *str, void *arg);
+
+struct param_spec {
+	const char      *name;
+	param_type_t     type;
+	uint64_t         min;     /* ignored for PARAM_TYPE_BOOL and PARAM_TYPE_STR */
+	uint64_t         max;     /* ignored for PARAM_TYPE_BOOL, maximum length for PARAM_TYPE_STR */
+	uint64_t         def;     /* default value */
+	const char      *def_str; /* default value for PARAM_TYPE_STR, NULL means empty string */
+	uint32_t         flags;   /* PARAM_FL_* */
+	param_apply_fn_t apply;   /* may be NULL */
+	void            *arg;     /* passed to apply */
+};
+
+struct param_registry;
+
+struct param_registry *param_registry_create(void);
+void                   param_registry_destroy(struct param_registry *reg);
+int                    param_register(struct param_registry *reg, const struct param_spec *spec);
+void                   param_registry_set_running(struct param_registry *reg);
+
+/*
+ * Get current value of a parameter. Use param_get_str for PARAM_TYPE_STR parameters
+ * and param_get for others, -EINVAL is returned on type mismatch. The string is owned
+ * by the registry and it is valid only until the parameter is changed.
+ */
+int param_get(struct param_registry *reg, const char *name, uint64_t *value);
+int param_get_str(struct param_registry *reg, const char *name, const char **value);
+
+/*
+ * Set values from 'list' of 'list_size' bytes containing consecutive NAME=VALUE
+ * strings, each one terminated by '\0'. The batch is applied atomically - either
+ * all values are changed or none of them is.
+ *
+ * Returns:
+ *   0        all values set
+ *   -ENOENT  unknown parameter
+ *   -EINVAL  value not parseable for the parameter's type
+ *   -ERANGE  value out of the parameter's range or string value too long
+ *   -EPERM   parameter is not hot-reloadable and registry is running
+ *   other    error returned by apply callback
+ *
+ * Values are applied in the order the parameters were registered. On error,
+ * 'failed' (if not NULL) points to the name of the registered parameter that
+ * caused the failure or to the offending item in 'list' if there's no such
+ * parameter.
+ */
+int param_set(struct param_registry *reg, const char *list, size_t list_size, const char **failed);
+
+/*
+ * Load values of all registered parameters from environment. Invalid values
+ * are ignored and defaults are kept for them. Returns -EINVAL and sets 'failed'
+ * to the name of the first such parameter if any, 0 otherwise.
+ */
+int param_load_env(struct param_registry *reg, const char **failed);
+
+/*
+ * Load values from sysconfig-style file with KEY=VALUE lines, comments starting
+ * with '#' and optionally quoted values. Keys which are not registered parameters
+ * are ignored. Values are then set as one batch with param_set.
+ */
+int param_load_file(struct param_registry *reg, const char *path, const char **failed);
+
+/*
+ * Write parameters listed in 'names' or all parameters if 'names' is NULL. The
+ * 'names' list is formatted the same way as 'list' in param_set, but the "=VALUE"
+ * part is optional and ignored if present. Returns -ENOENT for unknown parameter.
+ */
+int param_write(struct param_registry *reg,
+                const char            *names,
+                size_t                 names_size,
+                output_format_t        format,
+                struct sid_buffer     *buf,
+                const char           **failed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -58,6 +58,16 @@ extern const struct log_target log_target_journal;
 
 void log_init(log_target_t target, int verbose_mode);
 void log_change_target(log_target_t new_target);
+void log_change_verbose_mode(int new_verbose_mode);
+int  log_get_verbose_mode(void);
+
+/*
+ * Force debug messages to be logged even if the verbose mode is lower, until the
+ * force is dropped again. The verbose mode reported by log_get_verbose_mode and
+ * set by log_change_verbose_mode is not affected. The log target is not reopened,
+ * so this is cheap enough to be switched for each command.
+ */
+void log_force_debug(int force);
 
 __attribute__((format(printf, 8, 9))) void log_output(int         level_id,
                                                       const char *prefix,
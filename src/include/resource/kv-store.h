@@ -53,7 +53,9 @@ struct kv_store_hash_backend_params {
 };
 
 struct kv_store_bptree_backend_params {
-	int order;
+	int      order;
+	unsigned merge_threshold; /* min node occupancy in percent before merging nodes on removal, 0 for default */
+	bool     lazy_remove;     /* leave tombstones on removal, delete them with kv_store_compact */
 };
 
 struct sid_kv_store_resource_params {
@@ -111,7 +113,7 @@ typedef int (*kv_store_update_cb_fn_t)(struct kv_store_update_spec *update_spec)
  * B     0     0     1     value ref    value size    0     0    value copy ref         value size   merge flag has no effect: B == A
  * C     0     1     0     value ref    value size    0     1    value ref              value size
  * D     0     1     1     value ref    value size    0     1    value ref              value size   merge flag has no effect: D == C
- * E     1     0     0     iovec ref    iovec size    1     0    iovec deep copy ref    iovec size   allocated both iovec copy and value parts
+ * E     1     0     0     iovec ref    iovec size    1     0    iovec deep copy ref    iovec size   value parts packed together, iovec created on first get
  * F     1     0     1     iovec ref    iovec size    0     0    value merger ref       value size   iovec members merged into single value
  * G     1     1     0     iovec ref    iovec size    1     1    iovec ref              iovec size
  * H     1     1     1     iovec ref    iovec size    1     1    value merger iovec ref iovec size   iovec members merged into single value, iovec has refs to merged value parts
@@ -125,7 +127,8 @@ typedef int (*kv_store_update_cb_fn_t)(struct kv_store_update_spec *update_spec)
  *
  *
  * Returns:
- *   The value that has been set.
+ *   The value that has been set. For E, this is the input iovec unless kv_update_fn changed
+ *   the value. Use kv_store_get_value to get the iovec referencing the stored copy.
  */
 // clang-format on
 void *kv_store_set_value(sid_resource_t           *kv_store_res,
@@ -167,6 +170,19 @@ int kv_store_unset(sid_resource_t *kv_store_res, const char *key, kv_store_updat
 
 size_t kv_store_get_size(sid_resource_t *kv_store_res, size_t *meta_size, size_t *data_size);
 
+/*
+ * Gets generation of the store which changes whenever any value is set, unset or rolled back
+ * or an alias is added. Any value, or its absence, found before may be different once the
+ * generation changes and pointers to values found before may not be valid anymore.
+ */
+uint64_t kv_store_get_generation(sid_resource_t *kv_store_res);
+
+/*
+ * Compacts the backend storage, for example, deletes tombstones left after removing keys
+ * with 'lazy_remove' B+ tree backend parameter set. This does not change stored values.
+ */
+int kv_store_compact(sid_resource_t *kv_store_res);
+
 int  kv_store_transaction_begin(sid_resource_t *kv_store_res);
 void kv_store_transaction_end(sid_resource_t *kv_store_res, bool rollback);
 bool kv_store_in_transaction(sid_resource_t *kv_store_res);
@@ -174,16 +190,29 @@ bool kv_store_in_transaction(sid_resource_t *kv_store_res);
 typedef struct kv_store_iter kv_store_iter_t;
 
 kv_store_iter_t *kv_store_iter_create(sid_resource_t *kv_store_res, const char *key_start, const char *key_end);
+/*
+ * Iterate over all keys starting with the first 'prefix_len' characters of 'prefix'.
+ * The prefix is not copied and it must be kept valid while the iterator is in use.
+ * Empty prefix selects all keys.
+ */
+kv_store_iter_t *kv_store_iter_create_prefix(sid_resource_t *kv_store_res, const char *prefix, size_t prefix_len);
 int              kv_store_iter_current_size(kv_store_iter_t *iter,
                                             size_t          *int_size,
                                             size_t          *int_data_size,
                                             size_t          *ext_size,
                                             size_t          *ext_data_size);
+/*
+ * Get size the current record would have if vector values were stored with an iovec per item
+ * (unpacked_size) and size of the iovec created for a packed vector on first access (view_size).
+ */
+int              kv_store_iter_current_vector_size(kv_store_iter_t *iter, size_t *unpacked_size, size_t *view_size);
 const char      *kv_store_iter_current_key(kv_store_iter_t *iter);
 void            *kv_store_iter_current(kv_store_iter_t *iter, size_t *size, kv_store_value_flags_t *flags);
 void            *kv_store_iter_next(kv_store_iter_t *iter, size_t *size, const char **return_key, kv_store_value_flags_t *flags);
 void             kv_store_iter_reset(kv_store_iter_t *iter, const char *key_start, const char *key_end);
+void             kv_store_iter_reset_prefix(kv_store_iter_t *iter, const char *prefix, size_t prefix_len);
 void             kv_store_iter_destroy(kv_store_iter_t *iter);
+size_t           kv_store_iter_count_prefix(sid_resource_t *kv_store_res, const char *prefix, size_t prefix_len);
 
 #ifdef __cplusplus
 }
@@ -176,6 +176,17 @@ typedef enum {
 	SID_RESOURCE_POS_REL,
 } sid_resource_pos_t;
 
+/*
+ * Event source priorities - if more event sources are pending at once,
+ * the one with lower value is dispatched first. Completing work which is
+ * already in progress is preferred to admitting new work. Housekeeping
+ * is done only if there's nothing else pending.
+ */
+#define SID_RESOURCE_EVENT_PRIO_COMPLETION -10
+#define SID_RESOURCE_EVENT_PRIO_NORMAL     0
+#define SID_RESOURCE_EVENT_PRIO_ADMISSION  10
+#define SID_RESOURCE_EVENT_PRIO_IDLE       100
+
 int sid_resource_create_io_event_source(sid_resource_t                 *res,
                                         sid_resource_event_source_t   **es,
                                         int                             fd,
@@ -238,6 +249,14 @@ int sid_resource_create_exit_event_source(sid_resource_t                      *r
 int sid_resource_set_event_source_counter(sid_resource_event_source_t *es, sid_resource_pos_t disposition, uint64_t events_max);
 int sid_resource_get_event_source_counter(sid_resource_event_source_t *es, uint64_t *events_fired, uint64_t *events_max);
 
+/*
+ * Deferral counter counts the times the event source's handler left some of its pending events
+ * for later iterations, e.g. to let event sources with higher priority go first. The counter is
+ * only increased by the handlers themselves.
+ */
+int sid_resource_count_event_source_deferral(sid_resource_event_source_t *es);
+int sid_resource_get_event_source_deferrals(sid_resource_event_source_t *es, uint64_t *events_deferred);
+
 int sid_resource_destroy_event_source(sid_resource_event_source_t **es);
 
 int sid_resource_run_event_loop(sid_resource_t *res);
@@ -246,6 +265,20 @@ int sid_resource_exit_event_loop(sid_resource_t *res);
 /*
  * miscellanous functions
  */
+struct sid_resource_write_spec {
+	output_format_t format;
+	int             fd;         /* if set, flush outbuf to this fd whenever it holds at least flush_size bytes, -1 otherwise */
+	size_t          flush_size; /* outbuf fill level to flush at */
+	unsigned        max_depth;  /* write only resources up to this depth, counting from 1 (0 = unlimited) */
+	const char     *type_name;  /* write only resources of this type, unmatched ones are skipped over (NULL = all) */
+};
+
+int sid_resource_write_tree(sid_resource_t                 *res,
+                            struct sid_resource_write_spec *spec,
+                            struct sid_buffer              *outbuf,
+                            int                             level,
+                            bool                            with_comma);
+
 int sid_resource_write_tree_recursively(sid_resource_t    *res,
                                         output_format_t    format,
                                         struct sid_buffer *outbuf,
@@ -27,6 +27,7 @@ extern "C" {
 #endif
 
 int ubridge_cmd_dbdump(sid_resource_t *ubridge_res, const char *file_path);
+int ubridge_reload_params(sid_resource_t *ubridge_res);
 
 #ifdef __cplusplus
 }
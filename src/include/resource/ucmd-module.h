@@ -211,6 +211,12 @@ const void *sid_ucmd_get_foreign_dev_mod_kv(struct module          *mod,
                                             size_t                 *value_size,
                                             sid_ucmd_kv_flags_t    *flags);
 
+/*
+ * Get a KV_NS_DEVICE record of the whole disk the current partition belongs to.
+ * The disk's records are looked up by its device identifier, which is resolved
+ * from the whole disk's device number, so these are the same records the disk
+ * sees as its own KV_NS_DEVICE records when it is processed.
+ */
 const void *sid_ucmd_part_get_disk_kv(struct module       *mod,
                                       struct sid_ucmd_ctx *ucmd_ctx,
                                       const char          *key,
@@ -158,6 +158,9 @@ int worker_control_run_worker(sid_resource_t *worker_control_res);
 sid_resource_t *worker_control_get_idle_worker(sid_resource_t *worker_control_res);
 sid_resource_t *worker_control_find_worker(sid_resource_t *worker_control_res, const char *id);
 
+/* Process messages already sent by workers, but not yet dispatched by event loop. */
+int worker_control_recv_pending(sid_resource_t *worker_control_res);
+
 /* Worker utility functions. */
 bool           worker_control_is_worker(sid_resource_t *res);
 worker_state_t worker_control_get_worker_state(sid_resource_t *res);
@@ -53,11 +53,21 @@
  *     the same record with the original key
  *   - added 'bptree_destroy_with_fn' to call custom fn before each record
  *     is unreferenced/removed
+ *   - added 'bptree_iter_create_prefix' to iterate over keys with given prefix
+ *     which seeks to the first matching key and stops at the first key beyond
+ *   - added 'bptree_set_merge_threshold' to lower the node occupancy below
+ *     which nodes are coalesced or redistributed on deletion
+ *   - added lazy removal mode ('bptree_set_lazy_remove') which leaves a tombstone
+ *     in the leaf instead of deleting the entry and 'bptree_compact' to delete
+ *     the tombstones later
+ *   - added concurrent mode ('bptree_set_concurrent') with a single writer
+ *     and lock-free readers ('bptree_reader_*') validating per-node versions
  */
 
 #include "internal/bptree.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -65,6 +75,7 @@ typedef struct bptree_record {
 	size_t   data_size;
 	void    *data;
 	unsigned ref_count;
+	unsigned version;
 } bptree_record_t;
 
 typedef struct bptree_key {
@@ -96,6 +107,13 @@ typedef struct bptree_key {
  *
  * In a leaf, the number of valid pointers to data is always num_keys.
  * The last leaf pointer points to the next leaf.
+ *
+ * In lazy removal mode, a leaf pointer to data may be NULL. Such an entry
+ * is a tombstone - its key is still in the tree, but there's no record.
+ *
+ * In concurrent mode, the version is odd while the writer changes the node.
+ * Readers take a copy of the node and use it only if the version was even
+ * and did not change while copying.
  */
 
 typedef struct bptree_node {
@@ -104,12 +122,15 @@ typedef struct bptree_node {
 	struct bptree_node *parent;
 	bool                is_leaf;
 	int                 num_keys;
+	unsigned            version;
 } bptree_node_t;
 
 typedef struct bptree_iter {
 	bptree_t      *bptree;
 	const char    *key_start;
 	const char    *key_end;
+	const char    *prefix;
+	size_t         prefix_len;
 	bptree_node_t *c;
 	int            i;
 } bptree_iter_t;
@@ -119,17 +140,25 @@ typedef struct bptree_iter {
  *
  * The order determines the maximum and minimum number of entries
  * (keys and pointers) in any node. Every node has at most order - 1 keys
- * and at least (roughly speaking) half that number. Every leaf has as many
- * pointers to data as keys, and every internal node has one more pointer
- * to a subtree than the number of keys.
+ * and at least min_leaf_keys or min_node_keys keys. By default, this is
+ * (roughly speaking) half of the maximum, but it can be lowered with
+ * bptree_set_merge_threshold. Every leaf has as many pointers to data as keys,
+ * and every internal node has one more pointer to a subtree than the number
+ * of keys.
  */
 
 typedef struct bptree {
-	bptree_node_t *root;
-	int            order;
-	size_t         meta_size;
-	size_t         data_size;
-	size_t         num_entries;
+	bptree_node_t        *root;
+	unsigned              root_version;
+	int                   order;
+	int                   min_leaf_keys;
+	int                   min_node_keys;
+	bool                  lazy_remove;
+	struct bptree_shared *shared;
+	size_t                meta_size;
+	size_t                data_size;
+	size_t                num_entries;
+	size_t                num_tombstones;
 } bptree_t;
 
 typedef enum {
@@ -137,12 +166,279 @@ typedef enum {
 	LOOKUP_PREFIX,
 } bptree_lookup_method_t;
 
+/*
+ * Concurrent mode.
+ *
+ * There's a single writer which uses the usual bptree functions and any number
+ * of readers, each registered with bptree_reader_create and calling
+ * bptree_reader_lookup or bptree_reader_iter between bptree_read_begin
+ * and bptree_read_end.
+ *
+ * The writer makes the version of each node, record or root pointer it changes
+ * odd before the first change and even again once the whole operation is done.
+ * Readers copy the node and retry if the version was odd or changed meanwhile.
+ * Also, a reader descending from a parent to a child checks that the parent
+ * did not change after copying the child (lock coupling) so the child was
+ * still linked.
+ *
+ * Nodes, keys and records which the writer frees may still be accessed by
+ * readers so they're put aside and freed once all readers which were reading
+ * at the time have finished (epoch-based reclamation).
+ */
+
+#define BPTREE_CONCURRENT_MAX_ORDER 64
+#define BPTREE_MAX_READERS          64
+
+typedef enum {
+	RETIRED_NODE,
+	RETIRED_BKEY,
+	RETIRED_RECORD,
+	RETIRED_DATA,
+} bptree_retired_type_t;
+
+typedef struct bptree_retired {
+	struct bptree_retired *next;
+	void                  *ptr;
+	bptree_retired_type_t  type;
+	uint64_t               epoch;
+} bptree_retired_t;
+
+typedef struct bptree_reader {
+	bptree_t *bptree;
+	uint64_t  epoch; /* epoch at bptree_read_begin or 0 if not reading */
+	bool      used;
+} bptree_reader_t;
+
+typedef struct bptree_shared {
+	uint64_t          epoch;       /* current epoch, incremented by writer */
+	unsigned        **dirty;       /* versions made odd by current write operation */
+	size_t            dirty_count; /* number of used items in dirty */
+	size_t            dirty_size;  /* number of allocated items in dirty */
+	bptree_retired_t *retired;     /* freed by writer, but possibly still accessed by readers */
+	bptree_retired_t *spare;       /* preallocated items for retired list */
+	size_t            spare_count; /* number of items in spare */
+	bptree_reader_t   readers[BPTREE_MAX_READERS];
+} bptree_shared_t;
+
+/* reader's copy of a node */
+typedef struct bptree_node_copy {
+	unsigned       version;
+	bool           is_leaf;
+	int            num_keys;
+	bptree_key_t  *bkeys[BPTREE_CONCURRENT_MAX_ORDER - 1];
+	void          *pointers[BPTREE_CONCURRENT_MAX_ORDER];
+	bptree_node_t *next;
+} bptree_node_copy_t;
+
 static bptree_node_t *_insert_into_parent(bptree_t       *bptree,
                                           bptree_node_t **node_list,
                                           bptree_node_t  *left,
                                           bptree_key_t   *bkey,
                                           bptree_node_t  *right);
 static bptree_node_t *_delete_entry(bptree_t *bptree, bptree_node_t *n, bptree_key_t *bkey, void *pointer);
+static int            _cut(int length);
+
+/*
+ * Marks the start of a change of a node, record or root pointer
+ * protected by given version in concurrent mode.
+ */
+static void _write_lock(bptree_t *bptree, unsigned *version)
+{
+	bptree_shared_t *shared = bptree->shared;
+
+	if (!shared || (*version & 1))
+		return;
+
+	assert(shared->dirty_count < shared->dirty_size);
+
+	__atomic_store_n(version, *version + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	shared->dirty[shared->dirty_count++] = version;
+}
+
+static void _write_node(bptree_t *bptree, bptree_node_t *n)
+{
+	_write_lock(bptree, &n->version);
+}
+
+static void _free_retired_item(void *ptr, bptree_retired_type_t type)
+{
+	bptree_node_t *n;
+	bptree_key_t  *bkey;
+
+	switch (type) {
+		case RETIRED_NODE:
+			n = ptr;
+			free(n->bkeys);
+			free(n->pointers);
+			free(n);
+			break;
+		case RETIRED_BKEY:
+			bkey = ptr;
+			free((void *) bkey->key);
+			free(bkey);
+			break;
+		case RETIRED_RECORD:
+		case RETIRED_DATA:
+			free(ptr);
+			break;
+	}
+}
+
+/*
+ * Frees retired items which no reader can access anymore - those retired
+ * before the oldest epoch in which a reader is still reading.
+ */
+static void _reclaim(bptree_t *bptree, bool all)
+{
+	bptree_shared_t   *shared    = bptree->shared;
+	uint64_t           min_epoch = UINT64_MAX;
+	uint64_t           epoch;
+	bptree_retired_t **p, *retired;
+	int                i;
+
+	if (!all) {
+		for (i = 0; i < BPTREE_MAX_READERS; i++) {
+			epoch = __atomic_load_n(&shared->readers[i].epoch, __ATOMIC_SEQ_CST);
+			if (epoch && epoch < min_epoch)
+				min_epoch = epoch;
+		}
+	}
+
+	for (p = &shared->retired; (retired = *p);) {
+		if (retired->epoch < min_epoch) {
+			*p = retired->next;
+			_free_retired_item(retired->ptr, retired->type);
+			retired->next  = shared->spare;
+			shared->spare  = retired;
+			shared->spare_count++;
+		} else
+			p = &retired->next;
+	}
+}
+
+/*
+ * Waits until all readers which were reading in current epoch have finished.
+ */
+static void _synchronize(bptree_t *bptree)
+{
+	bptree_shared_t *shared = bptree->shared;
+	uint64_t         epoch, reader_epoch;
+	int              i;
+
+	epoch = __atomic_add_fetch(&shared->epoch, 1, __ATOMIC_SEQ_CST);
+
+	for (i = 0; i < BPTREE_MAX_READERS; i++) {
+		do
+			reader_epoch = __atomic_load_n(&shared->readers[i].epoch, __ATOMIC_SEQ_CST);
+		while (reader_epoch && reader_epoch < epoch);
+	}
+}
+
+/*
+ * Frees the item, or puts it aside in concurrent mode until readers can't access it.
+ * Within a write operation, this never fails as spare items are preallocated.
+ */
+static void _retire(bptree_t *bptree, void *ptr, bptree_retired_type_t type)
+{
+	bptree_shared_t  *shared = bptree->shared;
+	bptree_retired_t *retired;
+
+	if (!shared) {
+		_free_retired_item(ptr, type);
+		return;
+	}
+
+	if ((retired = shared->spare)) {
+		shared->spare = retired->next;
+		shared->spare_count--;
+	} else if (!(retired = malloc(sizeof(*retired)))) {
+		assert(!shared->dirty_count);
+		_synchronize(bptree);
+		_free_retired_item(ptr, type);
+		return;
+	}
+
+	retired->ptr    = ptr;
+	retired->type   = type;
+	retired->epoch  = shared->epoch;
+	retired->next   = shared->retired;
+	shared->retired = retired;
+}
+
+static void _free_shared(bptree_t *bptree)
+{
+	bptree_shared_t  *shared = bptree->shared;
+	bptree_retired_t *retired;
+
+	_reclaim(bptree, true);
+
+	while ((retired = shared->spare)) {
+		shared->spare = retired->next;
+		free(retired);
+	}
+
+	free(shared->dirty);
+	free(shared);
+	bptree->shared = NULL;
+}
+
+/*
+ * Prepares for a write operation in concurrent mode so that
+ * it can't fail once the tree is being changed.
+ */
+static int _write_begin(bptree_t *bptree)
+{
+	bptree_shared_t  *shared = bptree->shared;
+	bptree_retired_t *retired;
+	unsigned        **dirty;
+	size_t            size;
+
+	if (!shared)
+		return 0;
+
+	/* nodes on the path from root to leaf, their neighbors, root pointer and records */
+	size = 4 * (bptree_get_height(bptree) + 2) + 8;
+
+	if (size > shared->dirty_size) {
+		if (!(dirty = realloc(shared->dirty, size * sizeof(*dirty))))
+			return -1;
+		shared->dirty      = dirty;
+		shared->dirty_size = size;
+	}
+
+	while (shared->spare_count < size) {
+		if (!(retired = malloc(sizeof(*retired))))
+			return -1;
+		retired->next = shared->spare;
+		shared->spare = retired;
+		shared->spare_count++;
+	}
+
+	return 0;
+}
+
+/*
+ * Ends a write operation in concurrent mode - makes all changes visible
+ * to readers and frees retired items which readers can't access anymore.
+ */
+static void _write_end(bptree_t *bptree)
+{
+	bptree_shared_t *shared = bptree->shared;
+	size_t           i;
+
+	if (!shared)
+		return;
+
+	for (i = 0; i < shared->dirty_count; i++)
+		__atomic_store_n(shared->dirty[i], *shared->dirty[i] + 1, __ATOMIC_RELEASE);
+	shared->dirty_count = 0;
+
+	if (shared->retired) {
+		__atomic_add_fetch(&shared->epoch, 1, __ATOMIC_SEQ_CST);
+		_reclaim(bptree, false);
+	}
+}
 
 /*
  * Create new tree.
@@ -157,15 +453,102 @@ bptree_t *bptree_create(int order)
 	if (!(bptree = malloc(sizeof(bptree_t))))
 		return NULL;
 
-	bptree->root        = NULL;
-	bptree->order       = order;
-	bptree->meta_size   = sizeof(*bptree);
-	bptree->data_size   = 0;
-	bptree->num_entries = 0;
+	bptree->root           = NULL;
+	bptree->root_version   = 0;
+	bptree->order          = order;
+	bptree->min_leaf_keys  = _cut(order - 1);
+	bptree->min_node_keys  = _cut(order) - 1;
+	bptree->lazy_remove    = false;
+	bptree->shared         = NULL;
+	bptree->meta_size      = sizeof(*bptree);
+	bptree->data_size      = 0;
+	bptree->num_entries    = 0;
+	bptree->num_tombstones = 0;
 
 	return bptree;
 }
 
+/*
+ * Set the minimum occupancy of a node, in percent, below which the node is
+ * coalesced with or takes entries from its neighbor on deletion. The default
+ * is 50. Lower values let nodes shrink further before restructuring the tree,
+ * which avoids repeated splits and merges if the same keys are removed and
+ * added again.
+ */
+int bptree_set_merge_threshold(bptree_t *bptree, unsigned percent)
+{
+	int min_keys;
+
+	if (!percent || percent > 50)
+		return -1;
+
+	/* leaf occupancy counts keys, internal node occupancy counts pointers */
+	min_keys              = ((bptree->order - 1) * percent + 99) / 100;
+	bptree->min_leaf_keys = min_keys > 1 ? min_keys : 1;
+
+	min_keys              = (bptree->order * percent + 99) / 100 - 1;
+	bptree->min_node_keys = min_keys > 1 ? min_keys : 1;
+
+	return 0;
+}
+
+/*
+ * In lazy removal mode, removing a key only drops the record and leaves
+ * a tombstone in the leaf so the tree is not restructured. The tombstone
+ * is reused if the key is inserted again. Tombstones are deleted from a leaf
+ * if the leaf would need to be split on insertion, or all at once by calling
+ * bptree_compact.
+ */
+void bptree_set_lazy_remove(bptree_t *bptree, bool lazy)
+{
+	bptree->lazy_remove = lazy;
+}
+
+/*
+ * Switch concurrent mode on or off. This must be called by the writer and concurrent
+ * mode can be switched off only if there are no readers. Supported only for trees
+ * with order up to BPTREE_CONCURRENT_MAX_ORDER.
+ */
+int bptree_set_concurrent(bptree_t *bptree, bool concurrent)
+{
+	bptree_shared_t *shared = bptree->shared;
+	int              i;
+
+	if (concurrent == !!shared)
+		return 0;
+
+	if (concurrent) {
+		if (bptree->order > BPTREE_CONCURRENT_MAX_ORDER || !(shared = calloc(1, sizeof(*shared))))
+			return -1;
+
+		shared->epoch  = 1;
+		bptree->shared = shared;
+		return 0;
+	}
+
+	for (i = 0; i < BPTREE_MAX_READERS; i++) {
+		if (__atomic_load_n(&shared->readers[i].used, __ATOMIC_ACQUIRE))
+			return -1;
+	}
+
+	_free_shared(bptree);
+	return 0;
+}
+
+/*
+ * Free data in concurrent mode once readers can't access them anymore. The writer
+ * uses this to free data which were replaced or removed from the tree.
+ */
+void bptree_free_deferred(bptree_t *bptree, void *data)
+{
+	_retire(bptree, data, RETIRED_DATA);
+
+	if (bptree->shared) {
+		__atomic_add_fetch(&bptree->shared->epoch, 1, __ATOMIC_SEQ_CST);
+		_reclaim(bptree, false);
+	}
+}
+
 /*
  * Utility function to give the height of the tree, which is the
  * number of edges of the path from the root to any leaf.
@@ -202,6 +585,11 @@ size_t bptree_get_num_entries(bptree_t *bptree)
 	return bptree->num_entries;
 }
 
+size_t bptree_get_num_tombstones(bptree_t *bptree)
+{
+	return bptree->num_tombstones;
+}
+
 /*
  * Traces the path from the root to a leaf, searching by key.
  * Returns the leaf containing the given key.
@@ -234,6 +622,9 @@ static bptree_node_t *_find_leaf(bptree_t *bptree, const char *key)
 
 /*
  * Looks up and returns the record to which a key refers.
+ *
+ * If the key is found, but it is a tombstone, NULL is returned and
+ * leaf_out, i_out and bkey_out are set to point to the tombstone.
  */
 static bptree_record_t *_find(bptree_t              *bptree,
                               const char            *key,
@@ -330,6 +721,7 @@ static bptree_record_t *_make_record(bptree_t *bptree, void *data, size_t data_s
 	rec->data_size    = data_size;
 	rec->data         = data;
 	rec->ref_count    = 0;
+	rec->version      = 0;
 
 	bptree->meta_size += sizeof(*rec);
 	bptree->data_size += data_size;
@@ -344,7 +736,7 @@ static void _destroy_record(bptree_t *bptree, bptree_record_t *rec)
 	bptree->data_size -= rec->data_size;
 	bptree->num_entries--;
 
-	free(rec);
+	_retire(bptree, rec, RETIRED_RECORD);
 }
 
 static bptree_record_t *_ref_record(bptree_record_t *rec)
@@ -384,8 +776,7 @@ static void _destroy_bkey(bptree_t *bptree, bptree_key_t *bkey)
 {
 	bptree->meta_size -= (sizeof(*bkey) + strlen(bkey->key) + 1);
 
-	free((void *) bkey->key);
-	free(bkey);
+	_retire(bptree, bkey, RETIRED_BKEY);
 }
 
 static bptree_key_t *_ref_bkey(bptree_key_t *bkey)
@@ -433,6 +824,7 @@ static bptree_node_t *_make_node(bptree_t *bptree)
 	new_node->is_leaf  = false;
 	new_node->num_keys = 0;
 	new_node->parent   = NULL;
+	new_node->version  = 0;
 
 	bptree->meta_size  += (sizeof(*new_node) + pointers_size + bkeys_size);
 
@@ -443,9 +835,8 @@ static void _destroy_node(bptree_t *bptree, bptree_node_t *n)
 {
 	bptree->meta_size -= (sizeof(*n) + ((bptree->order - 1) * sizeof(bptree_key_t *)) + (bptree->order * sizeof(void *)));
 
-	free(n->bkeys);
-	free(n->pointers);
-	free(n);
+	_write_node(bptree, n);
+	_retire(bptree, n, RETIRED_NODE);
 }
 
 static bptree_node_t *_make_node_list(bptree_t *bptree, size_t count)
@@ -511,10 +902,12 @@ static int _get_left_index(bptree_node_t *parent, bptree_node_t *left)
  * Inserts a new pointer to a record and its corresponding key into a leaf.
  * Returns the altered leaf.
  */
-static bptree_node_t *_insert_into_leaf(bptree_node_t *leaf, bptree_key_t *bkey, bptree_record_t *pointer)
+static bptree_node_t *_insert_into_leaf(bptree_t *bptree, bptree_node_t *leaf, bptree_key_t *bkey, bptree_record_t *pointer)
 {
 	int i, insertion_point = 0;
 
+	_write_node(bptree, leaf);
+
 	while (insertion_point < leaf->num_keys && strcmp(leaf->bkeys[insertion_point]->key, bkey->key) <= 0) {
 		insertion_point++;
 	}
@@ -548,6 +941,9 @@ static bptree_node_t *_insert_into_leaf_after_splitting(bptree_t        *bptree,
 	new_leaf          = _get_node_from_list(node_list);
 	new_leaf->is_leaf = true;
 
+	_write_node(bptree, leaf);
+	_write_node(bptree, new_leaf);
+
 	insertion_index   = 0;
 	while (insertion_index < bptree->order - 1 && strcmp(leaf->bkeys[insertion_index]->key, bkey->key) <= 0)
 		insertion_index++;
@@ -601,6 +997,8 @@ static bptree_node_t *
 {
 	int i;
 
+	_write_node(bptree, n);
+
 	for (i = n->num_keys; i > left_index; i--) {
 		n->pointers[i + 1] = n->pointers[i];
 		n->bkeys[i]        = n->bkeys[i - 1];
@@ -635,6 +1033,10 @@ static bptree_node_t *_insert_into_node_after_splitting(bptree_t       *bptree,
 	 */
 	split              = _cut(bptree->order);
 	new_node           = _get_node_from_list(node_list);
+
+	_write_node(bptree, old_node);
+	_write_node(bptree, new_node);
+
 	old_node->num_keys = split - 1;
 	new_node->num_keys = bptree->order - split;
 
@@ -708,8 +1110,12 @@ static bptree_node_t *_insert_into_new_root(bptree_t       *bptree,
                                             bptree_key_t   *bkey,
                                             bptree_node_t  *right)
 {
+	_write_lock(bptree, &bptree->root_version);
+
 	bptree->root              = _get_node_from_list(node_list);
 
+	_write_node(bptree, bptree->root);
+
 	bptree->root->bkeys[0]    = _ref_bkey(bkey);
 	bptree->root->pointers[0] = left;
 	bptree->root->pointers[1] = right;
@@ -769,6 +1175,9 @@ static bptree_node_t *_create_root(bptree_t *bptree, bptree_key_t *bkey, bptree_
 		return NULL;
 	leaf->is_leaf                             = true;
 
+	_write_lock(bptree, &bptree->root_version);
+	_write_node(bptree, leaf);
+
 	bptree->root                              = leaf;
 	bptree->root->bkeys[0]                    = _ref_bkey(bkey);
 	bptree->root->pointers[0]                 = _ref_record(pointer);
@@ -779,18 +1188,53 @@ static bptree_node_t *_create_root(bptree_t *bptree, bptree_key_t *bkey, bptree_
 	return bptree->root;
 }
 
+/*
+ * Deletes tombstones from a leaf without restructuring the tree. The last key
+ * in the leaf is always kept so that the copy of it in an internal node
+ * still matches.
+ */
+static void _compact_leaf(bptree_t *bptree, bptree_node_t *leaf)
+{
+	int i, j;
+
+	_write_node(bptree, leaf);
+
+	for (i = 0, j = 0; i < leaf->num_keys; i++) {
+		if (!leaf->pointers[i] && i < leaf->num_keys - 1) {
+			_unref_bkey(bptree, leaf->bkeys[i]);
+			bptree->num_tombstones--;
+			continue;
+		}
+
+		leaf->bkeys[j]    = leaf->bkeys[i];
+		leaf->pointers[j] = leaf->pointers[i];
+		j++;
+	}
+
+	leaf->num_keys = j;
+
+	for (i = leaf->num_keys; i < bptree->order - 1; i++)
+		leaf->pointers[i] = NULL;
+}
+
 static int _insert(bptree_t *bptree, bptree_key_t *bkey, bptree_record_t *rec)
 {
 	bptree_node_t *leaf, *node_list;
 	size_t         count;
 
-	leaf  = _find_leaf(bptree, bkey->key);
+	leaf = _find_leaf(bptree, bkey->key);
+
+	/* Case: leaf is full, but there may be tombstones to make room. */
+
+	if (bptree->num_tombstones && leaf->num_keys == bptree->order - 1)
+		_compact_leaf(bptree, leaf);
+
 	count = _number_of_nodes_needed(bptree, leaf);
 
 	/* Case: leaf has room for key and record pointer. */
 
 	if (count == 0) {
-		_insert_into_leaf(leaf, bkey, rec);
+		_insert_into_leaf(bptree, leaf, bkey, rec);
 		return 0;
 	}
 
@@ -804,21 +1248,37 @@ static int _insert(bptree_t *bptree, bptree_key_t *bkey, bptree_record_t *rec)
 	return 0;
 }
 
-/*
- * Main insertion function.
- * Inserts a key and associated data into the B+ tree, causing the tree
- * to be adjusted however necessary to maintain the B+ tree properties.
- */
-int bptree_insert(bptree_t *bptree, const char *key, void *data, size_t data_size)
+static void _write_record(bptree_t *bptree, bptree_record_t *rec, void *data, size_t data_size)
+{
+	_write_lock(bptree, &rec->version);
+
+	rec->data         = data;
+	bptree->data_size -= rec->data_size;
+	rec->data_size    = data_size;
+	bptree->data_size += rec->data_size;
+}
+
+static int _insert_key(bptree_t *bptree, const char *key, void *data, size_t data_size)
 {
 	bptree_record_t *rec;
+	bptree_node_t   *leaf;
 	bptree_key_t    *bkey;
+	int              i;
+
+	if ((rec = _find(bptree, key, LOOKUP_EXACT, &leaf, &i, &bkey))) {
+		_write_record(bptree, rec, data, data_size);
+		return 0;
+	}
 
-	if ((rec = _find(bptree, key, LOOKUP_EXACT, NULL, NULL, NULL))) {
-		rec->data         = data;
-		bptree->data_size -= rec->data_size;
-		rec->data_size    = data_size;
-		bptree->data_size += rec->data_size;
+	/* Case: the key is a tombstone. Reuse it. */
+
+	if (bkey) {
+		if (!(rec = _make_record(bptree, data, data_size)))
+			return -1;
+
+		_write_node(bptree, leaf);
+		leaf->pointers[i] = _ref_record(rec);
+		bptree->num_tombstones--;
 		return 0;
 	}
 
@@ -853,7 +1313,25 @@ int bptree_insert(bptree_t *bptree, const char *key, void *data, size_t data_siz
 	return 0;
 }
 
-int bptree_insert_alias(bptree_t *bptree, const char *key, const char *alias, bool force)
+/*
+ * Main insertion function.
+ * Inserts a key and associated data into the B+ tree, causing the tree
+ * to be adjusted however necessary to maintain the B+ tree properties.
+ */
+int bptree_insert(bptree_t *bptree, const char *key, void *data, size_t data_size)
+{
+	int r;
+
+	if (_write_begin(bptree) < 0)
+		return -1;
+
+	r = _insert_key(bptree, key, data, data_size);
+
+	_write_end(bptree);
+	return r;
+}
+
+static int _insert_alias(bptree_t *bptree, const char *key, const char *alias, bool force)
 {
 	bptree_record_t *rec;
 	bptree_record_t *rec_alias;
@@ -864,17 +1342,27 @@ int bptree_insert_alias(bptree_t *bptree, const char *key, const char *alias, bo
 	if (!(rec = _find(bptree, key, LOOKUP_EXACT, NULL, NULL, NULL)))
 		return -1;
 
-	if ((rec_alias = _find(bptree, alias, LOOKUP_EXACT, &leaf, &i, NULL))) {
+	if ((rec_alias = _find(bptree, alias, LOOKUP_EXACT, &leaf, &i, &bkey))) {
 		if (rec != rec_alias) {
 			if (!force)
 				return -1;
 
+			_write_node(bptree, leaf);
 			leaf->pointers[i] = _ref_record(rec);
 			_unref_record(bptree, rec_alias);
 		}
 		return 0;
 	}
 
+	/* Case: the alias is a tombstone. Reuse it. */
+
+	if (bkey) {
+		_write_node(bptree, leaf);
+		leaf->pointers[i] = _ref_record(rec);
+		bptree->num_tombstones--;
+		return 0;
+	}
+
 	if (!(bkey = _make_bkey(bptree, alias)))
 		return -1;
 
@@ -886,20 +1374,49 @@ int bptree_insert_alias(bptree_t *bptree, const char *key, const char *alias, bo
 	return 0;
 }
 
-int bptree_update(bptree_t             *bptree,
-                  const char           *key,
-                  void                **data,
-                  size_t               *data_size,
-                  bptree_update_cb_fn_t bptree_update_fn,
-                  void                 *bptree_update_fn_arg)
+int bptree_insert_alias(bptree_t *bptree, const char *key, const char *alias, bool force)
+{
+	int r;
+
+	if (_write_begin(bptree) < 0)
+		return -1;
+
+	r = _insert_alias(bptree, key, alias, force);
+
+	_write_end(bptree);
+	return r;
+}
+
+/*
+ * Removes the entry at index i in the leaf, or turns it into a tombstone
+ * in lazy removal mode.
+ */
+static void _remove(bptree_t *bptree, bptree_node_t *leaf, int i, bptree_key_t *bkey, bptree_record_t *rec)
+{
+	if (bptree->lazy_remove) {
+		_write_node(bptree, leaf);
+		leaf->pointers[i] = NULL;
+		bptree->num_tombstones++;
+	} else
+		(void) _delete_entry(bptree, leaf, bkey, rec);
+
+	_unref_record(bptree, rec);
+}
+
+static int _update(bptree_t             *bptree,
+                   const char           *key,
+                   void                **data,
+                   size_t               *data_size,
+                   bptree_update_cb_fn_t bptree_update_fn,
+                   void                 *bptree_update_fn_arg)
 {
 	bptree_node_t         *key_leaf;
 	bptree_record_t       *rec;
 	bptree_key_t          *bkey;
 	bptree_update_action_t act;
-	int                    r;
+	int                    i, r;
 
-	rec = _find(bptree, key, LOOKUP_EXACT, &key_leaf, NULL, &bkey);
+	rec = _find(bptree, key, LOOKUP_EXACT, &key_leaf, &i, &bkey);
 
 	if (bptree_update_fn) {
 		if (rec)
@@ -922,20 +1439,15 @@ int bptree_update(bptree_t             *bptree,
 	switch (act) {
 		case BPTREE_UPDATE_WRITE:
 			if (rec) {
-				rec->data         = data ? *data : NULL;
-				bptree->data_size -= rec->data_size;
-				rec->data_size    = data_size ? *data_size : 0;
-				bptree->data_size += rec->data_size;
-				r                 = 0;
+				_write_record(bptree, rec, data ? *data : NULL, data_size ? *data_size : 0);
+				r = 0;
 			} else
-				r = bptree_insert(bptree, key, data ? *data : NULL, data_size ? *data_size : 0);
+				r = _insert_key(bptree, key, data ? *data : NULL, data_size ? *data_size : 0);
 			break;
 
 		case BPTREE_UPDATE_REMOVE:
-			if (rec && key_leaf) {
-				(void) _delete_entry(bptree, key_leaf, bkey, rec);
-				_unref_record(bptree, rec);
-			}
+			if (rec && key_leaf)
+				_remove(bptree, key_leaf, i, bkey, rec);
 			r = 0;
 			break;
 
@@ -947,6 +1459,24 @@ int bptree_update(bptree_t             *bptree,
 	return r;
 }
 
+int bptree_update(bptree_t             *bptree,
+                  const char           *key,
+                  void                **data,
+                  size_t               *data_size,
+                  bptree_update_cb_fn_t bptree_update_fn,
+                  void                 *bptree_update_fn_arg)
+{
+	int r;
+
+	if (_write_begin(bptree) < 0)
+		return -1;
+
+	r = _update(bptree, key, data, data_size, bptree_update_fn, bptree_update_fn_arg);
+
+	_write_end(bptree);
+	return r;
+}
+
 /*
  * Utility function for deletion.
  * Retrieves the index of a node's nearest neighbor (sibling) to the left
@@ -972,17 +1502,32 @@ static int _get_neighbor_index(bptree_node_t *n)
 
 static bptree_node_t *_remove_entry_from_node(bptree_t *bptree, bptree_node_t *n, bptree_key_t *bkey, bptree_node_t *pointer)
 {
-	int           i            = 0, num_pointers;
+	int           i            = 0, key_index, num_pointers;
 	bptree_key_t *swapped_bkey = NULL;
 
+	_write_node(bptree, n);
+
 	/* Remove the key and shift other keys accordingly. */
 	while (n->bkeys[i] != bkey)
 		i++;
 
-	/* if the last key in a leaf is deleted, swap it out for the previous
-	 * key, in the internal nodes */
-	if (n->is_leaf && i == n->num_keys - 1)
-		swapped_bkey = n->bkeys[i - 1];
+	key_index = i;
+
+	/*
+	 * If the last key in a leaf is deleted, swap it out for the previous
+	 * key, in the internal nodes. If it is the only key in the leaf, the
+	 * previous key is the last key of the left neighbor, which is the key
+	 * in the parent just before the pointer to this leaf. If there's no
+	 * left neighbor, the leaf will be coalesced with the right neighbor
+	 * and the key is removed from the parent then.
+	 */
+	if (n->is_leaf && i == n->num_keys - 1) {
+		if (i > 0)
+			swapped_bkey = n->bkeys[i - 1];
+		else if (n->parent && (i = _get_left_index(n->parent, n)) > 0)
+			swapped_bkey = n->parent->bkeys[i - 1];
+		i = key_index;
+	}
 
 	_unref_bkey(bptree, bkey);
 
@@ -991,13 +1536,18 @@ static bptree_node_t *_remove_entry_from_node(bptree_t *bptree, bptree_node_t *n
 
 	/*
 	 * Remove the pointer and shift other pointers accordingly.
-	 * First determine number of pointers.
+	 * First determine number of pointers. In a leaf, the pointer
+	 * has the same index as the key (it may be NULL for a tombstone).
 	 */
 	num_pointers = n->is_leaf ? n->num_keys : n->num_keys + 1;
-	i            = 0;
 
-	while (n->pointers[i] != pointer)
-		i++;
+	if (n->is_leaf)
+		i = key_index;
+	else {
+		i = 0;
+		while (n->pointers[i] != pointer)
+			i++;
+	}
 
 	for (++i; i < num_pointers; i++)
 		n->pointers[i - 1] = n->pointers[i];
@@ -1022,6 +1572,7 @@ static bptree_node_t *_remove_entry_from_node(bptree_t *bptree, bptree_node_t *n
 		for (p = n->parent; p; p = p->parent) {
 			for (i = 0; i < p->num_keys; i++) {
 				if (p->bkeys[i] == bkey) {
+					_write_node(bptree, p);
 					_unref_bkey(bptree, bkey);
 					p->bkeys[i] = _ref_bkey(swapped_bkey);
 					goto out;
@@ -1047,6 +1598,8 @@ static bptree_node_t *_adjust_root(bptree_t *bptree)
 
 	/* Case: empty root. */
 
+	_write_lock(bptree, &bptree->root_version);
+
 	/* If it has a child, promote the first (only) child as the new root. */
 
 	if (!bptree->root->is_leaf) {
@@ -1086,6 +1639,9 @@ static bptree_node_t *
 		neighbor = tmp;
 	}
 
+	_write_node(bptree, n);
+	_write_node(bptree, neighbor);
+
 	/*
 	 * Starting point in the neighbor for copying keys and pointers
 	 * from n. Recall that n and neighbor have swapped places in the
@@ -1163,6 +1719,10 @@ static bptree_node_t *_redistribute_nodes(bptree_t      *bptree,
 {
 	int i;
 
+	_write_node(bptree, n);
+	_write_node(bptree, neighbor);
+	_write_node(bptree, n->parent);
+
 	/*
 	 * Case: n has a neighbor to the left.
 	 * Pull the neighbor's last key-pointer pair over
@@ -1265,7 +1825,7 @@ static bptree_node_t *_delete_entry(bptree_t *bptree, bptree_node_t *n, bptree_k
 	 * after deletion.
 	 */
 
-	min_keys = n->is_leaf ? _cut(bptree->order - 1) : _cut(bptree->order) - 1;
+	min_keys = n->is_leaf ? bptree->min_leaf_keys : bptree->min_node_keys;
 
 	/*
 	 * Case: node stays at or above minimum. (The simple case.)
@@ -1312,13 +1872,19 @@ int bptree_remove(bptree_t *bptree, const char *key)
 	bptree_record_t *rec      = NULL;
 	bptree_key_t    *bkey     = NULL;
 
-	rec                       = _find(bptree, key, LOOKUP_EXACT, &key_leaf, NULL, &bkey);
+	int              i;
+
+	rec = _find(bptree, key, LOOKUP_EXACT, &key_leaf, &i, &bkey);
 
 	/* CHANGE */
 
 	if (rec && key_leaf) {
-		(void) _delete_entry(bptree, key_leaf, bkey, rec);
-		_unref_record(bptree, rec);
+		if (_write_begin(bptree) < 0)
+			return -1;
+
+		_remove(bptree, key_leaf, i, bkey, rec);
+
+		_write_end(bptree);
 	}
 
 	return 0;
@@ -1331,12 +1897,13 @@ static void _destroy_tree_nodes(bptree_t *bptree, bptree_node_t *n, bptree_itera
 
 	if (n->is_leaf) {
 		for (i = 0; i < n->num_keys; i++) {
-			if (fn) {
-				rec = n->pointers[i];
-				fn(n->bkeys[i]->key, rec->data, rec->data_size, rec->ref_count, fn_arg);
-			}
+			if ((rec = n->pointers[i])) {
+				if (fn)
+					fn(n->bkeys[i]->key, rec->data, rec->data_size, rec->ref_count, fn_arg);
+				_unref_record(bptree, rec);
+			} else
+				bptree->num_tombstones--;
 			_unref_bkey(bptree, n->bkeys[i]);
-			_unref_record(bptree, n->pointers[i]);
 		}
 	} else {
 		for (i = 0; i < n->num_keys + 1; i++) {
@@ -1351,6 +1918,8 @@ static void _destroy_tree_nodes(bptree_t *bptree, bptree_node_t *n, bptree_itera
 
 int bptree_destroy(bptree_t *bptree)
 {
+	if (bptree->shared)
+		_free_shared(bptree);
 	if (bptree->root)
 		_destroy_tree_nodes(bptree, bptree->root, NULL, NULL);
 	free(bptree);
@@ -1359,6 +1928,8 @@ int bptree_destroy(bptree_t *bptree)
 
 int bptree_destroy_with_fn(bptree_t *bptree, bptree_iterate_fn_t fn, void *fn_arg)
 {
+	if (bptree->shared)
+		_free_shared(bptree);
 	if (bptree->root)
 		_destroy_tree_nodes(bptree, bptree->root, fn, fn_arg);
 	free(bptree);
@@ -1378,6 +1949,95 @@ static bptree_node_t *_get_first_leaf_node(bptree_t *bptree)
 	return c;
 }
 
+/*
+ * Deletes all tombstones, restructuring the tree as needed.
+ */
+int bptree_compact(bptree_t *bptree)
+{
+	bptree_key_t **bkeys;
+	bptree_node_t *leaf;
+	size_t         count = 0, j;
+	int            i;
+
+	if (!bptree->num_tombstones)
+		return 0;
+
+	/*
+	 * Deleting an entry may move other entries between leaves so
+	 * collect the tombstones first and then delete them one by one.
+	 */
+	if (!(bkeys = malloc(bptree->num_tombstones * sizeof(bptree_key_t *))))
+		return -1;
+
+	for (leaf = _get_first_leaf_node(bptree); leaf; leaf = leaf->pointers[bptree->order - 1]) {
+		for (i = 0; i < leaf->num_keys; i++) {
+			if (!leaf->pointers[i])
+				bkeys[count++] = _ref_bkey(leaf->bkeys[i]);
+		}
+	}
+
+	assert(count == bptree->num_tombstones);
+
+	for (j = 0; j < count; j++) {
+		if (_write_begin(bptree) < 0)
+			break;
+
+		leaf = _find_leaf(bptree, bkeys[j]->key);
+		(void) _delete_entry(bptree, leaf, bkeys[j], NULL);
+		bptree->num_tombstones--;
+		_unref_bkey(bptree, bkeys[j]);
+
+		_write_end(bptree);
+	}
+
+	/* Out of memory in concurrent mode - the rest stays as tombstones. */
+	for (i = j; (size_t) i < count; i++)
+		_unref_bkey(bptree, bkeys[i]);
+
+	free(bkeys);
+	return j == count ? 0 : -1;
+}
+
+/*
+ * Finds the first key which is not lower than the prefix, comparing only the
+ * first 'prefix_len' characters. Internal node keys are copies of the last key
+ * of the left subtree so if such a key starts with the prefix, the first key
+ * with that prefix is found in the left subtree.
+ */
+static void _find_prefix(bptree_t *bptree, const char *prefix, size_t prefix_len, bptree_node_t **leaf_out, int *i_out)
+{
+	bptree_node_t *c;
+	int            i;
+
+	if (!(c = bptree->root)) {
+		*leaf_out = NULL;
+		*i_out    = 0;
+		return;
+	}
+
+	while (!c->is_leaf) {
+		i = 0;
+
+		while (i < c->num_keys && strncmp(c->bkeys[i]->key, prefix, prefix_len) < 0)
+			i++;
+
+		c = (bptree_node_t *) c->pointers[i];
+	}
+
+	i = 0;
+
+	while (i < c->num_keys && strncmp(c->bkeys[i]->key, prefix, prefix_len) < 0)
+		i++;
+
+	if (i == c->num_keys) {
+		c = c->pointers[bptree->order - 1];
+		i = 0;
+	}
+
+	*leaf_out = c;
+	*i_out    = i;
+}
+
 bptree_iter_t *bptree_iter_create(bptree_t *bptree, const char *key_start, const char *key_end)
 {
 	bptree_iter_t *iter;
@@ -1385,11 +2045,26 @@ bptree_iter_t *bptree_iter_create(bptree_t *bptree, const char *key_start, const
 	if (!(iter = malloc(sizeof(bptree_iter_t))))
 		return NULL;
 
-	iter->bptree    = bptree;
-	iter->key_start = key_start;
-	iter->key_end   = key_end;
-	iter->c         = NULL;
-	iter->i         = 0;
+	iter->bptree     = bptree;
+	iter->key_start  = key_start;
+	iter->key_end    = key_end;
+	iter->prefix     = NULL;
+	iter->prefix_len = 0;
+	iter->c          = NULL;
+	iter->i          = 0;
+
+	return iter;
+}
+
+bptree_iter_t *bptree_iter_create_prefix(bptree_t *bptree, const char *prefix, size_t prefix_len)
+{
+	bptree_iter_t *iter;
+
+	if (!(iter = bptree_iter_create(bptree, NULL, NULL)))
+		return NULL;
+
+	iter->prefix     = prefix;
+	iter->prefix_len = prefix ? prefix_len : 0;
 
 	return iter;
 }
@@ -1403,6 +2078,16 @@ void *bptree_iter_current(bptree_iter_t *iter, const char **key, size_t *data_si
 
 		if (key)
 			*key = iter->c->bkeys[iter->i]->key;
+
+		/* the current entry may have been removed in lazy removal mode */
+		if (!rec) {
+			if (data_size)
+				*data_size = 0;
+			if (data_ref_count)
+				*data_ref_count = 0;
+			return NULL;
+		}
+
 		if (data_size)
 			*data_size = rec->data_size;
 		if (data_ref_count)
@@ -1429,6 +2114,18 @@ const char *bptree_iter_current_key(bptree_iter_t *iter)
 		return NULL;
 }
 
+static void _iter_skip_tombstones(bptree_iter_t *iter)
+{
+	while (iter->c && !iter->c->pointers[iter->i]) {
+		if (iter->i < (iter->c->num_keys - 1))
+			iter->i++;
+		else {
+			iter->c = iter->c->pointers[iter->bptree->order - 1];
+			iter->i = 0;
+		}
+	}
+}
+
 void *bptree_iter_next(bptree_iter_t *iter, const char **key, size_t *data_size, unsigned *data_ref_count)
 {
 	if (iter->c) {
@@ -1439,7 +2136,9 @@ void *bptree_iter_next(bptree_iter_t *iter, const char **key, size_t *data_size,
 			iter->i = 0;
 		}
 	} else {
-		if (iter->key_start)
+		if (iter->prefix_len)
+			_find_prefix(iter->bptree, iter->prefix, iter->prefix_len, &iter->c, &iter->i);
+		else if (iter->key_start)
 			(void) _find(iter->bptree, iter->key_start, LOOKUP_PREFIX, &iter->c, &iter->i, NULL);
 		else {
 			iter->c = _get_first_leaf_node(iter->bptree);
@@ -1447,7 +2146,10 @@ void *bptree_iter_next(bptree_iter_t *iter, const char **key, size_t *data_size,
 		}
 	}
 
-	if (iter->key_end && iter->c && strcmp(iter->c->bkeys[iter->i]->key, iter->key_end) > 0) {
+	_iter_skip_tombstones(iter);
+
+	if (iter->c && ((iter->key_end && strcmp(iter->c->bkeys[iter->i]->key, iter->key_end) > 0) ||
+	                (iter->prefix_len && strncmp(iter->c->bkeys[iter->i]->key, iter->prefix, iter->prefix_len)))) {
 		iter->c = NULL;
 		iter->i = 0;
 	}
@@ -1457,15 +2159,30 @@ void *bptree_iter_next(bptree_iter_t *iter, const char **key, size_t *data_size,
 
 void bptree_iter_reset(bptree_iter_t *iter, const char *key_start, const char *key_end)
 {
-	iter->c         = NULL;
-	iter->i         = 0;
-	iter->key_start = key_start;
-	iter->key_end   = key_end;
+	iter->c          = NULL;
+	iter->i          = 0;
+	iter->key_start  = key_start;
+	iter->key_end    = key_end;
+	iter->prefix     = NULL;
+	iter->prefix_len = 0;
+}
+
+void bptree_iter_reset_prefix(bptree_iter_t *iter, const char *prefix, size_t prefix_len)
+{
+	bptree_iter_reset(iter, NULL, NULL);
+	iter->prefix     = prefix;
+	iter->prefix_len = prefix ? prefix_len : 0;
 }
 
 void bptree_iter(bptree_t *bptree, const char *key_start, const char *key_end, bptree_iterate_fn_t fn, void *fn_arg)
 {
-	bptree_iter_t iter = {.bptree = bptree, .key_start = key_start, .key_end = key_end, .c = NULL, .i = 0};
+	bptree_iter_t iter = {.bptree     = bptree,
+	                      .key_start  = key_start,
+	                      .key_end    = key_end,
+	                      .prefix     = NULL,
+	                      .prefix_len = 0,
+	                      .c          = NULL,
+	                      .i          = 0};
 	const char   *key;
 	void         *data;
 	size_t        data_size;
@@ -1485,3 +2202,249 @@ void bptree_iter_destroy(bptree_iter_t *iter)
 {
 	free(iter);
 }
+
+bptree_reader_t *bptree_reader_create(bptree_t *bptree)
+{
+	bptree_shared_t *shared = bptree->shared;
+	bptree_reader_t *reader;
+	int              i;
+
+	if (!shared)
+		return NULL;
+
+	for (i = 0; i < BPTREE_MAX_READERS; i++) {
+		reader = &shared->readers[i];
+
+		if (!__atomic_exchange_n(&reader->used, true, __ATOMIC_ACQ_REL)) {
+			reader->bptree = bptree;
+			__atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+			return reader;
+		}
+	}
+
+	return NULL;
+}
+
+void bptree_reader_destroy(bptree_reader_t *reader)
+{
+	__atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&reader->used, false, __ATOMIC_RELEASE);
+}
+
+void bptree_read_begin(bptree_reader_t *reader)
+{
+	uint64_t epoch = __atomic_load_n(&reader->bptree->shared->epoch, __ATOMIC_SEQ_CST);
+
+	/*
+	 * The writer must see the reader's epoch before the reader
+	 * reads anything from the tree, otherwise it may free items
+	 * which the reader is about to access.
+	 */
+	__atomic_store_n(&reader->epoch, epoch, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void bptree_read_end(bptree_reader_t *reader)
+{
+	__atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Waits until the version is even (no change in progress) and returns it.
+ */
+static unsigned _read_version(unsigned *version)
+{
+	unsigned v;
+
+	while ((v = __atomic_load_n(version, __ATOMIC_ACQUIRE)) & 1)
+		;
+
+	return v;
+}
+
+/*
+ * Checks that nothing changed since the version was read.
+ */
+static bool _read_validate(unsigned *version, unsigned v)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(version, __ATOMIC_RELAXED) == v;
+}
+
+/*
+ * Copies a node for a reader. Returns false if the node changed while copying.
+ */
+static bool _read_node(bptree_t *bptree, bptree_node_t *n, bptree_node_copy_t *copy)
+{
+	int i, num_pointers;
+
+	copy->version  = _read_version(&n->version);
+	copy->is_leaf  = __atomic_load_n(&n->is_leaf, __ATOMIC_RELAXED);
+	copy->num_keys = __atomic_load_n(&n->num_keys, __ATOMIC_RELAXED);
+
+	/* torn read, the version check would fail anyway */
+	if (copy->num_keys < 0 || copy->num_keys > bptree->order - 1)
+		return false;
+
+	for (i = 0; i < copy->num_keys; i++)
+		copy->bkeys[i] = __atomic_load_n(&n->bkeys[i], __ATOMIC_RELAXED);
+
+	num_pointers = copy->is_leaf ? copy->num_keys : copy->num_keys + 1;
+
+	for (i = 0; i < num_pointers; i++)
+		copy->pointers[i] = __atomic_load_n(&n->pointers[i], __ATOMIC_RELAXED);
+
+	copy->next = copy->is_leaf ? __atomic_load_n(&n->pointers[bptree->order - 1], __ATOMIC_RELAXED) : NULL;
+
+	return _read_validate(&n->version, copy->version);
+}
+
+static void *_read_record(bptree_record_t *rec, size_t *data_size, unsigned *data_ref_count)
+{
+	void    *data;
+	size_t   size;
+	unsigned ref_count, v;
+
+	do {
+		v         = _read_version(&rec->version);
+		data      = __atomic_load_n(&rec->data, __ATOMIC_RELAXED);
+		size      = __atomic_load_n(&rec->data_size, __ATOMIC_RELAXED);
+		ref_count = __atomic_load_n(&rec->ref_count, __ATOMIC_RELAXED);
+	} while (!_read_validate(&rec->version, v));
+
+	if (data_size)
+		*data_size = size;
+	if (data_ref_count)
+		*data_ref_count = ref_count;
+
+	return data;
+}
+
+/*
+ * Reader's version of _find_leaf. Copies the leaf which may contain
+ * the key or the leftmost leaf if key is NULL. Returns NULL if the tree is empty.
+ */
+static bptree_node_t *_reader_find_leaf(bptree_t *bptree, const char *key, bptree_node_copy_t *copy)
+{
+	bptree_node_t *c, *parent;
+	unsigned       v;
+	int            i;
+
+restart:
+	v = _read_version(&bptree->root_version);
+
+	if (!(c = __atomic_load_n(&bptree->root, __ATOMIC_RELAXED))) {
+		if (!_read_validate(&bptree->root_version, v))
+			goto restart;
+		return NULL;
+	}
+
+	if (!_read_node(bptree, c, copy) || !_read_validate(&bptree->root_version, v))
+		goto restart;
+
+	while (!copy->is_leaf) {
+		i = 0;
+
+		if (key) {
+			while (i < copy->num_keys && strcmp(key, copy->bkeys[i]->key) > 0)
+				i++;
+		}
+
+		parent = c;
+		v      = copy->version;
+		c      = copy->pointers[i];
+
+		/* the child is still linked only if the parent did not change meanwhile */
+		if (!_read_node(bptree, c, copy) || !_read_validate(&parent->version, v))
+			goto restart;
+	}
+
+	return c;
+}
+
+/*
+ * Looks up and returns the data to which a key refers. Must be called
+ * between bptree_read_begin and bptree_read_end.
+ */
+void *bptree_reader_lookup(bptree_reader_t *reader, const char *key, size_t *data_size, unsigned *data_ref_count)
+{
+	bptree_node_copy_t leaf;
+	bptree_record_t   *rec = NULL;
+	int                i;
+
+	if (_reader_find_leaf(reader->bptree, key, &leaf)) {
+		for (i = 0; i < leaf.num_keys; i++) {
+			if (!strcmp(key, leaf.bkeys[i]->key)) {
+				rec = leaf.pointers[i];
+				break;
+			}
+		}
+	}
+
+	if (!rec)
+		return NULL;
+
+	return _read_record(rec, data_size, data_ref_count);
+}
+
+/*
+ * Calls fn for each key between key_start and key_end (both inclusive,
+ * NULL for no limit) in ascending order. Must be called between
+ * bptree_read_begin and bptree_read_end. This is not a snapshot
+ * of the whole tree - each entry is read consistently, but entries
+ * changed by the writer meanwhile may be seen either way.
+ */
+void bptree_reader_iter(bptree_reader_t    *reader,
+                        const char         *key_start,
+                        const char         *key_end,
+                        bptree_iterate_fn_t fn,
+                        void               *fn_arg)
+{
+	bptree_t           *bptree = reader->bptree;
+	bptree_node_copy_t  copies[2], *leaf, *next;
+	bptree_node_t      *c, *n;
+	bptree_record_t    *rec;
+	const char         *key, *last = NULL;
+	void               *data;
+	size_t              data_size;
+	unsigned            data_ref_count;
+	int                 i;
+
+restart:
+	leaf = &copies[0];
+	next = &copies[1];
+
+	/* continue after the last key passed to fn if the leaf changed */
+	if (!(c = _reader_find_leaf(bptree, last ? last : key_start, leaf)))
+		return;
+
+	while (true) {
+		for (i = 0; i < leaf->num_keys; i++) {
+			key = leaf->bkeys[i]->key;
+
+			if (last ? strcmp(key, last) <= 0 : key_start && strcmp(key, key_start) < 0)
+				continue;
+
+			if (key_end && strcmp(key, key_end) > 0)
+				return;
+
+			if (!(rec = leaf->pointers[i]))
+				continue;
+
+			data = _read_record(rec, &data_size, &data_ref_count);
+			fn(key, data, data_size, data_ref_count, fn_arg);
+			last = key;
+		}
+
+		if (!(n = leaf->next))
+			return;
+
+		/* the next leaf is still the right one only if the current leaf did not change meanwhile */
+		if (!_read_node(bptree, n, next) || !_read_validate(&c->version, leaf->version))
+			goto restart;
+
+		c    = n;
+		leaf = next;
+		next = leaf == &copies[0] ? &copies[1] : &copies[0];
+	}
+}
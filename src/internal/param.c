@@ -0,0 +1,550 @@
+/*
+ * This file is part of SID.
+ *
+ * Copyright (C) 2024 Red Hat, Inc. All rights reserved.
+ *
+ * SID is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SID is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SID.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "internal/param.h"
+
+#include "internal/mem.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PARAM_FILE_LIST_ALLOC_STEP 256
+
+struct param {
+	struct param_spec spec;
+	uint64_t          value;
+	uint64_t          new_value; /* value to set, valid only if 'pending' is set */
+	char             *str;       /* value of PARAM_TYPE_STR parameter */
+	char             *new_str;   /* value to set for PARAM_TYPE_STR parameter, valid only if 'pending' is set */
+	bool              pending;
+};
+
+struct param_registry {
+	struct param *params;
+	unsigned      nr_params;
+	bool          running;
+};
+
+static const char * const _type_names[] = {
+	[PARAM_TYPE_BOOL] = "bool",
+	[PARAM_TYPE_UINT] = "uint",
+	[PARAM_TYPE_STR]  = "str",
+};
+
+struct param_registry *param_registry_create(void)
+{
+	return mem_zalloc(sizeof(struct param_registry));
+}
+
+void param_registry_destroy(struct param_registry *reg)
+{
+	unsigned i;
+
+	if (!reg)
+		return;
+
+	for (i = 0; i < reg->nr_params; i++) {
+		free((void *) reg->params[i].spec.name);
+		free((void *) reg->params[i].spec.def_str);
+		free(reg->params[i].str);
+	}
+
+	free(reg->params);
+	free(reg);
+}
+
+static struct param *_find_param(struct param_registry *reg, const char *name, size_t name_len)
+{
+	unsigned i;
+
+	for (i = 0; i < reg->nr_params; i++) {
+		if (!strncmp(reg->params[i].spec.name, name, name_len) && !reg->params[i].spec.name[name_len])
+			return &reg->params[i];
+	}
+
+	return NULL;
+}
+
+int param_register(struct param_registry *reg, const struct param_spec *spec)
+{
+	struct param *params;
+	struct param *param;
+	const char   *def_str = NULL;
+	uint64_t      min, max;
+
+	if (!reg || !spec || !spec->name || !*spec->name || strchr(spec->name, '='))
+		return -EINVAL;
+
+	if (_find_param(reg, spec->name, strlen(spec->name)))
+		return -EEXIST;
+
+	if (spec->type == PARAM_TYPE_BOOL) {
+		min = 0;
+		max = 1;
+	} else if (spec->type == PARAM_TYPE_STR) {
+		min     = 0;
+		max     = spec->max;
+		def_str = spec->def_str ?: "";
+		if (strlen(def_str) > max)
+			return -ERANGE;
+	} else {
+		min = spec->min;
+		max = spec->max;
+	}
+
+	if (min > max || (!def_str && (spec->def < min || spec->def > max)))
+		return -ERANGE;
+
+	if (!(params = realloc(reg->params, (reg->nr_params + 1) * sizeof(struct param))))
+		return -ENOMEM;
+	reg->params         = params;
+
+	param               = &reg->params[reg->nr_params];
+	param->spec         = *spec;
+	param->spec.min     = min;
+	param->spec.max     = max;
+	param->spec.def_str = NULL;
+	param->value        = spec->def;
+	param->new_value    = spec->def;
+	param->str          = NULL;
+	param->new_str      = NULL;
+	param->pending      = false;
+
+	if (!(param->spec.name = strdup(spec->name)))
+		return -ENOMEM;
+
+	if (def_str) {
+		if (!(param->spec.def_str = strdup(def_str)) || !(param->str = strdup(def_str))) {
+			free((void *) param->spec.name);
+			free((void *) param->spec.def_str);
+			return -ENOMEM;
+		}
+	}
+
+	reg->nr_params++;
+	return 0;
+}
+
+void param_registry_set_running(struct param_registry *reg)
+{
+	reg->running = true;
+}
+
+int param_get(struct param_registry *reg, const char *name, uint64_t *value)
+{
+	struct param *param;
+
+	if (!reg || !name || !value)
+		return -EINVAL;
+
+	if (!(param = _find_param(reg, name, strlen(name))))
+		return -ENOENT;
+
+	if (param->spec.type == PARAM_TYPE_STR)
+		return -EINVAL;
+
+	*value = param->value;
+	return 0;
+}
+
+int param_get_str(struct param_registry *reg, const char *name, const char **value)
+{
+	struct param *param;
+
+	if (!reg || !name || !value)
+		return -EINVAL;
+
+	if (!(param = _find_param(reg, name, strlen(name))))
+		return -ENOENT;
+
+	if (param->spec.type != PARAM_TYPE_STR)
+		return -EINVAL;
+
+	*value = param->str;
+	return 0;
+}
+
+static int _parse_value(struct param *param, const char *str, uint64_t *value)
+{
+	unsigned long long val;
+	char              *p;
+
+	/* strtoull accepts sign and leading space, we don't */
+	if (!isdigit((unsigned char) *str))
+		return -EINVAL;
+
+	errno = 0;
+	val   = strtoull(str, &p, 10);
+	if (errno || *p)
+		return -EINVAL;
+
+	if (val < param->spec.min || val > param->spec.max)
+		return -ERANGE;
+
+	*value = val;
+	return 0;
+}
+
+static int _parse_str(struct param *param, const char *str, size_t len, char **value)
+{
+	if (len > param->spec.max)
+		return -ERANGE;
+
+	if (!(*value = strndup(str, len)))
+		return -ENOMEM;
+
+	return 0;
+}
+
+static bool _changed(struct param *param)
+{
+	if (param->spec.type == PARAM_TYPE_STR)
+		return strcmp(param->new_str, param->str) != 0;
+
+	return param->new_value != param->value;
+}
+
+/*
+ * Iterate over '\0'-terminated items in 'list', returning the next item and its length
+ * or NULL at the end of the list. The 'list_size' may include the last '\0' or not.
+ */
+static const char *_next_item(const char *list, size_t list_size, size_t *pos, size_t *len)
+{
+	const char *item;
+
+	while (*pos < list_size && !list[*pos])
+		(*pos)++;
+
+	if (*pos >= list_size)
+		return NULL;
+
+	item  = list + *pos;
+	*len  = strnlen(item, list_size - *pos);
+	*pos += *len + 1;
+
+	return item;
+}
+
+static void _rollback(struct param_registry *reg, unsigned count)
+{
+	struct param *param;
+
+	while (count--) {
+		param = &reg->params[count];
+		if (param->pending && _changed(param) && param->spec.apply)
+			(void) param->spec.apply(param->spec.name, param->value, param->str, param->spec.arg);
+	}
+}
+
+int param_set(struct param_registry *reg, const char *list, size_t list_size, const char **failed)
+{
+	struct param *param;
+	const char   *item, *eq;
+	char          str[32];
+	size_t        pos = 0, len;
+	unsigned      i;
+	int           r   = 0;
+
+	if (failed)
+		*failed = NULL;
+
+	if (!reg || (!list && list_size))
+		return -EINVAL;
+
+	/* validate the whole batch first */
+	while ((item = _next_item(list, list_size, &pos, &len))) {
+		if (!(eq = memchr(item, '=', len)) || !(param = _find_param(reg, item, eq - item))) {
+			r = eq ? -ENOENT : -EINVAL;
+			if (failed)
+				*failed = item;
+			goto out;
+		}
+
+		if (failed)
+			*failed = param->spec.name;
+
+		len -= eq - item + 1;
+
+		if (param->spec.type == PARAM_TYPE_STR) {
+			/* the same parameter may be repeated in the batch, the last one wins */
+			free(param->new_str);
+			param->new_str = NULL;
+			if ((r = _parse_str(param, eq + 1, len, &param->new_str)) < 0)
+				goto out;
+		} else {
+			if (len >= sizeof(str)) {
+				r = -EINVAL;
+				goto out;
+			}
+
+			memcpy(str, eq + 1, len);
+			str[len] = '\0';
+
+			if ((r = _parse_value(param, str, &param->new_value)) < 0)
+				goto out;
+		}
+
+		if (reg->running && !(param->spec.flags & PARAM_FL_HOT) && _changed(param)) {
+			r = -EPERM;
+			goto out;
+		}
+
+		param->pending = true;
+	}
+
+	/* now apply, reverting changes already applied if any of the subsystems fails */
+	if (reg->running) {
+		for (i = 0; i < reg->nr_params; i++) {
+			param = &reg->params[i];
+
+			if (!param->pending || !_changed(param) || !param->spec.apply)
+				continue;
+
+			if ((r = param->spec.apply(param->spec.name, param->new_value, param->new_str, param->spec.arg)) < 0) {
+				if (failed)
+					*failed = param->spec.name;
+				_rollback(reg, i);
+				goto out;
+			}
+		}
+	}
+
+	for (i = 0; i < reg->nr_params; i++) {
+		param = &reg->params[i];
+
+		if (!param->pending)
+			continue;
+
+		if (param->spec.type == PARAM_TYPE_STR) {
+			free(param->str);
+			param->str     = param->new_str;
+			param->new_str = NULL;
+		} else
+			param->value = param->new_value;
+	}
+
+	if (failed)
+		*failed = NULL;
+	r = 0;
+out:
+	for (i = 0; i < reg->nr_params; i++) {
+		free(reg->params[i].new_str);
+		reg->params[i].new_str = NULL;
+		reg->params[i].pending = false;
+	}
+
+	return r;
+}
+
+int param_load_env(struct param_registry *reg, const char **failed)
+{
+	struct param *param;
+	const char   *str;
+	char         *new_str;
+	unsigned      i;
+	int           r = 0, r1;
+
+	if (failed)
+		*failed = NULL;
+
+	if (!reg)
+		return -EINVAL;
+
+	for (i = 0; i < reg->nr_params; i++) {
+		param = &reg->params[i];
+
+		if (!(str = getenv(param->spec.name)))
+			continue;
+
+		if (param->spec.type == PARAM_TYPE_STR) {
+			if ((r1 = _parse_str(param, str, strlen(str), &new_str)) == 0) {
+				free(param->str);
+				param->str = new_str;
+			}
+		} else
+			r1 = _parse_value(param, str, &param->value);
+
+		if (r1 < 0 && !r) {
+			r = -EINVAL;
+			if (failed)
+				*failed = param->spec.name;
+		}
+	}
+
+	return r;
+}
+
+static char *_strip(char *str)
+{
+	char *end;
+
+	while (isspace((unsigned char) *str))
+		str++;
+
+	end = str + strlen(str);
+	while (end > str && isspace((unsigned char) end[-1]))
+		end--;
+	*end = '\0';
+
+	return str;
+}
+
+int param_load_file(struct param_registry *reg, const char *path, const char **failed)
+{
+	struct sid_buffer *buf       = NULL;
+	FILE              *f         = NULL;
+	char              *line      = NULL;
+	size_t             line_size = 0;
+	char              *key, *value, *eq;
+	const void        *list;
+	size_t             list_size, len;
+	int                r;
+
+	if (failed)
+		*failed = NULL;
+
+	if (!reg || !path)
+		return -EINVAL;
+
+	if (!(f = fopen(path, "re")))
+		return -errno;
+
+	if (!(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                          .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                          .mode    = SID_BUFFER_MODE_PLAIN}),
+	                              &((struct sid_buffer_init) {.size       = PARAM_FILE_LIST_ALLOC_STEP,
+	                                                          .alloc_step = PARAM_FILE_LIST_ALLOC_STEP,
+	                                                          .limit      = 0}),
+	                              &r)))
+		goto out;
+
+	while (getline(&line, &line_size, f) >= 0) {
+		key = _strip(line);
+
+		if (!*key || *key == '#' || !(eq = strchr(key, '=')))
+			continue;
+
+		*eq   = '\0';
+		key   = _strip(key);
+		value = _strip(eq + 1);
+
+		/* not our parameter, the file is shared with other settings */
+		if (!_find_param(reg, key, strlen(key)))
+			continue;
+
+		len = strlen(value);
+		if (len >= 2 && (*value == '"' || *value == '\'') && value[len - 1] == *value) {
+			value[len - 1] = '\0';
+			value++;
+		}
+
+		if ((r = sid_buffer_fmt_add(buf, NULL, NULL, "%s=%s", key, value)) < 0)
+			goto out;
+	}
+
+	if (ferror(f)) {
+		r = -EIO;
+		goto out;
+	}
+
+	if ((r = sid_buffer_get_data(buf, &list, &list_size)) < 0)
+		goto out;
+
+	r = param_set(reg, list, list_size, failed);
+out:
+	free(line);
+	if (buf)
+		sid_buffer_destroy(buf);
+	fclose(f);
+	return r;
+}
+
+static void _write_param(struct param *param, output_format_t format, struct sid_buffer *buf, bool with_comma)
+{
+	print_start_elem(format, buf, 2, with_comma);
+	print_str_field(format, buf, 3, "NAME", param->spec.name, false);
+	print_str_field(format, buf, 3, "TYPE", _type_names[param->spec.type], true);
+	if (param->spec.type == PARAM_TYPE_STR) {
+		print_str_field(format, buf, 3, "VALUE", param->str, true);
+		print_str_field(format, buf, 3, "DEFAULT", param->spec.def_str, true);
+		print_uint64_field(format, buf, 3, "MAXLEN", param->spec.max, true);
+	} else {
+		print_uint64_field(format, buf, 3, "VALUE", param->value, true);
+		print_uint64_field(format, buf, 3, "DEFAULT", param->spec.def, true);
+		print_uint64_field(format, buf, 3, "MIN", param->spec.min, true);
+		print_uint64_field(format, buf, 3, "MAX", param->spec.max, true);
+	}
+	print_uint_field(format, buf, 3, "HOT", !!(param->spec.flags & PARAM_FL_HOT), true);
+	print_end_elem(format, buf, 2);
+}
+
+int param_write(struct param_registry *reg,
+                const char            *names,
+                size_t                 names_size,
+                output_format_t        format,
+                struct sid_buffer     *buf,
+                const char           **failed)
+{
+	struct param *param;
+	const char   *item, *eq;
+	size_t        pos, len;
+	unsigned      i;
+	bool          with_comma = false;
+
+	if (failed)
+		*failed = NULL;
+
+	if (!reg || !buf)
+		return -EINVAL;
+
+	/* check all names before writing anything */
+	for (pos = 0; (item = _next_item(names, names_size, &pos, &len));) {
+		if ((eq = memchr(item, '=', len)))
+			len = eq - item;
+
+		if (!_find_param(reg, item, len)) {
+			if (failed)
+				*failed = item;
+			return -ENOENT;
+		}
+	}
+
+	print_start_document(format, buf, 0);
+	print_start_array(format, buf, 1, "sidparams", false);
+
+	if (names) {
+		for (pos = 0; (item = _next_item(names, names_size, &pos, &len)); with_comma = true) {
+			if ((eq = memchr(item, '=', len)))
+				len = eq - item;
+			param = _find_param(reg, item, len);
+			_write_param(param, format, buf, with_comma);
+		}
+	} else {
+		for (i = 0; i < reg->nr_params; i++, with_comma = true)
+			_write_param(&reg->params[i], format, buf, with_comma);
+	}
+
+	print_end_array(format, buf, 1);
+	print_end_document(format, buf, 0);
+
+	return 0;
+}
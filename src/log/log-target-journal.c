@@ -30,6 +30,11 @@ static int _with_src_info = 1;
 
 void log_journal_open(int verbose_mode)
 {
+	/* reset to defaults first, the target may be reopened with lower verbosity */
+	_force_err_out = 0;
+	_with_pids     = 0;
+	_with_src_info = 1;
+
 	switch (verbose_mode) {
 		case 0:
 			_max_level_id = LOG_NOTICE;
@@ -29,6 +29,11 @@ static int _with_src_info = 0;
 
 void log_standard_open(int verbose_mode)
 {
+	/* reset to defaults first, the target may be reopened with lower verbosity */
+	_force_err_out = 0;
+	_with_pids     = 0;
+	_with_src_info = 0;
+
 	switch (verbose_mode) {
 		case 0:
 			_max_level_id = LOG_NOTICE;
@@ -19,20 +19,61 @@
 
 #include "log/log.h"
 
+#define VERBOSE_MODE_DEBUG 2 /* lowest verbose mode with debug messages */
+
 static log_target_t _current_target                   = LOG_TARGET_NONE;
 static int          _current_verbose_mode             = 0;
+static int          _max_level_id                     = LOG_NOTICE;
+static int          _debug_forced                     = 0;
 
 static const struct log_target *log_target_registry[] = {[LOG_TARGET_STANDARD] = &log_target_standard,
                                                          [LOG_TARGET_SYSLOG]   = &log_target_syslog,
                                                          [LOG_TARGET_JOURNAL]  = &log_target_journal};
 
-void log_init(log_target_t target, int verbose_mode)
+/*
+ * Verbose mode the target is opened with. It is at least VERBOSE_MODE_DEBUG so the target
+ * itself never drops debug messages, levels are filtered in log_output instead. Then debug
+ * messages can be forced without reopening the target. The verbose modes lower than
+ * VERBOSE_MODE_DEBUG differ in the maximum level only, not in the output format.
+ */
+static int _target_verbose_mode(void)
+{
+	return _current_verbose_mode < VERBOSE_MODE_DEBUG ? VERBOSE_MODE_DEBUG : _current_verbose_mode;
+}
+
+static void _set_verbose_mode(int verbose_mode)
 {
-	_current_target       = target;
 	_current_verbose_mode = verbose_mode;
 
+	switch (verbose_mode) {
+		case 0:
+			_max_level_id = LOG_NOTICE;
+			break;
+		case 1:
+			_max_level_id = LOG_INFO;
+			break;
+		default:
+			_max_level_id = LOG_DEBUG;
+			break;
+	}
+}
+
+static void _reopen_target(int old_target_verbose_mode)
+{
+	if (_current_target == LOG_TARGET_NONE || _target_verbose_mode() == old_target_verbose_mode)
+		return;
+
+	log_target_registry[_current_target]->close();
+	log_target_registry[_current_target]->open(_target_verbose_mode());
+}
+
+void log_init(log_target_t target, int verbose_mode)
+{
+	_current_target = target;
+	_set_verbose_mode(verbose_mode);
+
 	if (_current_target != LOG_TARGET_NONE)
-		log_target_registry[_current_target]->open(verbose_mode);
+		log_target_registry[_current_target]->open(_target_verbose_mode());
 }
 
 void log_change_target(log_target_t new_target)
@@ -43,11 +84,33 @@ void log_change_target(log_target_t new_target)
 	if (_current_target != LOG_TARGET_NONE)
 		log_target_registry[_current_target]->close();
 	if (new_target != LOG_TARGET_NONE)
-		log_target_registry[new_target]->open(_current_verbose_mode);
+		log_target_registry[new_target]->open(_target_verbose_mode());
 
 	_current_target = new_target;
 }
 
+void log_change_verbose_mode(int new_verbose_mode)
+{
+	int old_target_verbose_mode;
+
+	if (_current_verbose_mode == new_verbose_mode)
+		return;
+
+	old_target_verbose_mode = _target_verbose_mode();
+	_set_verbose_mode(new_verbose_mode);
+	_reopen_target(old_target_verbose_mode);
+}
+
+int log_get_verbose_mode(void)
+{
+	return _current_verbose_mode;
+}
+
+void log_force_debug(int force)
+{
+	_debug_forced = !!force;
+}
+
 void log_output(int         level_id,
                 const char *prefix,
                 int         class_id,
@@ -64,6 +127,10 @@ void log_output(int         level_id,
 	if (_current_target == LOG_TARGET_NONE)
 		return;
 
+	/* levels above LOG_DEBUG, like LOG_PRINT, are left for the target to decide */
+	if (level_id <= LOG_DEBUG && level_id > (_debug_forced ? LOG_DEBUG : _max_level_id))
+		return;
+
 	if (errno_id < 0)
 		errno_id = -errno_id;
 
@@ -18,6 +18,7 @@
  */
 
 #include "blkid-type.h"
+#include "base/util.h"
 #include "log/log.h"
 #include "resource/ucmd-module.h"
 
@@ -32,7 +33,11 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define MID "blkid"
+#define MID                   "blkid"
+
+#define PART_ENTRY_PREFIX     "PART_ENTRY_"
+#define KEY_PART_TABLE_ENTRY  "BLKID_PT_ENTRY_%d"
+#define PART_TABLE_ENTRY_SIZE 512
 
 SID_UCMD_MOD_PRIO(0)
 
@@ -57,8 +62,9 @@ enum {
 	_UDEV_KEY_START = U_FS_TYPE,
 	_UDEV_KEY_END   = U_FS_BOOT_SYSTEM_ID,
 	D_NEXT_MOD,
+	D_PART_TABLE,
 	_DEVICE_KEY_START = D_NEXT_MOD,
-	_DEVICE_KEY_END   = D_NEXT_MOD,
+	_DEVICE_KEY_END   = D_PART_TABLE,
 
 	_NUM_KEYS
 };
@@ -82,6 +88,20 @@ static const char *keys[_NUM_KEYS] = {
 	[U_FS_APPLICATION_ID] = "ID_FS_APPLICATION_ID",
 	[U_FS_BOOT_SYSTEM_ID] = "ID_FS_BOOT_SYSTEM_ID",
 	[D_NEXT_MOD]          = SID_UCMD_KEY_DEVICE_NEXT_MOD,
+	[D_PART_TABLE]        = "BLKID_PT",
+};
+
+/*
+ * Partition table as read while scanning a whole disk is stored in disk's
+ * KV_NS_DEVICE records so partition scans do not need to read and parse
+ * it again. The D_PART_TABLE record identifies the table and each
+ * KEY_PART_TABLE_ENTRY record then consists of the seqnum of the disk
+ * event that stored the table, followed by NUL-separated "NAME=VALUE"
+ * pairs as returned by blkid when probing the partition itself.
+ */
+struct part_table {
+	uint64_t diskseq; /* disk sequence number at the time the table was read */
+	uint64_t seqnum;  /* seqnum of the disk event which read the table */
 };
 
 static int _blkid_init(struct module *module, struct sid_ucmd_common_ctx *ucmd_common_ctx)
@@ -209,7 +229,182 @@ static void _add_property(struct module *mod, struct sid_ucmd_ctx *ucmd_ctx, con
 	}
 }
 
-static int _probe_superblocks(blkid_probe pr)
+static int _append_part_entry_value(char *buf, size_t buf_size, size_t *pos, const char *name, const char *value)
+{
+	int len;
+
+	if (!value || !*value)
+		return 0;
+
+	len = snprintf(buf + *pos, buf_size - *pos, PART_ENTRY_PREFIX "%s=%s", name, value);
+	if (len < 0 || (size_t) len >= buf_size - *pos)
+		return -ENOBUFS;
+
+	*pos += len + 1;
+	return 0;
+}
+
+static int _store_part_table_entry(struct module *mod, struct sid_ucmd_ctx *ucmd_ctx, uint64_t seqnum, blkid_partition par)
+{
+	char        buf[PART_TABLE_ENTRY_SIZE];
+	char        key[32];
+	char        s[64];
+	const char *type_str;
+	size_t      pos = sizeof(seqnum);
+	int         partno;
+
+	partno = blkid_partition_get_partno(par);
+	memcpy(buf, &seqnum, sizeof(seqnum));
+
+	if (_append_part_entry_value(buf,
+	                             sizeof(buf),
+	                             &pos,
+	                             "SCHEME",
+	                             blkid_parttable_get_type(blkid_partition_get_table(par))) < 0 ||
+	    _append_part_entry_value(buf, sizeof(buf), &pos, "NAME", blkid_partition_get_name(par)) < 0 ||
+	    _append_part_entry_value(buf, sizeof(buf), &pos, "UUID", blkid_partition_get_uuid(par)) < 0)
+		return -ENOBUFS;
+
+	if (!(type_str = blkid_partition_get_type_string(par))) {
+		snprintf(s, sizeof(s), "0x%x", blkid_partition_get_type(par));
+		type_str = s;
+	}
+
+	if (_append_part_entry_value(buf, sizeof(buf), &pos, "TYPE", type_str) < 0)
+		return -ENOBUFS;
+
+	if (blkid_partition_get_flags(par)) {
+		snprintf(s, sizeof(s), "0x%llx", blkid_partition_get_flags(par));
+		if (_append_part_entry_value(buf, sizeof(buf), &pos, "FLAGS", s) < 0)
+			return -ENOBUFS;
+	}
+
+	snprintf(s, sizeof(s), "%d", partno);
+	if (_append_part_entry_value(buf, sizeof(buf), &pos, "NUMBER", s) < 0)
+		return -ENOBUFS;
+
+	snprintf(s, sizeof(s), "%jd", (intmax_t) blkid_partition_get_start(par));
+	if (_append_part_entry_value(buf, sizeof(buf), &pos, "OFFSET", s) < 0)
+		return -ENOBUFS;
+
+	snprintf(s, sizeof(s), "%jd", (intmax_t) blkid_partition_get_size(par));
+	if (_append_part_entry_value(buf, sizeof(buf), &pos, "SIZE", s) < 0)
+		return -ENOBUFS;
+
+	snprintf(s, sizeof(s), "%d:%d", sid_ucmd_event_get_dev_major(ucmd_ctx), sid_ucmd_event_get_dev_minor(ucmd_ctx));
+	if (_append_part_entry_value(buf, sizeof(buf), &pos, "DISK", s) < 0)
+		return -ENOBUFS;
+
+	snprintf(key, sizeof(key), KEY_PART_TABLE_ENTRY, partno);
+
+	if (!sid_ucmd_set_kv(mod, ucmd_ctx, KV_NS_DEVICE, key, buf, pos, KV_SYNC_P | KV_RD))
+		return -EREMOTEIO;
+
+	return 0;
+}
+
+static void _store_part_table(struct module *mod, struct sid_ucmd_ctx *ucmd_ctx, blkid_probe pr)
+{
+	struct part_table pt = {.diskseq = sid_ucmd_event_get_dev_diskseq(ucmd_ctx),
+	                        .seqnum  = sid_ucmd_event_get_dev_seqnum(ucmd_ctx)};
+	blkid_partlist    ls = NULL;
+	int               i, nr = 0;
+
+	/*
+	 * Partitions can check whether the stored table is still valid only
+	 * by comparing the diskseq so do not store anything if it is not
+	 * available.
+	 */
+	if (pt.diskseq && !blkid_probe_lookup_value(pr, "PTTYPE", NULL, NULL) && (ls = blkid_probe_get_partitions(pr)))
+		nr = blkid_partlist_numof_partitions(ls);
+
+	for (i = 0; i < nr; i++) {
+		if (_store_part_table_entry(mod, ucmd_ctx, pt.seqnum, blkid_partlist_get_partition(ls, i)) < 0) {
+			log_debug(MID, "Failed to store partition table entry %d, partitions will be probed directly.", i);
+			nr = 0;
+			break;
+		}
+	}
+
+	/*
+	 * Any entries left over from a previous partition table are not
+	 * matched by the new seqnum so there is no need to remove them.
+	 */
+	if (nr)
+		sid_ucmd_set_kv(mod, ucmd_ctx, KV_NS_DEVICE, keys[D_PART_TABLE], &pt, sizeof(pt), KV_SYNC_P | KV_RD);
+	else
+		sid_ucmd_set_kv(mod, ucmd_ctx, KV_NS_DEVICE, keys[D_PART_TABLE], SID_UCMD_KV_UNSET, 0, KV_SYNC_P | KV_RD);
+}
+
+static int _get_partno(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	char path[PATH_MAX];
+	char buf[16];
+
+	snprintf(path, sizeof(path), "%s%s/partition", SYSTEM_SYSFS_PATH, sid_ucmd_event_get_dev_path(ucmd_ctx));
+
+	if (sid_util_sysfs_get_value(path, buf, sizeof(buf)) < 0)
+		return -1;
+
+	return atoi(buf);
+}
+
+/*
+ * Add PART_ENTRY_* properties for current partition using the partition
+ * table stored while scanning the whole disk. Returns 1 if the properties
+ * were added and 0 if the stored table is missing or stale and the
+ * partition needs to be probed directly.
+ */
+static int _add_part_entry_properties_from_disk(struct module *mod, struct sid_ucmd_ctx *ucmd_ctx)
+{
+	struct part_table pt;
+	char              key[32];
+	char              name[64];
+	const char       *value, *p, *end, *eq;
+	uint64_t          seqnum, diskseq;
+	size_t            size;
+	int               partno;
+
+	/* Without diskseq, the stored table can not be validated so do not even look it up. */
+	if (!(diskseq = sid_ucmd_event_get_dev_diskseq(ucmd_ctx)))
+		return 0;
+
+	if (!(value = sid_ucmd_part_get_disk_kv(mod, ucmd_ctx, keys[D_PART_TABLE], &size, NULL)) || size != sizeof(pt))
+		return 0;
+
+	memcpy(&pt, value, sizeof(pt));
+
+	if (pt.diskseq != diskseq)
+		return 0;
+
+	if ((partno = _get_partno(ucmd_ctx)) <= 0)
+		return 0;
+
+	snprintf(key, sizeof(key), KEY_PART_TABLE_ENTRY, partno);
+
+	if (!(value = sid_ucmd_part_get_disk_kv(mod, ucmd_ctx, key, &size, NULL)) || size <= sizeof(seqnum))
+		return 0;
+
+	memcpy(&seqnum, value, sizeof(seqnum));
+
+	if (seqnum != pt.seqnum)
+		return 0;
+
+	for (p = value + sizeof(seqnum), end = value + size; p < end; p += strlen(p) + 1) {
+		if (!(eq = strchr(p, '=')) || (size_t) (eq - p) >= sizeof(name))
+			continue;
+
+		memcpy(name, p, eq - p);
+		name[eq - p] = '\0';
+
+		_add_property(mod, ucmd_ctx, name, eq + 1);
+	}
+
+	log_debug(MID, "Partition table entry %d taken from whole disk records.", partno);
+	return 1;
+}
+
+static int _probe_superblocks(blkid_probe pr, bool probe_parts)
 {
 	struct stat st;
 	int         rc;
@@ -217,7 +412,7 @@ static int _probe_superblocks(blkid_probe pr)
 	if (fstat(blkid_probe_get_fd(pr), &st))
 		return -errno;
 
-	blkid_probe_enable_partitions(pr, 1);
+	blkid_probe_enable_partitions(pr, probe_parts);
 
 	if (!S_ISCHR(st.st_mode) && blkid_probe_get_size(pr) <= 1024 * 1440 && blkid_probe_is_wholedisk(pr)) {
 		/*
@@ -234,7 +429,8 @@ static int _probe_superblocks(blkid_probe pr)
 			return 0; /* partition table detected */
 	}
 
-	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+	if (probe_parts)
+		blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
 	blkid_probe_enable_superblocks(pr, 1);
 
 	return blkid_do_safeprobe(pr);
@@ -249,6 +445,7 @@ static int _blkid_scan_next(struct module *module, struct sid_ucmd_ctx *ucmd_ctx
 	blkid_probe pr     = NULL;
 	const char *data;
 	const char *name;
+	bool        probe_parts = true;
 	int         nvals;
 	int         i;
 	int         r = -1;
@@ -278,7 +475,15 @@ static int _blkid_scan_next(struct module *module, struct sid_ucmd_ctx *ucmd_ctx
 
 	log_debug(MID, "Probe %s %sraid offset=%" PRIi64, dev_path, noraid ? "no" : "", offset);
 
-	if ((r = _probe_superblocks(pr)) < 0)
+	/*
+	 * For a partition, try to use the partition table already read while
+	 * scanning the whole disk instead of reading and parsing it again.
+	 */
+	if (sid_ucmd_event_get_dev_type(ucmd_ctx) == UDEV_DEVTYPE_PARTITION &&
+	    _add_part_entry_properties_from_disk(module, ucmd_ctx))
+		probe_parts = false;
+
+	if ((r = _probe_superblocks(pr, probe_parts)) < 0)
 		goto out;
 
 	nvals = blkid_probe_numof_values(pr);
@@ -289,6 +494,9 @@ static int _blkid_scan_next(struct module *module, struct sid_ucmd_ctx *ucmd_ctx
 		_add_property(module, ucmd_ctx, name, data);
 	}
 
+	if (sid_ucmd_event_get_dev_type(ucmd_ctx) == UDEV_DEVTYPE_DISK)
+		_store_part_table(module, ucmd_ctx, pr);
+
 	r = 0;
 out:
 	if (fd >= 0)
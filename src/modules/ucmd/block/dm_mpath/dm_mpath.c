@@ -26,14 +26,36 @@
 #include <mpath_valid.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #define MID "dm_mpath"
 
 SID_UCMD_MOD_PRIO(-1)
 
-#define U_DEV_PATH "DM_MULTIPATH_DEVICE_PATH"
-#define X_VALID    "VALID"
-#define X_WWID     "WWID"
+#define U_DEV_PATH  "DM_MULTIPATH_DEVICE_PATH"
+#define U_ID_SERIAL "ID_SERIAL"
+#define X_VALID     "VALID"
+#define X_WWID      "WWID"
+#define M_VALID     "VALID_"
+
+/*
+ * Files which mpathvalid_is_path result depends on besides the device itself.
+ * The conf.d directory changes only if a file is added or removed there.
+ */
+static const char *mpath_gen_files[] = {"/etc/multipath.conf", "/etc/multipath/conf.d", "/etc/multipath/wwids"};
+
+#define MPATH_NR_GEN_FILES (sizeof(mpath_gen_files) / sizeof(mpath_gen_files[0]))
+
+struct mpath_file_gen {
+	ino_t           ino;
+	struct timespec mtime;
+};
+
+/* Cached mpathvalid_is_path result for a WWID, stored in module namespace. */
+struct mpath_valid_cache {
+	struct mpath_file_gen gen[MPATH_NR_GEN_FILES];
+	int                   valid;
+};
 
 static int _dm_mpath_init(struct module *module, struct sid_ucmd_common_ctx *ucmd_common_ctx)
 {
@@ -110,6 +132,105 @@ static int _is_parent_multipathed(struct module *mod, struct sid_ucmd_ctx *ucmd_
 	return 0;
 }
 
+static void _get_gen(struct mpath_file_gen *gen)
+{
+	struct stat st;
+	size_t      i;
+
+	memset(gen, 0, MPATH_NR_GEN_FILES * sizeof(*gen));
+
+	/* A missing file is a valid state too, it has zero generation. */
+	for (i = 0; i < MPATH_NR_GEN_FILES; i++) {
+		if (stat(mpath_gen_files[i], &st) == 0) {
+			gen[i].ino   = st.st_ino;
+			gen[i].mtime = st.st_mtim;
+		}
+	}
+}
+
+static int _get_cache_key(const char *wwid, char *buf, size_t buf_size)
+{
+	/* ':' is the key part delimiter */
+	if (!wwid || !*wwid || strchr(wwid, ':'))
+		return -EINVAL;
+
+	if (snprintf(buf, buf_size, M_VALID "%s", wwid) >= buf_size)
+		return -ENAMETOOLONG;
+
+	return 0;
+}
+
+/*
+ * All paths to a LUN share the WWID and so the mpathvalid_is_path result. Paths
+ * blacklisted by device node are the exception, but such blacklist entries are
+ * not expected to select only some paths of a multipathed LUN.
+ */
+static int _get_cached_valid(struct module               *module,
+                             struct sid_ucmd_ctx         *ucmd_ctx,
+                             const char                  *key,
+                             const struct mpath_file_gen *gen)
+{
+	const struct mpath_valid_cache *cache;
+	size_t                          size;
+
+	if (!(cache = sid_ucmd_get_kv(module, ucmd_ctx, KV_NS_MODULE, key, &size, NULL)) || size != sizeof(*cache) ||
+	    memcmp(cache->gen, gen, sizeof(cache->gen)))
+		return MPATH_IS_ERROR;
+
+	return cache->valid;
+}
+
+static void _set_cached_valid(struct module               *module,
+                              struct sid_ucmd_ctx         *ucmd_ctx,
+                              const char                  *key,
+                              const struct mpath_file_gen *gen,
+                              int                          valid)
+{
+	struct mpath_valid_cache cache = {.valid = valid};
+
+	memcpy(cache.gen, gen, sizeof(cache.gen));
+	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_MODULE, key, &cache, sizeof(cache), KV_SYNC_P);
+}
+
+static int _is_path(struct module *module, struct sid_ucmd_ctx *ucmd_ctx, char **wwid)
+{
+	struct mpath_file_gen gen[MPATH_NR_GEN_FILES];
+	char                  key[PATH_MAX];
+	const char           *serial;
+	bool                  cacheable;
+	int                   r;
+
+	/* multipath uses udev ID_SERIAL for the WWID by default */
+	serial    = sid_ucmd_get_kv(module, ucmd_ctx, KV_NS_UDEV, U_ID_SERIAL, NULL, NULL);
+	cacheable = _get_cache_key(serial, key, sizeof(key)) == 0;
+	*wwid     = NULL;
+
+	if (cacheable) {
+		_get_gen(gen);
+
+		if ((r = _get_cached_valid(module, ucmd_ctx, key, gen)) != MPATH_IS_ERROR) {
+			log_debug(MID, "%s using cached mpathvalid_is_path result %d", sid_ucmd_event_get_dev_name(ucmd_ctx), r);
+			*wwid = strdup(serial);
+			return r;
+		}
+	}
+
+	if (mpathvalid_reload_config() < 0) {
+		log_error(MID, "failed to reinitialize mpathvalid");
+		return MPATH_IS_ERROR;
+	}
+
+	// currently treats MPATH_SMART like MPATH_STRICT
+	r = mpathvalid_is_path(sid_ucmd_event_get_dev_name(ucmd_ctx), MPATH_DEFAULT, wwid, NULL, 0);
+	log_debug(MID, "%s mpathvalid_is_path returned %d", sid_ucmd_event_get_dev_name(ucmd_ctx), r);
+
+	/* MPATH_IS_MAYBE depends on other paths having appeared meanwhile. */
+	if (cacheable && *wwid && !strcmp(*wwid, serial) && r != MPATH_IS_ERROR && r != MPATH_IS_MAYBE)
+		_set_cached_valid(module, ucmd_ctx, key, gen, r);
+
+	return r;
+}
+
 static int _dm_mpath_scan_next(struct module *module, struct sid_ucmd_ctx *ucmd_ctx)
 {
 	int   r;
@@ -129,13 +250,7 @@ static int _dm_mpath_scan_next(struct module *module, struct sid_ucmd_ctx *ucmd_
 			return 0;
 	}
 
-	if (mpathvalid_reload_config() < 0) {
-		log_error(MID, "failed to reinitialize mpathvalid");
-		return -1;
-	}
-	// currently treats MPATH_SMART like MPATH_STRICT
-	r = mpathvalid_is_path(sid_ucmd_event_get_dev_name(ucmd_ctx), MPATH_DEFAULT, &wwid, NULL, 0);
-	log_debug(MID, "%s mpathvalid_is_path returned %d", sid_ucmd_event_get_dev_name(ucmd_ctx), r);
+	r = _is_path(module, ucmd_ctx, &wwid);
 
 	if (r == MPATH_IS_VALID) {
 		const char *old_valid_str;
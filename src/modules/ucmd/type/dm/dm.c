@@ -25,14 +25,26 @@
 #include "resource/module-registry.h"
 #include "resource/ucmd-module.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <linux/dm-ioctl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
 
 #define DM_ID                "dm"
 #define DM_SUBMODULES_ID     DM_ID "_sub"
 #define DM_SUBMODULE_ID_NONE "none"
+#define DM_CONTROL_PATH      "/dev/" DM_DIR "/" DM_CONTROL_NODE
+
+#define DM_X_NAME      "name"
+#define DM_X_UUID      "uuid"
+#define DM_X_SUSPENDED "suspended"
+#define DM_X_READONLY  "readonly"
+#define DM_X_EVENT_NR  "event_nr"
 
 SID_UCMD_MOD_PRIO(0)
 SID_UCMD_MOD_ALIASES("device_mapper")
@@ -79,10 +91,20 @@ struct dm_submod_fns {
 	sid_ucmd_fn_t *scan_post_next;
 } __attribute__((packed));
 
+struct dm_dev_info {
+	char     name[DM_NAME_LEN];
+	char     uuid[DM_UUID_LEN];
+	bool     suspended;
+	bool     readonly;
+	uint32_t event_nr;
+	bool     event_nr_valid; /* not available if we fall back to sysfs */
+};
+
 struct dm_mod_ctx {
 	sid_resource_t *submod_registry;
 	sid_resource_t *submod_res_current;
 	sid_resource_t *submod_res_next;
+	int             control_fd;
 };
 
 static int _dm_init(struct module *module, struct sid_ucmd_common_ctx *ucmd_common_ctx)
@@ -126,6 +148,10 @@ static int _dm_init(struct module *module, struct sid_ucmd_common_ctx *ucmd_comm
 		goto fail;
 	}
 
+	/* Without the control node, we read device information from sysfs instead. */
+	if ((dm_mod->control_fd = open(DM_CONTROL_PATH, O_RDWR | O_CLOEXEC)) < 0)
+		log_debug(DM_ID, "Failed to open %s: %s.", DM_CONTROL_PATH, strerror(errno));
+
 	module_set_data(module, dm_mod);
 	return 0;
 fail:
@@ -143,6 +169,8 @@ static int _dm_exit(struct module *module, struct sid_ucmd_common_ctx *ucmd_comm
 	log_debug(DM_ID, "exit");
 
 	dm_mod = module_get_data(module);
+	if (dm_mod->control_fd >= 0)
+		(void) close(dm_mod->control_fd);
 	free(dm_mod);
 
 	return 0;
@@ -156,12 +184,110 @@ static int _dm_reset(struct module *module, struct sid_ucmd_common_ctx *ucmd_com
 }
 SID_UCMD_MOD_RESET(_dm_reset)
 
+/*
+ * Get all the device information with a single DM_DEV_STATUS ioctl.
+ */
+static int _get_dev_info_ioctl(struct dm_mod_ctx *dm_mod, struct sid_ucmd_ctx *ucmd_ctx, struct dm_dev_info *info)
+{
+	struct dm_ioctl dmi = {
+		.version    = {DM_VERSION_MAJOR, 0, 0},
+		.data_size  = sizeof(dmi),
+		.data_start = sizeof(dmi),
+		.dev        = makedev(sid_ucmd_event_get_dev_major(ucmd_ctx), sid_ucmd_event_get_dev_minor(ucmd_ctx)),
+	};
+
+	if (ioctl(dm_mod->control_fd, DM_DEV_STATUS, &dmi) < 0)
+		return -errno;
+
+	memcpy(info->name, dmi.name, sizeof(info->name));
+	info->name[sizeof(info->name) - 1] = '\0';
+	memcpy(info->uuid, dmi.uuid, sizeof(info->uuid));
+	info->uuid[sizeof(info->uuid) - 1] = '\0';
+
+	info->suspended      = dmi.flags & DM_SUSPEND_FLAG;
+	info->readonly       = dmi.flags & DM_READONLY_FLAG;
+	info->event_nr       = dmi.event_nr;
+	info->event_nr_valid = true;
+
+	return 0;
+}
+
+static bool _get_sysfs_bool(struct sid_ucmd_ctx *ucmd_ctx, const char *attr)
+{
+	char path[PATH_MAX];
+	char buf[8];
+
+	snprintf(path, sizeof(path), "%s%s/%s", SYSTEM_SYSFS_PATH, sid_ucmd_event_get_dev_path(ucmd_ctx), attr);
+	return sid_util_sysfs_get_value(path, buf, sizeof(buf)) == 0 && buf[0] == '1';
+}
+
+/*
+ * Get the device information from sysfs if the ioctl is not possible.
+ * Sysfs does not provide event number.
+ */
+static int _get_dev_info_sysfs(struct sid_ucmd_ctx *ucmd_ctx, struct dm_dev_info *info)
+{
+	char path[PATH_MAX];
+	int  r;
+
+	snprintf(path, sizeof(path), "%s%s/dm/uuid", SYSTEM_SYSFS_PATH, sid_ucmd_event_get_dev_path(ucmd_ctx));
+	if (sid_util_sysfs_get_value(path, info->uuid, sizeof(info->uuid)) < 0)
+		info->uuid[0] = '\0';
+
+	snprintf(path, sizeof(path), "%s%s/dm/name", SYSTEM_SYSFS_PATH, sid_ucmd_event_get_dev_path(ucmd_ctx));
+	if ((r = sid_util_sysfs_get_value(path, info->name, sizeof(info->name))) < 0)
+		info->name[0] = '\0';
+
+	info->suspended      = _get_sysfs_bool(ucmd_ctx, "dm/suspended");
+	info->readonly       = _get_sysfs_bool(ucmd_ctx, "ro");
+	info->event_nr       = 0;
+	info->event_nr_valid = false;
+
+	return r;
+}
+
+static int _get_dev_info(struct dm_mod_ctx *dm_mod, struct sid_ucmd_ctx *ucmd_ctx, struct dm_dev_info *info)
+{
+	int r;
+
+	if (dm_mod->control_fd >= 0) {
+		if ((r = _get_dev_info_ioctl(dm_mod, ucmd_ctx, info)) == 0)
+			return 0;
+
+		log_debug(DM_ID,
+		          "DM_DEV_STATUS ioctl failed for %s: %s. Falling back to sysfs.",
+		          sid_ucmd_event_get_dev_name(ucmd_ctx),
+		          strerror(-r));
+	}
+
+	return _get_dev_info_sysfs(ucmd_ctx, info);
+}
+
+/*
+ * The event number changes with each table load and each event raised by the table
+ * so if it stays the same, a CHANGE event does not bring any new table for the device.
+ */
+static void _set_event_nr(struct module *module, struct sid_ucmd_ctx *ucmd_ctx, const struct dm_dev_info *dev)
+{
+	const char *old_event_nr;
+	char        event_nr[16];
+
+	if (!dev->event_nr_valid)
+		return;
+
+	snprintf(event_nr, sizeof(event_nr), "%" PRIu32, dev->event_nr);
+	old_event_nr = sid_ucmd_get_kv(module, ucmd_ctx, KV_NS_DEVMOD, DM_X_EVENT_NR, NULL, NULL);
+
+	if (old_event_nr && !strcmp(old_event_nr, event_nr))
+		log_debug(DM_ID, "Event number %s unchanged for %s.", event_nr, sid_ucmd_event_get_dev_name(ucmd_ctx));
+
+	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_DEVMOD, DM_X_EVENT_NR, event_nr, strlen(event_nr) + 1, KV_SYNC | KV_SUBMOD_RD);
+}
+
 static int _dm_ident(struct module *module, struct sid_ucmd_ctx *ucmd_ctx)
 {
-	char                  path[PATH_MAX];
-	char                  name[DM_NAME_LEN];
-	char                  uuid[DM_UUID_LEN];
 	struct dm_mod_ctx    *dm_mod;
+	struct dm_dev_info    dev;
 	sid_resource_iter_t  *iter;
 	sid_resource_t       *submod_res;
 	const char           *submod_name = NULL;
@@ -169,17 +295,20 @@ static int _dm_ident(struct module *module, struct sid_ucmd_ctx *ucmd_ctx)
 
 	log_debug(DM_ID, "ident");
 
-	snprintf(path, sizeof(path), "%s%s/dm/uuid", SYSTEM_SYSFS_PATH, sid_ucmd_event_get_dev_path(ucmd_ctx));
-	sid_util_sysfs_get_value(path, uuid, sizeof(uuid));
-	sid_ucmd_dev_add_alias(module, ucmd_ctx, "uuid", uuid);
-	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_DEVMOD, "uuid", uuid, strlen(uuid) + 1, KV_SYNC | KV_SUBMOD_RD);
+	dm_mod = module_get_data(module);
+	(void) _get_dev_info(dm_mod, ucmd_ctx, &dev);
 
-	snprintf(path, sizeof(path), "%s%s/dm/name", SYSTEM_SYSFS_PATH, sid_ucmd_event_get_dev_path(ucmd_ctx));
-	sid_util_sysfs_get_value(path, name, sizeof(name));
-	sid_ucmd_dev_add_alias(module, ucmd_ctx, "name", name);
-	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_DEVMOD, "name", name, strlen(name) + 1, KV_SYNC | KV_SUBMOD_RD);
+	sid_ucmd_dev_add_alias(module, ucmd_ctx, DM_X_UUID, dev.uuid);
+	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_DEVMOD, DM_X_UUID, dev.uuid, strlen(dev.uuid) + 1, KV_SYNC | KV_SUBMOD_RD);
+
+	sid_ucmd_dev_add_alias(module, ucmd_ctx, DM_X_NAME, dev.name);
+	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_DEVMOD, DM_X_NAME, dev.name, strlen(dev.name) + 1, KV_SYNC | KV_SUBMOD_RD);
+
+	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_DEVMOD, DM_X_SUSPENDED, dev.suspended ? "1" : "0", 2, KV_SYNC | KV_SUBMOD_RD);
+	sid_ucmd_set_kv(module, ucmd_ctx, KV_NS_DEVMOD, DM_X_READONLY, dev.readonly ? "1" : "0", 2, KV_SYNC | KV_SUBMOD_RD);
+
+	_set_event_nr(module, ucmd_ctx, &dev);
 
-	dm_mod      = module_get_data(module);
 	submod_name = sid_ucmd_get_kv(module, ucmd_ctx, KV_NS_DEVICE, DM_SUBMODULES_ID, NULL, NULL);
 
 	if (submod_name) {
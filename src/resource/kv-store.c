@@ -30,14 +30,20 @@
 #include <stdint.h>
 #include <stdio.h>
 
+/* grow transaction tracker buffers by 1024 records, big transactions would otherwise reallocate on each record */
+#define TRANS_ROLLBACK_BUF_ALLOC_STEP (1024 * sizeof(struct kv_rollback_arg))
+#define TRANS_UNSET_BUF_ALLOC_STEP    (1024 * sizeof(char *))
+
 typedef enum {
-	KV_STORE_VALUE_INT_ALLOC = UINT32_C(0x00000001),
+	KV_STORE_VALUE_INT_ALLOC  = UINT32_C(0x00000001),
+	KV_STORE_VALUE_INT_PACKED = UINT32_C(0x00000002),
 } kv_store_value_int_flags_t;
 
 struct kv_store {
 	kv_store_backend_t backend;
 	struct sid_buffer *trans_unset_buf;
 	struct sid_buffer *trans_rollback_buf;
+	uint64_t           gen; /* changed on each write, see kv_store_get_generation */
 
 	union {
 		struct hash_table *ht;
@@ -52,11 +58,22 @@ struct kv_store_value {
 	char                       data[] __attribute__((aligned));
 };
 
+/*
+ * Packed vector (E): element end offsets followed by concatenated element bytes,
+ * all in kv_store_value->data. The iovec view is created only when requested.
+ */
+struct kv_store_value_packed {
+	struct iovec *iov;
+	uint32_t      end[];
+};
+
 struct kv_update_fn_relay {
 	kv_store_update_cb_fn_t kv_update_fn;
 	void                   *kv_update_fn_arg;
+	struct iovec           *new_iov;
 	struct sid_buffer      *unset_buf;
 	struct sid_buffer      *rollback_buf;
+	bool                    removed;
 	int                     ret_code;
 };
 
@@ -66,6 +83,8 @@ struct kv_store_iter {
 	union {
 		struct {
 			struct hash_node *current;
+			const char       *prefix;
+			size_t            prefix_len;
 		} ht;
 
 		struct {
@@ -93,11 +112,41 @@ static void *_get_ptr(const void *src)
 	return (void *) ptr;
 }
 
+static char *_packed_bytes(struct kv_store_value *value)
+{
+	return value->data + sizeof(struct kv_store_value_packed) + value->size * sizeof(uint32_t);
+}
+
+static struct iovec *_get_packed_iov(struct kv_store_value *value)
+{
+	struct kv_store_value_packed *packed = (struct kv_store_value_packed *) value->data;
+	char                         *bytes;
+	uint32_t                      start;
+	size_t                        i;
+
+	if (packed->iov)
+		return packed->iov;
+
+	if (!(packed->iov = malloc(value->size * sizeof(struct iovec))))
+		return NULL;
+
+	for (i = 0, start = 0, bytes = _packed_bytes(value); i < value->size; i++) {
+		packed->iov[i].iov_base = bytes + start;
+		packed->iov[i].iov_len  = packed->end[i] - start;
+		start                   = packed->end[i];
+	}
+
+	return packed->iov;
+}
+
 static void *_get_data(struct kv_store_value *value)
 {
 	if (!value)
 		return NULL;
 
+	if (value->int_flags & KV_STORE_VALUE_INT_PACKED)
+		return _get_packed_iov(value);
+
 	return value->ext_flags & KV_STORE_VALUE_REF ? _get_ptr(value->data) : value->data;
 }
 
@@ -137,6 +186,10 @@ static void _destroy_kv_store_value(struct kv_store_value *value)
 		}
 	}
 
+	/* E - the iovec view of packed vector is allocated separately on demand. */
+	if (value->int_flags & KV_STORE_VALUE_INT_PACKED)
+		free(((struct kv_store_value_packed *) value->data)->iov);
+
 	/*
 	 * If the value stored is not a reference, it's stored as copy and
 	 * part of value->data[] field allocated together with the value itself.
@@ -180,14 +233,15 @@ static void _bptree_destroy_kv_store_value(const char *key __attribute__((unused
  * B     0     0     1     value ref    value size    0     0     1      value copy ref         value size   1
  * C     0     1     0     value ref    value size    0     1     0      value ref              value size
  * D     0     1     1     value ref    value size    0     1     0      value ref              value size   1
- * E     1     0     0     iovec ref    iovec size    1     0     1      iovec deep copy ref    iovec size   2
+ * E     1     0     0     iovec ref    iovec size    1     0     1      packed iovec copy ref  iovec size   2
  * F     1     0     1     iovec ref    iovec size    0     0     1      value merger ref       value size   3
  * G     1     1     0     iovec ref    iovec size    1     1     0      iovec ref              iovec size
  * H     1     1     1     iovec ref    iovec size    1     1     1      value merger iovec ref iovec size   4
  *
  * NOTES:
  * 1: Merge flag has no effect: B == A and D == C
- * 2: allocated both iovec copy and value parts
+ * 2: offset table and value parts allocated together, iovec view allocated on first access (PACKED int flag),
+ *    iovec copy allocated together with value parts if the values are too big for 32-bit offsets
  * 3: iovec members merged into a single value
  * 4: iovec members merged into a signle value. iovec has refs to merged value parts
  *
@@ -204,12 +258,13 @@ static struct kv_store_value *_create_kv_store_value(struct iovec             *i
                                                      kv_store_value_op_flags_t op_flags,
                                                      size_t                   *size)
 {
-	struct kv_store_value *value;
-	size_t                 value_size;
-	size_t                 data_size;
-	char                  *p1, *p2;
-	struct iovec          *iov2;
-	int                    i;
+	struct kv_store_value        *value;
+	struct kv_store_value_packed *packed;
+	size_t                        value_size;
+	size_t                        data_size;
+	char                         *p1, *p2;
+	struct iovec                 *iov2;
+	int                           i;
 
 	if (flags & KV_STORE_VALUE_VECTOR) {
 		if (flags & KV_STORE_VALUE_REF) {
@@ -258,6 +313,25 @@ static struct kv_store_value *_create_kv_store_value(struct iovec             *i
 				value->size      = data_size;
 				flags            &= ~KV_STORE_VALUE_VECTOR;
 				value->int_flags = KV_STORE_VALUE_INT_ALLOC;
+			} else if (iov_cnt && data_size <= UINT32_MAX) {
+				/* E */
+				value_size = sizeof(*value) + sizeof(struct kv_store_value_packed) + iov_cnt * sizeof(uint32_t) +
+				             data_size;
+
+				if (!(value = mem_zalloc(value_size)))
+					return NULL;
+
+				packed      = (struct kv_store_value_packed *) value->data;
+				value->size = iov_cnt;
+				p1          = _packed_bytes(value);
+
+				for (i = 0, data_size = 0; i < iov_cnt; i++) {
+					memcpy(p1 + data_size, iov[i].iov_base, iov[i].iov_len);
+					data_size      += iov[i].iov_len;
+					packed->end[i] = data_size;
+				}
+
+				value->int_flags = KV_STORE_VALUE_INT_ALLOC | KV_STORE_VALUE_INT_PACKED;
 			} else {
 				/* E */
 				value_size = sizeof(*value) + iov_cnt * sizeof(struct iovec) + data_size;
@@ -334,12 +408,26 @@ static int _update_fn(const char                *key,
 
 	if (relay->kv_update_fn) {
 		if (old_value) {
-			update_spec.old_data      = _get_data(old_value);
+			if (!(update_spec.old_data = _get_data(old_value)) && (old_value->int_flags & KV_STORE_VALUE_INT_PACKED)) {
+				relay->ret_code = -ENOMEM;
+				_destroy_kv_store_value(*new_value);
+				*new_value = NULL;
+				return 0;
+			}
 			update_spec.old_data_size = old_value->size;
 			update_spec.old_flags     = old_value->ext_flags;
 		}
 
-		update_spec.new_data = orig_new_data = _get_data(orig_new_value);
+		/*
+		 * A packed vector has the same content as the vector it was created from,
+		 * use that one so we don't need to create the iovec view for the callback.
+		 */
+		if (orig_new_value->int_flags & KV_STORE_VALUE_INT_PACKED)
+			orig_new_data = relay->new_iov;
+		else
+			orig_new_data = _get_data(orig_new_value);
+
+		update_spec.new_data = orig_new_data;
 		update_spec.new_data_size = orig_new_data_size = orig_new_value->size;
 		update_spec.new_flags = orig_new_flags = orig_new_value->ext_flags;
 
@@ -474,17 +562,18 @@ void *kv_store_set_value(sid_resource_t           *kv_store_res,
 	struct iovec             *iov;
 	int                       iov_cnt;
 	size_t                    kv_store_value_size;
-	struct kv_store_value    *kv_store_value;
+	struct kv_store_value    *kv_store_value, *created_value;
 
 	if (flags & KV_STORE_VALUE_VECTOR) {
-		iov     = value;
-		iov_cnt = value_size;
+		iov           = value;
+		iov_cnt       = value_size;
+		relay.new_iov = iov;
 	} else {
 		iov     = &iov_internal;
 		iov_cnt = 1;
 	}
 
-	if (!(kv_store_value = _create_kv_store_value(iov, iov_cnt, flags, op_flags, &kv_store_value_size)))
+	if (!(created_value = kv_store_value = _create_kv_store_value(iov, iov_cnt, flags, op_flags, &kv_store_value_size)))
 		return NULL;
 
 	key = _canonicalize_key(key);
@@ -515,19 +604,29 @@ void *kv_store_set_value(sid_resource_t           *kv_store_res,
 	if (relay.ret_code < 0)
 		return NULL;
 
+	if (kv_store_value)
+		kv_store->gen++;
+
+	/* Packed vector not edited by kv_update_fn has the same content as the input vector. */
+	if (kv_store_value && kv_store_value == created_value && (kv_store_value->int_flags & KV_STORE_VALUE_INT_PACKED))
+		return value;
+
 	return _get_data(kv_store_value);
 }
 
 int kv_store_add_alias(sid_resource_t *kv_store_res, const char *key, const char *alias, bool force)
 {
 	struct kv_store *kv_store = sid_resource_get_data(kv_store_res);
+	int              r;
 
-	key                       = _canonicalize_key(key);
-	alias                     = _canonicalize_key(alias);
+	key   = _canonicalize_key(key);
+	alias = _canonicalize_key(alias);
 
 	switch (kv_store->backend) {
 		case KV_STORE_BACKEND_BPTREE:
-			return bptree_insert_alias(kv_store->bpt, key, alias, force);
+			if ((r = bptree_insert_alias(kv_store->bpt, key, alias, force)) == 0)
+				kv_store->gen++;
+			return r;
 
 		default:
 			return -ENOTSUP;
@@ -581,7 +680,10 @@ static int _unset_fn(const char                *key,
 		update_spec.new_flags     = 0;
 
 		if (old_value) {
-			update_spec.old_data      = _get_data(old_value);
+			if (!(update_spec.old_data = _get_data(old_value)) && (old_value->int_flags & KV_STORE_VALUE_INT_PACKED)) {
+				relay->ret_code = -ENOMEM;
+				return 0;
+			}
 			update_spec.old_data_size = old_value->size;
 			update_spec.old_flags     = old_value->ext_flags;
 		} else {
@@ -600,8 +702,10 @@ static int _unset_fn(const char                *key,
 		if (relay->unset_buf) {
 			relay->ret_code = sid_buffer_add(relay->unset_buf, (void *) &key, sizeof(char *), NULL, NULL);
 			r               = 0;
-		} else if (old_value_ref_count == 1) {
-			_destroy_kv_store_value(old_value);
+		} else {
+			if (old_value_ref_count == 1)
+				_destroy_kv_store_value(old_value);
+			relay->removed = true;
 		}
 	}
 
@@ -671,6 +775,9 @@ int _kv_store_unset(sid_resource_t         *kv_store_res,
 			break;
 	}
 
+	if (relay.removed)
+		kv_store->gen++;
+
 	return relay.ret_code;
 }
 
@@ -744,6 +851,8 @@ static void _kv_store_rollback_value(sid_resource_t        *kv_store_res,
 {
 	struct kv_store *kv_store = sid_resource_get_data(kv_store_res);
 
+	kv_store->gen++;
+
 	switch (kv_store->backend) {
 		case KV_STORE_BACKEND_HASH:
 			hash_update(kv_store->ht,
@@ -766,6 +875,12 @@ static void _kv_store_rollback_value(sid_resource_t        *kv_store_res,
 	}
 }
 
+uint64_t kv_store_get_generation(sid_resource_t *kv_store_res)
+{
+	struct kv_store *kv_store = sid_resource_get_data(kv_store_res);
+	return kv_store->gen;
+}
+
 bool kv_store_in_transaction(sid_resource_t *kv_store_res)
 {
 	struct kv_store *kv_store = sid_resource_get_data(kv_store_res);
@@ -785,7 +900,9 @@ int kv_store_transaction_begin(sid_resource_t *kv_store_res)
 	if (!(rollback_buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
 	                                                                   .type    = SID_BUFFER_TYPE_LINEAR,
 	                                                                   .mode    = SID_BUFFER_MODE_PLAIN}),
-	                                       &((struct sid_buffer_init) {.size = 0, .alloc_step = 1, .limit = 0}),
+	                                       &((struct sid_buffer_init) {.size       = 0,
+	                                                                   .alloc_step = TRANS_ROLLBACK_BUF_ALLOC_STEP,
+	                                                                   .limit      = 0}),
 	                                       &r))) {
 		log_error_errno(ID(kv_store_res), r, "Failed to create transaction rollback tracker buffer");
 		goto fail;
@@ -793,7 +910,9 @@ int kv_store_transaction_begin(sid_resource_t *kv_store_res)
 	if (!(unset_buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
 	                                                                .type    = SID_BUFFER_TYPE_LINEAR,
 	                                                                .mode    = SID_BUFFER_MODE_PLAIN}),
-	                                    &((struct sid_buffer_init) {.size = 0, .alloc_step = 1, .limit = 0}),
+	                                    &((struct sid_buffer_init) {.size       = 0,
+	                                                                .alloc_step = TRANS_UNSET_BUF_ALLOC_STEP,
+	                                                                .limit      = 0}),
 	                                    &r))) {
 		log_error_errno(ID(kv_store_res), r, "Failed to create transaction unset tracker buffer");
 		goto fail;
@@ -858,7 +977,9 @@ kv_store_iter_t *kv_store_iter_create(sid_resource_t *kv_store_res, const char *
 	switch (iter->store->backend) {
 		case KV_STORE_BACKEND_HASH:
 			// TODO: use key_start and key_end
-			iter->ht.current = NULL;
+			iter->ht.current    = NULL;
+			iter->ht.prefix     = NULL;
+			iter->ht.prefix_len = 0;
 			break;
 
 		case KV_STORE_BACKEND_BPTREE:
@@ -872,6 +993,33 @@ kv_store_iter_t *kv_store_iter_create(sid_resource_t *kv_store_res, const char *
 	return iter;
 }
 
+kv_store_iter_t *kv_store_iter_create_prefix(sid_resource_t *kv_store_res, const char *prefix, size_t prefix_len)
+{
+	kv_store_iter_t *iter;
+
+	if (!(iter = malloc(sizeof(*iter))))
+		return NULL;
+
+	iter->store = sid_resource_get_data(kv_store_res);
+
+	switch (iter->store->backend) {
+		case KV_STORE_BACKEND_HASH:
+			iter->ht.current    = NULL;
+			iter->ht.prefix     = prefix;
+			iter->ht.prefix_len = prefix ? prefix_len : 0;
+			break;
+
+		case KV_STORE_BACKEND_BPTREE:
+			if (!(iter->bpt.iter = bptree_iter_create_prefix(iter->store->bpt, prefix, prefix_len))) {
+				free(iter);
+				iter = NULL;
+			}
+			break;
+	};
+
+	return iter;
+}
+
 void *kv_store_iter_current(kv_store_iter_t *iter, size_t *size, kv_store_value_flags_t *flags)
 {
 	struct kv_store_value *value;
@@ -921,7 +1069,10 @@ int kv_store_iter_current_size(kv_store_iter_t *iter,
 			break;
 	}
 
-	if (value->ext_flags & KV_STORE_VALUE_VECTOR) {
+	if (value->int_flags & KV_STORE_VALUE_INT_PACKED) {
+		iov_size  = sizeof(struct kv_store_value_packed) + value->size * sizeof(uint32_t);
+		data_size = ((struct kv_store_value_packed *) value->data)->end[value->size - 1];
+	} else if (value->ext_flags & KV_STORE_VALUE_VECTOR) {
 		int           i;
 		struct iovec *iov;
 
@@ -951,6 +1102,41 @@ int kv_store_iter_current_size(kv_store_iter_t *iter,
 	return 0;
 }
 
+int kv_store_iter_current_vector_size(kv_store_iter_t *iter, size_t *unpacked_size, size_t *view_size)
+{
+	struct kv_store_value        *value;
+	struct kv_store_value_packed *packed;
+	size_t                        int_size, int_data_size, ext_size, ext_data_size;
+
+	if (!unpacked_size || !view_size ||
+	    kv_store_iter_current_size(iter, &int_size, &int_data_size, &ext_size, &ext_data_size) < 0)
+		return -1;
+
+	switch (iter->store->backend) {
+		case KV_STORE_BACKEND_HASH:
+			value = hash_get_data(iter->store->ht, iter->ht.current, NULL);
+			break;
+
+		case KV_STORE_BACKEND_BPTREE:
+			value = bptree_iter_current(iter->bpt.iter, NULL, NULL, NULL);
+			break;
+
+		default:
+			return -ENOTSUP;
+	}
+
+	if (value->int_flags & KV_STORE_VALUE_INT_PACKED) {
+		packed         = (struct kv_store_value_packed *) value->data;
+		*unpacked_size = sizeof(*value) + value->size * sizeof(struct iovec) + int_data_size;
+		*view_size     = packed->iov ? value->size * sizeof(struct iovec) : 0;
+	} else {
+		*unpacked_size = int_size;
+		*view_size     = 0;
+	}
+
+	return 0;
+}
+
 const char *kv_store_iter_current_key(kv_store_iter_t *iter)
 {
 	const char *key;
@@ -971,8 +1157,14 @@ void *kv_store_iter_next(kv_store_iter_t *iter, size_t *size, const char **retur
 {
 	switch (iter->store->backend) {
 		case KV_STORE_BACKEND_HASH:
-			iter->ht.current = iter->ht.current ? hash_get_next(iter->store->ht, iter->ht.current)
-			                                    : hash_get_first(iter->store->ht);
+			/* hash has no key ordering, so filter out keys not matching the prefix */
+			do {
+				iter->ht.current = iter->ht.current ? hash_get_next(iter->store->ht, iter->ht.current)
+				                                    : hash_get_first(iter->store->ht);
+			} while (iter->ht.current && iter->ht.prefix_len &&
+			         strncmp(hash_get_key(iter->store->ht, iter->ht.current, NULL),
+			                 iter->ht.prefix,
+			                 iter->ht.prefix_len));
 			break;
 
 		case KV_STORE_BACKEND_BPTREE:
@@ -991,7 +1183,9 @@ void kv_store_iter_reset(kv_store_iter_t *iter, const char *key_start, const cha
 	switch (iter->store->backend) {
 		case KV_STORE_BACKEND_HASH:
 			// TODO: use key_start and key_end
-			iter->ht.current = NULL;
+			iter->ht.current    = NULL;
+			iter->ht.prefix     = NULL;
+			iter->ht.prefix_len = 0;
 			break;
 
 		case KV_STORE_BACKEND_BPTREE:
@@ -1000,6 +1194,21 @@ void kv_store_iter_reset(kv_store_iter_t *iter, const char *key_start, const cha
 	}
 }
 
+void kv_store_iter_reset_prefix(kv_store_iter_t *iter, const char *prefix, size_t prefix_len)
+{
+	switch (iter->store->backend) {
+		case KV_STORE_BACKEND_HASH:
+			iter->ht.current    = NULL;
+			iter->ht.prefix     = prefix;
+			iter->ht.prefix_len = prefix ? prefix_len : 0;
+			break;
+
+		case KV_STORE_BACKEND_BPTREE:
+			bptree_iter_reset_prefix(iter->bpt.iter, prefix, prefix_len);
+			break;
+	}
+}
+
 void kv_store_iter_destroy(kv_store_iter_t *iter)
 {
 	switch (iter->store->backend) {
@@ -1030,6 +1239,26 @@ size_t kv_store_num_entries(sid_resource_t *kv_store_res)
 	}
 }
 
+size_t kv_store_iter_count_prefix(sid_resource_t *kv_store_res, const char *prefix, size_t prefix_len)
+{
+	kv_store_iter_t *iter;
+	const char      *key;
+	size_t           count = 0;
+
+	if (!prefix_len)
+		return kv_store_num_entries(kv_store_res);
+
+	if (!(iter = kv_store_iter_create_prefix(kv_store_res, prefix, prefix_len)))
+		return 0;
+
+	do {
+		(void) kv_store_iter_next(iter, NULL, &key, NULL);
+	} while (key && ++count);
+
+	kv_store_iter_destroy(iter);
+	return count;
+}
+
 size_t kv_store_get_size(sid_resource_t *kv_store_res, size_t *meta_size, size_t *data_size)
 {
 	struct kv_store *kv_store = sid_resource_get_data(kv_store_res);
@@ -1046,6 +1275,19 @@ size_t kv_store_get_size(sid_resource_t *kv_store_res, size_t *meta_size, size_t
 	}
 }
 
+int kv_store_compact(sid_resource_t *kv_store_res)
+{
+	struct kv_store *kv_store = sid_resource_get_data(kv_store_res);
+
+	switch (kv_store->backend) {
+		case KV_STORE_BACKEND_BPTREE:
+			return bptree_compact(kv_store->bpt);
+
+		default:
+			return 0;
+	}
+}
+
 static int _init_kv_store(sid_resource_t *kv_store_res, const void *kickstart_data, void **data)
 {
 	const struct sid_kv_store_resource_params *params = kickstart_data;
@@ -1071,6 +1313,17 @@ static int _init_kv_store(sid_resource_t *kv_store_res, const void *kickstart_da
 				log_error(ID(kv_store_res), "Failed to create B+ tree for key-value store.");
 				goto out;
 			}
+
+			if (params->bptree.merge_threshold &&
+			    bptree_set_merge_threshold(kv_store->bpt, params->bptree.merge_threshold) < 0) {
+				log_error(ID(kv_store_res),
+				          "Invalid B+ tree merge threshold %u%% for key-value store.",
+				          params->bptree.merge_threshold);
+				bptree_destroy(kv_store->bpt);
+				goto out;
+			}
+
+			bptree_set_lazy_remove(kv_store->bpt, params->bptree.lazy_remove);
 	}
 
 	*data = kv_store;
@@ -1084,6 +1337,10 @@ static int _destroy_kv_store(sid_resource_t *kv_store_res)
 {
 	struct kv_store *kv_store = sid_resource_get_data(kv_store_res);
 
+	/* a transaction might still be open if the store is destroyed while it is being updated */
+	if (kv_store_in_transaction(kv_store_res))
+		kv_store_transaction_end(kv_store_res, true);
+
 	switch (kv_store->backend) {
 		case KV_STORE_BACKEND_HASH:
 			hash_iter(kv_store->ht, _hash_destroy_kv_store_value);
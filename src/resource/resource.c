@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <systemd/sd-daemon.h>
@@ -102,6 +103,7 @@ typedef struct sid_resource_event_source {
 	const char         *name;
 	uint64_t            events_fired;
 	uint64_t            events_max;
+	uint64_t            events_deferred;
 	void               *handler;
 	void               *data;
 } sid_resource_event_source_t;
@@ -132,6 +134,9 @@ static int _create_event_source(sid_resource_t               *res,
 	new_es->handler      = handler;
 	new_es->data         = data;
 
+	/* counted by the handlers, see sid_resource_count_event_source_deferral */
+	new_es->events_deferred = 0;
+
 	sd_event_source_set_userdata(sd_es, new_es);
 	if (name) {
 		/*
@@ -1006,6 +1011,20 @@ int sid_resource_get_event_source_counter(sid_resource_event_source_t *es, uint6
 	return 0;
 }
 
+int sid_resource_count_event_source_deferral(sid_resource_event_source_t *es)
+{
+	es->events_deferred++;
+	return 0;
+}
+
+int sid_resource_get_event_source_deferrals(sid_resource_event_source_t *es, uint64_t *events_deferred)
+{
+	if (events_deferred)
+		*events_deferred = es->events_deferred;
+
+	return 0;
+}
+
 int sid_resource_destroy_event_source(sid_resource_event_source_t **es)
 {
 	_destroy_event_source(*es);
@@ -1271,6 +1290,7 @@ static void _write_event_source_elem_fields(sid_resource_event_source_t *es,
 	print_str_field(format, outbuf, level, "name", (char *) es->name, false);
 	print_uint64_field(format, outbuf, level, "events_max", es->events_max, true);
 	print_uint64_field(format, outbuf, level, "events_fired", es->events_fired, true);
+	print_uint64_field(format, outbuf, level, "events_deferred", es->events_deferred, true);
 }
 
 static void _write_resource_elem_fields(sid_resource_t *res, output_format_t format, struct sid_buffer *outbuf, int level)
@@ -1298,30 +1318,119 @@ static void _write_resource_elem_fields(sid_resource_t *res, output_format_t for
 	print_uint_field(format, outbuf, level, "ref-count", res->ref_count, true);
 }
 
-int sid_resource_write_tree_recursively(sid_resource_t    *res,
-                                        output_format_t    format,
-                                        struct sid_buffer *outbuf,
-                                        int                level,
-                                        bool               with_comma)
+static bool _resource_matches_write_spec(sid_resource_t *res, struct sid_resource_write_spec *spec)
 {
-	sid_resource_t *child_res;
-	int             count, item = 0;
+	return !spec->type_name || (res->type && res->type->name && !strcmp(res->type->name, spec->type_name));
+}
+
+static bool _resource_descend_for_write(struct sid_resource_write_spec *spec, unsigned depth)
+{
+	return !spec->max_depth || depth < spec->max_depth;
+}
+
+static int _flush_resource_write_outbuf(struct sid_resource_write_spec *spec, struct sid_buffer *outbuf)
+{
+	int r;
+
+	if (spec->fd < 0 || sid_buffer_count(outbuf) < spec->flush_size)
+		return 0;
+
+	if ((r = sid_buffer_write_all(outbuf, spec->fd)) < 0)
+		return r;
+
+	/* keep the allocated memory for the rest of the output */
+	return sid_buffer_rewind(outbuf, 0, SID_BUFFER_POS_ABS);
+}
+
+/*
+ * Position in the output where resources are written to. The "children" array of a resource
+ * is started only with the first matching descendant, so the tree is walked just once.
+ */
+struct write_tree_level {
+	int  level;      /* level of the elements written here */
+	bool lazy_array; /* elements go into "children" array, not started yet if there's no element written */
+	bool with_comma; /* some element written already, the next one needs a comma */
+};
 
-	count = list_size(&res->children);
+static int _write_tree(sid_resource_t                 *res,
+                       struct sid_resource_write_spec *spec,
+                       struct sid_buffer              *outbuf,
+                       unsigned                        depth,
+                       struct write_tree_level        *tree_level)
+{
+	struct write_tree_level child_level;
+	sid_resource_t         *child_res;
+	int                     r;
+
+	/* Resources not matching the spec are skipped over, their matching descendants are written in their place. */
+	if (!_resource_matches_write_spec(res, spec)) {
+		if (_resource_descend_for_write(spec, depth)) {
+			list_iterate_items (child_res, &res->children) {
+				if ((r = _write_tree(child_res, spec, outbuf, depth + 1, tree_level)) < 0)
+					return r;
+			}
+		}
+		return 0;
+	}
 
-	print_start_elem(format, outbuf, level, with_comma);
-	_write_resource_elem_fields(res, format, outbuf, level + 1);
-	if (count > 0) {
-		print_start_array(format, outbuf, level + 1, "children", true);
+	if (tree_level->lazy_array && !tree_level->with_comma)
+		print_start_array(spec->format, outbuf, tree_level->level - 1, "children", true);
+
+	print_start_elem(spec->format, outbuf, tree_level->level, tree_level->with_comma);
+	tree_level->with_comma = true;
+	_write_resource_elem_fields(res, spec->format, outbuf, tree_level->level + 1);
+
+	child_level = (struct write_tree_level) {.level = tree_level->level + 2, .lazy_array = true, .with_comma = false};
+
+	if (_resource_descend_for_write(spec, depth)) {
 		list_iterate_items (child_res, &res->children) {
-			sid_resource_write_tree_recursively(child_res, format, outbuf, level + 2, item > 0);
-			item++;
+			if ((r = _write_tree(child_res, spec, outbuf, depth + 1, &child_level)) < 0)
+				return r;
 		}
-		print_end_array(format, outbuf, level + 1);
 	}
-	print_end_elem(format, outbuf, level);
 
-	return 0;
+	if (child_level.with_comma)
+		print_end_array(spec->format, outbuf, tree_level->level + 1);
+
+	print_end_elem(spec->format, outbuf, tree_level->level);
+
+	return _flush_resource_write_outbuf(spec, outbuf);
+}
+
+/*
+ * Write resource tree starting with 'res' to 'outbuf'. If spec->fd is set, the outbuf is
+ * flushed to the fd whenever it fills up to spec->flush_size so the whole tree is never
+ * kept in memory. The outbuf must be in plain mode then and it's up to the caller to flush
+ * whatever is left in outbuf at the end.
+ */
+int sid_resource_write_tree(sid_resource_t                 *res,
+                            struct sid_resource_write_spec *spec,
+                            struct sid_buffer              *outbuf,
+                            int                             level,
+                            bool                            with_comma)
+{
+	return _write_tree(res,
+	                   spec,
+	                   outbuf,
+	                   1,
+	                   &((struct write_tree_level) {.level = level, .lazy_array = false, .with_comma = with_comma}));
+}
+
+int sid_resource_write_tree_recursively(sid_resource_t    *res,
+                                        output_format_t    format,
+                                        struct sid_buffer *outbuf,
+                                        int                level,
+                                        bool               with_comma)
+{
+	return sid_resource_write_tree(res,
+	                               &((struct sid_resource_write_spec) {.format     = format,
+	                                                                   .fd         = -1,
+	                                                                   .flush_size = 0,
+	                                                                   .max_depth  = 0,
+	                                                                   .type_name  = NULL}),
+	                               outbuf,
+	                               level,
+	                               with_comma);
 }
 
 /*
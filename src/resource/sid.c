@@ -37,7 +37,10 @@ static int _on_sid_signal_event(sid_resource_event_source_t *es, const struct si
 			break;
 		case SIGPIPE:
 			break;
-		case SIGHUP: /* TODO: Reload config on SIGHUP? */
+		case SIGHUP:
+			if ((ubridge_res =
+			             sid_resource_search(res, SID_RESOURCE_SEARCH_IMM_DESC, &sid_resource_type_ubridge, NULL)))
+				(void) ubridge_reload_params(ubridge_res);
 			break;
 		case SIGUSR1:
 			if ((ubridge_res =
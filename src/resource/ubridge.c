@@ -25,7 +25,10 @@
 #include "iface/iface_internal.h"
 #include "internal/bitmap.h"
 #include "internal/formatter.h"
+#include "internal/hash.h"
+#include "internal/list.h"
 #include "internal/mem.h"
+#include "internal/param.h"
 #include "internal/util.h"
 #include "log/log.h"
 #include "resource/kv-store.h"
@@ -38,8 +41,12 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <libudev.h>
+#include <limits.h>
+#include <poll.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -76,7 +83,6 @@
 #define KV_INDEX_REMOVE                             2
 
 #define KV_PREFIX_OP_SYNC_C                         ">"
-#define KV_PREFIX_OP_SYNC_END_C                     "?" /* right after '>' */
 #define KV_PREFIX_OP_ILLEGAL_C                      "X"
 #define KV_PREFIX_OP_SET_C                          ""
 #define KV_PREFIX_OP_PLUS_C                         "+"
@@ -112,6 +118,8 @@
 
 #define OWNER_CORE                                  MOD_NAME_CORE
 #define DEFAULT_VALUE_FLAGS_CORE                    KV_SYNC_P | KV_MOD_RESERVED
+/* Internal value flag, set instead of KV_SYNC once the record is exported, not settable by modules. */
+#define KV_SYNCED                                   ((sid_ucmd_kv_flags_t) UINT64_C(0x4000000000000000))
 
 #define CMD_DEV_NAME_NUM_FMT                        "%s (%d:%d)"
 #define CMD_DEV_NAME_NUM(ucmd_ctx)                                                                                                 \
@@ -122,23 +130,228 @@ const sid_resource_type_t sid_resource_type_ubridge_common;
 const sid_resource_type_t sid_resource_type_ubridge_connection;
 const sid_resource_type_t sid_resource_type_ubridge_command;
 
+#define MAIN_KV_STORE_SYNC_MAX_RECORDS 4096 /* default max records to sync within one event loop iteration */
+#define MAIN_KV_STORE_SYNC_MAX_USEC    5000 /* default max time to spend syncing within one event loop iteration */
+
+#define RESOURCES_WRITE_FLUSH_SIZE 16384 /* flush resource tree output whenever this much is buffered */
+
+#define SPEC_SCAN_MAX_ENTRIES     256      /* max speculative scans to keep track of */
+#define SPEC_SCAN_TIMEOUT_USEC    10000000 /* max time to wait for a speculative scan to finish */
+#define SPEC_SCAN_MAX_WORKERS     1        /* default max workers executing speculative scans at a time */
+#define SPEC_SCAN_MAX_WORKERS_MAX 64       /* upper limit for configured max workers executing speculative scans */
+
+#define SCAN_MEMO_MAX_ENTRIES 4096                           /* max devices to keep memoized scan result for */
+#define SCAN_MEMO_MAX_DEPS    (2 * SCAN_MEMO_MAX_ENTRIES)    /* max devices to track record changes for */
+#define SCAN_MEMO_HASH_OFFSET UINT64_C(14695981039346656037) /* FNV-1a offset basis for udev environment hash */
+#define SCAN_MEMO_HASH_PRIME  UINT64_C(1099511628211)        /* FNV-1a prime for udev environment hash */
+
+#define ACCEPT_BUDGET     4    /* default max client connections to accept within one event loop iteration */
+#define ACCEPT_BUDGET_MAX 1024 /* upper limit for configured accept budget */
+
+#define KV_VIEW_INITIAL_SIZE 65536 /* initial size of shared KV view, doubled whenever it gets too small */
+
+#define CONN_BUF_SIZE     8192    /* default initial size of client connection buffer, fits usual scan request with udev env */
+#define CONN_BUF_SIZE_MIN 1024    /* lower limit for configured initial size of client connection buffer */
+#define CONN_BUF_SIZE_MAX 1048576 /* upper limit for configured initial size of client connection buffer */
+
+#define WORKER_ACCEPT_CHECK_USEC 1000000 /* how often to check the worker holding the accept token is still there */
+
+/* main KV store records in shared KV view: device ready and reserved states and aliases */
+#define KV_VIEW_PREFIX_DEVICE                                                                                                      \
+	KV_PREFIX_OP_SET_C KV_STORE_KEY_JOIN ID_NULL KV_STORE_KEY_JOIN KV_PREFIX_NS_DEVICE_C KV_STORE_KEY_JOIN
+#define KV_VIEW_PREFIX_ALIAS KV_PREFIX_OP_SET_C KV_STORE_KEY_JOIN KV_KEY_DOM_ALIAS KV_STORE_KEY_JOIN
+
+#define KEY_VERBOSE               "VERBOSE"
+#define KEY_SPECULATIVE_SCAN      "SPECULATIVE_SCAN"
+#define KEY_SPEC_SCAN_MAX_WORKERS "SPEC_SCAN_MAX_WORKERS"
+#define KEY_ACCEPT_BUDGET         "ACCEPT_BUDGET"
+#define KEY_KV_VIEW               "KV_VIEW"
+#define KEY_WORKER_ACCEPT         "WORKER_ACCEPT"
+#define KEY_SYNC_MAX_RECORDS      "SYNC_MAX_RECORDS"
+#define KEY_SYNC_MAX_USEC         "SYNC_MAX_USEC"
+#define KEY_CONN_BUF_SIZE         "CONN_BUF_SIZE"
+#define KEY_SCAN_MEMO             "SCAN_MEMO"
+#define KEY_DEBUG_DEVNO           "DEBUG_DEVNO"
+#define KEY_DEBUG_NAME            "DEBUG_NAME"
+#define KEY_DEBUG_MODULE          "DEBUG_MODULE"
+#define KEY_DEBUG_CMD             "DEBUG_CMD"
+
+#define SYNC_MAX_USEC_MAX 1000000 /* upper limit for configured sync time slice */
+#define DEBUG_FILTER_MAX  255     /* maximum length of debug filter value */
+
+#define PARAMS_SYSCONFIG_FILE SYSCONFIGDIR "/sid.sysconfig"
+
+struct kv_sync {
+	struct list     list;               /* link in main KV store sync queue */
+	char           *shm;                /* mapped KV store export, NULL if nothing to sync */
+	size_t          shm_size;           /* size of mapped KV store export */
+	size_t          offset;             /* offset of next record to apply, 0 if the sync has not started yet */
+	sid_resource_t *worker_control_res; /* worker control of the worker to ack */
+	char           *worker_id;          /* worker to ack once the sync is complete, NULL if no ack needed */
+	void           *ack_data;           /* ack message to send back to the worker */
+	size_t          ack_data_size;      /* ack message size */
+};
+
+/* Uevent identification, used to match speculative scan with scan requested by udev. */
+struct spec_scan_key {
+	uint64_t seqnum;
+	dev_t    devno;
+} __attribute__((packed));
+
+typedef enum {
+	SPEC_SCAN_QUEUED,    /* waiting to be dispatched to a worker */
+	SPEC_SCAN_RUNNING,   /* being executed by a worker */
+	SPEC_SCAN_DONE,      /* result available */
+	SPEC_SCAN_CLAIMED,   /* udev asked for the result before the scan started, scan is not done speculatively */
+	SPEC_SCAN_ABANDONED, /* timed out, the worker may still be executing it, but its result is not going to be used */
+} spec_scan_state_t;
+
+struct spec_scan {
+	struct list                  list;               /* link in speculative scan list, ordered by uevent arrival */
+	struct spec_scan_key         key;                /* uevent the scan is done for */
+	spec_scan_state_t            state;              /* current state */
+	void                        *req_data;           /* request to send to worker (header, devno and udev environment) */
+	size_t                       req_data_size;      /* request size */
+	void                        *deps;               /* udev properties the scan depends on which are not in request */
+	size_t                       deps_size;          /* size of deps */
+	int                          result_fd;          /* memfd with response for udev, -1 if not available */
+	int                          exp_fd;             /* memfd with KV store exports, applied only if result is used */
+	uint64_t                     kv_gen;             /* main KV store generation the worker started with */
+	bool                         foreign;            /* the scan looked up records of other devices */
+	sid_resource_t              *worker_control_res; /* worker control of the workers executing and waiting for the scan */
+	char                        *worker_id;          /* worker executing the scan, NULL if not dispatched yet */
+	sid_resource_event_source_t *timer_es;           /* time event source to abandon the scan taking too long */
+	char                        *waiter_id;          /* worker waiting for the result, NULL if none */
+	void                        *waiter_data;        /* fetch request from waiting worker */
+	size_t                       waiter_data_size;   /* fetch request size */
+};
+
+/* Scan request from udev to look up memoized result for. */
+struct scan_memo_key {
+	struct spec_scan_key uevent;   /* uevent the scan is requested for, devno identifies the memo */
+	uint64_t             env_hash; /* hash of udev environment from request, without SEQNUM */
+} __attribute__((packed));
+
+/* Scan result to memoize, sent by worker with device number, device identifier and udev environment appended. */
+struct scan_memo_store {
+	struct scan_memo_key key;        /* scan request the result is for */
+	uint64_t             kv_gen;     /* main KV store generation the worker started with */
+	uint64_t             exp_kv_gen; /* main KV store generation the scan's exports were synced with, 0 if none */
+	bool                 foreign;    /* the scan looked up records of other devices */
+} __attribute__((packed));
+
+/*
+ * Result of the last scan for a device, reused for scans with the same udev environment.
+ * The result is valid as long as main KV store records the scan depends on did not change.
+ */
+struct scan_memo {
+	struct list list;        /* link in scan memo list, least recently used first */
+	dev_t       devno;       /* device the scan was done for */
+	uint64_t    env_hash;    /* hash of udev environment the scan was done with, without SEQNUM */
+	void       *env;         /* udev environment the scan was done with, without SEQNUM */
+	size_t      env_size;    /* size of env */
+	char       *num_s;       /* device number string, records of the device the result depends on */
+	char       *uid_s;       /* device identifier string, NULL if none */
+	bool        foreign;     /* the result depends on records of other devices too */
+	uint64_t    kv_gen;      /* main KV store generation the result was stored with */
+	void       *result;      /* exact response for udev */
+	size_t      result_size; /* size of result */
+};
+
+/* Main KV store generations of the last two exports which changed a set of records. */
+struct scan_memo_dep {
+	uint64_t kv_gen;      /* generation of the last export changing the records */
+	uint64_t prev_kv_gen; /* generation of the export changing the records before that */
+};
+
+/* Client connection accepted by a worker which could not serve it, handed back to main process. */
+struct bounced_conn {
+	struct list list; /* link in bounced connection list */
+	int         fd;   /* client connection */
+};
+
 struct sid_ucmd_common_ctx {
-	sid_resource_t    *res;          /* resource representing this common ctx */
-	sid_resource_t    *modules_res;  /* top-level resource for all ucmd module registries */
-	sid_resource_t    *kv_store_res; /* main KV store or KV store snapshot */
-	uint16_t           gennum;       /* current KV store generation number */
-	struct sid_buffer *gen_buf;      /* generic buffer */
+	sid_resource_t        *res;           /* resource representing this common ctx */
+	sid_resource_t        *modules_res;   /* top-level resource for all ucmd module registries */
+	sid_resource_t        *kv_store_res;  /* main KV store or KV store snapshot */
+	uint16_t               gennum;        /* current KV store generation number */
+	struct sid_buffer     *gen_buf;       /* generic buffer */
+	struct param_registry *params;        /* runtime tuning parameters (changed in main process only) */
+	size_t                 conn_buf_size; /* initial size of client connection buffer */
+
+	struct {
+		struct list                  queue;       /* pending syncs of worker KV store exports with main KV store */
+		sid_resource_event_source_t *es;          /* deferred event source to resume syncing in next iteration */
+		sid_resource_event_source_t *held_es;     /* event source held until all pending syncs are complete */
+		sid_resource_event_source_t *compact_es;  /* deferred event source to compact main KV store when idle */
+		unsigned                     max_records; /* records to sync before yielding */
+		uint64_t                     max_usec;    /* time to spend syncing before yielding */
+	} sync;
+
+	struct {
+		bool                         enabled;     /* scan speculatively on kernel uevents */
+		struct list                  list;        /* speculative scans, ordered by uevent arrival */
+		unsigned                     nr_entries;  /* number of speculative scans in list */
+		unsigned                     max_workers; /* max workers executing speculative scans, including abandoned ones */
+		sid_resource_event_source_t *es;          /* deferred event source to dispatch next speculative scan */
+	} spec_scan;
+
+	struct {
+		bool                 enabled;    /* answer scans with unchanged input with memoized results */
+		uint64_t             kv_gen;     /* bumped with each KV store export synced, workers inherit it */
+		struct hash_table   *ht;         /* memoized scan results by devno */
+		struct list          list;       /* memoized scan results, least recently used first */
+		unsigned             nr_entries; /* number of memoized scan results */
+		struct hash_table   *dep_ht;     /* scan_memo_dep for records of single device, by device number or identifier */
+		struct scan_memo_dep shared;     /* scan_memo_dep for any other records */
+	} scan_memo;
+
+	struct {
+		bool                      enabled; /* keep shared read-only view of selected main KV store records */
+		bool                      dirty;   /* records in the view changed, the view needs to be rebuilt */
+		struct sid_kv_view_writer writer;  /* memfd with the view, handed over to clients */
+	} kv_view;
+
+	struct {
+		bool                         enabled;   /* workers accept client connections directly */
+		uint64_t                    *sync_gen;  /* number of KV store exports sent by workers, shared by all processes */
+		uint64_t                     fork_gen;  /* sync_gen when the worker holding the accept token was created */
+		char                        *token_id;  /* worker holding the accept token, NULL if none (main process) */
+		struct list                  bounced;   /* connections handed back by workers (main process) */
+		sid_resource_event_source_t *es;        /* deferred event source to hand the token over to new worker */
+		sid_resource_event_source_t *timer_es;  /* time event source to check the token holder is still there */
+		int                          socket_fd; /* inherited listening socket (worker process) */
+		int                          watch_fd;  /* exclusive watch of the listening socket (worker process) */
+		sid_resource_event_source_t *watch_es;  /* event source for watch_fd (worker process) */
+	} worker_accept;
+
+	/*
+	 * Commands matching all the filters set are handled with debug messages logged,
+	 * whatever the verbose mode is. Workers inherit the filters when forked.
+	 */
+	struct {
+		bool      enabled; /* at least one filter set */
+		int       major;   /* device major number, -1 if not filtering by device number */
+		int       minor;   /* device minor number, -1 if not filtering by device number */
+		char     *name;    /* device name glob, NULL if not filtering by device name */
+		char     *module;  /* device type module name, NULL if not filtering by module */
+		sid_cmd_t cmd;     /* command type, SID_CMD_UNDEFINED if not filtering by command */
+	} debug;
 };
 
 struct umonitor {
 	struct udev         *udev;
-	struct udev_monitor *mon;
+	struct udev_monitor *mon;  /* udev monitor for uevents processed by udev */
+	struct udev_monitor *kmon; /* kernel monitor for uevents before udev processes them (speculative scans) */
 };
 
 struct ubridge {
-	sid_resource_t *internal_res;
-	int             socket_fd;
-	struct umonitor umonitor;
+	sid_resource_t              *internal_res;
+	struct sid_ucmd_common_ctx  *common_ctx;
+	int                          socket_fd;
+	sid_resource_event_source_t *interface_es;
+	unsigned                     accept_budget;
+	struct umonitor              umonitor;
 };
 
 typedef enum {
@@ -173,8 +386,10 @@ struct udevice {
 };
 
 struct connection {
-	int                fd;
-	struct sid_buffer *buf;
+	int                          fd;
+	struct sid_buffer           *buf;
+	sid_resource_event_source_t *es;
+	bool                         closed;
 };
 
 typedef enum {
@@ -205,6 +420,26 @@ static const char *cmd_state_str[] = {[CMD_INITIALIZING]         = "CMD_INITIALI
                                       [CMD_OK]                   = "CMD_OK",
                                       [CMD_ERROR]                = "CMD_ERROR"};
 
+#define FOREIGN_KV_CACHE_SIZE 16
+#define UDEV_EXP_ALLOC_STEP   1024
+#define UDEV_EXP_HASH_SIZE    32
+
+/* Udev property in udev export block, KEY=VALUE\0 at 'offset' in the block. */
+struct udev_exp_item {
+	struct list list;   /* link in udev export item list, ordered by key and offset */
+	size_t      offset; /* offset of the property in the block */
+	size_t      size;   /* size of the property in the block, including the final '\0' */
+	char        key[];  /* property name */
+};
+
+struct kv_cache_entry {
+	char                   *fields;     /* NUL-separated owner, dom, ns_part, id_cat, id and core, NULL if unused */
+	sid_ucmd_kv_namespace_t ns;         /* namespace */
+	const void             *value;      /* cached value */
+	size_t                  value_size; /* cached value size, SIZE_MAX if record not found */
+	sid_ucmd_kv_flags_t     flags;      /* cached value flags */
+};
+
 struct sid_ucmd_ctx {
 	/* request */
 	msg_category_t        req_cat; /* request category */
@@ -216,6 +451,10 @@ struct sid_ucmd_ctx {
 			char          *uid_s; /* device identifier string */
 			char          *num_s; /* device number string (in "major_minor" format) */
 			struct udevice udev;
+			struct {
+				char devno_s[16];                 /* whole disk device number string (in "major:minor" format) */
+				char devid_s[UTIL_UUID_STR_SIZE]; /* whole disk device identifier string */
+			} disk;                                   /* whole disk info for a partition, resolved on first use */
 		} dev;
 
 		const char *exp_path; /* export path */
@@ -227,17 +466,66 @@ struct sid_ucmd_ctx {
 	/* cmd specific context */
 	union {
 		struct {
-			cmd_scan_phase_t phase; /* current scan phase */
+			cmd_scan_phase_t   phase;         /* current scan phase */
+			bool               spec_fetched;  /* speculative scan result already requested from main process */
+			int                spec_fd;       /* memfd with speculative or memoized scan result, -1 if not available */
+			void              *spec_env;      /* udev environment from request, to match with speculative scan */
+			size_t             spec_env_size; /* size of spec_env */
+			struct sid_buffer *spec_deps;     /* udev properties looked up, but not in speculative scan request */
+			uint64_t           memo_hash;     /* hash of udev environment to memoize the result with, 0 if not */
+			void              *memo_env;      /* udev environment from request, without SEQNUM */
+			size_t             memo_env_size; /* size of memo_env */
+			bool               memo_fetched;  /* memoized scan result already requested from main process */
+			bool               memo_hit;      /* spec_fd holds memoized scan result */
+			bool               foreign;       /* records of other devices looked up, the result depends on them */
+			uint64_t           memo_exp_gen;  /* main KV store generation the exports were synced with, 0 if none */
 		} scan;
 
 		struct {
-			void  *main_res_mem;      /* mmap-ed memory with result from main process */
-			size_t main_res_mem_size; /* overall size of main_res_mem */
+			int    fd;           /* memfd the response is written to, -1 if not created yet */
+			off_t  main_pos;     /* offset in fd where resource tree from main process starts */
+			bool   main_written; /* main process has written its resource tree to fd already */
+			void  *params;       /* KEY=VALUE pairs from request to select resources to write */
+			size_t params_size;  /* size of params */
 		} resources;
+
+		struct {
+			bool requested; /* shared KV view already requested from main process */
+			int  fd;        /* read-only memfd with shared KV view, -1 if not available */
+		} kv_view;
+
+		struct {
+			bool   requested;  /* parameters already requested from main process */
+			void  *list;       /* NAME or NAME=VALUE items from request */
+			size_t list_size;  /* size of list */
+			void  *reply;      /* parameters written by main process, NULL on failure */
+			size_t reply_size; /* size of reply */
+		} params;
 	};
 
+	/* cache for foreign KV lookups done during command execution */
+	struct {
+		struct kv_cache_entry entries[FOREIGN_KV_CACHE_SIZE];
+		unsigned              next;   /* index of next entry to replace */
+		uint64_t              kv_gen; /* KV store generation the entries are valid for */
+	} foreign_kv_cache;
+
+	/*
+	 * Udev records of the device marked for sync, exported as KEY=VALUE\0 pairs in key order,
+	 * ready to be copied to the response. The block is patched whenever such a record changes.
+	 */
+	struct {
+		char              *block;     /* KEY=VALUE\0 pairs */
+		size_t             size;      /* used size of block */
+		size_t             allocated; /* allocated size of block */
+		struct hash_table *ht;        /* udev_exp_item by property name */
+		struct list        items;     /* udev_exp_items in block order */
+		bool               failed;    /* block could not be updated, it is incomplete */
+	} udev_exp;
+
 	cmd_state_t                  state;          /* current command state */
 	sid_resource_event_source_t *cmd_handler_es; /* event source for deferred execution of _cmd_handler */
+	bool                         debug;          /* command matches debug filter, force debug messages while handling it */
 
 	/* response */
 	struct sid_msg_header res_hdr; /* response header */
@@ -384,6 +672,8 @@ struct sid_dbstats {
 	uint64_t value_int_data_size;
 	uint64_t value_ext_size;
 	uint64_t value_ext_data_size;
+	uint64_t value_view_size;
+	uint64_t value_unpacked_size;
 	uint64_t meta_size;
 	uint32_t nr_kv_pairs;
 };
@@ -393,7 +683,8 @@ typedef enum {
 	SELF_CMD_UNDEFINED = _SELF_CMD_START,
 	SELF_CMD_UNKNOWN,
 	SELF_CMD_DBDUMP,
-	_SELF_CMD_END = SELF_CMD_DBDUMP,
+	SELF_CMD_SCAN,
+	_SELF_CMD_END = SELF_CMD_SCAN,
 } self_cmd_t;
 
 typedef enum {
@@ -402,7 +693,17 @@ typedef enum {
 	SYSTEM_CMD_UNKNOWN,
 	SYSTEM_CMD_SYNC,
 	SYSTEM_CMD_RESOURCES,
-	_SYSTEM_CMD_END = SYSTEM_CMD_RESOURCES,
+	SYSTEM_CMD_SCAN_RESULT,
+	SYSTEM_CMD_SCAN_FETCH,
+	SYSTEM_CMD_KV_VIEW,
+	SYSTEM_CMD_ACCEPT_TOKEN,
+	SYSTEM_CMD_ACCEPT_REVOKE,
+	SYSTEM_CMD_ACCEPTED,
+	SYSTEM_CMD_PARAM_GET,
+	SYSTEM_CMD_PARAM_SET,
+	SYSTEM_CMD_SCAN_MEMO_FETCH,
+	SYSTEM_CMD_SCAN_MEMO_STORE,
+	_SYSTEM_CMD_END = SYSTEM_CMD_SCAN_MEMO_STORE,
 } system_cmd_t;
 
 struct sid_msg {
@@ -452,6 +753,7 @@ static bool _cmd_root_only[] = {
 	[SID_CMD_DBSTATS]    = true,
 	[SID_CMD_RESOURCES]  = true,
 	[SID_CMD_DEVICES]    = true,
+	[SID_CMD_KV_VIEW]    = true,
 };
 
 static struct cmd_reg      _cmd_scan_phase_regs[];
@@ -746,7 +1048,7 @@ static int _write_kv_store_stats(struct sid_dbstats *stats, sid_resource_t *kv_s
 	kv_store_iter_t *iter;
 	const char      *key;
 	size_t           size;
-	size_t           meta_size, int_size, int_data_size, ext_size, ext_data_size;
+	size_t           meta_size, int_size, int_data_size, ext_size, ext_data_size, unpacked_size, view_size;
 
 	memset(stats, 0, sizeof(*stats));
 	if (!(iter = kv_store_iter_create(kv_store_res, NULL, NULL))) {
@@ -756,11 +1058,14 @@ static int _write_kv_store_stats(struct sid_dbstats *stats, sid_resource_t *kv_s
 	while (kv_store_iter_next(iter, &size, &key, NULL)) {
 		stats->nr_kv_pairs++;
 		kv_store_iter_current_size(iter, &int_size, &int_data_size, &ext_size, &ext_data_size);
+		kv_store_iter_current_vector_size(iter, &unpacked_size, &view_size);
 		stats->key_size            += strlen(key) + 1;
 		stats->value_int_size      += int_size;
 		stats->value_int_data_size += int_data_size;
 		stats->value_ext_size      += ext_size;
 		stats->value_ext_data_size += ext_data_size;
+		stats->value_view_size     += view_size;
+		stats->value_unpacked_size += unpacked_size;
 	}
 	kv_store_get_size(kv_store_res, &meta_size, &int_size);
 	if (stats->value_int_size != int_size)
@@ -915,6 +1220,71 @@ static int _kv_cb_write(struct kv_store_update_spec *spec)
 	return 1;
 }
 
+/*
+ * Compare the two values, ignoring seqnum. KV_SYNC set only in the new value is not
+ * a change if the old value has already been synced with main KV store - the flag is
+ * replaced with KV_SYNCED in the old value then. A record which has never been synced
+ * and gets KV_SYNC now is a change.
+ */
+static bool _vvalue_unchanged(kv_vector_t *vvalue_old, size_t old_size, kv_vector_t *vvalue_new, size_t new_size)
+{
+	sid_ucmd_kv_flags_t old_flags = VVALUE_FLAGS(vvalue_old);
+	sid_ucmd_kv_flags_t new_flags = VVALUE_FLAGS(vvalue_new);
+	size_t              i;
+
+	if (old_flags & KV_SYNCED) {
+		old_flags &= ~KV_SYNCED;
+		new_flags &= ~KV_SYNC;
+	}
+
+	if ((old_size != new_size) || (old_flags != new_flags) ||
+	    (VVALUE_GENNUM(vvalue_old) != VVALUE_GENNUM(vvalue_new)) || strcmp(VVALUE_OWNER(vvalue_old), VVALUE_OWNER(vvalue_new)))
+		return false;
+
+	for (i = VVALUE_IDX_DATA; i < new_size; i++) {
+		if ((vvalue_old[i].iov_len != vvalue_new[i].iov_len) ||
+		    (vvalue_old[i].iov_len && memcmp(vvalue_old[i].iov_base, vvalue_new[i].iov_base, vvalue_old[i].iov_len)))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Like _kv_cb_write, but keep the old record if the new value is the same and do
+ * not mark it for sync - main KV store already has it. The exception are records
+ * in udev namespace which still need to be indexed so they're exported to udev
+ * with the result (these are not exported to main KV store with sync). The old
+ * value is returned in update_arg->custom.
+ */
+static int _kv_cb_write_changed(struct kv_store_update_spec *spec)
+{
+	struct kv_update_arg *update_arg = spec->arg;
+	kv_vector_t           tmp_vvalue_old[VVALUE_SINGLE_CNT];
+	kv_vector_t           tmp_vvalue_new[VVALUE_SINGLE_CNT];
+	kv_vector_t          *vvalue_old, *vvalue_new;
+	size_t                old_size, new_size;
+
+	if (!spec->old_data)
+		return _kv_cb_write(spec);
+
+	vvalue_old = _get_vvalue(spec->old_flags, spec->old_data, spec->old_data_size, tmp_vvalue_old);
+	vvalue_new = _get_vvalue(spec->new_flags, spec->new_data, spec->new_data_size, tmp_vvalue_new);
+	old_size   = spec->old_flags & KV_STORE_VALUE_VECTOR ? spec->old_data_size : VVALUE_SINGLE_CNT;
+	new_size   = spec->new_flags & KV_STORE_VALUE_VECTOR ? spec->new_data_size : VVALUE_SINGLE_CNT;
+
+	if (!_vvalue_unchanged(vvalue_old, old_size, vvalue_new, new_size))
+		return _kv_cb_write(spec);
+
+	if ((_get_ns_from_key(spec->key) == KV_NS_UDEV) && (VVALUE_FLAGS(vvalue_new) & KV_SYNC))
+		update_arg->ret_code = KV_INDEX_ADD;
+	else
+		update_arg->ret_code = KV_INDEX_NOOP;
+
+	update_arg->custom = spec->old_data;
+	return 0;
+}
+
 static const char *_get_mod_name(struct module *mod)
 {
 	return mod ? module_get_full_name(mod) : MOD_NAME_CORE;
@@ -1002,7 +1372,7 @@ static int _build_cmd_kv_buffers(sid_resource_t *cmd_res, const struct cmd_reg *
 	const char            *key;
 	void                  *raw_value;
 	bool                   vector;
-	size_t                 size, vvalue_size, key_size, data_offset;
+	size_t                 size, vvalue_size, key_size;
 	kv_store_value_flags_t kv_store_value_flags;
 	kv_vector_t           *vvalue;
 	unsigned               i, records = 0;
@@ -1026,7 +1396,9 @@ static int _build_cmd_kv_buffers(sid_resource_t *cmd_res, const struct cmd_reg *
 	 */
 
 	if (cmd_reg->flags & CMD_KV_EXPORT_SYNC)
-		iter = kv_store_iter_create(ucmd_ctx->common->kv_store_res, KV_PREFIX_OP_SYNC_C, KV_PREFIX_OP_SYNC_END_C);
+		iter = kv_store_iter_create_prefix(ucmd_ctx->common->kv_store_res,
+		                                   KV_PREFIX_OP_SYNC_C,
+		                                   sizeof(KV_PREFIX_OP_SYNC_C) - 1);
 	else
 		iter = kv_store_iter_create(ucmd_ctx->common->kv_store_res, NULL, NULL);
 
@@ -1068,6 +1440,18 @@ static int _build_cmd_kv_buffers(sid_resource_t *cmd_res, const struct cmd_reg *
 		print_start_array(format, export_buf, 1, "siddb", false);
 	}
 
+	if (cmd_reg->flags & CMD_KV_EXPORT_UDEV_TO_RESBUF) {
+		if (ucmd_ctx->udev_exp.failed) {
+			log_error(ID(cmd_res), "Incomplete udev export.");
+			r = -ENOMEM;
+			goto fail;
+		}
+
+		if (ucmd_ctx->udev_exp.size &&
+		    (r = sid_buffer_add(ucmd_ctx->res_buf, ucmd_ctx->udev_exp.block, ucmd_ctx->udev_exp.size, NULL, NULL)) < 0)
+			goto fail;
+	}
+
 	while ((raw_value = kv_store_iter_next(iter, &size, &key, &kv_store_value_flags))) {
 		vector = kv_store_value_flags & KV_STORE_VALUE_VECTOR;
 
@@ -1075,7 +1459,8 @@ static int _build_cmd_kv_buffers(sid_resource_t *cmd_res, const struct cmd_reg *
 			vvalue               = raw_value;
 			vvalue_size          = size;
 			svalue               = NULL;
-			VVALUE_FLAGS(vvalue) &= ~KV_SYNC;
+			if (VVALUE_FLAGS(vvalue) & KV_SYNC)
+				VVALUE_FLAGS(vvalue) = (VVALUE_FLAGS(vvalue) & ~KV_SYNC) | KV_SYNCED;
 			if (cmd_reg->flags & CMD_KV_EXPORT_PERSISTENT) {
 				if (!(VVALUE_FLAGS(vvalue) & KV_SYNC_P))
 					continue;
@@ -1084,7 +1469,8 @@ static int _build_cmd_kv_buffers(sid_resource_t *cmd_res, const struct cmd_reg *
 			vvalue        = NULL;
 			vvalue_size   = 0;
 			svalue        = raw_value;
-			svalue->flags &= ~KV_SYNC;
+			if (svalue->flags & KV_SYNC)
+				svalue->flags = (svalue->flags & ~KV_SYNC) | KV_SYNCED;
 			if (cmd_reg->flags & CMD_KV_EXPORT_PERSISTENT) {
 				if (!(svalue->flags & KV_SYNC_P))
 					continue;
@@ -1115,25 +1501,7 @@ static int _build_cmd_kv_buffers(sid_resource_t *cmd_res, const struct cmd_reg *
 				goto fail;
 			}
 
-			if (cmd_reg->flags & CMD_KV_EXPORT_UDEV_TO_RESBUF) {
-				key = _get_key_part(key, KEY_PART_CORE, NULL);
-				if (((r = sid_buffer_add(ucmd_ctx->res_buf, (void *) key, strlen(key), NULL, NULL)) < 0) ||
-				    (r = sid_buffer_add(ucmd_ctx->res_buf, KV_PAIR_C, 1, NULL, NULL) < 0))
-					goto fail;
-				data_offset = _svalue_ext_data_offset(svalue);
-				if (((r = sid_buffer_add(ucmd_ctx->res_buf,
-				                         svalue->data + data_offset,
-				                         strlen(svalue->data + data_offset),
-				                         NULL,
-				                         NULL)) < 0) ||
-				    ((r = sid_buffer_add(ucmd_ctx->res_buf, KV_END_C, 1, NULL, NULL)) < 0))
-					goto fail;
-				log_debug(ID(ucmd_ctx->common->kv_store_res),
-				          "Exported udev property %s=%s",
-				          key,
-				          svalue->data + data_offset);
-			}
-
+			/* already in udev export block added to response buffer above */
 			if (!(cmd_reg->flags & CMD_KV_EXPORT_UDEV_TO_EXPBUF))
 				continue;
 		} else { /* _get_ns_from_key(key) != KV_NS_UDEV */
@@ -2065,6 +2433,252 @@ out:
 	return r;
 }
 
+static bool _foreign_kv_cache_entry_match(struct kv_cache_entry *entry, const char *owner, struct kv_key_spec *key_spec)
+{
+	const char *fields[] = {owner, key_spec->dom, key_spec->ns_part, key_spec->id_cat, key_spec->id, key_spec->core};
+	const char *p        = entry->fields;
+	unsigned    i;
+
+	if (!p || entry->ns != key_spec->ns)
+		return false;
+
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+		if (strcmp(p, fields[i]))
+			return false;
+		p += strlen(p) + 1;
+	}
+
+	return true;
+}
+
+static struct kv_cache_entry *
+	_foreign_kv_cache_lookup(struct sid_ucmd_ctx *ucmd_ctx, const char *owner, struct kv_key_spec *key_spec)
+{
+	unsigned i;
+
+	for (i = 0; i < FOREIGN_KV_CACHE_SIZE; i++) {
+		if (_foreign_kv_cache_entry_match(&ucmd_ctx->foreign_kv_cache.entries[i], owner, key_spec))
+			return &ucmd_ctx->foreign_kv_cache.entries[i];
+	}
+
+	return NULL;
+}
+
+static void _foreign_kv_cache_add(struct sid_ucmd_ctx *ucmd_ctx,
+                                  const char          *owner,
+                                  struct kv_key_spec  *key_spec,
+                                  const void          *value,
+                                  size_t               value_size,
+                                  sid_ucmd_kv_flags_t  flags)
+{
+	const char            *fields[] = {owner, key_spec->dom, key_spec->ns_part, key_spec->id_cat, key_spec->id, key_spec->core};
+	size_t                 lens[sizeof(fields) / sizeof(fields[0])];
+	size_t                 size = 0;
+	struct kv_cache_entry *entry;
+	char                  *p;
+	unsigned               i;
+
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+		size += (lens[i] = strlen(fields[i]) + 1);
+
+	/* the cache is only an optimization, just skip adding the entry on allocation failure */
+	if (!(p = malloc(size)))
+		return;
+
+	entry = &ucmd_ctx->foreign_kv_cache.entries[ucmd_ctx->foreign_kv_cache.next];
+	free(entry->fields);
+
+	*entry = (struct kv_cache_entry) {.fields     = p,
+	                                  .ns         = key_spec->ns,
+	                                  .value      = value,
+	                                  .value_size = value_size,
+	                                  .flags      = flags};
+
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+		memcpy(p, fields[i], lens[i]);
+		p += lens[i];
+	}
+
+	ucmd_ctx->foreign_kv_cache.next = (ucmd_ctx->foreign_kv_cache.next + 1) % FOREIGN_KV_CACHE_SIZE;
+}
+
+/*
+ * Drop all entries if anything has been written to KV store since they were added.
+ * Any write, whatever the code path, can replace or free a cached value or add a
+ * record for which a negative result is cached.
+ */
+static void _foreign_kv_cache_validate(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	uint64_t kv_gen = kv_store_get_generation(ucmd_ctx->common->kv_store_res);
+	unsigned i;
+
+	if (kv_gen == ucmd_ctx->foreign_kv_cache.kv_gen)
+		return;
+
+	for (i = 0; i < FOREIGN_KV_CACHE_SIZE; i++) {
+		free(ucmd_ctx->foreign_kv_cache.entries[i].fields);
+		ucmd_ctx->foreign_kv_cache.entries[i].fields = NULL;
+	}
+
+	ucmd_ctx->foreign_kv_cache.kv_gen = kv_gen;
+}
+
+static void _foreign_kv_cache_destroy(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	unsigned i;
+
+	for (i = 0; i < FOREIGN_KV_CACHE_SIZE; i++)
+		free(ucmd_ctx->foreign_kv_cache.entries[i].fields);
+}
+
+/*
+ * Replace 'old_size' bytes at 'offset' in udev export block with room for 'new_size' bytes,
+ * shifting the rest of the block. Items starting with 'next' are the ones which follow.
+ */
+static int _udev_exp_splice(struct sid_ucmd_ctx *ucmd_ctx, size_t offset, size_t old_size, size_t new_size, struct list *next)
+{
+	size_t                end = offset + old_size;
+	size_t                allocated;
+	char                 *block;
+	struct list          *l;
+	struct udev_exp_item *item;
+
+	if (new_size == old_size)
+		return 0;
+
+	if (ucmd_ctx->udev_exp.size - old_size + new_size > ucmd_ctx->udev_exp.allocated) {
+		allocated = ucmd_ctx->udev_exp.size - old_size + new_size + UDEV_EXP_ALLOC_STEP;
+		if (!(block = realloc(ucmd_ctx->udev_exp.block, allocated)))
+			return -ENOMEM;
+		ucmd_ctx->udev_exp.block     = block;
+		ucmd_ctx->udev_exp.allocated = allocated;
+	}
+
+	memmove(ucmd_ctx->udev_exp.block + offset + new_size, ucmd_ctx->udev_exp.block + end, ucmd_ctx->udev_exp.size - end);
+	ucmd_ctx->udev_exp.size = ucmd_ctx->udev_exp.size - old_size + new_size;
+
+	/* items after the replaced part are shifted */
+	for (l = next; l != &ucmd_ctx->udev_exp.items; l = l->n) {
+		item         = list_item(l, struct udev_exp_item);
+		item->offset = item->offset - old_size + new_size;
+	}
+
+	return 0;
+}
+
+static void _udev_exp_remove(struct sid_ucmd_ctx *ucmd_ctx, struct udev_exp_item *item)
+{
+	(void) _udev_exp_splice(ucmd_ctx, item->offset, item->size, 0, item->list.n);
+
+	list_del(&item->list);
+	hash_remove(ucmd_ctx->udev_exp.ht, item->key, strlen(item->key) + 1);
+	free(item);
+}
+
+/* Insert new item with room for 'size' bytes, keeping items in key order. */
+static struct udev_exp_item *_udev_exp_insert(struct sid_ucmd_ctx *ucmd_ctx, const char *key, size_t key_size, size_t size)
+{
+	struct udev_exp_item *item;
+	struct list          *next;
+	size_t                offset = ucmd_ctx->udev_exp.size;
+
+	if (!ucmd_ctx->udev_exp.ht) {
+		if (!(ucmd_ctx->udev_exp.ht = hash_create(UDEV_EXP_HASH_SIZE)))
+			return NULL;
+		list_init(&ucmd_ctx->udev_exp.items);
+	}
+
+	for (next = ucmd_ctx->udev_exp.items.n; next != &ucmd_ctx->udev_exp.items; next = next->n) {
+		item = list_item(next, struct udev_exp_item);
+		if (strcmp(item->key, key) > 0) {
+			offset = item->offset;
+			break;
+		}
+	}
+
+	if (!(item = malloc(sizeof(*item) + key_size)))
+		return NULL;
+
+	item->offset = offset;
+	item->size   = size;
+	memcpy(item->key, key, key_size);
+
+	if (hash_insert(ucmd_ctx->udev_exp.ht, item->key, key_size, item, sizeof(item)) < 0) {
+		free(item);
+		return NULL;
+	}
+
+	if (_udev_exp_splice(ucmd_ctx, item->offset, 0, size, next) < 0) {
+		hash_remove(ucmd_ctx->udev_exp.ht, item->key, key_size);
+		free(item);
+		return NULL;
+	}
+
+	list_add(next, &item->list);
+	return item;
+}
+
+/*
+ * Update udev export block after udev record 'key' has been set to 'value' (NULL if unset).
+ * Unset records and records not marked for sync are not exported to udev so they are
+ * removed from the block. Properties are kept in key order, the same order in which the
+ * records are iterated in the KV store, so the response is the same as if it was built
+ * from the records directly.
+ */
+static void _udev_exp_update(struct sid_ucmd_ctx *ucmd_ctx,
+                             const char          *key,
+                             const char          *value,
+                             size_t               value_size,
+                             bool                 sync)
+{
+	struct udev_exp_item *item;
+	size_t                key_size = strlen(key) + 1;
+	size_t                value_len, size;
+	char                 *p;
+
+	item = ucmd_ctx->udev_exp.ht ? hash_lookup(ucmd_ctx->udev_exp.ht, key, key_size, NULL) : NULL;
+
+	if (!sync || !value) {
+		if (item)
+			_udev_exp_remove(ucmd_ctx, item);
+		return;
+	}
+
+	value_len = strnlen(value, value_size);
+	size      = key_size + value_len + 1;
+
+	if (item) {
+		if (_udev_exp_splice(ucmd_ctx, item->offset, item->size, size, item->list.n) < 0)
+			goto fail;
+		item->size = size;
+	} else if (!(item = _udev_exp_insert(ucmd_ctx, key, key_size, size)))
+		goto fail;
+
+	p    = mempcpy(ucmd_ctx->udev_exp.block + item->offset, key, key_size - 1);
+	*p++ = KV_PAIR_C[0];
+	p    = mempcpy(p, value, value_len);
+	*p   = '\0';
+	return;
+fail:
+	log_error(ID(ucmd_ctx->common->kv_store_res), "Failed to add udev property %s to udev export.", key);
+	ucmd_ctx->udev_exp.failed = true;
+}
+
+static void _udev_exp_destroy(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	struct udev_exp_item *item, *tmp_item;
+
+	if (!ucmd_ctx->udev_exp.ht)
+		return;
+
+	list_iterate_items_safe (item, tmp_item, &ucmd_ctx->udev_exp.items)
+		free(item);
+
+	hash_destroy(ucmd_ctx->udev_exp.ht);
+	free(ucmd_ctx->udev_exp.block);
+	memset(&ucmd_ctx->udev_exp, 0, sizeof(ucmd_ctx->udev_exp));
+}
+
 static void *_do_sid_ucmd_set_kv(struct module          *mod,
                                  struct sid_ucmd_ctx    *ucmd_ctx,
                                  const char             *dom,
@@ -2121,6 +2735,8 @@ static void *_do_sid_ucmd_set_kv(struct module          *mod,
 	if (!value)
 		value_size = 0;
 
+	flags &= ~KV_SYNCED;
+
 	VVALUE_HEADER_PREP(vvalue, ucmd_ctx->req_env.dev.udev.seqnum, flags, ucmd_ctx->common->gennum, (char *) owner);
 	VVALUE_DATA_PREP(vvalue, 0, value, value_size);
 
@@ -2130,20 +2746,25 @@ static void *_do_sid_ucmd_set_kv(struct module          *mod,
 	                                     .custom   = NULL,
 	                                     .ret_code = -EREMOTEIO};
 
+	/* Setting the same value again keeps the old record, _kv_cb_write_changed returns it in update_arg.custom. */
 	if (!(svalue = kv_store_set_value(ucmd_ctx->common->kv_store_res,
 	                                  key,
 	                                  vvalue,
 	                                  VVALUE_SINGLE_CNT,
 	                                  KV_STORE_VALUE_VECTOR,
 	                                  KV_STORE_VALUE_OP_MERGE,
-	                                  _kv_cb_write,
-	                                  &update_arg)))
+	                                  _kv_cb_write_changed,
+	                                  &update_arg)) &&
+	    !(svalue = update_arg.custom))
 		goto out;
 
 	if (value)
 		ret = svalue->data + _svalue_ext_data_offset(svalue);
 	else
 		ret = SID_UCMD_KV_UNSET;
+
+	if (ns == KV_NS_UDEV)
+		_udev_exp_update(ucmd_ctx, key_core, value, value_size, flags & KV_SYNC);
 out:
 	(void) _manage_kv_index(&update_arg, key);
 	_destroy_key(ucmd_ctx->common->gen_buf, key);
@@ -2172,6 +2793,23 @@ void *sid_ucmd_set_kv(struct module          *mod,
 	return _do_sid_ucmd_set_kv(mod, ucmd_ctx, dom, ns, key, flags, value, value_size);
 }
 
+/*
+ * Check if key_spec refers to records of other device than the one the command is for.
+ * Records with no device part in the key are not specific to any single device.
+ */
+static bool _is_foreign_dev_key_spec(struct sid_ucmd_ctx *ucmd_ctx, struct kv_key_spec *key_spec)
+{
+	switch (key_spec->ns) {
+		case KV_NS_UDEV:
+			return strcmp(key_spec->ns_part, ucmd_ctx->req_env.dev.num_s ?: ID_NULL);
+		case KV_NS_DEVICE:
+		case KV_NS_DEVMOD:
+			return strcmp(key_spec->ns_part, ucmd_ctx->req_env.dev.uid_s ?: ID_NULL);
+		default:
+			return false;
+	}
+}
+
 static const void *_cmd_get_key_spec_value(struct module       *mod,
                                            struct sid_ucmd_ctx *ucmd_ctx,
                                            struct kv_key_spec  *key_spec,
@@ -2187,6 +2825,12 @@ static const void *_cmd_get_key_spec_value(struct module       *mod,
 	if (!(key = _compose_key(ucmd_ctx->common->gen_buf, key_spec)))
 		goto out;
 
+	/* results of memoized and speculative scans are checked against changes of such records */
+	if (((ucmd_ctx->req_cat == MSG_CATEGORY_CLIENT && ucmd_ctx->req_hdr.cmd == SID_CMD_SCAN && ucmd_ctx->scan.memo_hash) ||
+	     (ucmd_ctx->req_cat == MSG_CATEGORY_SELF && ucmd_ctx->req_hdr.cmd == SELF_CMD_SCAN)) &&
+	    _is_foreign_dev_key_spec(ucmd_ctx, key_spec))
+		ucmd_ctx->scan.foreign = true;
+
 	if (!(svalue = kv_store_get_value(ucmd_ctx->common->kv_store_res, key, &size, NULL)))
 		goto out;
 
@@ -2205,7 +2849,7 @@ static const void *_cmd_get_key_spec_value(struct module       *mod,
 	}
 
 	if (flags)
-		*flags = svalue->flags;
+		*flags = svalue->flags & ~KV_SYNCED;
 
 	data_offset = _svalue_ext_data_offset(svalue);
 	size        -= (sizeof(*svalue) + data_offset);
@@ -2235,7 +2879,20 @@ static const void *_do_sid_ucmd_get_kv(struct module          *mod,
 	                               .id_cat  = ns == KV_NS_DEVMOD ? KV_PREFIX_NS_MODULE_C : ID_NULL,
 	                               .id      = ns == KV_NS_DEVMOD ? _get_ns_part(mod, ucmd_ctx, KV_NS_MODULE) : ID_NULL,
 	                               .core    = key};
-	return _cmd_get_key_spec_value(mod, ucmd_ctx, &key_spec, value_size, flags);
+	const void        *value;
+
+	value = _cmd_get_key_spec_value(mod, ucmd_ctx, &key_spec, value_size, flags);
+
+	/*
+	 * Speculative scan has only the kernel uevent environment. Remember udev properties
+	 * it looked up, but did not find, so we can check them later against the environment
+	 * coming from udev.
+	 */
+	if (!value && ns == KV_NS_UDEV && ucmd_ctx->req_cat == MSG_CATEGORY_SELF && ucmd_ctx->req_hdr.cmd == SELF_CMD_SCAN &&
+	    ucmd_ctx->scan.spec_deps)
+		(void) sid_buffer_add(ucmd_ctx->scan.spec_deps, (void *) key, strlen(key) + 1, NULL, NULL);
+
+	return value;
 }
 
 const void *sid_ucmd_get_kv(struct module          *mod,
@@ -2268,15 +2925,42 @@ static const void *_do_sid_ucmd_get_foreign_kv(struct module          *mod,
                                                size_t                 *value_size,
                                                sid_ucmd_kv_flags_t    *flags)
 {
-	struct kv_key_spec key_spec = {.op      = KV_OP_SET,
-	                               .dom     = dom ?: ID_NULL,
-	                               .ns      = ns,
-	                               .ns_part = _get_foreign_ns_part(mod, ucmd_ctx, foreign_mod_name, foreign_dev_id, ns),
-	                               .id_cat  = ns == KV_NS_DEVMOD ? KV_PREFIX_NS_MODULE_C : ID_NULL,
-	                               .id      = ns == KV_NS_DEVMOD ? foreign_mod_name : ID_NULL,
-	                               .core    = key};
+	const char            *owner    = _get_mod_name(mod);
+	struct kv_key_spec     key_spec = {.op      = KV_OP_SET,
+	                                   .dom     = dom ?: ID_NULL,
+	                                   .ns      = ns,
+	                                   .ns_part = _get_foreign_ns_part(mod, ucmd_ctx, foreign_mod_name, foreign_dev_id, ns),
+	                                   .id_cat  = ns == KV_NS_DEVMOD ? KV_PREFIX_NS_MODULE_C : ID_NULL,
+	                                   .id      = ns == KV_NS_DEVMOD ? foreign_mod_name : ID_NULL,
+	                                   .core    = key};
+	struct kv_cache_entry *entry;
+	const void            *value;
+	size_t                 size     = SIZE_MAX;
+	sid_ucmd_kv_flags_t    kv_flags = 0;
+
+	_foreign_kv_cache_validate(ucmd_ctx);
+
+	if (!(entry = _foreign_kv_cache_lookup(ucmd_ctx, owner, &key_spec))) {
+		/*
+		 * The size stays at SIZE_MAX if the record is not found or not accessible.
+		 * Cache this result too as the same lookup is often repeated by stacked modules.
+		 */
+		value = _cmd_get_key_spec_value(mod, ucmd_ctx, &key_spec, &size, &kv_flags);
+		_foreign_kv_cache_add(ucmd_ctx, owner, &key_spec, value, size, kv_flags);
+	} else {
+		value    = entry->value;
+		size     = entry->value_size;
+		kv_flags = entry->flags;
+	}
 
-	return _cmd_get_key_spec_value(mod, ucmd_ctx, &key_spec, value_size, flags);
+	if (size != SIZE_MAX) {
+		if (value_size)
+			*value_size = size;
+		if (flags)
+			*flags = kv_flags;
+	}
+
+	return value;
 }
 
 const void *sid_ucmd_get_foreign_mod_kv(struct module          *mod,
@@ -2882,9 +3566,18 @@ static char *_canonicalize_kv_key(char *id)
 
 int _part_get_whole_disk(struct module *mod, struct sid_ucmd_ctx *ucmd_ctx, char *devno_buf, size_t devno_buf_size)
 {
+	char       *disk_devno = ucmd_ctx->req_env.dev.disk.devno_s;
 	const char *s;
+	size_t      len;
 	int         r;
 
+	/*
+	 * The whole disk for a partition does not change during command execution
+	 * so read it from sysfs only once and then reuse the cached value.
+	 */
+	if (*disk_devno)
+		goto out;
+
 	if ((r = sid_buffer_fmt_add(ucmd_ctx->common->gen_buf,
 	                            (const void **) &s,
 	                            NULL,
@@ -2898,11 +3591,20 @@ int _part_get_whole_disk(struct module *mod, struct sid_ucmd_ctx *ucmd_ctx, char
 		return r;
 	}
 
-	if ((r = sid_util_sysfs_get_value(s, devno_buf, devno_buf_size)) < 0 || !*devno_buf)
+	if ((r = sid_util_sysfs_get_value(s, disk_devno, sizeof(ucmd_ctx->req_env.dev.disk.devno_s))) < 0 || !*disk_devno) {
 		log_error_errno(_get_mod_name(mod), r, "Failed to read whole disk device number from sysfs file %s.", s);
+		*disk_devno = '\0';
+		sid_buffer_rewind_mem(ucmd_ctx->common->gen_buf, s);
+		return r < 0 ? r : -ENODATA;
+	}
 
 	sid_buffer_rewind_mem(ucmd_ctx->common->gen_buf, s);
-	return r;
+out:
+	if ((len = strlen(disk_devno) + 1) > devno_buf_size)
+		return -ENOBUFS;
+
+	memcpy(devno_buf, disk_devno, len);
+	return 0;
 }
 
 static int _dev_is_nvme(struct sid_ucmd_ctx *ucmd_ctx)
@@ -3074,9 +3776,44 @@ out:
 	return mod_name;
 }
 
+static bool _connection_expects_ack(sid_resource_t *conn_res)
+{
+	sid_resource_iter_t *iter;
+	sid_resource_t      *cmd_res;
+	bool                 found = false;
+
+	if (!(iter = sid_resource_iter_create(conn_res)))
+		return false;
+
+	while ((cmd_res = sid_resource_iter_next(iter))) {
+		if (sid_resource_match(cmd_res, &sid_resource_type_ubridge_command, NULL) &&
+		    ((struct sid_ucmd_ctx *) sid_resource_get_data(cmd_res))->state == CMD_EXPECTING_EXPBUF_ACK) {
+			found = true;
+			break;
+		}
+	}
+
+	sid_resource_iter_destroy(iter);
+	return found;
+}
+
 static int _connection_cleanup(sid_resource_t *conn_res)
 {
-	sid_resource_t *worker_res = sid_resource_search(conn_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+	sid_resource_t    *worker_res = sid_resource_search(conn_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+	struct connection *conn       = sid_resource_get_data(conn_res);
+
+	/*
+	 * The response is sent before main process acks the exports, so the client may
+	 * close the connection while a command still waits for the ack. Stop listening
+	 * on the connection, but keep it with the command until the ack arrives - the
+	 * command finishes the cleanup then.
+	 */
+	if (_connection_expects_ack(conn_res)) {
+		if (conn->es)
+			sid_resource_destroy_event_source(&conn->es);
+		conn->closed = true;
+		return 0;
+	}
 
 	sid_resource_unref(conn_res);
 
@@ -3118,37 +3855,106 @@ static int _cmd_exec_version(struct cmd_exec_arg *exec_arg)
 	return sid_buffer_add(ucmd_ctx->res_buf, version_data, size, NULL, NULL);
 }
 
-static int _cmd_exec_resources(struct cmd_exec_arg *exec_arg)
+/*
+ * Parse KEY=VALUE pairs from resources request into write spec. The spec->type_name
+ * points into 'params' then.
+ */
+static int _parse_resources_params(sid_resource_t                 *res,
+                                   const char                     *params,
+                                   size_t                          params_size,
+                                   struct sid_resource_write_spec *spec)
 {
-	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(exec_arg->cmd_res);
-	struct sid_buffer   *gen_buf  = ucmd_ctx->common->gen_buf;
-	struct sid_buffer   *prn_buf  = ucmd_ctx->prn_buf;
-	output_format_t      format;
-	const char          *id;
-	size_t               buf_pos0, buf_pos1, buf_pos2;
-	char                *data;
-	size_t               size;
-	int                  r = -1;
+	const char        *end, *value;
+	unsigned long long val;
+	char              *p;
 
-	// TODO: check return values from all sid_buffer_* and error out properly on error
+	for (end = params + params_size; params < end; params += strnlen(params, end - params) + 1) {
+		if (!(value = memchr(params, KV_PAIR_C[0], end - params)))
+			continue;
+		value++;
+
+		if (!strncmp(params, SID_RESOURCES_KEY_MAX_DEPTH KV_PAIR_C, sizeof(SID_RESOURCES_KEY_MAX_DEPTH))) {
+			errno = 0;
+			val   = strtoull(value, &p, 10);
+			if (errno || p == value || *p || val > UINT_MAX) {
+				log_error(ID(res), "Incorrect value for %s: %s.", SID_RESOURCES_KEY_MAX_DEPTH, value);
+				return -EINVAL;
+			}
+			spec->max_depth = val;
+		} else if (!strncmp(params, SID_RESOURCES_KEY_TYPE KV_PAIR_C, sizeof(SID_RESOURCES_KEY_TYPE)))
+			spec->type_name = value;
+	}
 
-	/*
-	 * This handler is scheduled twice:
-	 * 	- right after we received the request to process the command from client
-	 * 	  (resources.main_res_mem is not set yet)
+	return 0;
+}
+
+static int _cmd_exec_resources(struct cmd_exec_arg *exec_arg)
+{
+	struct sid_ucmd_ctx           *ucmd_ctx = sid_resource_get_data(exec_arg->cmd_res);
+	struct sid_buffer             *gen_buf  = ucmd_ctx->common->gen_buf;
+	struct sid_buffer             *prn_buf  = ucmd_ctx->prn_buf;
+	struct sid_resource_write_spec spec;
+	const char                    *id;
+	size_t                         buf_pos0;
+	char                          *data;
+	size_t                         size;
+	off_t                          end;
+	int                            r = -1;
+
+	// TODO: check return values from all sid_buffer_* and error out properly on error
+
+	spec = (struct sid_resource_write_spec) {.format = flags_to_format(ucmd_ctx->req_hdr.flags), .fd = -1};
+
+	if (_parse_resources_params(exec_arg->cmd_res, ucmd_ctx->resources.params, ucmd_ctx->resources.params_size, &spec) < 0)
+		goto out;
+
+	/*
+	 * The response is written to a memfd and sent out to the client from there, so neither
+	 * main process nor this worker ever keeps the whole resource tree in memory. The response
+	 * is composed of these parts:
+	 *   - size prefix + header                                                    (filled in when sending out the response)
+	 *   - start element + start array                                             (written here, before main process' tree)
+	 *   - the resource tree from main process                                     (appended by main process)
+	 *   - the resource tree from current worker process + array end + end element (appended here at the end)
+	 *
+	 * This handler is scheduled twice:
+	 * 	- right after we received the request to process the command from client
+	 * 	  (resources.fd is not set yet)
 	 *
-	 * 	- after we received the result of resource dump from main process
-	 * 	  (resources.main_res_mem is set already)
+	 * 	- after main process has written its resource tree to resources.fd
+	 * 	  (resources.fd is set already)
 	 */
-	if (ucmd_ctx->resources.main_res_mem == NULL) {
+	if (ucmd_ctx->resources.fd < 0) {
+		if ((ucmd_ctx->resources.fd = memfd_create("resources", MFD_CLOEXEC)) < 0) {
+			log_error_errno(ID(exec_arg->cmd_res), errno, "Failed to create memfd for resource tree.");
+			goto out;
+		}
+
+		/* leave space for the size prefix and the header */
+		if (lseek(ucmd_ctx->resources.fd, SID_BUFFER_SIZE_PREFIX_LEN + SID_MSG_HEADER_SIZE, SEEK_SET) < 0) {
+			log_error_errno(ID(exec_arg->cmd_res), errno, "Failed to seek in memfd for resource tree.");
+			goto out;
+		}
+
+		print_start_elem(spec.format, prn_buf, 0, false);
+		print_start_array(spec.format, prn_buf, 1, "sidresources", false);
+
+		if ((r = sid_buffer_write_all(prn_buf, ucmd_ctx->resources.fd)) < 0 ||
+		    (ucmd_ctx->resources.main_pos = lseek(ucmd_ctx->resources.fd, 0, SEEK_CUR)) < 0) {
+			log_error(ID(exec_arg->cmd_res), "Failed to write resource tree start.");
+			r = -1;
+			goto out;
+		}
+
+		sid_buffer_rewind(prn_buf, 0, SID_BUFFER_POS_ABS);
+
 		/*
-		 * We don't have the result from main process yet - send request to
-		 * the main process to dump and send back its resources tree.
+		 * Send request to the main process to append its resources tree to resources.fd.
 		 *
 		 * We will receive response in _worker_recv_fn/_worker_recv_system_cmd_resources.
 		 * For us to be able to lookup the cmd resource the original request came from,
 		 * we also need to send this cmd resource's id withing the request - it is sent
-		 * right after the struct internal_msg_header.
+		 * right after the struct internal_msg_header, followed by the request parameters.
 		 */
 		id = sid_resource_get_id(exec_arg->cmd_res);
 
@@ -3165,14 +3971,17 @@ static int _cmd_exec_resources(struct cmd_exec_arg *exec_arg)
 		               NULL,
 		               &buf_pos0);
 		sid_buffer_add(gen_buf, (void *) id, strlen(id) + 1, NULL, NULL);
+		if (ucmd_ctx->resources.params)
+			sid_buffer_add(gen_buf, ucmd_ctx->resources.params, ucmd_ctx->resources.params_size, NULL, NULL);
 		sid_buffer_get_data_from(gen_buf, buf_pos0, (const void **) &data, &size);
 
 		if ((r = worker_control_channel_send(exec_arg->cmd_res,
 		                                     MAIN_WORKER_CHANNEL_ID,
 		                                     &(struct worker_data_spec) {
-							     .data      = data,
-							     .data_size = size,
-							     .ext.used  = false,
+							     .data               = data,
+							     .data_size          = size,
+							     .ext.used           = true,
+							     .ext.socket.fd_pass = ucmd_ctx->resources.fd,
 						     })) < 0) {
 			log_error_errno(ID(exec_arg->cmd_res),
 			                r,
@@ -3185,51 +3994,41 @@ static int _cmd_exec_resources(struct cmd_exec_arg *exec_arg)
 		return r;
 	}
 
-	if (ucmd_ctx->resources.main_res_mem == MAP_FAILED)
+	if (!ucmd_ctx->resources.main_written)
 		goto out;
 
-	/*
-	 * At this point, we already have received resource tree dump from
-	 * main process and so we are able to add both the resource tree from
-	 * main process as well as this process' resource tree to result buffer.
-	 *
-	 * The resulting output is composed of 3 parts:
-	 *   - start element + start array                                             (in prn_buf)
-	 *   - the resource tree from main process                                     (in mmap'd memfd sent from main process)
-	 *   - the resource tree from current worker process + array end + end element (in prn_buf)
-	 */
-	format   = flags_to_format(ucmd_ctx->req_hdr.flags);
+	if ((end = lseek(ucmd_ctx->resources.fd, 0, SEEK_END)) < 0) {
+		log_error_errno(ID(exec_arg->cmd_res), errno, "Failed to seek in memfd for resource tree.");
+		goto out;
+	}
 
-	buf_pos0 = sid_buffer_count(prn_buf);
-	print_start_elem(format, prn_buf, 0, false);
-	print_start_array(format, prn_buf, 1, "sidresources", false);
-	buf_pos1 = sid_buffer_count(prn_buf);
+	spec.fd         = ucmd_ctx->resources.fd;
+	spec.flush_size = RESOURCES_WRITE_FLUSH_SIZE;
 
-	sid_resource_write_tree_recursively(sid_resource_search(exec_arg->cmd_res, SID_RESOURCE_SEARCH_TOP, NULL, NULL),
-	                                    format,
-	                                    prn_buf,
-	                                    2,
-	                                    true);
+	/* the main process' part is not empty if anything at all matched there */
+	if ((r = sid_resource_write_tree(sid_resource_search(exec_arg->cmd_res, SID_RESOURCE_SEARCH_TOP, NULL, NULL),
+	                                 &spec,
+	                                 prn_buf,
+	                                 2,
+	                                 end > ucmd_ctx->resources.main_pos)) < 0) {
+		log_error_errno(ID(exec_arg->cmd_res), r, "Failed to write resource tree.");
+		r = -1;
+		goto out;
+	}
 
-	print_end_array(format, prn_buf, 1);
-	print_end_elem(format, prn_buf, 0);
+	print_end_array(spec.format, prn_buf, 1);
+	print_end_elem(spec.format, prn_buf, 0);
 	print_null_byte(prn_buf);
-	buf_pos2 = sid_buffer_count(prn_buf);
-
-	sid_buffer_get_data(prn_buf, (const void **) &data, &size);
 
-	sid_buffer_add(ucmd_ctx->res_buf, data + buf_pos0, buf_pos1 - buf_pos0, NULL, NULL);
-	sid_buffer_add(ucmd_ctx->res_buf,
-	               ucmd_ctx->resources.main_res_mem + SID_BUFFER_SIZE_PREFIX_LEN,
-	               ucmd_ctx->resources.main_res_mem_size - SID_BUFFER_SIZE_PREFIX_LEN,
-	               NULL,
-	               NULL);
-	sid_buffer_add(ucmd_ctx->res_buf, data + buf_pos1, buf_pos2 - buf_pos1, NULL, NULL);
+	if ((r = sid_buffer_write_all(prn_buf, ucmd_ctx->resources.fd)) < 0) {
+		log_error_errno(ID(exec_arg->cmd_res), r, "Failed to write resource tree end.");
+		r = -1;
+		goto out;
+	}
 
+	sid_buffer_rewind(prn_buf, 0, SID_BUFFER_POS_ABS);
 	r = 0;
 out:
-	ucmd_ctx->resources.main_res_mem      = NULL;
-	ucmd_ctx->resources.main_res_mem_size = 0;
 	_change_cmd_state(exec_arg->cmd_res, CMD_EXEC_FINISHED);
 	return r;
 }
@@ -3256,7 +4055,7 @@ static int _cmd_exec_devices(struct cmd_exec_arg *exec_arg)
 	prev_uuid                         = uuid_buf1;
 	uuid                              = uuid_buf2;
 
-	if (!(iter = kv_store_iter_create(ucmd_ctx->common->kv_store_res, "::D:", "::E:")))
+	if (!(iter = kv_store_iter_create_prefix(ucmd_ctx->common->kv_store_res, "::D:", sizeof("::D:") - 1)))
 		goto out;
 
 	print_start_document(format, prn_buf, 0);
@@ -3299,6 +4098,135 @@ out:
 	return r;
 }
 
+/*
+ * This handler is scheduled twice:
+ * 	- right after we received the request from client
+ * 	  (we ask main process for the shared KV view)
+ *
+ * 	- after main process replied
+ * 	  (kv_view.fd is set if main process keeps the view)
+ *
+ * The reply is received in _worker_recv_fn/_worker_recv_system_cmd_kv_view
+ * and the fd is passed to the client right after the response buffer.
+ */
+static int _cmd_exec_kv_view(struct cmd_exec_arg *exec_arg)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(exec_arg->cmd_res);
+	struct sid_buffer   *gen_buf  = ucmd_ctx->common->gen_buf;
+	const char          *id;
+	size_t               buf_pos;
+	char                *data;
+	size_t               size;
+	int                  r;
+
+	if (ucmd_ctx->kv_view.requested) {
+		if (ucmd_ctx->kv_view.fd < 0) {
+			log_error(ID(exec_arg->cmd_res), "Shared key-value store view is not available.");
+			return -1;
+		}
+		return 0;
+	}
+
+	ucmd_ctx->kv_view.requested = true;
+	id                          = sid_resource_get_id(exec_arg->cmd_res);
+
+	sid_buffer_add(gen_buf,
+	               &(struct internal_msg_header) {.cat = MSG_CATEGORY_SYSTEM,
+	                                              .header =
+	                                                      (struct sid_msg_header) {
+								      .status = 0,
+								      .prot   = 0,
+								      .cmd    = SYSTEM_CMD_KV_VIEW,
+								      .flags  = 0,
+							      }},
+	               INTERNAL_MSG_HEADER_SIZE,
+	               NULL,
+	               &buf_pos);
+	sid_buffer_add(gen_buf, (void *) id, strlen(id) + 1, NULL, NULL);
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &data, &size);
+
+	if ((r = worker_control_channel_send(exec_arg->cmd_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {
+						     .data      = data,
+						     .data_size = size,
+						     .ext.used  = false,
+					     })) < 0) {
+		log_error_errno(ID(exec_arg->cmd_res), r, "Failed to request shared key-value store view from main process.");
+		r = -1;
+	} else
+		_change_cmd_state(exec_arg->cmd_res, CMD_EXPECTING_DATA);
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+	return r;
+}
+
+/*
+ * Runtime tuning parameters are kept by main process, so this handler is scheduled twice:
+ * 	- right after we received the request from client
+ * 	  (we send the request to main process to get or set the parameters)
+ *
+ * 	- after main process replied
+ * 	  (params.reply is set if main process succeeded)
+ *
+ * The reply is received in _worker_recv_fn/_worker_recv_system_cmd_params.
+ */
+static int _cmd_exec_params(struct cmd_exec_arg *exec_arg)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(exec_arg->cmd_res);
+	struct sid_buffer   *gen_buf  = ucmd_ctx->common->gen_buf;
+	const char          *id;
+	size_t               buf_pos;
+	char                *data;
+	size_t               size;
+	int                  r;
+
+	if (ucmd_ctx->params.requested) {
+		if (!ucmd_ctx->params.reply) {
+			log_error(ID(exec_arg->cmd_res), "Main process failed to process parameters.");
+			return -1;
+		}
+		return sid_buffer_add(ucmd_ctx->res_buf, ucmd_ctx->params.reply, ucmd_ctx->params.reply_size, NULL, NULL);
+	}
+
+	ucmd_ctx->params.requested = true;
+	id                         = sid_resource_get_id(exec_arg->cmd_res);
+
+	sid_buffer_add(gen_buf,
+	               &(struct internal_msg_header) {.cat = MSG_CATEGORY_SYSTEM,
+	                                              .header =
+	                                                      (struct sid_msg_header) {
+								      .status = 0,
+								      .prot   = 0,
+								      .cmd    = ucmd_ctx->req_hdr.cmd == SID_CMD_PARAM_SET
+								                        ? SYSTEM_CMD_PARAM_SET
+								                        : SYSTEM_CMD_PARAM_GET,
+								      .flags = ucmd_ctx->req_hdr.flags,
+							      }},
+	               INTERNAL_MSG_HEADER_SIZE,
+	               NULL,
+	               &buf_pos);
+	sid_buffer_add(gen_buf, (void *) id, strlen(id) + 1, NULL, NULL);
+	if (ucmd_ctx->params.list)
+		sid_buffer_add(gen_buf, ucmd_ctx->params.list, ucmd_ctx->params.list_size, NULL, NULL);
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &data, &size);
+
+	if ((r = worker_control_channel_send(exec_arg->cmd_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {
+						     .data      = data,
+						     .data_size = size,
+						     .ext.used  = false,
+					     })) < 0) {
+		log_error_errno(ID(exec_arg->cmd_res), r, "Failed to send parameters request to main process.");
+		r = -1;
+	} else
+		_change_cmd_state(exec_arg->cmd_res, CMD_EXPECTING_DATA);
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+	return r;
+}
+
 static int _cmd_exec_dbstats(struct cmd_exec_arg *exec_arg)
 {
 	int                  r;
@@ -3317,8 +4245,22 @@ static int _cmd_exec_dbstats(struct cmd_exec_arg *exec_arg)
 		print_uint64_field(format, prn_buf, 1, "VALUES_INTERNAL_DATA_SIZE", stats.value_int_data_size, true);
 		print_uint64_field(format, prn_buf, 1, "VALUES_EXTERNAL_SIZE", stats.value_ext_size, true);
 		print_uint64_field(format, prn_buf, 1, "VALUES_EXTERNAL_DATA_SIZE", stats.value_ext_data_size, true);
+		print_uint64_field(format, prn_buf, 1, "VALUES_VIEW_SIZE", stats.value_view_size, true);
 		print_uint64_field(format, prn_buf, 1, "METADATA_SIZE", stats.meta_size, true);
 		print_uint_field(format, prn_buf, 1, "NR_KEY_VALUE_PAIRS", stats.nr_kv_pairs, true);
+		/* packed vectors compared to storing an iovec per vector item */
+		print_uint64_field(format,
+		                   prn_buf,
+		                   1,
+		                   "VALUE_BYTES_PER_RECORD",
+		                   stats.nr_kv_pairs ? (stats.value_int_size + stats.value_view_size) / stats.nr_kv_pairs : 0,
+		                   true);
+		print_uint64_field(format,
+		                   prn_buf,
+		                   1,
+		                   "VALUE_UNPACKED_BYTES_PER_RECORD",
+		                   stats.nr_kv_pairs ? stats.value_unpacked_size / stats.nr_kv_pairs : 0,
+		                   true);
 
 		print_end_document(format, prn_buf, 0);
 		print_null_byte(prn_buf);
@@ -3329,13 +4271,30 @@ static int _cmd_exec_dbstats(struct cmd_exec_arg *exec_arg)
 	return r;
 }
 
+static const char *_devno_to_devid(struct sid_ucmd_ctx *ucmd_ctx, const char *devno, char *devid_buf, size_t devid_buf_size);
+
+static const char *_part_get_whole_disk_devid(struct module *mod, struct sid_ucmd_ctx *ucmd_ctx)
+{
+	char devno_buf[16];
+
+	if (*ucmd_ctx->req_env.dev.disk.devid_s)
+		return ucmd_ctx->req_env.dev.disk.devid_s;
+
+	if (_part_get_whole_disk(mod, ucmd_ctx, devno_buf, sizeof(devno_buf)) < 0)
+		return NULL;
+
+	return _devno_to_devid(ucmd_ctx,
+	                       _canonicalize_kv_key(devno_buf),
+	                       ucmd_ctx->req_env.dev.disk.devid_s,
+	                       sizeof(ucmd_ctx->req_env.dev.disk.devid_s));
+}
+
 const void *sid_ucmd_part_get_disk_kv(struct module       *mod,
                                       struct sid_ucmd_ctx *ucmd_ctx,
                                       const char          *key_core,
                                       size_t              *value_size,
                                       sid_ucmd_kv_flags_t *flags)
 {
-	char               devno_buf[16];
 	struct kv_key_spec key_spec = {.op      = KV_OP_SET,
 	                               .dom     = KV_KEY_DOM_USER,
 	                               .ns      = KV_NS_DEVICE,
@@ -3347,11 +4306,10 @@ const void *sid_ucmd_part_get_disk_kv(struct module       *mod,
 	if (!mod || !ucmd_ctx || !key_core || !*key_core || (key_core[0] == KV_PREFIX_KEY_SYS_C[0]))
 		return NULL;
 
-	if (_part_get_whole_disk(mod, ucmd_ctx, devno_buf, sizeof(devno_buf)) < 0)
+	/* KV_NS_DEVICE records are stored under device identifier, not device number. */
+	if (!(key_spec.ns_part = _part_get_whole_disk_devid(mod, ucmd_ctx)))
 		return NULL;
 
-	key_spec.ns_part = _canonicalize_kv_key(devno_buf);
-
 	return _cmd_get_key_spec_value(mod, ucmd_ctx, &key_spec, value_size, flags);
 }
 
@@ -3594,7 +4552,6 @@ static int _refresh_device_partition_hierarchy_from_sysfs(sid_resource_t *cmd_re
 	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
 	kv_vector_t          vvalue[VVALUE_SINGLE_CNT];
 	char                 devno_buf[16];
-	char                 devid_buf[UTIL_UUID_STR_SIZE];
 	const char          *s;
 	char                *key;
 	util_mem_t           mem;
@@ -3632,12 +4589,13 @@ static int _refresh_device_partition_hierarchy_from_sysfs(sid_resource_t *cmd_re
 
 	_canonicalize_kv_key(devno_buf);
 
-	if (!(rel_spec.rel_key_spec->ns_part = _devno_to_devid(ucmd_ctx, devno_buf, devid_buf, sizeof(devid_buf)))) {
-		mem = (util_mem_t) {.base = devid_buf, .size = sizeof(devid_buf)};
+	if (!(rel_spec.rel_key_spec->ns_part = _part_get_whole_disk_devid(NULL, ucmd_ctx))) {
+		mem = (util_mem_t) {.base = ucmd_ctx->req_env.dev.disk.devid_s, .size = sizeof(ucmd_ctx->req_env.dev.disk.devid_s)};
 		if (!util_uuid_gen_str(&mem)) {
 			log_error(ID(cmd_res),
 			          "Failed to generate UUID for device " CMD_DEV_NAME_NUM_FMT ".",
 			          CMD_DEV_NAME_NUM(ucmd_ctx));
+			*ucmd_ctx->req_env.dev.disk.devid_s = '\0';
 			goto out;
 		}
 		rel_spec.rel_key_spec->ns_part = mem.base;
@@ -3854,6 +4812,57 @@ static int _set_device_kv_records(sid_resource_t *cmd_res)
 	return _refresh_device_hierarchy_from_sysfs(cmd_res);
 }
 
+/*
+ * Check if command matches all the debug filters set. The module filter is matched against
+ * device's type module so it can match only after the module is looked up in ident phase.
+ */
+static bool _debug_filter_match(struct sid_ucmd_ctx *ucmd_ctx, const char *mod_name)
+{
+	struct sid_ucmd_common_ctx *common_ctx = ucmd_ctx->common;
+	const struct udevice       *udev       = &ucmd_ctx->req_env.dev.udev;
+	sid_cmd_t                   cmd;
+
+	if (!common_ctx->debug.enabled)
+		return false;
+
+	if (common_ctx->debug.cmd != SID_CMD_UNDEFINED) {
+		if (ucmd_ctx->req_cat == MSG_CATEGORY_CLIENT)
+			cmd = ucmd_ctx->req_hdr.cmd;
+		else if (ucmd_ctx->req_cat == MSG_CATEGORY_SELF && ucmd_ctx->req_hdr.cmd == SELF_CMD_SCAN)
+			cmd = SID_CMD_SCAN;
+		else
+			cmd = SID_CMD_UNDEFINED;
+
+		if (cmd != common_ctx->debug.cmd)
+			return false;
+	}
+
+	if (common_ctx->debug.major >= 0 &&
+	    (!udev->name || udev->major != common_ctx->debug.major || udev->minor != common_ctx->debug.minor))
+		return false;
+
+	if (common_ctx->debug.name && (!udev->name || fnmatch(common_ctx->debug.name, udev->name, 0)))
+		return false;
+
+	if (common_ctx->debug.module && (!mod_name || strcmp(common_ctx->debug.module, mod_name)))
+		return false;
+
+	return true;
+}
+
+/* Debug messages are forced only while handling the command, not for the whole worker. */
+static void _cmd_debug_begin(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	if (ucmd_ctx->debug)
+		log_force_debug(1);
+}
+
+static void _cmd_debug_end(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	if (ucmd_ctx->debug)
+		log_force_debug(0);
+}
+
 static int _cmd_exec_scan_init(struct cmd_exec_arg *exec_arg)
 {
 	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(exec_arg->cmd_res);
@@ -3925,6 +4934,11 @@ static int _cmd_exec_scan_ident(struct cmd_exec_arg *exec_arg)
 		}
 	}
 
+	if (ucmd_ctx->common->debug.module && !ucmd_ctx->debug && _debug_filter_match(ucmd_ctx, mod_name)) {
+		ucmd_ctx->debug = true;
+		_cmd_debug_begin(ucmd_ctx);
+	}
+
 	if (!(exec_arg->type_mod_res_current = module_registry_get_module(exec_arg->type_mod_registry_res, mod_name)))
 		log_debug(ID(exec_arg->cmd_res), "Module %s not loaded.", mod_name);
 
@@ -4115,11 +5129,267 @@ static struct cmd_reg _cmd_scan_phase_regs[] = {
 	[CMD_SCAN_PHASE_ERROR]                 = {.name = "error", .flags = 0, .exec = _cmd_exec_scan_error},
 };
 
+/*
+ * Ask main process for the result of speculative scan done for the same uevent. Main process
+ * needs our udev environment to check the result is valid for us and it also needs this cmd
+ * resource's id which is sent back with the reply so we can find the cmd resource again. The
+ * reply is received in _worker_recv_fn/_worker_recv_system_cmd_scan_fetch.
+ */
+static int _fetch_spec_scan_result(sid_resource_t *cmd_res)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	struct sid_buffer   *gen_buf  = ucmd_ctx->common->gen_buf;
+	struct spec_scan_key key      = {.seqnum = ucmd_ctx->req_env.dev.udev.seqnum,
+	                                 .devno  = makedev(ucmd_ctx->req_env.dev.udev.major, ucmd_ctx->req_env.dev.udev.minor)};
+	const char          *id       = sid_resource_get_id(cmd_res);
+	size_t               buf_pos;
+	char                *data;
+	size_t               size;
+	int                  r;
+
+	sid_buffer_add(gen_buf,
+	               &(struct internal_msg_header) {.cat = MSG_CATEGORY_SYSTEM,
+	                                              .header =
+	                                                      (struct sid_msg_header) {
+								      .status = 0,
+								      .prot   = 0,
+								      .cmd    = SYSTEM_CMD_SCAN_FETCH,
+								      .flags  = 0,
+							      }},
+	               INTERNAL_MSG_HEADER_SIZE,
+	               NULL,
+	               &buf_pos);
+	sid_buffer_add(gen_buf, &key, sizeof(key), NULL, NULL);
+	sid_buffer_add(gen_buf, (void *) id, strlen(id) + 1, NULL, NULL);
+	sid_buffer_add(gen_buf, ucmd_ctx->scan.spec_env, ucmd_ctx->scan.spec_env_size, NULL, NULL);
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &data, &size);
+
+	if ((r = worker_control_channel_send(cmd_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {
+						     .data      = data,
+						     .data_size = size,
+						     .ext.used  = false,
+					     })) < 0) {
+		log_error_errno(ID(cmd_res), r, "Failed to request speculative scan result from main process.");
+		r = -1;
+	} else
+		_change_cmd_state(cmd_res, CMD_EXPECTING_DATA);
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+	return r;
+}
+
+/*
+ * SEQNUM is left out when comparing udev environments - it is different for each
+ * uevent even if udev runs the rules again with otherwise identical environment.
+ */
+static bool _is_scan_env_seqnum(const char *item)
+{
+	return !strncmp(item, UDEV_KEY_SEQNUM KV_PAIR_C, sizeof(UDEV_KEY_SEQNUM KV_PAIR_C) - 1);
+}
+
+/* FNV-1a hash of udev environment, without SEQNUM. */
+static uint64_t _hash_scan_env(const char *env, size_t env_size)
+{
+	const char *end  = env + env_size;
+	uint64_t    hash = SCAN_MEMO_HASH_OFFSET;
+	size_t      len, i;
+
+	for (; env < end; env += len + 1) {
+		len = strnlen(env, end - env);
+
+		if (_is_scan_env_seqnum(env))
+			continue;
+
+		for (i = 0; i < len; i++) {
+			hash ^= (unsigned char) env[i];
+			hash *= SCAN_MEMO_HASH_PRIME;
+		}
+
+		/* the same as hashing the terminating zero, so items are not merged */
+		hash *= SCAN_MEMO_HASH_PRIME;
+	}
+
+	/* 0 means 'not memoizing' */
+	return hash ? hash : 1;
+}
+
+/*
+ * Copy udev environment without SEQNUM, to compare with environment memoized scan
+ * result was stored with once the hashes match.
+ */
+static void *_copy_scan_env(const char *env, size_t env_size, size_t *copy_size)
+{
+	const char *end = env + env_size;
+	char       *copy, *p;
+	size_t      len;
+
+	/* the last item may be missing its terminating zero */
+	if (!(p = copy = malloc(env_size + 1)))
+		return NULL;
+
+	for (; env < end; env += len + 1) {
+		len = strnlen(env, end - env);
+
+		if (_is_scan_env_seqnum(env))
+			continue;
+
+		memcpy(p, env, len);
+		p    += len;
+		*p++ = '\0';
+	}
+
+	*copy_size = p - copy;
+	return copy;
+}
+
+static struct scan_memo_key _get_scan_memo_key(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	return (struct scan_memo_key) {
+		.uevent   = {.seqnum = ucmd_ctx->req_env.dev.udev.seqnum,
+		             .devno  = makedev(ucmd_ctx->req_env.dev.udev.major, ucmd_ctx->req_env.dev.udev.minor)},
+		.env_hash = ucmd_ctx->scan.memo_hash,
+	};
+}
+
+/*
+ * Ask main process for memoized result of scan with the same udev environment. The reply
+ * is received in _worker_recv_fn/_worker_recv_system_cmd_scan_memo_fetch, with the result
+ * memfd attached if there's a valid result.
+ */
+static int _fetch_scan_memo(sid_resource_t *cmd_res)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	struct sid_buffer   *gen_buf  = ucmd_ctx->common->gen_buf;
+	struct scan_memo_key key      = _get_scan_memo_key(ucmd_ctx);
+	const char          *id       = sid_resource_get_id(cmd_res);
+	size_t               buf_pos;
+	char                *data;
+	size_t               size;
+	int                  r;
+
+	sid_buffer_add(gen_buf,
+	               &(struct internal_msg_header) {.cat    = MSG_CATEGORY_SYSTEM,
+	                                              .header = (struct sid_msg_header) {.cmd = SYSTEM_CMD_SCAN_MEMO_FETCH}},
+	               INTERNAL_MSG_HEADER_SIZE,
+	               NULL,
+	               &buf_pos);
+	sid_buffer_add(gen_buf, &key, sizeof(key), NULL, NULL);
+	sid_buffer_add(gen_buf, (void *) id, strlen(id) + 1, NULL, NULL);
+	sid_buffer_add(gen_buf, ucmd_ctx->scan.memo_env, ucmd_ctx->scan.memo_env_size, NULL, NULL);
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &data, &size);
+
+	if ((r = worker_control_channel_send(
+		     cmd_res,
+		     MAIN_WORKER_CHANNEL_ID,
+		     &(struct worker_data_spec) {.data = data, .data_size = size, .ext.used = false})) < 0) {
+		log_error_errno(ID(cmd_res), r, "Failed to request memoized scan result from main process.");
+		r = -1;
+	} else
+		_change_cmd_state(cmd_res, CMD_EXPECTING_DATA);
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+	return r;
+}
+
+/*
+ * Send scan result to main process to memoize. The message carries main KV store generation
+ * inherited from main process when this worker was created and the generation this scan's
+ * exports were synced with, if any. Main process only keeps the result if no other export
+ * changed the records the result depends on in between - the records of this device, records
+ * not specific to any single device and, if the scan looked them up, records of other devices.
+ * If 'with_result' is false, main process drops memoized result for the device.
+ */
+static int _store_scan_memo(sid_resource_t *cmd_res, bool with_result)
+{
+	struct sid_ucmd_ctx   *ucmd_ctx = sid_resource_get_data(cmd_res);
+	struct sid_buffer     *gen_buf  = ucmd_ctx->common->gen_buf;
+	struct scan_memo_store store    = {.key        = _get_scan_memo_key(ucmd_ctx),
+	                                   .kv_gen     = ucmd_ctx->common->scan_memo.kv_gen,
+	                                   .exp_kv_gen = ucmd_ctx->scan.memo_exp_gen,
+	                                   .foreign    = ucmd_ctx->scan.foreign};
+	const char            *uid_s    = ucmd_ctx->req_env.dev.uid_s ?: ID_NULL;
+	size_t                 buf_pos;
+	char                  *data;
+	size_t                 size;
+	int                    fd = -1;
+	int                    r;
+
+	if (with_result &&
+	    ((fd = memfd_create("scan_memo_result", MFD_CLOEXEC)) < 0 || sid_buffer_write_all(ucmd_ctx->res_buf, fd) < 0)) {
+		log_error(ID(cmd_res), "Failed to store scan result to memoize.");
+		if (fd >= 0)
+			(void) close(fd);
+		return -1;
+	}
+
+	sid_buffer_add(gen_buf,
+	               &(struct internal_msg_header) {.cat    = MSG_CATEGORY_SYSTEM,
+	                                              .header = (struct sid_msg_header) {.cmd = SYSTEM_CMD_SCAN_MEMO_STORE}},
+	               INTERNAL_MSG_HEADER_SIZE,
+	               NULL,
+	               &buf_pos);
+	sid_buffer_add(gen_buf, &store, sizeof(store), NULL, NULL);
+	sid_buffer_add(gen_buf, ucmd_ctx->req_env.dev.num_s, strlen(ucmd_ctx->req_env.dev.num_s) + 1, NULL, NULL);
+	sid_buffer_add(gen_buf, (void *) uid_s, strlen(uid_s) + 1, NULL, NULL);
+	sid_buffer_add(gen_buf, ucmd_ctx->scan.memo_env, ucmd_ctx->scan.memo_env_size, NULL, NULL);
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &data, &size);
+
+	if ((r = worker_control_channel_send(cmd_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {.data               = data,
+	                                                                 .data_size          = size,
+	                                                                 .ext.used           = fd >= 0,
+	                                                                 .ext.socket.fd_pass = fd})) < 0) {
+		log_error_errno(ID(cmd_res), r, "Failed to send scan result to memoize to main process.");
+		r = -1;
+	}
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+
+	if (fd >= 0)
+		(void) close(fd);
+
+	return r;
+}
+
 static int _cmd_exec_scan(struct cmd_exec_arg *exec_arg)
 {
 	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(exec_arg->cmd_res);
 	cmd_scan_phase_t     phase;
 
+	/*
+	 * If main process scans speculatively, this handler is scheduled twice:
+	 * 	- right after we received the request from client
+	 * 	  (we ask main process for speculative scan result)
+	 *
+	 * 	- after main process replied
+	 * 	  (scan.spec_fd is set if there's a result for us, otherwise we scan on our own)
+	 *
+	 * The same applies if main process memoizes scan results, which is checked first.
+	 */
+	if (ucmd_ctx->scan.memo_hash && !ucmd_ctx->scan.memo_fetched) {
+		ucmd_ctx->scan.memo_fetched = true;
+
+		if (ucmd_ctx->req_env.dev.udev.action == UDEV_ACTION_REMOVE) {
+			/* The device is going away, drop its memoized result and do not memoize this one. */
+			(void) _store_scan_memo(exec_arg->cmd_res, false);
+			ucmd_ctx->scan.memo_hash = 0;
+		} else if (_fetch_scan_memo(exec_arg->cmd_res) == 0)
+			return 0;
+	} else if (ucmd_ctx->scan.memo_hit)
+		return 0;
+
+	if (ucmd_ctx->scan.spec_env) {
+		if (!ucmd_ctx->scan.spec_fetched) {
+			ucmd_ctx->scan.spec_fetched = true;
+			if (_fetch_spec_scan_result(exec_arg->cmd_res) == 0)
+				return 0;
+		} else if (ucmd_ctx->scan.spec_fd >= 0)
+			return 0;
+	}
+
 	for (phase = CMD_SCAN_PHASE_A_INIT; phase <= CMD_SCAN_PHASE_A_EXIT; phase++) {
 		log_debug(ID(exec_arg->cmd_res), "Executing %s phase.", _cmd_scan_phase_regs[phase].name);
 		ucmd_ctx->scan.phase = phase;
@@ -4127,6 +5397,9 @@ static int _cmd_exec_scan(struct cmd_exec_arg *exec_arg)
 		if (_cmd_scan_phase_regs[phase].exec(exec_arg) < 0) {
 			log_error(ID(exec_arg->cmd_res), "%s phase failed.", _cmd_scan_phase_regs[phase].name);
 
+			/* the result depends on more than input, do not reuse it */
+			ucmd_ctx->scan.memo_hash = 0;
+
 			/* if init or exit phase fails, there's nothing else we can do */
 			if (phase == CMD_SCAN_PHASE_A_INIT || phase == CMD_SCAN_PHASE_A_EXIT)
 				return -1;
@@ -4154,6 +5427,9 @@ static struct cmd_reg _client_cmd_regs[] = {
 	[SID_CMD_DBSTATS] = {.name = "c-dbstats", .flags = 0, .exec = _cmd_exec_dbstats},
 	[SID_CMD_RESOURCES] = {.name = "c-resource", .flags = 0, .exec = _cmd_exec_resources},
 	[SID_CMD_DEVICES]   = {.name = "c-devices", .flags = 0, .exec = _cmd_exec_devices},
+	[SID_CMD_KV_VIEW]   = {.name = "c-kvview", .flags = 0, .exec = _cmd_exec_kv_view},
+	[SID_CMD_PARAM_GET] = {.name = "c-paramget", .flags = 0, .exec = _cmd_exec_params},
+	[SID_CMD_PARAM_SET] = {.name = "c-paramset", .flags = 0, .exec = _cmd_exec_params},
 };
 
 static struct cmd_reg _self_cmd_regs[] = {
@@ -4161,6 +5437,10 @@ static struct cmd_reg _self_cmd_regs[] = {
                              .flags = CMD_KV_EXPORT_UDEV_TO_EXPBUF | CMD_KV_EXPORT_SID_TO_EXPBUF | CMD_KV_EXPBUF_TO_FILE |
                                       CMD_KV_EXPORT_PERSISTENT,
                              .exec = NULL},
+	[SELF_CMD_SCAN]   = {.name  = "s-scan",
+                             .flags = CMD_KV_IMPORT_UDEV | CMD_KV_EXPORT_UDEV_TO_RESBUF | CMD_KV_EXPORT_SID_TO_EXPBUF |
+                                      CMD_KV_EXPORT_SYNC | CMD_SESSION_ID,
+                             .exec = _cmd_exec_scan},
 };
 
 static ssize_t _send_fd_over_unix_comms(int fd, int unix_comms_fd)
@@ -4238,10 +5518,15 @@ static int _send_out_cmd_expbuf(sid_resource_t *cmd_res)
 												 ucmd_ctx->exp_buf)})) < 0) {
 				log_error_errno(ID(cmd_res), r, "Failed to send command exports to main SID process.");
 				r = -1;
-			}
+			} else if (ucmd_ctx->common->worker_accept.sync_gen)
+				/*
+				 * Bump the generation before replying to the client so that any worker accepting
+				 * a connection afterwards knows its copy of main KV store may be out of date.
+				 */
+				__atomic_add_fetch(ucmd_ctx->common->worker_accept.sync_gen, 1, __ATOMIC_RELEASE);
 
 			sid_buffer_rewind(buf, buf_pos, SID_BUFFER_POS_ABS);
-		} // TODO: if sid_buffer_count returns 0, then set the cmd state as if the buffer was acked
+		}
 	} else if (cmd_reg->flags & CMD_KV_EXPBUF_TO_FILE) {
 		if ((r = fsync(sid_buffer_get_fd(ucmd_ctx->exp_buf))) < 0) {
 			log_error_errno(ID(cmd_res), r, "Failed to fsync command exports to a file.");
@@ -4271,33 +5556,229 @@ static int _send_out_cmd_expbuf(sid_resource_t *cmd_res)
 	return r;
 }
 
-static int _send_out_cmd_resbuf(sid_resource_t *cmd_res)
+/* Write speculative scan's KV store exports, if any, followed by response for udev to a new memfd. */
+static int _write_spec_scan_result(struct sid_ucmd_ctx *ucmd_ctx, size_t *exp_size)
 {
-	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
-	sid_resource_t      *conn_res = NULL;
-	struct connection   *conn     = NULL;
-	int                  r        = -1;
+	struct stat st;
+	int         fd;
 
-	/* Send out response buffer. */
-	switch (ucmd_ctx->req_cat) {
-		case MSG_CATEGORY_SYSTEM:
-			break;
+	if ((fd = memfd_create("spec_scan_result", MFD_CLOEXEC)) < 0)
+		return -1;
 
-		case MSG_CATEGORY_CLIENT:
-			conn_res = sid_resource_search(cmd_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
-			conn     = sid_resource_get_data(conn_res);
+	if (ucmd_ctx->exp_buf && sid_buffer_count(ucmd_ctx->exp_buf) > 0) {
+		if (sid_buffer_write_all(ucmd_ctx->exp_buf, fd) < 0 || fstat(fd, &st) < 0)
+			goto fail;
+		*exp_size = st.st_size;
+	}
 
-			if (sid_buffer_write_all(ucmd_ctx->res_buf, conn->fd) < 0) {
-				log_error(ID(cmd_res), "Failed to send command response to client.");
-				(void) _connection_cleanup(conn_res);
-				goto out;
-			}
-			break;
+	if (sid_buffer_write_all(ucmd_ctx->res_buf, fd) < 0)
+		goto fail;
 
-		case MSG_CATEGORY_SELF:
-			// TODO: Return response buffer content to the resource which created this cmd resource.
-			break;
-	}
+	return fd;
+fail:
+	(void) close(fd);
+	return -1;
+}
+
+/*
+ * Send result of speculative scan to main process which keeps it until udev asks for it.
+ * The result is passed in a memfd with the scan's KV store exports, if any, followed by
+ * the exact response for udev. Main process applies the exports only if the result is
+ * used. The message itself carries the size of the exports, main KV store generation the
+ * worker started with, whether the scan looked up records of other devices and udev
+ * properties the scan looked up, but which were not in its environment, each one with
+ * the value the scan ended up with, if any. Main process uses these to check the result
+ * is valid for the environment udev comes with later and for current main KV store.
+ * If 'ok' is false, the scan failed and the message is sent without the memfd.
+ */
+static int _send_spec_scan_result(sid_resource_t *cmd_res, bool ok)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	struct sid_buffer   *gen_buf  = ucmd_ctx->common->gen_buf;
+	struct sid_buffer   *deps     = ucmd_ctx->scan.spec_deps;
+	struct spec_scan_key key      = {.seqnum = ucmd_ctx->req_env.dev.udev.seqnum,
+	                                 .devno  = makedev(ucmd_ctx->req_env.dev.udev.major, ucmd_ctx->req_env.dev.udev.minor)};
+	size_t               exp_size = 0;
+	const char          *dep, *deps_end, *value;
+	size_t               buf_pos;
+	char                *data;
+	size_t               size;
+	int                  fd = -1;
+	int                  r;
+
+	sid_buffer_add(gen_buf,
+	               &(struct internal_msg_header) {.cat = MSG_CATEGORY_SYSTEM,
+	                                              .header =
+	                                                      (struct sid_msg_header) {
+								      .status = 0,
+								      .prot   = 0,
+								      .cmd    = SYSTEM_CMD_SCAN_RESULT,
+								      .flags  = 0,
+							      }},
+	               INTERNAL_MSG_HEADER_SIZE,
+	               NULL,
+	               &buf_pos);
+	sid_buffer_add(gen_buf, &key, sizeof(key), NULL, NULL);
+
+	if (ok && (fd = _write_spec_scan_result(ucmd_ctx, &exp_size)) < 0)
+		log_error(ID(cmd_res), "Failed to store speculative scan result.");
+
+	sid_buffer_add(gen_buf, &exp_size, sizeof(exp_size), NULL, NULL);
+	sid_buffer_add(gen_buf, &ucmd_ctx->common->scan_memo.kv_gen, sizeof(ucmd_ctx->common->scan_memo.kv_gen), NULL, NULL);
+	sid_buffer_add(gen_buf, &ucmd_ctx->scan.foreign, sizeof(ucmd_ctx->scan.foreign), NULL, NULL);
+
+	if (fd >= 0 && deps) {
+		/* looking up the final values must not add more dependencies */
+		ucmd_ctx->scan.spec_deps = NULL;
+
+		sid_buffer_get_data(deps, (const void **) &dep, &size);
+
+		for (deps_end = dep + size; dep < deps_end; dep += strlen(dep) + 1) {
+			sid_buffer_add(gen_buf, (void *) dep, strlen(dep), NULL, NULL);
+			if ((value = _do_sid_ucmd_get_kv(NULL, ucmd_ctx, NULL, KV_NS_UDEV, dep, NULL, NULL))) {
+				sid_buffer_add(gen_buf, KV_PAIR_C, 1, NULL, NULL);
+				sid_buffer_add(gen_buf, (void *) value, strlen(value), NULL, NULL);
+			}
+			sid_buffer_add(gen_buf, KV_END_C, 1, NULL, NULL);
+		}
+
+		ucmd_ctx->scan.spec_deps = deps;
+	}
+
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &data, &size);
+
+	if ((r = worker_control_channel_send(cmd_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {.data               = data,
+	                                                                 .data_size          = size,
+	                                                                 .ext.used           = fd >= 0,
+	                                                                 .ext.socket.fd_pass = fd})) < 0) {
+		log_error_errno(ID(cmd_res), r, "Failed to send speculative scan result to main process.");
+		r = -1;
+	}
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+
+	if (fd >= 0)
+		(void) close(fd);
+
+	return r;
+}
+
+/* Send content of file referenced by 'fd' from 'pos' to the end to 'out_fd', regardless of fd's current offset. */
+static int _send_fd_content(int fd, off_t pos, int out_fd)
+{
+	struct stat st;
+	ssize_t     n;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	while (pos < st.st_size) {
+		if ((n = sendfile(out_fd, fd, &pos, st.st_size - pos)) < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return -errno;
+		}
+	}
+
+	return 0;
+}
+
+static int _send_out_cmd_spec_scan_result(sid_resource_t *cmd_res)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	sid_resource_t      *conn_res = sid_resource_search(cmd_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+	struct connection   *conn     = sid_resource_get_data(conn_res);
+	int                  r;
+
+	log_debug(ID(cmd_res),
+	          "Using %s scan result for device " CMD_DEV_NAME_NUM_FMT ".",
+	          ucmd_ctx->scan.memo_hit ? "memoized" : "speculative",
+	          CMD_DEV_NAME_NUM(ucmd_ctx));
+
+	if ((r = _send_fd_content(ucmd_ctx->scan.spec_fd, 0, conn->fd)) < 0) {
+		log_error_errno(ID(cmd_res),
+		                r,
+		                "Failed to send %s scan result to client.",
+		                ucmd_ctx->scan.memo_hit ? "memoized" : "speculative");
+		(void) _connection_cleanup(conn_res);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Resources response is written to resources.fd already, only the size prefix
+ * and the header are filled in right before sending it out.
+ */
+static int _send_resources_response(struct sid_ucmd_ctx *ucmd_ctx, int out_fd)
+{
+	SID_BUFFER_SIZE_PREFIX_TYPE msg_size;
+	struct stat                 st;
+
+	if (fstat(ucmd_ctx->resources.fd, &st) < 0)
+		return -errno;
+
+	if (st.st_size > UINT32_MAX)
+		return -EOVERFLOW;
+
+	msg_size = st.st_size;
+
+	if (pwrite(ucmd_ctx->resources.fd, &msg_size, SID_BUFFER_SIZE_PREFIX_LEN, 0) != SID_BUFFER_SIZE_PREFIX_LEN ||
+	    pwrite(ucmd_ctx->resources.fd, &ucmd_ctx->res_hdr, SID_MSG_HEADER_SIZE, SID_BUFFER_SIZE_PREFIX_LEN) !=
+	            SID_MSG_HEADER_SIZE)
+		return -errno;
+
+	return _send_fd_content(ucmd_ctx->resources.fd, 0, out_fd);
+}
+
+static int _send_out_cmd_resbuf(sid_resource_t *cmd_res)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	sid_resource_t      *conn_res = NULL;
+	struct connection   *conn     = NULL;
+	int                  r        = -1;
+
+	/* Send out response buffer. */
+	switch (ucmd_ctx->req_cat) {
+		case MSG_CATEGORY_SYSTEM:
+			break;
+
+		case MSG_CATEGORY_CLIENT:
+			conn_res = sid_resource_search(cmd_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+			conn     = sid_resource_get_data(conn_res);
+
+			if (ucmd_ctx->req_hdr.cmd == SID_CMD_RESOURCES && ucmd_ctx->resources.fd >= 0) {
+				if (_send_resources_response(ucmd_ctx, conn->fd) < 0) {
+					log_error(ID(cmd_res), "Failed to send resources response to client.");
+					(void) _connection_cleanup(conn_res);
+					goto out;
+				}
+			} else if (sid_buffer_write_all(ucmd_ctx->res_buf, conn->fd) < 0) {
+				log_error(ID(cmd_res), "Failed to send command response to client.");
+				(void) _connection_cleanup(conn_res);
+				goto out;
+			}
+
+			if (ucmd_ctx->req_hdr.cmd == SID_CMD_KV_VIEW &&
+			    _send_fd_over_unix_comms(ucmd_ctx->kv_view.fd, conn->fd) < 0) {
+				log_error(ID(cmd_res), "Failed to send shared key-value store view to client.");
+				(void) _connection_cleanup(conn_res);
+				goto out;
+			}
+			break;
+
+		case MSG_CATEGORY_SELF:
+			if (ucmd_ctx->req_hdr.cmd == SELF_CMD_SCAN) {
+				if (_send_spec_scan_result(cmd_res, true) < 0)
+					goto out;
+				break;
+			}
+			// TODO: Return response buffer content to the resource which created this cmd resource.
+			break;
+	}
 
 	r = 0;
 out:
@@ -4309,7 +5790,10 @@ static int _cmd_handler(sid_resource_event_source_t *es, void *data)
 	sid_resource_t       *cmd_res  = data;
 	struct sid_ucmd_ctx  *ucmd_ctx = sid_resource_get_data(cmd_res);
 	const struct cmd_reg *cmd_reg  = _get_cmd_reg(ucmd_ctx);
-	int                   r        = -1;
+	sid_resource_t       *conn_res;
+	int                   r = -1;
+
+	_cmd_debug_begin(ucmd_ctx);
 
 	if (ucmd_ctx->state == CMD_EXEC_SCHEDULED) {
 		_change_cmd_state(cmd_res, CMD_EXECUTING);
@@ -4327,23 +5811,42 @@ static int _cmd_handler(sid_resource_event_source_t *es, void *data)
 			_change_cmd_state(cmd_res, CMD_EXEC_FINISHED);
 	}
 
-	if (ucmd_ctx->state == CMD_EXEC_FINISHED) {
+	if (ucmd_ctx->state == CMD_EXEC_FINISHED && cmd_reg->exec == _cmd_exec_scan && ucmd_ctx->scan.spec_fd >= 0) {
+		/*
+		 * Speculative or memoized scan's KV store exports are already synced with main KV store
+		 * or main process queued them for sync before it passed us the result.
+		 */
+		r = _send_out_cmd_spec_scan_result(cmd_res);
+	} else if (ucmd_ctx->state == CMD_EXEC_FINISHED) {
 		if ((r = _build_cmd_kv_buffers(cmd_res, cmd_reg)) < 0) {
 			log_error(ID(cmd_res), "Failed to export KV store.");
 			goto out;
 		}
 
 		// TODO: check returned error code from _send_out_cmd_* fns
-		if (cmd_reg->flags & CMD_KV_EXPECT_EXPBUF_ACK) {
-			r = _send_out_cmd_expbuf(cmd_res);
-			_change_cmd_state(cmd_res, CMD_EXPECTING_EXPBUF_ACK);
+		if ((cmd_reg->flags & CMD_KV_EXPECT_EXPBUF_ACK) && ucmd_ctx->exp_buf && sid_buffer_count(ucmd_ctx->exp_buf) > 0) {
+			/*
+			 * Do not wait for the ack with the response. The response is complete
+			 * without the sync with main KV store. We only need to queue the exports
+			 * before sending the response so that main process applies them before
+			 * accepting any other request which might have been triggered by this response.
+			 */
+			if ((r = _send_out_cmd_expbuf(cmd_res)) == 0) {
+				_change_cmd_state(cmd_res, CMD_EXPECTING_EXPBUF_ACK);
+
+				/*
+				 * The exports are queued already, so wait for the ack even if
+				 * the response could not be sent and only record the failure.
+				 */
+				if (_send_out_cmd_resbuf(cmd_res) < 0)
+					ucmd_ctx->res_hdr.status |= SID_CMD_STATUS_FAILURE;
+			}
 		} else {
 			if ((r = _send_out_cmd_resbuf(cmd_res) == 0))
 				r = _send_out_cmd_expbuf(cmd_res);
 		}
-	} else if (ucmd_ctx->state == CMD_EXPBUF_ACKED) {
-		r = _send_out_cmd_resbuf(cmd_res);
-	}
+	} else if (ucmd_ctx->state == CMD_EXPBUF_ACKED)
+		r = (ucmd_ctx->res_hdr.status & SID_CMD_STATUS_FAILURE) ? -1 : 0;
 out:
 	if (r < 0) {
 		// TODO: res_hdr.status needs to be set before _send_out_cmd_kv_buffers so it's transmitted
@@ -4351,19 +5854,40 @@ out:
 		ucmd_ctx->res_hdr.status |= SID_CMD_STATUS_FAILURE;
 		_change_cmd_state(cmd_res, CMD_ERROR);
 	} else {
-		if (ucmd_ctx->state == CMD_EXEC_FINISHED || ucmd_ctx->state == CMD_EXPBUF_ACKED)
+		if (ucmd_ctx->state == CMD_EXEC_FINISHED || ucmd_ctx->state == CMD_EXPBUF_ACKED) {
 			_change_cmd_state(cmd_res, CMD_OK);
+
+			/* Exports are synced by now (if there were any), so the result can be memoized. */
+			if (cmd_reg->exec == _cmd_exec_scan && ucmd_ctx->scan.memo_hash && ucmd_ctx->scan.spec_fd < 0)
+				(void) _store_scan_memo(cmd_res, true);
+		}
 	}
 
+	_cmd_debug_end(ucmd_ctx);
+
 	/*
 	 * At the end of processing a 'SELF' request, there's no other external entity or event
 	 * that would cause the worker to yield itself so do it now before we resume the event loop.
 	 */
 	if (ucmd_ctx->req_cat == MSG_CATEGORY_SELF) {
+		/* Let main process know the speculative scan failed so it does not wait for the result. */
+		if (ucmd_ctx->state == CMD_ERROR && ucmd_ctx->req_hdr.cmd == SELF_CMD_SCAN)
+			(void) _send_spec_scan_result(cmd_res, false);
+
 		if (ucmd_ctx->state == CMD_OK || ucmd_ctx->state == CMD_ERROR)
 			(void) worker_control_worker_yield(sid_resource_search(cmd_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL));
 	}
 
+	/* Finish the connection cleanup deferred until the ack arrived, this also destroys the command. */
+	if (ucmd_ctx->req_cat == MSG_CATEGORY_CLIENT && (ucmd_ctx->state == CMD_OK || ucmd_ctx->state == CMD_ERROR)) {
+		conn_res = sid_resource_search(cmd_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+
+		if (((struct connection *) sid_resource_get_data(conn_res))->closed) {
+			(void) _connection_cleanup(conn_res);
+			return 0;
+		}
+	}
+
 	return r;
 }
 
@@ -4518,9 +6042,17 @@ fail:
 static int _init_connection(sid_resource_t *res, const void *kickstart_data, void **data)
 {
 	const struct worker_data_spec *data_spec = kickstart_data;
+	sid_resource_t                *common_res;
 	struct connection             *conn;
+	size_t                         size;
 	int                            r;
 
+	if (!(common_res = sid_resource_search(res, SID_RESOURCE_SEARCH_GENUS, &sid_resource_type_ubridge_common, COMMON_ID))) {
+		log_error(ID(res), INTERNAL_ERROR "%s: Failed to find common resource.", __func__);
+		return -1;
+	}
+	size = ((struct sid_ucmd_common_ctx *) sid_resource_get_data(common_res))->conn_buf_size;
+
 	if (!(conn = mem_zalloc(sizeof(*conn)))) {
 		log_error(ID(res), "Failed to allocate new connection structure.");
 		goto fail;
@@ -4528,7 +6060,7 @@ static int _init_connection(sid_resource_t *res, const void *kickstart_data, voi
 
 	conn->fd = data_spec->ext.socket.fd_pass;
 
-	if (sid_resource_create_io_event_source(res, NULL, conn->fd, _on_connection_event, 0, "client connection", res) < 0) {
+	if (sid_resource_create_io_event_source(res, &conn->es, conn->fd, _on_connection_event, 0, "client connection", res) < 0) {
 		log_error(ID(res), "Failed to register connection event handler.");
 		goto fail;
 	}
@@ -4536,7 +6068,7 @@ static int _init_connection(sid_resource_t *res, const void *kickstart_data, voi
 	if (!(conn->buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
 	                                                                .type    = SID_BUFFER_TYPE_LINEAR,
 	                                                                .mode    = SID_BUFFER_MODE_SIZE_PREFIX}),
-	                                    &((struct sid_buffer_init) {.size = 0, .alloc_step = 1, .limit = 0}),
+	                                    &((struct sid_buffer_init) {.size = size, .alloc_step = 1, .limit = 0}),
 	                                    &r))) {
 		log_error_errno(ID(res), r, "Failed to create connection buffer");
 		goto fail;
@@ -4601,6 +6133,13 @@ static int _init_command(sid_resource_t *res, const void *kickstart_data, void *
 		goto fail;
 	}
 
+	if (cmd_reg->exec == _cmd_exec_scan)
+		ucmd_ctx->scan.spec_fd = -1;
+	else if (cmd_reg->exec == _cmd_exec_kv_view)
+		ucmd_ctx->kv_view.fd = -1;
+	else if (cmd_reg->exec == _cmd_exec_resources)
+		ucmd_ctx->resources.fd = -1;
+
 	/* FIXME: Not all commands require print buffer - add command flag to control creation of this buffer. */
 	if (!(ucmd_ctx->prn_buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
 	                                                                        .type    = SID_BUFFER_TYPE_LINEAR,
@@ -4640,6 +6179,57 @@ static int _init_command(sid_resource_t *res, const void *kickstart_data, void *
 		}
 
 		log_debug(ID(res), "Processing uevent for device " CMD_DEV_NAME_NUM_FMT, CMD_DEV_NAME_NUM(ucmd_ctx));
+
+		if (cmd_reg->exec == _cmd_exec_scan && ucmd_ctx->common->spec_scan.enabled) {
+			if (ucmd_ctx->req_cat == MSG_CATEGORY_SELF) {
+				if (!(ucmd_ctx->scan.spec_deps = sid_buffer_create(
+					      &((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+					                                  .type    = SID_BUFFER_TYPE_LINEAR,
+					                                  .mode    = SID_BUFFER_MODE_PLAIN}),
+					      &((struct sid_buffer_init) {.size = 0, .alloc_step = PATH_MAX, .limit = 0}),
+					      &r))) {
+					log_error_errno(ID(res), r, "Failed to create speculative scan dependency buffer");
+					goto fail;
+				}
+			} else if (ucmd_ctx->req_env.dev.udev.seqnum && ucmd_ctx->req_env.dev.udev.action != UDEV_ACTION_REMOVE) {
+				/* keep udev environment, without devno prefix, to match with speculative scan */
+				ucmd_ctx->scan.spec_env_size = msg->size - SID_MSG_HEADER_SIZE - sizeof(dev_t);
+				if (!(ucmd_ctx->scan.spec_env = malloc(ucmd_ctx->scan.spec_env_size)))
+					goto fail;
+				memcpy(ucmd_ctx->scan.spec_env,
+				       (const char *) msg->header + SID_MSG_HEADER_SIZE + sizeof(dev_t),
+				       ucmd_ctx->scan.spec_env_size);
+			}
+		}
+
+		if (cmd_reg->exec == _cmd_exec_scan && ucmd_ctx->common->scan_memo.enabled &&
+		    ucmd_ctx->req_cat == MSG_CATEGORY_CLIENT && ucmd_ctx->req_env.dev.udev.seqnum) {
+			if (!(ucmd_ctx->scan.memo_env = _copy_scan_env(
+				      (const char *) msg->header + SID_MSG_HEADER_SIZE + sizeof(dev_t),
+				      msg->size - SID_MSG_HEADER_SIZE - sizeof(dev_t),
+				      &ucmd_ctx->scan.memo_env_size)))
+				goto fail;
+			ucmd_ctx->scan.memo_hash = _hash_scan_env(ucmd_ctx->scan.memo_env, ucmd_ctx->scan.memo_env_size);
+		}
+	}
+
+	/* evaluated once per command here, or in ident phase if filtering by module */
+	ucmd_ctx->debug = _debug_filter_match(ucmd_ctx, NULL);
+
+	if (cmd_reg->exec == _cmd_exec_resources && msg->size > SID_MSG_HEADER_SIZE) {
+		ucmd_ctx->resources.params_size = msg->size - SID_MSG_HEADER_SIZE;
+		if (!(ucmd_ctx->resources.params = malloc(ucmd_ctx->resources.params_size)))
+			goto fail;
+		memcpy(ucmd_ctx->resources.params,
+		       (const char *) msg->header + SID_MSG_HEADER_SIZE,
+		       ucmd_ctx->resources.params_size);
+	}
+
+	if (cmd_reg->exec == _cmd_exec_params && msg->size > SID_MSG_HEADER_SIZE) {
+		ucmd_ctx->params.list_size = msg->size - SID_MSG_HEADER_SIZE;
+		if (!(ucmd_ctx->params.list = malloc(ucmd_ctx->params.list_size)))
+			goto fail;
+		memcpy(ucmd_ctx->params.list, (const char *) msg->header + SID_MSG_HEADER_SIZE, ucmd_ctx->params.list_size);
 	}
 
 	if (cmd_reg->flags & CMD_KV_EXPBUF_TO_FILE) {
@@ -4681,12 +6271,27 @@ fail:
 		if (cmd_reg && cmd_reg->flags & CMD_KV_EXPBUF_TO_FILE && ucmd_ctx->req_env.exp_path)
 			free((void *) ucmd_ctx->req_env.exp_path);
 
+		if (cmd_reg && cmd_reg->exec == _cmd_exec_scan) {
+			free(ucmd_ctx->scan.spec_env);
+			free(ucmd_ctx->scan.memo_env);
+			if (ucmd_ctx->scan.spec_deps)
+				sid_buffer_destroy(ucmd_ctx->scan.spec_deps);
+		}
+
+		if (cmd_reg && cmd_reg->exec == _cmd_exec_resources)
+			free(ucmd_ctx->resources.params);
+
+		if (cmd_reg && cmd_reg->exec == _cmd_exec_params)
+			free(ucmd_ctx->params.list);
+
 		if (ucmd_ctx->prn_buf)
 			sid_buffer_destroy(ucmd_ctx->prn_buf);
 
 		if (ucmd_ctx->res_buf)
 			sid_buffer_destroy(ucmd_ctx->res_buf);
 
+		_udev_exp_destroy(ucmd_ctx);
+
 		if (ucmd_ctx->req_env.dev.num_s)
 			free(ucmd_ctx->req_env.dev.num_s);
 
@@ -4711,9 +6316,30 @@ static int _destroy_command(sid_resource_t *res)
 	if (ucmd_ctx->exp_buf)
 		sid_buffer_destroy(ucmd_ctx->exp_buf);
 
+	_foreign_kv_cache_destroy(ucmd_ctx);
+	_udev_exp_destroy(ucmd_ctx);
+
 	if (ucmd_ctx->req_hdr.cmd == SID_CMD_RESOURCES) {
-		if (ucmd_ctx->resources.main_res_mem)
-			munmap(ucmd_ctx->resources.main_res_mem, ucmd_ctx->resources.main_res_mem_size);
+		if (ucmd_ctx->resources.fd >= 0)
+			(void) close(ucmd_ctx->resources.fd);
+		free(ucmd_ctx->resources.params);
+	}
+
+	if (cmd_reg->exec == _cmd_exec_scan) {
+		if (ucmd_ctx->scan.spec_fd >= 0)
+			(void) close(ucmd_ctx->scan.spec_fd);
+		free(ucmd_ctx->scan.spec_env);
+		free(ucmd_ctx->scan.memo_env);
+		if (ucmd_ctx->scan.spec_deps)
+			sid_buffer_destroy(ucmd_ctx->scan.spec_deps);
+	}
+
+	if (cmd_reg->exec == _cmd_exec_kv_view && ucmd_ctx->kv_view.fd >= 0)
+		(void) close(ucmd_ctx->kv_view.fd);
+
+	if (cmd_reg->exec == _cmd_exec_params) {
+		free(ucmd_ctx->params.list);
+		free(ucmd_ctx->params.reply);
 	}
 
 	if ((cmd_reg->flags & CMD_KV_EXPBUF_TO_FILE))
@@ -4795,359 +6421,2183 @@ static int _kv_cb_main_set(struct kv_store_update_spec *spec)
 	return r;
 }
 
-static int _sync_main_kv_store(sid_resource_t *res, struct sid_ucmd_common_ctx *common_ctx, int fd)
+static bool _is_kv_view_key(const char *key)
 {
-	static const char           syncing_msg[] = "Syncing main key-value store:  %s = %s (seqnum %" PRIu64 ")";
-	kv_store_value_flags_t      kv_store_value_flags;
-	SID_BUFFER_SIZE_PREFIX_TYPE msg_size;
-	size_t                      key_size, value_size, data_offset, i;
-	char                       *key, *shm           = MAP_FAILED, *p, *end;
-	kv_scalar_t                 tmp_svalue, *svalue = NULL;
-	kv_vector_t                *vvalue = NULL;
-	const char                 *vvalue_str;
-	void                       *value_to_store;
-	struct kv_rel_spec          rel_spec   = {.delta = &((struct kv_delta) {0}), .abs_delta = &((struct kv_delta) {0})};
-	struct kv_update_arg        update_arg = {.gen_buf = common_ctx->gen_buf, .custom = &rel_spec};
-	bool                        unset;
-	int                         r = -1;
+	const char *core;
 
-	if (read(fd, &msg_size, SID_BUFFER_SIZE_PREFIX_LEN) != SID_BUFFER_SIZE_PREFIX_LEN) {
-		log_error_errno(ID(res), errno, "Failed to read shared memory size");
-		goto out;
-	}
+	if (!strncmp(key, KV_VIEW_PREFIX_ALIAS, sizeof(KV_VIEW_PREFIX_ALIAS) - 1))
+		return true;
 
-	if (msg_size <= SID_BUFFER_SIZE_PREFIX_LEN) { /* nothing to sync */
-		r = 0;
-		goto out;
-	}
+	if (strncmp(key, KV_VIEW_PREFIX_DEVICE, sizeof(KV_VIEW_PREFIX_DEVICE) - 1) ||
+	    !(core = _get_key_part(key, KEY_PART_CORE, NULL)))
+		return false;
 
-	if ((p = shm = mmap(NULL, msg_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
-		log_error_errno(ID(res), errno, "Failed to map memory with key-value store");
-		goto out;
-	}
+	return !strcmp(core, KV_KEY_DEV_READY) || !strcmp(core, KV_KEY_DEV_RESERVED);
+}
 
-	end = p + msg_size;
-	p   += sizeof(msg_size);
+/*
+ * Rebuild shared KV view from main KV store. The values are stored without the value
+ * header and data items of vector values are concatenated. Records are collected in
+ * two passes over main KV store, the first one only counts the records and data size.
+ *
+ * Clients have the view mapped with the size it had when they fetched it so if the
+ * records do not fit anymore, a new, bigger view is created and the old one is marked
+ * as stale so clients know they need to fetch the new one.
+ */
+static int _update_kv_view(struct sid_ucmd_common_ctx *common_ctx)
+{
+	static const char *const  prefixes[] = {KV_VIEW_PREFIX_DEVICE, KV_VIEW_PREFIX_ALIAS};
+	struct sid_kv_view_writer new_writer;
+	struct sid_kv_view_item  *items = NULL;
+	kv_store_iter_t          *iter  = NULL;
+	kv_store_value_flags_t    kv_store_value_flags;
+	kv_vector_t               tmp_vvalue[VVALUE_SINGLE_CNT];
+	kv_vector_t              *vvalue;
+	const char               *key;
+	void                     *value;
+	char                     *data = NULL, *p = NULL;
+	size_t                    nr_items = 0, data_size = 0, size, vsize, needed, i, j;
+	unsigned                  pass;
+	int                       r = -ENOMEM;
+
+	for (pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			if ((nr_items && !(items = malloc(nr_items * sizeof(*items)))) ||
+			    (data_size && !(data = malloc(data_size))))
+				goto out;
+			nr_items = 0;
+			p        = data;
+		}
 
-	if (kv_store_transaction_begin(common_ctx->kv_store_res) < 0) {
-		log_error(ID(res), "Failed to start key-value store transaction");
-		goto out;
-	}
+		for (i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+			if (!(iter = kv_store_iter_create_prefix(common_ctx->kv_store_res, prefixes[i], strlen(prefixes[i]))))
+				goto out;
 
-	while (p < end) {
-		memcpy(&kv_store_value_flags, p, sizeof(kv_store_value_flags));
-		p += sizeof(kv_store_value_flags);
+			while ((value = kv_store_iter_next(iter, &size, &key, &kv_store_value_flags))) {
+				if (!_is_kv_view_key(key))
+					continue;
 
-		memcpy(&key_size, p, sizeof(key_size));
-		p += sizeof(key_size);
+				vvalue = _get_vvalue(kv_store_value_flags, value, size, tmp_vvalue);
+				vsize  = kv_store_value_flags & KV_STORE_VALUE_VECTOR ? size : VVALUE_SINGLE_CNT;
 
-		memcpy(&value_size, p, sizeof(value_size));
-		p   += sizeof(value_size);
+				if (pass == 0) {
+					for (j = VVALUE_IDX_DATA; j < vsize; j++)
+						data_size += vvalue[j].iov_len;
+				} else {
+					items[nr_items] = (struct sid_kv_view_item) {.key = key, .value = p};
+					for (j = VVALUE_IDX_DATA; j < vsize; j++) {
+						memcpy(p, vvalue[j].iov_base, vvalue[j].iov_len);
+						p += vvalue[j].iov_len;
+					}
+					items[nr_items].value_size = p - (char *) items[nr_items].value;
+				}
 
-		key = p;
-		p   += key_size;
+				nr_items++;
+			}
 
-		/*
-		 * Note: if we're reserving a value, then we keep it even if it's NULL.
-		 * This prevents others to use the same key. To unset the value,
-		 * one needs to drop the flag explicitly.
-		 */
+			kv_store_iter_destroy(iter);
+			iter = NULL;
+		}
+	}
 
-		if (kv_store_value_flags & KV_STORE_VALUE_VECTOR) {
-			if (value_size < VVALUE_HEADER_CNT) {
-				log_error(ID(res),
-				          "Received incorrect vector of size %zu to sync with main key-value store.",
-				          value_size);
-				goto out;
-			}
+	if ((r = sid_kv_view_writer_update(&common_ctx->kv_view.writer, items, nr_items)) == -ENOSPC) {
+		needed = sid_kv_view_size(items, nr_items);
+		for (size = common_ctx->kv_view.writer.size; size < needed; size <<= 1)
+			;
 
-			if (!(vvalue = malloc(value_size * sizeof(kv_vector_t)))) {
-				log_error(ID(res), "Failed to allocate vector to sync main key-value store.");
-				goto out;
-			}
+		if ((r = sid_kv_view_writer_init(&new_writer, size)) < 0)
+			goto out;
 
-			for (i = 0; i < value_size; i++) {
-				memcpy(&vvalue[i].iov_len, p, sizeof(size_t));
-				p                  += sizeof(size_t);
-				vvalue[i].iov_base = p;
-				p                  += vvalue[i].iov_len;
-			}
-			/* Copy values to aligned memory */
-			memcpy(&tmp_svalue.seqnum, vvalue[VVALUE_IDX_SEQNUM].iov_base, sizeof(tmp_svalue.seqnum));
-			vvalue[VVALUE_IDX_SEQNUM].iov_base = &tmp_svalue.seqnum;
-			memcpy(&tmp_svalue.flags, vvalue[VVALUE_IDX_FLAGS].iov_base, sizeof(tmp_svalue.flags));
-			vvalue[VVALUE_IDX_FLAGS].iov_base = &tmp_svalue.flags;
-			memcpy(&tmp_svalue.gennum, vvalue[VVALUE_IDX_GENNUM].iov_base, sizeof(tmp_svalue.gennum));
-			vvalue[VVALUE_IDX_GENNUM].iov_base = &tmp_svalue.gennum;
-
-			unset               = !(VVALUE_FLAGS(vvalue) & KV_MOD_RESERVED) && (value_size == VVALUE_HEADER_CNT);
-
-			update_arg.owner    = VVALUE_OWNER(vvalue);
-			update_arg.res      = common_ctx->kv_store_res;
-			update_arg.ret_code = 0;
-
-			vvalue_str          = _buffer_get_vvalue_str(common_ctx->gen_buf, unset, vvalue, value_size);
-			log_debug(ID(res), syncing_msg, key, vvalue_str, VVALUE_SEQNUM(vvalue));
-			if (vvalue_str)
-				sid_buffer_rewind_mem(common_ctx->gen_buf, vvalue_str);
-
-			switch (rel_spec.delta->op = _get_op_from_key(key)) {
-				case KV_OP_PLUS:
-					key += sizeof(KV_PREFIX_OP_PLUS_C) - 1;
-					break;
-				case KV_OP_MINUS:
-					key += sizeof(KV_PREFIX_OP_MINUS_C) - 1;
-					break;
-				case KV_OP_SET:
-					break;
-				case KV_OP_ILLEGAL:
-					log_error(ID(res),
-					          INTERNAL_ERROR
-					          "Illegal operator found for key %s while trying to sync main key-value store.",
-					          key);
-					goto out;
-			}
+		if ((r = sid_kv_view_writer_update(&new_writer, items, nr_items)) < 0) {
+			sid_kv_view_writer_destroy(&new_writer, false);
+			goto out;
+		}
 
-			value_to_store = vvalue;
-		} else {
-			if (value_size <= sizeof(*svalue)) {
-				log_error(ID(res),
-				          "Received incorrect value of size %zu to sync with main key-value store.",
-				          value_size);
-				goto out;
-			}
+		sid_kv_view_writer_destroy(&common_ctx->kv_view.writer, true);
+		common_ctx->kv_view.writer = new_writer;
+		log_debug(ID(common_ctx->res), "Shared key-value store view resized to %zu bytes.", size);
+	}
+out:
+	if (iter)
+		kv_store_iter_destroy(iter);
+	free(items);
+	free(data);
 
-			if (!(svalue = malloc(value_size))) {
-				log_error(ID(res), "Failed to allocate svalue to sync main key-value store.");
-				goto out;
-			}
+	if (r < 0)
+		log_error_errno(ID(common_ctx->res), r, "Failed to update shared key-value store view.");
+	else
+		common_ctx->kv_view.dirty = false;
 
-			memcpy(svalue, p, value_size);
-			p                += value_size;
+	return r;
+}
 
-			data_offset      = _svalue_ext_data_offset(svalue);
-			unset            = ((svalue->flags != KV_MOD_RESERVED) && (value_size == (sizeof(*svalue) + data_offset)));
+static void _change_scan_memo_dep(struct scan_memo_dep *dep, uint64_t kv_gen)
+{
+	/* one export may change the same records many times */
+	if (dep->kv_gen == kv_gen)
+		return;
 
-			update_arg.owner = svalue->data;
-			update_arg.res   = common_ctx->kv_store_res;
-			update_arg.ret_code = 0;
+	dep->prev_kv_gen = dep->kv_gen;
+	dep->kv_gen      = kv_gen;
+}
 
-			log_debug(ID(res), syncing_msg, key, unset ? "NULL" : svalue->data + data_offset, svalue->seqnum);
+static void _free_scan_memo_dep(const void *key, uint32_t key_len, void *data, size_t data_len)
+{
+	free(data);
+}
 
-			rel_spec.delta->op = KV_OP_SET;
+/*
+ * Track change of main KV store record with 'key' done by the export being synced, for
+ * checking memoized scan results. Records of a single device, that is, records set in its
+ * udev, device or device-module namespace, are tracked per device. Any other change, like
+ * alias or group update or delta update which changes records of other devices too, is
+ * tracked as a change of records shared by all devices.
+ */
+static void _track_scan_memo_dep(struct sid_ucmd_common_ctx *common_ctx, const char *key, kv_op_t op)
+{
+	sid_ucmd_kv_namespace_t ns     = _get_ns_from_key(key);
+	uint64_t                kv_gen = common_ctx->scan_memo.kv_gen;
+	struct scan_memo_dep   *dep;
+	const char             *dom, *ns_part;
+	size_t                  dom_len, ns_part_len;
 
-			value_to_store     = svalue;
-		}
+	if (op != KV_OP_SET || (ns != KV_NS_UDEV && ns != KV_NS_DEVICE && ns != KV_NS_DEVMOD) ||
+	    !(dom = _get_key_part(key, KEY_PART_DOM, &dom_len)) ||
+	    (dom_len && (dom_len != sizeof(KV_KEY_DOM_USER) - 1 || strncmp(dom, KV_KEY_DOM_USER, dom_len))) ||
+	    !(ns_part = _get_key_part(key, KEY_PART_NS_PART, &ns_part_len)) || !ns_part_len)
+		goto shared;
 
-		if (unset)
-			(void) kv_store_unset(common_ctx->kv_store_res, key, _kv_cb_main_unset, &update_arg);
-		else {
-			if (rel_spec.delta->op == KV_OP_SET) {
-				if (!kv_store_set_value(common_ctx->kv_store_res,
-				                        key,
-				                        value_to_store,
-				                        value_size,
-				                        kv_store_value_flags,
-				                        KV_STORE_VALUE_NO_OP,
-				                        _kv_cb_main_set,
-				                        &update_arg))
-					goto out;
-			} else {
-				value_to_store = kv_store_set_value(common_ctx->kv_store_res,
-				                                    key,
-				                                    value_to_store,
-				                                    value_size,
-				                                    KV_STORE_VALUE_VECTOR | KV_STORE_VALUE_REF,
-				                                    KV_STORE_VALUE_NO_OP,
-				                                    _kv_cb_main_delta_step,
-				                                    &update_arg);
-				_destroy_delta_buffers(rel_spec.delta);
-				if (!value_to_store || update_arg.ret_code < 0)
-					goto out;
-			}
+	if (!(dep = hash_lookup(common_ctx->scan_memo.dep_ht, ns_part, ns_part_len, NULL))) {
+		/*
+		 * Forget tracked devices if there are too many. All records are considered changed
+		 * then, including the changes of this export - the tracked ones are lost.
+		 */
+		if (hash_get_num_entries(common_ctx->scan_memo.dep_ht) >= SCAN_MEMO_MAX_DEPS) {
+			hash_iter(common_ctx->scan_memo.dep_ht, _free_scan_memo_dep);
+			hash_wipe(common_ctx->scan_memo.dep_ht);
+			common_ctx->scan_memo.shared = (struct scan_memo_dep) {.kv_gen = kv_gen, .prev_kv_gen = kv_gen};
+			return;
 		}
 
-		svalue = mem_freen(svalue);
-		vvalue = mem_freen(vvalue);
-	}
-
-	r = 0;
-out:
-	if (kv_store_in_transaction(common_ctx->kv_store_res))
-		kv_store_transaction_end(common_ctx->kv_store_res, (r < 0));
-	free(vvalue);
-	free(svalue);
+		if (!(dep = mem_zalloc(sizeof(*dep))))
+			goto shared;
 
-	if (shm != MAP_FAILED && munmap(shm, msg_size) < 0) {
-		log_error_errno(ID(res), errno, "Failed to unmap memory with key-value store");
-		r = -1;
+		if (hash_insert(common_ctx->scan_memo.dep_ht, ns_part, ns_part_len, dep, sizeof(*dep)) < 0) {
+			free(dep);
+			goto shared;
+		}
 	}
 
-	return r;
+	_change_scan_memo_dep(dep, kv_gen);
+	return;
+shared:
+	_change_scan_memo_dep(&common_ctx->scan_memo.shared, kv_gen);
 }
 
-static int _worker_proxy_recv_system_cmd_sync(sid_resource_t *worker_proxy_res, struct worker_data_spec *data_spec, void *arg)
+static int _sync_main_kv_store_record(sid_resource_t *res, struct sid_ucmd_common_ctx *common_ctx, char **p_ptr)
 {
-	struct sid_ucmd_common_ctx *common_ctx = arg;
-	int                         r;
+	static const char      syncing_msg[] = "Syncing main key-value store:  %s = %s (seqnum %" PRIu64 ")";
+	kv_store_value_flags_t kv_store_value_flags;
+	size_t                 key_size, value_size, data_offset, i;
+	char                  *key, *p = *p_ptr;
+	kv_scalar_t            tmp_svalue, *svalue = NULL;
+	kv_vector_t           *vvalue = NULL;
+	const char            *vvalue_str;
+	void                  *value_to_store;
+	struct kv_rel_spec     rel_spec   = {.delta = &((struct kv_delta) {0}), .abs_delta = &((struct kv_delta) {0})};
+	struct kv_update_arg   update_arg = {.gen_buf = common_ctx->gen_buf, .custom = &rel_spec};
+	bool                   unset;
+	int                    r = -1;
 
-	if (!data_spec->ext.used) {
-		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received KV store sync request, but KV store sync data missing.");
-		return -1;
-	}
+	memcpy(&kv_store_value_flags, p, sizeof(kv_store_value_flags));
+	p += sizeof(kv_store_value_flags);
 
-	(void) _sync_main_kv_store(worker_proxy_res, common_ctx, data_spec->ext.socket.fd_pass);
+	memcpy(&key_size, p, sizeof(key_size));
+	p += sizeof(key_size);
 
-	r = worker_control_channel_send(
-		worker_proxy_res,
-		MAIN_WORKER_CHANNEL_ID,
-		&(struct worker_data_spec) {.data = data_spec->data, .data_size = data_spec->data_size, .ext.used = false});
+	memcpy(&value_size, p, sizeof(value_size));
+	p   += sizeof(value_size);
 
-	close(data_spec->ext.socket.fd_pass);
-	return r;
+	key = p;
+	p   += key_size;
+
+	/*
+	 * Note: if we're reserving a value, then we keep it even if it's NULL.
+	 * This prevents others to use the same key. To unset the value,
+	 * one needs to drop the flag explicitly.
+	 */
+
+	if (kv_store_value_flags & KV_STORE_VALUE_VECTOR) {
+		if (value_size < VVALUE_HEADER_CNT) {
+			log_error(ID(res), "Received incorrect vector of size %zu to sync with main key-value store.", value_size);
+			goto out;
+		}
+
+		if (!(vvalue = malloc(value_size * sizeof(kv_vector_t)))) {
+			log_error(ID(res), "Failed to allocate vector to sync main key-value store.");
+			goto out;
+		}
+
+		for (i = 0; i < value_size; i++) {
+			memcpy(&vvalue[i].iov_len, p, sizeof(size_t));
+			p                  += sizeof(size_t);
+			vvalue[i].iov_base = p;
+			p                  += vvalue[i].iov_len;
+		}
+		/* Copy values to aligned memory */
+		memcpy(&tmp_svalue.seqnum, vvalue[VVALUE_IDX_SEQNUM].iov_base, sizeof(tmp_svalue.seqnum));
+		vvalue[VVALUE_IDX_SEQNUM].iov_base = &tmp_svalue.seqnum;
+		memcpy(&tmp_svalue.flags, vvalue[VVALUE_IDX_FLAGS].iov_base, sizeof(tmp_svalue.flags));
+		vvalue[VVALUE_IDX_FLAGS].iov_base = &tmp_svalue.flags;
+		memcpy(&tmp_svalue.gennum, vvalue[VVALUE_IDX_GENNUM].iov_base, sizeof(tmp_svalue.gennum));
+		vvalue[VVALUE_IDX_GENNUM].iov_base = &tmp_svalue.gennum;
+
+		unset               = !(VVALUE_FLAGS(vvalue) & KV_MOD_RESERVED) && (value_size == VVALUE_HEADER_CNT);
+
+		update_arg.owner    = VVALUE_OWNER(vvalue);
+		update_arg.res      = common_ctx->kv_store_res;
+		update_arg.ret_code = 0;
+
+		vvalue_str          = _buffer_get_vvalue_str(common_ctx->gen_buf, unset, vvalue, value_size);
+		log_debug(ID(res), syncing_msg, key, vvalue_str, VVALUE_SEQNUM(vvalue));
+		if (vvalue_str)
+			sid_buffer_rewind_mem(common_ctx->gen_buf, vvalue_str);
+
+		switch (rel_spec.delta->op = _get_op_from_key(key)) {
+			case KV_OP_PLUS:
+				key += sizeof(KV_PREFIX_OP_PLUS_C) - 1;
+				break;
+			case KV_OP_MINUS:
+				key += sizeof(KV_PREFIX_OP_MINUS_C) - 1;
+				break;
+			case KV_OP_SET:
+				break;
+			case KV_OP_ILLEGAL:
+				log_error(ID(res),
+				          INTERNAL_ERROR
+				          "Illegal operator found for key %s while trying to sync main key-value store.",
+				          key);
+				goto out;
+		}
+
+		value_to_store = vvalue;
+	} else {
+		if (value_size <= sizeof(*svalue)) {
+			log_error(ID(res), "Received incorrect value of size %zu to sync with main key-value store.", value_size);
+			goto out;
+		}
+
+		if (!(svalue = malloc(value_size))) {
+			log_error(ID(res), "Failed to allocate svalue to sync main key-value store.");
+			goto out;
+		}
+
+		memcpy(svalue, p, value_size);
+		p                   += value_size;
+
+		data_offset         = _svalue_ext_data_offset(svalue);
+		unset               = ((svalue->flags != KV_MOD_RESERVED) && (value_size == (sizeof(*svalue) + data_offset)));
+
+		update_arg.owner    = svalue->data;
+		update_arg.res      = common_ctx->kv_store_res;
+		update_arg.ret_code = 0;
+
+		log_debug(ID(res), syncing_msg, key, unset ? "NULL" : svalue->data + data_offset, svalue->seqnum);
+
+		rel_spec.delta->op = KV_OP_SET;
+
+		value_to_store     = svalue;
+	}
+
+	if (common_ctx->kv_view.enabled && _is_kv_view_key(key))
+		common_ctx->kv_view.dirty = true;
+
+	if (common_ctx->scan_memo.dep_ht)
+		_track_scan_memo_dep(common_ctx, key, rel_spec.delta->op);
+
+	if (unset)
+		(void) kv_store_unset(common_ctx->kv_store_res, key, _kv_cb_main_unset, &update_arg);
+	else {
+		if (rel_spec.delta->op == KV_OP_SET) {
+			if (!kv_store_set_value(common_ctx->kv_store_res,
+			                        key,
+			                        value_to_store,
+			                        value_size,
+			                        kv_store_value_flags,
+			                        KV_STORE_VALUE_NO_OP,
+			                        _kv_cb_main_set,
+			                        &update_arg))
+				goto out;
+		} else {
+			value_to_store = kv_store_set_value(common_ctx->kv_store_res,
+			                                    key,
+			                                    value_to_store,
+			                                    value_size,
+			                                    KV_STORE_VALUE_VECTOR | KV_STORE_VALUE_REF,
+			                                    KV_STORE_VALUE_NO_OP,
+			                                    _kv_cb_main_delta_step,
+			                                    &update_arg);
+			_destroy_delta_buffers(rel_spec.delta);
+			if (!value_to_store || update_arg.ret_code < 0)
+				goto out;
+		}
+	}
+
+	*p_ptr = p;
+	r      = 0;
+out:
+	free(vvalue);
+	free(svalue);
+	return r;
+}
+
+/*
+ * Map KV store export from fd. If there's nothing to sync, *shm is set to NULL.
+ */
+static int _map_main_kv_store_sync(sid_resource_t *res, int fd, char **shm, size_t *shm_size)
+{
+	SID_BUFFER_SIZE_PREFIX_TYPE msg_size;
+	char                       *p;
+
+	*shm      = NULL;
+	*shm_size = 0;
+
+	if (read(fd, &msg_size, SID_BUFFER_SIZE_PREFIX_LEN) != SID_BUFFER_SIZE_PREFIX_LEN) {
+		log_error_errno(ID(res), errno, "Failed to read shared memory size");
+		return -1;
+	}
+
+	if (msg_size <= SID_BUFFER_SIZE_PREFIX_LEN) /* nothing to sync */
+		return 0;
+
+	if ((p = mmap(NULL, msg_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		log_error_errno(ID(res), errno, "Failed to map memory with key-value store");
+		return -1;
+	}
+
+	*shm      = p;
+	*shm_size = msg_size;
+	return 0;
+}
+
+static int _unmap_main_kv_store_sync(sid_resource_t *res, char *shm, size_t shm_size)
+{
+	if (shm && munmap(shm, shm_size) < 0) {
+		log_error_errno(ID(res), errno, "Failed to unmap memory with key-value store");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int _sync_main_kv_store(sid_resource_t *res, struct sid_ucmd_common_ctx *common_ctx, int fd)
+{
+	size_t shm_size;
+	char  *shm, *p, *end;
+	int    r;
+
+	if ((r = _map_main_kv_store_sync(res, fd, &shm, &shm_size)) < 0 || !shm)
+		return r;
+
+	end = shm + shm_size;
+	p   = shm + sizeof(SID_BUFFER_SIZE_PREFIX_TYPE);
+
+	if (kv_store_transaction_begin(common_ctx->kv_store_res) < 0) {
+		log_error(ID(res), "Failed to start key-value store transaction");
+		r = -1;
+		goto out;
+	}
+
+	common_ctx->scan_memo.kv_gen++;
+
+	while (p < end) {
+		if ((r = _sync_main_kv_store_record(res, common_ctx, &p)) < 0)
+			break;
+	}
+
+	kv_store_transaction_end(common_ctx->kv_store_res, (r < 0));
+out:
+	if (_unmap_main_kv_store_sync(res, shm, shm_size) < 0)
+		r = -1;
+
+	return r;
+}
+
+static void _destroy_main_kv_store_sync(sid_resource_t *res, struct kv_sync *sync)
+{
+	list_del(&sync->list);
+	(void) _unmap_main_kv_store_sync(res, sync->shm, sync->shm_size);
+	free(sync->worker_id);
+	free(sync->ack_data);
+	free(sync);
+}
+
+static void _finish_main_kv_store_sync(sid_resource_t *res, struct kv_sync *sync)
+{
+	sid_resource_t         *worker_proxy_res;
+	struct worker_data_spec data_spec;
+
+	/* The worker might have exited in the meantime, there's no one to ack then. */
+	if (sync->worker_id && (worker_proxy_res = worker_control_find_worker(sync->worker_control_res, sync->worker_id))) {
+		data_spec = (struct worker_data_spec) {.data = sync->ack_data, .data_size = sync->ack_data_size, .ext.used = false};
+		(void) worker_control_channel_send(worker_proxy_res, MAIN_WORKER_CHANNEL_ID, &data_spec);
+	}
+
+	_destroy_main_kv_store_sync(res, sync);
+}
+
+static bool _main_kv_store_slice_exhausted(unsigned records, unsigned max_records, uint64_t deadline)
+{
+	return records >= max_records || (deadline && util_time_get_now_usec(CLOCK_MONOTONIC) >= deadline);
+}
+
+/*
+ * Apply pending KV store exports to main KV store, but stop once 'max_records' records
+ * were processed or 'max_usec' microseconds (if not zero) were spent doing so. The limits
+ * are checked before each record, so a large export is applied across several calls. Its
+ * transaction stays open in between and the sync keeps the offset of the next record to
+ * apply. Nothing that reads main KV store runs until all pending syncs are complete (see
+ * _hold_for_main_kv_store_sync and _get_worker), so a half-applied export is never seen.
+ *
+ * Returns:
+ *   0 no more syncs pending
+ *   1 syncs still pending
+ */
+static int _sync_main_kv_store_slice(sid_resource_t             *res,
+                                     struct sid_ucmd_common_ctx *common_ctx,
+                                     unsigned                    max_records,
+                                     uint64_t                    max_usec)
+{
+	uint64_t        deadline = max_usec ? util_time_get_now_usec(CLOCK_MONOTONIC) + max_usec : 0;
+	unsigned        records  = 0;
+	uint64_t        kv_gen;
+	struct kv_sync *sync;
+	char           *p, *end;
+	int             r;
+
+	while (!list_is_empty(&common_ctx->sync.queue)) {
+		if (_main_kv_store_slice_exhausted(records, max_records, deadline))
+			return 1;
+
+		sync = list_item(common_ctx->sync.queue.n, struct kv_sync);
+
+		if (!sync->offset) {
+			if (kv_store_transaction_begin(common_ctx->kv_store_res) < 0) {
+				log_error(ID(res), "Failed to start key-value store transaction");
+				_finish_main_kv_store_sync(res, sync);
+				continue;
+			}
+
+			/*
+			 * Memoized scan results may depend on the records, changes are tracked with this
+			 * generation. The worker gets it with the ack so it can memoize its own result.
+			 */
+			kv_gen = ++common_ctx->scan_memo.kv_gen;
+			if (sync->ack_data)
+				memcpy((char *) sync->ack_data + sync->ack_data_size - sizeof(kv_gen), &kv_gen, sizeof(kv_gen));
+
+			sync->offset = sizeof(SID_BUFFER_SIZE_PREFIX_TYPE);
+		}
+
+		p   = sync->shm ? sync->shm + sync->offset : NULL;
+		end = sync->shm + sync->shm_size;
+		r   = 0;
+
+		while (p < end) {
+			if (_main_kv_store_slice_exhausted(records, max_records, deadline)) {
+				sync->offset = p - sync->shm;
+				return 1;
+			}
+
+			if ((r = _sync_main_kv_store_record(res, common_ctx, &p)) < 0)
+				break;
+
+			records++;
+		}
+
+		kv_store_transaction_end(common_ctx->kv_store_res, (r < 0));
+		_finish_main_kv_store_sync(res, sync);
+
+		if (common_ctx->kv_view.dirty)
+			(void) _update_kv_view(common_ctx);
+	}
+
+	return 0;
+}
+
+static int _on_main_kv_store_compact_event(sid_resource_event_source_t *es, void *data)
+{
+	struct sid_ucmd_common_ctx *common_ctx = data;
+
+	/* New syncs arrived in the meantime, compact once they are done. */
+	if (common_ctx->sync.es)
+		return 0;
+
+	if (kv_store_compact(common_ctx->kv_store_res) < 0)
+		log_error(ID(common_ctx->res), "Failed to compact main key-value store.");
+
+	return 0;
+}
+
+/*
+ * Removed records leave tombstones in main KV store so that records which are
+ * removed and added again in quick succession do not restructure the store each
+ * time. Delete the tombstones when there's nothing else to do.
+ */
+static void _schedule_main_kv_store_compact(struct sid_ucmd_common_ctx *common_ctx)
+{
+	int r;
+
+	if (common_ctx->sync.compact_es)
+		sid_resource_set_event_source_counter(common_ctx->sync.compact_es, SID_RESOURCE_POS_REL, 1);
+	else if ((r = sid_resource_create_deferred_event_source(common_ctx->res,
+	                                                        &common_ctx->sync.compact_es,
+	                                                        _on_main_kv_store_compact_event,
+	                                                        SID_RESOURCE_EVENT_PRIO_IDLE,
+	                                                        "main KV store compaction",
+	                                                        common_ctx)) < 0)
+		log_error_errno(ID(common_ctx->res), r, "Failed to register main key-value store compaction handler");
+}
+
+/* Stop watching the listening socket for connections to accept (worker process). */
+static void _stop_worker_accept_watch(struct sid_ucmd_common_ctx *common_ctx)
+{
+	if (common_ctx->worker_accept.watch_es)
+		sid_resource_destroy_event_source(&common_ctx->worker_accept.watch_es);
+
+	if (common_ctx->worker_accept.watch_fd >= 0) {
+		(void) close(common_ctx->worker_accept.watch_fd);
+		common_ctx->worker_accept.watch_fd = -1;
+	}
+
+	if (common_ctx->worker_accept.socket_fd >= 0) {
+		(void) close(common_ctx->worker_accept.socket_fd);
+		common_ctx->worker_accept.socket_fd = -1;
+	}
+}
+
+static void _destroy_worker_accept(struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct bounced_conn *bounced, *tmp_bounced;
+
+	list_iterate_items_safe (bounced, tmp_bounced, &common_ctx->worker_accept.bounced) {
+		list_del(&bounced->list);
+		(void) close(bounced->fd);
+		free(bounced);
+	}
+
+	if (common_ctx->worker_accept.timer_es)
+		sid_resource_destroy_event_source(&common_ctx->worker_accept.timer_es);
+
+	if (common_ctx->worker_accept.es)
+		sid_resource_destroy_event_source(&common_ctx->worker_accept.es);
+
+	free(common_ctx->worker_accept.token_id);
+	common_ctx->worker_accept.token_id = NULL;
+
+	_stop_worker_accept_watch(common_ctx);
+}
+
+static void _schedule_worker_accept(struct sid_ucmd_common_ctx *common_ctx)
+{
+	if (common_ctx->worker_accept.es)
+		sid_resource_set_event_source_counter(common_ctx->worker_accept.es, SID_RESOURCE_POS_REL, 1);
+}
+
+static void _schedule_spec_scan(struct sid_ucmd_common_ctx *common_ctx)
+{
+	if (common_ctx->spec_scan.es)
+		sid_resource_set_event_source_counter(common_ctx->spec_scan.es, SID_RESOURCE_POS_REL, 1);
+}
+
+static void _end_main_kv_store_sync(struct sid_ucmd_common_ctx *common_ctx)
+{
+	sid_resource_destroy_event_source(&common_ctx->sync.es);
+	_schedule_main_kv_store_compact(common_ctx);
+
+	/* Resume processing of events which were waiting for main KV store to be up to date. */
+	if (common_ctx->sync.held_es) {
+		sid_resource_set_event_source_counter(common_ctx->sync.held_es,
+		                                      SID_RESOURCE_POS_ABS,
+		                                      SID_RESOURCE_UNLIMITED_EVENT_COUNT);
+		common_ctx->sync.held_es = NULL;
+	}
+
+	/* New workers to accept client connections or to scan are only created with up-to-date main KV store. */
+	_schedule_worker_accept(common_ctx);
+	_schedule_spec_scan(common_ctx);
+}
+
+static int _on_main_kv_store_sync_event(sid_resource_event_source_t *es, void *data)
+{
+	struct sid_ucmd_common_ctx *common_ctx = data;
+
+	if (_sync_main_kv_store_slice(common_ctx->res, common_ctx, common_ctx->sync.max_records, common_ctx->sync.max_usec) > 0)
+		sid_resource_set_event_source_counter(es, SID_RESOURCE_POS_REL, 1);
+	else
+		_end_main_kv_store_sync(common_ctx);
+
+	return 0;
+}
+
+/*
+ * Hold the event source until all pending syncs with main KV store are complete.
+ * Returns true if the event source is held, false if there's nothing pending.
+ */
+static bool _hold_for_main_kv_store_sync(struct sid_ucmd_common_ctx *common_ctx, sid_resource_event_source_t *es)
+{
+	if (!common_ctx->sync.es)
+		return false;
+
+	sid_resource_set_event_source_counter(es, SID_RESOURCE_POS_REL, 0);
+	common_ctx->sync.held_es = es;
+	return true;
+}
+
+static struct kv_sync *_create_main_kv_store_sync(sid_resource_t *res,
+                                                  int             fd,
+                                                  sid_resource_t *worker_proxy_res,
+                                                  const void     *ack_data,
+                                                  size_t          ack_data_size)
+{
+	struct kv_sync *sync;
+
+	if (!(sync = mem_zalloc(sizeof(*sync)))) {
+		log_error(ID(res), "Failed to allocate main key-value store sync structure.");
+		return NULL;
+	}
+
+	list_init(&sync->list);
+
+	if (_map_main_kv_store_sync(res, fd, &sync->shm, &sync->shm_size) < 0)
+		goto fail;
+
+	if (worker_proxy_res) {
+		sync->worker_control_res = sid_resource_search(worker_proxy_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+
+		/* the ack carries main KV store generation the export is synced with, see _sync_main_kv_store_slice */
+		if (!(sync->worker_id = strdup(worker_control_get_worker_id(worker_proxy_res))) ||
+		    !(sync->ack_data = mem_zalloc(ack_data_size + sizeof(uint64_t)))) {
+			log_error(ID(res), "Failed to allocate main key-value store sync ack.");
+			goto fail;
+		}
+
+		memcpy(sync->ack_data, ack_data, ack_data_size);
+		sync->ack_data_size = ack_data_size + sizeof(uint64_t);
+	}
+
+	return sync;
+fail:
+	_destroy_main_kv_store_sync(res, sync);
+	return NULL;
+}
+
+/*
+ * Queue KV store export from fd to be applied to main KV store in time slices,
+ * without blocking the event loop. If worker_proxy_res is defined, 'ack_data'
+ * is sent back to the worker once the export is applied.
+ */
+static int _queue_main_kv_store_sync(sid_resource_t             *res,
+                                     struct sid_ucmd_common_ctx *common_ctx,
+                                     int                         fd,
+                                     sid_resource_t             *worker_proxy_res,
+                                     const void                 *ack_data,
+                                     size_t                      ack_data_size)
+{
+	struct kv_sync *sync;
+	int             r;
+
+	if (!(sync = _create_main_kv_store_sync(res, fd, worker_proxy_res, ack_data, ack_data_size)))
+		return -1;
+
+	if (!common_ctx->sync.es && (r = sid_resource_create_deferred_event_source(common_ctx->res,
+	                                                                           &common_ctx->sync.es,
+	                                                                           _on_main_kv_store_sync_event,
+	                                                                           0,
+	                                                                           "main KV store sync",
+	                                                                           common_ctx)) < 0) {
+		log_error_errno(ID(res), r, "Failed to register main key-value store sync handler");
+		_destroy_main_kv_store_sync(res, sync);
+		return r;
+	}
+
+	list_add(&common_ctx->sync.queue, &sync->list);
+	return 0;
+}
+
+/*
+ * Apply all pending KV store exports to main KV store right away. This blocks the event
+ * loop until all the syncs are complete, so use it only where waiting is expected.
+ */
+static void _flush_main_kv_store_sync(struct sid_ucmd_common_ctx *common_ctx)
+{
+	if (!common_ctx->sync.es)
+		return;
+
+	while (_sync_main_kv_store_slice(common_ctx->res, common_ctx, UINT_MAX, 0) > 0)
+		;
+
+	_end_main_kv_store_sync(common_ctx);
+}
+
+/*
+ * Take the accept token back from the worker holding it, its copy of main KV store
+ * is missing the export which has just arrived. The token is handed over to a new
+ * worker once the export is synced with main KV store.
+ */
+static void _revoke_accept_token(sid_resource_t *worker_control_res, struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct internal_msg_header int_msg = {.cat    = MSG_CATEGORY_SYSTEM,
+	                                      .header = (struct sid_msg_header) {.cmd = SYSTEM_CMD_ACCEPT_REVOKE}};
+	sid_resource_t            *worker_proxy_res;
+
+	if (!common_ctx->worker_accept.token_id)
+		return;
+
+	if ((worker_proxy_res = worker_control_find_worker(worker_control_res, common_ctx->worker_accept.token_id)))
+		(void) worker_control_channel_send(
+			worker_proxy_res,
+			MAIN_WORKER_CHANNEL_ID,
+			&(struct worker_data_spec) {.data = &int_msg, .data_size = INTERNAL_MSG_HEADER_SIZE, .ext.used = false});
+
+	free(common_ctx->worker_accept.token_id);
+	common_ctx->worker_accept.token_id = NULL;
+	_schedule_worker_accept(common_ctx);
+}
+
+static int _worker_proxy_recv_system_cmd_sync(sid_resource_t *worker_proxy_res, struct worker_data_spec *data_spec, void *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	int                         r;
+
+	if (!data_spec->ext.used) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received KV store sync request, but KV store sync data missing.");
+		return -1;
+	}
+
+	_revoke_accept_token(sid_resource_search(worker_proxy_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL), common_ctx);
+
+	/*
+	 * Large exports would block the event loop for too long if applied at once,
+	 * so queue them to be applied in time slices. The ack is sent back once done.
+	 */
+	if ((r = _queue_main_kv_store_sync(worker_proxy_res,
+	                                   common_ctx,
+	                                   data_spec->ext.socket.fd_pass,
+	                                   worker_proxy_res,
+	                                   data_spec->data,
+	                                   data_spec->data_size)) < 0)
+		r = worker_control_channel_send(
+			worker_proxy_res,
+			MAIN_WORKER_CHANNEL_ID,
+			&(struct worker_data_spec) {.data = data_spec->data, .data_size = data_spec->data_size, .ext.used = false});
+
+	close(data_spec->ext.socket.fd_pass);
+	return r;
+}
+
+/*
+ * The resource tree is appended to the memfd from the worker through a bounded buffer
+ * so the whole tree, which may be large with lots of commands in flight, is never kept
+ * in memory.
+ */
+static int _worker_proxy_recv_system_cmd_resources(sid_resource_t          *worker_proxy_res,
+                                                   struct worker_data_spec *data_spec,
+                                                   void                    *arg __attribute__((unused)))
+{
+	struct internal_msg_header     int_msg;
+	struct sid_resource_write_spec spec;
+	struct sid_buffer             *buf = NULL;
+	size_t                         params_offset;
+	int                            fd = data_spec->ext.used ? data_spec->ext.socket.fd_pass : -1;
+	int                            r  = -1;
+
+	memcpy(&int_msg, data_spec->data, sizeof(int_msg));
+
+	if (fd < 0) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received resources request, but memfd missing.");
+		goto out;
+	}
+
+	if (data_spec->data_size <= INTERNAL_MSG_HEADER_SIZE) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received resources request, but command identifier missing.");
+		goto out;
+	}
+
+	/* request parameters follow the command identifier */
+	params_offset = INTERNAL_MSG_HEADER_SIZE +
+	                strnlen((const char *) data_spec->data + INTERNAL_MSG_HEADER_SIZE,
+	                        data_spec->data_size - INTERNAL_MSG_HEADER_SIZE) +
+	                1;
+
+	spec = (struct sid_resource_write_spec) {.format     = flags_to_format(int_msg.header.flags),
+	                                         .fd         = fd,
+	                                         .flush_size = RESOURCES_WRITE_FLUSH_SIZE};
+
+	if (params_offset < data_spec->data_size && _parse_resources_params(worker_proxy_res,
+	                                                                    (const char *) data_spec->data + params_offset,
+	                                                                    data_spec->data_size - params_offset,
+	                                                                    &spec) < 0)
+		goto out;
+
+	if (!(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                          .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                          .mode    = SID_BUFFER_MODE_PLAIN}),
+	                              &((struct sid_buffer_init) {.size       = RESOURCES_WRITE_FLUSH_SIZE,
+	                                                          .alloc_step = PATH_MAX,
+	                                                          .limit      = 0}),
+	                              &r))) {
+		log_error_errno(ID(worker_proxy_res), r, "Failed to create temporary buffer.");
+		r = -1;
+		goto out;
+	}
+
+	/* the worker has written the start of its response already */
+	if (lseek(fd, 0, SEEK_END) < 0) {
+		log_error_errno(ID(worker_proxy_res), errno, "Failed to seek in memfd for resource tree.");
+		r = -1;
+		goto out;
+	}
+
+	if ((r = sid_resource_write_tree(sid_resource_search(worker_proxy_res, SID_RESOURCE_SEARCH_TOP, NULL, NULL),
+	                                 &spec,
+	                                 buf,
+	                                 2,
+	                                 false)) < 0 ||
+	    (r = sid_buffer_write_all(buf, fd)) < 0) {
+		log_error_errno(ID(worker_proxy_res), r, "Failed to write resource tree.");
+		r = -1;
+		goto out;
+	}
+
+	/* reply to the worker with the same header and data (cmd id and parameters) */
+	r = worker_control_channel_send(
+		worker_proxy_res,
+		MAIN_WORKER_CHANNEL_ID,
+		&(struct worker_data_spec) {.data = data_spec->data, .data_size = data_spec->data_size, .ext.used = false});
+out:
+	if (buf)
+		sid_buffer_destroy(buf);
+	if (fd >= 0)
+		(void) close(fd);
+	return r;
+}
+
+static struct spec_scan *_find_spec_scan(struct sid_ucmd_common_ctx *common_ctx, const struct spec_scan_key *key)
+{
+	struct spec_scan *scan;
+
+	list_iterate_items (scan, &common_ctx->spec_scan.list) {
+		if (!memcmp(&scan->key, key, sizeof(*key)))
+			return scan;
+	}
+
+	return NULL;
+}
+
+static void _destroy_spec_scan(struct sid_ucmd_common_ctx *common_ctx, struct spec_scan *scan)
+{
+	list_del(&scan->list);
+	common_ctx->spec_scan.nr_entries--;
+
+	if (scan->result_fd >= 0)
+		(void) close(scan->result_fd);
+
+	if (scan->exp_fd >= 0)
+		(void) close(scan->exp_fd);
+
+	if (scan->timer_es)
+		sid_resource_destroy_event_source(&scan->timer_es);
+
+	free(scan->req_data);
+	free(scan->deps);
+	free(scan->worker_id);
+	free(scan->waiter_id);
+	free(scan->waiter_data);
+	free(scan);
+}
+
+static void _destroy_spec_scans(struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct spec_scan *scan, *tmp_scan;
+
+	list_iterate_items_safe (scan, tmp_scan, &common_ctx->spec_scan.list)
+		_destroy_spec_scan(common_ctx, scan);
+
+	if (common_ctx->spec_scan.es)
+		sid_resource_destroy_event_source(&common_ctx->spec_scan.es);
+}
+
+/*
+ * Create new speculative scan record. If there are too many records already,
+ * drop the oldest one which is not being executed by a worker - udev would have
+ * asked for it long before if it was ever going to.
+ */
+static struct spec_scan *_create_spec_scan(sid_resource_t             *res,
+                                           struct sid_ucmd_common_ctx *common_ctx,
+                                           const struct spec_scan_key *key,
+                                           spec_scan_state_t           state)
+{
+	struct spec_scan *scan;
+
+	if (common_ctx->spec_scan.nr_entries >= SPEC_SCAN_MAX_ENTRIES) {
+		list_iterate_items (scan, &common_ctx->spec_scan.list) {
+			if (scan->state != SPEC_SCAN_RUNNING && scan->state != SPEC_SCAN_ABANDONED) {
+				_destroy_spec_scan(common_ctx, scan);
+				break;
+			}
+		}
+	}
+
+	if (!(scan = mem_zalloc(sizeof(*scan)))) {
+		log_error(ID(res), "Failed to allocate speculative scan structure.");
+		return NULL;
+	}
+
+	scan->key       = *key;
+	scan->state     = state;
+	scan->result_fd = -1;
+	scan->exp_fd    = -1;
+
+	list_add(&common_ctx->spec_scan.list, &scan->list);
+	common_ctx->spec_scan.nr_entries++;
+
+	return scan;
+}
+
+/*
+ * Queue speculative scan for uevent identified by 'key'. The 'req_data' is the
+ * SELF_CMD_SCAN request for a worker, with the kernel uevent environment.
+ */
+static int _queue_spec_scan(sid_resource_t             *res,
+                            struct sid_ucmd_common_ctx *common_ctx,
+                            const struct spec_scan_key *key,
+                            const void                 *req_data,
+                            size_t                      req_data_size)
+{
+	struct spec_scan *scan;
+
+	/* Either already queued or udev asked for the result before we have seen the uevent. */
+	if (_find_spec_scan(common_ctx, key))
+		return 0;
+
+	if (!(scan = _create_spec_scan(res, common_ctx, key, SPEC_SCAN_QUEUED)))
+		return -1;
+
+	if (!(scan->req_data = malloc(req_data_size))) {
+		log_error(ID(res), "Failed to allocate speculative scan request.");
+		_destroy_spec_scan(common_ctx, scan);
+		return -1;
+	}
+
+	memcpy(scan->req_data, req_data, req_data_size);
+	scan->req_data_size = req_data_size;
+
+	_schedule_spec_scan(common_ctx);
+	return 0;
+}
+
+/*
+ * Check if there's earlier speculative scan for the same device which is not finished
+ * yet or which has its result kept, but not used yet. The exports of such a scan are not
+ * in main KV store yet, so the scan would not see them.
+ */
+static bool _has_pending_spec_scan(struct sid_ucmd_common_ctx *common_ctx, struct spec_scan *scan)
+{
+	struct spec_scan *prev_scan;
+
+	list_iterate_items (prev_scan, &common_ctx->spec_scan.list) {
+		if (prev_scan == scan)
+			break;
+
+		if (prev_scan->key.devno == scan->key.devno &&
+		    (prev_scan->state == SPEC_SCAN_RUNNING || prev_scan->state == SPEC_SCAN_DONE))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Get next speculative scan to dispatch. Scans are dispatched in uevent order, but only
+ * while there are less than 'max_workers' workers executing them. Workers which are still
+ * executing abandoned scans count too, so scans which keep timing out do not end up
+ * occupying more and more workers.
+ */
+static struct spec_scan *_get_next_spec_scan(struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct spec_scan *scan, *tmp_scan;
+	unsigned          nr_workers = 0;
+
+	list_iterate_items_safe (scan, tmp_scan, &common_ctx->spec_scan.list) {
+		if (scan->state == SPEC_SCAN_RUNNING)
+			nr_workers++;
+		else if (scan->state == SPEC_SCAN_ABANDONED) {
+			/* The worker is gone without sending the result, it is not occupied by the scan anymore. */
+			if (worker_control_find_worker(scan->worker_control_res, scan->worker_id))
+				nr_workers++;
+			else
+				_destroy_spec_scan(common_ctx, scan);
+		}
+	}
+
+	if (nr_workers >= common_ctx->spec_scan.max_workers)
+		return NULL;
+
+	list_iterate_items (scan, &common_ctx->spec_scan.list) {
+		if (scan->state == SPEC_SCAN_QUEUED && !_has_pending_spec_scan(common_ctx, scan))
+			return scan;
+	}
+
+	return NULL;
+}
+
+static const char *_find_env(const char *env, size_t env_size, const char *key, size_t key_len)
+{
+	const char *end;
+
+	for (end = env + env_size; env < end; env += strnlen(env, end - env) + 1) {
+		if (!strncmp(env, key, key_len) && env[key_len] == KV_PAIR_C[0])
+			return env;
+	}
+
+	return NULL;
+}
+
+/*
+ * Check speculative scan result is valid for udev environment 'env' coming with the
+ * scan request from udev. The udev environment is a superset of the kernel uevent
+ * environment the speculative scan ran with, udev rules add more properties. All
+ * properties the speculative scan had must match. Properties the scan looked up,
+ * but did not have, must be either still missing or they must have the value the
+ * scan ended up with.
+ */
+static bool _match_spec_scan_env(struct spec_scan *scan, const char *env, size_t env_size)
+{
+	const char *p, *end, *found;
+	size_t      key_len;
+
+	p   = (const char *) scan->req_data + INTERNAL_MSG_HEADER_SIZE + sizeof(dev_t);
+	end = (const char *) scan->req_data + scan->req_data_size;
+
+	for (; p < end; p += strlen(p) + 1) {
+		key_len = strcspn(p, KV_PAIR_C);
+		if (!(found = _find_env(env, env_size, p, key_len)) || strcmp(found, p))
+			return false;
+	}
+
+	for (p = scan->deps, end = p + scan->deps_size; p < end; p += strlen(p) + 1) {
+		key_len = strcspn(p, KV_PAIR_C);
+		if ((found = _find_env(env, env_size, p, key_len)) && (!p[key_len] || strcmp(found, p)))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Scan fetch request from worker consists of internal message header, struct spec_scan_key,
+ * command id and udev environment. The reply consists of the same header, key and command id,
+ * with the result memfd attached if the result is available and valid for the worker.
+ */
+static int _parse_spec_scan_fetch(const void           *data,
+                                  size_t                data_size,
+                                  struct spec_scan_key *key,
+                                  size_t               *reply_size,
+                                  const char          **env,
+                                  size_t               *env_size)
+{
+	const char *cmd_id = (const char *) data + INTERNAL_MSG_HEADER_SIZE + sizeof(*key);
+	size_t      cmd_id_size;
+
+	if (data_size <= INTERNAL_MSG_HEADER_SIZE + sizeof(*key))
+		return -EINVAL;
+
+	memcpy(key, (const char *) data + INTERNAL_MSG_HEADER_SIZE, sizeof(*key));
+
+	cmd_id_size = strnlen(cmd_id, data_size - INTERNAL_MSG_HEADER_SIZE - sizeof(*key)) + 1;
+	*reply_size = INTERNAL_MSG_HEADER_SIZE + sizeof(*key) + cmd_id_size;
+
+	if (*reply_size > data_size)
+		return -EINVAL;
+
+	*env      = (const char *) data + *reply_size;
+	*env_size = data_size - *reply_size;
+
+	return 0;
+}
+
+static int _reply_spec_scan_fetch(sid_resource_t *worker_proxy_res, const void *data, size_t reply_size, int fd)
+{
+	return worker_control_channel_send(worker_proxy_res,
+	                                   MAIN_WORKER_CHANNEL_ID,
+	                                   &(struct worker_data_spec) {.data               = (void *) data,
+	                                                               .data_size          = reply_size,
+	                                                               .ext.used           = fd >= 0,
+	                                                               .ext.socket.fd_pass = fd});
+}
+
+/*
+ * Queue speculative scan's KV store exports for sync with main KV store, the same way as
+ * exports from any other scan are queued before the worker replies to udev. Called only
+ * once the scan's result is going to be used, the exports are never applied otherwise.
+ */
+static int _apply_spec_scan_exports(sid_resource_t             *worker_proxy_res,
+                                    struct sid_ucmd_common_ctx *common_ctx,
+                                    struct spec_scan           *scan)
+{
+	if (scan->exp_fd < 0)
+		return 0;
+
+	if (lseek(scan->exp_fd, 0, SEEK_SET) < 0 ||
+	    _queue_main_kv_store_sync(worker_proxy_res, common_ctx, scan->exp_fd, NULL, NULL, 0) < 0) {
+		log_error(ID(worker_proxy_res), "Failed to queue speculative scan exports for sync with main key-value store.");
+		return -1;
+	}
+
+	_revoke_accept_token(sid_resource_search(worker_proxy_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL), common_ctx);
+
+	if (common_ctx->worker_accept.sync_gen)
+		__atomic_add_fetch(common_ctx->worker_accept.sync_gen, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * Check speculative scan result does not depend on records of other devices which changed
+ * after the worker started the scan. Exports of other speculative scans are only applied when
+ * their results are used, so a scan for a partition may have missed records which the scan
+ * for its disk exported. The records the scan looked up are not tracked one by one, the same
+ * as for memoized scan results, so any change or pending sync with main KV store counts.
+ */
+static bool _spec_scan_foreign_unchanged(struct sid_ucmd_common_ctx *common_ctx, struct spec_scan *scan)
+{
+	return !scan->foreign || (scan->kv_gen == common_ctx->scan_memo.kv_gen && list_is_empty(&common_ctx->sync.queue));
+}
+
+/*
+ * Reply to worker asking for speculative scan result with udev environment 'env'. The result
+ * is passed only if 'ok' is true and the result is valid for the environment and current main
+ * KV store, in which case the scan's exports are applied as well.
+ */
+static int _reply_spec_scan_result(sid_resource_t             *worker_proxy_res,
+                                   struct sid_ucmd_common_ctx *common_ctx,
+                                   struct spec_scan           *scan,
+                                   bool                        ok,
+                                   const void                 *data,
+                                   size_t                      reply_size,
+                                   const char                 *env,
+                                   size_t                      env_size)
+{
+	if (ok && (!_match_spec_scan_env(scan, env, env_size) || !_spec_scan_foreign_unchanged(common_ctx, scan) ||
+	           _apply_spec_scan_exports(worker_proxy_res, common_ctx, scan) < 0))
+		ok = false;
+
+	return _reply_spec_scan_fetch(worker_proxy_res, data, reply_size, ok ? scan->result_fd : -1);
+}
+
+static void _reply_spec_scan_waiter(struct sid_ucmd_common_ctx *common_ctx, struct spec_scan *scan, bool ok)
+{
+	sid_resource_t      *worker_proxy_res;
+	struct spec_scan_key key;
+	const char          *env;
+	size_t               env_size, reply_size;
+
+	/* The worker might have exited in the meantime, there's no one to reply to then. */
+	if (!scan->waiter_id || !(worker_proxy_res = worker_control_find_worker(scan->worker_control_res, scan->waiter_id)))
+		return;
+
+	(void) _parse_spec_scan_fetch(scan->waiter_data, scan->waiter_data_size, &key, &reply_size, &env, &env_size);
+	(void) _reply_spec_scan_result(worker_proxy_res, common_ctx, scan, ok, scan->waiter_data, reply_size, env, env_size);
+}
+
+/*
+ * Keep speculative scan result received in 'fd' (see _send_spec_scan_result). The response
+ * for udev is copied to a memfd of its own which is passed to the worker asking for it later.
+ * The 'fd' is kept only if there are KV store exports in it. Takes over the 'fd'.
+ */
+static int _store_spec_scan_result(sid_resource_t   *res,
+                                   struct spec_scan *scan,
+                                   int               fd,
+                                   size_t            exp_size,
+                                   const void       *deps,
+                                   size_t            deps_size)
+{
+	if (deps_size) {
+		if (!(scan->deps = malloc(deps_size))) {
+			log_error(ID(res), "Failed to allocate speculative scan dependencies.");
+			goto fail;
+		}
+
+		memcpy(scan->deps, deps, deps_size);
+		scan->deps_size = deps_size;
+	}
+
+	if ((scan->result_fd = memfd_create("spec_scan_result", MFD_CLOEXEC)) < 0 ||
+	    _send_fd_content(fd, exp_size, scan->result_fd) < 0) {
+		log_error(ID(res), "Failed to store speculative scan result.");
+		goto fail;
+	}
+
+	if (exp_size)
+		scan->exp_fd = fd;
+	else
+		(void) close(fd);
+
+	return 0;
+fail:
+	(void) close(fd);
+	return -1;
+}
+
+/*
+ * Finish running speculative scan. The 'fd' is memfd with the result or -1 if the scan
+ * failed, the 'exp_size' and 'deps' describe the result (see _send_spec_scan_result).
+ * If there's a worker waiting for the result already, reply to it right away, otherwise
+ * keep the result until udev asks for it. Takes over the 'fd'.
+ */
+static void _finish_spec_scan(sid_resource_t             *res,
+                              struct sid_ucmd_common_ctx *common_ctx,
+                              struct spec_scan           *scan,
+                              int                         fd,
+                              size_t                      exp_size,
+                              const void                 *deps,
+                              size_t                      deps_size)
+{
+	bool ok;
+
+	if (scan->timer_es)
+		sid_resource_destroy_event_source(&scan->timer_es);
+
+	_schedule_spec_scan(common_ctx);
+
+	ok = fd >= 0 && _store_spec_scan_result(res, scan, fd, exp_size, deps, deps_size) == 0;
+
+	if (ok && !scan->waiter_id) {
+		scan->state = SPEC_SCAN_DONE;
+		return;
+	}
+
+	_reply_spec_scan_waiter(common_ctx, scan, ok);
+	_destroy_spec_scan(common_ctx, scan);
+}
+
+/*
+ * Give up waiting for speculative scan which takes too long. The worker executing the
+ * scan is still occupied until it sends the result, which is dropped then, or until it
+ * exits, so keep the record to account for the worker (see _get_next_spec_scan).
+ */
+static void _abandon_spec_scan(struct sid_ucmd_common_ctx *common_ctx, struct spec_scan *scan)
+{
+	if (scan->timer_es)
+		sid_resource_destroy_event_source(&scan->timer_es);
+
+	_reply_spec_scan_waiter(common_ctx, scan, false);
+
+	free(scan->waiter_id);
+	free(scan->waiter_data);
+	free(scan->req_data);
+	scan->waiter_id     = NULL;
+	scan->waiter_data   = NULL;
+	scan->req_data      = NULL;
+	scan->req_data_size = 0;
+	scan->state         = SPEC_SCAN_ABANDONED;
+}
+
+/*
+ * Scan result from worker consists of internal message header, struct spec_scan_key,
+ * size of the KV store exports in the result memfd, main KV store generation the worker
+ * started with, whether the scan looked up records of other devices and udev properties
+ * the scan depends on. The result memfd is attached if the scan succeeded.
+ */
+static int _worker_proxy_recv_system_cmd_scan_result(sid_resource_t          *worker_proxy_res,
+                                                     struct worker_data_spec *data_spec,
+                                                     void                    *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	int                         fd         = data_spec->ext.used ? data_spec->ext.socket.fd_pass : -1;
+	struct spec_scan_key        key;
+	struct spec_scan           *scan;
+	size_t                      exp_size;
+	uint64_t                    kv_gen;
+	bool                        foreign;
+	const char                 *p = (const char *) data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+	size_t                      deps_offset;
+
+	deps_offset = INTERNAL_MSG_HEADER_SIZE + sizeof(key) + sizeof(exp_size) + sizeof(kv_gen) + sizeof(foreign);
+
+	if (data_spec->data_size < deps_offset) {
+		log_error(ID(worker_proxy_res),
+		          INTERNAL_ERROR "Received speculative scan result, but uevent identification missing.");
+		if (fd >= 0)
+			(void) close(fd);
+		return -1;
+	}
+
+	memcpy(&key, p, sizeof(key));
+	p += sizeof(key);
+	memcpy(&exp_size, p, sizeof(exp_size));
+	p += sizeof(exp_size);
+	memcpy(&kv_gen, p, sizeof(kv_gen));
+	p += sizeof(kv_gen);
+	memcpy(&foreign, p, sizeof(foreign));
+
+	if (!(scan = _find_spec_scan(common_ctx, &key)) || scan->state != SPEC_SCAN_RUNNING) {
+		/* The scan was abandoned because it was taking too long, the worker is free now. */
+		if (scan && scan->state == SPEC_SCAN_ABANDONED) {
+			_destroy_spec_scan(common_ctx, scan);
+			_schedule_spec_scan(common_ctx);
+		}
+
+		if (fd >= 0)
+			(void) close(fd);
+		return 0;
+	}
+
+	scan->kv_gen  = kv_gen;
+	scan->foreign = foreign;
+
+	_finish_spec_scan(worker_proxy_res,
+	                  common_ctx,
+	                  scan,
+	                  fd,
+	                  exp_size,
+	                  (const char *) data_spec->data + deps_offset,
+	                  data_spec->data_size - deps_offset);
+	return 0;
+}
+
+static int _worker_proxy_recv_system_cmd_scan_fetch(sid_resource_t          *worker_proxy_res,
+                                                    struct worker_data_spec *data_spec,
+                                                    void                    *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	struct spec_scan_key        key;
+	struct spec_scan           *scan;
+	const char                 *env;
+	size_t                      env_size, reply_size;
+	int                         r;
+
+	if (_parse_spec_scan_fetch(data_spec->data, data_spec->data_size, &key, &reply_size, &env, &env_size) < 0) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received incomplete speculative scan result request.");
+		return -1;
+	}
+
+	if (!(scan = _find_spec_scan(common_ctx, &key))) {
+		/* We have not seen the uevent yet, make sure we do not scan speculatively for it later. */
+		(void) _create_spec_scan(worker_proxy_res, common_ctx, &key, SPEC_SCAN_CLAIMED);
+		return _reply_spec_scan_fetch(worker_proxy_res, data_spec->data, reply_size, -1);
+	}
+
+	switch (scan->state) {
+		case SPEC_SCAN_QUEUED:
+			/* Not started yet, the worker is going to scan on its own. */
+			scan->state = SPEC_SCAN_CLAIMED;
+			free(scan->req_data);
+			scan->req_data      = NULL;
+			scan->req_data_size = 0;
+			break;
+
+		case SPEC_SCAN_RUNNING:
+			/* Reply once the result is available, see _finish_spec_scan. */
+			if (scan->waiter_id)
+				break;
+
+			scan->worker_control_res = sid_resource_search(worker_proxy_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+
+			if (!(scan->waiter_id = strdup(worker_control_get_worker_id(worker_proxy_res))) ||
+			    !(scan->waiter_data = malloc(data_spec->data_size))) {
+				log_error(ID(worker_proxy_res), "Failed to allocate speculative scan result request.");
+				free(scan->waiter_id);
+				scan->waiter_id = NULL;
+				break;
+			}
+
+			memcpy(scan->waiter_data, data_spec->data, data_spec->data_size);
+			scan->waiter_data_size = data_spec->data_size;
+			return 0;
+
+		case SPEC_SCAN_DONE:
+			/* Unless the result is used, its exports are dropped with it. */
+			r = _reply_spec_scan_result(worker_proxy_res,
+			                            common_ctx,
+			                            scan,
+			                            true,
+			                            data_spec->data,
+			                            reply_size,
+			                            env,
+			                            env_size);
+			_destroy_spec_scan(common_ctx, scan);
+			_schedule_spec_scan(common_ctx);
+			return r;
+
+		case SPEC_SCAN_CLAIMED:
+		case SPEC_SCAN_ABANDONED:
+			break;
+	}
+
+	return _reply_spec_scan_fetch(worker_proxy_res, data_spec->data, reply_size, -1);
+}
+
+static void _free_scan_memo(struct scan_memo *memo)
+{
+	free(memo->env);
+	free(memo->num_s);
+	free(memo->uid_s);
+	free(memo->result);
+	free(memo);
+}
+
+static void _destroy_scan_memo(struct sid_ucmd_common_ctx *common_ctx, struct scan_memo *memo)
+{
+	hash_remove(common_ctx->scan_memo.ht, &memo->devno, sizeof(memo->devno));
+	list_del(&memo->list);
+	common_ctx->scan_memo.nr_entries--;
+
+	_free_scan_memo(memo);
+}
+
+static void _destroy_scan_memos(struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct scan_memo *memo, *tmp_memo;
+
+	if (!common_ctx->scan_memo.ht)
+		return;
+
+	list_iterate_items_safe (memo, tmp_memo, &common_ctx->scan_memo.list)
+		_destroy_scan_memo(common_ctx, memo);
+
+	hash_destroy(common_ctx->scan_memo.ht);
+	common_ctx->scan_memo.ht = NULL;
+
+	if (common_ctx->scan_memo.dep_ht) {
+		hash_iter(common_ctx->scan_memo.dep_ht, _free_scan_memo_dep);
+		hash_destroy(common_ctx->scan_memo.dep_ht);
+		common_ctx->scan_memo.dep_ht = NULL;
+	}
+}
+
+/* Check if no export since generation 'kv_gen' changed the records, except the one with generation 'exp_kv_gen'. */
+static bool _scan_memo_dep_unchanged(const struct scan_memo_dep *dep, uint64_t kv_gen, uint64_t exp_kv_gen)
+{
+	return dep->kv_gen <= kv_gen || (exp_kv_gen && dep->kv_gen == exp_kv_gen && dep->prev_kv_gen <= kv_gen);
+}
+
+static bool _scan_memo_dev_dep_unchanged(struct sid_ucmd_common_ctx *common_ctx,
+                                         const char                 *id,
+                                         uint64_t                    kv_gen,
+                                         uint64_t                    exp_kv_gen)
+{
+	struct scan_memo_dep *dep;
+
+	/* devices not tracked have not changed since tracking was reset, see _track_scan_memo_dep */
+	if (!id || !*id || !(dep = hash_lookup(common_ctx->scan_memo.dep_ht, id, strlen(id), NULL)))
+		return true;
+
+	return _scan_memo_dep_unchanged(dep, kv_gen, exp_kv_gen);
+}
+
+/*
+ * Check if main KV store records scan result for device with 'num_s' and 'uid_s' depends on
+ * did not change since generation 'kv_gen', except by the scan's own export with generation
+ * 'exp_kv_gen' (0 if none). Result of a scan which looked up records of other devices
+ * ('foreign') depends on all the records.
+ */
+static bool _scan_memo_deps_unchanged(struct sid_ucmd_common_ctx *common_ctx,
+                                      const char                 *num_s,
+                                      const char                 *uid_s,
+                                      bool                        foreign,
+                                      uint64_t                    kv_gen,
+                                      uint64_t                    exp_kv_gen)
+{
+	uint64_t cur_kv_gen = common_ctx->scan_memo.kv_gen;
+
+	if (foreign)
+		return cur_kv_gen == kv_gen || (exp_kv_gen && exp_kv_gen == kv_gen + 1 && cur_kv_gen == exp_kv_gen);
+
+	return _scan_memo_dep_unchanged(&common_ctx->scan_memo.shared, kv_gen, exp_kv_gen) &&
+	       _scan_memo_dev_dep_unchanged(common_ctx, num_s, kv_gen, exp_kv_gen) &&
+	       _scan_memo_dev_dep_unchanged(common_ctx, uid_s, kv_gen, exp_kv_gen);
+}
+
+/*
+ * Get memoized result for scan with 'key' if it's still valid, that is, if the udev
+ * environment 'env' is the same and main KV store records the result depends on have
+ * not changed since the result was stored. Stale results are dropped right away.
+ */
+static struct scan_memo *_get_scan_memo(struct sid_ucmd_common_ctx *common_ctx,
+                                        const struct scan_memo_key *key,
+                                        const void                 *env,
+                                        size_t                      env_size)
+{
+	struct scan_memo *memo;
+
+	if (!(memo = hash_lookup(common_ctx->scan_memo.ht, &key->uevent.devno, sizeof(key->uevent.devno), NULL)))
+		return NULL;
+
+	/* the hash is only a quick check, compare the whole environment if it matches */
+	if (memo->env_hash != key->env_hash || memo->env_size != env_size || memcmp(memo->env, env, env_size) ||
+	    !_scan_memo_deps_unchanged(common_ctx, memo->num_s, memo->uid_s, memo->foreign, memo->kv_gen, 0)) {
+		_destroy_scan_memo(common_ctx, memo);
+		return NULL;
+	}
+
+	/* keep recently used results at the end, the oldest ones are dropped first */
+	list_del(&memo->list);
+	list_add(&common_ctx->scan_memo.list, &memo->list);
+	return memo;
 }
 
-static int _worker_proxy_recv_system_cmd_resources(sid_resource_t          *worker_proxy_res,
-                                                   struct worker_data_spec *data_spec,
-                                                   void                    *arg __attribute__((unused)))
+/*
+ * Memoize scan result read from 'fd', replacing any previous result for the same device.
+ * If there are too many results already, drop the least recently used one.
+ */
+static int _set_scan_memo(sid_resource_t               *res,
+                          struct sid_ucmd_common_ctx   *common_ctx,
+                          const struct scan_memo_store *store,
+                          const char                   *num_s,
+                          const char                   *uid_s,
+                          const void                   *env,
+                          size_t                        env_size,
+                          int                           fd)
+{
+	struct scan_memo *memo;
+	struct stat       st;
+	int               r;
+
+	if ((memo = hash_lookup(common_ctx->scan_memo.ht, &store->key.uevent.devno, sizeof(store->key.uevent.devno), NULL)))
+		_destroy_scan_memo(common_ctx, memo);
+
+	if (common_ctx->scan_memo.nr_entries >= SCAN_MEMO_MAX_ENTRIES)
+		_destroy_scan_memo(common_ctx, list_item(common_ctx->scan_memo.list.n, struct scan_memo));
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if (!(memo = mem_zalloc(sizeof(*memo))) || !(memo->result = malloc(st.st_size)) || !(memo->env = malloc(env_size)) ||
+	    !(memo->num_s = strdup(num_s)) || (*uid_s && !(memo->uid_s = strdup(uid_s)))) {
+		log_error(ID(res), "Failed to allocate memoized scan result.");
+		r = -ENOMEM;
+		goto fail;
+	}
+
+	if (pread(fd, memo->result, st.st_size, 0) != st.st_size) {
+		log_error(ID(res), "Failed to read scan result to memoize.");
+		r = -EIO;
+		goto fail;
+	}
+
+	memcpy(memo->env, env, env_size);
+	memo->devno       = store->key.uevent.devno;
+	memo->env_hash    = store->key.env_hash;
+	memo->env_size    = env_size;
+	memo->foreign     = store->foreign;
+	memo->kv_gen      = common_ctx->scan_memo.kv_gen;
+	memo->result_size = st.st_size;
+
+	if (hash_insert(common_ctx->scan_memo.ht, &memo->devno, sizeof(memo->devno), memo, sizeof(memo)) < 0) {
+		r = -ENOMEM;
+		goto fail;
+	}
+
+	list_add(&common_ctx->scan_memo.list, &memo->list);
+	common_ctx->scan_memo.nr_entries++;
+
+	return 0;
+fail:
+	if (memo)
+		_free_scan_memo(memo);
+	return r;
+}
+
+/*
+ * Memo fetch request from worker consists of internal message header, struct scan_memo_key,
+ * command id and udev environment without SEQNUM. The reply is the same, without the udev
+ * environment, with memoized result in a memfd attached if there is a valid one. The result
+ * is only kept in memory here, the memfd is created for each reply so there's no fd held for
+ * each device.
+ */
+static int _worker_proxy_recv_system_cmd_scan_memo_fetch(sid_resource_t          *worker_proxy_res,
+                                                         struct worker_data_spec *data_spec,
+                                                         void                    *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	const char                 *data       = data_spec->data;
+	const char                 *end        = data + data_spec->data_size;
+	const char                 *id         = data + INTERNAL_MSG_HEADER_SIZE + sizeof(struct scan_memo_key);
+	struct scan_memo_key        key;
+	struct scan_memo           *memo;
+	struct spec_scan           *scan;
+	const char                 *env;
+	int                         fd = -1;
+	int                         r;
+
+	if (data_spec->data_size <= INTERNAL_MSG_HEADER_SIZE + sizeof(key) || !(env = memchr(id, '\0', end - id))) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received incomplete memoized scan result request.");
+		return -1;
+	}
+
+	memcpy(&key, data + INTERNAL_MSG_HEADER_SIZE, sizeof(key));
+	env++;
+
+	if ((memo = _get_scan_memo(common_ctx, &key, env, end - env))) {
+		if ((fd = memfd_create("scan_memo_result", MFD_CLOEXEC)) < 0 ||
+		    write(fd, memo->result, memo->result_size) != (ssize_t) memo->result_size) {
+			log_error(ID(worker_proxy_res), "Failed to pass memoized scan result to worker.");
+			if (fd >= 0) {
+				(void) close(fd);
+				fd = -1;
+			}
+		} else if (common_ctx->spec_scan.enabled) {
+			/* Do not scan speculatively for this uevent, the result is not going to be needed. */
+			if (!(scan = _find_spec_scan(common_ctx, &key.uevent)))
+				(void) _create_spec_scan(worker_proxy_res, common_ctx, &key.uevent, SPEC_SCAN_CLAIMED);
+			else if (scan->state == SPEC_SCAN_QUEUED || scan->state == SPEC_SCAN_DONE) {
+				_destroy_spec_scan(common_ctx, scan);
+				_schedule_spec_scan(common_ctx);
+			}
+		}
+	}
+
+	r = worker_control_channel_send(worker_proxy_res,
+	                                MAIN_WORKER_CHANNEL_ID,
+	                                &(struct worker_data_spec) {.data               = data_spec->data,
+	                                                            .data_size          = env - data,
+	                                                            .ext.used           = fd >= 0,
+	                                                            .ext.socket.fd_pass = fd});
+	if (fd >= 0)
+		(void) close(fd);
+
+	return r;
+}
+
+/*
+ * Memo store request from worker consists of internal message header, struct scan_memo_store,
+ * device number and identifier strings and udev environment without SEQNUM (see _store_scan_memo),
+ * with the result in a memfd attached. Without the memfd, any memoized result for the device
+ * is dropped.
+ */
+static int _worker_proxy_recv_system_cmd_scan_memo_store(sid_resource_t          *worker_proxy_res,
+                                                         struct worker_data_spec *data_spec,
+                                                         void                    *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	int                         fd         = data_spec->ext.used ? data_spec->ext.socket.fd_pass : -1;
+	const char                 *data       = data_spec->data;
+	const char                 *end        = data + data_spec->data_size;
+	const char                 *num_s      = data + INTERNAL_MSG_HEADER_SIZE + sizeof(struct scan_memo_store);
+	const char                 *uid_s      = NULL, *env = NULL;
+	struct scan_memo_store      store;
+	struct scan_memo           *memo;
+	int                         r = 0;
+
+	if (data_spec->data_size < INTERNAL_MSG_HEADER_SIZE + sizeof(store) || !(uid_s = memchr(num_s, '\0', end - num_s)) ||
+	    !(env = memchr(uid_s + 1, '\0', end - uid_s - 1))) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received incomplete scan result to memoize.");
+		r = -1;
+		goto out;
+	}
+
+	memcpy(&store, data + INTERNAL_MSG_HEADER_SIZE, sizeof(store));
+	uid_s++;
+	env++;
+
+	if (!common_ctx->scan_memo.ht)
+		goto out;
+
+	if (fd >= 0 && _scan_memo_deps_unchanged(common_ctx, num_s, uid_s, store.foreign, store.kv_gen, store.exp_kv_gen)) {
+		if ((r = _set_scan_memo(worker_proxy_res, common_ctx, &store, num_s, uid_s, env, end - env, fd)) < 0)
+			log_error_errno(ID(worker_proxy_res), r, "Failed to memoize scan result");
+	} else if ((memo = hash_lookup(common_ctx->scan_memo.ht, &store.key.uevent.devno, sizeof(store.key.uevent.devno), NULL)))
+		_destroy_scan_memo(common_ctx, memo);
+out:
+	if (fd >= 0)
+		(void) close(fd);
+
+	return r;
+}
+
+/*
+ * Reply with the same header and command identifier. If shared KV view is enabled,
+ * the reply carries read-only fd for the view, otherwise there's no fd.
+ */
+static int _worker_proxy_recv_system_cmd_kv_view(sid_resource_t          *worker_proxy_res,
+                                                 struct worker_data_spec *data_spec,
+                                                 void                    *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+
+	if (data_spec->data_size <= INTERNAL_MSG_HEADER_SIZE) {
+		log_error(ID(worker_proxy_res),
+		          INTERNAL_ERROR "Received key-value store view request, but command identifier missing.");
+		return -1;
+	}
+
+	if (!common_ctx->kv_view.enabled)
+		log_debug(ID(worker_proxy_res), "Shared key-value store view requested, but it is not enabled.");
+
+	return worker_control_channel_send(worker_proxy_res,
+	                                   MAIN_WORKER_CHANNEL_ID,
+	                                   &(struct worker_data_spec) {.data               = data_spec->data,
+	                                                               .data_size          = data_spec->data_size,
+	                                                               .ext.used           = common_ctx->kv_view.enabled,
+	                                                               .ext.socket.fd_pass = common_ctx->kv_view.writer.rdonly_fd});
+}
+
+/*
+ * Worker holding the accept token accepted a client connection. If the worker's copy of
+ * main KV store got out of date meanwhile, the worker hands the connection back so it
+ * can be passed to a new worker instead.
+ */
+static int _worker_proxy_recv_system_cmd_accepted(sid_resource_t          *worker_proxy_res,
+                                                  struct worker_data_spec *data_spec,
+                                                  void                    *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	struct bounced_conn        *bounced;
+
+	if (common_ctx->worker_accept.token_id &&
+	    !strcmp(common_ctx->worker_accept.token_id, worker_control_get_worker_id(worker_proxy_res))) {
+		free(common_ctx->worker_accept.token_id);
+		common_ctx->worker_accept.token_id = NULL;
+	}
+
+	_schedule_worker_accept(common_ctx);
+
+	if (!data_spec->ext.used) {
+		log_debug(ID(worker_proxy_res), "Worker accepted client connection.");
+		return 0;
+	}
+
+	log_debug(ID(worker_proxy_res), "Worker handed back client connection, its main key-value store copy is out of date.");
+
+	if (!(bounced = mem_zalloc(sizeof(*bounced)))) {
+		log_error(ID(worker_proxy_res), "Failed to allocate bounced connection structure.");
+		(void) close(data_spec->ext.socket.fd_pass);
+		return -1;
+	}
+
+	bounced->fd = data_spec->ext.socket.fd_pass;
+	list_add(&common_ctx->worker_accept.bounced, &bounced->list);
+
+	return 0;
+}
+
+/*
+ * Get or set runtime tuning parameters on behalf of a worker and reply with the parameters
+ * written in requested format. Status in the reply header is set to failure if the request
+ * was rejected, the parameters are then left unchanged.
+ */
+static int _worker_proxy_recv_system_cmd_params(sid_resource_t          *worker_proxy_res,
+                                                struct worker_data_spec *data_spec,
+                                                void                    *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	struct sid_buffer          *gen_buf    = common_ctx->gen_buf;
+	struct internal_msg_header  int_msg;
+	const char                 *id, *list, *failed;
+	size_t                      id_size, list_size;
+	size_t                      buf_pos;
+	char                       *data;
+	size_t                      size;
+	int                         r = 0;
+
+	memcpy(&int_msg, data_spec->data, sizeof(int_msg));
+
+	if (data_spec->data_size <= INTERNAL_MSG_HEADER_SIZE) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received parameters request, but command identifier missing.");
+		return -1;
+	}
+
+	/* request items follow the command identifier */
+	id      = (const char *) data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+	id_size = strnlen(id, data_spec->data_size - INTERNAL_MSG_HEADER_SIZE) + 1;
+
+	if (INTERNAL_MSG_HEADER_SIZE + id_size > data_spec->data_size) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received parameters request with malformed command identifier.");
+		return -1;
+	}
+
+	list      = id + id_size;
+	list_size = data_spec->data_size - INTERNAL_MSG_HEADER_SIZE - id_size;
+
+	sid_buffer_add(gen_buf, &int_msg, INTERNAL_MSG_HEADER_SIZE, NULL, &buf_pos);
+	sid_buffer_add(gen_buf, (void *) id, id_size, NULL, NULL);
+
+	if (int_msg.header.cmd == SYSTEM_CMD_PARAM_SET) {
+		if ((r = param_set(common_ctx->params, list, list_size, &failed)) < 0)
+			log_error_errno(ID(worker_proxy_res), r, "Failed to set parameter %s", failed ? failed : "");
+		else
+			log_debug(ID(worker_proxy_res), "Parameters changed.");
+	}
+
+	if (r == 0 && (r = param_write(common_ctx->params,
+	                               list_size ? list : NULL,
+	                               list_size,
+	                               flags_to_format(int_msg.header.flags),
+	                               gen_buf,
+	                               &failed)) < 0)
+		log_error_errno(ID(worker_proxy_res), r, "Failed to write parameter %s", failed ? failed : "");
+
+	if (r < 0) {
+		/* drop any partial output and reply with failure status and command identifier only */
+		int_msg.header.status = SID_CMD_STATUS_FAILURE;
+		sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+		sid_buffer_add(gen_buf, &int_msg, INTERNAL_MSG_HEADER_SIZE, NULL, NULL);
+		sid_buffer_add(gen_buf, (void *) id, id_size, NULL, NULL);
+	} else
+		print_null_byte(gen_buf);
+
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &data, &size);
+
+	if ((r = worker_control_channel_send(worker_proxy_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {
+						     .data      = data,
+						     .data_size = size,
+						     .ext.used  = false,
+					     })) < 0)
+		log_error_errno(ID(worker_proxy_res), r, "Failed to send parameters to worker.");
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+	return r < 0 ? -1 : 0;
+}
+
+static int _worker_proxy_recv_fn(sid_resource_t          *worker_proxy_res,
+                                 struct worker_channel   *chan,
+                                 struct worker_data_spec *data_spec,
+                                 void                    *arg)
 {
 	struct internal_msg_header int_msg;
-	struct sid_buffer         *buf;
-	int                        r = -1;
 
 	memcpy(&int_msg, data_spec->data, sizeof(int_msg));
 
-	if (!(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MEMFD,
-	                                                          .type    = SID_BUFFER_TYPE_LINEAR,
-	                                                          .mode    = SID_BUFFER_MODE_SIZE_PREFIX}),
-	                              &((struct sid_buffer_init) {.size = 0, .alloc_step = PATH_MAX, .limit = 0}),
-	                              &r))) {
-		log_error_errno(ID(worker_proxy_res), r, "Failed to create temporary buffer.");
-		return -1;
+	if (int_msg.cat != MSG_CATEGORY_SYSTEM) {
+		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received unexpected message category.");
+		return -1;
+	}
+
+	switch (int_msg.header.cmd) {
+		case SYSTEM_CMD_SYNC:
+			return _worker_proxy_recv_system_cmd_sync(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_RESOURCES:
+			return _worker_proxy_recv_system_cmd_resources(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_SCAN_RESULT:
+			return _worker_proxy_recv_system_cmd_scan_result(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_SCAN_FETCH:
+			return _worker_proxy_recv_system_cmd_scan_fetch(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_KV_VIEW:
+			return _worker_proxy_recv_system_cmd_kv_view(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_ACCEPTED:
+			return _worker_proxy_recv_system_cmd_accepted(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_PARAM_GET:
+		case SYSTEM_CMD_PARAM_SET:
+			return _worker_proxy_recv_system_cmd_params(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_SCAN_MEMO_FETCH:
+			return _worker_proxy_recv_system_cmd_scan_memo_fetch(worker_proxy_res, data_spec, arg);
+
+		case SYSTEM_CMD_SCAN_MEMO_STORE:
+			return _worker_proxy_recv_system_cmd_scan_memo_store(worker_proxy_res, data_spec, arg);
+
+		default:
+			log_error(ID(worker_proxy_res), "Unknown system command.");
+			return -1;
+	}
+}
+
+static int _worker_recv_system_cmd_resources(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
+{
+	static const char    _msg_prologue[] = "Received result from resource cmd for main process, but";
+	const char          *cmd_id;
+	sid_resource_t      *cmd_res;
+	struct sid_ucmd_ctx *ucmd_ctx;
+
+	// TODO: make sure error path is not causing the client waiting for response to hang !!!
+
+	if (data_spec->data_size <= INTERNAL_MSG_HEADER_SIZE) {
+		log_error(ID(worker_res), "%s command identifier missing.", _msg_prologue);
+		return -1;
+	}
+
+	cmd_id = data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+
+	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
+		log_error(ID(worker_res), "%s failed to find command resource with id %s.", _msg_prologue, cmd_id);
+		return -1;
+	}
+
+	/* main process has appended its resource tree to the memfd we sent with the request */
+	ucmd_ctx                         = sid_resource_get_data(cmd_res);
+	ucmd_ctx->resources.main_written = true;
+
+	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
+	_change_cmd_state(cmd_res, CMD_EXEC_SCHEDULED);
+
+	return 0;
+}
+
+static int _worker_recv_system_cmd_sync(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
+{
+	const char          *cmd_id;
+	size_t               id_size;
+	sid_resource_t      *cmd_res;
+	struct sid_ucmd_ctx *ucmd_ctx;
+
+	cmd_id = data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+
+	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
+		log_error(ID(worker_res),
+		          "Received ack from main process, but failed to find command resource with id %s.",
+		          cmd_id);
+		return -1;
+	}
+
+	ucmd_ctx = sid_resource_get_data(cmd_res);
+
+	/* main KV store generation the exports were synced with follows the command id */
+	id_size = strlen(cmd_id) + 1;
+	if (ucmd_ctx->req_cat == MSG_CATEGORY_CLIENT && ucmd_ctx->req_hdr.cmd == SID_CMD_SCAN &&
+	    data_spec->data_size >= INTERNAL_MSG_HEADER_SIZE + id_size + sizeof(ucmd_ctx->scan.memo_exp_gen))
+		memcpy(&ucmd_ctx->scan.memo_exp_gen, cmd_id + id_size, sizeof(ucmd_ctx->scan.memo_exp_gen));
+
+	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
+	_change_cmd_state(cmd_res, CMD_EXPBUF_ACKED);
+
+	return 0;
+}
+
+static int _worker_recv_system_cmd_scan_fetch(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
+{
+	const char          *cmd_id;
+	sid_resource_t      *cmd_res;
+	struct sid_ucmd_ctx *ucmd_ctx;
+
+	cmd_id = data_spec->data + INTERNAL_MSG_HEADER_SIZE + sizeof(struct spec_scan_key);
+
+	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
+		log_debug(ID(worker_res), "Received speculative scan result for command %s which is already gone.", cmd_id);
+		if (data_spec->ext.used)
+			(void) close(data_spec->ext.socket.fd_pass);
+		return 0;
+	}
+
+	ucmd_ctx = sid_resource_get_data(cmd_res);
+
+	if (data_spec->ext.used)
+		ucmd_ctx->scan.spec_fd = data_spec->ext.socket.fd_pass;
+
+	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
+	_change_cmd_state(cmd_res, CMD_EXEC_SCHEDULED);
+
+	return 0;
+}
+
+static int _worker_recv_system_cmd_scan_memo_fetch(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
+{
+	const char          *cmd_id;
+	sid_resource_t      *cmd_res;
+	struct sid_ucmd_ctx *ucmd_ctx;
+
+	cmd_id = data_spec->data + INTERNAL_MSG_HEADER_SIZE + sizeof(struct scan_memo_key);
+
+	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
+		log_debug(ID(worker_res), "Received memoized scan result for command %s which is already gone.", cmd_id);
+		if (data_spec->ext.used)
+			(void) close(data_spec->ext.socket.fd_pass);
+		return 0;
+	}
+
+	ucmd_ctx = sid_resource_get_data(cmd_res);
+
+	if (data_spec->ext.used) {
+		ucmd_ctx->scan.spec_fd  = data_spec->ext.socket.fd_pass;
+		ucmd_ctx->scan.memo_hit = true;
+	}
+
+	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
+	_change_cmd_state(cmd_res, CMD_EXEC_SCHEDULED);
+
+	return 0;
+}
+
+static int _worker_recv_system_cmd_kv_view(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
+{
+	const char          *cmd_id;
+	sid_resource_t      *cmd_res;
+	struct sid_ucmd_ctx *ucmd_ctx;
+
+	cmd_id = data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+
+	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
+		log_debug(ID(worker_res), "Received key-value store view for command %s which is already gone.", cmd_id);
+		if (data_spec->ext.used)
+			(void) close(data_spec->ext.socket.fd_pass);
+		return 0;
 	}
 
-	if (sid_resource_write_tree_recursively(sid_resource_search(worker_proxy_res, SID_RESOURCE_SEARCH_TOP, NULL, NULL),
-	                                        flags_to_format(int_msg.header.flags),
-	                                        buf,
-	                                        2,
-	                                        false)) {
-		log_error(ID(worker_proxy_res), "Failed to write resource tree.");
-		goto out;
-	}
+	ucmd_ctx = sid_resource_get_data(cmd_res);
 
-	/* reply to the worker with the same header and data (cmd id) */
-	r = worker_control_channel_send(worker_proxy_res,
-	                                MAIN_WORKER_CHANNEL_ID,
-	                                &(struct worker_data_spec) {.data               = data_spec->data,
-	                                                            .data_size          = data_spec->data_size,
-	                                                            .ext.used           = true,
-	                                                            .ext.socket.fd_pass = sid_buffer_get_fd(buf)});
-out:
-	sid_buffer_destroy(buf);
-	return r;
+	if (data_spec->ext.used)
+		ucmd_ctx->kv_view.fd = data_spec->ext.socket.fd_pass;
+
+	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
+	_change_cmd_state(cmd_res, CMD_EXEC_SCHEDULED);
+
+	return 0;
 }
 
-static int _worker_proxy_recv_fn(sid_resource_t          *worker_proxy_res,
-                                 struct worker_channel   *chan,
-                                 struct worker_data_spec *data_spec,
-                                 void                    *arg)
+static int _worker_recv_system_cmd_params(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
 {
 	struct internal_msg_header int_msg;
+	const char                *cmd_id;
+	size_t                     cmd_id_size;
+	sid_resource_t            *cmd_res;
+	struct sid_ucmd_ctx       *ucmd_ctx;
 
 	memcpy(&int_msg, data_spec->data, sizeof(int_msg));
+	cmd_id      = data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+	cmd_id_size = strlen(cmd_id) + 1;
 
-	if (int_msg.cat != MSG_CATEGORY_SYSTEM) {
-		log_error(ID(worker_proxy_res), INTERNAL_ERROR "Received unexpected message category.");
-		return -1;
+	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
+		log_debug(ID(worker_res), "Received parameters for command %s which is already gone.", cmd_id);
+		return 0;
 	}
 
-	switch (int_msg.header.cmd) {
-		case SYSTEM_CMD_SYNC:
-			return _worker_proxy_recv_system_cmd_sync(worker_proxy_res, data_spec, arg);
-
-		case SYSTEM_CMD_RESOURCES:
-			return _worker_proxy_recv_system_cmd_resources(worker_proxy_res, data_spec, arg);
+	ucmd_ctx = sid_resource_get_data(cmd_res);
 
-		default:
-			log_error(ID(worker_proxy_res), "Unknown system command.");
-			return -1;
+	if (!(int_msg.header.status & SID_CMD_STATUS_FAILURE)) {
+		ucmd_ctx->params.reply_size = data_spec->data_size - INTERNAL_MSG_HEADER_SIZE - cmd_id_size;
+		if (!(ucmd_ctx->params.reply = malloc(ucmd_ctx->params.reply_size))) {
+			log_error(ID(cmd_res), "Failed to allocate memory for parameters.");
+			ucmd_ctx->params.reply_size = 0;
+		} else
+			memcpy(ucmd_ctx->params.reply, cmd_id + cmd_id_size, ucmd_ctx->params.reply_size);
 	}
-}
 
-static int _worker_recv_system_cmd_resources(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
-{
-	static const char           _msg_prologue[] = "Received result from resource cmd for main process, but";
-	const char                 *cmd_id;
-	sid_resource_t             *cmd_res;
-	struct sid_ucmd_ctx        *ucmd_ctx;
-	SID_BUFFER_SIZE_PREFIX_TYPE msg_size;
-	int                         r = -1;
+	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
+	_change_cmd_state(cmd_res, CMD_EXEC_SCHEDULED);
 
-	// TODO: make sure error path is not causing the client waiting for response to hang !!!
+	return 0;
+}
 
-	if (!data_spec->ext.used) {
-		log_error(ID(worker_res), "%s data handler is missing.", _msg_prologue);
+static int _create_connection_resource(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
+{
+	if (!sid_resource_create(worker_res,
+	                         &sid_resource_type_ubridge_connection,
+	                         SID_RESOURCE_NO_FLAGS,
+	                         SID_RESOURCE_NO_CUSTOM_ID,
+	                         data_spec,
+	                         SID_RESOURCE_PRIO_NORMAL,
+	                         SID_RESOURCE_NO_SERVICE_LINKS)) {
+		log_error(ID(worker_res), "Failed to create connection resource.");
 		return -1;
 	}
 
-	if (read(data_spec->ext.socket.fd_pass, &msg_size, SID_BUFFER_SIZE_PREFIX_LEN) != SID_BUFFER_SIZE_PREFIX_LEN) {
-		log_error_errno(ID(worker_res), errno, "%s failed to read shared memory size", _msg_prologue);
-		goto out;
-	}
+	return 0;
+}
 
-	if (!msg_size) {
-		log_error(ID(worker_res), "%s no data received.", _msg_prologue);
-		goto out;
-	}
+static int _on_worker_accept_watch_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
+{
+	struct sid_ucmd_common_ctx *common_ctx = data;
+	sid_resource_t             *worker_res = sid_resource_search(common_ctx->res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+	struct internal_msg_header  int_msg    = {.cat    = MSG_CATEGORY_SYSTEM,
+	                                          .header = (struct sid_msg_header) {.cmd = SYSTEM_CMD_ACCEPTED}};
+	struct worker_data_spec     conn_spec;
+	bool                        stale;
+	int                         conn_fd;
+	int                         r;
 
-	if (data_spec->data_size <= INTERNAL_MSG_HEADER_SIZE) {
-		log_error(ID(worker_res), "%s command identifier missing.", _msg_prologue);
-		goto out;
+	if ((conn_fd = sid_comms_unix_accept(common_ctx->worker_accept.socket_fd, fd)) < 0) {
+		/* Another process watching the socket was faster. */
+		if (conn_fd == -EAGAIN || conn_fd == -EINTR || conn_fd == -ECONNABORTED)
+			return 0;
+
+		/* Give up the token, main process hands it over to another worker once this one is gone. */
+		log_error_errno(ID(worker_res), conn_fd, "Failed to accept client connection");
+		_stop_worker_accept_watch(common_ctx);
+		(void) worker_control_worker_yield(worker_res);
+		return 0;
 	}
 
-	cmd_id = data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+	_stop_worker_accept_watch(common_ctx);
 
-	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
-		log_error(ID(worker_res), "%s failed to find command resource with id %s.", _msg_prologue, cmd_id);
-		goto out;
-	}
+	/*
+	 * If any worker sent its KV store export to main process since this worker was created,
+	 * this worker's copy of main KV store may be missing results which the client already
+	 * relies on. Hand the connection back to main process then, it passes it to a new worker.
+	 */
+	stale = __atomic_load_n(common_ctx->worker_accept.sync_gen, __ATOMIC_ACQUIRE) != common_ctx->worker_accept.fork_gen;
 
-	ucmd_ctx                              = sid_resource_get_data(cmd_res);
+	if ((r = worker_control_channel_send(worker_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {.data               = &int_msg,
+	                                                                 .data_size          = INTERNAL_MSG_HEADER_SIZE,
+	                                                                 .ext.used           = stale,
+	                                                                 .ext.socket.fd_pass = conn_fd})) < 0)
+		log_error_errno(ID(worker_res), r, "Failed to notify main process about accepted client connection");
 
-	ucmd_ctx->resources.main_res_mem_size = msg_size;
-	ucmd_ctx->resources.main_res_mem =
-		mmap(NULL, ucmd_ctx->resources.main_res_mem_size, PROT_READ, MAP_SHARED, data_spec->ext.socket.fd_pass, 0);
+	conn_spec = (struct worker_data_spec) {.ext.used = true, .ext.socket.fd_pass = conn_fd};
 
-	close(data_spec->ext.socket.fd_pass);
-	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
-	_change_cmd_state(cmd_res, CMD_EXEC_SCHEDULED);
+	if (stale || _create_connection_resource(worker_res, &conn_spec) < 0) {
+		(void) close(conn_fd);
+		(void) worker_control_worker_yield(worker_res);
+	}
 
-	r = 0;
-out:
-	close(data_spec->ext.socket.fd_pass);
-	return r;
+	return 0;
 }
 
-static int _worker_recv_system_cmd_sync(sid_resource_t *worker_res, struct worker_data_spec *data_spec)
+/*
+ * This worker holds the accept token now, watch the listening socket and accept next
+ * client connection directly. The socket is watched exclusively so that the worker is
+ * not woken up for connections accepted by another process watching the same socket.
+ */
+static int _worker_recv_system_cmd_accept_token(sid_resource_t *worker_res, struct sid_ucmd_common_ctx *common_ctx)
 {
-	const char          *cmd_id;
-	sid_resource_t      *cmd_res;
-	struct sid_ucmd_ctx *ucmd_ctx;
+	int r;
 
-	cmd_id = data_spec->data + INTERNAL_MSG_HEADER_SIZE;
+	if (common_ctx->worker_accept.socket_fd < 0) {
+		log_error(ID(worker_res), INTERNAL_ERROR "Received accept token, but listening socket missing.");
+		goto fail;
+	}
 
-	if (!(cmd_res = sid_resource_search(worker_res, SID_RESOURCE_SEARCH_DFS, &sid_resource_type_ubridge_command, cmd_id))) {
-		log_error(ID(worker_res),
-		          "Received ack from main process, but failed to find command resource with id %s.",
-		          cmd_id);
-		_change_cmd_state(worker_res, CMD_ERROR);
-		return -1;
+	if ((common_ctx->worker_accept.watch_fd = sid_comms_unix_accept_watch(common_ctx->worker_accept.socket_fd)) < 0) {
+		log_error_errno(ID(worker_res), common_ctx->worker_accept.watch_fd, "Failed to watch listening socket");
+		goto fail;
 	}
 
-	ucmd_ctx = sid_resource_get_data(cmd_res);
+	if ((r = sid_resource_create_io_event_source(worker_res,
+	                                             &common_ctx->worker_accept.watch_es,
+	                                             common_ctx->worker_accept.watch_fd,
+	                                             _on_worker_accept_watch_event,
+	                                             SID_RESOURCE_EVENT_PRIO_ADMISSION,
+	                                             "listening socket watch",
+	                                             common_ctx)) < 0) {
+		log_error_errno(ID(worker_res), r, "Failed to register listening socket watch");
+		goto fail;
+	}
 
-	sid_resource_set_event_source_counter(ucmd_ctx->cmd_handler_es, SID_RESOURCE_POS_REL, 1);
-	_change_cmd_state(cmd_res, CMD_EXPBUF_ACKED);
+	return 0;
+fail:
+	_stop_worker_accept_watch(common_ctx);
+	(void) worker_control_worker_yield(worker_res);
+	return -1;
+}
+
+static int _worker_recv_system_cmd_accept_revoke(sid_resource_t *worker_res, struct sid_ucmd_common_ctx *common_ctx)
+{
+	/* The token may have been used already, the accepted connection is still served then. */
+	if (!common_ctx->worker_accept.watch_es)
+		return 0;
+
+	_stop_worker_accept_watch(common_ctx);
+	(void) worker_control_worker_yield(worker_res);
 
 	return 0;
 }
@@ -5155,8 +8605,9 @@ static int _worker_recv_system_cmd_sync(sid_resource_t *worker_res, struct worke
 static int _worker_recv_fn(sid_resource_t          *worker_res,
                            struct worker_channel   *chan,
                            struct worker_data_spec *data_spec,
-                           void                    *arg __attribute__((unused)))
+                           void                    *arg)
 {
+	struct sid_ucmd_common_ctx *common_ctx = arg;
 	struct internal_msg_header int_msg;
 
 	memcpy(&int_msg, data_spec->data, sizeof(int_msg));
@@ -5174,6 +8625,37 @@ static int _worker_recv_fn(sid_resource_t          *worker_res,
 						return -1;
 					break;
 
+				case SYSTEM_CMD_SCAN_FETCH:
+					if (_worker_recv_system_cmd_scan_fetch(worker_res, data_spec) < 0)
+						return -1;
+					break;
+
+				case SYSTEM_CMD_KV_VIEW:
+					if (_worker_recv_system_cmd_kv_view(worker_res, data_spec) < 0)
+						return -1;
+					break;
+
+				case SYSTEM_CMD_ACCEPT_TOKEN:
+					if (_worker_recv_system_cmd_accept_token(worker_res, common_ctx) < 0)
+						return -1;
+					break;
+
+				case SYSTEM_CMD_ACCEPT_REVOKE:
+					if (_worker_recv_system_cmd_accept_revoke(worker_res, common_ctx) < 0)
+						return -1;
+					break;
+
+				case SYSTEM_CMD_PARAM_GET:
+				case SYSTEM_CMD_PARAM_SET:
+					if (_worker_recv_system_cmd_params(worker_res, data_spec) < 0)
+						return -1;
+					break;
+
+				case SYSTEM_CMD_SCAN_MEMO_FETCH:
+					if (_worker_recv_system_cmd_scan_memo_fetch(worker_res, data_spec) < 0)
+						return -1;
+					break;
+
 				default:
 					log_error(ID(worker_res), INTERNAL_ERROR "Received unexpected system command.");
 					return -1;
@@ -5186,16 +8668,8 @@ static int _worker_recv_fn(sid_resource_t          *worker_res,
 			 * sid_msg will be read from client through the connection.
 			 */
 			if (data_spec->ext.used) {
-				if (!sid_resource_create(worker_res,
-				                         &sid_resource_type_ubridge_connection,
-				                         SID_RESOURCE_NO_FLAGS,
-				                         SID_RESOURCE_NO_CUSTOM_ID,
-				                         data_spec,
-				                         SID_RESOURCE_PRIO_NORMAL,
-				                         SID_RESOURCE_NO_SERVICE_LINKS)) {
-					log_error(ID(worker_res), "Failed to create connection resource.");
+				if (_create_connection_resource(worker_res, data_spec) < 0)
 					return -1;
-				}
 			} else {
 				log_error(ID(worker_res), "Received command from worker proxy, but connection handle missing.");
 				return -1;
@@ -5224,6 +8698,29 @@ static int _worker_init_fn(sid_resource_t *worker_res, void *arg)
 {
 	struct sid_ucmd_common_ctx *common_ctx  = arg;
 	sid_resource_t             *old_top_res = sid_resource_search(common_ctx->res, SID_RESOURCE_SEARCH_TOP, NULL, NULL);
+	sid_resource_t             *ubridge_res;
+	struct ubridge             *ubridge;
+
+	/* speculative scans and memoized scan results are tracked by main process only */
+	_destroy_spec_scans(common_ctx);
+	_destroy_scan_memos(common_ctx);
+
+	/* accept token is handed over by main process only, keep the listening socket in case this worker gets it */
+	_destroy_worker_accept(common_ctx);
+
+	if (common_ctx->worker_accept.enabled &&
+	    (ubridge_res = sid_resource_search(common_ctx->res, SID_RESOURCE_SEARCH_ANC, &sid_resource_type_ubridge, NULL))) {
+		ubridge = sid_resource_get_data(ubridge_res);
+
+		if ((common_ctx->worker_accept.socket_fd = fcntl(ubridge->socket_fd, F_DUPFD_CLOEXEC, 0)) < 0)
+			log_sys_error(ID(worker_res), "fcntl", "listening socket");
+	}
+
+	/* shared KV view is updated by main process only, keep it intact for its readers */
+	if (common_ctx->kv_view.enabled) {
+		sid_kv_view_writer_destroy(&common_ctx->kv_view.writer, false);
+		common_ctx->kv_view.enabled = false;
+	}
 
 	/* only take inherited common resource and attach it to the worker */
 	(void) sid_resource_isolate_with_children(common_ctx->res);
@@ -5235,7 +8732,24 @@ static int _worker_init_fn(sid_resource_t *worker_res, void *arg)
 	return 0;
 }
 
-/* *res_p is set to the worker_proxy resource. If a new worker process is created, when it returns, *res_p will be NULL */
+static sid_resource_t *_get_worker_control(sid_resource_t *ubridge_res)
+{
+	struct ubridge *ubridge = sid_resource_get_data(ubridge_res);
+	sid_resource_t *worker_control_res;
+
+	if (!(worker_control_res = sid_resource_search(ubridge->internal_res,
+	                                               SID_RESOURCE_SEARCH_IMM_DESC,
+	                                               &sid_resource_type_worker_control,
+	                                               NULL)))
+		log_error(ID(ubridge_res), INTERNAL_ERROR "%s: Failed to find worker control resource.", __func__);
+
+	return worker_control_res;
+}
+
+/*
+ * *res_p is set to the worker_proxy resource. If a new worker process is created, when it returns, *res_p will be NULL.
+ * Returns -EAGAIN if there are syncs with main KV store in progress, the caller should try again once they are complete.
+ */
 static int _get_worker(sid_resource_t *ubridge_res, sid_resource_t **res_p)
 {
 	struct ubridge *ubridge = sid_resource_get_data(ubridge_res);
@@ -5244,13 +8758,20 @@ static int _get_worker(sid_resource_t *ubridge_res, sid_resource_t **res_p)
 	sid_resource_t *worker_control_res, *worker_proxy_res;
 
 	*res_p = NULL;
-	if (!(worker_control_res = sid_resource_search(ubridge->internal_res,
-	                                               SID_RESOURCE_SEARCH_IMM_DESC,
-	                                               &sid_resource_type_worker_control,
-	                                               NULL))) {
-		log_error(ID(ubridge_res), INTERNAL_ERROR "%s: Failed to find worker control resource.", __func__);
+	if (!(worker_control_res = _get_worker_control(ubridge_res)))
 		return -1;
-	}
+
+	/*
+	 * Workers reply to clients before their KV store exports are synced with main KV store.
+	 * Receive any such syncs which are already queued in worker channels before handing over
+	 * a new request so that the new worker always sees the results of previous requests.
+	 * The syncs are applied in time slices, never fork a new worker before they are complete,
+	 * it would inherit incomplete main KV store.
+	 */
+	(void) worker_control_recv_pending(worker_control_res);
+
+	if (ubridge->common_ctx->sync.es)
+		return -EAGAIN;
 
 	if ((worker_proxy_res = worker_control_get_idle_worker(worker_control_res)))
 		*res_p = worker_proxy_res;
@@ -5262,61 +8783,273 @@ static int _get_worker(sid_resource_t *ubridge_res, sid_resource_t **res_p)
 			return -1;
 		}
 
-		if (worker_control_get_new_worker(worker_control_res, &((struct worker_params) {.id = uuid}), res_p) < 0)
-			return -1;
+		if (worker_control_get_new_worker(worker_control_res, &((struct worker_params) {.id = uuid}), res_p) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+static bool _has_pending_connection(int socket_fd)
+{
+	struct pollfd pfd = {.fd = socket_fd, .events = POLLIN};
+
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+static int _pass_connection(sid_resource_t *ubridge_res, sid_resource_t *worker_proxy_res, int fd)
+{
+	struct worker_data_spec    data_spec;
+	struct internal_msg_header int_msg;
+	int                        r;
+
+	int_msg.cat                  = MSG_CATEGORY_CLIENT;
+	int_msg.header               = (struct sid_msg_header) {0};
+
+	data_spec.data               = &int_msg;
+	data_spec.data_size          = INTERNAL_MSG_HEADER_SIZE;
+	data_spec.ext.used           = true;
+	data_spec.ext.socket.fd_pass = fd;
+
+	if ((r = worker_control_channel_send(worker_proxy_res, MAIN_WORKER_CHANNEL_ID, &data_spec)) < 0) {
+		log_error_errno(ID(ubridge_res), r, "worker_control_channel_send");
+		r = -1;
+	}
+
+	return r;
+}
+
+static int _accept_connection(sid_resource_t *ubridge_res, struct ubridge *ubridge, sid_resource_t *worker_proxy_res)
+{
+	int fd;
+	int r;
+
+	if ((fd = accept4(ubridge->socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+		log_sys_error(ID(ubridge_res), "accept", "");
+		return -1;
+	}
+
+	r = _pass_connection(ubridge_res, worker_proxy_res, fd);
+
+	(void) close(fd);
+	return r;
+}
+
+static int _on_ubridge_interface_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
+{
+	sid_resource_t *ubridge_res = data;
+	struct ubridge *ubridge     = sid_resource_get_data(ubridge_res);
+	sid_resource_t *worker_control_res, *worker_proxy_res;
+	unsigned        i;
+	int             r;
+
+	log_debug(ID(ubridge_res), "Received an event.");
+
+	/*
+	 * Leave the new request waiting in the socket backlog while there are syncs with main KV
+	 * store in progress, _get_worker does not create workers until they are complete. The
+	 * interface event source is released again as soon as all the syncs are complete.
+	 */
+	if (!(worker_control_res = _get_worker_control(ubridge_res)))
+		return -1;
+
+	(void) worker_control_recv_pending(worker_control_res);
+
+	if (_hold_for_main_kv_store_sync(ubridge->common_ctx, es)) {
+		(void) sid_resource_count_event_source_deferral(es);
+		return 0;
+	}
+
+	/*
+	 * Accept at most 'accept_budget' connections in one go. Anything left
+	 * in the backlog is accepted in next event loop iterations, after any
+	 * pending events with higher priority are handled.
+	 */
+	for (i = 0; i < ubridge->accept_budget; i++) {
+		if (i && !_has_pending_connection(ubridge->socket_fd))
+			return 0;
+
+		if ((r = _get_worker(ubridge_res, &worker_proxy_res)) == -EAGAIN) {
+			(void) _hold_for_main_kv_store_sync(ubridge->common_ctx, es);
+			(void) sid_resource_count_event_source_deferral(es);
+			return 0;
+		}
+
+		if (r < 0)
+			return -1;
+
+		/* If this is a worker process, exit the handler */
+		if (!worker_proxy_res)
+			return 0;
+
+		if (_accept_connection(ubridge_res, ubridge, worker_proxy_res) < 0)
+			return -1;
+	}
+
+	if (_has_pending_connection(ubridge->socket_fd))
+		(void) sid_resource_count_event_source_deferral(es);
+
+	return 0;
+}
+
+/*
+ * Accepting client connections in workers failed, accept them in main process from now on.
+ */
+static void _fall_back_to_main_accept(sid_resource_t *ubridge_res, struct ubridge *ubridge)
+{
+	log_warning(ID(ubridge_res), "Failed to hand over accept token to a worker, accepting client connections in main process.");
+
+	ubridge->common_ctx->worker_accept.enabled = false;
+
+	if (ubridge->common_ctx->worker_accept.timer_es)
+		sid_resource_destroy_event_source(&ubridge->common_ctx->worker_accept.timer_es);
+
+	sid_resource_set_event_source_counter(ubridge->interface_es, SID_RESOURCE_POS_ABS, SID_RESOURCE_UNLIMITED_EVENT_COUNT);
+}
+
+/*
+ * Create a new worker and hand over the accept token to it. The worker accepts next
+ * client connection itself, directly from the listening socket, so the client does not
+ * need to wait for main process to create the worker and pass the connection over.
+ * Main process only learns which worker accepted the connection afterwards.
+ */
+static int _on_worker_accept_event(sid_resource_event_source_t *es, void *data)
+{
+	sid_resource_t             *ubridge_res = data;
+	struct ubridge             *ubridge     = sid_resource_get_data(ubridge_res);
+	struct sid_ucmd_common_ctx *common_ctx  = ubridge->common_ctx;
+	struct internal_msg_header  int_msg     = {.cat    = MSG_CATEGORY_SYSTEM,
+	                                           .header = (struct sid_msg_header) {.cmd = SYSTEM_CMD_ACCEPT_TOKEN}};
+	sid_resource_t             *worker_proxy_res;
+	struct bounced_conn        *bounced;
+	int                         r;
+
+	/* Rescheduled once the token is back or all pending syncs with main KV store are complete. */
+	if (common_ctx->worker_accept.token_id || common_ctx->sync.es)
+		return 0;
+
+	/* Connections handed back by workers are passed to new workers the usual way. */
+	while (!list_is_empty(&common_ctx->worker_accept.bounced)) {
+		if ((r = _get_worker(ubridge_res, &worker_proxy_res)) == -EAGAIN)
+			return 0;
+
+		if (r < 0)
+			goto fail;
+
+		/* If this is a worker process, exit the handler */
+		if (!worker_proxy_res)
+			return 0;
+
+		bounced = list_item(common_ctx->worker_accept.bounced.n, struct bounced_conn);
+		list_del(&bounced->list);
+		(void) _pass_connection(ubridge_res, worker_proxy_res, bounced->fd);
+		(void) close(bounced->fd);
+		free(bounced);
 	}
 
-	return 0;
-}
+	if (!common_ctx->worker_accept.enabled)
+		return 0;
 
-static int _on_ubridge_interface_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
-{
-	sid_resource_t            *ubridge_res = data;
-	struct ubridge            *ubridge     = sid_resource_get_data(ubridge_res);
-	sid_resource_t            *worker_proxy_res;
-	struct worker_data_spec    data_spec;
-	struct internal_msg_header int_msg;
-	int                        r;
+	/*
+	 * Exports which main process has not received yet at this point are not part of new
+	 * worker's copy of main KV store, so take the generation before _get_worker receives
+	 * pending syncs. The worker compares it with current generation when it accepts.
+	 */
+	common_ctx->worker_accept.fork_gen = __atomic_load_n(common_ctx->worker_accept.sync_gen, __ATOMIC_ACQUIRE);
 
-	log_debug(ID(ubridge_res), "Received an event.");
+	if ((r = _get_worker(ubridge_res, &worker_proxy_res)) == -EAGAIN)
+		return 0;
 
-	if (_get_worker(ubridge_res, &worker_proxy_res) < 0)
-		return -1;
+	if (r < 0)
+		goto fail;
 
 	/* If this is a worker process, exit the handler */
 	if (!worker_proxy_res)
 		return 0;
 
-	int_msg.cat         = MSG_CATEGORY_CLIENT;
-	int_msg.header      = (struct sid_msg_header) {0};
+	if ((r = worker_control_channel_send(worker_proxy_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {.data      = &int_msg,
+	                                                                 .data_size = INTERNAL_MSG_HEADER_SIZE,
+	                                                                 .ext.used  = false})) < 0) {
+		log_error_errno(ID(ubridge_res), r, "Failed to send accept token to worker");
+		goto fail;
+	}
 
-	data_spec.data      = &int_msg;
-	data_spec.data_size = INTERNAL_MSG_HEADER_SIZE;
-	data_spec.ext.used  = true;
+	if (!(common_ctx->worker_accept.token_id = strdup(worker_control_get_worker_id(worker_proxy_res)))) {
+		log_error(ID(ubridge_res), "Failed to copy worker identifier.");
+		goto fail;
+	}
 
-	if ((data_spec.ext.socket.fd_pass = accept4(ubridge->socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
-		log_sys_error(ID(ubridge_res), "accept", "");
-		return -1;
+	return 0;
+fail:
+	_fall_back_to_main_accept(ubridge_res, ubridge);
+	return 0;
+}
+
+/*
+ * The worker holding the accept token only exits after it gives the token up,
+ * but if it is gone unexpectedly, the token needs to be handed over again.
+ */
+static int _on_worker_accept_check_event(sid_resource_event_source_t *es, uint64_t usec, void *data)
+{
+	sid_resource_t             *ubridge_res = data;
+	struct ubridge             *ubridge     = sid_resource_get_data(ubridge_res);
+	struct sid_ucmd_common_ctx *common_ctx  = ubridge->common_ctx;
+	sid_resource_t             *worker_control_res;
+
+	if (common_ctx->worker_accept.token_id && (worker_control_res = _get_worker_control(ubridge_res)) &&
+	    !worker_control_find_worker(worker_control_res, common_ctx->worker_accept.token_id)) {
+		log_warning(ID(ubridge_res), "Worker holding accept token exited unexpectedly.");
+		free(common_ctx->worker_accept.token_id);
+		common_ctx->worker_accept.token_id = NULL;
+		_schedule_worker_accept(common_ctx);
 	}
 
-	if ((r = worker_control_channel_send(worker_proxy_res, MAIN_WORKER_CHANNEL_ID, &data_spec)) < 0) {
-		log_error_errno(ID(ubridge_res), r, "worker_control_channel_send");
-		r = -1;
+	(void) sid_resource_rearm_time_event_source(es, SID_RESOURCE_POS_REL, WORKER_ACCEPT_CHECK_USEC);
+	return 0;
+}
+
+int ubridge_reload_params(sid_resource_t *ubridge_res)
+{
+	struct ubridge *ubridge = sid_resource_get_data(ubridge_res);
+	const char     *failed;
+	int             r;
+
+	if (worker_control_is_worker(ubridge_res))
+		return 0;
+
+	if ((r = param_load_file(ubridge->common_ctx->params, PARAMS_SYSCONFIG_FILE, &failed)) < 0) {
+		if (failed)
+			log_error_errno(ID(ubridge_res),
+			                r,
+			                "Failed to reload parameters from %s, parameter %s rejected",
+			                PARAMS_SYSCONFIG_FILE,
+			                failed);
+		else
+			log_error_errno(ID(ubridge_res), r, "Failed to reload parameters from %s", PARAMS_SYSCONFIG_FILE);
+		return -1;
 	}
 
-	(void) close(data_spec.ext.socket.fd_pass);
-	return r;
+	log_notice(ID(ubridge_res), "Parameters reloaded from %s.", PARAMS_SYSCONFIG_FILE);
+	return 0;
 }
 
 int ubridge_cmd_dbdump(sid_resource_t *ubridge_res, const char *file_path)
 {
+	struct ubridge             *ubridge = sid_resource_get_data(ubridge_res);
 	sid_resource_t             *worker_proxy_res;
 	struct internal_msg_header *int_msg;
 	struct worker_data_spec     data_spec;
 	size_t                      file_path_size;
 	char                        buf[INTERNAL_MSG_HEADER_SIZE + PATH_MAX + 1];
+	int                         r;
 
-	if (_get_worker(ubridge_res, &worker_proxy_res) < 0)
+	/* The dump is requested explicitly, it is fine to wait for pending syncs with main KV store here. */
+	while ((r = _get_worker(ubridge_res, &worker_proxy_res)) == -EAGAIN)
+		_flush_main_kv_store_sync(ubridge->common_ctx);
+
+	if (r < 0)
 		return -1;
 
 	/* If this is a worker process, return right away */
@@ -5380,6 +9113,157 @@ static int _load_kv_store(sid_resource_t *ubridge_res, struct sid_ucmd_common_ct
 	return r;
 }
 
+static int _on_spec_scan_timeout_event(sid_resource_event_source_t *es, uint64_t usec, void *data)
+{
+	struct sid_ucmd_common_ctx *common_ctx = data;
+	struct spec_scan           *scan;
+
+	list_iterate_items (scan, &common_ctx->spec_scan.list) {
+		if (scan->timer_es == es) {
+			log_warning(ID(common_ctx->res), "Speculative scan for uevent %" PRIu64 " timed out.", scan->key.seqnum);
+			_abandon_spec_scan(common_ctx, scan);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int _on_spec_scan_dispatch_event(sid_resource_event_source_t *es, void *data)
+{
+	sid_resource_t             *ubridge_res = data;
+	struct ubridge             *ubridge     = sid_resource_get_data(ubridge_res);
+	struct sid_ucmd_common_ctx *common_ctx  = ubridge->common_ctx;
+	sid_resource_t             *worker_proxy_res;
+	struct spec_scan           *scan;
+	int                         r;
+
+	if (!_get_next_spec_scan(common_ctx))
+		return 0;
+
+	/* Rescheduled once all pending syncs with main KV store are complete. */
+	if ((r = _get_worker(ubridge_res, &worker_proxy_res)) == -EAGAIN)
+		return 0;
+
+	if (r < 0)
+		return -1;
+
+	/* If this is a worker process, exit the handler */
+	if (!worker_proxy_res)
+		return 0;
+
+	/* Getting the worker processes pending messages from workers, the scan might have been claimed meanwhile. */
+	if (!(scan = _get_next_spec_scan(common_ctx)))
+		return 0;
+
+	scan->worker_control_res = sid_resource_search(worker_proxy_res, SID_RESOURCE_SEARCH_IMM_ANC, NULL, NULL);
+
+	if (!(scan->worker_id = strdup(worker_control_get_worker_id(worker_proxy_res)))) {
+		log_error(ID(ubridge_res), "Failed to allocate speculative scan worker identifier.");
+		return -1;
+	}
+
+	if ((r = worker_control_channel_send(worker_proxy_res,
+	                                     MAIN_WORKER_CHANNEL_ID,
+	                                     &(struct worker_data_spec) {
+						     .data      = scan->req_data,
+						     .data_size = scan->req_data_size,
+						     .ext.used  = false,
+					     })) < 0) {
+		log_error_errno(ID(ubridge_res), r, "Failed to send speculative scan request to worker.");
+		_destroy_spec_scan(common_ctx, scan);
+		_schedule_spec_scan(common_ctx);
+		return 0;
+	}
+
+	scan->state = SPEC_SCAN_RUNNING;
+
+	/* There might be more workers allowed to execute speculative scans. */
+	_schedule_spec_scan(common_ctx);
+
+	if ((r = sid_resource_create_time_event_source(ubridge_res,
+	                                               &scan->timer_es,
+	                                               CLOCK_MONOTONIC,
+	                                               SID_RESOURCE_POS_REL,
+	                                               SPEC_SCAN_TIMEOUT_USEC,
+	                                               0,
+	                                               _on_spec_scan_timeout_event,
+	                                               0,
+	                                               "speculative scan timeout",
+	                                               common_ctx)) < 0)
+		log_error_errno(ID(ubridge_res), r, "Failed to register speculative scan timeout handler");
+
+	return 0;
+}
+
+/*
+ * Kernel uevents are received right when the kernel generates them, in parallel with udev.
+ * Start scanning speculatively so the result is ready, or at least closer to being ready,
+ * by the time udev rules ask for it.
+ */
+static int _on_ubridge_udev_kernel_monitor_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
+{
+	sid_resource_t         *ubridge_res = data;
+	struct ubridge         *ubridge     = sid_resource_get_data(ubridge_res);
+	struct sid_buffer      *gen_buf     = ubridge->common_ctx->gen_buf;
+	struct udev_device     *udev_dev;
+	struct udev_list_entry *entry;
+	struct spec_scan_key    key;
+	const char             *action, *name, *value;
+	size_t                  buf_pos;
+	char                   *req_data;
+	size_t                  req_data_size;
+	int                     r = -1;
+
+	if (!(udev_dev = udev_monitor_receive_device(ubridge->umonitor.kmon)))
+		goto out;
+
+	r = 0;
+
+	/*
+	 * Scan only for uevents which udev rules ask us to scan for. Do not scan for "remove"
+	 * speculatively, the device is going away and there's nothing to gain from it.
+	 */
+	if (!(action = udev_device_get_action(udev_dev)) || (strcmp(action, "add") && strcmp(action, "change")))
+		goto out;
+
+	key = (struct spec_scan_key) {.seqnum = udev_device_get_seqnum(udev_dev), .devno = udev_device_get_devnum(udev_dev)};
+
+	if (!key.seqnum || !major(key.devno))
+		goto out;
+
+	sid_buffer_add(gen_buf,
+	               &(struct internal_msg_header) {.cat    = MSG_CATEGORY_SELF,
+	                                              .header = (struct sid_msg_header) {.status = 0,
+	                                                                                 .prot   = SID_PROTOCOL,
+	                                                                                 .cmd    = SELF_CMD_SCAN,
+	                                                                                 .flags  = SID_CMD_FLAGS_FMT_ENV}},
+	               INTERNAL_MSG_HEADER_SIZE,
+	               NULL,
+	               &buf_pos);
+	sid_buffer_add(gen_buf, &key.devno, sizeof(key.devno), NULL, NULL);
+
+	udev_list_entry_foreach(entry, udev_device_get_properties_list_entry(udev_dev)) {
+		name  = udev_list_entry_get_name(entry);
+		value = udev_list_entry_get_value(entry);
+		sid_buffer_add(gen_buf, (void *) name, strlen(name), NULL, NULL);
+		sid_buffer_add(gen_buf, KV_PAIR_C, 1, NULL, NULL);
+		sid_buffer_add(gen_buf, (void *) value, strlen(value), NULL, NULL);
+		sid_buffer_add(gen_buf, KV_END_C, 1, NULL, NULL);
+	}
+
+	sid_buffer_get_data_from(gen_buf, buf_pos, (const void **) &req_data, &req_data_size);
+
+	log_debug(ID(ubridge_res), "Queueing speculative scan for uevent %" PRIu64 ".", key.seqnum);
+	r = _queue_spec_scan(ubridge_res, ubridge->common_ctx, &key, req_data, req_data_size);
+
+	sid_buffer_rewind(gen_buf, buf_pos, SID_BUFFER_POS_ABS);
+out:
+	if (udev_dev)
+		udev_device_unref(udev_dev);
+	return r;
+}
+
 static int _on_ubridge_udev_monitor_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
 {
 	sid_resource_t     *ubridge_res = data;
@@ -5419,14 +9303,26 @@ static void _destroy_udev_monitor(sid_resource_t *ubridge_res, struct umonitor *
 		umonitor->mon = NULL;
 	}
 
+	if (umonitor->kmon) {
+		udev_monitor_unref(umonitor->kmon);
+		umonitor->kmon = NULL;
+	}
+
 	udev_unref(umonitor->udev);
 	umonitor->udev = NULL;
 }
 
 static int _set_up_ubridge_socket(sid_resource_t *ubridge_res, int *ubridge_socket_fd)
 {
-	char *val;
-	int   fd;
+	char   path[SID_SOCKET_PATH_MAX];
+	size_t path_len;
+	char  *val;
+	int    fd;
+
+	if ((fd = sid_socket_path_get(path, &path_len)) < 0) {
+		log_error_errno(ID(ubridge_res), fd, "Incorrect value for key %s", SID_KEY_SOCKET);
+		return fd;
+	}
 
 	if (service_fd_activation_present(1)) {
 		if (!(val = getenv(SERVICE_KEY_ACTIVATION_TYPE))) {
@@ -5442,14 +9338,13 @@ static int _set_up_ubridge_socket(sid_resource_t *ubridge_res, int *ubridge_sock
 		/* The very first FD passed in is the one we are interested in. */
 		fd = SERVICE_FD_ACTIVATION_FDS_START;
 
-		if (!(service_fd_is_socket_unix(fd, SOCK_STREAM, 1, SID_SOCKET_PATH, SID_SOCKET_PATH_LEN))) {
+		if (!(service_fd_is_socket_unix(fd, SOCK_STREAM, 1, path, path_len))) {
 			log_error(ID(ubridge_res), "Passed file descriptor is of incorrect type.");
 			return -EINVAL;
 		}
 	} else {
 		/* No systemd autoactivation - create new socket FD. */
-		if ((fd = sid_comms_unix_create(SID_SOCKET_PATH, SID_SOCKET_PATH_LEN, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC)) <
-		    0) {
+		if ((fd = sid_comms_unix_create(path, path_len, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
 			log_error_errno(ID(ubridge_res), fd, "Failed to create local server socket");
 			return fd;
 		}
@@ -5572,7 +9467,7 @@ static int _set_up_udev_monitor(sid_resource_t *ubridge_res, struct umonitor *um
 	                                        NULL,
 	                                        umonitor_fd,
 	                                        _on_ubridge_udev_monitor_event,
-	                                        0,
+	                                        SID_RESOURCE_EVENT_PRIO_NORMAL,
 	                                        "udev monitor",
 	                                        ubridge_res) < 0) {
 		log_error(ID(ubridge_res), "Failed to register udev monitoring.");
@@ -5590,6 +9485,52 @@ fail:
 	return -1;
 }
 
+/*
+ * Monitor uevents coming directly from kernel for speculative scans. We can not use uevents
+ * coming from udev for this, those are sent only after udev rules, including the scan
+ * request, are processed.
+ */
+static int _set_up_udev_kernel_monitor(sid_resource_t *ubridge_res, struct umonitor *umonitor)
+{
+	int umonitor_fd = -1;
+
+	if (!(umonitor->kmon = udev_monitor_new_from_netlink(umonitor->udev, "kernel"))) {
+		log_error(ID(ubridge_res), "Failed to create udev kernel monitor.");
+		goto fail;
+	}
+
+	if (udev_monitor_filter_add_match_subsystem_devtype(umonitor->kmon, "block", NULL) < 0) {
+		log_error(ID(ubridge_res), "Failed to create subsystem filter.");
+		goto fail;
+	}
+
+	umonitor_fd = udev_monitor_get_fd(umonitor->kmon);
+
+	if (sid_resource_create_io_event_source(ubridge_res,
+	                                        NULL,
+	                                        umonitor_fd,
+	                                        _on_ubridge_udev_kernel_monitor_event,
+	                                        SID_RESOURCE_EVENT_PRIO_ADMISSION,
+	                                        "udev kernel monitor",
+	                                        ubridge_res) < 0) {
+		log_error(ID(ubridge_res), "Failed to register udev kernel monitoring.");
+		goto fail;
+	}
+
+	if (udev_monitor_enable_receiving(umonitor->kmon) < 0) {
+		log_error(ID(ubridge_res), "Failed to enable udev kernel monitoring.");
+		goto fail;
+	}
+
+	return 0;
+fail:
+	if (umonitor->kmon) {
+		udev_monitor_unref(umonitor->kmon);
+		umonitor->kmon = NULL;
+	}
+	return -1;
+}
+
 static struct module_symbol_params block_symbol_params[]                  = {{
                                                                     SID_UCMD_MOD_FN_NAME_IDENT,
                                                                     MODULE_SYMBOL_INDIRECT,
@@ -5666,7 +9607,9 @@ static struct module_symbol_params type_symbol_params[]                   = {{
                                                            },
                                                                              NULL_MODULE_SYMBOL_PARAMS};
 
-static const struct sid_kv_store_resource_params main_kv_store_res_params = {.backend = KV_STORE_BACKEND_BPTREE, .bptree.order = 4};
+static const struct sid_kv_store_resource_params main_kv_store_res_params = {
+	.backend = KV_STORE_BACKEND_BPTREE,
+	.bptree  = {.order = 4, .merge_threshold = 25, .lazy_remove = true}};
 
 static int _init_common(sid_resource_t *res, const void *kickstart_data, void **data)
 {
@@ -5678,6 +9621,15 @@ static int _init_common(sid_resource_t *res, const void *kickstart_data, void **
 		goto fail;
 	}
 	common_ctx->res = res;
+	list_init(&common_ctx->sync.queue);
+	common_ctx->sync.max_records = MAIN_KV_STORE_SYNC_MAX_RECORDS;
+	common_ctx->sync.max_usec    = MAIN_KV_STORE_SYNC_MAX_USEC;
+	common_ctx->conn_buf_size    = CONN_BUF_SIZE;
+	list_init(&common_ctx->spec_scan.list);
+	list_init(&common_ctx->scan_memo.list);
+	list_init(&common_ctx->worker_accept.bounced);
+	common_ctx->worker_accept.socket_fd = -1;
+	common_ctx->worker_accept.watch_fd  = -1;
 
 	/*
 	 * Set higher priority to kv_store_res compared to modules so they can
@@ -5769,18 +9721,244 @@ fail:
 static int _destroy_common(sid_resource_t *res)
 {
 	struct sid_ucmd_common_ctx *common_ctx = sid_resource_get_data(res);
+	struct kv_sync             *sync, *tmp_sync;
+
+	list_iterate_items_safe (sync, tmp_sync, &common_ctx->sync.queue)
+		_destroy_main_kv_store_sync(res, sync);
+
+	_destroy_spec_scans(common_ctx);
+	_destroy_scan_memos(common_ctx);
+	_destroy_worker_accept(common_ctx);
 
+	if (common_ctx->worker_accept.sync_gen)
+		(void) munmap(common_ctx->worker_accept.sync_gen, sizeof(*common_ctx->worker_accept.sync_gen));
+
+	if (common_ctx->kv_view.enabled)
+		sid_kv_view_writer_destroy(&common_ctx->kv_view.writer, true);
+
+	free(common_ctx->debug.name);
+	free(common_ctx->debug.module);
+	param_registry_destroy(common_ctx->params);
 	sid_buffer_destroy(common_ctx->gen_buf);
 	free(common_ctx);
 
 	return 0;
 }
 
+static int _apply_verbose(const char *name, uint64_t value, const char *str, void *arg)
+{
+	log_change_verbose_mode(value);
+	return 0;
+}
+
+static int _apply_accept_budget(const char *name, uint64_t value, const char *str, void *arg)
+{
+	struct ubridge *ubridge = arg;
+
+	ubridge->accept_budget = value;
+	return 0;
+}
+
+static int _apply_sync_max_records(const char *name, uint64_t value, const char *str, void *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+
+	common_ctx->sync.max_records = value;
+	return 0;
+}
+
+static int _apply_sync_max_usec(const char *name, uint64_t value, const char *str, void *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+
+	common_ctx->sync.max_usec = value;
+	return 0;
+}
+
+static int _apply_spec_scan_max_workers(const char *name, uint64_t value, const char *str, void *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+
+	common_ctx->spec_scan.max_workers = value;
+	_schedule_spec_scan(common_ctx);
+	return 0;
+}
+
+static int _apply_debug_filter(const char *name, uint64_t value, const char *str, void *arg)
+{
+	struct sid_ucmd_common_ctx *common_ctx = arg;
+	char                       *copy       = NULL;
+	int                         major = -1, minor = -1, pos;
+	sid_cmd_t                   cmd;
+
+	if (!strcmp(name, KEY_DEBUG_DEVNO)) {
+		if (*str && (sscanf(str, "%d:%d%n", &major, &minor, &pos) != 2 || str[pos] || major < 0 || minor < 0))
+			return -EINVAL;
+		common_ctx->debug.major = major;
+		common_ctx->debug.minor = minor;
+	} else if (!strcmp(name, KEY_DEBUG_CMD)) {
+		if (!*str)
+			cmd = SID_CMD_UNDEFINED;
+		else if ((cmd = sid_cmd_name_to_type(str)) <= SID_CMD_UNKNOWN)
+			return -EINVAL;
+		common_ctx->debug.cmd = cmd;
+	} else {
+		if (*str && !(copy = strdup(str)))
+			return -ENOMEM;
+
+		if (!strcmp(name, KEY_DEBUG_NAME)) {
+			free(common_ctx->debug.name);
+			common_ctx->debug.name = copy;
+		} else {
+			free(common_ctx->debug.module);
+			common_ctx->debug.module = copy;
+		}
+	}
+
+	common_ctx->debug.enabled = common_ctx->debug.major >= 0 || common_ctx->debug.name || common_ctx->debug.module ||
+	                            common_ctx->debug.cmd != SID_CMD_UNDEFINED;
+	return 0;
+}
+
+/*
+ * Set up debug filter from DEBUG_* parameters loaded from environment. Invalid filters
+ * are reset to empty value so they do not filter at all.
+ */
+static int _init_debug_filter(sid_resource_t *res, struct sid_ucmd_common_ctx *common_ctx)
+{
+	static const char * const keys[] = {KEY_DEBUG_DEVNO, KEY_DEBUG_NAME, KEY_DEBUG_MODULE, KEY_DEBUG_CMD};
+	char                      item[32];
+	const char               *str;
+	unsigned                  i;
+	int                       r;
+
+	common_ctx->debug.major = -1;
+	common_ctx->debug.minor = -1;
+
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		(void) param_get_str(common_ctx->params, keys[i], &str);
+
+		if ((r = _apply_debug_filter(keys[i], 0, str, common_ctx)) == -EINVAL) {
+			log_warning(ID(res), "Ignoring invalid value of %s parameter, using default.", keys[i]);
+			/* the registry is not running yet, so the apply callback is not called */
+			(void) snprintf(item, sizeof(item), "%s=", keys[i]);
+			(void) param_set(common_ctx->params, item, strlen(item) + 1, NULL);
+		} else if (r < 0) {
+			log_error_errno(ID(res), r, "Failed to set debug filter from %s parameter", keys[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Register runtime tuning parameters and load their values from environment (the
+ * daemon is started with sid.sysconfig in its environment). Parameters which only
+ * take effect while setting up ubridge are not hot-reloadable.
+ */
+static int _init_params(sid_resource_t *res, struct ubridge *ubridge, struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct param_spec specs[] = {
+		{.name  = KEY_VERBOSE,
+		 .type  = PARAM_TYPE_UINT,
+		 .max   = INT_MAX,
+		 .def   = log_get_verbose_mode(),
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_verbose},
+		{.name = KEY_SPECULATIVE_SCAN, .type = PARAM_TYPE_BOOL, .def = false},
+		{.name  = KEY_SPEC_SCAN_MAX_WORKERS,
+		 .type  = PARAM_TYPE_UINT,
+		 .min   = 1,
+		 .max   = SPEC_SCAN_MAX_WORKERS_MAX,
+		 .def   = SPEC_SCAN_MAX_WORKERS,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_spec_scan_max_workers,
+		 .arg   = common_ctx},
+		{.name  = KEY_ACCEPT_BUDGET,
+		 .type  = PARAM_TYPE_UINT,
+		 .min   = 1,
+		 .max   = ACCEPT_BUDGET_MAX,
+		 .def   = ACCEPT_BUDGET,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_accept_budget,
+		 .arg   = ubridge},
+		{.name = KEY_KV_VIEW, .type = PARAM_TYPE_BOOL, .def = false},
+		{.name = KEY_WORKER_ACCEPT, .type = PARAM_TYPE_BOOL, .def = false},
+		{.name  = KEY_SYNC_MAX_RECORDS,
+		 .type  = PARAM_TYPE_UINT,
+		 .min   = 1,
+		 .max   = UINT_MAX,
+		 .def   = MAIN_KV_STORE_SYNC_MAX_RECORDS,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_sync_max_records,
+		 .arg   = common_ctx},
+		{.name  = KEY_SYNC_MAX_USEC,
+		 .type  = PARAM_TYPE_UINT,
+		 .max   = SYNC_MAX_USEC_MAX,
+		 .def   = MAIN_KV_STORE_SYNC_MAX_USEC,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_sync_max_usec,
+		 .arg   = common_ctx},
+		{.name = KEY_CONN_BUF_SIZE,
+		 .type = PARAM_TYPE_UINT,
+		 .min  = CONN_BUF_SIZE_MIN,
+		 .max  = CONN_BUF_SIZE_MAX,
+		 .def  = CONN_BUF_SIZE},
+		{.name = KEY_SCAN_MEMO, .type = PARAM_TYPE_BOOL, .def = false},
+		{.name  = KEY_DEBUG_DEVNO,
+		 .type  = PARAM_TYPE_STR,
+		 .max   = DEBUG_FILTER_MAX,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_debug_filter,
+		 .arg   = common_ctx},
+		{.name  = KEY_DEBUG_NAME,
+		 .type  = PARAM_TYPE_STR,
+		 .max   = DEBUG_FILTER_MAX,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_debug_filter,
+		 .arg   = common_ctx},
+		{.name  = KEY_DEBUG_MODULE,
+		 .type  = PARAM_TYPE_STR,
+		 .max   = DEBUG_FILTER_MAX,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_debug_filter,
+		 .arg   = common_ctx},
+		{.name  = KEY_DEBUG_CMD,
+		 .type  = PARAM_TYPE_STR,
+		 .max   = DEBUG_FILTER_MAX,
+		 .flags = PARAM_FL_HOT,
+		 .apply = _apply_debug_filter,
+		 .arg   = common_ctx},
+	};
+	const char *failed;
+	unsigned    i;
+	int         r;
+
+	if (!(common_ctx->params = param_registry_create())) {
+		log_error(ID(res), "Failed to create parameter registry.");
+		return -1;
+	}
+
+	for (i = 0; i < sizeof(specs) / sizeof(specs[0]); i++) {
+		if ((r = param_register(common_ctx->params, &specs[i])) < 0) {
+			log_error_errno(ID(res), r, "Failed to register parameter %s", specs[i].name);
+			return -1;
+		}
+	}
+
+	if (param_load_env(common_ctx->params, &failed) < 0)
+		log_warning(ID(res), "Ignoring invalid value of %s parameter, using default.", failed);
+
+	return 0;
+}
+
 static int _init_ubridge(sid_resource_t *res, const void *kickstart_data, void **data)
 {
 	struct ubridge             *ubridge = NULL;
 	sid_resource_t             *common_res;
 	struct sid_ucmd_common_ctx *common_ctx = NULL;
+	uint64_t                    val;
 
 	if (!(ubridge = mem_zalloc(sizeof(struct ubridge)))) {
 		log_error(ID(res), "Failed to allocate memory for ubridge structure.");
@@ -5809,7 +9987,70 @@ static int _init_ubridge(sid_resource_t *res, const void *kickstart_data, void *
 		log_error(ID(res), "Failed to create ubridge common resource.");
 		goto fail;
 	}
-	common_ctx                                                      = sid_resource_get_data(common_res);
+	common_ctx          = sid_resource_get_data(common_res);
+	ubridge->common_ctx = common_ctx;
+
+	if (_init_params(res, ubridge, common_ctx) < 0)
+		goto fail;
+
+	(void) param_get(common_ctx->params, KEY_SPECULATIVE_SCAN, &val);
+	common_ctx->spec_scan.enabled = val;
+
+	(void) param_get(common_ctx->params, KEY_SPEC_SCAN_MAX_WORKERS, &val);
+	common_ctx->spec_scan.max_workers = val;
+
+	(void) param_get(common_ctx->params, KEY_ACCEPT_BUDGET, &val);
+	ubridge->accept_budget = val;
+
+	(void) param_get(common_ctx->params, KEY_SYNC_MAX_RECORDS, &val);
+	common_ctx->sync.max_records = val;
+
+	(void) param_get(common_ctx->params, KEY_SYNC_MAX_USEC, &val);
+	common_ctx->sync.max_usec = val;
+
+	(void) param_get(common_ctx->params, KEY_CONN_BUF_SIZE, &val);
+	common_ctx->conn_buf_size = val;
+
+	if (_init_debug_filter(res, common_ctx) < 0)
+		goto fail;
+
+	if (param_get(common_ctx->params, KEY_SCAN_MEMO, &val) == 0 && val) {
+		if (!(common_ctx->scan_memo.ht = hash_create(SCAN_MEMO_MAX_ENTRIES)) ||
+		    !(common_ctx->scan_memo.dep_ht = hash_create(SCAN_MEMO_MAX_DEPS))) {
+			log_error(ID(res), "Failed to create hash table for memoized scan results.");
+			goto fail;
+		}
+
+		common_ctx->scan_memo.enabled = true;
+	}
+
+	if (param_get(common_ctx->params, KEY_KV_VIEW, &val) == 0 && val) {
+		if (sid_kv_view_writer_init(&common_ctx->kv_view.writer, KV_VIEW_INITIAL_SIZE) < 0) {
+			log_error(ID(res), "Failed to create shared key-value store view.");
+			goto fail;
+		}
+
+		common_ctx->kv_view.enabled = true;
+
+		if (_update_kv_view(common_ctx) < 0)
+			goto fail;
+	}
+
+	if (param_get(common_ctx->params, KEY_WORKER_ACCEPT, &val) == 0 && val) {
+		/* shared with all workers, they bump it whenever they send KV store export to main process */
+		if ((common_ctx->worker_accept.sync_gen = mmap(NULL,
+		                                               sizeof(*common_ctx->worker_accept.sync_gen),
+		                                               PROT_READ | PROT_WRITE,
+		                                               MAP_SHARED | MAP_ANONYMOUS,
+		                                               -1,
+		                                               0)) == MAP_FAILED) {
+			common_ctx->worker_accept.sync_gen = NULL;
+			log_sys_error(ID(res), "mmap", "worker accept generation");
+			goto fail;
+		}
+
+		common_ctx->worker_accept.enabled = true;
+	}
 
 	struct worker_control_resource_params worker_control_res_params = {
 		.worker_type = WORKER_TYPE_INTERNAL,
@@ -5863,21 +10104,58 @@ static int _init_ubridge(sid_resource_t *res, const void *kickstart_data, void *
 	}
 
 	if (sid_resource_create_io_event_source(res,
-	                                        NULL,
+	                                        &ubridge->interface_es,
 	                                        ubridge->socket_fd,
 	                                        _on_ubridge_interface_event,
-	                                        0,
+	                                        SID_RESOURCE_EVENT_PRIO_ADMISSION,
 	                                        sid_resource_type_ubridge.name,
 	                                        res) < 0) {
 		log_error(ID(res), "Failed to register interface with event loop.");
 		goto fail;
 	}
 
+	if (common_ctx->worker_accept.enabled) {
+		/* Workers accept client connections, main process only takes over if that fails. */
+		sid_resource_set_event_source_counter(ubridge->interface_es, SID_RESOURCE_POS_REL, 0);
+
+		if (sid_resource_create_deferred_event_source(res,
+		                                              &common_ctx->worker_accept.es,
+		                                              _on_worker_accept_event,
+		                                              SID_RESOURCE_EVENT_PRIO_ADMISSION,
+		                                              "worker accept",
+		                                              res) < 0 ||
+		    sid_resource_create_time_event_source(res,
+		                                          &common_ctx->worker_accept.timer_es,
+		                                          CLOCK_MONOTONIC,
+		                                          SID_RESOURCE_POS_REL,
+		                                          WORKER_ACCEPT_CHECK_USEC,
+		                                          0,
+		                                          _on_worker_accept_check_event,
+		                                          0,
+		                                          "worker accept check",
+		                                          res) < 0) {
+			log_error(ID(res), "Failed to set up accepting client connections in workers.");
+			goto fail;
+		}
+	}
+
 	if (_set_up_udev_monitor(res, &ubridge->umonitor) < 0) {
 		log_error(ID(res), "Failed to set up udev monitor.");
 		goto fail;
 	}
 
+	if (common_ctx->spec_scan.enabled &&
+	    (_set_up_udev_kernel_monitor(res, &ubridge->umonitor) < 0 ||
+	     sid_resource_create_deferred_event_source(res,
+	                                               &common_ctx->spec_scan.es,
+	                                               _on_spec_scan_dispatch_event,
+	                                               SID_RESOURCE_EVENT_PRIO_ADMISSION,
+	                                               "speculative scan dispatch",
+	                                               res) < 0)) {
+		log_error(ID(res), "Failed to set up speculative scanning.");
+		goto fail;
+	}
+
 	/*
 	sid_resource_create_time_event_source(res,
 	                                      NULL,
@@ -5897,6 +10175,9 @@ static int _init_ubridge(sid_resource_t *res, const void *kickstart_data, void *
 	 */
 	(void) sid_util_kernel_cmdline_get_arg("root", NULL, NULL);
 
+	/* from now on, only hot-reloadable parameters can be changed */
+	param_registry_set_running(common_ctx->params);
+
 	*data = ubridge;
 	return 0;
 fail:
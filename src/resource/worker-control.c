@@ -28,6 +28,7 @@
 
 #include <dirent.h>
 #include <limits.h>
+#include <poll.h>
 #include <sys/prctl.h>
 #include <unistd.h>
 
@@ -351,9 +352,16 @@ static int _make_worker_exit(sid_resource_t *worker_proxy_res)
 static const char _unexpected_internal_command_msg[]    = "unexpected internal command received.";
 static const char _custom_message_handling_failed_msg[] = "Custom message handling failed.";
 
-static int _on_worker_proxy_channel_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
+/*
+ * Returns:
+ *   < 0 error
+ *     0 expecting more data
+ *     1 MSG processed
+ *     2 EOF
+ *     3 MSG processed + EOF
+ */
+static int _worker_proxy_channel_recv(struct worker_channel *chan, uint32_t revents)
 {
-	struct worker_channel  *chan = data;
 	worker_channel_cmd_t    chan_cmd;
 	struct worker_data_spec data_spec = {0};
 	/*uint64_t timeout_usec;*/
@@ -401,6 +409,16 @@ static int _on_worker_proxy_channel_event(sid_resource_event_source_t *es, int f
 		sid_buffer_reset(chan->in_buf);
 	}
 
+	return r;
+}
+
+static int _on_worker_proxy_channel_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
+{
+	int r;
+
+	if ((r = _worker_proxy_channel_recv(data, revents)) < 0)
+		return r;
+
 	if (r & CHAN_BUF_RECV_EOF)
 		sid_resource_destroy_event_source(&es);
 
@@ -607,11 +625,16 @@ static int
 	}
 
 	if (owner) {
+		/*
+		 * On proxy side, channels carry results of the work already in progress
+		 * in workers, so let them take precedence over accepting new work.
+		 */
 		if (sid_resource_create_io_event_source(owner,
 		                                        NULL,
 		                                        chan->fd,
 		                                        is_worker ? _on_worker_channel_event : _on_worker_proxy_channel_event,
-		                                        0,
+		                                        is_worker ? SID_RESOURCE_EVENT_PRIO_NORMAL
+		                                                  : SID_RESOURCE_EVENT_PRIO_COMPLETION,
 		                                        chan->spec->id,
 		                                        chan) < 0) {
 			log_error(id, "Failed to register communication channel with ID %s.", chan->spec->id);
@@ -1088,6 +1111,59 @@ sid_resource_t *worker_control_find_worker(sid_resource_t *worker_control_res, c
 	return sid_resource_search(worker_control_res, SID_RESOURCE_SEARCH_IMM_DESC, &sid_resource_type_worker_proxy, id);
 }
 
+/*
+ * Process messages which workers have already sent to their proxies, but which
+ * are still waiting in the channels for the event loop to dispatch them. This is
+ * used to make sure that anything a worker sent before a new event got noticed
+ * is handled before that new event, regardless of event loop dispatch order.
+ */
+int worker_control_recv_pending(sid_resource_t *worker_control_res)
+{
+	sid_resource_iter_t   *iter;
+	sid_resource_t        *res;
+	struct worker_proxy   *worker_proxy;
+	struct worker_channel *chan;
+	struct pollfd          pfd;
+	unsigned               i;
+	int                    r;
+
+	if (!(iter = sid_resource_iter_create(worker_control_res)))
+		return -ENOMEM;
+
+	while ((res = sid_resource_iter_next(iter))) {
+		if (!sid_resource_match(res, &sid_resource_type_worker_proxy, NULL))
+			continue;
+
+		worker_proxy = sid_resource_get_data(res);
+
+		if (worker_proxy->state == WORKER_STATE_EXITED)
+			continue;
+
+		for (i = 0; i < worker_proxy->channel_count; i++) {
+			chan = &worker_proxy->channels[i];
+
+			if (!chan->in_buf || chan->fd < 0)
+				continue;
+
+			/*
+			 * Stop at EOF or error and leave that for the channel's event source,
+			 * it is still signalled and it is the one to clean up the channel.
+			 */
+			do {
+				pfd = (struct pollfd) {.fd = chan->fd, .events = POLLIN | POLLRDHUP};
+
+				if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+					break;
+
+				r = _worker_proxy_channel_recv(chan, pfd.revents);
+			} while (r >= 0 && !(r & CHAN_BUF_RECV_EOF));
+		}
+	}
+
+	sid_resource_iter_destroy(iter);
+	return 0;
+}
+
 bool worker_control_is_worker(sid_resource_t *res)
 {
 	// TODO: detect external worker
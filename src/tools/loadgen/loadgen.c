@@ -0,0 +1,701 @@
+/*
+ * This file is part of SID.
+ *
+ * Copyright (C) 2024 Red Hat, Inc. All rights reserved.
+ *
+ * SID is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * SID is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with SID.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "base/buffer.h"
+#include "iface/iface_internal.h"
+#include "internal/formatter.h"
+#include "log/log.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysmacros.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_PREFIX                  "loadgen"
+
+#define LOADGEN_DEFAULT_CONNECTIONS 8
+#define LOADGEN_DEFAULT_RATE        100
+#define LOADGEN_DEFAULT_DURATION    10
+#define LOADGEN_DEFAULT_MIX         "version,dbstats,devices,resources,dbdump"
+#define LOADGEN_MAX_CONNECTIONS     1024
+#define LOADGEN_MAX_REQUESTS        (UINT64_C(1) << 24)
+#define LOADGEN_MAX_WEIGHT          1000
+#define LOADGEN_SEQNUM_SIZE         32
+
+#define NSEC_PER_SEC                UINT64_C(1000000000)
+#define NSEC_PER_USEC               UINT64_C(1000)
+#define NSEC_PER_MSEC               UINT64_C(1000000)
+
+#define SYSFS_DEV_BLOCK_PATH        "/sys/dev/block"
+#define SYSFS_PATH                  "/sys"
+#define SYSFS_UEVENT                "uevent"
+
+#define KEY_LOADGEN                 "SID_LOADGEN"
+#define KEY_COMMANDS                "COMMANDS"
+#define KEY_COMMAND                 "COMMAND"
+#define KEY_CONNECTIONS             "CONNECTIONS"
+#define KEY_RATE                    "RATE"
+#define KEY_DURATION_MSEC           "DURATION_MSEC"
+#define KEY_REQUESTS                "REQUESTS"
+#define KEY_COMPLETED               "COMPLETED"
+#define KEY_ERRORS                  "ERRORS"
+#define KEY_THROUGHPUT              "THROUGHPUT"
+#define KEY_LATENCY_P50_USEC        "LATENCY_P50_USEC"
+#define KEY_LATENCY_P90_USEC        "LATENCY_P90_USEC"
+#define KEY_LATENCY_P99_USEC        "LATENCY_P99_USEC"
+#define KEY_LATENCY_P999_USEC       "LATENCY_P999_USEC"
+#define KEY_LATENCY_MAX_USEC        "LATENCY_MAX_USEC"
+
+/* commands that can be part of the mix */
+static const sid_cmd_t _mix_cmds[] =
+	{SID_CMD_VERSION, SID_CMD_DBDUMP, SID_CMD_DBSTATS, SID_CMD_RESOURCES, SID_CMD_DEVICES, SID_CMD_SCAN};
+
+struct loadgen_req {
+	sid_cmd_t cmd;
+	int       r;
+	uint64_t  latency_nsec;
+};
+
+struct loadgen {
+	unsigned            connections;
+	uint64_t            rate;
+	uint64_t            duration;
+	unsigned            weights[_SID_CMD_END + 1];
+	sid_cmd_t          *slots; /* each command repeated by its weight */
+	unsigned            nr_slots;
+	char               *scan_env; /* devno and udev environment without SEQNUM */
+	size_t              scan_env_size;
+	struct loadgen_req *reqs;
+	uint64_t            nr_reqs;
+	uint64_t            next_req;
+	struct timespec     start;
+	uint64_t            elapsed_nsec;
+};
+
+struct loadgen_stats {
+	uint64_t requests;
+	uint64_t completed;
+	uint64_t errors;
+	uint64_t latency_usec[5]; /* p50, p90, p99, p99.9, max */
+};
+
+static void _help(FILE *f)
+{
+	fprintf(f,
+	        "Usage: sid-loadgen [-h|--help] [-v|--verbose] [-V|--version] [-f|--format env|json|table]\n"
+	        "                   [-c|--connections <n>] [-r|--rate <n>] [-d|--duration <sec>] [-m|--mix <cmd>[=<weight>],...]\n"
+	        "                   [-D|--scan-device <major>:<minor>] [-s|--socket <path>]\n"
+	        "\n"
+	        "Generate concurrent command load for the SID daemon.\n"
+	        "\n"
+	        "Requests are issued at a constant rate, independently of how fast SID replies (open loop).\n"
+	        "The latency of each request is measured from the time it was scheduled to be sent, so any\n"
+	        "time spent waiting for a free connection is included.\n"
+	        "\n"
+	        "Options:\n"
+	        "    -c|--connections <n>              Maximum number of concurrent connections (default %u).\n"
+	        "    -r|--rate <n>                     Requests per second in total (default %u).\n"
+	        "    -d|--duration <sec>               Duration of the run in seconds (default %u).\n"
+	        "    -m|--mix <cmd>[=<weight>],...     Commands to send and their relative weights\n"
+	        "                                      (default %s).\n"
+	        "                                      Available commands: version, dbdump, dbstats, resources,\n"
+	        "                                      devices and scan.\n"
+	        "    -D|--scan-device <major>:<minor>  Block device to use for scan requests (required for scan).\n"
+	        "    -s|--socket <path>                Connect to SID at given socket path, '@' prefix stands for\n"
+	        "                                      abstract socket.\n"
+	        "    -f|--format env|json|table        Show the output in specified format.\n"
+	        "    -h|--help                         Show this help information.\n"
+	        "    -v|--verbose                      Verbose mode, repeat to increase level.\n"
+	        "    -V|--version                      Show SID-LOADGEN version.\n"
+	        "\n",
+	        LOADGEN_DEFAULT_CONNECTIONS,
+	        LOADGEN_DEFAULT_RATE,
+	        LOADGEN_DEFAULT_DURATION,
+	        LOADGEN_DEFAULT_MIX);
+}
+
+static void _version(FILE *f)
+{
+	fprintf(f, PACKAGE_STRING "\n");
+	fprintf(f, "Configuration line: %s\n", SID_CONFIGURE_LINE);
+	fprintf(f, "Compiled by: %s on %s with %s\n", SID_COMPILED_BY, SID_COMPILATION_HOST, SID_COMPILER);
+}
+
+static int _get_format(char *format)
+{
+	if (format == NULL)
+		return -1;
+	if (!strcasecmp(format, "json"))
+		return JSON;
+	if (!strcasecmp(format, "env"))
+		return ENV;
+	if (!strcasecmp(format, "table"))
+		return TABLE;
+	return -1;
+}
+
+static int _get_ull(const char *str, unsigned long long min, unsigned long long max, unsigned long long *val)
+{
+	char *p;
+
+	errno = 0;
+	*val  = strtoull(str, &p, 10);
+
+	if (errno || p == str || *p || *val < min || *val > max)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int _parse_mix(struct loadgen *lg, const char *mix)
+{
+	char              *str, *item, *saveptr, *eq;
+	unsigned long long weight;
+	sid_cmd_t          cmd;
+	unsigned           i, j;
+	int                r = 0;
+
+	if (!(str = strdup(mix)))
+		return -ENOMEM;
+
+	memset(lg->weights, 0, sizeof(lg->weights));
+
+	for (item = strtok_r(str, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+		weight = 1;
+
+		if ((eq = strchr(item, '='))) {
+			*eq = '\0';
+			if (_get_ull(eq + 1, 0, LOADGEN_MAX_WEIGHT, &weight) < 0) {
+				log_error(LOG_PREFIX, "Incorrect weight for command %s.", item);
+				r = -EINVAL;
+				goto out;
+			}
+		}
+
+		cmd = sid_cmd_name_to_type(item);
+		for (i = 0; i < sizeof(_mix_cmds) / sizeof(_mix_cmds[0]); i++)
+			if (_mix_cmds[i] == cmd)
+				break;
+
+		if (i == sizeof(_mix_cmds) / sizeof(_mix_cmds[0])) {
+			log_error(LOG_PREFIX, "Command %s can not be part of the mix.", item);
+			r = -EINVAL;
+			goto out;
+		}
+
+		lg->weights[cmd] = weight;
+	}
+
+	for (cmd = 0, lg->nr_slots = 0; cmd <= _SID_CMD_END; cmd++)
+		lg->nr_slots += lg->weights[cmd];
+
+	if (!lg->nr_slots) {
+		log_error(LOG_PREFIX, "No command in the mix.");
+		r = -EINVAL;
+		goto out;
+	}
+
+	if (!(lg->slots = malloc(lg->nr_slots * sizeof(*lg->slots)))) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	for (cmd = 0, i = 0; cmd <= _SID_CMD_END; cmd++)
+		for (j = 0; j < lg->weights[cmd]; j++)
+			lg->slots[i++] = cmd;
+out:
+	free(str);
+	return r;
+}
+
+/*
+ * Prepare the scan request data the same way usid would get them from udev:
+ *
+ *   devno key1=value1\0key2=value2\0...
+ *
+ * The SEQNUM is added separately for each request.
+ */
+static int _prepare_scan_env(struct loadgen *lg, const char *device)
+{
+	char               devpath[PATH_MAX], path[PATH_MAX + sizeof(SYSFS_UEVENT)];
+	unsigned           major, minor;
+	struct sid_buffer *buf = NULL;
+	const void        *data;
+	char              *line      = NULL;
+	size_t             line_size = 0, size;
+	dev_t              devno;
+	FILE              *f = NULL;
+	char               c;
+	int                r;
+
+	if (sscanf(device, "%u:%u%c", &major, &minor, &c) != 2) {
+		log_error(LOG_PREFIX, "Incorrect device number, expected <major>:<minor>.");
+		return -EINVAL;
+	}
+
+	snprintf(path, sizeof(path), SYSFS_DEV_BLOCK_PATH "/%u:%u", major, minor);
+	if (!realpath(path, devpath)) {
+		r = -errno;
+		log_error_errno(LOG_PREFIX, r, "Failed to find device %u:%u", major, minor);
+		return r;
+	}
+
+	if (!(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                          .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                          .mode    = SID_BUFFER_MODE_PLAIN}),
+	                              &((struct sid_buffer_init) {.size = 0, .alloc_step = 1, .limit = 0}),
+	                              &r)))
+		return r;
+
+	devno = makedev(major, minor);
+	if ((r = sid_buffer_add(buf, &devno, sizeof(devno), NULL, NULL)) < 0 ||
+	    (r = sid_buffer_fmt_add(buf, NULL, NULL, "ACTION=change")) < 0 ||
+	    (r = sid_buffer_fmt_add(buf, NULL, NULL, "SUBSYSTEM=block")) < 0 ||
+	    (r = sid_buffer_fmt_add(buf, NULL, NULL, "DEVPATH=%s", devpath + sizeof(SYSFS_PATH) - 1)) < 0)
+		goto out;
+
+	/* uevent file has MAJOR, MINOR, DEVNAME, DEVTYPE and the rest of device properties */
+	snprintf(path, sizeof(path), "%s/" SYSFS_UEVENT, devpath);
+	if (!(f = fopen(path, "r"))) {
+		r = -errno;
+		log_error_errno(LOG_PREFIX, r, "Failed to open %s", path);
+		goto out;
+	}
+
+	while (getline(&line, &line_size, f) > 0) {
+		line[strcspn(line, "\n")] = '\0';
+		if (*line && (r = sid_buffer_fmt_add(buf, NULL, NULL, "%s", line)) < 0)
+			goto out;
+	}
+
+	if ((r = sid_buffer_get_data(buf, &data, &size)) < 0)
+		goto out;
+
+	if (!(lg->scan_env = malloc(size))) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	memcpy(lg->scan_env, data, size);
+	lg->scan_env_size = size;
+	r                 = 0;
+out:
+	if (f)
+		fclose(f);
+	free(line);
+	sid_buffer_destroy(buf);
+	return r;
+}
+
+/* splitmix64 finalizer, spreads the commands in the mix evenly but not periodically */
+static uint64_t _mix_hash(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+	return x ^ (x >> 31);
+}
+
+static uint64_t _timespec_diff_nsec(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * NSEC_PER_SEC + end->tv_nsec - start->tv_nsec;
+}
+
+static int _do_req(struct loadgen *lg, sid_cmd_t cmd, uint64_t seqnum, char *scan_buf)
+{
+	struct sid_request req = {.cmd = cmd, .seqnum = seqnum};
+	struct sid_result *res;
+	uint64_t           status;
+	int                r;
+
+	if (cmd == SID_CMD_SCAN) {
+		memcpy(scan_buf, lg->scan_env, lg->scan_env_size);
+		req.flags                = SID_CMD_FLAGS_UNMODIFIED_DATA;
+		req.data.unmodified.mem  = scan_buf;
+		req.data.unmodified.size = lg->scan_env_size + 1 +
+		                           snprintf(scan_buf + lg->scan_env_size, LOADGEN_SEQNUM_SIZE, "SEQNUM=%" PRIu64, seqnum);
+	}
+
+	if ((r = sid_req(&req, &res)) < 0)
+		return r;
+
+	if (sid_result_status(res, &status) < 0 || (status & SID_CMD_STATUS_FAILURE))
+		r = -EREMOTEIO;
+
+	sid_result_free(res);
+	return r;
+}
+
+static void *_connection_fn(void *arg)
+{
+	struct loadgen     *lg       = arg;
+	char               *scan_buf = NULL;
+	struct loadgen_req *req;
+	struct timespec     due, end;
+	uint64_t            i, offset;
+
+	if (lg->scan_env && !(scan_buf = malloc(lg->scan_env_size + LOADGEN_SEQNUM_SIZE)))
+		return NULL;
+
+	while ((i = __atomic_fetch_add(&lg->next_req, 1, __ATOMIC_RELAXED)) < lg->nr_reqs) {
+		req         = &lg->reqs[i];
+
+		/* the time the request is due is fixed, no matter how late we are */
+		offset      = i * NSEC_PER_SEC / lg->rate + lg->start.tv_nsec;
+		due.tv_sec  = lg->start.tv_sec + offset / NSEC_PER_SEC;
+		due.tv_nsec = offset % NSEC_PER_SEC;
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+			;
+
+		req->r = _do_req(lg, req->cmd, i + 1, scan_buf);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		req->latency_nsec = _timespec_diff_nsec(&due, &end);
+
+		if (req->r < 0)
+			log_debug(LOG_PREFIX,
+			          "Request %" PRIu64 " (%s) failed: %s.",
+			          i,
+			          sid_cmd_type_to_name(req->cmd),
+			          strerror(-req->r));
+	}
+
+	free(scan_buf);
+	return NULL;
+}
+
+static int _run(struct loadgen *lg)
+{
+	pthread_t      *threads;
+	struct timespec end;
+	unsigned        i, nr_threads;
+	uint64_t        n;
+	int             r = 0;
+
+	lg->nr_reqs = lg->rate * lg->duration;
+	if (lg->nr_reqs > LOADGEN_MAX_REQUESTS) {
+		log_error(LOG_PREFIX, "Too many requests, lower the rate or duration.");
+		return -E2BIG;
+	}
+
+	if (!(lg->reqs = calloc(lg->nr_reqs, sizeof(*lg->reqs))) || !(threads = calloc(lg->connections, sizeof(*threads))))
+		return -ENOMEM;
+
+	for (n = 0; n < lg->nr_reqs; n++)
+		lg->reqs[n].cmd = lg->slots[_mix_hash(n) % lg->nr_slots];
+
+	clock_gettime(CLOCK_MONOTONIC, &lg->start);
+
+	for (nr_threads = 0; nr_threads < lg->connections; nr_threads++) {
+		if ((r = -pthread_create(&threads[nr_threads], NULL, _connection_fn, lg)) < 0) {
+			log_error_errno(LOG_PREFIX, r, "Failed to create connection thread");
+			/* let the running threads finish what is left */
+			break;
+		}
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		(void) pthread_join(threads[i], NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	lg->elapsed_nsec = _timespec_diff_nsec(&lg->start, &end);
+
+	free(threads);
+	return nr_threads ? 0 : r;
+}
+
+static int _u64_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile, 'permille' of sorted values are less or equal */
+static uint64_t _percentile(const uint64_t *sorted, uint64_t count, unsigned permille)
+{
+	uint64_t rank;
+
+	if (!count)
+		return 0;
+
+	rank = (count * permille + 999) / 1000;
+	return sorted[rank ? rank - 1 : 0];
+}
+
+static int _get_stats(struct loadgen *lg, sid_cmd_t cmd, struct loadgen_stats *stats)
+{
+	uint64_t *latencies;
+	uint64_t  i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	if (!(latencies = malloc((lg->nr_reqs ?: 1) * sizeof(*latencies))))
+		return -ENOMEM;
+
+	for (i = 0; i < lg->nr_reqs; i++) {
+		if (cmd != SID_CMD_UNDEFINED && lg->reqs[i].cmd != cmd)
+			continue;
+
+		stats->requests++;
+		if (lg->reqs[i].r < 0)
+			stats->errors++;
+		else
+			latencies[stats->completed++] = lg->reqs[i].latency_nsec / NSEC_PER_USEC;
+	}
+
+	qsort(latencies, stats->completed, sizeof(*latencies), _u64_cmp);
+
+	stats->latency_usec[0] = _percentile(latencies, stats->completed, 500);
+	stats->latency_usec[1] = _percentile(latencies, stats->completed, 900);
+	stats->latency_usec[2] = _percentile(latencies, stats->completed, 990);
+	stats->latency_usec[3] = _percentile(latencies, stats->completed, 999);
+	stats->latency_usec[4] = _percentile(latencies, stats->completed, 1000);
+
+	free(latencies);
+	return 0;
+}
+
+static void _print_stats(output_format_t       format,
+                         struct sid_buffer    *buf,
+                         int                   level,
+                         const char           *prefix,
+                         struct loadgen       *lg,
+                         struct loadgen_stats *stats)
+{
+	static const char * const latency_keys[] =
+		{KEY_LATENCY_P50_USEC, KEY_LATENCY_P90_USEC, KEY_LATENCY_P99_USEC, KEY_LATENCY_P999_USEC, KEY_LATENCY_MAX_USEC};
+	char     key[64];
+	uint64_t elapsed_msec = lg->elapsed_nsec / NSEC_PER_MSEC ?: 1;
+	unsigned i;
+
+#define PRINT_FIELD(name, value)                                                                                                   \
+	do {                                                                                                                       \
+		snprintf(key, sizeof(key), "%s%s", prefix, name);                                                                  \
+		print_uint64_field(format, buf, level, key, value, true);                                                          \
+	} while (0)
+
+	PRINT_FIELD(KEY_REQUESTS, stats->requests);
+	PRINT_FIELD(KEY_COMPLETED, stats->completed);
+	PRINT_FIELD(KEY_ERRORS, stats->errors);
+	PRINT_FIELD(KEY_THROUGHPUT, stats->completed * 1000 / elapsed_msec);
+
+	for (i = 0; i < sizeof(latency_keys) / sizeof(latency_keys[0]); i++)
+		PRINT_FIELD(latency_keys[i], stats->latency_usec[i]);
+
+#undef PRINT_FIELD
+}
+
+static int _report(struct loadgen *lg, output_format_t format)
+{
+	struct sid_buffer   *buf;
+	struct loadgen_stats stats;
+	char                 prefix[32];
+	const char          *name;
+	sid_cmd_t            cmd;
+	bool                 first = true;
+	int                  r, i;
+
+	if (!(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                          .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                          .mode    = SID_BUFFER_MODE_PLAIN}),
+	                              &((struct sid_buffer_init) {.size = 4096, .alloc_step = 1, .limit = 0}),
+	                              &r)))
+		return r;
+
+	if ((r = _get_stats(lg, SID_CMD_UNDEFINED, &stats)) < 0)
+		goto out;
+
+	print_start_document(format, buf, 0);
+	print_elem_name(format, buf, 0, KEY_LOADGEN, false);
+	print_start_elem(format, buf, 0, false);
+	print_uint_field(format, buf, 1, KEY_CONNECTIONS, lg->connections, false);
+	print_uint64_field(format, buf, 1, KEY_RATE, lg->rate, true);
+	print_uint64_field(format, buf, 1, KEY_DURATION_MSEC, lg->elapsed_nsec / NSEC_PER_MSEC, true);
+	_print_stats(format, buf, 1, "", lg, &stats);
+	print_end_elem(format, buf, 0);
+
+	print_start_array(format, buf, 0, KEY_COMMANDS, true);
+
+	for (cmd = 0; cmd <= _SID_CMD_END; cmd++) {
+		if (!lg->weights[cmd])
+			continue;
+
+		if ((r = _get_stats(lg, cmd, &stats)) < 0)
+			goto out;
+
+		name = sid_cmd_type_to_name(cmd);
+
+		print_start_elem(format, buf, 1, !first);
+
+		/* env format has no structure, prefix the keys with command name to keep them unique */
+		if (format == ENV) {
+			for (i = 0; name[i] && i < (int) sizeof(prefix) - 2; i++)
+				prefix[i] = toupper((unsigned char) name[i]);
+			prefix[i++] = '_';
+			prefix[i]   = '\0';
+		} else {
+			prefix[0] = '\0';
+			print_str_field(format, buf, 2, KEY_COMMAND, name, false);
+		}
+
+		_print_stats(format, buf, 2, prefix, lg, &stats);
+		print_end_elem(format, buf, 1);
+		first = false;
+	}
+
+	print_end_array(format, buf, 0);
+	print_end_document(format, buf, 0);
+
+	if ((r = sid_buffer_write_all(buf, fileno(stdout))) < 0)
+		log_error_errno(LOG_PREFIX, r, "Failed to write output");
+out:
+	sid_buffer_destroy(buf);
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	struct loadgen     lg      = {.connections = LOADGEN_DEFAULT_CONNECTIONS,
+	                              .rate        = LOADGEN_DEFAULT_RATE,
+	                              .duration    = LOADGEN_DEFAULT_DURATION};
+	const char        *mix     = LOADGEN_DEFAULT_MIX;
+	char              *device  = NULL;
+	int                format  = TABLE;
+	int                verbose = 0;
+	unsigned long long val;
+	int                opt;
+	int                r = -1;
+
+	struct option longopts[] = {
+		{"connections", required_argument, NULL, 'c'},
+		{"rate", required_argument, NULL, 'r'},
+		{"duration", required_argument, NULL, 'd'},
+		{"mix", required_argument, NULL, 'm'},
+		{"scan-device", required_argument, NULL, 'D'},
+		{"socket", required_argument, NULL, 's'},
+		{"format", required_argument, NULL, 'f'},
+		{"help", no_argument, NULL, 'h'},
+		{"verbose", no_argument, NULL, 'v'},
+		{"version", no_argument, NULL, 'V'},
+		{NULL, no_argument, NULL, 0},
+	};
+
+	while ((opt = getopt_long(argc, argv, "c:r:d:m:D:s:f:hvV", longopts, NULL)) != EOF) {
+		switch (opt) {
+			case 'c':
+				if (_get_ull(optarg, 1, LOADGEN_MAX_CONNECTIONS, &val) < 0) {
+					_help(stderr);
+					return EXIT_FAILURE;
+				}
+				lg.connections = val;
+				break;
+			case 'r':
+				if (_get_ull(optarg, 1, LOADGEN_MAX_REQUESTS, &val) < 0) {
+					_help(stderr);
+					return EXIT_FAILURE;
+				}
+				lg.rate = val;
+				break;
+			case 'd':
+				if (_get_ull(optarg, 1, LOADGEN_MAX_REQUESTS, &val) < 0) {
+					_help(stderr);
+					return EXIT_FAILURE;
+				}
+				lg.duration = val;
+				break;
+			case 'm':
+				mix = optarg;
+				break;
+			case 'D':
+				device = optarg;
+				break;
+			case 's':
+				if (setenv(SID_KEY_SOCKET, optarg, 1) < 0) {
+					log_error_errno(LOG_PREFIX, errno, "Failed to set socket path");
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'f':
+				if ((format = _get_format(optarg)) < 0) {
+					_help(stderr);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'h':
+				_help(stdout);
+				return EXIT_SUCCESS;
+			case 'v':
+				verbose++;
+				break;
+			case 'V':
+				_version(stdout);
+				return EXIT_SUCCESS;
+			default:
+				_help(stderr);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (optind != argc) {
+		_help(stderr);
+		return EXIT_FAILURE;
+	}
+
+	log_init(LOG_TARGET_STANDARD, verbose);
+
+	/* SID may close the connection any time, do not get killed by that */
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((r = _parse_mix(&lg, mix)) < 0)
+		goto out;
+
+	if (lg.weights[SID_CMD_SCAN]) {
+		if (!device) {
+			log_error(LOG_PREFIX, "Scan requests need a device, use --scan-device.");
+			r = -EINVAL;
+			goto out;
+		}
+
+		if ((r = _prepare_scan_env(&lg, device)) < 0)
+			goto out;
+	}
+
+	if ((r = _run(&lg)) < 0)
+		goto out;
+
+	r = _report(&lg, format);
+out:
+	free(lg.reqs);
+	free(lg.scan_env);
+	free(lg.slots);
+
+	return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
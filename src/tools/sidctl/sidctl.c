@@ -24,6 +24,7 @@
 #include "internal/formatter.h"
 #include "log/log.h"
 
+#include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <stdio.h>
@@ -44,15 +45,14 @@
 #define KEY_SID_MINOR       "SID_MINOR"
 #define KEY_SID_RELEASE     "SID_RELEASE"
 
-static int _sid_cmd(sid_cmd_t cmd, uint16_t format)
+static int _sid_cmd(struct sid_request *req)
 {
 	struct sid_result *res = NULL;
 	const char        *data;
 	size_t             size;
 	int                r;
-	struct sid_request req = {.cmd = cmd, .flags = format};
 
-	if ((r = sid_req(&req, &res)) == 0) {
+	if ((r = sid_req(req, &res)) == 0) {
 		if ((data = sid_result_data(res, &size)) != NULL)
 			printf("%s", data);
 		else {
@@ -95,7 +95,7 @@ static int _sid_cmd_version(uint16_t format)
 	if ((r = sid_buffer_write_all(outbuf, fileno(stdout))) < 0)
 		log_error_errno(LOG_PREFIX, r, "failed to write version information");
 	sid_buffer_reset(outbuf);
-	if (_sid_cmd(SID_CMD_VERSION, format) < 0) {
+	if (_sid_cmd(&((struct sid_request) {.cmd = SID_CMD_VERSION, .flags = format})) < 0) {
 		print_start_document(format, outbuf, 0);
 		print_end_document(format, outbuf, 0);
 	} else
@@ -111,7 +111,8 @@ static int _sid_cmd_version(uint16_t format)
 static void _help(FILE *f)
 {
 	fprintf(f,
-	        "Usage: sidctl [-h|--help] [-v|--verbose] [-V|--version] [-f|--format json] [command]\n"
+	        "Usage: sidctl [-h|--help] [-v|--verbose] [-V|--version] [-f|--format json] [-d|--depth <n>] [-t|--type <name>]\n"
+	        "              [command] [argument...]\n"
 	        "\n"
 	        "Control and Query the SID daemon.\n"
 	        "\n"
@@ -120,6 +121,8 @@ static void _help(FILE *f)
 	        "    -h|--help                   Show this help information.\n"
 	        "    -v|--verbose                Verbose mode, repeat to increase level.\n"
 	        "    -V|--version                Show SIDCTL version.\n"
+	        "    -d|--depth <n>              Show resources only up to depth n (resources).\n"
+	        "    -t|--type <name>            Show resources of given type only (resources).\n"
 	        "\n"
 	        "Commands and arguments:\n"
 	        "\n"
@@ -146,8 +149,20 @@ static void _help(FILE *f)
 	        "\n"
 	        "    resources\n"
 	        "      Show current SID resource tree.\n"
-	        "      Input:  None.\n"
+	        "      Input:  Optional depth limit and resource type (-d and -t options).\n"
 	        "      Output: Resource tree.\n"
+	        "\n"
+	        "    get [<name>...]\n"
+	        "      Show runtime tuning parameters.\n"
+	        "      Input:  Optional list of parameter names (all parameters if none).\n"
+	        "      Output: Parameter values, defaults, ranges and whether they can be changed at runtime.\n"
+	        "\n"
+	        "    set <name>=<value>...\n"
+	        "      Change runtime tuning parameters, either all of them or none.\n"
+	        "      DEBUG_DEVNO, DEBUG_NAME, DEBUG_MODULE and DEBUG_CMD select commands to log debug messages for\n"
+	        "      (e.g. 'sidctl set DEBUG_NAME=sda DEBUG_CMD=scan', empty value unsets the filter).\n"
+	        "      Input:  List of parameter names and their new values.\n"
+	        "      Output: Changed parameters.\n"
 	        "\n");
 }
 
@@ -173,21 +188,26 @@ static int _get_format(char *format)
 
 int main(int argc, char *argv[])
 {
-	int       opt;
-	int       verbose = 0;
-	int       r       = -1;
-	int       format  = SID_CMD_FLAGS_FMT_TABLE;
-	sid_cmd_t cmd;
+	int                       opt;
+	int                       verbose   = 0;
+	int                       r         = -1;
+	int                       format    = SID_CMD_FLAGS_FMT_TABLE;
+	struct sid_resources_data resources = {0};
+	char                     *p;
+	sid_cmd_t                 cmd;
+	int                       nr_args;
 
 	struct option longopts[] = {
 		{"format", required_argument, NULL, 'f'},
+		{"depth", required_argument, NULL, 'd'},
+		{"type", required_argument, NULL, 't'},
 		{"help", no_argument, NULL, 'h'},
 		{"verbose", no_argument, NULL, 'v'},
 		{"version", no_argument, NULL, 'V'},
 		{NULL, no_argument, NULL, 0},
 	};
 
-	while ((opt = getopt_long(argc, argv, "f:hvV", longopts, NULL)) != EOF) {
+	while ((opt = getopt_long(argc, argv, "f:d:t:hvV", longopts, NULL)) != EOF) {
 		switch (opt) {
 			case 'h':
 				_help(stdout);
@@ -198,6 +218,17 @@ int main(int argc, char *argv[])
 					return EXIT_FAILURE;
 				}
 				break;
+			case 'd':
+				errno               = 0;
+				resources.max_depth = strtoul(optarg, &p, 10);
+				if (errno || p == optarg || *p || !resources.max_depth) {
+					_help(stderr);
+					return EXIT_FAILURE;
+				}
+				break;
+			case 't':
+				resources.type = optarg;
+				break;
 			case 'v':
 				verbose++;
 				break;
@@ -210,22 +241,39 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (optind != argc - 1) {
+	if (optind >= argc) {
+		_help(stderr);
+		return EXIT_FAILURE;
+	}
+
+	cmd     = sid_cmd_name_to_type(argv[optind]);
+	nr_args = argc - optind - 1;
+
+	/* only parameter commands take arguments, set requires at least one */
+	if ((nr_args && cmd != SID_CMD_PARAM_GET && cmd != SID_CMD_PARAM_SET) || (!nr_args && cmd == SID_CMD_PARAM_SET)) {
 		_help(stderr);
 		return EXIT_FAILURE;
 	}
 
 	log_init(LOG_TARGET_STANDARD, verbose);
 
-	switch ((cmd = sid_cmd_name_to_type(argv[optind]))) {
+	switch (cmd) {
 		case SID_CMD_VERSION:
 			r = _sid_cmd_version(format);
 			break;
 		case SID_CMD_DBDUMP:
 		case SID_CMD_DBSTATS:
-		case SID_CMD_RESOURCES:
 		case SID_CMD_DEVICES:
-			r = _sid_cmd(cmd, format);
+			r = _sid_cmd(&((struct sid_request) {.cmd = cmd, .flags = format}));
+			break;
+		case SID_CMD_RESOURCES:
+			r = _sid_cmd(&((struct sid_request) {.cmd = cmd, .flags = format, .data.resources = resources}));
+			break;
+		case SID_CMD_PARAM_GET:
+		case SID_CMD_PARAM_SET:
+			r = _sid_cmd(&((struct sid_request) {.cmd         = cmd,
+			                                     .flags       = format,
+			                                     .data.params = {.params = argv + optind + 1, .nr_params = nr_args}}));
 			break;
 		default:
 			_help(stderr);
@@ -0,0 +1,158 @@
+#include "bench.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+	const char *name;
+	uint32_t    type;
+	uint64_t    config;
+} _counters[] = {
+	[BENCH_COUNTER_INSTRUCTIONS]  = {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	[BENCH_COUNTER_CYCLES]        = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	[BENCH_COUNTER_CACHE_MISSES]  = {"cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	[BENCH_COUNTER_BRANCH_MISSES] = {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	[BENCH_COUNTER_TASK_CLOCK]    = {"task_clock_nsec", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+static int _counter_open(bench_counter_t counter)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size           = sizeof(attr);
+	attr.type           = _counters[counter].type;
+	attr.config         = _counters[counter].config;
+	attr.disabled       = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv     = 1;
+	attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+}
+
+/* Counters are multiplexed if there are not enough of them, scale the count up then. */
+static int _counter_read(int fd, uint64_t *value)
+{
+	struct {
+		uint64_t value;
+		uint64_t time_enabled;
+		uint64_t time_running;
+	} data;
+
+	if (read(fd, &data, sizeof(data)) != sizeof(data))
+		return -1;
+
+	if (data.time_running && data.time_running < data.time_enabled)
+		*value = (uint64_t) ((double) data.value * data.time_enabled / data.time_running);
+	else
+		*value = data.value;
+
+	return 0;
+}
+
+void bench_init(struct bench *bench, const char *name)
+{
+	bench_counter_t counter;
+
+	memset(bench, 0, sizeof(*bench));
+	snprintf(bench->name, sizeof(bench->name), "%s", name);
+
+	for (counter = 0; counter < _BENCH_COUNTER_COUNT; counter++)
+		bench->fds[counter] = _counter_open(counter);
+}
+
+void bench_destroy(struct bench *bench)
+{
+	bench_counter_t counter;
+
+	for (counter = 0; counter < _BENCH_COUNTER_COUNT; counter++) {
+		if (bench->fds[counter] >= 0) {
+			(void) close(bench->fds[counter]);
+			bench->fds[counter] = -1;
+		}
+	}
+}
+
+void bench_start(struct bench *bench)
+{
+	bench_counter_t counter;
+
+	for (counter = 0; counter < _BENCH_COUNTER_COUNT; counter++) {
+		if (bench->fds[counter] >= 0) {
+			(void) ioctl(bench->fds[counter], PERF_EVENT_IOC_RESET, 0);
+			(void) ioctl(bench->fds[counter], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &bench->start);
+}
+
+void bench_stop(struct bench *bench, uint64_t ops)
+{
+	struct timespec end;
+	bench_counter_t counter;
+	uint64_t        value;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	for (counter = 0; counter < _BENCH_COUNTER_COUNT; counter++) {
+		if (bench->fds[counter] < 0)
+			continue;
+
+		(void) ioctl(bench->fds[counter], PERF_EVENT_IOC_DISABLE, 0);
+
+		if (_counter_read(bench->fds[counter], &value) < 0) {
+			(void) close(bench->fds[counter]);
+			bench->fds[counter] = -1;
+			continue;
+		}
+
+		bench->values[counter] += value;
+	}
+
+	bench->nsec += (end.tv_sec - bench->start.tv_sec) * UINT64_C(1000000000) + end.tv_nsec - bench->start.tv_nsec;
+	bench->ops  += ops;
+}
+
+bool bench_counter_available(const struct bench *bench, bench_counter_t counter)
+{
+	return bench->fds[counter] >= 0;
+}
+
+int bench_report(const struct bench *bench)
+{
+	const char     *path;
+	FILE           *f;
+	bench_counter_t counter;
+	int             r = 0;
+
+	if (!(path = getenv(BENCH_KEY_JSON)) || !*path)
+		return 0;
+
+	if (!(f = fopen(path, "a")))
+		return -errno;
+
+	fprintf(f, "{\"name\": \"%s\", \"ops\": %" PRIu64 ", \"nsec\": %" PRIu64, bench->name, bench->ops, bench->nsec);
+
+	for (counter = 0; counter < _BENCH_COUNTER_COUNT; counter++) {
+		if (bench_counter_available(bench, counter))
+			fprintf(f, ", \"%s\": %" PRIu64, _counters[counter].name, bench->values[counter]);
+		else
+			fprintf(f, ", \"%s\": null", _counters[counter].name);
+	}
+
+	fprintf(f, "}\n");
+
+	if (fclose(f))
+		r = -errno;
+
+	return r;
+}
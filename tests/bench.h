@@ -0,0 +1,50 @@
+#ifndef _SID_TESTS_BENCH_H
+#define _SID_TESTS_BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Benchmark measurements with hardware performance counters.
+ *
+ * Counters are opened for the calling thread only and they count user space
+ * only. Any counter which is not available, e.g. because perf_event_paranoid
+ * forbids it or because there's no PMU in a virtual machine, is left out and
+ * the measurement continues with the rest, wall-clock time is always measured.
+ *
+ * If SID_BENCH_JSON environment variable is set, bench_report appends one JSON
+ * object per benchmark, on a separate line, to the file it points to.
+ */
+
+#define BENCH_NAME_SIZE 64
+#define BENCH_KEY_JSON  "SID_BENCH_JSON"
+
+typedef enum {
+	BENCH_COUNTER_INSTRUCTIONS,
+	BENCH_COUNTER_CYCLES,
+	BENCH_COUNTER_CACHE_MISSES,
+	BENCH_COUNTER_BRANCH_MISSES,
+	BENCH_COUNTER_TASK_CLOCK, /* software counter, CPU time in ns */
+	_BENCH_COUNTER_COUNT,
+} bench_counter_t;
+
+struct bench {
+	char            name[BENCH_NAME_SIZE];
+	int             fds[_BENCH_COUNTER_COUNT];    /* -1 if counter is not available */
+	uint64_t        values[_BENCH_COUNTER_COUNT]; /* counts accumulated over all measured regions */
+	uint64_t        ops;                          /* operations done in all measured regions */
+	uint64_t        nsec;                         /* wall-clock time spent in all measured regions */
+	struct timespec start;
+};
+
+void bench_init(struct bench *bench, const char *name);
+void bench_destroy(struct bench *bench);
+
+void bench_start(struct bench *bench);
+void bench_stop(struct bench *bench, uint64_t ops);
+
+bool bench_counter_available(const struct bench *bench, bench_counter_t counter);
+int  bench_report(const struct bench *bench);
+
+#endif
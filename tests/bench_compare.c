@@ -0,0 +1,542 @@
+#include "bench_compare.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_KEY_NAME       "name"
+#define BENCH_KEY_OPS        "ops"
+#define BENCH_MAX_LINE_ITEMS 32
+
+struct _line_item {
+	char   key[BENCH_METRIC_SIZE];
+	double value;
+	bool   is_null;
+};
+
+struct _ranked {
+	double value;
+	bool   is_a;
+};
+
+static const char *_skip_ws(const char *p)
+{
+	while (isspace((unsigned char) *p))
+		p++;
+	return p;
+}
+
+static const char *_parse_string(const char *p, char *buf, size_t size)
+{
+	size_t len = 0;
+
+	if (*p++ != '"')
+		return NULL;
+
+	while (*p != '"') {
+		if (!*p)
+			return NULL;
+		if (*p == '\\' && !*++p)
+			return NULL;
+		if (len + 1 >= size)
+			return NULL;
+		buf[len++] = *p++;
+	}
+
+	buf[len] = '\0';
+	return p + 1;
+}
+
+/*
+ * Parse one line as written by bench_report. This is not a general JSON parser,
+ * it accepts a flat object with string, number and null values only.
+ */
+static int _parse_line(const char *p, char *name, double *ops, struct _line_item *items, size_t *nr_items)
+{
+	char  key[BENCH_METRIC_SIZE];
+	char *end;
+
+	*name     = '\0';
+	*ops      = 0;
+	*nr_items = 0;
+
+	if (*(p = _skip_ws(p)) != '{')
+		return -EINVAL;
+	p = _skip_ws(p + 1);
+
+	while (*p != '}') {
+		if (!(p = _parse_string(p, key, sizeof(key))))
+			return -EINVAL;
+		if (*(p = _skip_ws(p)) != ':')
+			return -EINVAL;
+		p = _skip_ws(p + 1);
+
+		if (!strcmp(key, BENCH_KEY_NAME)) {
+			if (!(p = _parse_string(p, name, BENCH_NAME_SIZE)))
+				return -EINVAL;
+		} else {
+			if (*nr_items == BENCH_MAX_LINE_ITEMS)
+				return -EINVAL;
+
+			if (!strncmp(p, "null", 4)) {
+				items[*nr_items].is_null = true;
+				p                       += 4;
+			} else {
+				errno                    = 0;
+				items[*nr_items].value   = strtod(p, &end);
+				items[*nr_items].is_null = false;
+				if (errno || end == p)
+					return -EINVAL;
+				p = end;
+			}
+
+			if (!strcmp(key, BENCH_KEY_OPS)) {
+				if (!items[*nr_items].is_null)
+					*ops = items[*nr_items].value;
+			} else {
+				strcpy(items[*nr_items].key, key);
+				(*nr_items)++;
+			}
+		}
+
+		p = _skip_ws(p);
+		if (*p == ',')
+			p = _skip_ws(p + 1);
+		else if (*p != '}')
+			return -EINVAL;
+	}
+
+	if (*_skip_ws(p + 1) || !*name)
+		return -EINVAL;
+
+	return 0;
+}
+
+static struct bench_samples *_get_samples(struct bench_results *results, const char *name, const char *metric)
+{
+	struct bench_samples *samples;
+	size_t                allocated;
+
+	if ((samples = bench_results_find(results, name, metric)))
+		return samples;
+
+	if (results->count == results->allocated) {
+		allocated = results->allocated ? results->allocated * 2 : 16;
+		if (!(samples = realloc(results->samples, allocated * sizeof(*samples))))
+			return NULL;
+		results->samples   = samples;
+		results->allocated = allocated;
+	}
+
+	samples = &results->samples[results->count++];
+	memset(samples, 0, sizeof(*samples));
+	strcpy(samples->name, name);
+	strcpy(samples->metric, metric);
+
+	return samples;
+}
+
+static int _add_sample(struct bench_results *results, const char *name, const char *metric, double value)
+{
+	struct bench_samples *samples;
+	double               *values;
+	size_t                allocated;
+
+	if (!(samples = _get_samples(results, name, metric)))
+		return -ENOMEM;
+
+	if (samples->count == samples->allocated) {
+		allocated = samples->allocated ? samples->allocated * 2 : 8;
+		if (!(values = realloc(samples->values, allocated * sizeof(*values))))
+			return -ENOMEM;
+		samples->values    = values;
+		samples->allocated = allocated;
+	}
+
+	samples->values[samples->count++] = value;
+	return 0;
+}
+
+int bench_results_load(struct bench_results *results, const char *path, size_t *err_line)
+{
+	struct _line_item items[BENCH_MAX_LINE_ITEMS];
+	char              name[BENCH_NAME_SIZE];
+	char             *line     = NULL;
+	size_t            line_len = 0, line_nr = 0, nr_items, i;
+	double            ops;
+	FILE             *f;
+	int               r = 0;
+
+	memset(results, 0, sizeof(*results));
+
+	if (err_line)
+		*err_line = 0;
+
+	if (!(f = fopen(path, "r")))
+		return -errno;
+
+	while (getline(&line, &line_len, f) >= 0) {
+		line_nr++;
+
+		if (!*_skip_ws(line))
+			continue;
+
+		if ((r = _parse_line(line, name, &ops, items, &nr_items)) < 0) {
+			if (err_line)
+				*err_line = line_nr;
+			break;
+		}
+
+		for (i = 0; i < nr_items; i++) {
+			if (items[i].is_null)
+				continue;
+			if ((r = _add_sample(results, name, items[i].key, ops > 0 ? items[i].value / ops : items[i].value)) < 0)
+				break;
+		}
+
+		if (r < 0)
+			break;
+	}
+
+	free(line);
+	(void) fclose(f);
+
+	if (r < 0)
+		bench_results_destroy(results);
+
+	return r;
+}
+
+void bench_results_destroy(struct bench_results *results)
+{
+	size_t i;
+
+	for (i = 0; i < results->count; i++)
+		free(results->samples[i].values);
+
+	free(results->samples);
+	memset(results, 0, sizeof(*results));
+}
+
+struct bench_samples *bench_results_find(const struct bench_results *results, const char *name, const char *metric)
+{
+	size_t i;
+
+	for (i = 0; i < results->count; i++) {
+		if (!strcmp(results->samples[i].name, name) && !strcmp(results->samples[i].metric, metric))
+			return &results->samples[i];
+	}
+
+	return NULL;
+}
+
+static int _double_cmp(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+static double _sorted_median(const double *sorted, size_t count)
+{
+	if (count % 2)
+		return sorted[count / 2];
+
+	return (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+double bench_median(const double *values, size_t count)
+{
+	double *sorted;
+	double  median;
+
+	if (!count || !(sorted = malloc(count * sizeof(*sorted))))
+		return NAN;
+
+	memcpy(sorted, values, count * sizeof(*sorted));
+	qsort(sorted, count, sizeof(*sorted), _double_cmp);
+	median = _sorted_median(sorted, count);
+
+	free(sorted);
+	return median;
+}
+
+double bench_mad(const double *values, size_t count)
+{
+	double *deviations;
+	double  median, mad;
+	size_t  i;
+
+	if (!count || !(deviations = malloc(count * sizeof(*deviations))))
+		return NAN;
+
+	median = bench_median(values, count);
+	for (i = 0; i < count; i++)
+		deviations[i] = fabs(values[i] - median);
+
+	mad = bench_median(deviations, count);
+
+	free(deviations);
+	return mad;
+}
+
+static int _ranked_cmp(const void *a, const void *b)
+{
+	return _double_cmp(&((const struct _ranked *) a)->value, &((const struct _ranked *) b)->value);
+}
+
+/*
+ * Number of orderings of m values from one group and n values from the other one
+ * with statistic U <= u_max, divided by the number of all orderings. The counts
+ * follow the recurrence c(m, n, u) = c(m - 1, n, u - n) + c(m, n - 1, u).
+ */
+static double _mann_whitney_exact_cdf(size_t m, size_t n, size_t u_max)
+{
+	size_t  nr_u  = m * n + 1, i, j, u;
+	double  below = 0, total = 0;
+	double *c;
+
+#define C(i, j, u) c[((i) * (n + 1) + (j)) * nr_u + (u)]
+
+	if (!(c = calloc((m + 1) * (n + 1) * nr_u, sizeof(*c))))
+		return NAN;
+
+	for (i = 0; i <= m; i++) {
+		for (j = 0; j <= n; j++) {
+			if (!i || !j) {
+				C(i, j, 0) = 1;
+				continue;
+			}
+			for (u = 0; u <= i * j; u++)
+				C(i, j, u) = (u >= j ? C(i - 1, j, u - j) : 0) + (u <= i * (j - 1) ? C(i, j - 1, u) : 0);
+		}
+	}
+
+	for (u = 0; u < nr_u; u++) {
+		total += C(m, n, u);
+		if (u <= u_max)
+			below += C(m, n, u);
+	}
+
+#undef C
+
+	free(c);
+	return below / total;
+}
+
+double bench_mann_whitney(const double *a, size_t count_a, const double *b, size_t count_b)
+{
+	struct _ranked *ranked;
+	size_t          count      = count_a + count_b, i, j;
+	double          rank_sum_a = 0, ties = 0, rank, t, u_a, u, mean, sigma, z, p;
+
+	if (!count_a || !count_b || !(ranked = malloc(count * sizeof(*ranked))))
+		return 1;
+
+	for (i = 0; i < count_a; i++)
+		ranked[i] = (struct _ranked) {.value = a[i], .is_a = true};
+	for (i = 0; i < count_b; i++)
+		ranked[count_a + i] = (struct _ranked) {.value = b[i], .is_a = false};
+
+	qsort(ranked, count, sizeof(*ranked), _ranked_cmp);
+
+	/* tied values all get the average of the ranks they span */
+	for (i = 0; i < count; i = j) {
+		for (j = i + 1; j < count && ranked[j].value == ranked[i].value; j++)
+			;
+		rank  = (i + 1 + j) / 2.0;
+		t     = j - i;
+		ties += t * t * t - t;
+		for (; i < j; i++)
+			if (ranked[i].is_a)
+				rank_sum_a += rank;
+	}
+
+	free(ranked);
+
+	u_a = rank_sum_a - count_a * (count_a + 1) / 2.0;
+	u   = fmin(u_a, (double) count_a * count_b - u_a);
+
+	if (!ties && count <= BENCH_MW_EXACT_MAX)
+		p = 2 * _mann_whitney_exact_cdf(count_a, count_b, (size_t) u);
+	else {
+		mean  = count_a * count_b / 2.0;
+		sigma = sqrt(count_a * count_b / 12.0 * ((count + 1) - ties / ((double) count * (count - 1))));
+		if (sigma == 0)
+			return 1;
+		/* with continuity correction */
+		z = fmax(fabs(u_a - mean) - 0.5, 0) / sigma;
+		p = erfc(z / M_SQRT2);
+	}
+
+	return fmin(p, 1);
+}
+
+void bench_compare_opts_init(struct bench_compare_opts *opts)
+{
+	memset(opts, 0, sizeof(*opts));
+	opts->threshold = BENCH_COMPARE_THRESHOLD;
+	opts->alpha     = BENCH_COMPARE_ALPHA;
+}
+
+/* Parse "[metric=]percent" and set the default or per-metric threshold. */
+int bench_compare_opts_set_threshold(struct bench_compare_opts *opts, const char *arg)
+{
+	const char *eq;
+	char       *end;
+	double      threshold;
+	size_t      len = 0, i;
+
+	if ((eq = strchr(arg, '='))) {
+		if (!(len = eq - arg) || len >= BENCH_METRIC_SIZE)
+			return -EINVAL;
+		arg = eq + 1;
+	}
+
+	errno     = 0;
+	threshold = strtod(arg, &end);
+	if (errno || end == arg || *end || !(threshold >= 0))
+		return -EINVAL;
+	threshold /= 100;
+
+	if (!eq) {
+		opts->threshold = threshold;
+		return 0;
+	}
+
+	for (i = 0; i < opts->nr_overrides; i++) {
+		if (strlen(opts->overrides[i].metric) == len && !strncmp(opts->overrides[i].metric, eq - len, len))
+			break;
+	}
+
+	if (i == BENCH_COMPARE_MAX_OVERRIDE)
+		return -ENOSPC;
+
+	memcpy(opts->overrides[i].metric, eq - len, len);
+	opts->overrides[i].metric[len] = '\0';
+	opts->overrides[i].threshold   = threshold;
+
+	if (i == opts->nr_overrides)
+		opts->nr_overrides++;
+
+	return 0;
+}
+
+static double _get_threshold(const struct bench_compare_opts *opts, const char *metric)
+{
+	size_t i;
+
+	for (i = 0; i < opts->nr_overrides; i++) {
+		if (!strcmp(opts->overrides[i].metric, metric))
+			return opts->overrides[i].threshold;
+	}
+
+	return opts->threshold;
+}
+
+void bench_compare(const struct bench_samples *a,
+                   const struct bench_samples *b,
+                   const struct bench_compare_opts *opts,
+                   struct bench_stats *stats)
+{
+	double threshold = _get_threshold(opts, a->metric);
+
+	stats->count_a  = a->count;
+	stats->count_b  = b->count;
+	stats->median_a = bench_median(a->values, a->count);
+	stats->mad_a    = bench_mad(a->values, a->count);
+	stats->median_b = bench_median(b->values, b->count);
+	stats->mad_b    = bench_mad(b->values, b->count);
+	stats->p        = bench_mann_whitney(a->values, a->count, b->values, b->count);
+
+	if (stats->median_a != 0)
+		stats->delta = (stats->median_b - stats->median_a) / fabs(stats->median_a);
+	else
+		stats->delta = stats->median_b > 0 ? INFINITY : stats->median_b < 0 ? -INFINITY : 0;
+
+	if (stats->p >= opts->alpha)
+		stats->verdict = BENCH_VERDICT_UNCHANGED;
+	else if (stats->delta > threshold)
+		stats->verdict = BENCH_VERDICT_REGRESSED;
+	else if (stats->delta < -threshold)
+		stats->verdict = BENCH_VERDICT_IMPROVED;
+	else
+		stats->verdict = BENCH_VERDICT_UNCHANGED;
+}
+
+const char *bench_verdict_str(bench_verdict_t verdict)
+{
+	switch (verdict) {
+		case BENCH_VERDICT_IMPROVED:
+			return "improved";
+		case BENCH_VERDICT_REGRESSED:
+			return "REGRESSED";
+		case BENCH_VERDICT_UNCHANGED:
+		default:
+			return "unchanged";
+	}
+}
+
+/*
+ * Compare all benchmarks and metrics and print a line for each of them.
+ * Returns the number of regressed metrics.
+ */
+int bench_compare_results(const struct bench_results *a,
+                          const struct bench_results *b,
+                          const struct bench_compare_opts *opts,
+                          FILE *f)
+{
+	struct bench_samples *samples;
+	struct bench_stats    stats;
+	size_t                i;
+	int                   regressed = 0;
+
+	if (f)
+		fprintf(f,
+		        "%-32s %-16s %4s %22s %22s %9s %8s  %s\n",
+		        "benchmark",
+		        "metric",
+		        "runs",
+		        "before (median+/-MAD)",
+		        "after (median+/-MAD)",
+		        "delta",
+		        "p",
+		        "verdict");
+
+	for (i = 0; i < a->count; i++) {
+		if (!(samples = bench_results_find(b, a->samples[i].name, a->samples[i].metric))) {
+			if (f)
+				fprintf(f, "%-32s %-16s missing in after results\n", a->samples[i].name, a->samples[i].metric);
+			continue;
+		}
+
+		bench_compare(&a->samples[i], samples, opts, &stats);
+
+		if (stats.verdict == BENCH_VERDICT_REGRESSED)
+			regressed++;
+
+		if (f)
+			fprintf(f,
+			        "%-32s %-16s %2zu/%-2zu %12.6g+/-%-7.3g %12.6g+/-%-7.3g %+8.2f%% %8.4f  %s\n",
+			        a->samples[i].name,
+			        a->samples[i].metric,
+			        stats.count_a,
+			        stats.count_b,
+			        stats.median_a,
+			        stats.mad_a,
+			        stats.median_b,
+			        stats.mad_b,
+			        stats.delta * 100,
+			        stats.p,
+			        bench_verdict_str(stats.verdict));
+	}
+
+	for (i = 0; i < b->count; i++) {
+		if (f && !bench_results_find(a, b->samples[i].name, b->samples[i].metric))
+			fprintf(f, "%-32s %-16s missing in before results\n", b->samples[i].name, b->samples[i].metric);
+	}
+
+	return regressed;
+}
@@ -0,0 +1,96 @@
+#ifndef _SID_TESTS_BENCH_COMPARE_H
+#define _SID_TESTS_BENCH_COMPARE_H
+
+#include "bench.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Comparison of benchmark results recorded by bench_report.
+ *
+ * A result file contains one JSON object per line. Each line is one run of one
+ * benchmark and repeated runs of the same benchmark simply add more lines. All
+ * numeric fields except "ops" are metrics and they are compared per operation
+ * if "ops" is set. Metrics with null value (counter not available) are skipped.
+ *
+ * For each benchmark and metric found in both files, the median and the median
+ * absolute deviation (MAD) of the runs is computed and the two sets of runs are
+ * compared by two-sided Mann-Whitney U test. A change is reported only if the
+ * relative difference of medians exceeds the threshold and the test says it is
+ * significant. Lower values are always considered better.
+ */
+
+#define BENCH_METRIC_SIZE          32
+#define BENCH_COMPARE_THRESHOLD    0.05
+#define BENCH_COMPARE_ALPHA        0.05
+#define BENCH_COMPARE_MAX_OVERRIDE 16
+
+/* exact U distribution is used up to this total number of runs, normal approximation above */
+#define BENCH_MW_EXACT_MAX 20
+
+typedef enum {
+	BENCH_VERDICT_UNCHANGED,
+	BENCH_VERDICT_IMPROVED,
+	BENCH_VERDICT_REGRESSED,
+} bench_verdict_t;
+
+struct bench_samples {
+	char    name[BENCH_NAME_SIZE];
+	char    metric[BENCH_METRIC_SIZE];
+	double *values;
+	size_t  count;
+	size_t  allocated;
+};
+
+struct bench_results {
+	struct bench_samples *samples;
+	size_t                count;
+	size_t                allocated;
+};
+
+struct bench_stats {
+	size_t          count_a;
+	size_t          count_b;
+	double          median_a;
+	double          mad_a;
+	double          median_b;
+	double          mad_b;
+	double          delta; /* relative change of medians, (b - a) / a */
+	double          p;     /* two-sided Mann-Whitney p-value */
+	bench_verdict_t verdict;
+};
+
+struct bench_compare_opts {
+	double threshold; /* default relative threshold, e.g. 0.05 for 5% */
+	double alpha;     /* significance level */
+
+	struct {
+		char   metric[BENCH_METRIC_SIZE];
+		double threshold;
+	} overrides[BENCH_COMPARE_MAX_OVERRIDE]; /* per-metric thresholds */
+	size_t nr_overrides;
+};
+
+int                   bench_results_load(struct bench_results *results, const char *path, size_t *err_line);
+void                  bench_results_destroy(struct bench_results *results);
+struct bench_samples *bench_results_find(const struct bench_results *results, const char *name, const char *metric);
+
+double bench_median(const double *values, size_t count);
+double bench_mad(const double *values, size_t count);
+double bench_mann_whitney(const double *a, size_t count_a, const double *b, size_t count_b);
+
+void        bench_compare_opts_init(struct bench_compare_opts *opts);
+int         bench_compare_opts_set_threshold(struct bench_compare_opts *opts, const char *arg);
+void        bench_compare(const struct bench_samples *a,
+                          const struct bench_samples *b,
+                          const struct bench_compare_opts *opts,
+                          struct bench_stats *stats);
+int         bench_compare_results(const struct bench_results *a,
+                                  const struct bench_results *b,
+                                  const struct bench_compare_opts *opts,
+                                  FILE *f);
+const char *bench_verdict_str(bench_verdict_t verdict);
+
+#endif
@@ -0,0 +1,107 @@
+#include "bench_compare.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXIT_REGRESSED 1
+#define EXIT_ERROR     2
+
+static void _help(FILE *f)
+{
+	fprintf(f,
+	        "Usage: bench_compare [-h|--help] [-t|--threshold [<metric>=]<percent>] [-a|--alpha <p>] <before> <after>\n"
+	        "\n"
+	        "Compare benchmark results written to SID_BENCH_JSON by two different builds.\n"
+	        "\n"
+	        "Each line of the result files is one run of one benchmark, run the benchmarks\n"
+	        "repeatedly with the same file to collect more runs. At least 4 runs of each build\n"
+	        "are needed before any change can be reported as significant.\n"
+	        "\n"
+	        "Options:\n"
+	        "    -t|--threshold [<metric>=]<percent>  Report changes of medians above percent only (default 5),\n"
+	        "                                         if metric is given, set the threshold for that metric only.\n"
+	        "    -a|--alpha <p>                       Significance level of the Mann-Whitney test (default 0.05).\n"
+	        "    -h|--help                            Show this help information.\n"
+	        "\n"
+	        "Exit status is 0 if nothing regressed, 1 if any metric regressed and 2 on error.\n");
+}
+
+static int _load(struct bench_results *results, const char *path)
+{
+	size_t line;
+	int    r;
+
+	if ((r = bench_results_load(results, path, &line)) < 0) {
+		if (line)
+			fprintf(stderr, "%s:%zu: invalid benchmark result\n", path, line);
+		else
+			fprintf(stderr, "%s: %s\n", path, strerror(-r));
+	}
+
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_compare_opts opts;
+	struct bench_results      before, after;
+	char                     *p;
+	int                       opt, r;
+
+	struct option longopts[] = {
+		{"threshold", required_argument, NULL, 't'},
+		{"alpha", required_argument, NULL, 'a'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, no_argument, NULL, 0},
+	};
+
+	bench_compare_opts_init(&opts);
+
+	while ((opt = getopt_long(argc, argv, "t:a:h", longopts, NULL)) != EOF) {
+		switch (opt) {
+			case 'h':
+				_help(stdout);
+				return EXIT_SUCCESS;
+			case 't':
+				if (bench_compare_opts_set_threshold(&opts, optarg) < 0) {
+					_help(stderr);
+					return EXIT_ERROR;
+				}
+				break;
+			case 'a':
+				errno      = 0;
+				opts.alpha = strtod(optarg, &p);
+				if (errno || p == optarg || *p || !(opts.alpha > 0 && opts.alpha < 1)) {
+					_help(stderr);
+					return EXIT_ERROR;
+				}
+				break;
+			default:
+				_help(stderr);
+				return EXIT_ERROR;
+		}
+	}
+
+	if (optind != argc - 2) {
+		_help(stderr);
+		return EXIT_ERROR;
+	}
+
+	if (_load(&before, argv[optind]) < 0)
+		return EXIT_ERROR;
+
+	if (_load(&after, argv[optind + 1]) < 0) {
+		bench_results_destroy(&before);
+		return EXIT_ERROR;
+	}
+
+	r = bench_compare_results(&before, &after, &opts, stdout);
+
+	bench_results_destroy(&before);
+	bench_results_destroy(&after);
+
+	return r ? EXIT_REGRESSED : EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include "bench.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#define TEST_NR_ITERATIONS      10000000
+#define TEST_MAX_INSNS_PER_ITER 16
+#define TEST_MAX_INSNS_OVERHEAD 100000
+#define TEST_JSON_LINE_SIZE     512
+
+static bool deny_perf;
+
+long __real_syscall(long number, ...);
+
+long __wrap_syscall(long number, ...)
+{
+	va_list ap;
+	long    args[5];
+	int     i;
+
+	if (deny_perf && number == SYS_perf_event_open) {
+		errno = EACCES;
+		return -1;
+	}
+
+	va_start(ap, number);
+	for (i = 0; i < 5; i++)
+		args[i] = va_arg(ap, long);
+	va_end(ap);
+
+	return __real_syscall(number, args[0], args[1], args[2], args[3], args[4]);
+}
+
+static uint64_t _known_loop(uint64_t nr_iterations)
+{
+	uint64_t i, sum = 0;
+
+	/* the empty asm keeps the compiler from folding the loop */
+	for (i = 0; i < nr_iterations; i++) {
+		sum += i;
+		__asm__ volatile("" : "+r"(sum));
+	}
+
+	return sum;
+}
+
+/*
+ * Each loop iteration executes at least one instruction and only few of them, so
+ * the number of instructions counted must be between the number of iterations and
+ * a small multiple of it, regardless of how the compiler arranged the loop.
+ */
+static void test_bench_known_loop(void **state)
+{
+	struct bench bench;
+	uint64_t     insns;
+
+	bench_init(&bench, "known_loop");
+
+	bench_start(&bench);
+	assert_true(_known_loop(TEST_NR_ITERATIONS) > 0);
+	bench_stop(&bench, TEST_NR_ITERATIONS);
+
+	assert_int_equal(bench.ops, TEST_NR_ITERATIONS);
+	assert_true(bench.nsec > 0);
+
+	if (bench_counter_available(&bench, BENCH_COUNTER_TASK_CLOCK))
+		assert_true(bench.values[BENCH_COUNTER_TASK_CLOCK] > 0);
+
+	if (!bench_counter_available(&bench, BENCH_COUNTER_INSTRUCTIONS)) {
+		print_message("instruction counter not available, skipping\n");
+		bench_destroy(&bench);
+		skip();
+	}
+
+	insns = bench.values[BENCH_COUNTER_INSTRUCTIONS];
+	print_message("known loop: %" PRIu64 " iterations, %" PRIu64 " instructions\n", (uint64_t) TEST_NR_ITERATIONS, insns);
+
+	assert_true(insns >= TEST_NR_ITERATIONS);
+	assert_true(insns <= (uint64_t) TEST_NR_ITERATIONS * TEST_MAX_INSNS_PER_ITER + TEST_MAX_INSNS_OVERHEAD);
+
+	/* counts accumulate over measured regions */
+	bench_start(&bench);
+	assert_true(_known_loop(TEST_NR_ITERATIONS) > 0);
+	bench_stop(&bench, TEST_NR_ITERATIONS);
+
+	assert_int_equal(bench.ops, 2 * TEST_NR_ITERATIONS);
+	assert_true(bench.values[BENCH_COUNTER_INSTRUCTIONS] >= insns + TEST_NR_ITERATIONS);
+
+	bench_destroy(&bench);
+}
+
+static void test_bench_no_counters(void **state)
+{
+	struct bench    bench;
+	bench_counter_t counter;
+
+	deny_perf = true;
+	bench_init(&bench, "no_counters");
+	deny_perf = false;
+
+	for (counter = 0; counter < _BENCH_COUNTER_COUNT; counter++)
+		assert_false(bench_counter_available(&bench, counter));
+
+	bench_start(&bench);
+	assert_true(_known_loop(1000) > 0);
+	bench_stop(&bench, 1000);
+
+	assert_int_equal(bench.ops, 1000);
+	assert_true(bench.nsec > 0);
+
+	for (counter = 0; counter < _BENCH_COUNTER_COUNT; counter++)
+		assert_int_equal(bench.values[counter], 0);
+
+	bench_destroy(&bench);
+}
+
+static void test_bench_report(void **state)
+{
+	struct bench bench;
+	char         path[] = "/tmp/sid-test-bench-XXXXXX";
+	char         line[TEST_JSON_LINE_SIZE];
+	FILE        *f;
+	int          fd;
+
+	assert_true((fd = mkstemp(path)) >= 0);
+	(void) close(fd);
+
+	/* nothing is written without the output file set */
+	unsetenv(BENCH_KEY_JSON);
+	bench_init(&bench, "unset");
+	assert_int_equal(bench_report(&bench), 0);
+	bench_destroy(&bench);
+
+	assert_int_equal(setenv(BENCH_KEY_JSON, path, 1), 0);
+
+	deny_perf = true;
+	bench_init(&bench, "first");
+	deny_perf = false;
+	bench_start(&bench);
+	bench_stop(&bench, 42);
+	assert_int_equal(bench_report(&bench), 0);
+	bench_destroy(&bench);
+
+	bench_init(&bench, "second");
+	bench_start(&bench);
+	bench_stop(&bench, 7);
+	assert_int_equal(bench_report(&bench), 0);
+	bench_destroy(&bench);
+
+	unsetenv(BENCH_KEY_JSON);
+
+	assert_non_null(f = fopen(path, "r"));
+
+	assert_non_null(fgets(line, sizeof(line), f));
+	assert_non_null(strstr(line, "{\"name\": \"first\", \"ops\": 42, \"nsec\": "));
+	assert_non_null(strstr(line, "\"instructions\": null"));
+	assert_non_null(strstr(line, "\"task_clock_nsec\": null}\n"));
+
+	assert_non_null(fgets(line, sizeof(line), f));
+	assert_non_null(strstr(line, "{\"name\": \"second\", \"ops\": 7, \"nsec\": "));
+	assert_non_null(strstr(line, "\"branch_misses\": "));
+	assert_true(line[strlen(line) - 2] == '}');
+
+	assert_null(fgets(line, sizeof(line), f));
+
+	fclose(f);
+	assert_int_equal(unlink(path), 0);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_bench_known_loop),
+		cmocka_unit_test(test_bench_no_counters),
+		cmocka_unit_test(test_bench_report),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,234 @@
+#include "bench_compare.h"
+
+#include <errno.h>
+#include <math.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cmocka.h>
+
+#ifndef BENCH_FIXTURES_DIR
+#	define BENCH_FIXTURES_DIR "bench_fixtures"
+#endif
+
+#define TEST_FIXTURE(name) BENCH_FIXTURES_DIR "/" name ".jsonl"
+#define TEST_EPSILON       1e-9
+
+/* assert_float_equal is not available in older cmocka */
+#define assert_near(a, b) assert_true(fabs((a) - (b)) < TEST_EPSILON)
+
+struct test_verdict {
+	const char     *name;
+	const char     *metric;
+	bench_verdict_t verdict;
+};
+
+static void test_bench_compare_stats(void **state)
+{
+	double odd[]  = {5, 1, 4, 2, 3};
+	double even[] = {10, 1, 2, 4};
+	double same[] = {7, 7, 7};
+
+	assert_near(bench_median(odd, 5), 3);
+	assert_near(bench_median(even, 4), 3);
+	assert_near(bench_median(same, 3), 7);
+	assert_true(isnan(bench_median(odd, 0)));
+
+	/* deviations from the median are {2, 2, 1, 1, 0} and {7, 2, 1, 1} */
+	assert_near(bench_mad(odd, 5), 1);
+	assert_near(bench_mad(even, 4), 1.5);
+	assert_near(bench_mad(same, 3), 0);
+
+	/* input is left unsorted */
+	assert_near(odd[0], 5);
+}
+
+static void test_bench_compare_mann_whitney(void **state)
+{
+	double low[]       = {1, 2, 3, 4, 5};
+	double high[]      = {6, 7, 8, 9, 10};
+	double mixed[]     = {1.5, 3.5, 5.5, 7.5, 9.5};
+	double tied_low[]  = {1, 1, 2, 2, 3, 3};
+	double tied_high[] = {3, 4, 4, 5, 5, 6};
+	double big_low[30], big_high[30];
+	int    i;
+
+	/* exact: only 2 of C(10, 5) = 252 orderings are as extreme as full separation */
+	assert_near(bench_mann_whitney(low, 5, high, 5), 2.0 / 252);
+	assert_near(bench_mann_whitney(high, 5, low, 5), 2.0 / 252);
+
+	/* exact: one each way with U = 0 out of C(4, 1) = 4 */
+	assert_near(bench_mann_whitney(low, 1, high, 3), 0.5);
+
+	/* exact: U = 6 and 28 of 252 orderings have U <= 6 */
+	assert_near(bench_mann_whitney(low, 5, mixed, 5), 2 * 28.0 / 252);
+	assert_near(bench_mann_whitney(low, 5, low, 5), 1);
+
+	/* no runs, no evidence */
+	assert_near(bench_mann_whitney(low, 5, high, 0), 1);
+
+	/* ties and bigger samples use normal approximation */
+	assert_true(bench_mann_whitney(tied_low, 6, tied_high, 6) < 0.05);
+	assert_near(bench_mann_whitney(tied_low, 6, tied_low, 6), 1);
+
+	for (i = 0; i < 30; i++) {
+		big_low[i]  = i;
+		big_high[i] = 100 + i;
+	}
+	assert_true(bench_mann_whitney(big_low, 30, big_high, 30) < 1e-9);
+}
+
+static void test_bench_compare_threshold(void **state)
+{
+	struct bench_compare_opts opts;
+
+	bench_compare_opts_init(&opts);
+	assert_near(opts.threshold, BENCH_COMPARE_THRESHOLD);
+
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, "10"), 0);
+	assert_near(opts.threshold, 0.1);
+
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, "instructions=1.5"), 0);
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, "instructions=2"), 0);
+	assert_int_equal(opts.nr_overrides, 1);
+	assert_string_equal(opts.overrides[0].metric, "instructions");
+	assert_near(opts.overrides[0].threshold, 0.02);
+	assert_near(opts.threshold, 0.1);
+
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, ""), -EINVAL);
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, "5%"), -EINVAL);
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, "-1"), -EINVAL);
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, "=5"), -EINVAL);
+	assert_int_equal(bench_compare_opts_set_threshold(&opts, "nsec="), -EINVAL);
+}
+
+static void _check_fixture(const char *after_path, const char *threshold, int regressed, const struct test_verdict *verdicts)
+{
+	struct bench_compare_opts opts;
+	struct bench_results      before, after;
+	struct bench_samples     *a, *b;
+	struct bench_stats        stats;
+
+	bench_compare_opts_init(&opts);
+	if (threshold)
+		assert_int_equal(bench_compare_opts_set_threshold(&opts, threshold), 0);
+
+	assert_int_equal(bench_results_load(&before, TEST_FIXTURE("before"), NULL), 0);
+	assert_int_equal(bench_results_load(&after, after_path, NULL), 0);
+
+	assert_int_equal(bench_compare_results(&before, &after, &opts, NULL), regressed);
+
+	for (; verdicts && verdicts->name; verdicts++) {
+		assert_non_null(a = bench_results_find(&before, verdicts->name, verdicts->metric));
+		assert_non_null(b = bench_results_find(&after, verdicts->name, verdicts->metric));
+		bench_compare(a, b, &opts, &stats);
+		assert_int_equal(stats.verdict, verdicts->verdict);
+	}
+
+	bench_results_destroy(&before);
+	bench_results_destroy(&after);
+}
+
+static void test_bench_compare_load(void **state)
+{
+	struct bench_results  results;
+	struct bench_samples *samples;
+
+	assert_int_equal(bench_results_load(&results, TEST_FIXTURE("before"), NULL), 0);
+
+	/* null counters are left out, "ops" is not a metric */
+	assert_int_equal(results.count, 6);
+	assert_null(bench_results_find(&results, "bptree_add_remove", "cycles"));
+	assert_null(bench_results_find(&results, "bptree_add_remove", "ops"));
+
+	/* values are per operation */
+	assert_non_null(samples = bench_results_find(&results, "bptree_add_remove", "nsec"));
+	assert_int_equal(samples->count, 8);
+	assert_near(samples->values[0], 50);
+
+	bench_results_destroy(&results);
+}
+
+static void test_bench_compare_verdicts(void **state)
+{
+	/* same distribution, different noise */
+	_check_fixture(TEST_FIXTURE("after_same"), NULL, 0, NULL);
+
+	/* time per operation is 20% worse, instructions are not affected */
+	_check_fixture(TEST_FIXTURE("after_regressed"),
+	               NULL,
+	               2,
+	               (struct test_verdict[]) {
+			       {"bptree_add_remove", "nsec", BENCH_VERDICT_REGRESSED},
+			       {"bptree_add_remove", "task_clock_nsec", BENCH_VERDICT_REGRESSED},
+			       {"bptree_add_remove", "instructions", BENCH_VERDICT_UNCHANGED},
+			       {"kv_view_lookup", "nsec", BENCH_VERDICT_UNCHANGED},
+			       {NULL},
+		       });
+
+	/* ...but not beyond higher threshold */
+	_check_fixture(TEST_FIXTURE("after_regressed"), "25", 0, NULL);
+	_check_fixture(TEST_FIXTURE("after_regressed"), "nsec=25", 1, NULL);
+
+	/* improvements never fail */
+	_check_fixture(TEST_FIXTURE("after_improved"),
+	               NULL,
+	               0,
+	               (struct test_verdict[]) {
+			       {"bptree_add_remove", "nsec", BENCH_VERDICT_IMPROVED},
+			       {"bptree_add_remove", "instructions", BENCH_VERDICT_UNCHANGED},
+			       {NULL},
+		       });
+
+	/* median is 15% worse, but the runs are too scattered for that to be significant */
+	_check_fixture(TEST_FIXTURE("after_noisy"),
+	               NULL,
+	               0,
+	               (struct test_verdict[]) {
+			       {"bptree_add_remove", "nsec", BENCH_VERDICT_UNCHANGED},
+			       {NULL},
+		       });
+
+	/* 2% more instructions is significant, but below default threshold */
+	_check_fixture(TEST_FIXTURE("after_small"), NULL, 0, NULL);
+	_check_fixture(TEST_FIXTURE("after_small"),
+	               "instructions=1",
+	               1,
+	               (struct test_verdict[]) {
+			       {"kv_view_lookup", "instructions", BENCH_VERDICT_REGRESSED},
+			       {"kv_view_lookup", "nsec", BENCH_VERDICT_UNCHANGED},
+			       {NULL},
+		       });
+}
+
+static void test_bench_compare_invalid(void **state)
+{
+	struct bench_results results;
+	size_t               line;
+
+	assert_int_equal(bench_results_load(&results, TEST_FIXTURE("invalid"), &line), -EINVAL);
+	assert_int_equal(line, 2);
+	assert_int_equal(results.count, 0);
+	assert_null(results.samples);
+
+	assert_int_equal(bench_results_load(&results, TEST_FIXTURE("nonexistent"), &line), -ENOENT);
+	assert_int_equal(line, 0);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_bench_compare_stats),
+		cmocka_unit_test(test_bench_compare_mann_whitney),
+		cmocka_unit_test(test_bench_compare_threshold),
+		cmocka_unit_test(test_bench_compare_load),
+		cmocka_unit_test(test_bench_compare_verdicts),
+		cmocka_unit_test(test_bench_compare_invalid),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
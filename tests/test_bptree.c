@@ -1,11 +1,14 @@
 #include "../src/internal/bptree.c"
+#include "bench.h"
 
+#include <pthread.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <cmocka.h>
 
@@ -41,6 +44,7 @@ void verify_node(bptree_t       *bptree,
                  bptree_node_t **next_leaf,
                  bptree_key_t  **bkey,
                  size_t         *num_entries,
+                 size_t         *num_tombstones,
                  size_t         *data_size,
                  size_t         *meta_size,
                  bool            last)
@@ -52,20 +56,25 @@ void verify_node(bptree_t       *bptree,
 		if (*next_leaf)
 			assert_ptr_equal(n, *next_leaf);
 		assert_true(n->num_keys < bptree->order);
-		if (n != bptree->root)
-			assert_true(n->num_keys >= _cut(bptree->order - 1));
-		*num_entries += n->num_keys;
-		*meta_size   += sizeof(*n) + (bptree->order - 1) * sizeof(bptree_key_t *) + bptree->order * sizeof(void *);
+		assert_true(n->num_keys > 0);
+		/* leaves may shrink below the minimum when tombstones are deleted on insertion */
+		if (n != bptree->root && !bptree->lazy_remove)
+			assert_true(n->num_keys >= bptree->min_leaf_keys);
+		*meta_size += sizeof(*n) + (bptree->order - 1) * sizeof(bptree_key_t *) + bptree->order * sizeof(void *);
 		for (i = 0; i < n->num_keys; i++) {
 			int ref = i < n->num_keys - 1 ? 1 : last ? 1 : 2;
 			assert_non_null(n->bkeys[i]);
-			assert_non_null(n->pointers[i]);
 			if (*bkey)
 				assert_true(strcmp((*bkey)->key, n->bkeys[i]->key) < 0);
 			*bkey = n->bkeys[i];
 			assert_true((*bkey)->ref_count == ref);
-			*meta_size += sizeof(bptree_key_t) + strlen((*bkey)->key) + 1 + sizeof(bptree_record_t);
-			rec        = n->pointers[i];
+			*meta_size += sizeof(bptree_key_t) + strlen((*bkey)->key) + 1;
+			if (!(rec = n->pointers[i])) {
+				(*num_tombstones)++;
+				continue;
+			}
+			(*num_entries)++;
+			*meta_size += sizeof(bptree_record_t);
 			assert_true(rec->ref_count > 0);
 			*data_size += rec->data_size;
 		}
@@ -74,12 +83,20 @@ void verify_node(bptree_t       *bptree,
 	}
 	assert_true(n->num_keys < bptree->order);
 	if (n != bptree->root)
-		assert_true(n->num_keys >= _cut(bptree->order) - 1);
+		assert_true(n->num_keys >= bptree->min_node_keys);
 	*meta_size += sizeof(*n) + (bptree->order - 1) * sizeof(bptree_key_t *) + bptree->order * sizeof(void *);
 	for (i = 0; i <= n->num_keys; i++) {
 		assert_non_null(n->pointers[i]);
 		assert_ptr_equal(((bptree_node_t *) n->pointers[i])->parent, n);
-		verify_node(bptree, n->pointers[i], next_leaf, bkey, num_entries, data_size, meta_size, last && i == n->num_keys);
+		verify_node(bptree,
+		            n->pointers[i],
+		            next_leaf,
+		            bkey,
+		            num_entries,
+		            num_tombstones,
+		            data_size,
+		            meta_size,
+		            last && i == n->num_keys);
 		if (i < n->num_keys)
 			assert_ptr_equal(n->bkeys[i], *bkey);
 	}
@@ -92,15 +109,16 @@ void verify_node(bptree_t       *bptree,
  * 4. that all the keys have the proper reference counts
  * 5. That every node correctly points to its parent
  * 6. That the keys are in order
- * 7. That the number of entries in the stats match the actual number
+ * 7. That the number of entries and tombstones in the stats match the actual number
  * 8. That the meta_size is correct
  * 9. That the data_size is correct
  */
 void verify_bptree(bptree_t *bptree)
 {
-	bptree_node_t *next_leaf   = NULL;
-	bptree_key_t  *bkey        = NULL;
-	size_t         num_entries = 0;
+	bptree_node_t *next_leaf      = NULL;
+	bptree_key_t  *bkey           = NULL;
+	size_t         num_entries    = 0;
+	size_t         num_tombstones = 0;
 	size_t         check_data_size, data_size = 0;
 	size_t         check_meta_size, meta_size = sizeof(*bptree);
 
@@ -109,11 +127,12 @@ void verify_bptree(bptree_t *bptree)
 		goto out;
 
 	assert_null(bptree->root->parent);
-	verify_node(bptree, bptree->root, &next_leaf, &bkey, &num_entries, &data_size, &meta_size, true);
+	verify_node(bptree, bptree->root, &next_leaf, &bkey, &num_entries, &num_tombstones, &data_size, &meta_size, true);
 	assert_null(next_leaf);
 
 out:
 	assert_int_equal(bptree_get_num_entries(bptree), num_entries);
+	assert_int_equal(bptree_get_num_tombstones(bptree), num_tombstones);
 	bptree_get_size(bptree, &check_meta_size, &check_data_size);
 	assert_int_equal(check_meta_size, meta_size);
 	assert_int_equal(check_data_size, data_size);
@@ -249,6 +268,7 @@ static void free_checker(checker_t *checker)
 	free(checker->values);
 	free(checker->sizes);
 	free(checker->ref_counts);
+	free(checker->skips);
 	free(checker);
 }
 
@@ -583,6 +603,680 @@ static void test_bptree_remove_3_height()
 	do_test_bptree_actions(ids, 22, ids, 22, false, 0);
 }
 
+#define PREFIX_ALPHABET     "ab\xff"
+#define PREFIX_ALPHABET_LEN (sizeof(PREFIX_ALPHABET) - 1)
+#define PREFIX_MAX_KEY_LEN  4
+#define PREFIX_MAX_KEYS     (3 + 9 + 27 + 81)
+
+/* generate all keys over PREFIX_ALPHABET with length from 1 to max_len */
+static int gen_prefix_keys(char keys[][PREFIX_MAX_KEY_LEN + 1], int max_len)
+{
+	int count = 0, len, n, i, j, v;
+
+	for (len = 1, n = PREFIX_ALPHABET_LEN; len <= max_len; len++, n *= PREFIX_ALPHABET_LEN) {
+		for (i = 0; i < n; i++, count++) {
+			for (j = len - 1, v = i; j >= 0; j--, v /= PREFIX_ALPHABET_LEN)
+				keys[count][j] = PREFIX_ALPHABET[v % PREFIX_ALPHABET_LEN];
+			keys[count][len] = '\0';
+		}
+	}
+
+	return count;
+}
+
+/* iterate over keys with given prefix and compare with what is expected from linear scan */
+static void
+	check_prefix_iter(bptree_t *bptree, char keys[][PREFIX_MAX_KEY_LEN + 1], bool *removed, int num_keys, const char *prefix)
+{
+	size_t         prefix_len = strlen(prefix);
+	bptree_iter_t *iter;
+	const char    *key;
+	const char    *prev_key = NULL;
+	int            expected = 0;
+	int            found    = 0;
+	int            i;
+
+	for (i = 0; i < num_keys; i++)
+		if (!removed[i] && !strncmp(keys[i], prefix, prefix_len))
+			expected++;
+
+	assert_non_null(iter = bptree_iter_create_prefix(bptree, prefix, prefix_len));
+
+	while (bptree_iter_next(iter, &key, NULL, NULL)) {
+		assert_int_equal(strncmp(key, prefix, prefix_len), 0);
+		if (prev_key)
+			assert_true(strcmp(prev_key, key) < 0);
+		prev_key = key;
+		found++;
+	}
+
+	assert_int_equal(found, expected);
+
+	/* reset must start the iteration again from the first matching key */
+	bptree_iter_reset_prefix(iter, prefix, prefix_len);
+	for (found = 0; bptree_iter_next(iter, &key, NULL, NULL); found++)
+		;
+	assert_int_equal(found, expected);
+
+	bptree_iter_destroy(iter);
+}
+
+static void check_all_prefixes(bptree_t *bptree, char keys[][PREFIX_MAX_KEY_LEN + 1], bool *removed, int num_keys)
+{
+	char prefixes[PREFIX_MAX_KEYS][PREFIX_MAX_KEY_LEN + 1];
+	int  num_prefixes, i;
+
+	/* empty prefix selects all keys */
+	check_prefix_iter(bptree, keys, removed, num_keys, "");
+
+	/* prefixes equal to existing keys, including the ones ending with 0xff */
+	num_prefixes = gen_prefix_keys(prefixes, PREFIX_MAX_KEY_LEN);
+	for (i = 0; i < num_prefixes; i++)
+		check_prefix_iter(bptree, keys, removed, num_keys, prefixes[i]);
+
+	/* prefixes with no match */
+	check_prefix_iter(bptree, keys, removed, num_keys, "\xff\xff\xff\xff\xff");
+	check_prefix_iter(bptree, keys, removed, num_keys, "c");
+	check_prefix_iter(bptree, keys, removed, num_keys, "A");
+}
+
+static void test_bptree_iter_prefix()
+{
+	char      keys[PREFIX_MAX_KEYS][PREFIX_MAX_KEY_LEN + 1];
+	bool      removed[PREFIX_MAX_KEYS] = {false};
+	bptree_t *bptree;
+	int       num_keys, i;
+
+	assert_non_null(bptree = bptree_create(4));
+
+	/* prefix iteration on empty tree */
+	check_prefix_iter(bptree, keys, removed, 0, "a");
+
+	num_keys = gen_prefix_keys(keys, PREFIX_MAX_KEY_LEN);
+	assert_int_equal(num_keys, PREFIX_MAX_KEYS);
+
+	for (i = 0; i < num_keys; i++)
+		assert_int_equal(bptree_insert(bptree, keys[i], keys[i], sizeof(keys[i])), 0);
+	verify_bptree(bptree);
+	check_all_prefixes(bptree, keys, removed, num_keys);
+
+	/* removals leave internal node keys which are not in leaves anymore */
+	for (i = 0; i < num_keys; i += 3) {
+		assert_int_equal(bptree_remove(bptree, keys[i]), 0);
+		removed[i] = true;
+	}
+	verify_bptree(bptree);
+	check_all_prefixes(bptree, keys, removed, num_keys);
+
+	bptree_destroy(bptree);
+}
+
+#define PROP_NUM_KEYS      300
+#define PROP_KEY_LEN       8
+#define PROP_NUM_OPS       20000
+#define PROP_PHASE_OPS     1500
+#define PROP_CHECK_OPS     250
+#define PROP_COMPACT_OPS   3000
+#define BENCH_NUM_KEYS     10000
+#define BENCH_NUM_ROUNDS   10
+#define CONC_NUM_KEYS      512
+#define CONC_KEY_LEN       16
+#define CONC_NUM_READERS   8
+#define CONC_NUM_OPS       100000
+#define CONC_COMPACT_OPS   1000
+#define CONC_ITER_LOOKUPS  64
+#define CONC_BENCH_LOOKUPS 1000000
+
+/* reference: sorted array of keys present in the tree with their values */
+typedef struct prop_ref {
+	const char *keys[PROP_NUM_KEYS];
+	void       *values[PROP_NUM_KEYS];
+	int         num_keys;
+} prop_ref_t;
+
+static int prop_ref_find(prop_ref_t *ref, const char *key, bool *found)
+{
+	int lo = 0, hi = ref->num_keys, mid, r;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (!(r = strcmp(ref->keys[mid], key))) {
+			*found = true;
+			return mid;
+		}
+		if (r < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*found = false;
+	return lo;
+}
+
+static void prop_ref_insert(prop_ref_t *ref, const char *key, void *value)
+{
+	bool found;
+	int  i = prop_ref_find(ref, key, &found);
+
+	if (!found) {
+		memmove(&ref->keys[i + 1], &ref->keys[i], (ref->num_keys - i) * sizeof(ref->keys[0]));
+		memmove(&ref->values[i + 1], &ref->values[i], (ref->num_keys - i) * sizeof(ref->values[0]));
+		ref->keys[i] = key;
+		ref->num_keys++;
+	}
+	ref->values[i] = value;
+}
+
+static void prop_ref_remove(prop_ref_t *ref, const char *key)
+{
+	bool found;
+	int  i = prop_ref_find(ref, key, &found);
+
+	if (!found)
+		return;
+
+	memmove(&ref->keys[i], &ref->keys[i + 1], (ref->num_keys - i - 1) * sizeof(ref->keys[0]));
+	memmove(&ref->values[i], &ref->values[i + 1], (ref->num_keys - i - 1) * sizeof(ref->values[0]));
+	ref->num_keys--;
+}
+
+static void prop_check(bptree_t *bptree, prop_ref_t *ref, char keys[][PROP_KEY_LEN])
+{
+	bptree_iter_t *iter;
+	const char    *key;
+	void          *data;
+	bool           found;
+	int            i, j;
+
+	verify_bptree(bptree);
+	assert_int_equal(bptree_get_num_entries(bptree), ref->num_keys);
+
+	for (i = 0; i < PROP_NUM_KEYS; i++) {
+		j    = prop_ref_find(ref, keys[i], &found);
+		data = bptree_lookup(bptree, keys[i], NULL, NULL);
+		if (found)
+			assert_ptr_equal(data, ref->values[j]);
+		else
+			assert_null(data);
+	}
+
+	assert_non_null(iter = bptree_iter_create(bptree, NULL, NULL));
+	for (i = 0; (data = bptree_iter_next(iter, &key, NULL, NULL)); i++) {
+		assert_true(i < ref->num_keys);
+		assert_string_equal(key, ref->keys[i]);
+		assert_ptr_equal(data, ref->values[i]);
+	}
+	assert_int_equal(i, ref->num_keys);
+
+	/* keys "k1xxxx" */
+	bptree_iter_reset_prefix(iter, "k1", 2);
+	j = prop_ref_find(ref, "k1", &found);
+	for (i = j; bptree_iter_next(iter, &key, NULL, NULL); i++)
+		assert_string_equal(key, ref->keys[i]);
+	assert_true(i == ref->num_keys || strncmp(ref->keys[i], "k1", 2));
+	bptree_iter_destroy(iter);
+}
+
+/*
+ * Interleave random inserts and removes of a fixed set of keys and compare
+ * the tree with a reference sorted array. Phases with more inserts and more
+ * removes alternate so that the tree grows and shrinks down to empty.
+ */
+static void do_test_bptree_property(int order, unsigned merge_threshold, bool lazy_remove)
+{
+	char       keys[PROP_NUM_KEYS][PROP_KEY_LEN];
+	prop_ref_t ref  = {.num_keys = 0};
+	unsigned   seed = order * 100 + merge_threshold + lazy_remove;
+	bptree_t  *bptree;
+	intptr_t   value;
+	int        op, i, insert_pct;
+
+	for (i = 0; i < PROP_NUM_KEYS; i++)
+		snprintf(keys[i], PROP_KEY_LEN, "k%04d", (i * 7919) % 2000);
+
+	assert_non_null(bptree = bptree_create(order));
+	assert_int_equal(bptree_set_merge_threshold(bptree, merge_threshold), 0);
+	bptree_set_lazy_remove(bptree, lazy_remove);
+
+	for (op = 1; op <= PROP_NUM_OPS; op++) {
+		insert_pct = (op / PROP_PHASE_OPS) % 2 ? 25 : 75;
+		i          = rand_r(&seed) % PROP_NUM_KEYS;
+
+		if (rand_r(&seed) % 100 < insert_pct) {
+			value = op;
+			assert_int_equal(bptree_insert(bptree, keys[i], (void *) value, i), 0);
+			prop_ref_insert(&ref, keys[i], (void *) value);
+		} else {
+			assert_int_equal(bptree_remove(bptree, keys[i]), 0);
+			prop_ref_remove(&ref, keys[i]);
+		}
+
+		if (lazy_remove && op % PROP_COMPACT_OPS == 0) {
+			assert_int_equal(bptree_compact(bptree), 0);
+			assert_int_equal(bptree_get_num_tombstones(bptree), 0);
+		}
+
+		if (op % PROP_CHECK_OPS == 0)
+			prop_check(bptree, &ref, keys);
+	}
+
+	for (i = 0; i < PROP_NUM_KEYS; i++) {
+		assert_int_equal(bptree_remove(bptree, keys[i]), 0);
+		prop_ref_remove(&ref, keys[i]);
+	}
+	prop_check(bptree, &ref, keys);
+
+	if (lazy_remove) {
+		assert_int_equal(bptree_compact(bptree), 0);
+		assert_null(bptree->root);
+	}
+
+	bptree_destroy(bptree);
+}
+
+static void test_bptree_property()
+{
+	do_test_bptree_property(4, 50, false);
+	do_test_bptree_property(4, 25, false);
+	do_test_bptree_property(4, 1, false);
+	do_test_bptree_property(9, 50, false);
+	do_test_bptree_property(9, 20, false);
+	do_test_bptree_property(4, 50, true);
+	do_test_bptree_property(4, 25, true);
+	do_test_bptree_property(9, 20, true);
+}
+
+static void test_bptree_merge_threshold()
+{
+	bptree_t *bptree;
+
+	assert_non_null(bptree = bptree_create(4));
+	assert_int_equal(bptree->min_leaf_keys, 2);
+	assert_int_equal(bptree->min_node_keys, 1);
+	assert_int_equal(bptree_set_merge_threshold(bptree, 0), -1);
+	assert_int_equal(bptree_set_merge_threshold(bptree, 51), -1);
+	assert_int_equal(bptree_set_merge_threshold(bptree, 25), 0);
+	assert_int_equal(bptree->min_leaf_keys, 1);
+	assert_int_equal(bptree->min_node_keys, 1);
+	bptree_destroy(bptree);
+
+	assert_non_null(bptree = bptree_create(16));
+	assert_int_equal(bptree->min_leaf_keys, 8);
+	assert_int_equal(bptree->min_node_keys, 7);
+	assert_int_equal(bptree_set_merge_threshold(bptree, 50), 0);
+	assert_int_equal(bptree->min_leaf_keys, 8);
+	assert_int_equal(bptree->min_node_keys, 7);
+	assert_int_equal(bptree_set_merge_threshold(bptree, 25), 0);
+	assert_int_equal(bptree->min_leaf_keys, 4);
+	assert_int_equal(bptree->min_node_keys, 3);
+	bptree_destroy(bptree);
+}
+
+static void test_bptree_tombstones()
+{
+	checker_t *checker = init_checker(10);
+	bptree_t  *bptree  = bptree_create(4);
+	int        ids[]   = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+	int        rm_ids[] = {1, 2, 3, 5, 9};
+	int        height;
+
+	bptree_set_lazy_remove(bptree, true);
+	insert_from_checker_ids(bptree, checker, ids, 10);
+	height = bptree_get_height(bptree);
+	remove_from_checker_ids(bptree, checker, rm_ids, 5);
+	verify_bptree(bptree);
+	assert_int_equal(bptree_get_num_tombstones(bptree), 5);
+	assert_int_equal(bptree_get_height(bptree), height);
+	lookup_all_from_checker(bptree, checker);
+	bptree_iter(bptree, NULL, NULL, checker_fn, checker);
+	assert_checker_finished(checker);
+
+	/* reinserting removed keys reuses the tombstones */
+	insert_from_checker(bptree, checker, 2);
+	assert_int_equal(bptree_get_num_tombstones(bptree), 4);
+	assert_int_equal(bptree_insert_alias(bptree, checker->keys[2], checker->keys[3], false), 0);
+	assert_int_equal(bptree_get_num_tombstones(bptree), 3);
+	assert_ptr_equal(bptree_lookup(bptree, checker->keys[3], NULL, NULL), checker->values[2]);
+	assert_int_equal(bptree_remove(bptree, checker->keys[3]), 0);
+	verify_bptree(bptree);
+
+	assert_int_equal(bptree_compact(bptree), 0);
+	assert_int_equal(bptree_get_num_tombstones(bptree), 0);
+	verify_bptree(bptree);
+	checker->idx = 0;
+	lookup_all_from_checker(bptree, checker);
+	bptree_destroy_with_fn(bptree, checker_fn, checker);
+	assert_checker_finished(checker);
+	free_checker(checker);
+}
+
+static double bench_add_remove(const char *name, int order, unsigned merge_threshold, bool lazy_remove, char (*keys)[PROP_KEY_LEN])
+{
+	struct bench bench;
+	bptree_t    *bptree;
+	int          round, i;
+
+	assert_non_null(bptree = bptree_create(order));
+	assert_int_equal(bptree_set_merge_threshold(bptree, merge_threshold), 0);
+	bptree_set_lazy_remove(bptree, lazy_remove);
+
+	for (i = 0; i < BENCH_NUM_KEYS; i++)
+		assert_int_equal(bptree_insert(bptree, keys[i], keys[i], 0), 0);
+
+	bench_init(&bench, name);
+	bench_start(&bench);
+	for (round = 0; round < BENCH_NUM_ROUNDS; round++) {
+		for (i = 0; i < BENCH_NUM_KEYS; i++) {
+			assert_int_equal(bptree_remove(bptree, keys[i]), 0);
+			assert_int_equal(bptree_insert(bptree, keys[i], keys[i], 0), 0);
+		}
+	}
+	bench_stop(&bench, BENCH_NUM_ROUNDS * BENCH_NUM_KEYS);
+	assert_int_equal(bench_report(&bench), 0);
+	bench_destroy(&bench);
+
+	assert_int_equal(bptree_get_num_entries(bptree), BENCH_NUM_KEYS);
+	bptree_destroy(bptree);
+
+	return bench.nsec / 1e9;
+}
+
+/* remove each key and add it back right away */
+static void test_bptree_bench_add_remove()
+{
+	char (*keys)[PROP_KEY_LEN];
+	int    i;
+
+	assert_non_null(keys = calloc(BENCH_NUM_KEYS, PROP_KEY_LEN));
+	for (i = 0; i < BENCH_NUM_KEYS; i++)
+		snprintf(keys[i], PROP_KEY_LEN, "k%05d", (i * 7919) % BENCH_NUM_KEYS);
+
+	print_message("bptree add/remove of %d keys, %d rounds: merge 50%%: %.3fs, merge 25%%: %.3fs, lazy: %.3fs\n",
+	              BENCH_NUM_KEYS,
+	              BENCH_NUM_ROUNDS,
+	              bench_add_remove("bptree_add_remove_merge50", 4, 50, false, keys),
+	              bench_add_remove("bptree_add_remove_merge25", 4, 25, false, keys),
+	              bench_add_remove("bptree_add_remove_lazy", 4, 50, true, keys));
+	free(keys);
+}
+
+typedef struct {
+	uint64_t gen;
+	uint64_t idx;
+	uint64_t check;
+	char     key[CONC_KEY_LEN];
+} conc_value_t;
+
+typedef struct {
+	bptree_reader_t *reader;
+	char (*keys)[CONC_KEY_LEN];
+	int             *done;
+	unsigned         seed;
+	uint64_t         lookups;
+	uint64_t         found;
+	uint64_t         iterated;
+	uint64_t         errors;
+	const char      *last_key;
+} conc_reader_t;
+
+static void conc_key(char *buf, unsigned idx)
+{
+	snprintf(buf, CONC_KEY_LEN, "key%05u", idx);
+}
+
+/* the value must be written completely by the writer and must belong to the key */
+static bool conc_value_ok(conc_reader_t *r, const char *key, conc_value_t *value, size_t value_size)
+{
+	return value && value_size == sizeof(*value) && value->idx < CONC_NUM_KEYS &&
+	       value->check == value->gen * 31 + value->idx && !strcmp(value->key, key) && !strcmp(r->keys[value->idx], key);
+}
+
+static void conc_iter_fn(const char *key, void *data, size_t data_size, unsigned data_ref_count, void *arg)
+{
+	conc_reader_t *r = arg;
+
+	if (!conc_value_ok(r, key, data, data_size) || (r->last_key && strcmp(key, r->last_key) <= 0))
+		r->errors++;
+
+	r->last_key = key;
+	r->iterated++;
+}
+
+static void *conc_reader_fn(void *arg)
+{
+	conc_reader_t *r = arg;
+	conc_value_t  *value;
+	size_t         value_size;
+	unsigned       idx, end_idx;
+
+	while (!__atomic_load_n(r->done, __ATOMIC_ACQUIRE)) {
+		idx = rand_r(&r->seed) % CONC_NUM_KEYS;
+
+		bptree_read_begin(r->reader);
+
+		if ((value = bptree_reader_lookup(r->reader, r->keys[idx], &value_size, NULL))) {
+			if (conc_value_ok(r, r->keys[idx], value, value_size) && value->idx == idx)
+				r->found++;
+			else
+				r->errors++;
+		}
+
+		if (++r->lookups % CONC_ITER_LOOKUPS == 0) {
+			end_idx     = idx + rand_r(&r->seed) % (CONC_NUM_KEYS - idx);
+			r->last_key = NULL;
+			if (idx % 2)
+				bptree_reader_iter(r->reader, NULL, NULL, conc_iter_fn, r);
+			else
+				bptree_reader_iter(r->reader, r->keys[idx], r->keys[end_idx], conc_iter_fn, r);
+			if (r->last_key && idx % 2 == 0 && strcmp(r->last_key, r->keys[end_idx]) > 0)
+				r->errors++;
+		}
+
+		bptree_read_end(r->reader);
+	}
+
+	return NULL;
+}
+
+static conc_value_t *conc_make_value(char (*keys)[CONC_KEY_LEN], unsigned idx, uint64_t gen)
+{
+	conc_value_t *value;
+
+	assert_non_null(value = malloc(sizeof(*value)));
+	value->gen   = gen;
+	value->idx   = idx;
+	value->check = gen * 31 + idx;
+	memcpy(value->key, keys[idx], CONC_KEY_LEN);
+	return value;
+}
+
+static void conc_free_fn(const char *key, void *data, size_t data_size, unsigned data_ref_count, void *arg)
+{
+	free(data);
+}
+
+/*
+ * One writer inserts, replaces and removes values while reader threads look
+ * the keys up and iterate over ranges of keys, checking that they never see
+ * a torn value or a key with a value which does not belong to it.
+ */
+static void do_test_bptree_concurrent(int order, unsigned merge_threshold, bool lazy_remove)
+{
+	conc_reader_t readers[CONC_NUM_READERS];
+	pthread_t     threads[CONC_NUM_READERS];
+	conc_value_t *values[CONC_NUM_KEYS] = {0};
+	conc_value_t *value;
+	size_t        value_size = sizeof(*value);
+	char (*keys)[CONC_KEY_LEN];
+	bptree_t     *bptree;
+	uint64_t      found = 0, iterated = 0;
+	unsigned      seed  = 1, i, idx;
+	int           done  = 0, op;
+
+	assert_non_null(keys = calloc(CONC_NUM_KEYS, CONC_KEY_LEN));
+	for (i = 0; i < CONC_NUM_KEYS; i++)
+		conc_key(keys[i], i);
+
+	assert_non_null(bptree = bptree_create(order));
+	assert_int_equal(bptree_set_merge_threshold(bptree, merge_threshold), 0);
+	bptree_set_lazy_remove(bptree, lazy_remove);
+	assert_int_equal(bptree_set_concurrent(bptree, true), 0);
+
+	for (i = 0; i < CONC_NUM_READERS; i++) {
+		readers[i] = (conc_reader_t) {.keys = keys, .done = &done, .seed = i + 1};
+		assert_non_null(readers[i].reader = bptree_reader_create(bptree));
+		assert_int_equal(pthread_create(&threads[i], NULL, conc_reader_fn, &readers[i]), 0);
+	}
+
+	for (op = 1; op <= CONC_NUM_OPS; op++) {
+		idx = rand_r(&seed) % CONC_NUM_KEYS;
+
+		switch (rand_r(&seed) % 4) {
+			case 0:
+			case 1:
+				value = conc_make_value(keys, idx, op);
+				assert_int_equal(bptree_insert(bptree, keys[idx], value, sizeof(*value)), 0);
+				break;
+			case 2:
+				value = conc_make_value(keys, idx, op);
+				assert_int_equal(bptree_update(bptree, keys[idx], (void **) &value, &value_size, NULL, NULL), 0);
+				break;
+			default:
+				value = NULL;
+				assert_int_equal(bptree_remove(bptree, keys[idx]), 0);
+		}
+
+		/* readers may still use the old value */
+		if (values[idx])
+			bptree_free_deferred(bptree, values[idx]);
+		values[idx] = value;
+
+		if (lazy_remove && op % CONC_COMPACT_OPS == 0)
+			assert_int_equal(bptree_compact(bptree), 0);
+	}
+
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+
+	for (i = 0; i < CONC_NUM_READERS; i++) {
+		assert_int_equal(pthread_join(threads[i], NULL), 0);
+		assert_int_equal(readers[i].errors, 0);
+		found    += readers[i].found;
+		iterated += readers[i].iterated;
+	}
+
+	assert_true(found > 0);
+	assert_true(iterated > 0);
+
+	/* the tree is still consistent for the writer */
+	verify_bptree(bptree);
+	for (i = 0; i < CONC_NUM_KEYS; i++)
+		assert_ptr_equal(bptree_lookup(bptree, keys[i], NULL, NULL), values[i]);
+
+	/* concurrent mode can't be switched off while there are readers */
+	assert_int_equal(bptree_set_concurrent(bptree, false), -1);
+	for (i = 0; i < CONC_NUM_READERS; i++)
+		bptree_reader_destroy(readers[i].reader);
+	assert_int_equal(bptree_set_concurrent(bptree, false), 0);
+
+	bptree_destroy_with_fn(bptree, conc_free_fn, NULL);
+	free(keys);
+}
+
+static void test_bptree_concurrent()
+{
+	bptree_t *bptree;
+
+	assert_non_null(bptree = bptree_create(BPTREE_CONCURRENT_MAX_ORDER + 1));
+	assert_null(bptree_reader_create(bptree));
+	assert_int_equal(bptree_set_concurrent(bptree, true), -1);
+	bptree_destroy(bptree);
+
+	do_test_bptree_concurrent(4, 50, false);
+	do_test_bptree_concurrent(8, 25, true);
+}
+
+typedef struct {
+	bptree_reader_t *reader;
+	char (*keys)[PROP_KEY_LEN];
+	unsigned         seed;
+} conc_bench_t;
+
+static void *conc_bench_fn(void *arg)
+{
+	conc_bench_t *b = arg;
+	int           i;
+
+	for (i = 0; i < CONC_BENCH_LOOKUPS; i++) {
+		bptree_read_begin(b->reader);
+		assert_non_null(bptree_reader_lookup(b->reader, b->keys[rand_r(&b->seed) % BENCH_NUM_KEYS], NULL, NULL));
+		bptree_read_end(b->reader);
+	}
+
+	return NULL;
+}
+
+static double conc_secs(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* read throughput of lock-free readers compared to single-threaded lookup */
+static void test_bptree_bench_concurrent()
+{
+	conc_bench_t    bench[CONC_NUM_READERS];
+	pthread_t       threads[CONC_NUM_READERS];
+	struct timespec start, end;
+	bptree_t       *bptree;
+	char (*keys)[PROP_KEY_LEN];
+	double          single, one_reader;
+	unsigned        seed = 1;
+	int             i;
+
+	assert_non_null(keys = calloc(BENCH_NUM_KEYS, PROP_KEY_LEN));
+	assert_non_null(bptree = bptree_create(16));
+	assert_int_equal(bptree_set_concurrent(bptree, true), 0);
+	for (i = 0; i < BENCH_NUM_KEYS; i++) {
+		snprintf(keys[i], PROP_KEY_LEN, "k%05d", (i * 7919) % BENCH_NUM_KEYS);
+		assert_int_equal(bptree_insert(bptree, keys[i], keys[i], 0), 0);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < CONC_BENCH_LOOKUPS; i++)
+		assert_non_null(bptree_lookup(bptree, keys[rand_r(&seed) % BENCH_NUM_KEYS], NULL, NULL));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	single = CONC_BENCH_LOOKUPS / conc_secs(&start, &end);
+
+	for (i = 0; i < CONC_NUM_READERS; i++) {
+		bench[i] = (conc_bench_t) {.keys = keys, .seed = i + 1};
+		assert_non_null(bench[i].reader = bptree_reader_create(bptree));
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	conc_bench_fn(&bench[0]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	one_reader = CONC_BENCH_LOOKUPS / conc_secs(&start, &end);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < CONC_NUM_READERS; i++)
+		assert_int_equal(pthread_create(&threads[i], NULL, conc_bench_fn, &bench[i]), 0);
+	for (i = 0; i < CONC_NUM_READERS; i++)
+		assert_int_equal(pthread_join(threads[i], NULL), 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	print_message("bptree lookups of %d keys: single-threaded: %.0f/s, 1 reader: %.0f/s, %d readers: %.0f/s\n",
+	              BENCH_NUM_KEYS,
+	              single,
+	              one_reader,
+	              CONC_NUM_READERS,
+	              (double) CONC_NUM_READERS * CONC_BENCH_LOOKUPS / conc_secs(&start, &end));
+
+	for (i = 0; i < CONC_NUM_READERS; i++)
+		bptree_reader_destroy(bench[i].reader);
+	bptree_destroy(bptree);
+	free(keys);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -628,6 +1322,13 @@ int main(void)
 		cmocka_unit_test(test_coalesce_coalesce_right),
 		cmocka_unit_test(test_coalesce_till_root),
 		cmocka_unit_test(test_bptree_remove_3_height),
+		cmocka_unit_test(test_bptree_iter_prefix),
+		cmocka_unit_test(test_bptree_merge_threshold),
+		cmocka_unit_test(test_bptree_tombstones),
+		cmocka_unit_test(test_bptree_property),
+		cmocka_unit_test(test_bptree_bench_add_remove),
+		cmocka_unit_test(test_bptree_concurrent),
+		cmocka_unit_test(test_bptree_bench_concurrent),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -1,10 +1,14 @@
 #include "base/buffer.h"
+#include "bench.h"
 
 #include <errno.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include <cmocka.h>
 
@@ -15,6 +19,10 @@
 #define TEST_STR3  "quux"
 #define TEST_SIZE3 sizeof(TEST_STR3)
 
+#define TEST_PRESIZE        8192 /* initial size of receiving buffer, same as default for client connections */
+#define TEST_BENCH_MSG_SIZE 3072 /* usual size of scan request with udev environment */
+#define TEST_BENCH_ROUNDS   20000
+
 int test_fmt_add(int buf_size)
 {
 	int                r   = 0;
@@ -194,6 +202,175 @@ static void test_vector_prefix_get_data_from(void **state)
 	do_test_get_data_from(SID_BUFFER_TYPE_VECTOR, SID_BUFFER_MODE_SIZE_PREFIX);
 }
 
+static struct sid_buffer *_create_prefix_buf(size_t size)
+{
+	struct sid_buffer *buf;
+
+	buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                    .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                    .mode    = SID_BUFFER_MODE_SIZE_PREFIX}),
+	                        &((struct sid_buffer_init) {.size = size, .alloc_step = 1, .limit = 0}),
+	                        NULL);
+	assert_non_null(buf);
+
+	return buf;
+}
+
+/* Send size-prefixed message with 'size' bytes of data the same way clients do. */
+static void _send_msg(int fd, size_t size)
+{
+	struct sid_buffer *buf = _create_prefix_buf(0);
+	char              *data;
+
+	assert_int_equal(sid_buffer_add(buf, NULL, size, (const void **) &data, NULL), 0);
+	memset(data, 'x', size);
+	assert_int_equal(sid_buffer_write_all(buf, fd), 0);
+	sid_buffer_destroy(buf);
+}
+
+/* Receive one message and return number of reads (each sid_buffer_read does exactly one read syscall). */
+static unsigned _recv_msg(struct sid_buffer *buf, int fd)
+{
+	unsigned reads = 0;
+
+	do {
+		assert_true(sid_buffer_read(buf, fd) > 0);
+		reads++;
+	} while (!sid_buffer_is_complete(buf, NULL));
+
+	return reads;
+}
+
+static void do_test_prefix_read(size_t init_size, size_t msg_size, unsigned expected_reads)
+{
+	struct sid_buffer *buf;
+	const char        *data;
+	size_t             size, i;
+	int                fds[2];
+	int                round;
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+	buf = _create_prefix_buf(init_size);
+
+	/* the buffer is reused for the next message after reset, it must behave the same */
+	for (round = 0; round < 2; round++) {
+		_send_msg(fds[0], msg_size);
+		assert_int_equal(_recv_msg(buf, fds[1]), expected_reads);
+
+		assert_int_equal(sid_buffer_get_data(buf, (const void **) &data, &size), 0);
+		assert_int_equal(size, msg_size);
+		for (i = 0; i < size; i++)
+			assert_int_equal(data[i], 'x');
+
+		/* grown straight to the message size, no intermediate steps */
+		if (msg_size > init_size)
+			assert_int_equal(sid_buffer_stat(buf).usage.allocated, msg_size + SID_BUFFER_SIZE_PREFIX_LEN);
+		else
+			assert_int_equal(sid_buffer_stat(buf).usage.allocated, init_size + SID_BUFFER_SIZE_PREFIX_LEN);
+
+		assert_int_equal(sid_buffer_reset(buf), 0);
+		assert_int_equal(sid_buffer_stat(buf).usage.allocated, init_size + SID_BUFFER_SIZE_PREFIX_LEN);
+	}
+
+	sid_buffer_destroy(buf);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void test_prefix_read_unsized(void **state)
+{
+	/* size prefix first, then the rest */
+	do_test_prefix_read(0, 100, 2);
+}
+
+static void test_prefix_read_smaller(void **state)
+{
+	do_test_prefix_read(TEST_PRESIZE, 100, 1);
+}
+
+static void test_prefix_read_equal(void **state)
+{
+	do_test_prefix_read(TEST_PRESIZE, TEST_PRESIZE, 1);
+}
+
+static void test_prefix_read_larger(void **state)
+{
+	/* initial capacity first, then the rest after growing to the size from prefix */
+	do_test_prefix_read(TEST_PRESIZE, 4 * TEST_PRESIZE, 2);
+}
+
+static void test_prefix_read_overrun(void **state)
+{
+	struct sid_buffer *buf;
+	int                fds[2];
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+	buf = _create_prefix_buf(TEST_PRESIZE);
+
+	/* peer sending another message without waiting for reply is detected */
+	_send_msg(fds[0], 100);
+	_send_msg(fds[0], 100);
+	assert_int_equal(sid_buffer_read(buf, fds[1]), -EBADMSG);
+
+	/* premature EOF */
+	assert_int_equal(sid_buffer_reset(buf), 0);
+	assert_int_equal(write(fds[0], "\xff\0\0\0", SID_BUFFER_SIZE_PREFIX_LEN), SID_BUFFER_SIZE_PREFIX_LEN);
+	close(fds[0]);
+	assert_int_equal(sid_buffer_read(buf, fds[1]), SID_BUFFER_SIZE_PREFIX_LEN);
+	assert_int_equal(sid_buffer_read(buf, fds[1]), -EBADMSG);
+
+	sid_buffer_destroy(buf);
+	close(fds[1]);
+}
+
+static unsigned bench_prefix_read(const char *name, size_t init_size)
+{
+	struct sid_buffer *buf;
+	struct bench       bench;
+	unsigned           reads = 0;
+	int                fds[2];
+	int                i;
+
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+	buf = _create_prefix_buf(init_size);
+
+	bench_init(&bench, name);
+	bench_start(&bench);
+
+	for (i = 0; i < TEST_BENCH_ROUNDS; i++) {
+		_send_msg(fds[0], TEST_BENCH_MSG_SIZE);
+		reads += _recv_msg(buf, fds[1]);
+		(void) sid_buffer_reset(buf);
+	}
+
+	bench_stop(&bench, TEST_BENCH_ROUNDS);
+	assert_int_equal(bench_report(&bench), 0);
+	bench_destroy(&bench);
+
+	sid_buffer_destroy(buf);
+	close(fds[0]);
+	close(fds[1]);
+
+	return reads;
+}
+
+static void test_prefix_read_bench(void **state)
+{
+	unsigned unsized, presized;
+
+	unsized  = bench_prefix_read("buffer_prefix_read_unsized", 0);
+	presized = bench_prefix_read("buffer_prefix_read_presized", TEST_PRESIZE);
+
+	print_message("receiving %d byte messages: %.2f reads per message with unsized buffer, %.2f with %d byte buffer\n",
+	              TEST_BENCH_MSG_SIZE,
+	              (double) unsized / TEST_BENCH_ROUNDS,
+	              (double) presized / TEST_BENCH_ROUNDS,
+	              TEST_PRESIZE);
+
+	assert_int_equal(presized, TEST_BENCH_ROUNDS);
+	assert_true(presized < unsized);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -213,6 +390,12 @@ int main(void)
 		cmocka_unit_test(test_linear_prefix_get_data_from),
 		cmocka_unit_test(test_vector_plain_get_data_from),
 		cmocka_unit_test(test_vector_prefix_get_data_from),
+		cmocka_unit_test(test_prefix_read_unsized),
+		cmocka_unit_test(test_prefix_read_smaller),
+		cmocka_unit_test(test_prefix_read_equal),
+		cmocka_unit_test(test_prefix_read_larger),
+		cmocka_unit_test(test_prefix_read_overrun),
+		cmocka_unit_test(test_prefix_read_bench),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,345 @@
+#include "base/comms.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#define TEST_PATH_SIZE         64
+#define TEST_NR_CONNECTIONS    1024
+#define TEST_NR_ACCEPTORS      8
+#define TEST_NR_CONNECTORS     64
+#define TEST_POLL_TIMEOUT_MSEC 10
+#define TEST_BENCH_NR_CONNECTS 2000
+
+struct test_socket {
+	char   path[TEST_PATH_SIZE];
+	size_t path_len;
+	int    fd;
+};
+
+struct test_acceptor {
+	int            socket_fd;
+	int            watch_fd;
+	volatile bool *done;
+	unsigned      *served;
+	uint64_t       accepted;
+	uint64_t       missed;
+	uint64_t       errors;
+};
+
+struct test_connector {
+	struct test_socket *sock;
+	unsigned            first;
+	unsigned            count;
+	uint64_t            errors;
+};
+
+struct test_server {
+	int            socket_fd;
+	int            watch_fd;
+	int            chan_fd;
+	volatile bool *done;
+};
+
+static void _socket_create(struct test_socket *sock)
+{
+	/* abstract socket, nothing to clean up in the filesystem */
+	sock->path[0]  = '\0';
+	sock->path_len = 1 + snprintf(sock->path + 1, sizeof(sock->path) - 1, "sid-test-comms-%d", getpid());
+	sock->fd       = sid_comms_unix_create(sock->path, sock->path_len, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC);
+	assert_true(sock->fd >= 0);
+}
+
+static bool _wait_readable(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+	return poll(&pfd, 1, TEST_POLL_TIMEOUT_MSEC) > 0;
+}
+
+/* Accept next connection or return -1 if there's none within poll timeout. */
+static int _accept(int socket_fd, int watch_fd, uint64_t *missed)
+{
+	int fd;
+
+	if (!_wait_readable(watch_fd >= 0 ? watch_fd : socket_fd))
+		return -1;
+
+	if ((fd = sid_comms_unix_accept(socket_fd, watch_fd)) < 0) {
+		if (fd == -EAGAIN && missed)
+			(*missed)++;
+		return -1;
+	}
+
+	/* accepted connections are non-blocking, simple blocking I/O is enough here */
+	(void) fcntl(fd, F_SETFL, 0);
+	return fd;
+}
+
+static void *_acceptor_fn(void *arg)
+{
+	struct test_acceptor *acceptor = arg;
+	unsigned              idx;
+	char                  byte = 1;
+	int                   fd;
+
+	while (!*acceptor->done) {
+		if ((fd = _accept(acceptor->socket_fd, acceptor->watch_fd, &acceptor->missed)) < 0)
+			continue;
+
+		if (read(fd, &idx, sizeof(idx)) != sizeof(idx) || idx >= TEST_NR_CONNECTIONS ||
+		    write(fd, &byte, sizeof(byte)) != sizeof(byte))
+			acceptor->errors++;
+		else {
+			__atomic_add_fetch(&acceptor->served[idx], 1, __ATOMIC_RELAXED);
+			acceptor->accepted++;
+		}
+
+		(void) close(fd);
+	}
+
+	return NULL;
+}
+
+static void *_connector_fn(void *arg)
+{
+	struct test_connector *connector = arg;
+	unsigned               idx;
+	char                   byte;
+	int                    fd;
+
+	for (idx = connector->first; idx < connector->first + connector->count; idx++) {
+		if ((fd = sid_comms_unix_init(connector->sock->path, connector->sock->path_len, SOCK_STREAM)) < 0) {
+			connector->errors++;
+			continue;
+		}
+
+		if (write(fd, &idx, sizeof(idx)) != sizeof(idx) || read(fd, &byte, sizeof(byte)) != sizeof(byte))
+			connector->errors++;
+
+		(void) close(fd);
+	}
+
+	return NULL;
+}
+
+/*
+ * Several acceptors, each with its own exclusive watch of the same listening socket,
+ * race for connections coming from many connectors at once. Each connection sends
+ * its index and it must be served by exactly one acceptor.
+ */
+static void test_comms_accept_exclusive(void **state)
+{
+	struct test_socket    sock;
+	struct test_acceptor  acceptors[TEST_NR_ACCEPTORS];
+	struct test_connector connectors[TEST_NR_CONNECTORS];
+	pthread_t             acceptor_threads[TEST_NR_ACCEPTORS];
+	pthread_t             connector_threads[TEST_NR_CONNECTORS];
+	unsigned             *served;
+	volatile bool         done     = false;
+	uint64_t              accepted = 0, missed = 0;
+	unsigned              i;
+
+	assert_non_null(served = calloc(TEST_NR_CONNECTIONS, sizeof(*served)));
+	_socket_create(&sock);
+
+	for (i = 0; i < TEST_NR_ACCEPTORS; i++) {
+		acceptors[i] = (struct test_acceptor) {.socket_fd = sock.fd,
+		                                       .watch_fd  = sid_comms_unix_accept_watch(sock.fd),
+		                                       .done      = &done,
+		                                       .served    = served};
+		assert_true(acceptors[i].watch_fd >= 0);
+		assert_int_equal(pthread_create(&acceptor_threads[i], NULL, _acceptor_fn, &acceptors[i]), 0);
+	}
+
+	for (i = 0; i < TEST_NR_CONNECTORS; i++) {
+		connectors[i] = (struct test_connector) {.sock  = &sock,
+		                                         .first = i * (TEST_NR_CONNECTIONS / TEST_NR_CONNECTORS),
+		                                         .count = TEST_NR_CONNECTIONS / TEST_NR_CONNECTORS};
+		assert_int_equal(pthread_create(&connector_threads[i], NULL, _connector_fn, &connectors[i]), 0);
+	}
+
+	for (i = 0; i < TEST_NR_CONNECTORS; i++) {
+		assert_int_equal(pthread_join(connector_threads[i], NULL), 0);
+		assert_int_equal(connectors[i].errors, 0);
+	}
+
+	done = true;
+
+	for (i = 0; i < TEST_NR_ACCEPTORS; i++) {
+		assert_int_equal(pthread_join(acceptor_threads[i], NULL), 0);
+		assert_int_equal(acceptors[i].errors, 0);
+		accepted += acceptors[i].accepted;
+		missed   += acceptors[i].missed;
+		(void) close(acceptors[i].watch_fd);
+	}
+
+	assert_int_equal(accepted, TEST_NR_CONNECTIONS);
+	for (i = 0; i < TEST_NR_CONNECTIONS; i++)
+		assert_int_equal(served[i], 1);
+
+	print_message("exclusive accept: %u connections, %" PRIu64 " wakeups without a connection\n",
+	              TEST_NR_CONNECTIONS,
+	              missed);
+
+	(void) close(sock.fd);
+	free(served);
+}
+
+static void test_comms_accept_empty(void **state)
+{
+	struct test_socket sock;
+	int                watch_fd;
+
+	_socket_create(&sock);
+	assert_true((watch_fd = sid_comms_unix_accept_watch(sock.fd)) >= 0);
+
+	assert_int_equal(sid_comms_unix_accept(sock.fd, watch_fd), -EAGAIN);
+	assert_int_equal(sid_comms_unix_accept(sock.fd, -1), -EAGAIN);
+	assert_true(sid_comms_unix_accept_watch(-1) < 0);
+
+	(void) close(watch_fd);
+	(void) close(sock.fd);
+}
+
+/* Worker accepting connections itself. */
+static void *_direct_worker_fn(void *arg)
+{
+	struct test_server *server = arg;
+	char                byte   = 1;
+	int                 fd;
+
+	while (!*server->done) {
+		if ((fd = _accept(server->socket_fd, server->watch_fd, NULL)) < 0)
+			continue;
+
+		(void) write(fd, &byte, sizeof(byte));
+		(void) close(fd);
+	}
+
+	return NULL;
+}
+
+/* Main process accepting connections and passing them to a worker. */
+static void *_main_fn(void *arg)
+{
+	struct test_server *server = arg;
+	char                byte   = 0;
+	int                 fd;
+
+	while (!*server->done) {
+		if ((fd = _accept(server->socket_fd, -1, NULL)) < 0)
+			continue;
+
+		(void) sid_comms_unix_send(server->chan_fd, &byte, sizeof(byte), fd);
+		(void) close(fd);
+	}
+
+	return NULL;
+}
+
+static void *_passed_worker_fn(void *arg)
+{
+	struct test_server *server = arg;
+	char                byte;
+	int                 fd;
+
+	while (!*server->done) {
+		if (!_wait_readable(server->chan_fd) || sid_comms_unix_recv(server->chan_fd, &byte, sizeof(byte), &fd) <= 0 ||
+		    fd < 0)
+			continue;
+
+		byte = 1;
+		(void) write(fd, &byte, sizeof(byte));
+		(void) close(fd);
+	}
+
+	return NULL;
+}
+
+static double _bench_first_byte_usec(struct test_socket *sock)
+{
+	struct timespec start, end;
+	double          usec = 0;
+	char            byte;
+	unsigned        i;
+	int             fd;
+
+	for (i = 0; i < TEST_BENCH_NR_CONNECTS; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		assert_true((fd = sid_comms_unix_init(sock->path, sock->path_len, SOCK_STREAM)) >= 0);
+		assert_int_equal(read(fd, &byte, sizeof(byte)), sizeof(byte));
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		(void) close(fd);
+
+		usec += (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+	}
+
+	return usec / TEST_BENCH_NR_CONNECTS;
+}
+
+static void test_comms_accept_bench(void **state)
+{
+	struct test_socket sock;
+	struct test_server server, worker;
+	pthread_t          threads[2];
+	volatile bool      done;
+	int                chan[2];
+	double             passed_usec, direct_usec;
+
+	_socket_create(&sock);
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, chan), 0);
+
+	/* accepted in main and passed over to the worker */
+	done   = false;
+	server = (struct test_server) {.socket_fd = sock.fd, .watch_fd = -1, .chan_fd = chan[0], .done = &done};
+	worker = (struct test_server) {.socket_fd = -1, .watch_fd = -1, .chan_fd = chan[1], .done = &done};
+	assert_int_equal(pthread_create(&threads[0], NULL, _main_fn, &server), 0);
+	assert_int_equal(pthread_create(&threads[1], NULL, _passed_worker_fn, &worker), 0);
+	passed_usec = _bench_first_byte_usec(&sock);
+	done        = true;
+	assert_int_equal(pthread_join(threads[0], NULL), 0);
+	assert_int_equal(pthread_join(threads[1], NULL), 0);
+
+	/* accepted directly in the worker */
+	done   = false;
+	server = (struct test_server) {.socket_fd = sock.fd, .watch_fd = sid_comms_unix_accept_watch(sock.fd), .done = &done};
+	assert_true(server.watch_fd >= 0);
+	assert_int_equal(pthread_create(&threads[0], NULL, _direct_worker_fn, &server), 0);
+	direct_usec = _bench_first_byte_usec(&sock);
+	done        = true;
+	assert_int_equal(pthread_join(threads[0], NULL), 0);
+
+	print_message("accept to first byte: passed by main %.1f usec, accepted by worker %.1f usec\n", passed_usec, direct_usec);
+
+	(void) close(server.watch_fd);
+	(void) close(chan[0]);
+	(void) close(chan[1]);
+	(void) close(sock.fd);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_comms_accept_empty),
+		cmocka_unit_test(test_comms_accept_exclusive),
+		cmocka_unit_test(test_comms_accept_bench),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
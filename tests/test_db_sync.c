@@ -7,9 +7,11 @@
 #include "../src/internal/mem.c"
 #include "../src/resource/kv-store.c"
 #include "../src/resource/ubridge.c"
+#include "bench.h"
 #include "ucmd-module.h"
 
 #include <sys/socket.h>
+#include <sys/wait.h>
 
 #include <cmocka.h>
 
@@ -18,6 +20,16 @@
 #define VALUE3 "xyzzy"
 #define VALUE4 "foobar"
 
+#define NR_SLICED_EXPORTS     16
+#define NR_SLICED_RECORDS     2048 /* per export */
+#define NR_BIG_EXPORT_RECORDS 200000
+#define SLICE_MAX_RECORDS     4096
+#define SLICE_MAX_USEC        1000
+
+#define WORKER_CMD_ID      "fakecmd"
+#define NR_LATENCY_ROUNDS  1000
+#define NR_LATENCY_RECORDS 64
+
 struct sid_ucmd_common_ctx *_create_common_ctx(void)
 {
 	struct sid_ucmd_common_ctx *common_ctx;
@@ -38,6 +50,7 @@ struct sid_ucmd_common_ctx *_create_common_ctx(void)
 	                                        NULL);
 	assert_non_null(common_ctx->gen_buf);
 	common_ctx->gennum = 1;
+	list_init(&common_ctx->sync.queue);
 	return common_ctx;
 }
 
@@ -177,7 +190,7 @@ static void _set_kv(struct sid_ucmd_ctx *ucmd_ctx, const char *core, char **data
 	key_spec.core = core;
 	assert_non_null(key = _compose_key(ucmd_ctx->common->gen_buf, &key_spec));
 
-	VVALUE_HEADER_PREP(vvalue, ucmd_ctx->common->gennum, ucmd_ctx->req_env.dev.udev.seqnum, flags, (char *) owner);
+	VVALUE_HEADER_PREP(vvalue, ucmd_ctx->req_env.dev.udev.seqnum, flags, ucmd_ctx->common->gennum, (char *) owner);
 	for (i = 0; i < nr_data; i++)
 		VVALUE_DATA_PREP(vvalue, i, data[i], data[i] ? strlen(data[i]) + 1 : 0);
 
@@ -210,7 +223,7 @@ static void _set_broken_kv(struct sid_ucmd_ctx *ucmd_ctx, const char *core)
 	key_spec.core                   = core;
 	assert_non_null(key = _compose_key(ucmd_ctx->common->gen_buf, &key_spec));
 
-	VVALUE_HEADER_PREP(vvalue, ucmd_ctx->common->gennum, ucmd_ctx->req_env.dev.udev.seqnum, flags, (char *) owner);
+	VVALUE_HEADER_PREP(vvalue, ucmd_ctx->req_env.dev.udev.seqnum, flags, ucmd_ctx->common->gennum, (char *) owner);
 	assert_non_null(kv_store_set_value(ucmd_ctx->common->kv_store_res,
 	                                   key,
 	                                   vvalue,
@@ -665,6 +678,484 @@ static void test_multi_broken_3(void **state)
 	compare_dumps(old, new);
 }
 
+static void _set_many_kvs(struct sid_ucmd_ctx *ucmd_ctx, unsigned first, unsigned nr)
+{
+	char     core[32];
+	char     value[32];
+	char    *data[] = {value};
+	unsigned i;
+
+	for (i = first; i < first + nr; i++) {
+		snprintf(core, sizeof(core), "key%u", i);
+		snprintf(value, sizeof(value), "value%u", i);
+		_set_kv(ucmd_ctx, core, data, ARRAY_LEN(data), KV_OP_SET, i % 2);
+	}
+}
+
+static void _compare_stores(sid_resource_t *kv_store_res1, sid_resource_t *kv_store_res2)
+{
+	kv_store_iter_t       *iter1, *iter2;
+	const char            *key1, *key2;
+	void                  *value1, *value2;
+	kv_vector_t            tmp_vvalue1[VVALUE_SINGLE_CNT], tmp_vvalue2[VVALUE_SINGLE_CNT];
+	kv_vector_t           *vvalue1, *vvalue2;
+	kv_store_value_flags_t flags1, flags2;
+	size_t                 size1, size2, nr, i;
+
+	assert_int_equal(kv_store_num_entries(kv_store_res1), kv_store_num_entries(kv_store_res2));
+	assert_non_null(iter1 = kv_store_iter_create(kv_store_res1, NULL, NULL));
+	assert_non_null(iter2 = kv_store_iter_create(kv_store_res2, NULL, NULL));
+
+	while ((value1 = kv_store_iter_next(iter1, &size1, &key1, &flags1))) {
+		assert_non_null(value2 = kv_store_iter_next(iter2, &size2, &key2, &flags2));
+		assert_string_equal(key1, key2);
+		assert_int_equal(flags1, flags2);
+		assert_int_equal(size1, size2);
+
+		vvalue1 = _get_vvalue(flags1, value1, size1, tmp_vvalue1);
+		vvalue2 = _get_vvalue(flags2, value2, size2, tmp_vvalue2);
+		nr      = (flags1 & KV_STORE_VALUE_VECTOR) ? size1 : VVALUE_SINGLE_CNT;
+
+		for (i = 0; i < nr; i++) {
+			assert_int_equal(vvalue1[i].iov_len, vvalue2[i].iov_len);
+			if (vvalue1[i].iov_len)
+				assert_memory_equal(vvalue1[i].iov_base, vvalue2[i].iov_base, vvalue1[i].iov_len);
+		}
+	}
+	assert_null(kv_store_iter_next(iter2, &size2, &key2, &flags2));
+
+	kv_store_iter_destroy(iter1);
+	kv_store_iter_destroy(iter2);
+}
+
+static void _queue_sync(struct test_state *ts, int fd)
+{
+	struct kv_sync *sync;
+
+	assert_non_null(sync = _create_main_kv_store_sync(ts->main_res, fd, NULL, NULL, 0));
+	list_add(&ts->main_ctx->common->sync.queue, &sync->list);
+}
+
+/*
+ * Queue an export of 'nr' records to main KV store. If 'ref_res' is defined, the export
+ * is also synced with its KV store at once, to compare with the result of sliced syncs.
+ */
+static void _queue_many_kvs(struct test_state *ts, sid_resource_t *ref_res, unsigned first, unsigned nr, bool broken)
+{
+	sid_resource_t      *work_res = _create_fake_cmd_res();
+	struct sid_ucmd_ctx *work_ctx = sid_resource_get_data(work_res);
+	int                  fd;
+
+	_set_many_kvs(work_ctx, first, nr);
+	if (broken)
+		_set_broken_kv(work_ctx, "zzz");
+	fd = _do_build_buffers(work_res);
+
+	if (ref_res) {
+		assert_int_equal(_sync_main_kv_store(ref_res, ((struct sid_ucmd_ctx *) sid_resource_get_data(ref_res))->common, fd),
+		                 broken ? -1 : 0);
+		assert_int_equal(lseek(fd, 0, SEEK_SET), 0);
+	}
+
+	_queue_sync(ts, fd);
+	sid_resource_unref(work_res);
+}
+
+static void test_sliced_records(void **state)
+{
+	struct test_state          *ts         = *state;
+	struct sid_ucmd_common_ctx *common_ctx = ts->main_ctx->common;
+	sid_resource_t             *ref_res    = _create_fake_cmd_res();
+	struct sid_ucmd_ctx        *ref_ctx    = sid_resource_get_data(ref_res);
+	size_t                      entries, last_entries = 0;
+	unsigned                    i, slices = 0;
+
+	for (i = 0; i < NR_SLICED_EXPORTS; i++)
+		_queue_many_kvs(ts, ref_res, i * NR_SLICED_RECORDS, NR_SLICED_RECORDS, false);
+
+	while (_sync_main_kv_store_slice(ts->main_res, common_ctx, SLICE_MAX_RECORDS, 0) > 0) {
+		/* the budget is a multiple of the export size, each slice ends between exports */
+		assert_false(kv_store_in_transaction(common_ctx->kv_store_res));
+		entries = kv_store_num_entries(common_ctx->kv_store_res);
+		assert_int_equal(entries - last_entries, SLICE_MAX_RECORDS);
+		last_entries = entries;
+		slices++;
+	}
+
+	assert_int_equal(slices, NR_SLICED_EXPORTS * NR_SLICED_RECORDS / SLICE_MAX_RECORDS - 1);
+	assert_false(kv_store_in_transaction(common_ctx->kv_store_res));
+	assert_true(list_is_empty(&common_ctx->sync.queue));
+	_compare_stores(ref_ctx->common->kv_store_res, common_ctx->kv_store_res);
+
+	sid_resource_unref(ref_res);
+}
+
+static void test_sliced_big_export(void **state)
+{
+	struct test_state          *ts         = *state;
+	struct sid_ucmd_common_ctx *common_ctx = ts->main_ctx->common;
+	sid_resource_t             *ref_res    = _create_fake_cmd_res();
+	struct sid_ucmd_ctx        *ref_ctx    = sid_resource_get_data(ref_res);
+	size_t                      entries, last_entries = 0;
+	unsigned                    slices = 0;
+	struct kv_sync             *sync;
+
+	_queue_many_kvs(ts, ref_res, 0, NR_BIG_EXPORT_RECORDS, false);
+	sync = list_item(common_ctx->sync.queue.n, struct kv_sync);
+	_queue_many_kvs(ts, ref_res, NR_BIG_EXPORT_RECORDS, 1, false);
+
+	while (_sync_main_kv_store_slice(ts->main_res, common_ctx, SLICE_MAX_RECORDS, 0) > 0) {
+		/* a single export is applied across slices, within one transaction kept open in between */
+		assert_true(kv_store_in_transaction(common_ctx->kv_store_res));
+		assert_ptr_equal(list_item(common_ctx->sync.queue.n, struct kv_sync), sync);
+		entries = kv_store_num_entries(common_ctx->kv_store_res);
+		assert_int_equal(entries - last_entries, SLICE_MAX_RECORDS);
+		last_entries = entries;
+		slices++;
+	}
+
+	assert_int_equal(slices, NR_BIG_EXPORT_RECORDS / SLICE_MAX_RECORDS);
+	assert_false(kv_store_in_transaction(common_ctx->kv_store_res));
+	assert_true(list_is_empty(&common_ctx->sync.queue));
+	assert_int_equal(kv_store_num_entries(common_ctx->kv_store_res), NR_BIG_EXPORT_RECORDS + 1);
+	_compare_stores(ref_ctx->common->kv_store_res, common_ctx->kv_store_res);
+
+	sid_resource_unref(ref_res);
+}
+
+static void test_sliced_time(void **state)
+{
+	struct test_state          *ts         = *state;
+	struct sid_ucmd_common_ctx *common_ctx = ts->main_ctx->common;
+	sid_resource_t             *ref_res    = _create_fake_cmd_res();
+	struct sid_ucmd_ctx        *ref_ctx    = sid_resource_get_data(ref_res);
+	unsigned                    slices     = 0;
+
+	_queue_many_kvs(ts, ref_res, 0, NR_BIG_EXPORT_RECORDS, false);
+
+	while (_sync_main_kv_store_slice(ts->main_res, common_ctx, UINT_MAX, SLICE_MAX_USEC) > 0) {
+		assert_true(kv_store_in_transaction(common_ctx->kv_store_res));
+		slices++;
+	}
+
+	/* there's no record limit, the export is split by the time limit only */
+	assert_true(slices > 0);
+	assert_false(kv_store_in_transaction(common_ctx->kv_store_res));
+	assert_true(list_is_empty(&common_ctx->sync.queue));
+	_compare_stores(ref_ctx->common->kv_store_res, common_ctx->kv_store_res);
+
+	sid_resource_unref(ref_res);
+}
+
+static void test_sliced_broken(void **state)
+{
+	struct test_state          *ts         = *state;
+	struct sid_ucmd_common_ctx *common_ctx = ts->main_ctx->common;
+	sid_resource_t             *ref_res    = _create_fake_cmd_res();
+	struct sid_ucmd_ctx        *ref_ctx    = sid_resource_get_data(ref_res);
+	char                       *data[]     = {VALUE1, VALUE2};
+	unsigned                    slices     = 0;
+
+	_set_kv(ts->main_ctx, "base", data, ARRAY_LEN(data), KV_OP_SET, true);
+	_set_kv(ref_ctx, "base", data, ARRAY_LEN(data), KV_OP_SET, true);
+
+	_queue_many_kvs(ts, ref_res, 0, NR_SLICED_RECORDS, false);
+	_queue_many_kvs(ts, ref_res, NR_SLICED_RECORDS, 4 * SLICE_MAX_RECORDS, true);
+	_queue_many_kvs(ts, ref_res, NR_SLICED_RECORDS + 4 * SLICE_MAX_RECORDS, NR_SLICED_RECORDS, false);
+
+	/* count the slices which end in the middle of the broken export */
+	while (_sync_main_kv_store_slice(ts->main_res, common_ctx, SLICE_MAX_RECORDS, 0) > 0) {
+		if (kv_store_in_transaction(common_ctx->kv_store_res))
+			slices++;
+	}
+
+	/* the broken export is rolled back across all its slices, the exports around it are applied */
+	assert_true(slices > 1);
+	assert_false(kv_store_in_transaction(common_ctx->kv_store_res));
+	assert_int_equal(kv_store_num_entries(common_ctx->kv_store_res), 2 * NR_SLICED_RECORDS + 1);
+	_compare_stores(ref_ctx->common->kv_store_res, common_ctx->kv_store_res);
+
+	sid_resource_unref(ref_res);
+}
+
+/*
+ * Worker side of the tests with real worker processes. The worker exports records
+ * to main process the same way a scan command does - it queues the export, then it
+ * replies to the client (here, by writing to the reply pipe) without waiting for the
+ * ack and finally it receives the ack once main process has applied the export.
+ */
+struct worker_test {
+	sid_resource_t             *ubridge_res;
+	struct sid_ucmd_common_ctx *common_ctx;
+	int                         reply_fd[2];
+	unsigned                    nr_records;
+	unsigned                    rounds;
+	unsigned                    round;
+	bool                        bench;
+	struct bench                reply_bench;
+	struct bench                ack_bench;
+};
+
+static void _worker_send_export(sid_resource_t *worker_res, struct worker_test *wt)
+{
+	struct internal_msg_header int_msg = {.cat    = MSG_CATEGORY_SYSTEM,
+	                                      .header = (struct sid_msg_header) {.cmd = SYSTEM_CMD_SYNC}};
+	char                       data[INTERNAL_MSG_HEADER_SIZE + sizeof(WORKER_CMD_ID)];
+	sid_resource_t            *cmd_res = _create_fake_cmd_res();
+	int                        fd;
+
+	_set_many_kvs(sid_resource_get_data(cmd_res), 0, wt->nr_records);
+	fd = _do_build_buffers(cmd_res);
+
+	memcpy(data, &int_msg, INTERNAL_MSG_HEADER_SIZE);
+	memcpy(data + INTERNAL_MSG_HEADER_SIZE, WORKER_CMD_ID, sizeof(WORKER_CMD_ID));
+
+	if (wt->bench) {
+		bench_start(&wt->reply_bench);
+		bench_start(&wt->ack_bench);
+	}
+
+	assert_int_equal(worker_control_channel_send(worker_res,
+	                                             MAIN_WORKER_CHANNEL_ID,
+	                                             &(struct worker_data_spec) {.data               = data,
+	                                                                         .data_size          = sizeof(data),
+	                                                                         .ext.used           = true,
+	                                                                         .ext.socket.fd_pass = fd}),
+	                 0);
+
+	/* The reply is ready to be sent now, previously it was sent only after the ack. */
+	if (wt->bench)
+		bench_stop(&wt->reply_bench, 1);
+
+	assert_int_equal(write(wt->reply_fd[1], "", 1), 1);
+
+	sid_resource_unref(cmd_res);
+}
+
+static int _worker_init(sid_resource_t *worker_res, void *arg)
+{
+	_worker_send_export(worker_res, arg);
+	return 0;
+}
+
+static int _worker_recv_ack(sid_resource_t *worker_res, struct worker_channel *chan, struct worker_data_spec *data_spec, void *arg)
+{
+	struct worker_test        *wt = arg;
+	struct internal_msg_header int_msg;
+
+	memcpy(&int_msg, data_spec->data, sizeof(int_msg));
+
+	if (int_msg.cat != MSG_CATEGORY_SYSTEM || int_msg.header.cmd != SYSTEM_CMD_SYNC ||
+	    strcmp(data_spec->data + INTERNAL_MSG_HEADER_SIZE, WORKER_CMD_ID))
+		_exit(EXIT_FAILURE);
+
+	if (wt->bench)
+		bench_stop(&wt->ack_bench, 1);
+
+	if (++wt->round < wt->rounds) {
+		_worker_send_export(worker_res, wt);
+		return 0;
+	}
+
+	if (wt->bench) {
+		if (bench_report(&wt->reply_bench) < 0 || bench_report(&wt->ack_bench) < 0)
+			_exit(EXIT_FAILURE);
+
+		print_message("reply after export queued: %.1f us, reply after ack: %.1f us\n",
+		              (double) wt->reply_bench.nsec / wt->rounds / 1000,
+		              (double) wt->ack_bench.nsec / wt->rounds / 1000);
+	}
+
+	fflush(NULL);
+	_exit(EXIT_SUCCESS);
+}
+
+static int _init_fake_ubridge(sid_resource_t *res, const void *kickstart_data, void **data)
+{
+	struct worker_test                   *wt = (struct worker_test *) kickstart_data;
+	struct ubridge                       *ubridge;
+	struct worker_control_resource_params worker_control_res_params = {
+		.worker_type = WORKER_TYPE_INTERNAL,
+
+		.init_cb_spec =
+			(struct worker_init_cb_spec) {
+				.cb  = _worker_init,
+				.arg = wt,
+			},
+
+		.channel_specs = (struct worker_channel_spec[]) {
+			{
+				.id = MAIN_WORKER_CHANNEL_ID,
+
+				.wire =
+					(struct worker_wire_spec) {
+						.type = WORKER_WIRE_SOCKET,
+					},
+
+				.worker_tx_cb = NULL_WORKER_CHANNEL_CB_SPEC,
+				.worker_rx_cb =
+					(struct worker_channel_cb_spec) {
+						.cb  = _worker_recv_ack,
+						.arg = wt,
+					},
+
+				/* Main process applies the exports with the real handler. */
+				.proxy_tx_cb = NULL_WORKER_CHANNEL_CB_SPEC,
+				.proxy_rx_cb =
+					(struct worker_channel_cb_spec) {
+						.cb  = _worker_proxy_recv_fn,
+						.arg = wt->common_ctx,
+					},
+			},
+			NULL_WORKER_CHANNEL_SPEC,
+		}};
+
+	assert_non_null(ubridge = mem_zalloc(sizeof(*ubridge)));
+	ubridge->internal_res = res;
+	ubridge->common_ctx   = wt->common_ctx;
+	wt->common_ctx->res   = res;
+
+	assert_non_null(sid_resource_create(res,
+	                                    &sid_resource_type_worker_control,
+	                                    SID_RESOURCE_NO_FLAGS,
+	                                    SID_RESOURCE_NO_CUSTOM_ID,
+	                                    &worker_control_res_params,
+	                                    SID_RESOURCE_PRIO_NORMAL,
+	                                    SID_RESOURCE_NO_SERVICE_LINKS));
+	*data = ubridge;
+	return 0;
+}
+
+static int _destroy_fake_ubridge(sid_resource_t *res)
+{
+	struct ubridge *ubridge = sid_resource_get_data(res);
+
+	_destroy_common_ctx(ubridge->common_ctx);
+	free(ubridge);
+	return 0;
+}
+
+const sid_resource_type_t sid_resource_type_fake_ubridge = {
+	.name            = "fake_ubridge",
+	.short_name      = "fub",
+	.description     = "Fake ubridge resource running workers",
+	.init            = _init_fake_ubridge,
+	.destroy         = _destroy_fake_ubridge,
+	.with_event_loop = 1,
+};
+
+/* Start a worker which exports records to main process, returns in main process only. */
+static void _start_worker(struct worker_test *wt)
+{
+	sid_resource_t *worker_proxy_res;
+
+	assert_int_equal(pipe(wt->reply_fd), 0);
+	wt->common_ctx = _create_common_ctx();
+	assert_non_null(wt->ubridge_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                                      &sid_resource_type_fake_ubridge,
+	                                                      SID_RESOURCE_NO_FLAGS,
+	                                                      "fakeubridge",
+	                                                      wt,
+	                                                      SID_RESOURCE_PRIO_NORMAL,
+	                                                      SID_RESOURCE_NO_SERVICE_LINKS));
+
+	/* Do not let the worker inherit unflushed output. */
+	fflush(NULL);
+	assert_int_equal(_get_worker(wt->ubridge_res, &worker_proxy_res), 0);
+
+	if (!worker_proxy_res)
+		_exit(worker_control_run_worker(_get_worker_control(wt->ubridge_res)) < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+static void _wait_reply(struct worker_test *wt)
+{
+	char c;
+
+	assert_int_equal(read(wt->reply_fd[0], &c, 1), 1);
+}
+
+static void _stop_worker(struct worker_test *wt, unsigned nr_processes)
+{
+	int status;
+
+	for (; nr_processes; nr_processes--) {
+		assert_true(waitpid(-1, &status, 0) > 0);
+		assert_true(WIFEXITED(status));
+		assert_int_equal(WEXITSTATUS(status), EXIT_SUCCESS);
+	}
+
+	sid_resource_unref(wt->ubridge_res);
+	close(wt->reply_fd[0]);
+	close(wt->reply_fd[1]);
+}
+
+static void test_read_your_writes(void **state)
+{
+	struct worker_test  wt       = {.nr_records = 1, .rounds = 1};
+	struct sid_ucmd_ctx ucmd_ctx = {0};
+	char               *data[]   = {"value0"};
+	sid_resource_t     *worker_proxy_res;
+
+	_start_worker(&wt);
+	ucmd_ctx.common = wt.common_ctx;
+
+	/*
+	 * The worker replied before main process applied its export. The export is still
+	 * waiting in the worker channel, the event loop has not dispatched it yet.
+	 */
+	_wait_reply(&wt);
+	_check_missing_kv(&ucmd_ctx, "key0");
+
+	/*
+	 * A request triggered by the reply gets a new worker. The export must be applied
+	 * before that worker is created so it sees it in its copy of main KV store. The
+	 * worker is not created until the sync is complete, the event loop completes it
+	 * in time slices, here it is completed at once.
+	 */
+	assert_int_equal(_get_worker(wt.ubridge_res, &worker_proxy_res), -EAGAIN);
+	_check_missing_kv(&ucmd_ctx, "key0");
+	_flush_main_kv_store_sync(wt.common_ctx);
+
+	fflush(NULL);
+	assert_int_equal(_get_worker(wt.ubridge_res, &worker_proxy_res), 0);
+
+	if (!worker_proxy_res) {
+		_check_kv(&ucmd_ctx, "key0", data, ARRAY_LEN(data), false);
+		_exit(EXIT_SUCCESS);
+	}
+
+	_check_kv(&ucmd_ctx, "key0", data, ARRAY_LEN(data), false);
+
+	/* The first worker exits successfully only if it got the ack. */
+	_stop_worker(&wt, 2);
+}
+
+static void test_reply_latency(void **state)
+{
+	struct worker_test wt = {.nr_records = NR_LATENCY_RECORDS, .rounds = NR_LATENCY_ROUNDS, .bench = true};
+	sid_resource_t    *worker_control_res;
+	unsigned           i;
+
+	bench_init(&wt.reply_bench, "db_sync_reply_queued");
+	bench_init(&wt.ack_bench, "db_sync_reply_acked");
+
+	_start_worker(&wt);
+	worker_control_res = _get_worker_control(wt.ubridge_res);
+
+	/* Apply each export as soon as the reply is seen, before next request could get a worker. */
+	for (i = 0; i < NR_LATENCY_ROUNDS; i++) {
+		_wait_reply(&wt);
+		assert_int_equal(worker_control_recv_pending(worker_control_res), 0);
+		_flush_main_kv_store_sync(wt.common_ctx);
+	}
+
+	assert_int_equal(kv_store_num_entries(wt.common_ctx->kv_store_res), NR_LATENCY_RECORDS);
+	_stop_worker(&wt, 1);
+
+	bench_destroy(&wt.reply_bench);
+	bench_destroy(&wt.ack_bench);
+}
+
 int setup(void **state)
 {
 	struct test_state *ts = malloc(sizeof(struct test_state));
@@ -701,6 +1192,9 @@ int main(void)
 		setup_test(test_unset_broken),  setup_test(test_change_broken),    setup_test(test_subtract_broken),
 		setup_test(test_add_broken),    setup_test(test_multi_1),          setup_test(test_multi_broken_1),
 		setup_test(test_multi_2),       setup_test(test_multi_broken_2),   setup_test(test_multi_broken_3),
+		setup_test(test_sliced_records), setup_test(test_sliced_big_export), setup_test(test_sliced_time),
+		setup_test(test_sliced_broken),
+		cmocka_unit_test(test_read_your_writes), cmocka_unit_test(test_reply_latency),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -27,11 +27,44 @@ static void test_sid_cmd_name_to_type(void **state)
 	assert_int_equal(sid_cmd_name_to_type("resources"), SID_CMD_RESOURCES);
 }
 
+static char *socket_env;
+
 char *__wrap_getenv(const char *name)
 {
+	if (!strcmp(name, SID_KEY_SOCKET))
+		return socket_env;
+
 	return mock_ptr_type(char *);
 }
 
+static void test_socket_path(void **state)
+{
+	char   path[SID_SOCKET_PATH_MAX];
+	char   long_path[SID_SOCKET_PATH_MAX + 1];
+	size_t len;
+
+	assert_int_equal(sid_socket_path_get(path, &len), 0);
+	assert_int_equal(len, SID_SOCKET_PATH_LEN);
+	assert_memory_equal(path, SID_SOCKET_PATH, len);
+
+	socket_env = "@sid-test.socket";
+	assert_int_equal(sid_socket_path_get(path, &len), 0);
+	assert_int_equal(len, sizeof("@sid-test.socket") - 1);
+	assert_memory_equal(path, "\0sid-test.socket", len);
+
+	socket_env = "/tmp/sid-test.socket";
+	assert_int_equal(sid_socket_path_get(path, &len), 0);
+	assert_int_equal(len, sizeof("/tmp/sid-test.socket") - 1);
+	assert_memory_equal(path, "/tmp/sid-test.socket", len);
+
+	memset(long_path, 'x', sizeof(long_path) - 1);
+	long_path[sizeof(long_path) - 1] = '\0';
+	socket_env                       = long_path;
+	assert_int_equal(sid_socket_path_get(path, &len), -ENAMETOOLONG);
+
+	socket_env = NULL;
+}
+
 #define TEST_COMM_FD   1111
 #define TEST_EXPORT_FD 9999
 
@@ -564,6 +597,7 @@ int main(void)
 {
 	const struct CMUnitTest tests[] = {
 		cmocka_unit_test(test_sid_cmd_name_to_type),
+		cmocka_unit_test(test_socket_path),
 		cmocka_unit_test(test_checkpoint_with_key),
 		cmocka_unit_test(test_checkpoint_no_keys),
 		cmocka_unit_test(test_checkpoint_no_name),
@@ -9,6 +9,7 @@
 #include "../src/internal/mem.c"
 #include "../src/resource/kv-store.c"
 #include "../src/resource/ubridge.c"
+#include "bench.h"
 #include "ucmd-module.h"
 
 #include <cmocka.h>
@@ -18,6 +19,11 @@
 #define MERGE_KEY        "merge_key"
 #define TEST_OWNER       "test_owner"
 
+#define BENCH_NR_PREFIXES      1000
+#define BENCH_NR_PREFIX_KEYS   1000 /* keys per prefix, 1M keys in total */
+#define BENCH_NR_PREFIX_ROUNDS 1000
+#define BENCH_NR_SCAN_ROUNDS   10
+
 static void test_type_F(void **state)
 {
 	struct iovec           test_iov[]    = {{"test", sizeof("test")}, {"value", sizeof("value")}};
@@ -42,14 +48,20 @@ static void test_type_E(void **state)
 	struct kv_store_value *value =
 		_create_kv_store_value(test_iov, size, KV_STORE_VALUE_VECTOR, KV_STORE_VALUE_NO_OP, &value_size);
 	assert_ptr_not_equal(value, NULL);
-	return_iov = (struct iovec *) value->data;
+	assert_int_equal(value_size,
+	                 sizeof(*value) + sizeof(struct kv_store_value_packed) + size * sizeof(uint32_t) + sizeof("test") +
+	                         sizeof("value"));
+	assert_ptr_equal(((struct kv_store_value_packed *) value->data)->iov, NULL);
+	return_iov = _get_data(value);
+	assert_ptr_equal(_get_data(value), return_iov);
 
 	for (int i = 0; i < value->size; i++) {
 		assert_int_equal(return_iov[i].iov_len, test_iov[i].iov_len);
 		assert_string_equal(return_iov[i].iov_base, test_iov[i].iov_base);
+		assert_ptr_not_equal(return_iov[i].iov_base, test_iov[i].iov_base);
 	}
 	assert_int_equal(value->size, size);
-	assert_int_equal(value->int_flags, KV_STORE_VALUE_INT_ALLOC);
+	assert_int_equal(value->int_flags, KV_STORE_VALUE_INT_ALLOC | KV_STORE_VALUE_INT_PACKED);
 	assert_int_equal(value->ext_flags, KV_STORE_VALUE_VECTOR);
 	_destroy_kv_store_value(value);
 }
@@ -270,6 +282,366 @@ static void test_kvstore_merge_op(void **state)
 	sid_resource_unref(kv_store_res);
 }
 
+struct roundtrip_case {
+	const char               *name;
+	kv_store_value_flags_t    flags;
+	kv_store_value_op_flags_t op_flags;
+	kv_store_value_flags_t    stored_flags;
+};
+
+static const struct roundtrip_case roundtrip_cases[] = {
+	{"A", KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_NO_OP},
+	{"B", KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_OP_MERGE, KV_STORE_VALUE_NO_OP},
+	{"C", KV_STORE_VALUE_REF, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_REF},
+	{"D", KV_STORE_VALUE_REF, KV_STORE_VALUE_OP_MERGE, KV_STORE_VALUE_REF},
+	{"E", KV_STORE_VALUE_VECTOR, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_VECTOR},
+	{"F", KV_STORE_VALUE_VECTOR, KV_STORE_VALUE_OP_MERGE, KV_STORE_VALUE_NO_OP},
+	{"G", KV_STORE_VALUE_VECTOR | KV_STORE_VALUE_REF, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_VECTOR | KV_STORE_VALUE_REF},
+	{"H", KV_STORE_VALUE_VECTOR | KV_STORE_VALUE_REF, KV_STORE_VALUE_OP_MERGE, KV_STORE_VALUE_VECTOR | KV_STORE_VALUE_REF},
+};
+
+static char roundtrip_items[][8] = {"seqnum", "", "flags", "owner", "data"};
+
+#define NR_ROUNDTRIP_ITEMS (sizeof(roundtrip_items) / sizeof(roundtrip_items[0]))
+
+static void _check_roundtrip(const struct roundtrip_case *c, void *data, size_t size, kv_store_value_flags_t flags)
+{
+	struct iovec *iov = data;
+	char         *p   = data;
+	size_t        i;
+
+	assert_non_null(data);
+	assert_int_equal(flags, c->stored_flags);
+
+	if (flags & KV_STORE_VALUE_VECTOR) {
+		assert_int_equal(size, NR_ROUNDTRIP_ITEMS);
+		for (i = 0; i < NR_ROUNDTRIP_ITEMS; i++) {
+			assert_int_equal(iov[i].iov_len, strlen(roundtrip_items[i]) + 1);
+			assert_string_equal(iov[i].iov_base, roundtrip_items[i]);
+		}
+	} else if (c->flags & KV_STORE_VALUE_VECTOR) {
+		/* F - merged vector */
+		for (i = 0; i < NR_ROUNDTRIP_ITEMS; i++) {
+			assert_string_equal(p, roundtrip_items[i]);
+			p += strlen(roundtrip_items[i]) + 1;
+		}
+		assert_int_equal(size, p - (char *) data);
+	} else {
+		assert_int_equal(size, sizeof(roundtrip_items[0]));
+		assert_string_equal(data, roundtrip_items[0]);
+	}
+}
+
+static int _kv_cb_roundtrip(struct kv_store_update_spec *spec)
+{
+	_check_roundtrip(spec->arg, spec->new_data, spec->new_data_size, spec->new_flags);
+
+	if (spec->old_data)
+		_check_roundtrip(spec->arg, spec->old_data, spec->old_data_size, spec->old_flags);
+
+	return 1;
+}
+
+static void _test_kvstore_roundtrip(const struct sid_kv_store_resource_params *params, const struct roundtrip_case *c)
+{
+	struct iovec           iov[2][NR_ROUNDTRIP_ITEMS];
+	sid_resource_t        *kv_store_res;
+	kv_store_iter_t       *iter;
+	kv_store_value_flags_t flags;
+	void                  *value, *data;
+	size_t                 value_size, size, i, j;
+	size_t                 meta_size, int_size, int_data_size, ext_size, ext_data_size, unpacked_size, view_size;
+
+	assert_non_null(kv_store_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                                   &sid_resource_type_kv_store,
+	                                                   SID_RESOURCE_RESTRICT_WALK_UP,
+	                                                   "testkvstore",
+	                                                   params,
+	                                                   SID_RESOURCE_PRIO_NORMAL,
+	                                                   SID_RESOURCE_NO_SERVICE_LINKS));
+
+	/* set twice so the callback sees both new and old value, H needs separate iovec for each record */
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < NR_ROUNDTRIP_ITEMS; j++)
+			iov[i][j] = (struct iovec) {roundtrip_items[j], strlen(roundtrip_items[j]) + 1};
+
+		if (c->flags & KV_STORE_VALUE_VECTOR) {
+			value      = iov[i];
+			value_size = NR_ROUNDTRIP_ITEMS;
+		} else {
+			value      = roundtrip_items[0];
+			value_size = sizeof(roundtrip_items[0]);
+		}
+
+		assert_non_null(kv_store_set_value(kv_store_res,
+		                                   TEST_KEY,
+		                                   value,
+		                                   value_size,
+		                                   c->flags,
+		                                   c->op_flags,
+		                                   _kv_cb_roundtrip,
+		                                   (void *) c));
+	}
+
+	data = kv_store_get_value(kv_store_res, TEST_KEY, &size, &flags);
+	_check_roundtrip(c, data, size, flags);
+
+	/* copies must not reference the input */
+	if (!(c->flags & KV_STORE_VALUE_REF)) {
+		if (c->flags & KV_STORE_VALUE_VECTOR && !(c->op_flags & KV_STORE_VALUE_OP_MERGE)) {
+			for (i = 0; i < NR_ROUNDTRIP_ITEMS; i++)
+				assert_ptr_not_equal(((struct iovec *) data)[i].iov_base, roundtrip_items[i]);
+		} else
+			assert_ptr_not_equal(data, roundtrip_items[0]);
+	}
+
+	assert_non_null(iter = kv_store_iter_create(kv_store_res, NULL, NULL));
+	assert_non_null(data = kv_store_iter_next(iter, &size, NULL, &flags));
+	_check_roundtrip(c, data, size, flags);
+
+	assert_int_equal(kv_store_iter_current_size(iter, &int_size, &int_data_size, &ext_size, &ext_data_size), 0);
+	assert_int_equal(kv_store_iter_current_vector_size(iter, &unpacked_size, &view_size), 0);
+	if (c->flags == KV_STORE_VALUE_VECTOR && c->op_flags == KV_STORE_VALUE_NO_OP) {
+		assert_true(int_size < unpacked_size);
+		assert_int_equal(view_size, NR_ROUNDTRIP_ITEMS * sizeof(struct iovec));
+	} else {
+		assert_int_equal(unpacked_size, int_size);
+		assert_int_equal(view_size, 0);
+	}
+	kv_store_iter_destroy(iter);
+
+	/* merged H value is allocated separately, but reported as internal data by kv_store_iter_current_size */
+	if (!(c->flags & KV_STORE_VALUE_REF)) {
+		kv_store_get_size(kv_store_res, &meta_size, &size);
+		assert_int_equal(size, int_size);
+	}
+
+	assert_int_equal(kv_store_unset(kv_store_res, TEST_KEY, NULL, NULL), 0);
+	assert_int_equal(kv_store_num_entries(kv_store_res), 0);
+
+	sid_resource_unref(kv_store_res);
+}
+
+static void test_kvstore_roundtrip(void **state)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(roundtrip_cases) / sizeof(roundtrip_cases[0]); i++) {
+		_test_kvstore_roundtrip(&main_kv_store_res_params, &roundtrip_cases[i]);
+		_test_kvstore_roundtrip(
+			&((struct sid_kv_store_resource_params) {.backend = KV_STORE_BACKEND_HASH, .hash.initial_size = 32}),
+			&roundtrip_cases[i]);
+	}
+}
+
+static const char *prefix_test_keys[] = {"a", "ab", "abc", "abd", "b", "b\xff", "b\xff\xff", "b\xff\x01", "c"};
+
+static void _check_iterate_prefix(sid_resource_t *kv_store_res, const char *prefix, size_t expected)
+{
+	size_t           prefix_len = strlen(prefix);
+	size_t           found      = 0;
+	kv_store_iter_t *iter;
+	const char      *key;
+
+	assert_ptr_not_equal(iter = kv_store_iter_create_prefix(kv_store_res, prefix, prefix_len), NULL);
+	while (kv_store_iter_next(iter, NULL, &key, NULL)) {
+		assert_int_equal(strncmp(key, prefix, prefix_len), 0);
+		found++;
+	}
+	kv_store_iter_destroy(iter);
+
+	assert_int_equal(found, expected);
+	assert_int_equal(kv_store_iter_count_prefix(kv_store_res, prefix, prefix_len), expected);
+}
+
+static void _test_kvstore_iterate_prefix(const struct sid_kv_store_resource_params *params)
+{
+	sid_resource_t *kv_store_res;
+	size_t          i;
+
+	kv_store_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                   &sid_resource_type_kv_store,
+	                                   SID_RESOURCE_RESTRICT_WALK_UP,
+	                                   "testkvstore",
+	                                   params,
+	                                   SID_RESOURCE_PRIO_NORMAL,
+	                                   SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_ptr_not_equal(kv_store_res, NULL);
+
+	_check_iterate_prefix(kv_store_res, "", 0);
+	_check_iterate_prefix(kv_store_res, "a", 0);
+
+	for (i = 0; i < sizeof(prefix_test_keys) / sizeof(prefix_test_keys[0]); i++)
+		assert_ptr_not_equal(kv_store_set_value(kv_store_res,
+		                                        prefix_test_keys[i],
+		                                        (void *) prefix_test_keys[i],
+		                                        strlen(prefix_test_keys[i]) + 1,
+		                                        KV_STORE_VALUE_NO_OP,
+		                                        KV_STORE_VALUE_NO_OP,
+		                                        NULL,
+		                                        NULL),
+		                     NULL);
+
+	/* empty prefix */
+	_check_iterate_prefix(kv_store_res, "", 9);
+	/* prefix equal to a key */
+	_check_iterate_prefix(kv_store_res, "a", 4);
+	_check_iterate_prefix(kv_store_res, "ab", 3);
+	_check_iterate_prefix(kv_store_res, "abc", 1);
+	_check_iterate_prefix(kv_store_res, "c", 1);
+	/* prefix ending with 0xff */
+	_check_iterate_prefix(kv_store_res, "b\xff", 3);
+	_check_iterate_prefix(kv_store_res, "b\xff\xff", 1);
+	_check_iterate_prefix(kv_store_res, "\xff", 0);
+	/* no match */
+	_check_iterate_prefix(kv_store_res, "abe", 0);
+	_check_iterate_prefix(kv_store_res, "d", 0);
+	_check_iterate_prefix(kv_store_res, "abcd", 0);
+
+	sid_resource_unref(kv_store_res);
+}
+
+static void test_kvstore_iterate_prefix(void **state)
+{
+	_test_kvstore_iterate_prefix(&main_kv_store_res_params);
+	_test_kvstore_iterate_prefix(
+		&((struct sid_kv_store_resource_params) {.backend = KV_STORE_BACKEND_HASH, .hash.initial_size = 32}));
+}
+
+static size_t _iterate_prefix(kv_store_iter_t *iter, const char *prefix, size_t prefix_len)
+{
+	const char *key;
+	size_t      found = 0;
+
+	while (kv_store_iter_next(iter, NULL, &key, NULL)) {
+		/* a full scan has to filter, a prefix iterator returns matching keys only */
+		if (!strncmp(key, prefix, prefix_len))
+			found++;
+	}
+
+	kv_store_iter_destroy(iter);
+	return found;
+}
+
+static void test_kvstore_iterate_prefix_bench(void **state)
+{
+	sid_resource_t *kv_store_res;
+	struct bench    bench_prefix, bench_scan;
+	char            key[32], prefix[16];
+	size_t          prefix_len;
+	unsigned        i, j;
+
+	kv_store_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                   &sid_resource_type_kv_store,
+	                                   SID_RESOURCE_RESTRICT_WALK_UP,
+	                                   "testkvstore",
+	                                   &main_kv_store_res_params,
+	                                   SID_RESOURCE_PRIO_NORMAL,
+	                                   SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_ptr_not_equal(kv_store_res, NULL);
+
+	for (i = 0; i < BENCH_NR_PREFIXES; i++) {
+		for (j = 0; j < BENCH_NR_PREFIX_KEYS; j++) {
+			snprintf(key, sizeof(key), "dev%04u:key%04u", i, j);
+			assert_ptr_not_equal(
+				kv_store_set_value(kv_store_res, key, "x", 2, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_NO_OP, NULL, NULL),
+				NULL);
+		}
+	}
+
+	bench_init(&bench_prefix, "kv_store_iter_prefix");
+	bench_start(&bench_prefix);
+	for (i = 0; i < BENCH_NR_PREFIX_ROUNDS; i++) {
+		prefix_len = snprintf(prefix, sizeof(prefix), "dev%04u:", i * 7919 % BENCH_NR_PREFIXES);
+		assert_int_equal(_iterate_prefix(kv_store_iter_create_prefix(kv_store_res, prefix, prefix_len), prefix, prefix_len),
+		                 BENCH_NR_PREFIX_KEYS);
+	}
+	bench_stop(&bench_prefix, BENCH_NR_PREFIX_ROUNDS);
+	assert_int_equal(bench_report(&bench_prefix), 0);
+
+	bench_init(&bench_scan, "kv_store_iter_scan");
+	bench_start(&bench_scan);
+	for (i = 0; i < BENCH_NR_SCAN_ROUNDS; i++) {
+		prefix_len = snprintf(prefix, sizeof(prefix), "dev%04u:", i * 7919 % BENCH_NR_PREFIXES);
+		assert_int_equal(_iterate_prefix(kv_store_iter_create(kv_store_res, NULL, NULL), prefix, prefix_len),
+		                 BENCH_NR_PREFIX_KEYS);
+	}
+	bench_stop(&bench_scan, BENCH_NR_SCAN_ROUNDS);
+	assert_int_equal(bench_report(&bench_scan), 0);
+
+	print_message("prefix iteration: %u keys, %u per prefix, %.0f ns per prefix with seek, %.0f ns per prefix with full scan\n",
+	              BENCH_NR_PREFIXES * BENCH_NR_PREFIX_KEYS,
+	              BENCH_NR_PREFIX_KEYS,
+	              (double) bench_prefix.nsec / BENCH_NR_PREFIX_ROUNDS,
+	              (double) bench_scan.nsec / BENCH_NR_SCAN_ROUNDS);
+
+	bench_destroy(&bench_prefix);
+	bench_destroy(&bench_scan);
+	sid_resource_unref(kv_store_res);
+}
+
+static int _kv_cb_skip(struct kv_store_update_spec *spec)
+{
+	return 0;
+}
+
+static void _test_kvstore_generation(const struct sid_kv_store_resource_params *params)
+{
+	sid_resource_t *kv_store_res;
+	uint64_t        gen;
+
+	kv_store_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                   &sid_resource_type_kv_store,
+	                                   SID_RESOURCE_RESTRICT_WALK_UP,
+	                                   "testkvstore",
+	                                   params,
+	                                   SID_RESOURCE_PRIO_NORMAL,
+	                                   SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_ptr_not_equal(kv_store_res, NULL);
+
+	gen = kv_store_get_generation(kv_store_res);
+	assert_ptr_not_equal(
+		kv_store_set_value(kv_store_res, TEST_KEY, "a", 2, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_NO_OP, NULL, NULL),
+		NULL);
+	assert_int_not_equal(kv_store_get_generation(kv_store_res), gen);
+
+	/* reads and writes skipped by update callback do not change anything */
+	gen = kv_store_get_generation(kv_store_res);
+	assert_ptr_not_equal(kv_store_get_value(kv_store_res, TEST_KEY, NULL, NULL), NULL);
+	assert_ptr_equal(
+		kv_store_set_value(kv_store_res, TEST_KEY, "b", 2, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_NO_OP, _kv_cb_skip, NULL),
+		NULL);
+	assert_int_equal(kv_store_unset(kv_store_res, TEST_KEY, _kv_cb_skip, NULL), 0);
+	assert_int_equal(kv_store_get_generation(kv_store_res), gen);
+
+	/* unset within transaction is done at its end */
+	assert_int_equal(kv_store_transaction_begin(kv_store_res), 0);
+	assert_int_equal(kv_store_unset(kv_store_res, TEST_KEY, NULL, NULL), 0);
+	assert_int_equal(kv_store_get_generation(kv_store_res), gen);
+	kv_store_transaction_end(kv_store_res, false);
+	assert_int_not_equal(kv_store_get_generation(kv_store_res), gen);
+	assert_ptr_equal(kv_store_get_value(kv_store_res, TEST_KEY, NULL, NULL), NULL);
+
+	/* rollback */
+	assert_int_equal(kv_store_transaction_begin(kv_store_res), 0);
+	assert_ptr_not_equal(
+		kv_store_set_value(kv_store_res, TEST_KEY, "c", 2, KV_STORE_VALUE_NO_OP, KV_STORE_VALUE_NO_OP, NULL, NULL),
+		NULL);
+	gen = kv_store_get_generation(kv_store_res);
+	kv_store_transaction_end(kv_store_res, true);
+	assert_int_not_equal(kv_store_get_generation(kv_store_res), gen);
+	assert_ptr_equal(kv_store_get_value(kv_store_res, TEST_KEY, NULL, NULL), NULL);
+
+	sid_resource_unref(kv_store_res);
+}
+
+static void test_kvstore_generation(void **state)
+{
+	_test_kvstore_generation(&main_kv_store_res_params);
+	_test_kvstore_generation(
+		&((struct sid_kv_store_resource_params) {.backend = KV_STORE_BACKEND_HASH, .hash.initial_size = 32}));
+}
+
 int main(void)
 {
 	cmocka_set_message_output(CM_OUTPUT_STDOUT);
@@ -280,6 +652,10 @@ int main(void)
 		cmocka_unit_test(test_type_H),
 		cmocka_unit_test(test_kvstore_iterate),
 		cmocka_unit_test(test_kvstore_merge_op),
+		cmocka_unit_test(test_kvstore_roundtrip),
+		cmocka_unit_test(test_kvstore_iterate_prefix),
+		cmocka_unit_test(test_kvstore_iterate_prefix_bench),
+		cmocka_unit_test(test_kvstore_generation),
 	};
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,272 @@
+#include "bench.h"
+#include "iface/iface_internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#define TEST_KEY_SIZE          64
+#define TEST_NR_KEYS           256
+#define TEST_NR_GENERATIONS    2000
+#define TEST_NR_READERS        4
+#define TEST_BENCH_NR_KEYS     4096
+#define TEST_BENCH_NR_LOOKUPS  2000000
+
+struct test_value {
+	uint64_t gen;
+	uint64_t idx;
+	uint64_t check;
+};
+
+struct test_keys {
+	char keys[TEST_NR_KEYS][TEST_KEY_SIZE];
+};
+
+struct test_reader {
+	struct sid_kv_view *view;
+	struct test_keys   *keys;
+	volatile bool      *done;
+	unsigned            seed;
+	uint64_t            lookups;
+	uint64_t            found;
+	uint64_t            errors;
+};
+
+static void _key(char *buf, unsigned idx)
+{
+	snprintf(buf, TEST_KEY_SIZE, "::D:dev%04u:::#RDY", idx);
+}
+
+static struct sid_kv_view *_map(struct sid_kv_view_writer *writer)
+{
+	struct sid_kv_view *view;
+
+	assert_int_equal(sid_kv_view_map(writer->rdonly_fd, &view), 0);
+	assert_non_null(view);
+	return view;
+}
+
+static void test_kv_view_lookup(void **state)
+{
+	struct sid_kv_view_writer writer;
+	struct sid_kv_view       *view;
+	struct sid_kv_view_item   items[] = {
+                {.key = "::D:dev2:::#RDY", .value = "ready2", .value_size = 7},
+                {.key = "::D:dev1:::#RDY", .value = "ready1", .value_size = 7},
+                {.key = "::D:dev10:::#RDY", .value = "ready10", .value_size = 8},
+                {.key = ":ALS:M:::devno:8_0:#GMB", .value = "dev1", .value_size = 5},
+                {.key = "::D:dev3:::#RES", .value = NULL, .value_size = 0},
+        };
+	char   buf[16];
+	size_t size;
+
+	assert_int_equal(sid_kv_view_writer_init(&writer, 4096), 0);
+	view = _map(&writer);
+
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev1:::#RDY", buf, sizeof(buf), &size), -ENOENT);
+
+	assert_int_equal(sid_kv_view_writer_update(&writer, items, sizeof(items) / sizeof(items[0])), 0);
+
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev1:::#RDY", buf, sizeof(buf), &size), 0);
+	assert_int_equal(size, 7);
+	assert_string_equal(buf, "ready1");
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev10:::#RDY", buf, sizeof(buf), &size), 0);
+	assert_string_equal(buf, "ready10");
+	assert_int_equal(sid_kv_view_lookup(view, ":ALS:M:::devno:8_0:#GMB", buf, sizeof(buf), &size), 0);
+	assert_string_equal(buf, "dev1");
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev3:::#RES", NULL, 0, &size), 0);
+	assert_int_equal(size, 0);
+
+	/* prefix of an existing key and key with an existing key as prefix */
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev1", buf, sizeof(buf), &size), -ENOENT);
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev1:::#RDYX", buf, sizeof(buf), &size), -ENOENT);
+	assert_int_equal(sid_kv_view_lookup(view, "", buf, sizeof(buf), &size), -ENOENT);
+
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev10:::#RDY", buf, 4, &size), -ENOBUFS);
+	assert_int_equal(size, 8);
+
+	/* too small view is left intact */
+	items[0].value_size = 4096;
+	items[0].value      = calloc(1, 4096);
+	assert_non_null(items[0].value);
+	assert_int_equal(sid_kv_view_writer_update(&writer, items, 1), -ENOSPC);
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev1:::#RDY", buf, sizeof(buf), &size), 0);
+	free((void *) items[0].value);
+
+	/* readers see the view is gone once it is replaced */
+	sid_kv_view_writer_destroy(&writer, true);
+	assert_int_equal(sid_kv_view_lookup(view, "::D:dev1:::#RDY", buf, sizeof(buf), &size), -ESTALE);
+
+	sid_kv_view_close(view);
+}
+
+static void test_kv_view_map_invalid(void **state)
+{
+	struct sid_kv_view *view;
+	char                junk[256] = {0};
+	FILE               *f;
+
+	assert_non_null(f = tmpfile());
+	assert_int_equal(sid_kv_view_map(fileno(f), &view), -EBADMSG);
+	assert_int_equal(write(fileno(f), junk, sizeof(junk)), sizeof(junk));
+	assert_int_equal(sid_kv_view_map(fileno(f), &view), -EBADMSG);
+	assert_null(view);
+	fclose(f);
+}
+
+static void *_reader_fn(void *arg)
+{
+	struct test_reader *reader   = arg;
+	uint64_t            last_gen = 0;
+	struct test_value   value;
+	size_t              size;
+	unsigned            idx;
+	int                 r;
+
+	while (!*reader->done) {
+		idx = rand_r(&reader->seed) % TEST_NR_KEYS;
+		r   = sid_kv_view_lookup(reader->view, reader->keys->keys[idx], &value, sizeof(value), &size);
+		reader->lookups++;
+
+		if (r == -ENOENT)
+			continue;
+
+		/* the value must come from one generation and generations never go back */
+		if (r < 0 || size != sizeof(value) || value.idx != idx || value.check != value.gen * 31 + idx ||
+		    value.gen < last_gen)
+			reader->errors++;
+		else
+			reader->found++;
+
+		last_gen = value.gen;
+	}
+
+	return NULL;
+}
+
+/*
+ * One writer thread updates the view while reader threads look up random keys. Each
+ * generation stores values encoding the generation and every 7th key is present only
+ * in even generations so the layout of the view changes between generations as well.
+ */
+static void test_kv_view_concurrent(void **state)
+{
+	struct sid_kv_view_writer writer;
+	struct test_keys         *keys;
+	struct sid_kv_view_item  *items;
+	struct test_value        *values;
+	struct test_reader        readers[TEST_NR_READERS];
+	pthread_t                 threads[TEST_NR_READERS];
+	volatile bool             done = false;
+	uint64_t                  gen, found = 0;
+	size_t                    nr_items;
+	unsigned                  i;
+
+	assert_non_null(keys = malloc(sizeof(*keys)));
+	assert_non_null(items = calloc(TEST_NR_KEYS, sizeof(*items)));
+	assert_non_null(values = calloc(TEST_NR_KEYS, sizeof(*values)));
+
+	for (i = 0; i < TEST_NR_KEYS; i++)
+		_key(keys->keys[i], i);
+
+	assert_int_equal(sid_kv_view_writer_init(&writer, 65536), 0);
+
+	for (i = 0; i < TEST_NR_READERS; i++) {
+		readers[i] = (struct test_reader) {.view = _map(&writer), .keys = keys, .done = &done, .seed = i + 1};
+		assert_int_equal(pthread_create(&threads[i], NULL, _reader_fn, &readers[i]), 0);
+	}
+
+	for (gen = 1; gen <= TEST_NR_GENERATIONS; gen++) {
+		nr_items = 0;
+
+		for (i = 0; i < TEST_NR_KEYS; i++) {
+			if (i % 7 == 0 && gen % 2)
+				continue;
+
+			values[i]         = (struct test_value) {.gen = gen, .idx = i, .check = gen * 31 + i};
+			items[nr_items++] = (struct sid_kv_view_item) {.key        = keys->keys[i],
+			                                               .value      = &values[i],
+			                                               .value_size = sizeof(values[i])};
+		}
+
+		assert_int_equal(sid_kv_view_writer_update(&writer, items, nr_items), 0);
+	}
+
+	done = true;
+
+	for (i = 0; i < TEST_NR_READERS; i++) {
+		assert_int_equal(pthread_join(threads[i], NULL), 0);
+		assert_int_equal(readers[i].errors, 0);
+		found += readers[i].found;
+		sid_kv_view_close(readers[i].view);
+	}
+
+	assert_true(found > 0);
+
+	sid_kv_view_writer_destroy(&writer, true);
+	free(values);
+	free(items);
+	free(keys);
+}
+
+static void test_kv_view_bench(void **state)
+{
+	struct sid_kv_view_writer writer;
+	struct sid_kv_view       *view;
+	struct sid_kv_view_item  *items;
+	char                    (*keys)[TEST_KEY_SIZE];
+	struct bench              bench;
+	char                      value[TEST_KEY_SIZE];
+	size_t                    size;
+	unsigned                  i, seed = 1;
+
+	assert_non_null(keys = calloc(TEST_BENCH_NR_KEYS, TEST_KEY_SIZE));
+	assert_non_null(items = calloc(TEST_BENCH_NR_KEYS, sizeof(*items)));
+
+	for (i = 0; i < TEST_BENCH_NR_KEYS; i++) {
+		_key(keys[i], i);
+		items[i] = (struct sid_kv_view_item) {.key = keys[i], .value = keys[i], .value_size = strlen(keys[i]) + 1};
+	}
+
+	assert_int_equal(sid_kv_view_writer_init(&writer, sid_kv_view_size(items, TEST_BENCH_NR_KEYS)), 0);
+	assert_int_equal(sid_kv_view_writer_update(&writer, items, TEST_BENCH_NR_KEYS), 0);
+	view = _map(&writer);
+
+	bench_init(&bench, "kv_view_lookup");
+	bench_start(&bench);
+	for (i = 0; i < TEST_BENCH_NR_LOOKUPS; i++)
+		assert_int_equal(sid_kv_view_lookup(view, keys[rand_r(&seed) % TEST_BENCH_NR_KEYS], &value, sizeof(value), &size),
+		                 0);
+	bench_stop(&bench, TEST_BENCH_NR_LOOKUPS);
+	assert_int_equal(bench_report(&bench), 0);
+	bench_destroy(&bench);
+
+	print_message("kv view: %u keys, %.0f lookups/s\n", TEST_BENCH_NR_KEYS, TEST_BENCH_NR_LOOKUPS / (bench.nsec / 1e9));
+
+	sid_kv_view_close(view);
+	sid_kv_view_writer_destroy(&writer, true);
+	free(items);
+	free(keys);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_kv_view_lookup),
+		cmocka_unit_test(test_kv_view_map_invalid),
+		cmocka_unit_test(test_kv_view_concurrent),
+		cmocka_unit_test(test_kv_view_bench),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
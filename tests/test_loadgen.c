@@ -0,0 +1,258 @@
+#include "iface/iface_internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#ifndef SID_DAEMON_PATH
+#	define SID_DAEMON_PATH "../src/daemon/sid"
+#endif
+
+#ifndef SID_LOADGEN_PATH
+#	define SID_LOADGEN_PATH "../src/tools/loadgen/sid-loadgen"
+#endif
+
+#define TEST_DIR_TEMPLATE      "/tmp/sid-test-loadgen-XXXXXX"
+#define TEST_EXIT_SKIP         77
+#define TEST_START_TIMEOUT_MS  10000
+#define TEST_START_POLL_MS     100
+#define TEST_CONNECTIONS       "4"
+#define TEST_RATE              50
+#define TEST_DURATION          3
+#define TEST_MIX               "version,dbstats,devices,resources,dbdump"
+#define TEST_LINE_SIZE         128
+#define TEST_MAX_COMMANDS      5
+#define TEST_NR_LATENCY_FIELDS 5
+
+struct test_dir {
+	char path[sizeof(TEST_DIR_TEMPLATE)];
+	char socket[sizeof(TEST_DIR_TEMPLATE) + sizeof("/sid.socket")];
+	char log[sizeof(TEST_DIR_TEMPLATE) + sizeof("/sid.log")];
+	char out[sizeof(TEST_DIR_TEMPLATE) + sizeof("/loadgen.out")];
+};
+
+static int _write_file(const char *path, const char *fmt, ...)
+{
+	va_list ap;
+	int     fd, r = 0;
+
+	if ((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0)
+		return -errno;
+
+	va_start(ap, fmt);
+	if (vdprintf(fd, fmt, ap) < 0)
+		r = -errno;
+	va_end(ap);
+
+	(void) close(fd);
+	return r;
+}
+
+/*
+ * Run in new user, mount and network namespace, with private /run so the daemon
+ * does not touch the system database. This works without any privileges if
+ * unprivileged user namespaces are allowed.
+ */
+static int _enter_namespace(void)
+{
+	uid_t uid = getuid();
+	gid_t gid = getgid();
+
+	if (unshare(CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWNET) < 0)
+		return -errno;
+
+	if (_write_file("/proc/self/setgroups", "deny") < 0 || _write_file("/proc/self/uid_map", "0 %u 1", uid) < 0 ||
+	    _write_file("/proc/self/gid_map", "0 %u 1", gid) < 0)
+		return -EPERM;
+
+	if (mount(NULL, "/", NULL, MS_REC | MS_PRIVATE, NULL) < 0 || mount("tmpfs", "/run", "tmpfs", 0, NULL) < 0)
+		return -errno;
+
+	return 0;
+}
+
+static pid_t _spawn(const char *out_path, char *const argv[])
+{
+	pid_t pid;
+	int   fd;
+
+	if ((pid = fork()) != 0)
+		return pid;
+
+	if ((fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0 || dup2(fd, STDOUT_FILENO) < 0 ||
+	    dup2(fd, STDERR_FILENO) < 0)
+		_exit(EXIT_FAILURE);
+
+	execv(argv[0], argv);
+	_exit(EXIT_FAILURE);
+}
+
+static bool _wait_for_socket(const char *socket_path, pid_t daemon_pid)
+{
+	struct timespec delay = {.tv_nsec = TEST_START_POLL_MS * 1000000L};
+	struct stat     st;
+	int             waited;
+
+	for (waited = 0; waited < TEST_START_TIMEOUT_MS; waited += TEST_START_POLL_MS) {
+		if (!stat(socket_path, &st) && S_ISSOCK(st.st_mode))
+			return true;
+		if (waitpid(daemon_pid, NULL, WNOHANG) == daemon_pid)
+			return false;
+		nanosleep(&delay, NULL);
+	}
+
+	return false;
+}
+
+/* Child process: start SID and run the load generator against it, exit with its status. */
+static void _run_in_namespace(struct test_dir *dir)
+{
+	char *daemon_argv[] = {SID_DAEMON_PATH, "-f", NULL};
+	char  rate[16], duration[16];
+	char *loadgen_argv[] =
+		{SID_LOADGEN_PATH, "-c", TEST_CONNECTIONS, "-r", rate, "-d", duration, "-m", TEST_MIX, "-f", "env", NULL};
+	pid_t daemon_pid, loadgen_pid;
+	int   status;
+
+	if (_enter_namespace() < 0 || setenv(SID_KEY_SOCKET, dir->socket, 1) < 0)
+		_exit(TEST_EXIT_SKIP);
+
+	if ((daemon_pid = _spawn(dir->log, daemon_argv)) < 0)
+		_exit(EXIT_FAILURE);
+
+	/* SID may not be able to start here, e.g. without its modules installed */
+	if (!_wait_for_socket(dir->socket, daemon_pid)) {
+		(void) kill(daemon_pid, SIGKILL);
+		_exit(TEST_EXIT_SKIP);
+	}
+
+	snprintf(rate, sizeof(rate), "%d", TEST_RATE);
+	snprintf(duration, sizeof(duration), "%d", TEST_DURATION);
+
+	if ((loadgen_pid = _spawn(dir->out, loadgen_argv)) < 0 || waitpid(loadgen_pid, &status, 0) != loadgen_pid)
+		status = EXIT_FAILURE << 8;
+
+	(void) kill(daemon_pid, SIGTERM);
+	(void) waitpid(daemon_pid, NULL, 0);
+
+	_exit(WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE);
+}
+
+static unsigned long long _get_value(FILE *f, const char *key)
+{
+	char   line[TEST_LINE_SIZE];
+	size_t key_len = strlen(key);
+
+	rewind(f);
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, key, key_len) && line[key_len] == '=')
+			return strtoull(line + key_len + 1, NULL, 10);
+	}
+
+	fail_msg("%s missing in sid-loadgen output", key);
+	return 0;
+}
+
+static void _check_latencies(FILE *f, const char *prefix)
+{
+	static const char * const keys[TEST_NR_LATENCY_FIELDS] =
+		{"LATENCY_P50_USEC", "LATENCY_P90_USEC", "LATENCY_P99_USEC", "LATENCY_P999_USEC", "LATENCY_MAX_USEC"};
+	unsigned long long value, prev = 0;
+	char               key[TEST_LINE_SIZE];
+	int                i;
+
+	for (i = 0; i < TEST_NR_LATENCY_FIELDS; i++) {
+		snprintf(key, sizeof(key), "%s%s", prefix, keys[i]);
+		value = _get_value(f, key);
+		assert_true(value >= prev);
+		prev = value;
+	}
+
+	/* no request can take longer than the whole run */
+	assert_true(prev > 0);
+	assert_true(prev < (unsigned long long) _get_value(f, "DURATION_MSEC") * 1000);
+}
+
+static void test_loadgen_counters(void **state)
+{
+	static const char * const prefixes[TEST_MAX_COMMANDS] = {"VERSION_", "DBSTATS_", "DEVICES_", "RESOURCES_", "DBDUMP_"};
+	struct test_dir           dir;
+	char                      key[TEST_LINE_SIZE];
+	unsigned long long        requests = 0;
+	FILE                     *f;
+	pid_t                     pid;
+	int                       i, status;
+
+	memcpy(dir.path, TEST_DIR_TEMPLATE, sizeof(TEST_DIR_TEMPLATE));
+	assert_non_null(mkdtemp(dir.path));
+	snprintf(dir.socket, sizeof(dir.socket), "%s/sid.socket", dir.path);
+	snprintf(dir.log, sizeof(dir.log), "%s/sid.log", dir.path);
+	snprintf(dir.out, sizeof(dir.out), "%s/loadgen.out", dir.path);
+
+	assert_true((pid = fork()) >= 0);
+	if (!pid)
+		_run_in_namespace(&dir);
+
+	assert_int_equal(waitpid(pid, &status, 0), pid);
+	assert_true(WIFEXITED(status));
+
+	if (WEXITSTATUS(status) == TEST_EXIT_SKIP) {
+		print_message("SID could not be started in a test namespace, skipping\n");
+		(void) unlink(dir.log);
+		(void) unlink(dir.socket);
+		(void) rmdir(dir.path);
+		skip();
+	}
+
+	assert_int_equal(WEXITSTATUS(status), 0);
+	assert_non_null(f = fopen(dir.out, "r"));
+
+	/* all scheduled requests are accounted for, none of them failed */
+	assert_int_equal(_get_value(f, "REQUESTS"), TEST_RATE * TEST_DURATION);
+	assert_int_equal(_get_value(f, "COMPLETED"), TEST_RATE * TEST_DURATION);
+	assert_int_equal(_get_value(f, "ERRORS"), 0);
+	assert_true(_get_value(f, "THROUGHPUT") > 0);
+	assert_true(_get_value(f, "THROUGHPUT") <= TEST_RATE);
+	assert_true(_get_value(f, "DURATION_MSEC") >= (TEST_DURATION - 1) * 1000);
+	_check_latencies(f, "");
+
+	for (i = 0; i < TEST_MAX_COMMANDS; i++) {
+		snprintf(key, sizeof(key), "%sREQUESTS", prefixes[i]);
+		requests += _get_value(f, key);
+		snprintf(key, sizeof(key), "%sERRORS", prefixes[i]);
+		assert_int_equal(_get_value(f, key), 0);
+		_check_latencies(f, prefixes[i]);
+	}
+
+	assert_int_equal(requests, TEST_RATE * TEST_DURATION);
+
+	fclose(f);
+	(void) unlink(dir.out);
+	(void) unlink(dir.log);
+	(void) unlink(dir.socket);
+	assert_int_equal(rmdir(dir.path), 0);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_loadgen_counters),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,447 @@
+#include "internal/param.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#define TEST_FILE_TEMPLATE "/tmp/sid-test-param-XXXXXX"
+
+struct subsys {
+	uint64_t value;
+	char     str[64]; /* value of string parameter */
+	unsigned calls;
+	int      fail; /* error to return from apply callback, 0 to succeed */
+};
+
+static int _apply(const char *name, uint64_t value, const char *str, void *arg)
+{
+	struct subsys *subsys = arg;
+
+	subsys->calls++;
+	if (subsys->fail)
+		return subsys->fail;
+
+	subsys->value = value;
+	if (str)
+		snprintf(subsys->str, sizeof(subsys->str), "%s", str);
+	return 0;
+}
+
+/*
+ * HOT_A    uint  10..100, default 50, hot
+ * HOT_B    uint   0..5,   default 1,  hot
+ * COLD     uint   1..8,   default 4
+ * COLD_B   bool           default 0
+ */
+static struct param_registry *_create(struct subsys *a, struct subsys *b, struct subsys *cold)
+{
+	struct param_registry *reg;
+
+	assert_non_null(reg = param_registry_create());
+
+	a->value    = 50;
+	b->value    = 1;
+	cold->value = 4;
+
+	assert_int_equal(param_register(reg,
+	                                 &(struct param_spec) {.name  = "HOT_A",
+	                                                       .type  = PARAM_TYPE_UINT,
+	                                                       .min   = 10,
+	                                                       .max   = 100,
+	                                                       .def   = 50,
+	                                                       .flags = PARAM_FL_HOT,
+	                                                       .apply = _apply,
+	                                                       .arg   = a}),
+	                 0);
+	assert_int_equal(param_register(reg,
+	                                 &(struct param_spec) {.name  = "HOT_B",
+	                                                       .type  = PARAM_TYPE_UINT,
+	                                                       .max   = 5,
+	                                                       .def   = 1,
+	                                                       .flags = PARAM_FL_HOT,
+	                                                       .apply = _apply,
+	                                                       .arg   = b}),
+	                 0);
+	assert_int_equal(param_register(reg,
+	                                 &(struct param_spec) {.name  = "COLD",
+	                                                       .type  = PARAM_TYPE_UINT,
+	                                                       .min   = 1,
+	                                                       .max   = 8,
+	                                                       .def   = 4,
+	                                                       .apply = _apply,
+	                                                       .arg   = cold}),
+	                 0);
+	assert_int_equal(param_register(reg, &(struct param_spec) {.name = "COLD_B", .type = PARAM_TYPE_BOOL}), 0);
+
+	return reg;
+}
+
+static uint64_t _get(struct param_registry *reg, const char *name)
+{
+	uint64_t value;
+
+	assert_int_equal(param_get(reg, name, &value), 0);
+	return value;
+}
+
+static void test_param_register(void **state)
+{
+	struct param_registry *reg;
+	uint64_t               value;
+
+	assert_non_null(reg = param_registry_create());
+
+	/* default must be within range */
+	assert_int_equal(param_register(reg, &(struct param_spec) {.name = "X", .type = PARAM_TYPE_UINT, .min = 1, .max = 2}),
+	                 -ERANGE);
+	assert_int_equal(param_register(reg, &(struct param_spec) {.name = "X", .type = PARAM_TYPE_BOOL, .def = 2}), -ERANGE);
+	assert_int_equal(param_register(reg, &(struct param_spec) {.name = "X=1", .type = PARAM_TYPE_BOOL}), -EINVAL);
+	assert_int_equal(param_get(reg, "X", &value), -ENOENT);
+
+	/* range is ignored for bool */
+	assert_int_equal(param_register(reg, &(struct param_spec) {.name = "X", .type = PARAM_TYPE_BOOL, .max = 7, .def = 1}), 0);
+	assert_int_equal(param_register(reg, &(struct param_spec) {.name = "X", .type = PARAM_TYPE_BOOL}), -EEXIST);
+	assert_int_equal(_get(reg, "X"), 1);
+	assert_int_equal(param_set(reg, "X=2", sizeof("X=2"), NULL), -ERANGE);
+
+	param_registry_destroy(reg);
+}
+
+static void test_param_range(void **state)
+{
+	struct subsys          a = {0}, b = {0}, cold = {0};
+	struct param_registry *reg = _create(&a, &b, &cold);
+	const char            *failed;
+
+	param_registry_set_running(reg);
+
+	assert_int_equal(param_set(reg, "HOT_A=9", sizeof("HOT_A=9"), &failed), -ERANGE);
+	assert_string_equal(failed, "HOT_A");
+	assert_int_equal(param_set(reg, "HOT_A=101", sizeof("HOT_A=101"), &failed), -ERANGE);
+	assert_int_equal(param_set(reg, "HOT_A=-1", sizeof("HOT_A=-1"), &failed), -EINVAL);
+	assert_int_equal(param_set(reg, "HOT_A= 20", sizeof("HOT_A= 20"), &failed), -EINVAL);
+	assert_int_equal(param_set(reg, "HOT_A=20x", sizeof("HOT_A=20x"), &failed), -EINVAL);
+	assert_int_equal(param_set(reg, "HOT_A=", sizeof("HOT_A="), &failed), -EINVAL);
+	assert_int_equal(param_set(reg, "HOT_A=99999999999999999999999", sizeof("HOT_A=99999999999999999999999"), &failed),
+	                 -EINVAL);
+	assert_int_equal(param_set(reg, "COLD_B=2", sizeof("COLD_B=2"), &failed), -ERANGE);
+
+	assert_int_equal(param_set(reg, "NOPE=1", sizeof("NOPE=1"), &failed), -ENOENT);
+	assert_string_equal(failed, "NOPE=1");
+	assert_int_equal(param_set(reg, "HOT_A", sizeof("HOT_A"), &failed), -EINVAL);
+
+	/* nothing was applied */
+	assert_int_equal(a.calls, 0);
+	assert_int_equal(_get(reg, "HOT_A"), 50);
+
+	/* range limits are inclusive */
+	assert_int_equal(param_set(reg, "HOT_A=10", sizeof("HOT_A=10"), &failed), 0);
+	assert_null(failed);
+	assert_int_equal(_get(reg, "HOT_A"), 10);
+	assert_int_equal(param_set(reg, "HOT_A=100", sizeof("HOT_A=100"), &failed), 0);
+	assert_int_equal(_get(reg, "HOT_A"), 100);
+	assert_int_equal(a.value, 100);
+	assert_int_equal(a.calls, 2);
+
+	param_registry_destroy(reg);
+}
+
+static void test_param_atomic(void **state)
+{
+	static const char      bad_value[] = "HOT_A=20\0HOT_B=6";
+	static const char      good[]      = "HOT_A=20\0HOT_B=3";
+	struct subsys          a = {0}, b = {0}, cold = {0};
+	struct param_registry *reg = _create(&a, &b, &cold);
+	const char            *failed;
+
+	param_registry_set_running(reg);
+
+	/* invalid value later in the batch - nothing is applied */
+	assert_int_equal(param_set(reg, bad_value, sizeof(bad_value), &failed), -ERANGE);
+	assert_string_equal(failed, "HOT_B");
+	assert_int_equal(a.calls, 0);
+	assert_int_equal(b.calls, 0);
+	assert_int_equal(_get(reg, "HOT_A"), 50);
+
+	/* second subsystem fails to apply - the first one is rolled back */
+	b.fail = -EBUSY;
+	assert_int_equal(param_set(reg, good, sizeof(good), &failed), -EBUSY);
+	assert_string_equal(failed, "HOT_B");
+	assert_int_equal(a.calls, 2);
+	assert_int_equal(a.value, 50);
+	assert_int_equal(b.value, 1);
+	assert_int_equal(_get(reg, "HOT_A"), 50);
+	assert_int_equal(_get(reg, "HOT_B"), 1);
+
+	/* all applied */
+	b.fail = 0;
+	assert_int_equal(param_set(reg, good, sizeof(good), &failed), 0);
+	assert_int_equal(a.value, 20);
+	assert_int_equal(b.value, 3);
+	assert_int_equal(_get(reg, "HOT_A"), 20);
+	assert_int_equal(_get(reg, "HOT_B"), 3);
+
+	/* unchanged values are not applied again, the last one in the batch wins */
+	a.calls = b.calls = 0;
+	assert_int_equal(param_set(reg, "HOT_A=20\0HOT_B=4\0HOT_B=5", sizeof("HOT_A=20\0HOT_B=4\0HOT_B=5"), NULL), 0);
+	assert_int_equal(a.calls, 0);
+	assert_int_equal(b.calls, 1);
+	assert_int_equal(_get(reg, "HOT_B"), 5);
+
+	param_registry_destroy(reg);
+}
+
+static void test_param_not_hot(void **state)
+{
+	static const char      mixed[] = "HOT_A=30\0COLD=5";
+	struct subsys          a = {0}, b = {0}, cold = {0};
+	struct param_registry *reg = _create(&a, &b, &cold);
+	const char            *failed;
+
+	/* anything can be changed before running, apply callbacks are not called */
+	assert_int_equal(param_set(reg, "COLD=2\0COLD_B=1", sizeof("COLD=2\0COLD_B=1"), NULL), 0);
+	assert_int_equal(_get(reg, "COLD"), 2);
+	assert_int_equal(_get(reg, "COLD_B"), 1);
+	assert_int_equal(cold.calls, 0);
+
+	param_registry_set_running(reg);
+
+	assert_int_equal(param_set(reg, "COLD=3", sizeof("COLD=3"), &failed), -EPERM);
+	assert_string_equal(failed, "COLD");
+	assert_int_equal(param_set(reg, "COLD_B=0", sizeof("COLD_B=0"), &failed), -EPERM);
+
+	/* hot parameter in the same batch is not changed either */
+	assert_int_equal(param_set(reg, mixed, sizeof(mixed), &failed), -EPERM);
+	assert_int_equal(a.calls, 0);
+	assert_int_equal(_get(reg, "HOT_A"), 50);
+	assert_int_equal(_get(reg, "COLD"), 2);
+
+	/* setting the current value is fine, e.g. when reloading unchanged config */
+	assert_int_equal(param_set(reg, "HOT_A=30\0COLD=2", sizeof("HOT_A=30\0COLD=2"), &failed), 0);
+	assert_int_equal(_get(reg, "HOT_A"), 30);
+	assert_int_equal(cold.calls, 0);
+
+	param_registry_destroy(reg);
+}
+
+static void test_param_load(void **state)
+{
+	static const char      content[] = "# comment\n"
+					   "\n"
+					   "HOT_A=70\n"
+					   "  HOT_B = \"2\"  \n"
+					   "UNRELATED=whatever\n"
+					   "COLD='4'\n"
+					   "#COLD_B=1\n";
+	char                   path[] = TEST_FILE_TEMPLATE;
+	struct subsys          a = {0}, b = {0}, cold = {0};
+	struct param_registry *reg = _create(&a, &b, &cold);
+	const char            *failed;
+	int                    fd;
+
+	/* invalid values from environment are ignored */
+	assert_int_equal(setenv("HOT_A", "20", 1), 0);
+	assert_int_equal(setenv("HOT_B", "6", 1), 0);
+	assert_int_equal(param_load_env(reg, &failed), -EINVAL);
+	assert_string_equal(failed, "HOT_B");
+	assert_int_equal(_get(reg, "HOT_A"), 20);
+	assert_int_equal(_get(reg, "HOT_B"), 1);
+	unsetenv("HOT_A");
+	unsetenv("HOT_B");
+
+	param_registry_set_running(reg);
+
+	assert_true((fd = mkstemp(path)) >= 0);
+	assert_int_equal(write(fd, content, sizeof(content) - 1), sizeof(content) - 1);
+	close(fd);
+
+	assert_int_equal(param_load_file(reg, path, &failed), 0);
+	assert_int_equal(_get(reg, "HOT_A"), 70);
+	assert_int_equal(_get(reg, "HOT_B"), 2);
+	assert_int_equal(a.value, 70);
+	assert_int_equal(b.value, 2);
+	assert_int_equal(cold.calls, 0);
+
+	/* changed value of parameter which is not hot-reloadable rejects whole file */
+	assert_true((fd = open(path, O_WRONLY | O_APPEND)) >= 0);
+	assert_int_equal(write(fd, "COLD=5\nHOT_A=80\n", 16), 16);
+	close(fd);
+
+	assert_int_equal(param_load_file(reg, path, &failed), -EPERM);
+	assert_string_equal(failed, "COLD");
+	assert_int_equal(_get(reg, "HOT_A"), 70);
+
+	assert_int_equal(unlink(path), 0);
+	assert_int_equal(param_load_file(reg, path, &failed), -ENOENT);
+
+	param_registry_destroy(reg);
+}
+
+static const char *_get_str(struct param_registry *reg, const char *name)
+{
+	const char *value;
+
+	assert_int_equal(param_get_str(reg, name, &value), 0);
+	return value;
+}
+
+static void test_param_str(void **state)
+{
+	static const char      batch[]      = "STR=new\0LONG=x";
+	static const char      long_value[] = "LONG=0123456789012345678901234567890123456789";
+	struct subsys          a = {0}, b = {0}, cold = {0}, str = {0}, other = {0};
+	struct param_registry *reg = _create(&a, &b, &cold);
+	struct sid_buffer     *buf;
+	const char            *failed, *value;
+	const void            *data;
+	size_t                 size;
+	uint64_t               num;
+
+	/* default must fit */
+	assert_int_equal(
+		param_register(reg, &(struct param_spec) {.name = "STR", .type = PARAM_TYPE_STR, .max = 2, .def_str = "abc"}),
+		-ERANGE);
+	assert_int_equal(param_register(reg,
+	                                 &(struct param_spec) {.name    = "STR",
+	                                                       .type    = PARAM_TYPE_STR,
+	                                                       .max     = 8,
+	                                                       .def_str = "abc",
+	                                                       .flags   = PARAM_FL_HOT,
+	                                                       .apply   = _apply,
+	                                                       .arg     = &str}),
+	                 0);
+	assert_int_equal(param_register(reg,
+	                                 &(struct param_spec) {.name  = "LONG",
+	                                                       .type  = PARAM_TYPE_STR,
+	                                                       .max   = 64,
+	                                                       .flags = PARAM_FL_HOT,
+	                                                       .apply = _apply,
+	                                                       .arg   = &other}),
+	                 0);
+
+	/* types must match */
+	assert_int_equal(param_get(reg, "STR", &num), -EINVAL);
+	assert_int_equal(param_get_str(reg, "HOT_A", &value), -EINVAL);
+	assert_string_equal(_get_str(reg, "STR"), "abc");
+	assert_string_equal(_get_str(reg, "LONG"), "");
+
+	assert_int_equal(setenv("LONG", "from env", 1), 0);
+	assert_int_equal(param_load_env(reg, NULL), 0);
+	assert_string_equal(_get_str(reg, "LONG"), "from env");
+	unsetenv("LONG");
+
+	param_registry_set_running(reg);
+
+	assert_int_equal(param_set(reg, "STR=toolong12", sizeof("STR=toolong12"), &failed), -ERANGE);
+	assert_string_equal(failed, "STR");
+	assert_int_equal(str.calls, 0);
+
+	/* values longer than numeric ones are fine, the last one in the batch wins */
+	assert_int_equal(param_set(reg, long_value, sizeof(long_value), NULL), 0);
+	assert_string_equal(_get_str(reg, "LONG"), long_value + sizeof("LONG=") - 1);
+	assert_int_equal(param_set(reg, "STR=x\0STR=y", sizeof("STR=x\0STR=y"), NULL), 0);
+	assert_string_equal(_get_str(reg, "STR"), "y");
+	assert_string_equal(str.str, "y");
+	assert_int_equal(str.calls, 1);
+
+	/* unchanged value is not applied again, empty value is fine */
+	assert_int_equal(param_set(reg, "STR=y", sizeof("STR=y"), NULL), 0);
+	assert_int_equal(str.calls, 1);
+	assert_int_equal(param_set(reg, "STR=", sizeof("STR="), NULL), 0);
+	assert_string_equal(_get_str(reg, "STR"), "");
+	assert_string_equal(str.str, "");
+
+	/* rolled back with the original string */
+	other.fail = -EBUSY;
+	assert_int_equal(param_set(reg, batch, sizeof(batch), &failed), -EBUSY);
+	assert_string_equal(failed, "LONG");
+	assert_string_equal(_get_str(reg, "STR"), "");
+	assert_string_equal(str.str, "");
+	assert_int_equal(str.calls, 4);
+
+	other.fail = 0;
+	assert_int_equal(param_set(reg, batch, sizeof(batch), NULL), 0);
+	assert_string_equal(_get_str(reg, "STR"), "new");
+	assert_string_equal(other.str, "x");
+
+	assert_non_null(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                                    .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                                    .mode    = SID_BUFFER_MODE_PLAIN}),
+	                                        &((struct sid_buffer_init) {.size = 0, .alloc_step = 1, .limit = 0}),
+	                                        NULL));
+	assert_int_equal(param_write(reg, "STR", sizeof("STR"), ENV, buf, NULL), 0);
+	print_null_byte(buf);
+	sid_buffer_get_data(buf, &data, &size);
+	assert_non_null(strstr(data, "TYPE=str\n"));
+	assert_non_null(strstr(data, "VALUE=new\n"));
+	assert_non_null(strstr(data, "DEFAULT=abc\n"));
+	assert_non_null(strstr(data, "MAXLEN=8\n"));
+
+	sid_buffer_destroy(buf);
+	param_registry_destroy(reg);
+}
+
+static void test_param_write(void **state)
+{
+	struct subsys          a = {0}, b = {0}, cold = {0};
+	struct param_registry *reg = _create(&a, &b, &cold);
+	struct sid_buffer     *buf;
+	const char            *failed;
+	const void            *data;
+	size_t                 size;
+
+	assert_non_null(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                                    .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                                    .mode    = SID_BUFFER_MODE_PLAIN}),
+	                                        &((struct sid_buffer_init) {.size = 0, .alloc_step = 1, .limit = 0}),
+	                                        NULL));
+
+	assert_int_equal(param_write(reg, "HOT_B\0NOPE", sizeof("HOT_B\0NOPE"), ENV, buf, &failed), -ENOENT);
+	assert_string_equal(failed, "NOPE");
+	assert_int_equal(sid_buffer_count(buf), 0);
+
+	/* values in the list are ignored */
+	assert_int_equal(param_write(reg, "HOT_B=4", sizeof("HOT_B=4"), ENV, buf, NULL), 0);
+	print_null_byte(buf);
+	sid_buffer_get_data(buf, &data, &size);
+	assert_non_null(strstr(data, "NAME=HOT_B\n"));
+	assert_non_null(strstr(data, "VALUE=1\n"));
+	assert_non_null(strstr(data, "MAX=5\n"));
+	assert_non_null(strstr(data, "HOT=1\n"));
+	assert_null(strstr(data, "HOT_A"));
+
+	sid_buffer_rewind(buf, 0, SID_BUFFER_POS_ABS);
+	assert_int_equal(param_write(reg, NULL, 0, ENV, buf, NULL), 0);
+	print_null_byte(buf);
+	sid_buffer_get_data(buf, &data, &size);
+	assert_non_null(strstr(data, "NAME=HOT_A\n"));
+	assert_non_null(strstr(data, "NAME=COLD_B\n"));
+	assert_non_null(strstr(data, "TYPE=bool\n"));
+
+	sid_buffer_destroy(buf);
+	param_registry_destroy(reg);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_param_register),
+		cmocka_unit_test(test_param_range),
+		cmocka_unit_test(test_param_atomic),
+		cmocka_unit_test(test_param_not_hot),
+		cmocka_unit_test(test_param_load),
+		cmocka_unit_test(test_param_str),
+		cmocka_unit_test(test_param_write),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,579 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "ucmd_fixture.h"
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#define TEST_NR_CHILDREN 10000
+#define TEST_FLUSH_SIZE  4096
+#define TEST_BUF_LIMIT   16384
+#define TEST_CMD_ID      "cmd-id"
+
+/* the buffers used for resources command may grow over the flush size only by the last resource written */
+#define TEST_CMD_BUF_LIMIT (2 * RESOURCES_WRITE_FLUSH_SIZE)
+
+#define TEST_STORM_CHANNELS        8
+#define TEST_STORM_INITIAL_CLIENTS 16
+#define TEST_STORM_CLIENTS_PER_ACC 2
+#define TEST_STORM_ACCEPT_BUDGET   4
+#define TEST_STORM_ROUNDS          20
+#define TEST_STORM_MAX_CLIENTS     256
+
+static const sid_resource_type_t test_resource_type = {
+	.name       = "test",
+	.short_name = "tst",
+};
+
+static const sid_resource_type_t test_event_loop_resource_type = {
+	.name            = "test event loop",
+	.short_name      = "tel",
+	.with_event_loop = 1,
+};
+
+/* the last message sent through worker channel */
+static struct {
+	char   data[PATH_MAX];
+	size_t data_size;
+	int    fd;
+} sent = {.fd = -1};
+
+/* the most memory allocated by any buffer destroyed so far */
+static size_t buf_high_water;
+
+int __wrap_worker_control_channel_send(sid_resource_t *res, const char *channel_id, struct worker_data_spec *data_spec)
+{
+	assert_true(data_spec->data_size <= sizeof(sent.data));
+	memcpy(sent.data, data_spec->data, data_spec->data_size);
+	sent.data_size = data_spec->data_size;
+
+	/* the fd is received by another process, so it stays open there even if the sender closes it */
+	sent.fd = data_spec->ext.used ? dup(data_spec->ext.socket.fd_pass) : -1;
+
+	return 0;
+}
+
+void __real_sid_buffer_destroy(struct sid_buffer *buf);
+
+void __wrap_sid_buffer_destroy(struct sid_buffer *buf)
+{
+	size_t allocated = sid_buffer_stat(buf).usage.allocated;
+
+	if (allocated > buf_high_water)
+		buf_high_water = allocated;
+
+	__real_sid_buffer_destroy(buf);
+}
+
+static int _init_fake_connection(sid_resource_t *res, const void *kickstart_data, void **data)
+{
+	*data = (void *) kickstart_data;
+	return 0;
+}
+
+static const sid_resource_type_t test_connection_resource_type = {
+	.name       = "fake_connection",
+	.short_name = "fcn",
+	.init       = _init_fake_connection,
+};
+
+static int _init_fake_command(sid_resource_t *res, const void *kickstart_data, void **data)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = ucmd_fixture_ctx_create();
+
+	ucmd_ctx->req_cat        = MSG_CATEGORY_CLIENT;
+	ucmd_ctx->req_hdr.cmd    = SID_CMD_RESOURCES;
+	ucmd_ctx->req_hdr.flags  = SID_CMD_FLAGS_FMT_JSON;
+	ucmd_ctx->res_hdr.status = SID_CMD_STATUS_SUCCESS;
+	ucmd_ctx->res_hdr.cmd    = SID_CMD_REPLY;
+	ucmd_ctx->prn_buf        = ucmd_fixture_buffer_create();
+	ucmd_ctx->resources.fd   = -1;
+	*data                    = ucmd_ctx;
+	return 0;
+}
+
+static int _destroy_fake_command(sid_resource_t *res)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(res);
+
+	if (ucmd_ctx->resources.fd >= 0)
+		close(ucmd_ctx->resources.fd);
+	sid_buffer_destroy(ucmd_ctx->prn_buf);
+	ucmd_fixture_ctx_destroy(ucmd_ctx);
+	return 0;
+}
+
+static const sid_resource_type_t test_command_resource_type = {
+	.name       = "fake_command",
+	.short_name = "fcm",
+	.init       = _init_fake_command,
+	.destroy    = _destroy_fake_command,
+};
+
+static sid_resource_t *_create_res(sid_resource_t *parent_res, const sid_resource_type_t *type, const char *id)
+{
+	sid_resource_t *res;
+
+	assert_non_null(res = sid_resource_create(parent_res,
+	                                          type,
+	                                          SID_RESOURCE_NO_FLAGS,
+	                                          id,
+	                                          SID_RESOURCE_NO_PARAMS,
+	                                          SID_RESOURCE_PRIO_NORMAL,
+	                                          SID_RESOURCE_NO_SERVICE_LINKS));
+	return res;
+}
+
+static struct sid_buffer *_create_buf(size_t limit)
+{
+	struct sid_buffer *buf;
+
+	assert_non_null(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                                     .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                                     .mode    = SID_BUFFER_MODE_PLAIN}),
+	                                        &((struct sid_buffer_init) {.size = 0, .alloc_step = 1024, .limit = limit}),
+	                                        NULL));
+	return buf;
+}
+
+/* Write resource tree with 'spec' into buffer and return the output as null-terminated string. */
+static char *_write_tree(sid_resource_t *res, struct sid_resource_write_spec *spec)
+{
+	struct sid_buffer *buf = _create_buf(0);
+	const char        *data;
+	size_t             size;
+	char              *out;
+
+	assert_int_equal(sid_resource_write_tree(res, spec, buf, 0, false), 0);
+	assert_int_equal(sid_buffer_get_data(buf, (const void **) &data, &size), 0);
+	assert_non_null(out = size ? strndup(data, size) : strdup(""));
+	sid_buffer_destroy(buf);
+
+	return out;
+}
+
+static unsigned _count_str(const char *haystack, const char *needle)
+{
+	unsigned count = 0;
+
+	while ((haystack = strstr(haystack, needle))) {
+		count++;
+		haystack += strlen(needle);
+	}
+
+	return count;
+}
+
+static void test_write_tree_streamed(void **state)
+{
+	output_format_t    formats[] = {TABLE, JSON, ENV};
+	sid_resource_t    *root_res, *res;
+	struct sid_buffer *buf, *stream_buf;
+	const char        *data;
+	char              *stream_data;
+	char               id[32];
+	size_t             size;
+	int                i, fd;
+
+	root_res = _create_res(SID_RESOURCE_NO_PARENT, &sid_resource_type_aggregate, "root");
+	res      = _create_res(root_res, &sid_resource_type_aggregate, "parent");
+	for (i = 0; i < TEST_NR_CHILDREN; i++) {
+		snprintf(id, sizeof(id), "child%d", i);
+		_create_res(res, &test_resource_type, id);
+	}
+
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		buf = _create_buf(0);
+		assert_int_equal(sid_resource_write_tree_recursively(root_res, formats[i], buf, 0, false), 0);
+		assert_int_equal(sid_buffer_get_data(buf, (const void **) &data, &size), 0);
+
+		/* the buffer limit makes writing fail if the whole tree was kept in memory */
+		stream_buf = _create_buf(TEST_BUF_LIMIT);
+		assert_true((fd = memfd_create("test_resource", MFD_CLOEXEC)) >= 0);
+		assert_int_equal(sid_resource_write_tree(root_res,
+		                                         &((struct sid_resource_write_spec) {.format     = formats[i],
+		                                                                             .fd         = fd,
+		                                                                             .flush_size = TEST_FLUSH_SIZE}),
+		                                         stream_buf,
+		                                         0,
+		                                         false),
+		                 0);
+		assert_int_equal(sid_buffer_write_all(stream_buf, fd), 0);
+		assert_true(sid_buffer_stat(stream_buf).usage.allocated <= TEST_BUF_LIMIT);
+
+		assert_int_equal(lseek(fd, 0, SEEK_END), size);
+		assert_true((stream_data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED);
+		assert_memory_equal(stream_data, data, size);
+
+		munmap(stream_data, size);
+		close(fd);
+		sid_buffer_destroy(stream_buf);
+		sid_buffer_destroy(buf);
+	}
+
+	sid_resource_unref(root_res);
+}
+
+/*
+ * Write the response for resources command the same way as the worker and the main process do,
+ * but with all the resources in memory.
+ */
+static struct sid_buffer *_write_resources_response(sid_resource_t *main_res, sid_resource_t *worker_res)
+{
+	struct sid_buffer *buf = _create_buf(0);
+
+	print_start_elem(JSON, buf, 0, false);
+	print_start_array(JSON, buf, 1, "sidresources", false);
+	assert_int_equal(sid_resource_write_tree_recursively(main_res, JSON, buf, 2, false), 0);
+	assert_int_equal(sid_resource_write_tree_recursively(worker_res, JSON, buf, 2, true), 0);
+	print_end_array(JSON, buf, 1);
+	print_end_elem(JSON, buf, 0);
+	print_null_byte(buf);
+
+	return buf;
+}
+
+static void test_resources_cmd_streamed(void **state)
+{
+	struct connection           conn = {.fd = -1};
+	sid_resource_t             *main_res, *res, *worker_res, *conn_res, *cmd_res;
+	struct sid_ucmd_ctx        *ucmd_ctx;
+	struct worker_data_spec     data_spec;
+	struct sid_buffer          *buf;
+	struct sid_msg_header       hdr;
+	SID_BUFFER_SIZE_PREFIX_TYPE msg_size;
+	const char                 *data;
+	char                       *out;
+	char                        id[32];
+	size_t                      size;
+	off_t                       out_size;
+	int                         i;
+
+	main_res = _create_res(SID_RESOURCE_NO_PARENT, &sid_resource_type_aggregate, "main");
+	res      = _create_res(main_res, &sid_resource_type_aggregate, "parent");
+	for (i = 0; i < TEST_NR_CHILDREN; i++) {
+		snprintf(id, sizeof(id), "child%d", i);
+		_create_res(res, &test_resource_type, id);
+	}
+
+	/* the client connection is a memfd so that the whole response can be checked afterwards */
+	assert_true((conn.fd = memfd_create("test_resource_conn", MFD_CLOEXEC)) >= 0);
+	worker_res = _create_res(SID_RESOURCE_NO_PARENT, &sid_resource_type_aggregate, "worker");
+	assert_non_null(conn_res = sid_resource_create(worker_res,
+	                                               &test_connection_resource_type,
+	                                               SID_RESOURCE_NO_FLAGS,
+	                                               "conn",
+	                                               &conn,
+	                                               SID_RESOURCE_PRIO_NORMAL,
+	                                               SID_RESOURCE_NO_SERVICE_LINKS));
+	cmd_res  = _create_res(conn_res, &test_command_resource_type, TEST_CMD_ID);
+	ucmd_ctx = sid_resource_get_data(cmd_res);
+
+	buf_high_water = 0;
+
+	/* the worker sends request with memfd to main process... */
+	assert_int_equal(_cmd_exec_resources(&(struct cmd_exec_arg) {.cmd_res = cmd_res}), 0);
+	assert_int_equal(ucmd_ctx->state, CMD_EXPECTING_DATA);
+	assert_true(sent.fd >= 0);
+
+	/* ...main process appends its resource tree to the memfd and replies... */
+	data_spec = (struct worker_data_spec) {.data               = sent.data,
+	                                       .data_size          = sent.data_size,
+	                                       .ext.used           = true,
+	                                       .ext.socket.fd_pass = sent.fd};
+	assert_int_equal(_worker_proxy_recv_system_cmd_resources(main_res, &data_spec, NULL), 0);
+	assert_int_equal(sent.fd, -1);
+
+	/* ...and the worker adds its own resource tree and sends out the response, see _worker_recv_system_cmd_resources */
+	ucmd_ctx->resources.main_written = true;
+	assert_int_equal(_cmd_exec_resources(&(struct cmd_exec_arg) {.cmd_res = cmd_res}), 0);
+	assert_int_equal(ucmd_ctx->state, CMD_EXEC_FINISHED);
+	assert_int_equal(_send_out_cmd_resbuf(cmd_res), 0);
+
+	/* no buffer on the way ever kept the whole tree */
+	assert_true(buf_high_water <= TEST_CMD_BUF_LIMIT);
+	assert_true(sid_buffer_stat(ucmd_ctx->prn_buf).usage.allocated <= TEST_CMD_BUF_LIMIT);
+	assert_true(sid_buffer_stat(ucmd_ctx->res_buf).usage.allocated <= TEST_CMD_BUF_LIMIT);
+	assert_true(sid_buffer_stat(ucmd_ctx->common->gen_buf).usage.allocated <= TEST_CMD_BUF_LIMIT);
+
+	/* the response is the same as if it was written all at once */
+	buf = _write_resources_response(main_res, worker_res);
+	assert_int_equal(sid_buffer_get_data(buf, (const void **) &data, &size), 0);
+
+	out_size = lseek(conn.fd, 0, SEEK_END);
+	assert_int_equal(out_size, SID_BUFFER_SIZE_PREFIX_LEN + SID_MSG_HEADER_SIZE + size);
+	assert_true((out = mmap(NULL, out_size, PROT_READ, MAP_SHARED, conn.fd, 0)) != MAP_FAILED);
+
+	memcpy(&msg_size, out, SID_BUFFER_SIZE_PREFIX_LEN);
+	assert_int_equal(msg_size, out_size);
+	memcpy(&hdr, out + SID_BUFFER_SIZE_PREFIX_LEN, SID_MSG_HEADER_SIZE);
+	assert_int_equal(hdr.cmd, SID_CMD_REPLY);
+	assert_int_equal(hdr.status, SID_CMD_STATUS_SUCCESS);
+	assert_memory_equal(out + SID_BUFFER_SIZE_PREFIX_LEN + SID_MSG_HEADER_SIZE, data, size);
+	assert_int_equal(_count_str(data, "tst child"), TEST_NR_CHILDREN);
+
+	munmap(out, out_size);
+	sid_buffer_destroy(buf);
+	sid_resource_unref(worker_res);
+	sid_resource_unref(main_res);
+	close(conn.fd);
+}
+
+static void test_write_tree_depth(void **state)
+{
+	sid_resource_t *root_res, *res;
+	char           *out;
+
+	root_res = _create_res(SID_RESOURCE_NO_PARENT, &sid_resource_type_aggregate, "root");
+	res      = _create_res(root_res, &sid_resource_type_aggregate, "parent");
+	_create_res(res, &sid_resource_type_aggregate, "child");
+
+	out = _write_tree(root_res, &((struct sid_resource_write_spec) {.format = JSON, .fd = -1, .max_depth = 1}));
+	assert_non_null(strstr(out, "agg root"));
+	assert_null(strstr(out, "agg parent"));
+	assert_null(strstr(out, "children"));
+	free(out);
+
+	out = _write_tree(root_res, &((struct sid_resource_write_spec) {.format = JSON, .fd = -1, .max_depth = 2}));
+	assert_non_null(strstr(out, "agg parent"));
+	assert_null(strstr(out, "agg child"));
+	assert_int_equal(_count_str(out, "children"), 1);
+	free(out);
+
+	out = _write_tree(root_res, &((struct sid_resource_write_spec) {.format = JSON, .fd = -1, .max_depth = 0}));
+	assert_non_null(strstr(out, "agg child"));
+	assert_int_equal(_count_str(out, "children"), 2);
+	free(out);
+
+	sid_resource_unref(root_res);
+}
+
+static void test_write_tree_type(void **state)
+{
+	sid_resource_t *root_res, *res;
+	char           *out;
+
+	/*
+	 * root (agg)
+	 *   parent (agg)
+	 *     child1 (tst)
+	 *       child2 (tst)
+	 *   child3 (tst)
+	 */
+	root_res = _create_res(SID_RESOURCE_NO_PARENT, &sid_resource_type_aggregate, "root");
+	res      = _create_res(root_res, &sid_resource_type_aggregate, "parent");
+	res      = _create_res(res, &test_resource_type, "child1");
+	_create_res(res, &test_resource_type, "child2");
+	_create_res(root_res, &test_resource_type, "child3");
+
+	out = _write_tree(root_res, &((struct sid_resource_write_spec) {.format = JSON, .fd = -1, .type_name = "test"}));
+	assert_null(strstr(out, "agg root"));
+	assert_null(strstr(out, "agg parent"));
+	assert_non_null(strstr(out, "tst child1"));
+	assert_non_null(strstr(out, "tst child2"));
+	assert_non_null(strstr(out, "tst child3"));
+	/* only child1 keeps its children, the other matching resources are at top level */
+	assert_int_equal(_count_str(out, "children"), 1);
+	free(out);
+
+	out = _write_tree(root_res,
+	                  &((struct sid_resource_write_spec) {.format = JSON, .fd = -1, .max_depth = 2, .type_name = "test"}));
+	assert_null(strstr(out, "tst child1"));
+	assert_non_null(strstr(out, "tst child3"));
+	assert_null(strstr(out, "children"));
+	free(out);
+
+	out = _write_tree(root_res, &((struct sid_resource_write_spec) {.format = JSON, .fd = -1, .type_name = "none"}));
+	assert_string_equal(out, "");
+	free(out);
+
+	sid_resource_unref(root_res);
+}
+
+struct storm {
+	sid_resource_t              *res;
+	int                          listen_fd;
+	sid_resource_event_source_t *listen_es;
+	int                          clients[TEST_STORM_MAX_CLIENTS];
+	unsigned                     clients_count;
+	unsigned                     accepted;
+	unsigned                     backlog_max;
+	unsigned                     rounds;
+	int                          workers[TEST_STORM_CHANNELS][2]; /* [0] proxy side, [1] worker side */
+	sid_resource_event_source_t *worker_es[TEST_STORM_CHANNELS];
+	unsigned                     completions_sent;
+	unsigned                     completions_done;
+};
+
+static void _storm_connect(struct storm *storm, struct sockaddr_un *addr, socklen_t addr_len)
+{
+	int fd;
+
+	assert_true(storm->clients_count < TEST_STORM_MAX_CLIENTS);
+	assert_true((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) >= 0);
+	assert_int_equal(connect(fd, (struct sockaddr *) addr, addr_len), 0);
+	storm->clients[storm->clients_count++] = fd;
+}
+
+static bool _storm_has_pending_connection(struct storm *storm)
+{
+	struct pollfd pfd = {.fd = storm->listen_fd, .events = POLLIN};
+
+	return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+static int _on_storm_worker_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
+{
+	struct storm *storm = data;
+	char          c;
+
+	assert_int_equal(read(fd, &c, 1), 1);
+	storm->completions_done++;
+
+	return 0;
+}
+
+/*
+ * Accept a budget of connections like ubridge does. Each accepted connection
+ * starts work in one of the workers and more clients keep coming in meanwhile.
+ */
+static int _on_storm_listen_event(sid_resource_event_source_t *es, int fd, uint32_t revents, void *data)
+{
+	struct storm      *storm = data;
+	struct sockaddr_un addr;
+	socklen_t          addr_len = sizeof(addr);
+	unsigned           i, j;
+	int                conn_fd;
+
+	/* whatever workers sent before we got here must have been handled already */
+	assert_int_equal(storm->completions_done, storm->completions_sent);
+
+	assert_int_equal(getsockname(storm->listen_fd, (struct sockaddr *) &addr, &addr_len), 0);
+
+	for (i = 0; i < TEST_STORM_ACCEPT_BUDGET; i++) {
+		if (i && !_storm_has_pending_connection(storm))
+			break;
+
+		assert_true((conn_fd = accept4(storm->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0);
+		close(conn_fd);
+		storm->accepted++;
+
+		assert_int_equal(write(storm->workers[storm->accepted % TEST_STORM_CHANNELS][1], "c", 1), 1);
+		storm->completions_sent++;
+
+		for (j = 0; j < TEST_STORM_CLIENTS_PER_ACC; j++)
+			_storm_connect(storm, &addr, addr_len);
+	}
+
+	if (_storm_has_pending_connection(storm))
+		sid_resource_count_event_source_deferral(es);
+
+	if (storm->clients_count - storm->accepted > storm->backlog_max)
+		storm->backlog_max = storm->clients_count - storm->accepted;
+
+	if (++storm->rounds == TEST_STORM_ROUNDS)
+		sid_resource_exit_event_loop(storm->res);
+
+	return 0;
+}
+
+static void test_event_prio_storm(void **state)
+{
+	struct storm       storm = {0};
+	struct sockaddr_un addr  = {.sun_family = AF_UNIX};
+	socklen_t          addr_len;
+	uint64_t           deferred;
+	unsigned           i;
+
+	storm.res = sid_resource_ref(_create_res(SID_RESOURCE_NO_PARENT, &test_event_loop_resource_type, "storm"));
+
+	/* abstract socket address */
+	snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "sid-test-storm-%d", getpid());
+	addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr.sun_path + 1);
+
+	assert_true((storm.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) >= 0);
+	assert_int_equal(bind(storm.listen_fd, (struct sockaddr *) &addr, addr_len), 0);
+	assert_int_equal(listen(storm.listen_fd, TEST_STORM_MAX_CLIENTS), 0);
+
+	for (i = 0; i < TEST_STORM_INITIAL_CLIENTS; i++)
+		_storm_connect(&storm, &addr, addr_len);
+
+	assert_int_equal(sid_resource_create_io_event_source(storm.res,
+	                                                     &storm.listen_es,
+	                                                     storm.listen_fd,
+	                                                     _on_storm_listen_event,
+	                                                     SID_RESOURCE_EVENT_PRIO_ADMISSION,
+	                                                     "listen",
+	                                                     &storm),
+	                 0);
+
+	for (i = 0; i < TEST_STORM_CHANNELS; i++) {
+		assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, storm.workers[i]), 0);
+		assert_int_equal(sid_resource_create_io_event_source(storm.res,
+		                                                     &storm.worker_es[i],
+		                                                     storm.workers[i][0],
+		                                                     _on_storm_worker_event,
+		                                                     SID_RESOURCE_EVENT_PRIO_COMPLETION,
+		                                                     "worker",
+		                                                     &storm),
+		                 0);
+	}
+
+	assert_true(sid_resource_run_event_loop(storm.res) >= 0);
+
+	assert_int_equal(storm.rounds, TEST_STORM_ROUNDS);
+	assert_int_equal(storm.accepted, TEST_STORM_ROUNDS * TEST_STORM_ACCEPT_BUDGET);
+	/* the storm outgrows the budget, so the backlog keeps growing... */
+	assert_true(storm.backlog_max > TEST_STORM_INITIAL_CLIENTS);
+	assert_int_equal(storm.backlog_max, storm.clients_count - storm.accepted);
+	/* ...but completions still keep up - all but the ones from the last round are done */
+	assert_true(storm.completions_done + TEST_STORM_ACCEPT_BUDGET >= storm.completions_sent);
+
+	/* each round, admission leaves the rest of the storm in the backlog and counts that... */
+	assert_int_equal(sid_resource_get_event_source_deferrals(storm.listen_es, &deferred), 0);
+	assert_int_equal(deferred, TEST_STORM_ROUNDS);
+
+	/* ...while completions never leave anything for later */
+	for (i = 0; i < TEST_STORM_CHANNELS; i++) {
+		assert_int_equal(sid_resource_get_event_source_deferrals(storm.worker_es[i], &deferred), 0);
+		assert_int_equal(deferred, 0);
+	}
+
+	sid_resource_unref(storm.res);
+
+	for (i = 0; i < TEST_STORM_CHANNELS; i++) {
+		close(storm.workers[i][0]);
+		close(storm.workers[i][1]);
+	}
+	for (i = 0; i < storm.clients_count; i++)
+		close(storm.clients[i]);
+	close(storm.listen_fd);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_write_tree_streamed),
+		cmocka_unit_test(test_resources_cmd_streamed),
+		cmocka_unit_test(test_write_tree_depth),
+		cmocka_unit_test(test_write_tree_type),
+		cmocka_unit_test(test_event_prio_storm),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
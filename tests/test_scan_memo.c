@@ -0,0 +1,542 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_WORKER_ID "test-worker"
+#define TEST_CMD_ID    "cmd-id"
+#define TEST_DEVNO     makedev(8, 0)
+#define TEST_ENV_HASH  UINT64_C(0x1234)
+#define TEST_RESULT    "SID_DEV_ID=test-dev-id\0SID_SESSION_ID=" TEST_WORKER_ID
+#define TEST_ENV       "ACTION=change\0DEVNAME=/dev/sda"
+#define TEST_UID       "test-dev-id"
+
+/* the last message sent to worker */
+static struct {
+	unsigned count;
+	char     data[PATH_MAX];
+	size_t   data_size;
+	int      fd;
+} sent = {.fd = -1};
+
+static sid_resource_t *worker_control_res;
+static sid_resource_t *worker_proxy_res;
+
+int __wrap_worker_control_channel_send(sid_resource_t *res, const char *channel_id, struct worker_data_spec *data_spec)
+{
+	assert_ptr_equal(res, worker_proxy_res);
+	assert_true(data_spec->data_size <= sizeof(sent.data));
+
+	if (sent.fd >= 0)
+		close(sent.fd);
+
+	sent.count++;
+	memcpy(sent.data, data_spec->data, data_spec->data_size);
+	sent.data_size = data_spec->data_size;
+	sent.fd        = data_spec->ext.used ? dup(data_spec->ext.socket.fd_pass) : -1;
+
+	return 0;
+}
+
+sid_resource_t *__wrap_worker_control_find_worker(sid_resource_t *res, const char *id)
+{
+	assert_ptr_equal(res, worker_control_res);
+	assert_string_equal(id, TEST_WORKER_ID);
+	return worker_proxy_res;
+}
+
+const char *__wrap_worker_control_get_worker_id(sid_resource_t *res)
+{
+	return TEST_WORKER_ID;
+}
+
+static struct scan_memo_key _key(unsigned seqnum, dev_t devno, uint64_t env_hash)
+{
+	return (struct scan_memo_key) {.uevent = {.seqnum = seqnum, .devno = devno}, .env_hash = env_hash};
+}
+
+static int _create_result_fd(void)
+{
+	int fd;
+
+	assert_true((fd = memfd_create("test_result", MFD_CLOEXEC)) >= 0);
+	assert_int_equal(write(fd, TEST_RESULT, sizeof(TEST_RESULT)), sizeof(TEST_RESULT));
+
+	return fd;
+}
+
+/* Device number string of 'devno', as used in udev namespace keys. */
+static const char *_num_s(dev_t devno)
+{
+	static char buf[32];
+
+	snprintf(buf, sizeof(buf), "%u_%u", major(devno), minor(devno));
+	return buf;
+}
+
+/* Store request from the worker which executed the scan, without result if 'with_result' is false. */
+static void _store_env(struct sid_ucmd_common_ctx *common_ctx,
+                       struct scan_memo_store      store,
+                       const char                 *env,
+                       size_t                      env_size,
+                       bool                        with_result)
+{
+	const char             *num_s = _num_s(store.key.uevent.devno);
+	char                    buf[PATH_MAX];
+	struct worker_data_spec data_spec;
+	size_t                  size = INTERNAL_MSG_HEADER_SIZE;
+
+	memcpy(buf + size, &store, sizeof(store));
+	size += sizeof(store);
+	memcpy(buf + size, num_s, strlen(num_s) + 1);
+	size += strlen(num_s) + 1;
+	memcpy(buf + size, TEST_UID, sizeof(TEST_UID));
+	size += sizeof(TEST_UID);
+	memcpy(buf + size, env, env_size);
+	size += env_size;
+
+	data_spec = (struct worker_data_spec) {.data = buf, .data_size = size, .ext.used = with_result};
+	if (with_result)
+		data_spec.ext.socket.fd_pass = _create_result_fd();
+
+	assert_int_equal(_worker_proxy_recv_system_cmd_scan_memo_store(worker_proxy_res, &data_spec, common_ctx), 0);
+}
+
+static void _store(struct sid_ucmd_common_ctx *common_ctx, struct scan_memo_key key, uint64_t kv_gen, bool with_result)
+{
+	_store_env(common_ctx, (struct scan_memo_store) {.key = key, .kv_gen = kv_gen}, TEST_ENV, sizeof(TEST_ENV), with_result);
+}
+
+/* Fetch request from the worker which handles the scan requested by udev, with udev environment 'env'. */
+static void _fetch_env(struct sid_ucmd_common_ctx *common_ctx, struct scan_memo_key key, const char *env, size_t env_size)
+{
+	char                    buf[PATH_MAX];
+	struct worker_data_spec data_spec;
+
+	memcpy(buf + INTERNAL_MSG_HEADER_SIZE, &key, sizeof(key));
+	memcpy(buf + INTERNAL_MSG_HEADER_SIZE + sizeof(key), TEST_CMD_ID, sizeof(TEST_CMD_ID));
+	memcpy(buf + INTERNAL_MSG_HEADER_SIZE + sizeof(key) + sizeof(TEST_CMD_ID), env, env_size);
+
+	data_spec = (struct worker_data_spec) {.data      = buf,
+	                                       .data_size = INTERNAL_MSG_HEADER_SIZE + sizeof(key) + sizeof(TEST_CMD_ID) + env_size,
+	                                       .ext.used  = false};
+
+	assert_int_equal(_worker_proxy_recv_system_cmd_scan_memo_fetch(worker_proxy_res, &data_spec, common_ctx), 0);
+}
+
+static void _fetch(struct sid_ucmd_common_ctx *common_ctx, struct scan_memo_key key)
+{
+	_fetch_env(common_ctx, key, TEST_ENV, sizeof(TEST_ENV));
+}
+
+static void _assert_reply(unsigned count, bool with_result)
+{
+	char    buf[PATH_MAX];
+	ssize_t n;
+
+	assert_int_equal(sent.count, count);
+	assert_int_equal(sent.data_size, INTERNAL_MSG_HEADER_SIZE + sizeof(struct scan_memo_key) + sizeof(TEST_CMD_ID));
+	assert_string_equal(sent.data + INTERNAL_MSG_HEADER_SIZE + sizeof(struct scan_memo_key), TEST_CMD_ID);
+
+	if (!with_result) {
+		assert_int_equal(sent.fd, -1);
+		return;
+	}
+
+	assert_true(sent.fd >= 0);
+	assert_true((n = pread(sent.fd, buf, sizeof(buf), 0)) > 0);
+	assert_int_equal(n, sizeof(TEST_RESULT));
+	assert_memory_equal(buf, TEST_RESULT, sizeof(TEST_RESULT));
+}
+
+/*
+ * Complete KV store sync of an export from the worker, with record 'key' changed (if not NULL).
+ * Returns main KV store generation the export was synced with, as passed to the worker in the ack.
+ */
+static uint64_t _sync(struct sid_ucmd_common_ctx *common_ctx, const char *key)
+{
+	struct kv_sync *sync;
+	uint64_t        kv_gen;
+
+	assert_non_null(sync = mem_zalloc(sizeof(*sync)));
+	sync->worker_control_res = worker_control_res;
+	assert_non_null(sync->worker_id = strdup(TEST_WORKER_ID));
+	assert_non_null(sync->ack_data = mem_zalloc(INTERNAL_MSG_HEADER_SIZE + sizeof(TEST_CMD_ID) + sizeof(kv_gen)));
+	memcpy((char *) sync->ack_data + INTERNAL_MSG_HEADER_SIZE, TEST_CMD_ID, sizeof(TEST_CMD_ID));
+	sync->ack_data_size = INTERNAL_MSG_HEADER_SIZE + sizeof(TEST_CMD_ID) + sizeof(kv_gen);
+	list_add(&common_ctx->sync.queue, &sync->list);
+
+	assert_int_equal(_sync_main_kv_store_slice(worker_proxy_res, common_ctx, 1, 0), 0);
+	assert_true(list_is_empty(&common_ctx->sync.queue));
+
+	assert_int_equal(sent.data_size, INTERNAL_MSG_HEADER_SIZE + sizeof(TEST_CMD_ID) + sizeof(kv_gen));
+	memcpy(&kv_gen, sent.data + INTERNAL_MSG_HEADER_SIZE + sizeof(TEST_CMD_ID), sizeof(kv_gen));
+	assert_int_equal(kv_gen, common_ctx->scan_memo.kv_gen);
+
+	/* only replies to fetch requests are counted */
+	sent.count--;
+
+	/* there are no records in the export, track the change as if the record was synced */
+	if (key)
+		_track_scan_memo_dep(common_ctx, key, KV_OP_SET);
+
+	return kv_gen;
+}
+
+static void test_scan_memo_hit(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	/* nothing memoized yet */
+	_fetch(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, false);
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 1);
+
+	/* the same environment for a later uevent, the result is reused repeatedly */
+	_fetch(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(2, true);
+	_fetch(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(3, true);
+
+	/* other device has nothing memoized */
+	_fetch(common_ctx, _key(4, makedev(8, 16), TEST_ENV_HASH));
+	_assert_reply(4, false);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 1);
+}
+
+static void test_scan_memo_env_changed(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+
+	_fetch(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH + 1));
+	_assert_reply(1, false);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 0);
+
+	/* dropped, even the original environment does not match now */
+	_fetch(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(2, false);
+}
+
+static void test_scan_memo_env_collision(void **state)
+{
+	static const char           env[]      = "ACTION=change\0DEVNAME=/dev/sdb";
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+
+	/* the hash matches, but the environment is different */
+	_fetch_env(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH), env, sizeof(env));
+	_assert_reply(1, false);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 0);
+}
+
+static void test_scan_memo_db_changed(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+
+	/* udev records of the device changed */
+	assert_int_equal(_sync(common_ctx, "::U:8_0:::ID_FS_TYPE"), 1);
+
+	_fetch(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, false);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 0);
+
+	/* new result stored with the new generation is valid again */
+	_store(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH), 1, true);
+	_fetch(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(2, true);
+
+	/* records of the device stored under its identifier changed */
+	_sync(common_ctx, ":USR:D:" TEST_UID ":::key");
+	_fetch(common_ctx, _key(4, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(3, false);
+}
+
+static void test_scan_memo_other_dev_changed(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+
+	/* records of other devices changed, the result does not depend on them */
+	_sync(common_ctx, "::U:8_16:::ID_FS_TYPE");
+	_sync(common_ctx, ":USR:X:other-dev-id:M:dm:key");
+	_sync(common_ctx, NULL);
+
+	_fetch(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, true);
+
+	/* records not specific to single device changed */
+	_sync(common_ctx, ":USR:M:dm:::key");
+	_fetch(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(2, false);
+
+	/* aliases are looked up across devices */
+	_store(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH), common_ctx->scan_memo.kv_gen, true);
+	_sync(common_ctx, ":ALS:D:other-dev-id:::key");
+	_fetch(common_ctx, _key(4, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(3, false);
+
+	/* delta updates change records of other devices too */
+	_store(common_ctx, _key(4, TEST_DEVNO, TEST_ENV_HASH), common_ctx->scan_memo.kv_gen, true);
+	common_ctx->scan_memo.kv_gen++;
+	_track_scan_memo_dep(common_ctx, "::D:other-dev-id:::key", KV_OP_PLUS);
+	_fetch(common_ctx, _key(5, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(4, false);
+}
+
+static void test_scan_memo_foreign(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct scan_memo_store      store      = {.key = _key(1, TEST_DEVNO, TEST_ENV_HASH), .foreign = true};
+
+	/* the scan looked up records of other devices */
+	_store_env(common_ctx, store, TEST_ENV, sizeof(TEST_ENV), true);
+	_fetch(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, true);
+
+	_sync(common_ctx, "::U:8_16:::ID_FS_TYPE");
+	_fetch(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(2, false);
+
+	/* the scan's own export is the only change since the scan started */
+	store.kv_gen     = common_ctx->scan_memo.kv_gen;
+	store.exp_kv_gen = _sync(common_ctx, "::U:8_0:::ID_FS_TYPE");
+	_store_env(common_ctx, store, TEST_ENV, sizeof(TEST_ENV), true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 1);
+
+	/* other export was synced in between */
+	store.kv_gen     = common_ctx->scan_memo.kv_gen;
+	_sync(common_ctx, NULL);
+	store.exp_kv_gen = _sync(common_ctx, "::U:8_0:::ID_FS_TYPE");
+	_store_env(common_ctx, store, TEST_ENV, sizeof(TEST_ENV), true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 0);
+}
+
+static void test_scan_memo_stale_store(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+
+	/* the scan ran before other worker's changes to the device were synced */
+	_sync(common_ctx, "::U:8_0:::ID_FS_TYPE");
+	_store(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 0);
+
+	_fetch(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, false);
+
+	/* changes to other devices do not matter */
+	_sync(common_ctx, "::U:8_16:::ID_FS_TYPE");
+	_store(common_ctx, _key(4, TEST_DEVNO, TEST_ENV_HASH), 1, true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 1);
+}
+
+static void test_scan_memo_own_exports(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct scan_memo_store      store      = {.key = _key(1, TEST_DEVNO, TEST_ENV_HASH)};
+
+	/* the scan's own export is synced before the result is stored */
+	store.exp_kv_gen = _sync(common_ctx, "::U:8_0:::ID_FS_TYPE");
+	_store_env(common_ctx, store, TEST_ENV, sizeof(TEST_ENV), true);
+	_fetch(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, true);
+
+	/* other worker changed the device before the scan's own export was synced */
+	store.kv_gen = common_ctx->scan_memo.kv_gen;
+	_sync(common_ctx, "::U:8_0:::ID_FS_TYPE");
+	store.exp_kv_gen = _sync(common_ctx, "::U:8_0:::ID_FS_TYPE");
+	_store_env(common_ctx, store, TEST_ENV, sizeof(TEST_ENV), true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 0);
+}
+
+static void test_scan_memo_deps_reset(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	char                        key[64];
+	unsigned                    i;
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+	_sync(common_ctx, NULL);
+
+	for (i = 0; i < SCAN_MEMO_MAX_DEPS; i++) {
+		snprintf(key, sizeof(key), "::U:9_%u:::ID_FS_TYPE", i);
+		_track_scan_memo_dep(common_ctx, key, KV_OP_SET);
+	}
+
+	_fetch(common_ctx, _key(2, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, true);
+
+	/* too many devices tracked, changes are not tracked per device anymore */
+	_track_scan_memo_dep(common_ctx, "::U:10_0:::ID_FS_TYPE", KV_OP_SET);
+	assert_int_equal(hash_get_num_entries(common_ctx->scan_memo.dep_ht), 0);
+
+	_fetch(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(2, false);
+}
+
+static void test_scan_memo_remove(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+	_store(common_ctx, _key(2, makedev(8, 16), TEST_ENV_HASH), 0, true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 2);
+
+	/* the device is removed, its result is dropped */
+	_store(common_ctx, _key(3, TEST_DEVNO, TEST_ENV_HASH), 0, false);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, 1);
+
+	_fetch(common_ctx, _key(4, TEST_DEVNO, TEST_ENV_HASH));
+	_assert_reply(1, false);
+	_fetch(common_ctx, _key(5, makedev(8, 16), TEST_ENV_HASH));
+	_assert_reply(2, true);
+}
+
+static void test_scan_memo_spec_scan_cancelled(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct scan_memo_key        key        = _key(2, TEST_DEVNO, TEST_ENV_HASH);
+	struct spec_scan           *scan;
+
+	common_ctx->spec_scan.enabled = true;
+	_store(common_ctx, _key(1, TEST_DEVNO, TEST_ENV_HASH), 0, true);
+
+	/* queued speculative scan is not needed anymore */
+	assert_non_null(_create_spec_scan(worker_proxy_res, common_ctx, &key.uevent, SPEC_SCAN_QUEUED));
+	_fetch(common_ctx, key);
+	_assert_reply(1, true);
+	assert_null(_find_spec_scan(common_ctx, &key.uevent));
+
+	/* the uevent comes later, it's not scanned speculatively */
+	key.uevent.seqnum = 3;
+	_fetch(common_ctx, key);
+	_assert_reply(2, true);
+	assert_non_null(scan = _find_spec_scan(common_ctx, &key.uevent));
+	assert_int_equal(scan->state, SPEC_SCAN_CLAIMED);
+}
+
+static void test_scan_memo_evict(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	unsigned                    i;
+
+	for (i = 0; i < SCAN_MEMO_MAX_ENTRIES; i++)
+		_store(common_ctx, _key(i + 1, makedev(8, i), TEST_ENV_HASH), 0, true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, SCAN_MEMO_MAX_ENTRIES);
+
+	/* use the oldest one so the second oldest one is evicted instead */
+	_fetch(common_ctx, _key(i + 1, makedev(8, 0), TEST_ENV_HASH));
+	_assert_reply(1, true);
+
+	_store(common_ctx, _key(i + 2, makedev(8, i), TEST_ENV_HASH), 0, true);
+	assert_int_equal(common_ctx->scan_memo.nr_entries, SCAN_MEMO_MAX_ENTRIES);
+
+	_fetch(common_ctx, _key(i + 3, makedev(8, 1), TEST_ENV_HASH));
+	_assert_reply(2, false);
+	_fetch(common_ctx, _key(i + 4, makedev(8, 0), TEST_ENV_HASH));
+	_assert_reply(3, true);
+}
+
+static void test_scan_memo_env_hash(void **state)
+{
+	static const char env_a[] = "ACTION=change\0DEVNAME=/dev/sda\0SEQNUM=10\0ID_FS_TYPE=ext4";
+	static const char env_b[] = "ACTION=change\0DEVNAME=/dev/sda\0SEQNUM=11\0ID_FS_TYPE=ext4";
+	static const char env_c[] = "ACTION=change\0DEVNAME=/dev/sda\0SEQNUM=12\0ID_FS_TYPE=xfs";
+	static const char env_d[] = "ACTION=change\0DEVNAME=/dev/sda\0SEQNUM=12\0ID_FS_TYPE=ext\0004";
+
+	/* only SEQNUM differs */
+	assert_int_equal(_hash_scan_env(env_a, sizeof(env_a)), _hash_scan_env(env_b, sizeof(env_b)));
+	assert_int_not_equal(_hash_scan_env(env_a, sizeof(env_a)), _hash_scan_env(env_c, sizeof(env_c)));
+
+	/* the same characters split into different items */
+	assert_int_not_equal(_hash_scan_env(env_a, sizeof(env_a)), _hash_scan_env(env_d, sizeof(env_d)));
+	assert_int_not_equal(_hash_scan_env(env_a, sizeof(env_a)), 0);
+}
+
+static int setup(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx;
+
+	common_ctx = ucmd_fixture_common_ctx_create();
+	assert_non_null(common_ctx->scan_memo.ht = hash_create(SCAN_MEMO_MAX_ENTRIES));
+	assert_non_null(common_ctx->scan_memo.dep_ht = hash_create(SCAN_MEMO_MAX_DEPS));
+	common_ctx->scan_memo.enabled = true;
+
+	worker_control_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                         &sid_resource_type_aggregate,
+	                                         SID_RESOURCE_NO_FLAGS,
+	                                         "testworkercontrol",
+	                                         SID_RESOURCE_NO_PARAMS,
+	                                         SID_RESOURCE_PRIO_NORMAL,
+	                                         SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(worker_control_res);
+	worker_proxy_res = sid_resource_create(worker_control_res,
+	                                       &sid_resource_type_aggregate,
+	                                       SID_RESOURCE_NO_FLAGS,
+	                                       "testworkerproxy",
+	                                       SID_RESOURCE_NO_PARAMS,
+	                                       SID_RESOURCE_PRIO_NORMAL,
+	                                       SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(worker_proxy_res);
+
+	sent   = (typeof(sent)) {.fd = -1};
+	*state = common_ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_destroy_spec_scans(common_ctx);
+	_destroy_scan_memos(common_ctx);
+	ucmd_fixture_common_ctx_destroy(common_ctx);
+	sid_resource_unref(worker_control_res);
+
+	if (sent.fd >= 0)
+		close(sent.fd);
+
+	return 0;
+}
+
+#define setup_test(func) cmocka_unit_test_setup_teardown((func), setup, teardown)
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		setup_test(test_scan_memo_hit),
+		setup_test(test_scan_memo_env_changed),
+		setup_test(test_scan_memo_env_collision),
+		setup_test(test_scan_memo_db_changed),
+		setup_test(test_scan_memo_other_dev_changed),
+		setup_test(test_scan_memo_foreign),
+		setup_test(test_scan_memo_stale_store),
+		setup_test(test_scan_memo_own_exports),
+		setup_test(test_scan_memo_remove),
+		setup_test(test_scan_memo_spec_scan_cancelled),
+		setup_test(test_scan_memo_evict),
+		setup_test(test_scan_memo_deps_reset),
+		cmocka_unit_test(test_scan_memo_env_hash),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
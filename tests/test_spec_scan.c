@@ -0,0 +1,662 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_WORKER_ID  "test-worker"
+#define TEST_DEVNO      makedev(8, 0)
+#define TEST_DEVNO_2    makedev(8, 16)
+#define TEST_DEVNO_3    makedev(8, 32)
+#define TEST_DEVNO_PART makedev(8, 1)
+#define TEST_KERNEL_ENV "ACTION=add\0DEVPATH=/devices/virtual/block/sda\0SUBSYSTEM=block\0"
+#define TEST_UDEV_ENV   "ID_FS_TYPE=ext4\0SID_DEV_ID=test-dev-id"
+#define TEST_RESULT     "SID_DEV_ID=test-dev-id\0SID_SESSION_ID=" TEST_WORKER_ID
+#define TEST_EXPORTS    "test-exports"
+
+/* environment with its size, including the terminating zero */
+#define TEST_ENV(env) (env), sizeof(env)
+
+/* the last message sent to worker */
+static struct {
+	unsigned count;
+	char     data[PATH_MAX];
+	size_t   data_size;
+	int      fd;
+} sent = {.fd = -1};
+
+static sid_resource_t *worker_control_res;
+static sid_resource_t *worker_proxy_res;
+static bool            worker_gone;
+
+static const sid_resource_type_t test_event_loop_resource_type = {
+	.name            = "test event loop",
+	.short_name      = "tel",
+	.with_event_loop = 1,
+};
+
+int __wrap_worker_control_channel_send(sid_resource_t *res, const char *channel_id, struct worker_data_spec *data_spec)
+{
+	assert_ptr_equal(res, worker_proxy_res);
+	assert_true(data_spec->data_size <= sizeof(sent.data));
+
+	if (sent.fd >= 0)
+		close(sent.fd);
+
+	sent.count++;
+	memcpy(sent.data, data_spec->data, data_spec->data_size);
+	sent.data_size = data_spec->data_size;
+	sent.fd        = data_spec->ext.used ? dup(data_spec->ext.socket.fd_pass) : -1;
+
+	return 0;
+}
+
+sid_resource_t *__wrap_worker_control_find_worker(sid_resource_t *res, const char *id)
+{
+	assert_ptr_equal(res, worker_control_res);
+	assert_string_equal(id, TEST_WORKER_ID);
+	return worker_gone ? NULL : worker_proxy_res;
+}
+
+const char *__wrap_worker_control_get_worker_id(sid_resource_t *res)
+{
+	return TEST_WORKER_ID;
+}
+
+static struct spec_scan_key _dev_key(unsigned seqnum, dev_t devno)
+{
+	return (struct spec_scan_key) {.seqnum = seqnum, .devno = devno};
+}
+
+static struct spec_scan_key _key(unsigned seqnum)
+{
+	return _dev_key(seqnum, TEST_DEVNO);
+}
+
+static size_t _kernel_env(char *buf, unsigned seqnum)
+{
+	static const char env[] = TEST_KERNEL_ENV;
+	size_t            size  = sizeof(env) - 1;
+
+	memcpy(buf, env, size);
+	size += sprintf(buf + size, "SEQNUM=%u", seqnum) + 1;
+
+	return size;
+}
+
+/* Inject kernel uevent as if it came from the kernel monitor. */
+static void _inject_dev_uevent(struct sid_ucmd_common_ctx *common_ctx, unsigned seqnum, dev_t devno)
+{
+	char                       buf[PATH_MAX];
+	struct spec_scan_key       key = _dev_key(seqnum, devno);
+	struct internal_msg_header int_msg;
+	size_t                     size;
+
+	int_msg = (struct internal_msg_header) {
+		.cat    = MSG_CATEGORY_SELF,
+		.header = {.prot = SID_PROTOCOL, .cmd = SELF_CMD_SCAN, .flags = SID_CMD_FLAGS_FMT_ENV},
+	};
+	memcpy(buf, &int_msg, INTERNAL_MSG_HEADER_SIZE);
+	memcpy(buf + INTERNAL_MSG_HEADER_SIZE, &key.devno, sizeof(key.devno));
+	size = INTERNAL_MSG_HEADER_SIZE + sizeof(key.devno);
+	size += _kernel_env(buf + size, seqnum);
+
+	assert_int_equal(_queue_spec_scan(worker_proxy_res, common_ctx, &key, buf, size), 0);
+}
+
+static void _inject_uevent(struct sid_ucmd_common_ctx *common_ctx, unsigned seqnum)
+{
+	_inject_dev_uevent(common_ctx, seqnum, TEST_DEVNO);
+}
+
+/* Dispatch next speculative scan, without the worker. */
+static struct spec_scan *_dispatch(struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct spec_scan *scan;
+
+	if ((scan = _get_next_spec_scan(common_ctx))) {
+		scan->state              = SPEC_SCAN_RUNNING;
+		scan->worker_control_res = worker_control_res;
+		assert_non_null(scan->worker_id = strdup(TEST_WORKER_ID));
+	}
+
+	return scan;
+}
+
+static struct sid_buffer *_create_buffer(sid_buffer_backend_t backend, sid_buffer_type_t type, const char *data, size_t data_size)
+{
+	struct sid_buffer *buf;
+
+	assert_non_null(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = backend,
+	                                                                     .type    = type,
+	                                                                     .mode    = SID_BUFFER_MODE_SIZE_PREFIX}),
+	                                        &((struct sid_buffer_init) {.size = 1, .alloc_step = 1, .limit = 0}),
+	                                        NULL));
+	assert_int_equal(sid_buffer_add(buf, (void *) data, data_size, NULL, NULL), 0);
+
+	return buf;
+}
+
+/* Result memfd as written by the worker which executed the speculative scan. */
+static int _create_result_fd(size_t *exp_size)
+{
+	struct sid_ucmd_ctx ucmd_ctx = {0};
+	int                 fd;
+
+	ucmd_ctx.res_buf = _create_buffer(SID_BUFFER_BACKEND_MALLOC, SID_BUFFER_TYPE_VECTOR, TEST_RESULT, sizeof(TEST_RESULT));
+	ucmd_ctx.exp_buf = _create_buffer(SID_BUFFER_BACKEND_MEMFD, SID_BUFFER_TYPE_LINEAR, TEST_EXPORTS, sizeof(TEST_EXPORTS));
+
+	*exp_size = 0;
+	assert_true((fd = _write_spec_scan_result(&ucmd_ctx, exp_size)) >= 0);
+	assert_int_equal(*exp_size, SID_BUFFER_SIZE_PREFIX_LEN + sizeof(TEST_EXPORTS));
+
+	sid_buffer_destroy(ucmd_ctx.res_buf);
+	sid_buffer_destroy(ucmd_ctx.exp_buf);
+
+	return fd;
+}
+
+/*
+ * Result message from the worker which executed the speculative scan, started with main KV store
+ * generation 'kv_gen'. If 'foreign' is set, the scan looked up records of other devices.
+ */
+static void _send_dev_result(struct sid_ucmd_common_ctx *common_ctx,
+                             struct spec_scan_key        key,
+                             uint64_t                    kv_gen,
+                             bool                        foreign,
+                             const char                 *deps,
+                             size_t                      deps_size,
+                             bool                        ok)
+{
+	char                    buf[PATH_MAX];
+	size_t                  exp_size = 0;
+	struct worker_data_spec data_spec;
+	size_t                  size;
+	int                     fd = -1;
+
+	if (ok)
+		fd = _create_result_fd(&exp_size);
+
+	memcpy(buf + INTERNAL_MSG_HEADER_SIZE, &key, sizeof(key));
+	size = INTERNAL_MSG_HEADER_SIZE + sizeof(key);
+	memcpy(buf + size, &exp_size, sizeof(exp_size));
+	size += sizeof(exp_size);
+	memcpy(buf + size, &kv_gen, sizeof(kv_gen));
+	size += sizeof(kv_gen);
+	memcpy(buf + size, &foreign, sizeof(foreign));
+	size += sizeof(foreign);
+	if (deps_size)
+		memcpy(buf + size, deps, deps_size);
+	size += deps_size;
+
+	data_spec = (struct worker_data_spec) {.data = buf, .data_size = size, .ext.used = ok, .ext.socket.fd_pass = fd};
+
+	assert_int_equal(_worker_proxy_recv_system_cmd_scan_result(worker_proxy_res, &data_spec, common_ctx), 0);
+}
+
+static void _send_result(struct sid_ucmd_common_ctx *common_ctx, unsigned seqnum, const char *deps, size_t deps_size, bool ok)
+{
+	_send_dev_result(common_ctx, _key(seqnum), common_ctx->scan_memo.kv_gen, false, deps, deps_size, ok);
+}
+
+/* Number of KV store exports queued for sync with main KV store. */
+static unsigned _nr_syncs(struct sid_ucmd_common_ctx *common_ctx)
+{
+	return list_size(&common_ctx->sync.queue);
+}
+
+/* Pretend queued syncs with main KV store are complete, each one bumps the generation. */
+static void _complete_syncs(struct sid_ucmd_common_ctx *common_ctx)
+{
+	struct kv_sync *sync, *tmp_sync;
+
+	list_iterate_items_safe (sync, tmp_sync, &common_ctx->sync.queue) {
+		_destroy_main_kv_store_sync(common_ctx->res, sync);
+		common_ctx->scan_memo.kv_gen++;
+	}
+}
+
+/* Fetch request from the worker which handles the scan requested by udev. */
+static void _fetch_dev(struct sid_ucmd_common_ctx *common_ctx, struct spec_scan_key key, const char *udev_env, size_t udev_env_size)
+{
+	char                    buf[PATH_MAX];
+	struct worker_data_spec data_spec;
+	size_t                  size;
+
+	memcpy(buf + INTERNAL_MSG_HEADER_SIZE, &key, sizeof(key));
+	size = INTERNAL_MSG_HEADER_SIZE + sizeof(key);
+	memcpy(buf + size, "cmd-id", sizeof("cmd-id"));
+	size += sizeof("cmd-id");
+
+	/* properties set by udev rules come first so they can override the kernel ones */
+	if (udev_env_size)
+		memcpy(buf + size, udev_env, udev_env_size);
+	size += udev_env_size;
+	size += _kernel_env(buf + size, key.seqnum);
+
+	data_spec = (struct worker_data_spec) {.data = buf, .data_size = size, .ext.used = false};
+
+	assert_int_equal(_worker_proxy_recv_system_cmd_scan_fetch(worker_proxy_res, &data_spec, common_ctx), 0);
+}
+
+static void _fetch(struct sid_ucmd_common_ctx *common_ctx, unsigned seqnum, const char *udev_env, size_t udev_env_size)
+{
+	_fetch_dev(common_ctx, _key(seqnum), udev_env, udev_env_size);
+}
+
+static void _assert_reply(unsigned count, bool with_result)
+{
+	struct spec_scan_key key;
+	char                 buf[PATH_MAX];
+	ssize_t              n;
+
+	assert_int_equal(sent.count, count);
+	assert_int_equal(sent.data_size, INTERNAL_MSG_HEADER_SIZE + sizeof(key) + sizeof("cmd-id"));
+	assert_string_equal(sent.data + INTERNAL_MSG_HEADER_SIZE + sizeof(key), "cmd-id");
+
+	if (!with_result) {
+		assert_int_equal(sent.fd, -1);
+		return;
+	}
+
+	assert_true(sent.fd >= 0);
+	assert_true((n = pread(sent.fd, buf, sizeof(buf), 0)) > 0);
+	assert_int_equal(n, SID_BUFFER_SIZE_PREFIX_LEN + sizeof(TEST_RESULT));
+	assert_memory_equal(buf + SID_BUFFER_SIZE_PREFIX_LEN, TEST_RESULT, sizeof(TEST_RESULT));
+}
+
+static void test_spec_scan_no_duplicate(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct spec_scan           *scan;
+
+	_inject_uevent(common_ctx, 1);
+	_inject_uevent(common_ctx, 1);
+	_inject_dev_uevent(common_ctx, 2, TEST_DEVNO_2);
+	assert_int_equal(common_ctx->spec_scan.nr_entries, 2);
+
+	/* scans run one at a time by default, in uevent order */
+	assert_non_null(scan = _dispatch(common_ctx));
+	assert_int_equal(scan->key.seqnum, 1);
+	assert_null(_dispatch(common_ctx));
+
+	_send_result(common_ctx, 1, NULL, 0, true);
+	assert_non_null(scan = _dispatch(common_ctx));
+	assert_int_equal(scan->key.seqnum, 2);
+
+	/* duplicate result must not change anything */
+	_send_result(common_ctx, 1, NULL, 0, true);
+	assert_int_equal(common_ctx->spec_scan.nr_entries, 2);
+	assert_int_equal(sent.count, 0);
+}
+
+static void test_spec_scan_result_kept(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_inject_uevent(common_ctx, 1);
+	_dispatch(common_ctx);
+	_send_result(common_ctx, 1, NULL, 0, true);
+
+	/* the exports are not applied until the result is used */
+	assert_int_equal(_nr_syncs(common_ctx), 0);
+
+	_fetch(common_ctx, 1, TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(1, true);
+	assert_int_equal(_nr_syncs(common_ctx), 1);
+	assert_int_equal(common_ctx->spec_scan.nr_entries, 0);
+	assert_null(_dispatch(common_ctx));
+}
+
+static void test_spec_scan_result_waiter(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_inject_uevent(common_ctx, 1);
+	_dispatch(common_ctx);
+
+	/* udev asks while the scan is running, the reply comes with the result */
+	_fetch(common_ctx, 1, TEST_ENV(TEST_UDEV_ENV));
+	assert_int_equal(sent.count, 0);
+
+	_send_result(common_ctx, 1, NULL, 0, true);
+	_assert_reply(1, true);
+	assert_int_equal(_nr_syncs(common_ctx), 1);
+	assert_int_equal(common_ctx->spec_scan.nr_entries, 0);
+}
+
+static void test_spec_scan_failed(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_inject_uevent(common_ctx, 1);
+	_dispatch(common_ctx);
+	_fetch(common_ctx, 1, TEST_ENV(TEST_UDEV_ENV));
+
+	_send_result(common_ctx, 1, NULL, 0, false);
+	_assert_reply(1, false);
+	assert_int_equal(_nr_syncs(common_ctx), 0);
+	assert_int_equal(common_ctx->spec_scan.nr_entries, 0);
+}
+
+static void test_spec_scan_missed_uevent(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	/* udev asks before we see the uevent, the worker scans on its own */
+	_fetch(common_ctx, 1, TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(1, false);
+
+	/* the uevent seen late must not be scanned again */
+	_inject_uevent(common_ctx, 1);
+	assert_null(_dispatch(common_ctx));
+}
+
+static void test_spec_scan_not_started(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	_inject_uevent(common_ctx, 1);
+	_inject_uevent(common_ctx, 2);
+	_dispatch(common_ctx);
+
+	/* udev asks before the scan starts, the worker scans on its own */
+	_fetch(common_ctx, 2, TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(1, false);
+
+	_send_result(common_ctx, 1, NULL, 0, true);
+	assert_null(_dispatch(common_ctx));
+}
+
+static void _check_deps(struct sid_ucmd_common_ctx *common_ctx,
+                        const char                 *deps,
+                        size_t                      deps_size,
+                        const char                 *udev_env,
+                        size_t                      udev_env_size,
+                        bool                        valid)
+{
+	unsigned count    = sent.count;
+	unsigned nr_syncs = _nr_syncs(common_ctx);
+
+	_inject_uevent(common_ctx, 1);
+	_dispatch(common_ctx);
+	_send_result(common_ctx, 1, deps, deps_size, true);
+	_fetch(common_ctx, 1, udev_env, udev_env_size);
+	_assert_reply(count + 1, valid);
+
+	/* the exports are dropped with the result which is not valid */
+	assert_int_equal(_nr_syncs(common_ctx), nr_syncs + valid);
+	assert_int_equal(common_ctx->spec_scan.nr_entries, 0);
+}
+
+static void test_spec_scan_deps(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+
+	/* the scan set the property which udev has with the same value */
+	_check_deps(common_ctx, TEST_ENV("SID_DEV_ID=test-dev-id"), TEST_ENV(TEST_UDEV_ENV), true);
+	_check_deps(common_ctx, TEST_ENV("SID_DEV_ID=test-dev-id"), NULL, 0, true);
+
+	/* the scan set the property which udev has with different value */
+	_check_deps(common_ctx, TEST_ENV("SID_DEV_ID=other-id"), TEST_ENV(TEST_UDEV_ENV), false);
+
+	/* the scan looked up the property which only udev has */
+	_check_deps(common_ctx, TEST_ENV("ID_FS_TYPE"), TEST_ENV(TEST_UDEV_ENV), false);
+	_check_deps(common_ctx, TEST_ENV("ID_FS_TYPE"), NULL, 0, true);
+
+	/* udev changed the kernel property the scan had */
+	_check_deps(common_ctx, NULL, 0, TEST_ENV("ACTION=change"), false);
+}
+
+static void test_spec_scan_evict(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct spec_scan_key        key;
+	unsigned                    i;
+
+	_inject_uevent(common_ctx, 1);
+	_dispatch(common_ctx);
+
+	for (i = 2; i <= SPEC_SCAN_MAX_ENTRIES + 1; i++)
+		_inject_uevent(common_ctx, i);
+
+	/* the running scan is kept, the oldest one waiting is dropped */
+	assert_int_equal(common_ctx->spec_scan.nr_entries, SPEC_SCAN_MAX_ENTRIES);
+	key = _key(1);
+	assert_non_null(_find_spec_scan(common_ctx, &key));
+	key = _key(2);
+	assert_null(_find_spec_scan(common_ctx, &key));
+	key = _key(SPEC_SCAN_MAX_ENTRIES + 1);
+	assert_non_null(_find_spec_scan(common_ctx, &key));
+}
+
+static void test_spec_scan_same_device(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct spec_scan           *scan;
+
+	common_ctx->spec_scan.max_workers = 2;
+
+	_inject_uevent(common_ctx, 1);
+	_inject_uevent(common_ctx, 2);
+
+	/* the scan waits for the previous one for the same device */
+	assert_non_null(scan = _dispatch(common_ctx));
+	assert_int_equal(scan->key.seqnum, 1);
+	assert_null(_dispatch(common_ctx));
+
+	/* ...until its result is used and the exports are applied */
+	_send_result(common_ctx, 1, NULL, 0, true);
+	assert_null(_dispatch(common_ctx));
+
+	_fetch(common_ctx, 1, TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(1, true);
+	assert_non_null(scan = _dispatch(common_ctx));
+	assert_int_equal(scan->key.seqnum, 2);
+}
+
+static void test_spec_scan_parent_changed(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct spec_scan_key        disk       = _key(1);
+	uint64_t                    kv_gen     = common_ctx->scan_memo.kv_gen;
+
+	common_ctx->spec_scan.max_workers = 2;
+
+	/* disk and its partition are scanned at the same time */
+	_inject_uevent(common_ctx, 1);
+	_inject_dev_uevent(common_ctx, 2, TEST_DEVNO_PART);
+	assert_non_null(_dispatch(common_ctx));
+	assert_non_null(_dispatch(common_ctx));
+
+	/* the partition scan looked up disk records, the disk scan exports were not there yet */
+	_send_dev_result(common_ctx, disk, kv_gen, false, NULL, 0, true);
+	_send_dev_result(common_ctx, _dev_key(2, TEST_DEVNO_PART), kv_gen, true, NULL, 0, true);
+
+	/* udev uses the disk result first, its exports are queued for sync */
+	_fetch_dev(common_ctx, disk, TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(1, true);
+	assert_int_equal(_nr_syncs(common_ctx), 1);
+
+	/* the partition result is stale, it is dropped with its exports */
+	_fetch_dev(common_ctx, _dev_key(2, TEST_DEVNO_PART), TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(2, false);
+	assert_int_equal(_nr_syncs(common_ctx), 1);
+
+	/* ...the same once the disk exports are synced */
+	_complete_syncs(common_ctx);
+	_inject_dev_uevent(common_ctx, 3, TEST_DEVNO_PART);
+	assert_non_null(_dispatch(common_ctx));
+	_send_dev_result(common_ctx, _dev_key(3, TEST_DEVNO_PART), kv_gen, true, NULL, 0, true);
+	_fetch_dev(common_ctx, _dev_key(3, TEST_DEVNO_PART), TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(3, false);
+	assert_int_equal(_nr_syncs(common_ctx), 0);
+
+	/* the partition scan which started with the disk exports in place is valid */
+	_inject_dev_uevent(common_ctx, 4, TEST_DEVNO_PART);
+	assert_non_null(_dispatch(common_ctx));
+	_send_dev_result(common_ctx, _dev_key(4, TEST_DEVNO_PART), common_ctx->scan_memo.kv_gen, true, NULL, 0, true);
+	_fetch_dev(common_ctx, _dev_key(4, TEST_DEVNO_PART), TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(4, true);
+	assert_int_equal(_nr_syncs(common_ctx), 1);
+}
+
+static void test_spec_scan_max_workers(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct spec_scan           *scan1, *scan2, *scan;
+	struct spec_scan_key        key;
+
+	common_ctx->spec_scan.max_workers = 2;
+
+	_inject_uevent(common_ctx, 1);
+	_inject_dev_uevent(common_ctx, 2, TEST_DEVNO_2);
+	_inject_dev_uevent(common_ctx, 3, TEST_DEVNO_3);
+
+	assert_non_null(scan1 = _dispatch(common_ctx));
+	assert_non_null(scan2 = _dispatch(common_ctx));
+	assert_null(_dispatch(common_ctx));
+
+	/* the worker executing abandoned scan is still occupied */
+	_abandon_spec_scan(common_ctx, scan1);
+	assert_null(_dispatch(common_ctx));
+
+	/* udev does not get abandoned result */
+	_fetch(common_ctx, 1, TEST_ENV(TEST_UDEV_ENV));
+	_assert_reply(1, false);
+
+	/* late result is dropped with its exports, the worker is free now */
+	_send_result(common_ctx, 1, NULL, 0, true);
+	assert_int_equal(_nr_syncs(common_ctx), 0);
+	assert_int_equal(common_ctx->spec_scan.nr_entries, 2);
+	assert_non_null(scan = _dispatch(common_ctx));
+	assert_int_equal(scan->key.seqnum, 3);
+
+	/* the worker executing abandoned scan is gone without sending the result */
+	_abandon_spec_scan(common_ctx, scan2);
+	worker_gone = true;
+	assert_null(_dispatch(common_ctx));
+	key = _dev_key(2, TEST_DEVNO_2);
+	assert_null(_find_spec_scan(common_ctx, &key));
+}
+
+static void test_spec_scan_result_identical(void **state)
+{
+	struct sid_ucmd_ctx ucmd_ctx = {0};
+	struct spec_scan    scan     = {.result_fd = -1, .exp_fd = -1};
+	size_t              exp_size = 0;
+	int                 sv[2], fd;
+	char                direct[PATH_MAX], spec[PATH_MAX];
+	ssize_t             direct_size, spec_size;
+
+	ucmd_ctx.res_buf = _create_buffer(SID_BUFFER_BACKEND_MALLOC, SID_BUFFER_TYPE_VECTOR, TEST_RESULT, sizeof(TEST_RESULT));
+	ucmd_ctx.exp_buf = _create_buffer(SID_BUFFER_BACKEND_MEMFD, SID_BUFFER_TYPE_LINEAR, TEST_EXPORTS, sizeof(TEST_EXPORTS));
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+
+	/* response written to client directly */
+	assert_int_equal(sid_buffer_write_all(ucmd_ctx.res_buf, sv[0]), 0);
+	assert_true((direct_size = read(sv[1], direct, sizeof(direct))) > 0);
+
+	/* response stored by speculative scan together with exports and written to client later */
+	assert_true((fd = _write_spec_scan_result(&ucmd_ctx, &exp_size)) >= 0);
+	assert_int_equal(_store_spec_scan_result(worker_proxy_res, &scan, fd, exp_size, NULL, 0), 0);
+	assert_true(scan.exp_fd >= 0);
+	assert_int_equal(_send_fd_content(scan.result_fd, 0, sv[0]), 0);
+	assert_true((spec_size = read(sv[1], spec, sizeof(spec))) > 0);
+
+	assert_int_equal(direct_size, spec_size);
+	assert_memory_equal(direct, spec, direct_size);
+
+	close(scan.result_fd);
+	close(scan.exp_fd);
+	close(sv[0]);
+	close(sv[1]);
+	sid_buffer_destroy(ucmd_ctx.res_buf);
+	sid_buffer_destroy(ucmd_ctx.exp_buf);
+}
+
+static int setup(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx;
+
+	common_ctx                        = ucmd_fixture_common_ctx_create();
+	common_ctx->spec_scan.enabled     = true;
+	common_ctx->spec_scan.max_workers = SPEC_SCAN_MAX_WORKERS;
+
+	worker_control_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                         &test_event_loop_resource_type,
+	                                         SID_RESOURCE_NO_FLAGS,
+	                                         "testworkercontrol",
+	                                         SID_RESOURCE_NO_PARAMS,
+	                                         SID_RESOURCE_PRIO_NORMAL,
+	                                         SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(worker_control_res);
+	worker_proxy_res = sid_resource_create(worker_control_res,
+	                                       &sid_resource_type_aggregate,
+	                                       SID_RESOURCE_NO_FLAGS,
+	                                       "testworkerproxy",
+	                                       SID_RESOURCE_NO_PARAMS,
+	                                       SID_RESOURCE_PRIO_NORMAL,
+	                                       SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(worker_proxy_res);
+
+	/* main KV store syncs are queued in the event loop */
+	common_ctx->res = worker_control_res;
+
+	sent        = (typeof(sent)) {.fd = -1};
+	worker_gone = false;
+	*state      = common_ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct sid_ucmd_common_ctx *common_ctx = *state;
+	struct kv_sync             *sync, *tmp_sync;
+
+	list_iterate_items_safe (sync, tmp_sync, &common_ctx->sync.queue)
+		_destroy_main_kv_store_sync(common_ctx->res, sync);
+
+	if (common_ctx->sync.es)
+		sid_resource_destroy_event_source(&common_ctx->sync.es);
+
+	_destroy_spec_scans(common_ctx);
+	ucmd_fixture_common_ctx_destroy(common_ctx);
+	sid_resource_unref(worker_control_res);
+
+	if (sent.fd >= 0)
+		close(sent.fd);
+
+	return 0;
+}
+
+#define setup_test(func) cmocka_unit_test_setup_teardown((func), setup, teardown)
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		setup_test(test_spec_scan_no_duplicate),
+		setup_test(test_spec_scan_result_kept),
+		setup_test(test_spec_scan_result_waiter),
+		setup_test(test_spec_scan_failed),
+		setup_test(test_spec_scan_missed_uevent),
+		setup_test(test_spec_scan_not_started),
+		setup_test(test_spec_scan_deps),
+		setup_test(test_spec_scan_evict),
+		setup_test(test_spec_scan_same_device),
+		setup_test(test_spec_scan_parent_changed),
+		setup_test(test_spec_scan_max_workers),
+		setup_test(test_spec_scan_result_identical),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
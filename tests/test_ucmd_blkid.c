@@ -0,0 +1,511 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "../src/modules/ucmd/block/blkid/blkid.c"
+#include "bench.h"
+#include "ucmd-module.h"
+#include "ucmd_fixture.h"
+
+#include <endian.h>
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_MOD_NAME       "blkid"
+#define TEST_DISK_PATH      "/devices/virtual/block/sda"
+#define TEST_DISK_DEVNO     "8:0"
+#define TEST_DISK_DEVID     "test_disk_devid"
+#define TEST_PART_DEVID     "test_part_devid"
+#define TEST_DISKSEQ        10
+#define TEST_SECTOR_SIZE    512
+#define TEST_DISK_SECTORS   8192
+#define TEST_PART_START     2048
+#define TEST_PART_SECTORS   8
+#define TEST_NR_PARTS       2
+#define TEST_BENCH_NR_PARTS 128
+#define TEST_NR_ROUNDS      10
+
+/* GPT on-disk structures, all values are little-endian. */
+struct gpt_header {
+	char     signature[8];
+	uint32_t revision;
+	uint32_t header_size;
+	uint32_t header_crc32;
+	uint32_t reserved;
+	uint64_t my_lba;
+	uint64_t alternate_lba;
+	uint64_t first_usable_lba;
+	uint64_t last_usable_lba;
+	uint8_t  disk_guid[16];
+	uint64_t partition_entries_lba;
+	uint32_t num_partition_entries;
+	uint32_t sizeof_partition_entry;
+	uint32_t partition_entry_array_crc32;
+} __attribute__((packed));
+
+struct gpt_entry {
+	uint8_t  type_guid[16];
+	uint8_t  unique_guid[16];
+	uint64_t first_lba;
+	uint64_t last_lba;
+	uint64_t attributes;
+	uint16_t name[36];
+} __attribute__((packed));
+
+#define GPT_NR_ENTRIES 128
+#define GPT_LINUX_FS   "0fc63daf-8483-4772-8e79-3d69d8477de4"
+
+/* GPT_LINUX_FS with first three fields stored little-endian */
+static const uint8_t gpt_linux_fs[16] =
+	{0xaf, 0x3d, 0xc6, 0x0f, 0x83, 0x84, 0x72, 0x47, 0x8e, 0x79, 0x3d, 0x69, 0xd8, 0x47, 0x7d, 0xe4};
+
+static char  fake_root[] = "/tmp/sid-test-blkid-XXXXXX";
+static char  fake_sysfs_root[PATH_MAX];
+static int   sysfs_reads;
+static char *fake_mod = TEST_MOD_NAME;
+
+/* The type mapper is generated by gperf and it is not needed to test partition tables. */
+const struct blkid_type *blkid_type_lookup(const char *key, size_t len)
+{
+	return NULL;
+}
+
+int __real_sid_util_sysfs_get_value(const char *path, char *buf, size_t buf_size);
+
+/* Redirect sysfs reads to the fake sysfs root and count them. */
+int __wrap_sid_util_sysfs_get_value(const char *path, char *buf, size_t buf_size)
+{
+	char fake_path[PATH_MAX];
+
+	assert_int_equal(strncmp(path, SYSTEM_SYSFS_PATH, sizeof(SYSTEM_SYSFS_PATH) - 1), 0);
+	snprintf(fake_path, sizeof(fake_path), "%s%s", fake_sysfs_root, path + sizeof(SYSTEM_SYSFS_PATH) - 1);
+	sysfs_reads++;
+
+	return __real_sid_util_sysfs_get_value(fake_path, buf, buf_size);
+}
+
+static uint32_t _crc32(const void *buf, size_t len)
+{
+	const uint8_t *p   = buf;
+	uint32_t       crc = 0xffffffff;
+	int            i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+
+	return ~crc;
+}
+
+static void _write_file(const char *path, const char *content)
+{
+	FILE *f;
+
+	assert_non_null(f = fopen(path, "w"));
+	fprintf(f, "%s\n", content);
+	fclose(f);
+}
+
+static void _write_sector(int fd, uint64_t lba, const void *buf, size_t size)
+{
+	assert_int_equal(pwrite(fd, buf, size, lba * TEST_SECTOR_SIZE), size);
+}
+
+/*
+ * Write a disk image with protective MBR and primary GPT with nr_parts
+ * partitions, each TEST_PART_SECTORS long and named "part<number>".
+ */
+static void _write_gpt_image(const char *path, int nr_parts)
+{
+	uint8_t           mbr[TEST_SECTOR_SIZE] = {0};
+	struct gpt_entry  entries[GPT_NR_ENTRIES];
+	struct gpt_header hdr = {0};
+	uint32_t          lba;
+	const char       *s;
+	char              name[16];
+	int               fd, i, j;
+
+	assert_true((fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600)) >= 0);
+	assert_int_equal(ftruncate(fd, (off_t) TEST_DISK_SECTORS * TEST_SECTOR_SIZE), 0);
+
+	/* protective MBR with single partition of type 0xee covering the disk */
+	mbr[446 + 4] = 0xee;
+	lba          = htole32(1);
+	memcpy(mbr + 446 + 8, &lba, sizeof(lba));
+	lba = htole32(TEST_DISK_SECTORS - 1);
+	memcpy(mbr + 446 + 12, &lba, sizeof(lba));
+	mbr[510] = 0x55;
+	mbr[511] = 0xaa;
+	_write_sector(fd, 0, mbr, sizeof(mbr));
+
+	memset(entries, 0, sizeof(entries));
+	for (i = 0; i < nr_parts; i++) {
+		memcpy(entries[i].type_guid, gpt_linux_fs, sizeof(gpt_linux_fs));
+		entries[i].unique_guid[15] = i + 1;
+		entries[i].first_lba       = htole64(TEST_PART_START + i * TEST_PART_SECTORS);
+		entries[i].last_lba        = htole64(TEST_PART_START + (i + 1) * TEST_PART_SECTORS - 1);
+		snprintf(name, sizeof(name), "part%d", i + 1);
+		for (s = name, j = 0; *s; s++, j++)
+			entries[i].name[j] = htole16(*s);
+	}
+	_write_sector(fd, 2, entries, sizeof(entries));
+
+	memcpy(hdr.signature, "EFI PART", sizeof(hdr.signature));
+	hdr.revision                    = htole32(0x00010000);
+	hdr.header_size                 = htole32(sizeof(hdr));
+	hdr.my_lba                      = htole64(1);
+	hdr.alternate_lba               = htole64(TEST_DISK_SECTORS - 1);
+	hdr.first_usable_lba            = htole64(34);
+	hdr.last_usable_lba             = htole64(TEST_DISK_SECTORS - 34);
+	hdr.disk_guid[0]                = 1;
+	hdr.partition_entries_lba       = htole64(2);
+	hdr.num_partition_entries       = htole32(GPT_NR_ENTRIES);
+	hdr.sizeof_partition_entry      = htole32(sizeof(struct gpt_entry));
+	hdr.partition_entry_array_crc32 = htole32(_crc32(entries, sizeof(entries)));
+	hdr.header_crc32                = htole32(_crc32(&hdr, sizeof(hdr)));
+	_write_sector(fd, 1, &hdr, sizeof(hdr));
+
+	close(fd);
+}
+
+static void _create_fake_part_sysfs(int partno)
+{
+	char path[PATH_MAX];
+	char value[16];
+
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH "/sda%d", fake_sysfs_root, partno);
+	assert_int_equal(mkdir(path, 0755), 0);
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH "/sda%d/partition", fake_sysfs_root, partno);
+	snprintf(value, sizeof(value), "%d", partno);
+	_write_file(path, value);
+}
+
+static void _destroy_fake_part_sysfs(int partno)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH "/sda%d/partition", fake_sysfs_root, partno);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH "/sda%d", fake_sysfs_root, partno);
+	rmdir(path);
+}
+
+static void _create_fake_root(void)
+{
+	char path[PATH_MAX];
+	int  fd, i;
+
+	assert_non_null(mkdtemp(fake_root));
+
+	snprintf(fake_sysfs_root, sizeof(fake_sysfs_root), "%s/sys", fake_root);
+	snprintf(path, sizeof(path), "%s/devices", fake_sysfs_root);
+	assert_int_equal(mkdir(fake_sysfs_root, 0755), 0);
+	assert_int_equal(mkdir(path, 0755), 0);
+	snprintf(path, sizeof(path), "%s/devices/virtual", fake_sysfs_root);
+	assert_int_equal(mkdir(path, 0755), 0);
+	snprintf(path, sizeof(path), "%s/devices/virtual/block", fake_sysfs_root);
+	assert_int_equal(mkdir(path, 0755), 0);
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH, fake_sysfs_root);
+	assert_int_equal(mkdir(path, 0755), 0);
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH "/dev", fake_sysfs_root);
+	_write_file(path, TEST_DISK_DEVNO);
+
+	for (i = 1; i <= TEST_BENCH_NR_PARTS; i++)
+		_create_fake_part_sysfs(i);
+
+	/* partition content has no signatures so blkid finds nothing in there itself */
+	snprintf(path, sizeof(path), "%s/part", fake_root);
+	assert_true((fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600)) >= 0);
+	assert_int_equal(ftruncate(fd, TEST_PART_SECTORS * TEST_SECTOR_SIZE), 0);
+	close(fd);
+}
+
+static void _destroy_fake_root(void)
+{
+	char path[PATH_MAX];
+	int  i;
+
+	for (i = 1; i <= TEST_BENCH_NR_PARTS; i++)
+		_destroy_fake_part_sysfs(i);
+
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH "/dev", fake_sysfs_root);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s" TEST_DISK_PATH, fake_sysfs_root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/devices/virtual/block", fake_sysfs_root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/devices/virtual", fake_sysfs_root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/devices", fake_sysfs_root);
+	rmdir(path);
+	rmdir(fake_sysfs_root);
+	snprintf(path, sizeof(path), "%s/disk", fake_root);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/part", fake_root);
+	unlink(path);
+	rmdir(fake_root);
+}
+
+/* Device names are relative to /dev, point them to the image files instead. */
+static void _set_dev_name(char *buf, size_t buf_size, const char *file)
+{
+	snprintf(buf, buf_size, "..%s/%s", fake_root, file);
+}
+
+struct test_ctx {
+	struct sid_ucmd_ctx *disk;
+	struct sid_ucmd_ctx  part;
+	char                 disk_name[PATH_MAX];
+	char                 part_name[PATH_MAX];
+	char                 part_path[PATH_MAX];
+};
+
+static void _set_part(struct test_ctx *test_ctx, int partno, uint64_t diskseq)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = &test_ctx->part;
+
+	snprintf(test_ctx->part_path, sizeof(test_ctx->part_path), TEST_DISK_PATH "/sda%d", partno);
+
+	ucmd_ctx->req_env.dev.udev.path       = test_ctx->part_path;
+	ucmd_ctx->req_env.dev.udev.minor      = partno;
+	ucmd_ctx->req_env.dev.udev.diskseq    = diskseq;
+	ucmd_ctx->req_env.dev.disk.devno_s[0] = '\0';
+	ucmd_ctx->req_env.dev.disk.devid_s[0] = '\0';
+}
+
+static void _scan_disk(struct test_ctx *test_ctx, int nr_parts)
+{
+	struct module *mod = (struct module *) fake_mod;
+	char           path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/disk", fake_root);
+	_write_gpt_image(path, nr_parts);
+
+	assert_int_equal(_blkid_scan_next(mod, test_ctx->disk), 0);
+	assert_string_equal(sid_ucmd_get_kv(mod, test_ctx->disk, KV_NS_UDEV, keys[U_PART_TABLE_TYPE], NULL, NULL), "gpt");
+	assert_non_null(sid_ucmd_get_kv(mod, test_ctx->disk, KV_NS_DEVICE, keys[D_PART_TABLE], NULL, NULL));
+}
+
+static const char *_get_part_kv(struct test_ctx *test_ctx, const char *key)
+{
+	return sid_ucmd_get_kv((struct module *) fake_mod, &test_ctx->part, KV_NS_UDEV, key, NULL, NULL);
+}
+
+static void test_part_entry_from_disk(void **state)
+{
+	struct test_ctx *test_ctx = *state;
+	char             value[64];
+	int              i;
+
+	_scan_disk(test_ctx, TEST_NR_PARTS);
+
+	for (i = 1; i <= TEST_NR_PARTS; i++) {
+		_set_part(test_ctx, i, TEST_DISKSEQ);
+		assert_int_equal(_blkid_scan_next((struct module *) fake_mod, &test_ctx->part), 0);
+
+		assert_string_equal(_get_part_kv(test_ctx, "ID_PART_ENTRY_SCHEME"), "gpt");
+		assert_string_equal(_get_part_kv(test_ctx, keys[U_PART_ENTRY_TYPE]), GPT_LINUX_FS);
+		snprintf(value, sizeof(value), "part%d", i);
+		assert_string_equal(_get_part_kv(test_ctx, keys[U_PART_ENTRY_NAME]), value);
+		snprintf(value, sizeof(value), "00000000-0000-0000-0000-0000000000%02x", i);
+		assert_string_equal(_get_part_kv(test_ctx, "ID_PART_ENTRY_UUID"), value);
+		snprintf(value, sizeof(value), "%d", i);
+		assert_string_equal(_get_part_kv(test_ctx, "ID_PART_ENTRY_NUMBER"), value);
+		snprintf(value, sizeof(value), "%d", TEST_PART_START + (i - 1) * TEST_PART_SECTORS);
+		assert_string_equal(_get_part_kv(test_ctx, "ID_PART_ENTRY_OFFSET"), value);
+		snprintf(value, sizeof(value), "%d", TEST_PART_SECTORS);
+		assert_string_equal(_get_part_kv(test_ctx, "ID_PART_ENTRY_SIZE"), value);
+		assert_string_equal(_get_part_kv(test_ctx, "ID_PART_ENTRY_DISK"), TEST_DISK_DEVNO);
+	}
+}
+
+static void test_part_entry_stale_diskseq(void **state)
+{
+	struct test_ctx *test_ctx = *state;
+
+	_scan_disk(test_ctx, TEST_NR_PARTS);
+
+	/* the disk changed since its partition table was stored */
+	_set_part(test_ctx, 1, TEST_DISKSEQ + 1);
+	assert_int_equal(_add_part_entry_properties_from_disk((struct module *) fake_mod, &test_ctx->part), 0);
+	assert_null(_get_part_kv(test_ctx, "ID_PART_ENTRY_NUMBER"));
+}
+
+static void test_part_entry_no_diskseq(void **state)
+{
+	struct test_ctx *test_ctx = *state;
+
+	_scan_disk(test_ctx, TEST_NR_PARTS);
+
+	/* without diskseq, the stored table is not even looked up */
+	_set_part(test_ctx, 1, 0);
+	sysfs_reads = 0;
+	assert_int_equal(_add_part_entry_properties_from_disk((struct module *) fake_mod, &test_ctx->part), 0);
+	assert_int_equal(sysfs_reads, 0);
+	assert_null(_get_part_kv(test_ctx, "ID_PART_ENTRY_NUMBER"));
+}
+
+static uint64_t _get_bytes_read(void)
+{
+	char     line[64];
+	uint64_t rchar = 0;
+	FILE    *f;
+
+	if (!(f = fopen("/proc/self/io", "r")))
+		return 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "rchar: %" SCNu64, &rchar) == 1)
+			break;
+	}
+	fclose(f);
+
+	return rchar;
+}
+
+/*
+ * Without the stored table, each partition needs the whole disk's
+ * partition table to be read and parsed to get its entry.
+ */
+static void _probe_part_entry(const char *disk_path, int partno)
+{
+	blkid_probe     pr;
+	blkid_partlist  ls;
+	blkid_partition par;
+	int             fd;
+
+	assert_true((fd = open(disk_path, O_RDONLY | O_CLOEXEC)) >= 0);
+	assert_non_null(pr = blkid_new_probe());
+	assert_int_equal(blkid_probe_set_device(pr, fd, 0, 0), 0);
+	blkid_probe_enable_partitions(pr, 1);
+	blkid_probe_set_partitions_flags(pr, BLKID_PARTS_ENTRY_DETAILS);
+	assert_int_equal(blkid_do_safeprobe(pr), 0);
+	assert_non_null(ls = blkid_probe_get_partitions(pr));
+	assert_non_null(par = blkid_partlist_get_partition_by_partno(ls, partno));
+	assert_int_equal(blkid_partition_get_partno(par), partno);
+	blkid_free_probe(pr);
+	close(fd);
+}
+
+static void test_part_entry_bench(void **state)
+{
+	struct test_ctx *test_ctx = *state;
+	struct bench     bench_probe, bench_stored;
+	char             path[PATH_MAX];
+	uint64_t         probe_bytes, stored_bytes;
+	int              i, j;
+
+	_scan_disk(test_ctx, TEST_BENCH_NR_PARTS);
+	snprintf(path, sizeof(path), "%s/disk", fake_root);
+
+	bench_init(&bench_probe, "blkid_part_entry_probe");
+	probe_bytes = _get_bytes_read();
+	bench_start(&bench_probe);
+	for (i = 0; i < TEST_NR_ROUNDS; i++) {
+		for (j = 1; j <= TEST_BENCH_NR_PARTS; j++)
+			_probe_part_entry(path, j);
+	}
+	bench_stop(&bench_probe, TEST_NR_ROUNDS * TEST_BENCH_NR_PARTS);
+	probe_bytes = _get_bytes_read() - probe_bytes;
+	assert_int_equal(bench_report(&bench_probe), 0);
+
+	bench_init(&bench_stored, "blkid_part_entry_stored");
+	stored_bytes = _get_bytes_read();
+	bench_start(&bench_stored);
+	for (i = 0; i < TEST_NR_ROUNDS; i++) {
+		for (j = 1; j <= TEST_BENCH_NR_PARTS; j++) {
+			_set_part(test_ctx, j, TEST_DISKSEQ);
+			assert_int_equal(_add_part_entry_properties_from_disk((struct module *) fake_mod, &test_ctx->part), 1);
+		}
+	}
+	bench_stop(&bench_stored, TEST_NR_ROUNDS * TEST_BENCH_NR_PARTS);
+	stored_bytes = _get_bytes_read() - stored_bytes;
+	assert_int_equal(bench_report(&bench_stored), 0);
+
+	print_message("partition entry: %.0f ns and %" PRIu64 " bytes read per partition when probed, "
+	              "%.0f ns and %" PRIu64 " bytes read per partition from disk records\n",
+	              (double) bench_probe.nsec / (TEST_NR_ROUNDS * TEST_BENCH_NR_PARTS),
+	              probe_bytes / (TEST_NR_ROUNDS * TEST_BENCH_NR_PARTS),
+	              (double) bench_stored.nsec / (TEST_NR_ROUNDS * TEST_BENCH_NR_PARTS),
+	              stored_bytes / (TEST_NR_ROUNDS * TEST_BENCH_NR_PARTS));
+
+	bench_destroy(&bench_probe);
+	bench_destroy(&bench_stored);
+}
+
+static int setup(void **state)
+{
+	struct test_ctx     *test_ctx;
+	struct sid_ucmd_ctx *disk;
+
+	assert_non_null(test_ctx = mem_zalloc(sizeof(*test_ctx)));
+	disk = test_ctx->disk = ucmd_fixture_ctx_create();
+
+	_set_dev_name(test_ctx->disk_name, sizeof(test_ctx->disk_name), "disk");
+	disk->req_env.dev.udev.type    = UDEV_DEVTYPE_DISK;
+	disk->req_env.dev.udev.path    = TEST_DISK_PATH;
+	disk->req_env.dev.udev.name    = test_ctx->disk_name;
+	disk->req_env.dev.udev.major   = 8;
+	disk->req_env.dev.udev.minor   = 0;
+	disk->req_env.dev.udev.seqnum  = 1;
+	disk->req_env.dev.udev.diskseq = TEST_DISKSEQ;
+	disk->req_env.dev.uid_s        = TEST_DISK_DEVID;
+
+	/* whole disk device number to device identifier mapping */
+	assert_int_equal(
+		_handle_dev_for_group(NULL, disk, TEST_DISK_DEVID, KV_KEY_DOM_ALIAS, KV_NS_MODULE, "devno", "8_0", KV_OP_PLUS),
+		0);
+
+	ucmd_fixture_ctx_init(&test_ctx->part, disk->common);
+	_set_dev_name(test_ctx->part_name, sizeof(test_ctx->part_name), "part");
+	test_ctx->part.req_env.dev.udev.type   = UDEV_DEVTYPE_PARTITION;
+	test_ctx->part.req_env.dev.udev.name   = test_ctx->part_name;
+	test_ctx->part.req_env.dev.udev.major  = 8;
+	test_ctx->part.req_env.dev.udev.seqnum = 2;
+	test_ctx->part.req_env.dev.uid_s       = TEST_PART_DEVID;
+
+	*state = test_ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_ctx *test_ctx = *state;
+
+	ucmd_fixture_ctx_cleanup(&test_ctx->part);
+	ucmd_fixture_ctx_destroy(test_ctx->disk);
+	free(test_ctx);
+	return 0;
+}
+
+static int group_setup(void **state)
+{
+	_create_fake_root();
+	return 0;
+}
+
+static int group_teardown(void **state)
+{
+	_destroy_fake_root();
+	return 0;
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_part_entry_from_disk, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_part_entry_stale_diskseq, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_part_entry_no_diskseq, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_part_entry_bench, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, group_setup, group_teardown);
+}
@@ -0,0 +1,326 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "bench.h"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_OUT_TEMPLATE          "/tmp/sid-test-debug-filter-XXXXXX"
+#define TEST_NR_STEPS              8
+#define TEST_BENCH_NR_CMDS         100000
+#define TEST_BENCH_NR_LOGS_PER_CMD 20
+
+struct test_ctx {
+	sid_resource_t             *res;
+	struct ubridge              ubridge;
+	struct sid_ucmd_common_ctx *common_ctx;
+	struct sid_ucmd_ctx         devs[2]; /* sda (8:0) and sdb (8:16) */
+	int                         out_fd;  /* captured standard output */
+	int                         saved_fd;
+};
+
+static void _init_dev(struct test_ctx *ctx, unsigned i, const char *name, int major, int minor)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = &ctx->devs[i];
+
+	memset(ucmd_ctx, 0, sizeof(*ucmd_ctx));
+	ucmd_ctx->common                 = ctx->common_ctx;
+	ucmd_ctx->req_cat                = MSG_CATEGORY_CLIENT;
+	ucmd_ctx->req_hdr.cmd            = SID_CMD_SCAN;
+	ucmd_ctx->req_env.dev.udev.name  = name;
+	ucmd_ctx->req_env.dev.udev.major = major;
+	ucmd_ctx->req_env.dev.udev.minor = minor;
+
+	/* as done in _init_command */
+	ucmd_ctx->debug                  = _debug_filter_match(ucmd_ctx, NULL);
+}
+
+static void _init_devs(struct test_ctx *ctx)
+{
+	_init_dev(ctx, 0, "sda", 8, 0);
+	_init_dev(ctx, 1, "sdb", 8, 16);
+}
+
+static void _set_filter(struct test_ctx *ctx, const char *list, size_t list_size)
+{
+	assert_int_equal(param_set(ctx->common_ctx->params, list, list_size, NULL), 0);
+	_init_devs(ctx);
+}
+
+/*
+ * One step of a command being handled, as done by _cmd_handler. Both devices
+ * take turns, so any debug messages forced for one of them must not leak to
+ * the other one.
+ */
+static void _scan_step(struct sid_ucmd_ctx *ucmd_ctx, unsigned step)
+{
+	_cmd_debug_begin(ucmd_ctx);
+	log_debug(ucmd_ctx->req_env.dev.udev.name, "scan step %u", step);
+	_cmd_debug_end(ucmd_ctx);
+	log_debug(ucmd_ctx->req_env.dev.udev.name, "between steps");
+}
+
+static void _scan_concurrently(struct test_ctx *ctx)
+{
+	unsigned step;
+
+	for (step = 0; step < TEST_NR_STEPS; step++) {
+		_scan_step(&ctx->devs[0], step);
+		_scan_step(&ctx->devs[1], step);
+	}
+}
+
+static void _capture_start(struct test_ctx *ctx)
+{
+	char path[] = TEST_OUT_TEMPLATE;
+
+	assert_true((ctx->out_fd = mkstemp(path)) >= 0);
+	assert_int_equal(unlink(path), 0);
+
+	fflush(stdout);
+	assert_true((ctx->saved_fd = dup(STDOUT_FILENO)) >= 0);
+	assert_true(dup2(ctx->out_fd, STDOUT_FILENO) >= 0);
+}
+
+static char *_capture_end(struct test_ctx *ctx)
+{
+	char   *out;
+	off_t   size;
+	ssize_t n;
+
+	fflush(stdout);
+	assert_true(dup2(ctx->saved_fd, STDOUT_FILENO) >= 0);
+	close(ctx->saved_fd);
+
+	assert_true((size = lseek(ctx->out_fd, 0, SEEK_END)) >= 0);
+	assert_non_null(out = malloc(size + 1));
+	assert_int_equal((n = pread(ctx->out_fd, out, size, 0)), size);
+	out[size] = '\0';
+	close(ctx->out_fd);
+
+	return out;
+}
+
+static unsigned _count(const char *out, const char *str)
+{
+	unsigned count = 0;
+
+	while ((out = strstr(out, str))) {
+		count++;
+		out += strlen(str);
+	}
+
+	return count;
+}
+
+/* Scan both devices concurrently and check how many debug messages were logged for each. */
+static void _assert_scan_output(struct test_ctx *ctx, unsigned nr_sda, unsigned nr_sdb, unsigned nr_between)
+{
+	char *out;
+
+	_capture_start(ctx);
+	_scan_concurrently(ctx);
+	out = _capture_end(ctx);
+
+	assert_int_equal(_count(out, "<sda> scan step"), nr_sda);
+	assert_int_equal(_count(out, "<sdb> scan step"), nr_sdb);
+	assert_int_equal(_count(out, "between steps"), nr_between);
+
+	free(out);
+}
+
+static void test_debug_filter_unfiltered(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	_init_devs(ctx);
+	assert_false(ctx->common_ctx->debug.enabled);
+	assert_false(ctx->devs[0].debug);
+	assert_false(ctx->devs[1].debug);
+
+	_assert_scan_output(ctx, 0, 0, 0);
+
+	/* global verbose mode still logs everything */
+	log_change_verbose_mode(2);
+	_assert_scan_output(ctx, TEST_NR_STEPS, TEST_NR_STEPS, 2 * TEST_NR_STEPS);
+	log_change_verbose_mode(0);
+}
+
+static void test_debug_filter_device(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	_set_filter(ctx, "DEBUG_NAME=sda", sizeof("DEBUG_NAME=sda"));
+	_assert_scan_output(ctx, TEST_NR_STEPS, 0, 0);
+
+	_set_filter(ctx, "DEBUG_NAME=sd[ab]", sizeof("DEBUG_NAME=sd[ab]"));
+	_assert_scan_output(ctx, TEST_NR_STEPS, TEST_NR_STEPS, 0);
+
+	/* all filters set must match */
+	_set_filter(ctx, "DEBUG_DEVNO=8:16", sizeof("DEBUG_DEVNO=8:16"));
+	_assert_scan_output(ctx, 0, TEST_NR_STEPS, 0);
+
+	_set_filter(ctx, "DEBUG_NAME=sd*\0DEBUG_CMD=checkpoint", sizeof("DEBUG_NAME=sd*\0DEBUG_CMD=checkpoint"));
+	_assert_scan_output(ctx, 0, 0, 0);
+
+	_set_filter(ctx, "DEBUG_CMD=scan", sizeof("DEBUG_CMD=scan"));
+	_assert_scan_output(ctx, 0, TEST_NR_STEPS, 0);
+
+	/* forced debug messages do not change verbose mode and they are not forced anymore once filters are unset */
+	assert_int_equal(log_get_verbose_mode(), 0);
+	_set_filter(ctx, "DEBUG_DEVNO=\0DEBUG_NAME=\0DEBUG_CMD=", sizeof("DEBUG_DEVNO=\0DEBUG_NAME=\0DEBUG_CMD="));
+	assert_false(ctx->common_ctx->debug.enabled);
+	_assert_scan_output(ctx, 0, 0, 0);
+}
+
+static void test_debug_filter_module(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	/* module is not known before ident phase */
+	_set_filter(ctx, "DEBUG_MODULE=dm", sizeof("DEBUG_MODULE=dm"));
+	assert_true(ctx->common_ctx->debug.enabled);
+	assert_false(ctx->devs[0].debug);
+	assert_false(_debug_filter_match(&ctx->devs[0], "sd"));
+	assert_true(_debug_filter_match(&ctx->devs[0], "dm"));
+
+	/* as done in _cmd_exec_scan_ident */
+	ctx->devs[1].debug = _debug_filter_match(&ctx->devs[1], "dm");
+	_assert_scan_output(ctx, 0, TEST_NR_STEPS, 0);
+}
+
+static void test_debug_filter_invalid(void **state)
+{
+	struct test_ctx *ctx = *state;
+	const char      *failed;
+
+	_set_filter(ctx, "DEBUG_NAME=sda", sizeof("DEBUG_NAME=sda"));
+
+	assert_int_equal(param_set(ctx->common_ctx->params, "DEBUG_DEVNO=8", sizeof("DEBUG_DEVNO=8"), &failed), -EINVAL);
+	assert_string_equal(failed, KEY_DEBUG_DEVNO);
+	assert_int_equal(param_set(ctx->common_ctx->params, "DEBUG_DEVNO=8:0x", sizeof("DEBUG_DEVNO=8:0x"), NULL), -EINVAL);
+	assert_int_equal(param_set(ctx->common_ctx->params, "DEBUG_DEVNO=-1:0", sizeof("DEBUG_DEVNO=-1:0"), NULL), -EINVAL);
+	assert_int_equal(param_set(ctx->common_ctx->params, "DEBUG_CMD=unknown", sizeof("DEBUG_CMD=unknown"), NULL), -EINVAL);
+
+	/* the whole batch is rejected, including the name filter applied before */
+	assert_int_equal(param_set(ctx->common_ctx->params,
+	                           "DEBUG_NAME=sdb\0DEBUG_CMD=nope",
+	                           sizeof("DEBUG_NAME=sdb\0DEBUG_CMD=nope"),
+	                           &failed),
+	                 -EINVAL);
+	assert_string_equal(failed, KEY_DEBUG_CMD);
+	assert_string_equal(ctx->common_ctx->debug.name, "sda");
+	assert_int_equal(ctx->common_ctx->debug.major, -1);
+	assert_int_equal(ctx->common_ctx->debug.cmd, SID_CMD_UNDEFINED);
+
+	_init_devs(ctx);
+	_assert_scan_output(ctx, TEST_NR_STEPS, 0, 0);
+}
+
+static void _bench_cmds(struct test_ctx *ctx, struct bench *bench)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = &ctx->devs[0];
+	unsigned             i, j;
+
+	bench_start(bench);
+	for (i = 0; i < TEST_BENCH_NR_CMDS; i++) {
+		ucmd_ctx->debug = _debug_filter_match(ucmd_ctx, NULL);
+		_cmd_debug_begin(ucmd_ctx);
+		for (j = 0; j < TEST_BENCH_NR_LOGS_PER_CMD; j++)
+			log_debug(ucmd_ctx->req_env.dev.udev.name, "message %u", j);
+		_cmd_debug_end(ucmd_ctx);
+	}
+	bench_stop(bench, TEST_BENCH_NR_CMDS);
+}
+
+/*
+ * Commands with debug messages which are not logged, without any filter compared
+ * to a filter set which does not match the device.
+ */
+static void test_debug_filter_bench(void **state)
+{
+	struct test_ctx *ctx = *state;
+	struct bench     bench_none, bench_nomatch;
+
+	_init_devs(ctx);
+	bench_init(&bench_none, "debug_filter_none");
+	_bench_cmds(ctx, &bench_none);
+	assert_int_equal(bench_report(&bench_none), 0);
+
+	_set_filter(ctx, "DEBUG_NAME=nvme*\0DEBUG_CMD=scan", sizeof("DEBUG_NAME=nvme*\0DEBUG_CMD=scan"));
+	assert_false(ctx->devs[0].debug);
+	bench_init(&bench_nomatch, "debug_filter_nomatch");
+	_bench_cmds(ctx, &bench_nomatch);
+	assert_int_equal(bench_report(&bench_nomatch), 0);
+
+	print_message("debug filter: %u debug messages per command, %.0f ns per command without filter, %.0f ns with "
+	              "filter not matching\n",
+	              TEST_BENCH_NR_LOGS_PER_CMD,
+	              (double) bench_none.nsec / TEST_BENCH_NR_CMDS,
+	              (double) bench_nomatch.nsec / TEST_BENCH_NR_CMDS);
+
+	bench_destroy(&bench_none);
+	bench_destroy(&bench_nomatch);
+}
+
+static int setup(void **state)
+{
+	struct test_ctx *ctx;
+
+	assert_non_null(ctx = mem_zalloc(sizeof(*ctx)));
+	ctx->res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                               &sid_resource_type_aggregate,
+	                               SID_RESOURCE_NO_FLAGS,
+	                               "testubridge",
+	                               SID_RESOURCE_NO_PARAMS,
+	                               SID_RESOURCE_PRIO_NORMAL,
+	                               SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(ctx->res);
+	ctx->common_ctx = ucmd_fixture_common_ctx_create();
+
+	log_init(LOG_TARGET_STANDARD, 0);
+
+	assert_int_equal(_init_params(ctx->res, &ctx->ubridge, ctx->common_ctx), 0);
+	assert_int_equal(_init_debug_filter(ctx->res, ctx->common_ctx), 0);
+	param_registry_set_running(ctx->common_ctx->params);
+
+	*state = ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	free(ctx->common_ctx->debug.name);
+	free(ctx->common_ctx->debug.module);
+	param_registry_destroy(ctx->common_ctx->params);
+	ucmd_fixture_common_ctx_destroy(ctx->common_ctx);
+	sid_resource_unref(ctx->res);
+	free(ctx);
+	return 0;
+}
+
+#define setup_test(func) cmocka_unit_test_setup_teardown((func), setup, teardown)
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		setup_test(test_debug_filter_unfiltered),
+		setup_test(test_debug_filter_device),
+		setup_test(test_debug_filter_module),
+		setup_test(test_debug_filter_invalid),
+		setup_test(test_debug_filter_bench),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
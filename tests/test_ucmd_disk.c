@@ -0,0 +1,231 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "ucmd-module.h"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_MOD_NAME   "test"
+#define TEST_PART_PATH  "/devices/virtual/block/sda/sda1"
+#define TEST_DISK_DEVNO "8:0"
+#define TEST_DISK_DEVID "test_disk_devid"
+#define TEST_NR_KEYS    20
+
+static char  fake_sysfs_root[] = "/tmp/sid-test-sysfs-XXXXXX";
+static int   sysfs_reads;
+static char *fake_mod = TEST_MOD_NAME;
+
+int __real_sid_util_sysfs_get_value(const char *path, char *buf, size_t buf_size);
+
+/* Redirect sysfs reads to the fake sysfs root and count them. */
+int __wrap_sid_util_sysfs_get_value(const char *path, char *buf, size_t buf_size)
+{
+	char fake_path[PATH_MAX];
+
+	assert_int_equal(strncmp(path, SYSTEM_SYSFS_PATH, sizeof(SYSTEM_SYSFS_PATH) - 1), 0);
+	snprintf(fake_path, sizeof(fake_path), "%s%s", fake_sysfs_root, path + sizeof(SYSTEM_SYSFS_PATH) - 1);
+	sysfs_reads++;
+
+	return __real_sid_util_sysfs_get_value(fake_path, buf, buf_size);
+}
+
+static void _mkdir_p(const char *root, const char *path)
+{
+	char  dir[PATH_MAX];
+	char *p;
+
+	snprintf(dir, sizeof(dir), "%s%s", root, path);
+	for (p = dir + strlen(root) + 1; (p = strchr(p, '/')); p++) {
+		*p = '\0';
+		assert_true(mkdir(dir, 0755) == 0 || errno == EEXIST);
+		*p = '/';
+	}
+	assert_true(mkdir(dir, 0755) == 0 || errno == EEXIST);
+}
+
+static void _create_fake_sysfs(void)
+{
+	char  path[PATH_MAX];
+	FILE *f;
+
+	assert_non_null(mkdtemp(fake_sysfs_root));
+	_mkdir_p(fake_sysfs_root, TEST_PART_PATH);
+
+	snprintf(path, sizeof(path), "%s%s/../dev", fake_sysfs_root, TEST_PART_PATH);
+	assert_non_null(f = fopen(path, "w"));
+	fprintf(f, "%s\n", TEST_DISK_DEVNO);
+	fclose(f);
+}
+
+static void _destroy_fake_sysfs(void)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s%s/../dev", fake_sysfs_root, TEST_PART_PATH);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s%s", fake_sysfs_root, TEST_PART_PATH);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/devices/virtual/block/sda", fake_sysfs_root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/devices/virtual/block", fake_sysfs_root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/devices/virtual", fake_sysfs_root);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/devices", fake_sysfs_root);
+	rmdir(path);
+	rmdir(fake_sysfs_root);
+}
+
+static struct sid_ucmd_ctx *_create_ucmd_ctx(void)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = ucmd_fixture_ctx_create();
+
+	ucmd_ctx->req_env.dev.udev.type  = UDEV_DEVTYPE_PARTITION;
+	ucmd_ctx->req_env.dev.udev.path  = TEST_PART_PATH;
+	ucmd_ctx->req_env.dev.udev.name  = "sda1";
+	ucmd_ctx->req_env.dev.udev.major = 8;
+	ucmd_ctx->req_env.dev.udev.minor = 1;
+
+	return ucmd_ctx;
+}
+
+static void _set_disk_kv(struct sid_ucmd_ctx *ucmd_ctx, const char *core, const char *value)
+{
+	struct kv_key_spec   key_spec   = {.op      = KV_OP_SET,
+	                                   .dom     = KV_KEY_DOM_USER,
+	                                   .ns      = KV_NS_DEVICE,
+	                                   .ns_part = TEST_DISK_DEVID,
+	                                   .id_cat  = ID_NULL,
+	                                   .id      = ID_NULL,
+	                                   .core    = core};
+	sid_ucmd_kv_flags_t  flags      = KV_RD;
+	struct kv_update_arg update_arg = {.res      = ucmd_ctx->common->kv_store_res,
+	                                   .owner    = TEST_MOD_NAME,
+	                                   .gen_buf  = ucmd_ctx->common->gen_buf,
+	                                   .custom   = NULL,
+	                                   .ret_code = -EREMOTEIO};
+	kv_vector_t          vvalue[VVALUE_SINGLE_CNT];
+	char                *key;
+
+	assert_non_null(key = _compose_key(ucmd_ctx->common->gen_buf, &key_spec));
+
+	VVALUE_HEADER_PREP(vvalue, ucmd_ctx->req_env.dev.udev.seqnum, flags, ucmd_ctx->common->gennum, TEST_MOD_NAME);
+	VVALUE_DATA_PREP(vvalue, 0, value, strlen(value) + 1);
+
+	assert_non_null(kv_store_set_value(ucmd_ctx->common->kv_store_res,
+	                                   key,
+	                                   vvalue,
+	                                   VVALUE_SINGLE_CNT,
+	                                   KV_STORE_VALUE_VECTOR,
+	                                   KV_STORE_VALUE_OP_MERGE,
+	                                   _kv_cb_write,
+	                                   &update_arg));
+	assert_true(update_arg.ret_code >= 0);
+
+	_destroy_key(ucmd_ctx->common->gen_buf, key);
+}
+
+static void _check_disk_kvs(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	struct module *mod = (struct module *) fake_mod;
+	char           core[16];
+	char           value[16];
+	const char    *data;
+	size_t         size;
+	int            i;
+
+	for (i = 0; i < TEST_NR_KEYS; i++) {
+		snprintf(core, sizeof(core), "KEY%d", i);
+		snprintf(value, sizeof(value), "VALUE%d", i);
+		assert_non_null(data = sid_ucmd_part_get_disk_kv(mod, ucmd_ctx, core, &size, NULL));
+		assert_int_equal(size, strlen(value) + 1);
+		assert_string_equal(data, value);
+	}
+}
+
+static void test_part_get_disk_kv_cached(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+
+	_check_disk_kvs(ucmd_ctx);
+	assert_int_equal(sysfs_reads, 1);
+	assert_string_equal(ucmd_ctx->req_env.dev.disk.devno_s, TEST_DISK_DEVNO);
+	assert_string_equal(ucmd_ctx->req_env.dev.disk.devid_s, TEST_DISK_DEVID);
+
+	/* forgetting the cached whole disk must give the same results */
+	ucmd_ctx->req_env.dev.disk.devno_s[0] = '\0';
+	ucmd_ctx->req_env.dev.disk.devid_s[0] = '\0';
+	_check_disk_kvs(ucmd_ctx);
+	assert_int_equal(sysfs_reads, 2);
+}
+
+static void test_part_get_whole_disk_small_buf(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+	char                 devno_buf[sizeof(TEST_DISK_DEVNO) - 1];
+
+	assert_int_equal(_part_get_whole_disk(NULL, ucmd_ctx, devno_buf, sizeof(devno_buf)), -ENOBUFS);
+	assert_int_equal(sysfs_reads, 1);
+	assert_int_equal(_part_get_whole_disk(NULL, ucmd_ctx, devno_buf, sizeof(devno_buf)), -ENOBUFS);
+	assert_int_equal(sysfs_reads, 1);
+}
+
+static int setup(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = _create_ucmd_ctx();
+	char                 core[16];
+	char                 value[16];
+	int                  i;
+
+	/* whole disk device number to device identifier mapping */
+	assert_int_equal(
+		_handle_dev_for_group(NULL, ucmd_ctx, TEST_DISK_DEVID, KV_KEY_DOM_ALIAS, KV_NS_MODULE, "devno", "8_0", KV_OP_PLUS),
+		0);
+
+	for (i = 0; i < TEST_NR_KEYS; i++) {
+		snprintf(core, sizeof(core), "KEY%d", i);
+		snprintf(value, sizeof(value), "VALUE%d", i);
+		_set_disk_kv(ucmd_ctx, core, value);
+	}
+
+	sysfs_reads = 0;
+	*state      = ucmd_ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	ucmd_fixture_ctx_destroy(*state);
+	return 0;
+}
+
+static int group_setup(void **state)
+{
+	_create_fake_sysfs();
+	return 0;
+}
+
+static int group_teardown(void **state)
+{
+	_destroy_fake_sysfs();
+	return 0;
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_part_get_disk_kv_cached, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_part_get_whole_disk_small_buf, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, group_setup, group_teardown);
+}
@@ -0,0 +1,332 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "../src/modules/ucmd/type/dm/dm.c"
+#include "ucmd-module.h"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+#include <time.h>
+
+#include <cmocka.h>
+
+#define TEST_MOD_NAME       "dm"
+#define TEST_DEV_PATH       "/devices/virtual/block/dm-0"
+#define TEST_DEV_MAJOR      253
+#define TEST_DEV_ID         "test_dev_id"
+#define TEST_CONTROL_FD     1000
+#define TEST_NAME           "vg-lv"
+#define TEST_UUID           "LVM-test"
+#define TEST_SYSFS_NAME     "sysfs-vg-lv"
+#define TEST_SYSFS_UUID     "LVM-sysfs-test"
+#define TEST_BENCH_NR_DEVS  10000
+#define TEST_DEV_ID_SIZE    16
+
+static char  fake_sysfs_root[] = "/tmp/sid-test-sysfs-XXXXXX";
+static int   sysfs_reads;
+static int   ioctl_calls;
+static int   ioctl_errno;
+static bool  ioctl_suspended;
+static __u32 ioctl_event_nr;
+static char *fake_mod = TEST_MOD_NAME;
+
+int __real_sid_util_sysfs_get_value(const char *path, char *buf, size_t buf_size);
+
+/* Redirect sysfs reads to the fake sysfs root and count them. */
+int __wrap_sid_util_sysfs_get_value(const char *path, char *buf, size_t buf_size)
+{
+	char fake_path[PATH_MAX];
+
+	assert_int_equal(strncmp(path, SYSTEM_SYSFS_PATH, sizeof(SYSTEM_SYSFS_PATH) - 1), 0);
+	snprintf(fake_path, sizeof(fake_path), "%s%s", fake_sysfs_root, path + sizeof(SYSTEM_SYSFS_PATH) - 1);
+	sysfs_reads++;
+
+	return __real_sid_util_sysfs_get_value(fake_path, buf, buf_size);
+}
+
+/* Answer DM_DEV_STATUS on the fake control fd like the kernel would for any minor number. */
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+	struct dm_ioctl *dmi;
+	va_list          ap;
+
+	va_start(ap, request);
+	dmi = va_arg(ap, struct dm_ioctl *);
+	va_end(ap);
+
+	assert_int_equal(fd, TEST_CONTROL_FD);
+	assert_int_equal(request, DM_DEV_STATUS);
+	assert_int_equal(dmi->version[0], DM_VERSION_MAJOR);
+	assert_int_equal(dmi->data_size, sizeof(*dmi));
+	assert_int_equal(major(dmi->dev), TEST_DEV_MAJOR);
+	ioctl_calls++;
+
+	if (ioctl_errno) {
+		errno = ioctl_errno;
+		return -1;
+	}
+
+	snprintf(dmi->name, sizeof(dmi->name), "%s%u", TEST_NAME, minor(dmi->dev));
+	snprintf(dmi->uuid, sizeof(dmi->uuid), "%s%u", TEST_UUID, minor(dmi->dev));
+	dmi->flags      = DM_READONLY_FLAG | (ioctl_suspended ? DM_SUSPEND_FLAG : 0);
+	dmi->open_count = 2;
+	dmi->event_nr   = ioctl_event_nr;
+
+	return 0;
+}
+
+static void _write_sysfs_attr(const char *attr, const char *value)
+{
+	char  path[PATH_MAX];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s%s/%s", fake_sysfs_root, TEST_DEV_PATH, attr);
+	assert_non_null(f = fopen(path, "w"));
+	fprintf(f, "%s\n", value);
+	fclose(f);
+}
+
+static void _remove_sysfs_path(const char *path)
+{
+	char full_path[PATH_MAX];
+
+	snprintf(full_path, sizeof(full_path), "%s%s", fake_sysfs_root, path);
+	assert_int_equal(remove(full_path), 0);
+}
+
+static void _create_fake_sysfs(void)
+{
+	static const char *const dirs[] =
+		{"/devices", "/devices/virtual", "/devices/virtual/block", TEST_DEV_PATH, TEST_DEV_PATH "/dm"};
+	char   path[PATH_MAX];
+	size_t i;
+
+	strcpy(fake_sysfs_root, "/tmp/sid-test-sysfs-XXXXXX");
+	assert_non_null(mkdtemp(fake_sysfs_root));
+
+	for (i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+		snprintf(path, sizeof(path), "%s%s", fake_sysfs_root, dirs[i]);
+		assert_int_equal(mkdir(path, 0755), 0);
+	}
+
+	_write_sysfs_attr("dm/name", TEST_SYSFS_NAME);
+	_write_sysfs_attr("dm/uuid", TEST_SYSFS_UUID);
+	_write_sysfs_attr("dm/suspended", "1");
+	_write_sysfs_attr("ro", "0");
+}
+
+static void _destroy_fake_sysfs(void)
+{
+	_remove_sysfs_path(TEST_DEV_PATH "/dm/name");
+	_remove_sysfs_path(TEST_DEV_PATH "/dm/uuid");
+	_remove_sysfs_path(TEST_DEV_PATH "/dm/suspended");
+	_remove_sysfs_path(TEST_DEV_PATH "/ro");
+	_remove_sysfs_path(TEST_DEV_PATH "/dm");
+	_remove_sysfs_path(TEST_DEV_PATH);
+	_remove_sysfs_path("/devices/virtual/block");
+	_remove_sysfs_path("/devices/virtual");
+	_remove_sysfs_path("/devices");
+	assert_int_equal(rmdir(fake_sysfs_root), 0);
+}
+
+struct test_ctx {
+	struct sid_ucmd_ctx *ucmd_ctx;
+	struct dm_mod_ctx    dm_mod;
+};
+
+static int setup(void **state)
+{
+	struct test_ctx *ctx;
+
+	_create_fake_sysfs();
+
+	assert_non_null(ctx = mem_zalloc(sizeof(*ctx)));
+	ctx->ucmd_ctx                         = ucmd_fixture_ctx_create();
+	ctx->ucmd_ctx->req_env.dev.uid_s      = TEST_DEV_ID;
+	ctx->ucmd_ctx->req_env.dev.udev.path  = TEST_DEV_PATH;
+	ctx->ucmd_ctx->req_env.dev.udev.name  = "dm-0";
+	ctx->ucmd_ctx->req_env.dev.udev.major = TEST_DEV_MAJOR;
+	ctx->ucmd_ctx->req_env.dev.udev.minor = 0;
+
+	ctx->dm_mod.control_fd                = TEST_CONTROL_FD;
+
+	sysfs_reads                           = 0;
+	ioctl_calls                           = 0;
+	ioctl_errno                           = 0;
+	ioctl_suspended                       = false;
+	ioctl_event_nr                        = 1;
+
+	*state                                = ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	ucmd_fixture_ctx_destroy(ctx->ucmd_ctx);
+	free(ctx);
+
+	_destroy_fake_sysfs();
+	return 0;
+}
+
+static void test_dev_info_ioctl(void **state)
+{
+	struct test_ctx   *ctx = *state;
+	struct dm_dev_info info;
+
+	ioctl_suspended = true;
+	ioctl_event_nr  = 42;
+
+	assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &info), 0);
+	assert_string_equal(info.name, TEST_NAME "0");
+	assert_string_equal(info.uuid, TEST_UUID "0");
+	assert_true(info.suspended);
+	assert_true(info.readonly);
+	assert_int_equal(info.event_nr, 42);
+	assert_true(info.event_nr_valid);
+
+	assert_int_equal(ioctl_calls, 1);
+	assert_int_equal(sysfs_reads, 0);
+}
+
+static void _check_sysfs_info(struct dm_dev_info *info)
+{
+	assert_string_equal(info->name, TEST_SYSFS_NAME);
+	assert_string_equal(info->uuid, TEST_SYSFS_UUID);
+	assert_true(info->suspended);
+	assert_false(info->readonly);
+	assert_false(info->event_nr_valid);
+	assert_int_equal(sysfs_reads, 4);
+}
+
+static void test_dev_info_ioctl_fail(void **state)
+{
+	struct test_ctx   *ctx = *state;
+	struct dm_dev_info info;
+
+	ioctl_errno = ENXIO;
+
+	assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &info), 0);
+	assert_int_equal(ioctl_calls, 1);
+	_check_sysfs_info(&info);
+}
+
+static void test_dev_info_no_control(void **state)
+{
+	struct test_ctx   *ctx = *state;
+	struct dm_dev_info info;
+
+	ctx->dm_mod.control_fd = -1;
+
+	assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &info), 0);
+	assert_int_equal(ioctl_calls, 0);
+	_check_sysfs_info(&info);
+}
+
+static void _check_event_nr_kv(struct sid_ucmd_ctx *ucmd_ctx, const char *event_nr)
+{
+	const char *value;
+
+	value = sid_ucmd_get_kv((struct module *) fake_mod, ucmd_ctx, KV_NS_DEVMOD, DM_X_EVENT_NR, NULL, NULL);
+
+	if (event_nr)
+		assert_string_equal(value, event_nr);
+	else
+		assert_null(value);
+}
+
+static void test_event_nr(void **state)
+{
+	struct test_ctx   *ctx    = *state;
+	struct module     *module = (struct module *) fake_mod;
+	struct dm_dev_info dev;
+
+	assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &dev), 0);
+	_set_event_nr(module, ctx->ucmd_ctx, &dev);
+	_check_event_nr_kv(ctx->ucmd_ctx, "1");
+
+	/* CHANGE without a table change */
+	assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &dev), 0);
+	_set_event_nr(module, ctx->ucmd_ctx, &dev);
+	_check_event_nr_kv(ctx->ucmd_ctx, "1");
+
+	ioctl_event_nr = 2;
+	assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &dev), 0);
+	_set_event_nr(module, ctx->ucmd_ctx, &dev);
+	_check_event_nr_kv(ctx->ucmd_ctx, "2");
+
+	/* without the event number, the last known one is kept */
+	ctx->dm_mod.control_fd = -1;
+	assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &dev), 0);
+	_set_event_nr(module, ctx->ucmd_ctx, &dev);
+	_check_event_nr_kv(ctx->ucmd_ctx, "2");
+}
+
+static double _bench_ident(struct test_ctx *ctx, char (*dev_ids)[TEST_DEV_ID_SIZE])
+{
+	struct module     *module = (struct module *) fake_mod;
+	struct dm_dev_info dev;
+	struct timespec    start, end;
+	unsigned           i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < TEST_BENCH_NR_DEVS; i++) {
+		ctx->ucmd_ctx->req_env.dev.uid_s      = dev_ids[i];
+		ctx->ucmd_ctx->req_env.dev.udev.minor = i;
+		assert_int_equal(_get_dev_info(&ctx->dm_mod, ctx->ucmd_ctx, &dev), 0);
+		_set_event_nr(module, ctx->ucmd_ctx, &dev);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * Device information and event number handling in ident for TEST_BENCH_NR_DEVS devices.
+ * The ioctl is mocked so this shows the cost on our side, sysfs fallback reads files.
+ */
+static void test_ident_bench(void **state)
+{
+	struct test_ctx *ctx = *state;
+	char           (*dev_ids)[TEST_DEV_ID_SIZE];
+	double           secs_ioctl, secs_sysfs;
+	unsigned         i;
+
+	assert_non_null(dev_ids = calloc(TEST_BENCH_NR_DEVS, TEST_DEV_ID_SIZE));
+	for (i = 0; i < TEST_BENCH_NR_DEVS; i++)
+		snprintf(dev_ids[i], TEST_DEV_ID_SIZE, "dev%05u", i);
+
+	secs_ioctl = _bench_ident(ctx, dev_ids);
+	assert_int_equal(ioctl_calls, TEST_BENCH_NR_DEVS);
+	assert_int_equal(sysfs_reads, 0);
+
+	ctx->dm_mod.control_fd = -1;
+	secs_sysfs             = _bench_ident(ctx, dev_ids);
+	assert_int_equal(sysfs_reads, 4 * TEST_BENCH_NR_DEVS);
+
+	print_message("dm ident: %u devices, ioctl %.3f s, sysfs %.3f s\n", TEST_BENCH_NR_DEVS, secs_ioctl, secs_sysfs);
+
+	ctx->ucmd_ctx->req_env.dev.uid_s = TEST_DEV_ID;
+	free(dev_ids);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_dev_info_ioctl, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_dev_info_ioctl_fail, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_dev_info_no_control, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_event_nr, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_ident_bench, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
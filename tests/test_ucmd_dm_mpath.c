@@ -0,0 +1,239 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "../src/modules/ucmd/block/dm_mpath/dm_mpath.c"
+#include "ucmd-module.h"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_MOD_NAME     "dm_mpath"
+#define TEST_NR_PATHS     8
+#define TEST_NR_CHANGES   5
+#define TEST_WWID         "3600508b400105e210000900000490000"
+#define TEST_OTHER_WWID   "3600508b400105e210000900000490001"
+#define TEST_DEV_ID_SIZE  16
+#define TEST_DEV_NUM_SIZE 16
+
+static char  fake_etc[]    = "/tmp/sid-test-mpath-XXXXXX";
+static char  gen_paths[MPATH_NR_GEN_FILES][PATH_MAX];
+static int   is_path_calls;
+static int   is_path_result;
+static char *is_path_wwid;
+static char *fake_mod = TEST_MOD_NAME;
+
+struct test_path {
+	struct sid_ucmd_ctx ucmd_ctx;
+	char                dev_id[TEST_DEV_ID_SIZE];
+	char                dev_num[TEST_DEV_NUM_SIZE];
+	char                dev_name[TEST_DEV_ID_SIZE];
+};
+
+struct test_ctx {
+	struct sid_ucmd_common_ctx *common;
+	struct test_path            paths[TEST_NR_PATHS];
+};
+
+int __wrap_mpathvalid_init(int verbosity, int log_style)
+{
+	return 0;
+}
+
+int __wrap_mpathvalid_exit(void)
+{
+	return 0;
+}
+
+int __wrap_mpathvalid_reload_config(void)
+{
+	return 0;
+}
+
+int __wrap_mpathvalid_is_path(const char *name, unsigned int mode, char **wwid, const char **path_wwids, unsigned int nr_paths)
+{
+	is_path_calls++;
+	*wwid = is_path_wwid ? strdup(is_path_wwid) : NULL;
+	return is_path_result;
+}
+
+static void _touch(const char *path, time_t mtime)
+{
+	struct timespec times[2] = {{.tv_sec = mtime}, {.tv_sec = mtime}};
+
+	assert_int_equal(utimensat(AT_FDCWD, path, times, 0), 0);
+}
+
+static int setup(void **state)
+{
+	struct test_ctx  *ctx;
+	struct test_path *path;
+	FILE             *f;
+	unsigned          i;
+
+	strcpy(fake_etc, "/tmp/sid-test-mpath-XXXXXX");
+	assert_non_null(mkdtemp(fake_etc));
+
+	for (i = 0; i < MPATH_NR_GEN_FILES; i++) {
+		snprintf(gen_paths[i], sizeof(gen_paths[i]), "%s/gen%u", fake_etc, i);
+		mpath_gen_files[i] = gen_paths[i];
+	}
+
+	/* config and wwids file exist, conf.d does not */
+	assert_non_null(f = fopen(gen_paths[0], "w"));
+	fclose(f);
+	assert_non_null(f = fopen(gen_paths[2], "w"));
+	fclose(f);
+	_touch(gen_paths[0], 1000);
+	_touch(gen_paths[2], 1000);
+
+	assert_non_null(ctx = mem_zalloc(sizeof(*ctx)));
+	ctx->common = ucmd_fixture_common_ctx_create();
+
+	for (i = 0; i < TEST_NR_PATHS; i++) {
+		path = &ctx->paths[i];
+		snprintf(path->dev_id, sizeof(path->dev_id), "dev_id_%u", i);
+		snprintf(path->dev_num, sizeof(path->dev_num), "8_%u", i * 16);
+		snprintf(path->dev_name, sizeof(path->dev_name), "sd%c", 'a' + i);
+
+		ucmd_fixture_ctx_init(&path->ucmd_ctx, ctx->common);
+		path->ucmd_ctx.req_env.dev.uid_s      = path->dev_id;
+		path->ucmd_ctx.req_env.dev.num_s      = path->dev_num;
+		path->ucmd_ctx.req_env.dev.udev.name  = path->dev_name;
+		path->ucmd_ctx.req_env.dev.udev.type  = UDEV_DEVTYPE_DISK;
+		path->ucmd_ctx.req_env.dev.udev.major = 8;
+		path->ucmd_ctx.req_env.dev.udev.minor = i * 16;
+
+		assert_non_null(sid_ucmd_set_kv((struct module *) fake_mod,
+		                                &path->ucmd_ctx,
+		                                KV_NS_UDEV,
+		                                U_ID_SERIAL,
+		                                TEST_WWID,
+		                                sizeof(TEST_WWID),
+		                                KV_RD));
+	}
+
+	is_path_calls  = 0;
+	is_path_result = MPATH_IS_VALID;
+	is_path_wwid   = TEST_WWID;
+
+	*state = ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_ctx *ctx = *state;
+	unsigned         i;
+
+	for (i = 0; i < TEST_NR_PATHS; i++)
+		ucmd_fixture_ctx_cleanup(&ctx->paths[i].ucmd_ctx);
+
+	ucmd_fixture_common_ctx_destroy(ctx->common);
+	free(ctx);
+
+	for (i = 0; i < MPATH_NR_GEN_FILES; i++)
+		(void) remove(gen_paths[i]);
+	assert_int_equal(rmdir(fake_etc), 0);
+	return 0;
+}
+
+static void _scan_path(struct test_ctx *ctx, unsigned idx, const char *expected_dev_path)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = &ctx->paths[idx].ucmd_ctx;
+	const char          *value;
+
+	assert_int_equal(_dm_mpath_scan_next((struct module *) fake_mod, ucmd_ctx), 0);
+	assert_non_null(value = sid_ucmd_get_kv((struct module *) fake_mod, ucmd_ctx, KV_NS_UDEV, U_DEV_PATH, NULL, NULL));
+	assert_string_equal(value, expected_dev_path);
+	assert_non_null(value = sid_ucmd_get_kv((struct module *) fake_mod, ucmd_ctx, KV_NS_DEVMOD, X_WWID, NULL, NULL));
+	assert_string_equal(value, TEST_WWID);
+}
+
+static void _scan_all_paths(struct test_ctx *ctx, const char *expected_dev_path)
+{
+	unsigned i;
+
+	for (i = 0; i < TEST_NR_PATHS; i++)
+		_scan_path(ctx, i, expected_dev_path);
+}
+
+static void test_mpath_cache_paths_and_changes(void **state)
+{
+	struct test_ctx *ctx = *state;
+	unsigned         i;
+
+	/* ADD of all paths */
+	_scan_all_paths(ctx, "1");
+	assert_int_equal(is_path_calls, 1);
+
+	/* CHANGE events */
+	for (i = 0; i < TEST_NR_CHANGES; i++)
+		_scan_all_paths(ctx, "1");
+	assert_int_equal(is_path_calls, 1);
+}
+
+static void test_mpath_cache_invalidate(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	_scan_all_paths(ctx, "1");
+	assert_int_equal(is_path_calls, 1);
+
+	/* wwids file changed */
+	_touch(gen_paths[2], 2000);
+	_scan_all_paths(ctx, "1");
+	assert_int_equal(is_path_calls, 2);
+
+	/* config changed, the result changes too */
+	_touch(gen_paths[0], 2000);
+	is_path_result = MPATH_IS_NOT_VALID;
+	_scan_all_paths(ctx, "0");
+	assert_int_equal(is_path_calls, 3);
+
+	/* config replaced by a new file with the same mtime */
+	assert_int_equal(rename(gen_paths[2], gen_paths[0]), 0);
+	_scan_path(ctx, 0, "0");
+	assert_int_equal(is_path_calls, 4);
+
+	/* conf.d created */
+	assert_int_equal(mkdir(gen_paths[1], 0755), 0);
+	_scan_all_paths(ctx, "0");
+	assert_int_equal(is_path_calls, 5);
+}
+
+static void test_mpath_cache_not_used(void **state)
+{
+	struct test_ctx *ctx = *state;
+
+	/* multipath WWID different from ID_SERIAL */
+	is_path_wwid = TEST_OTHER_WWID;
+	assert_int_equal(_dm_mpath_scan_next((struct module *) fake_mod, &ctx->paths[0].ucmd_ctx), 0);
+	assert_int_equal(_dm_mpath_scan_next((struct module *) fake_mod, &ctx->paths[1].ucmd_ctx), 0);
+	assert_int_equal(is_path_calls, 2);
+
+	/* MPATH_IS_MAYBE is not cached */
+	is_path_wwid   = TEST_WWID;
+	is_path_result = MPATH_IS_MAYBE;
+	assert_int_equal(_dm_mpath_scan_next((struct module *) fake_mod, &ctx->paths[0].ucmd_ctx), 0);
+	assert_int_equal(_dm_mpath_scan_next((struct module *) fake_mod, &ctx->paths[1].ucmd_ctx), 0);
+	assert_int_equal(is_path_calls, 4);
+}
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_mpath_cache_paths_and_changes, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_mpath_cache_invalidate, setup, teardown),
+		cmocka_unit_test_setup_teardown(test_mpath_cache_not_used, setup, teardown),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
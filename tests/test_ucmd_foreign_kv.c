@@ -0,0 +1,319 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "bench.h"
+#include "ucmd-module.h"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_MOD_A       "mod_a"
+#define TEST_MOD_B       "mod_b"
+#define TEST_DEV_ID      "test_dev_id"
+#define TEST_KEY         "TEST_KEY"
+#define TEST_NR_LOOKUPS  1000
+#define TEST_NR_ROUNDS   100
+#define TEST_MOD_A_INDEX 0
+#define TEST_MOD_B_INDEX 1
+
+/* Module names double as fake module handles. */
+static char *test_mods[] = {TEST_MOD_A, TEST_MOD_B};
+
+#define TEST_MOD(idx) ((struct module *) test_mods[idx])
+
+static const char *
+	_get_foreign_dev_kv(struct sid_ucmd_ctx *ucmd_ctx, int mod_idx, size_t *value_size, sid_ucmd_kv_flags_t *flags)
+{
+	return sid_ucmd_get_foreign_dev_kv(TEST_MOD(mod_idx), ucmd_ctx, TEST_DEV_ID, KV_NS_DEVICE, TEST_KEY, value_size, flags);
+}
+
+static void _check_foreign_dev_kv(struct sid_ucmd_ctx *ucmd_ctx, const char *value)
+{
+	const char         *data;
+	size_t              size  = 0;
+	sid_ucmd_kv_flags_t flags = 0;
+
+	data = _get_foreign_dev_kv(ucmd_ctx, TEST_MOD_B_INDEX, &size, &flags);
+
+	if (!value) {
+		assert_null(data);
+		return;
+	}
+
+	assert_non_null(data);
+	assert_string_equal(data, value);
+	assert_int_equal(size, strlen(value) + 1);
+	assert_true(flags & KV_MOD_RD);
+}
+
+static void _set_kv(struct sid_ucmd_ctx *ucmd_ctx, const char *value)
+{
+	assert_non_null(sid_ucmd_set_kv(TEST_MOD(TEST_MOD_A_INDEX),
+	                                ucmd_ctx,
+	                                KV_NS_DEVICE,
+	                                TEST_KEY,
+	                                value ?: SID_UCMD_KV_UNSET,
+	                                value ? strlen(value) + 1 : 0,
+	                                KV_MOD_RD));
+}
+
+/*
+ * Write the record directly to KV store, bypassing sid_ucmd_set_kv, as group,
+ * delta, alias and reservation updates do. NULL value unsets the record.
+ */
+static void _store_kv(struct sid_ucmd_ctx *ucmd_ctx, const char *value)
+{
+	struct kv_key_spec  key_spec = {.op      = KV_OP_SET,
+	                                .dom     = KV_KEY_DOM_USER,
+	                                .ns      = KV_NS_DEVICE,
+	                                .ns_part = TEST_DEV_ID,
+	                                .id_cat  = ID_NULL,
+	                                .id      = ID_NULL,
+	                                .core    = TEST_KEY};
+	sid_ucmd_kv_flags_t flags    = KV_MOD_RD;
+	kv_vector_t         vvalue[VVALUE_SINGLE_CNT];
+	char               *key;
+
+	assert_non_null(key = _compose_key(ucmd_ctx->common->gen_buf, &key_spec));
+
+	if (value) {
+		VVALUE_HEADER_PREP(vvalue, ucmd_ctx->req_env.dev.udev.seqnum, flags, ucmd_ctx->common->gennum, TEST_MOD_A);
+		VVALUE_DATA_PREP(vvalue, 0, value, strlen(value) + 1);
+		assert_non_null(kv_store_set_value(ucmd_ctx->common->kv_store_res,
+		                                   key,
+		                                   vvalue,
+		                                   VVALUE_SINGLE_CNT,
+		                                   KV_STORE_VALUE_VECTOR,
+		                                   KV_STORE_VALUE_OP_MERGE,
+		                                   NULL,
+		                                   NULL));
+	} else
+		assert_int_equal(kv_store_unset(ucmd_ctx->common->kv_store_res, key, NULL, NULL), 0);
+
+	_destroy_key(ucmd_ctx->common->gen_buf, key);
+}
+
+static void test_foreign_kv_missing(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+
+	_check_foreign_dev_kv(ucmd_ctx, NULL);
+	_check_foreign_dev_kv(ucmd_ctx, NULL);
+
+	/* negative result must not hide a record set afterwards */
+	_set_kv(ucmd_ctx, "value1");
+	_check_foreign_dev_kv(ucmd_ctx, "value1");
+}
+
+static void test_foreign_kv_set_coherency(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+
+	_set_kv(ucmd_ctx, "value1");
+	_check_foreign_dev_kv(ucmd_ctx, "value1");
+	_check_foreign_dev_kv(ucmd_ctx, "value1");
+
+	_set_kv(ucmd_ctx, "value2");
+	_check_foreign_dev_kv(ucmd_ctx, "value2");
+
+	_set_kv(ucmd_ctx, NULL);
+	_check_foreign_dev_kv(ucmd_ctx, NULL);
+
+	_set_kv(ucmd_ctx, "value3");
+	_check_foreign_dev_kv(ucmd_ctx, "value3");
+}
+
+static void test_foreign_kv_store_coherency(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+
+	/* cached value is freed when replaced, it must not be returned anymore */
+	_set_kv(ucmd_ctx, "value1");
+	_check_foreign_dev_kv(ucmd_ctx, "value1");
+	_store_kv(ucmd_ctx, "value2");
+	_check_foreign_dev_kv(ucmd_ctx, "value2");
+
+	_store_kv(ucmd_ctx, NULL);
+	_check_foreign_dev_kv(ucmd_ctx, NULL);
+
+	/* negative result must not hide a record written through any path */
+	_store_kv(ucmd_ctx, "value3");
+	_check_foreign_dev_kv(ucmd_ctx, "value3");
+}
+
+static void test_foreign_kv_rollback(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+
+	_set_kv(ucmd_ctx, "value1");
+	_check_foreign_dev_kv(ucmd_ctx, "value1");
+
+	assert_int_equal(kv_store_transaction_begin(ucmd_ctx->common->kv_store_res), 0);
+	_set_kv(ucmd_ctx, "value2");
+	_check_foreign_dev_kv(ucmd_ctx, "value2");
+	kv_store_transaction_end(ucmd_ctx->common->kv_store_res, true);
+
+	_check_foreign_dev_kv(ucmd_ctx, "value1");
+}
+
+static void test_foreign_kv_owner(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+	const char          *data;
+
+	assert_non_null(sid_ucmd_set_kv(TEST_MOD(TEST_MOD_A_INDEX),
+	                                ucmd_ctx,
+	                                KV_NS_DEVICE,
+	                                TEST_KEY,
+	                                "private",
+	                                sizeof("private"),
+	                                KV_FLAGS_UNSET));
+
+	/* the owner can read its own record, but the other module must not see it, even if cached */
+	assert_non_null(data = _get_foreign_dev_kv(ucmd_ctx, TEST_MOD_A_INDEX, NULL, NULL));
+	assert_string_equal(data, "private");
+	_check_foreign_dev_kv(ucmd_ctx, NULL);
+}
+
+static void test_foreign_kv_repeated(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+	const char          *first, *data;
+	int                  i;
+
+	_set_kv(ucmd_ctx, "value1");
+	assert_non_null(first = _get_foreign_dev_kv(ucmd_ctx, TEST_MOD_B_INDEX, NULL, NULL));
+
+	for (i = 0; i < TEST_NR_LOOKUPS; i++) {
+		data = _get_foreign_dev_kv(ucmd_ctx, TEST_MOD_B_INDEX, NULL, NULL);
+		assert_ptr_equal(data, first);
+	}
+
+	assert_non_null(_foreign_kv_cache_lookup(ucmd_ctx,
+	                                         TEST_MOD_B,
+	                                         &((struct kv_key_spec) {.op      = KV_OP_SET,
+	                                                                 .dom     = KV_KEY_DOM_USER,
+	                                                                 .ns      = KV_NS_DEVICE,
+	                                                                 .ns_part = TEST_DEV_ID,
+	                                                                 .id_cat  = ID_NULL,
+	                                                                 .id      = ID_NULL,
+	                                                                 .core    = TEST_KEY})));
+}
+
+static void test_foreign_kv_scan_memo_dep(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+
+	/* result of the scan is going to be memoized */
+	ucmd_ctx->req_cat        = MSG_CATEGORY_CLIENT;
+	ucmd_ctx->req_hdr.cmd    = SID_CMD_SCAN;
+	ucmd_ctx->scan.memo_hash = 1;
+
+	/* the device's own records looked up */
+	_check_foreign_dev_kv(ucmd_ctx, NULL);
+	assert_false(ucmd_ctx->scan.foreign);
+
+	/* the result depends on other device's records now */
+	assert_null(sid_ucmd_get_foreign_dev_kv(TEST_MOD(TEST_MOD_B_INDEX),
+	                                        ucmd_ctx,
+	                                        "other_dev_id",
+	                                        KV_NS_DEVICE,
+	                                        TEST_KEY,
+	                                        NULL,
+	                                        NULL));
+	assert_true(ucmd_ctx->scan.foreign);
+}
+
+/*
+ * Synthetic module looking up the same foreign record repeatedly, with and without the cache.
+ * Without the cache, each lookup composes the key and walks the KV store.
+ */
+static void test_foreign_kv_bench(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = *state;
+	struct kv_key_spec   key_spec = {.op      = KV_OP_SET,
+	                                 .dom     = KV_KEY_DOM_USER,
+	                                 .ns      = KV_NS_DEVICE,
+	                                 .ns_part = TEST_DEV_ID,
+	                                 .id_cat  = ID_NULL,
+	                                 .id      = ID_NULL,
+	                                 .core    = TEST_KEY};
+	struct bench         bench_uncached, bench_cached;
+	size_t               size;
+	sid_ucmd_kv_flags_t  flags;
+	char                 core[16];
+	int                  i, j;
+
+	/* other records in the store */
+	for (i = 0; i < TEST_NR_LOOKUPS; i++) {
+		snprintf(core, sizeof(core), "KEY_%d", i);
+		assert_non_null(sid_ucmd_set_kv(TEST_MOD(TEST_MOD_A_INDEX), ucmd_ctx, KV_NS_DEVICE, core, "x", 2, KV_MOD_RD));
+	}
+	_set_kv(ucmd_ctx, "value1");
+
+	bench_init(&bench_uncached, "foreign_kv_uncached");
+	bench_start(&bench_uncached);
+	for (i = 0; i < TEST_NR_ROUNDS; i++) {
+		for (j = 0; j < TEST_NR_LOOKUPS; j++)
+			assert_non_null(_cmd_get_key_spec_value(TEST_MOD(TEST_MOD_B_INDEX), ucmd_ctx, &key_spec, &size, &flags));
+	}
+	bench_stop(&bench_uncached, TEST_NR_ROUNDS * TEST_NR_LOOKUPS);
+	assert_int_equal(bench_report(&bench_uncached), 0);
+
+	bench_init(&bench_cached, "foreign_kv_cached");
+	bench_start(&bench_cached);
+	for (i = 0; i < TEST_NR_ROUNDS; i++) {
+		for (j = 0; j < TEST_NR_LOOKUPS; j++)
+			assert_non_null(_get_foreign_dev_kv(ucmd_ctx, TEST_MOD_B_INDEX, &size, &flags));
+	}
+	bench_stop(&bench_cached, TEST_NR_ROUNDS * TEST_NR_LOOKUPS);
+	assert_int_equal(bench_report(&bench_cached), 0);
+
+	print_message("foreign kv: %.0f ns per lookup without cache, %.0f ns per lookup with cache\n",
+	              (double) bench_uncached.nsec / (TEST_NR_ROUNDS * TEST_NR_LOOKUPS),
+	              (double) bench_cached.nsec / (TEST_NR_ROUNDS * TEST_NR_LOOKUPS));
+
+	bench_destroy(&bench_uncached);
+	bench_destroy(&bench_cached);
+}
+
+static int setup(void **state)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = ucmd_fixture_ctx_create();
+
+	ucmd_ctx->req_env.dev.uid_s = TEST_DEV_ID;
+	*state                      = ucmd_ctx;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	ucmd_fixture_ctx_destroy(*state);
+	return 0;
+}
+
+#define setup_test(func) cmocka_unit_test_setup_teardown((func), setup, teardown)
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		setup_test(test_foreign_kv_missing),
+		setup_test(test_foreign_kv_set_coherency),
+		setup_test(test_foreign_kv_store_coherency),
+		setup_test(test_foreign_kv_rollback),
+		setup_test(test_foreign_kv_owner),
+		setup_test(test_foreign_kv_repeated),
+		setup_test(test_foreign_kv_scan_memo_dep),
+		setup_test(test_foreign_kv_bench),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
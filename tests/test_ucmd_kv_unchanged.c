@@ -0,0 +1,280 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "bench.h"
+#include "ucmd-module.h"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_MOD              "mod_a"
+#define TEST_DEV_ID           "test_dev_id"
+#define TEST_KEY              "TEST_KEY"
+#define TEST_VALUE1           "foo"
+#define TEST_VALUE2           "bar"
+#define TEST_BENCH_NR_KEYS    32
+#define TEST_BENCH_NR_EVENTS  2000
+#define TEST_BENCH_KEY_SIZE   32
+#define TEST_BENCH_VALUE_SIZE 32
+
+/* Module name doubles as fake module handle. */
+#define TEST_MOD_HANDLE       ((struct module *) TEST_MOD)
+
+/* Same flags as used for the scan command which syncs its records with main KV store. */
+static const struct cmd_reg test_cmd_reg = {.flags = CMD_KV_EXPORT_UDEV_TO_RESBUF | CMD_KV_EXPORT_SID_TO_EXPBUF |
+                                                     CMD_KV_EXPBUF_TO_MAIN | CMD_KV_EXPORT_SYNC};
+
+static int _init_fake_command(sid_resource_t *res, const void *kickstart_data, void **data)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = ucmd_fixture_ctx_create();
+
+	ucmd_ctx->req_env.dev.uid_s = TEST_DEV_ID;
+	*data                       = ucmd_ctx;
+	return 0;
+}
+
+static int _destroy_fake_command(sid_resource_t *res)
+{
+	ucmd_fixture_ctx_destroy(sid_resource_get_data(res));
+	return 0;
+}
+
+const sid_resource_type_t sid_resource_type_fake_cmd = {
+	.name        = "fake_command",
+	.short_name  = "fake",
+	.description = "Fake ubridge command resource",
+	.init        = _init_fake_command,
+	.destroy     = _destroy_fake_command,
+};
+
+static void
+	_set_kv(sid_resource_t *cmd_res, sid_ucmd_kv_namespace_t ns, const char *key, const char *value, sid_ucmd_kv_flags_t flags)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	const char          *data;
+
+	assert_non_null(data = sid_ucmd_set_kv(TEST_MOD_HANDLE, ucmd_ctx, ns, key, value, strlen(value) + 1, flags));
+	assert_string_equal(data, value);
+}
+
+/*
+ * Export records like the worker does at the end of an event and return the number of
+ * records exported to main KV store. Then drop the sync index to start next event
+ * with a KV store in the same state as main KV store after the sync.
+ */
+static unsigned _sync(sid_resource_t *cmd_res, uint64_t seqnum, size_t *exp_size, size_t *res_size)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	kv_store_iter_t     *iter;
+	const char          *key;
+	char               **keys = NULL;
+	unsigned             i, nr_keys = 0, records = 0;
+
+	assert_int_equal(_build_cmd_kv_buffers(cmd_res, &test_cmd_reg), 0);
+
+	assert_non_null(iter = kv_store_iter_create_prefix(ucmd_ctx->common->kv_store_res,
+	                                                   KV_PREFIX_OP_SYNC_C,
+	                                                   sizeof(KV_PREFIX_OP_SYNC_C) - 1));
+	while (kv_store_iter_next(iter, NULL, &key, NULL)) {
+		assert_non_null(keys = realloc(keys, (nr_keys + 1) * sizeof(*keys)));
+		assert_non_null(keys[nr_keys++] = strdup(key));
+		if (_get_ns_from_key(key + 1) != KV_NS_UDEV)
+			records++;
+	}
+	kv_store_iter_destroy(iter);
+
+	for (i = 0; i < nr_keys; i++) {
+		assert_int_equal(kv_store_unset(ucmd_ctx->common->kv_store_res, keys[i], NULL, NULL), 0);
+		free(keys[i]);
+	}
+	free(keys);
+
+	if (exp_size)
+		*exp_size = sid_buffer_count(ucmd_ctx->exp_buf);
+	if (res_size)
+		*res_size = sid_buffer_count(ucmd_ctx->res_buf);
+
+	sid_buffer_destroy(ucmd_ctx->exp_buf);
+	ucmd_ctx->exp_buf = NULL;
+	assert_int_equal(sid_buffer_rewind(ucmd_ctx->res_buf, 0, SID_BUFFER_POS_ABS), 0);
+
+	/* next event */
+	ucmd_ctx->req_env.dev.udev.seqnum = seqnum + 1;
+	return records;
+}
+
+static void test_kv_unchanged_no_export(void **state)
+{
+	sid_resource_t *cmd_res = *state;
+	size_t          exp_size;
+
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 1, &exp_size, NULL), 1);
+	assert_true(exp_size > 0);
+
+	/* same value in a later event is not exported again... */
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 2, &exp_size, NULL), 0);
+	assert_int_equal(exp_size, 0);
+
+	/* ...even if it is set repeatedly within the event */
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_RD);
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 3, &exp_size, NULL), 0);
+	assert_int_equal(exp_size, 0);
+
+	/* a change is still exported, only once if set again within the event */
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE2, KV_SYNC_P | KV_MOD_RD);
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE2, KV_SYNC_P | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 4, NULL, NULL), 1);
+
+	/* setting back the old value is a change too */
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 5, NULL, NULL), 1);
+}
+
+static void test_kv_unchanged_flags(void **state)
+{
+	sid_resource_t *cmd_res = *state;
+
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 1, NULL, NULL), 1);
+
+	/* same data with different flags is a change */
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_WR);
+	assert_int_equal(_sync(cmd_res, 2, NULL, NULL), 1);
+
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC_P | KV_MOD_WR);
+	assert_int_equal(_sync(cmd_res, 3, NULL, NULL), 0);
+}
+
+static void test_kv_unchanged_sync_added(void **state)
+{
+	sid_resource_t *cmd_res = *state;
+
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 1, NULL, NULL), 0);
+
+	/* record which has never been synced gets KV_SYNC with the same data */
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 2, NULL, NULL), 1);
+
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE1, KV_SYNC | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 3, NULL, NULL), 0);
+
+	/* the same within the event, before the record is synced */
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE2, KV_MOD_RD);
+	_set_kv(cmd_res, KV_NS_DEVICE, TEST_KEY, TEST_VALUE2, KV_SYNC | KV_MOD_RD);
+	assert_int_equal(_sync(cmd_res, 4, NULL, NULL), 1);
+}
+
+static void test_kv_unchanged_udev(void **state)
+{
+	sid_resource_t *cmd_res = *state;
+	size_t          res_size1, res_size2;
+
+	/* udev records are returned to udev with each event, changed or not */
+	_set_kv(cmd_res, KV_NS_UDEV, TEST_KEY, TEST_VALUE1, KV_RD);
+	assert_int_equal(_sync(cmd_res, 1, NULL, &res_size1), 0);
+	assert_int_equal(res_size1, sizeof(TEST_KEY "=" TEST_VALUE1));
+
+	_set_kv(cmd_res, KV_NS_UDEV, TEST_KEY, TEST_VALUE1, KV_RD);
+	assert_int_equal(_sync(cmd_res, 2, NULL, &res_size2), 0);
+	assert_int_equal(res_size2, res_size1);
+}
+
+/*
+ * Storm of change events for the same device where each event sets all the
+ * properties again, but only one of them changes.
+ */
+static void test_kv_unchanged_bench(void **state)
+{
+	sid_resource_t *cmd_res = *state;
+	char            keys[TEST_BENCH_NR_KEYS][TEST_BENCH_KEY_SIZE];
+	char            value[TEST_BENCH_VALUE_SIZE];
+	struct bench    bench;
+	size_t          exp_size, exp_size_total = 0;
+	unsigned        records = 0;
+	uint64_t        event;
+	int             i;
+
+	for (i = 0; i < TEST_BENCH_NR_KEYS; i++)
+		snprintf(keys[i], sizeof(keys[i]), "KEY_%d", i);
+
+	/* initial add event */
+	for (i = 0; i < TEST_BENCH_NR_KEYS; i++) {
+		snprintf(value, sizeof(value), "value_%d", i);
+		_set_kv(cmd_res, KV_NS_DEVICE, keys[i], value, KV_SYNC_P | KV_MOD_RD);
+	}
+	assert_int_equal(_sync(cmd_res, 0, NULL, NULL), TEST_BENCH_NR_KEYS);
+
+	bench_init(&bench, "kv_change_storm");
+	bench_start(&bench);
+	for (event = 1; event <= TEST_BENCH_NR_EVENTS; event++) {
+		for (i = 0; i < TEST_BENCH_NR_KEYS; i++) {
+			if (i)
+				snprintf(value, sizeof(value), "value_%d", i);
+			else
+				snprintf(value, sizeof(value), "change_%" PRIu64, event);
+			_set_kv(cmd_res, KV_NS_DEVICE, keys[i], value, KV_SYNC_P | KV_MOD_RD);
+		}
+		records        += _sync(cmd_res, event, &exp_size, NULL);
+		exp_size_total += exp_size;
+	}
+	bench_stop(&bench, TEST_BENCH_NR_EVENTS);
+	assert_int_equal(bench_report(&bench), 0);
+	bench_destroy(&bench);
+
+	/* only the changed property is synced */
+	assert_int_equal(records, TEST_BENCH_NR_EVENTS);
+
+	print_message("kv change storm: %u keys per event, %.1f records and %.1f bytes exported per event\n",
+	              TEST_BENCH_NR_KEYS,
+	              (double) records / TEST_BENCH_NR_EVENTS,
+	              (double) exp_size_total / TEST_BENCH_NR_EVENTS);
+}
+
+static int setup(void **state)
+{
+	sid_resource_t *res;
+
+	res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                          &sid_resource_type_fake_cmd,
+	                          SID_RESOURCE_NO_FLAGS,
+	                          "fakecmd",
+	                          SID_RESOURCE_NO_PARAMS,
+	                          SID_RESOURCE_PRIO_NORMAL,
+	                          SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(res);
+	*state = res;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	sid_resource_unref(*state);
+	return 0;
+}
+
+#define setup_test(func) cmocka_unit_test_setup_teardown((func), setup, teardown)
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		setup_test(test_kv_unchanged_no_export),
+		setup_test(test_kv_unchanged_flags),
+		setup_test(test_kv_unchanged_sync_added),
+		setup_test(test_kv_unchanged_udev),
+		setup_test(test_kv_unchanged_bench),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,309 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "bench.h"
+#include "ucmd-module.h"
+#include "ucmd_fixture.h"
+
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_MOD                 "mod_a"
+#define TEST_DEV_NUM             "8_0"
+#define TEST_NR_KEYS             12
+#define TEST_NR_OPS              2000
+#define TEST_MAX_VALUE_LEN       24
+#define TEST_SEED                4242
+#define TEST_BENCH_NR_PROPERTIES 80
+#define TEST_BENCH_NR_REPLIES    20000
+#define TEST_KEY_SIZE            32
+#define TEST_VALUE_SIZE          64
+
+/* Module name doubles as fake module handle. */
+#define TEST_MOD_HANDLE          ((struct module *) TEST_MOD)
+
+/* Same flags as used for the scan command. */
+static const struct cmd_reg test_cmd_reg = {.flags = CMD_KV_EXPORT_UDEV_TO_RESBUF | CMD_KV_EXPORT_SID_TO_EXPBUF |
+                                                     CMD_KV_EXPBUF_TO_MAIN | CMD_KV_EXPORT_SYNC};
+
+static int _init_fake_command(sid_resource_t *res, const void *kickstart_data, void **data)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = ucmd_fixture_ctx_create();
+
+	ucmd_ctx->req_env.dev.num_s = TEST_DEV_NUM;
+	*data                       = ucmd_ctx;
+	return 0;
+}
+
+static int _destroy_fake_command(sid_resource_t *res)
+{
+	ucmd_fixture_ctx_destroy(sid_resource_get_data(res));
+	return 0;
+}
+
+const sid_resource_type_t sid_resource_type_fake_cmd = {
+	.name        = "fake_command",
+	.short_name  = "fake",
+	.description = "Fake ubridge command resource",
+	.init        = _init_fake_command,
+	.destroy     = _destroy_fake_command,
+};
+
+/* Set udev property from module, NULL value unsets it. */
+static void _set(struct sid_ucmd_ctx *ucmd_ctx, const char *key, const char *value)
+{
+	assert_non_null(sid_ucmd_set_kv(TEST_MOD_HANDLE,
+	                                ucmd_ctx,
+	                                KV_NS_UDEV,
+	                                key,
+	                                value ?: SID_UCMD_KV_UNSET,
+	                                value ? strlen(value) + 1 : 0,
+	                                KV_RD | KV_WR));
+}
+
+/* Set udev property as if it was imported from udev environment, it is not exported back. */
+static void _import(struct sid_ucmd_ctx *ucmd_ctx, const char *key, const char *value)
+{
+	assert_non_null(_do_sid_ucmd_set_kv(NULL, ucmd_ctx, NULL, KV_NS_UDEV, key, KV_RD | KV_WR, value, strlen(value) + 1));
+}
+
+/*
+ * Build udev export from scratch by iterating over KV store records marked for sync,
+ * the way the export used to be built for each response. Unset records are not exported.
+ */
+static void _build_fresh(struct sid_ucmd_ctx *ucmd_ctx, struct sid_buffer *buf)
+{
+	kv_store_iter_t *iter;
+	kv_scalar_t     *svalue;
+	const char      *key;
+	size_t           size, data_offset;
+
+	assert_non_null(iter = kv_store_iter_create_prefix(ucmd_ctx->common->kv_store_res,
+	                                                   KV_PREFIX_OP_SYNC_C,
+	                                                   sizeof(KV_PREFIX_OP_SYNC_C) - 1));
+
+	while ((svalue = kv_store_iter_next(iter, &size, &key, NULL))) {
+		if (_get_ns_from_key(key + 1) != KV_NS_UDEV)
+			continue;
+
+		data_offset = _svalue_ext_data_offset(svalue);
+		if (size <= sizeof(*svalue) + data_offset)
+			continue;
+
+		key = _get_key_part(key + 1, KEY_PART_CORE, NULL);
+		assert_int_equal(sid_buffer_fmt_add(buf, NULL, NULL, "%s" KV_PAIR_C "%s", key, svalue->data + data_offset), 0);
+	}
+
+	kv_store_iter_destroy(iter);
+}
+
+/* The block must be exactly what building the export from scratch gives, including the order. */
+static void _assert_block_matches(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	struct sid_buffer *buf;
+	const void        *data;
+	size_t             size;
+
+	assert_non_null(buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                                     .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                                     .mode    = SID_BUFFER_MODE_PLAIN}),
+	                                        &((struct sid_buffer_init) {.size = 0, .alloc_step = PATH_MAX, .limit = 0}),
+	                                        NULL));
+	_build_fresh(ucmd_ctx, buf);
+	assert_int_equal(sid_buffer_get_data(buf, &data, &size), 0);
+
+	assert_false(ucmd_ctx->udev_exp.failed);
+	assert_int_equal(ucmd_ctx->udev_exp.size, size);
+	if (size)
+		assert_memory_equal(ucmd_ctx->udev_exp.block, data, size);
+
+	sid_buffer_destroy(buf);
+}
+
+/* Build response the way the scan command does, return the udev part of it. */
+static void _build_reply(sid_resource_t *cmd_res, const void **data, size_t *size)
+{
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+
+	assert_int_equal(sid_buffer_rewind(ucmd_ctx->res_buf, 0, SID_BUFFER_POS_ABS), 0);
+	assert_int_equal(_build_cmd_kv_buffers(cmd_res, &test_cmd_reg), 0);
+	assert_int_equal(sid_buffer_get_data(ucmd_ctx->res_buf, data, size), 0);
+
+	sid_buffer_destroy(ucmd_ctx->exp_buf);
+	ucmd_ctx->exp_buf = NULL;
+}
+
+static void test_udev_export_patch(void **state)
+{
+	sid_resource_t      *cmd_res  = *state;
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	const void          *data;
+	size_t               size;
+
+	_set(ucmd_ctx, "B", "yy");
+	_set(ucmd_ctx, "A", "xx");
+	assert_int_equal(ucmd_ctx->udev_exp.size, sizeof("A=xx\0B=yy"));
+	assert_memory_equal(ucmd_ctx->udev_exp.block, "A=xx\0B=yy", sizeof("A=xx\0B=yy"));
+
+	/* the same size, patched in place */
+	_set(ucmd_ctx, "A", "zz");
+	assert_memory_equal(ucmd_ctx->udev_exp.block, "A=zz\0B=yy", sizeof("A=zz\0B=yy"));
+
+	/* different size, the rest of the block is shifted */
+	_set(ucmd_ctx, "A", "longer");
+	assert_memory_equal(ucmd_ctx->udev_exp.block, "A=longer\0B=yy", sizeof("A=longer\0B=yy"));
+
+	/* unset is not exported */
+	_set(ucmd_ctx, "A", NULL);
+	assert_memory_equal(ucmd_ctx->udev_exp.block, "B=yy", sizeof("B=yy"));
+
+	/* not marked for sync, not exported */
+	_set(ucmd_ctx, "A", "aa");
+	_import(ucmd_ctx, "A", "imported");
+	_import(ucmd_ctx, "C", "imported");
+	assert_memory_equal(ucmd_ctx->udev_exp.block, "B=yy", sizeof("B=yy"));
+
+	/* the response gets the block as it is */
+	_set(ucmd_ctx, "C", "cc");
+	_set(ucmd_ctx, "A", "aa");
+	_assert_block_matches(ucmd_ctx);
+	_build_reply(cmd_res, &data, &size);
+	assert_int_equal(size, sizeof("A=aa\0B=yy\0C=cc"));
+	assert_memory_equal(data, "A=aa\0B=yy\0C=cc", sizeof("A=aa\0B=yy\0C=cc"));
+}
+
+static void test_udev_export_random(void **state)
+{
+	sid_resource_t      *cmd_res  = *state;
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	char                 keys[TEST_NR_KEYS][TEST_KEY_SIZE];
+	char                 value[TEST_MAX_VALUE_LEN + 1];
+	const void          *data;
+	size_t               size;
+	unsigned             seed = TEST_SEED;
+	unsigned             i, op, len;
+
+	for (i = 0; i < TEST_NR_KEYS; i++)
+		snprintf(keys[i], sizeof(keys[i]), "PROPERTY_%u", i);
+
+	for (op = 0; op < TEST_NR_OPS; op++) {
+		i = rand_r(&seed) % TEST_NR_KEYS;
+
+		switch (rand_r(&seed) % 4) {
+			case 0:
+				_set(ucmd_ctx, keys[i], NULL);
+				break;
+			case 1:
+				_import(ucmd_ctx, keys[i], "imported");
+				break;
+			default:
+				/* few different sizes so values are patched in place as well as resized */
+				len = rand_r(&seed) % 4 * (TEST_MAX_VALUE_LEN / 4) + 1;
+				memset(value, 'a' + rand_r(&seed) % 26, len);
+				value[len] = '\0';
+				_set(ucmd_ctx, keys[i], value);
+		}
+
+		_assert_block_matches(ucmd_ctx);
+	}
+
+	_build_reply(cmd_res, &data, &size);
+	assert_int_equal(size, ucmd_ctx->udev_exp.size);
+	assert_memory_equal(data, ucmd_ctx->udev_exp.block, size);
+}
+
+/*
+ * Response construction for device with many udev properties, building the udev
+ * export from scratch compared to copying the maintained block.
+ */
+static void test_udev_export_bench(void **state)
+{
+	sid_resource_t      *cmd_res  = *state;
+	struct sid_ucmd_ctx *ucmd_ctx = sid_resource_get_data(cmd_res);
+	char                 key[TEST_KEY_SIZE], value[TEST_VALUE_SIZE];
+	struct bench         bench_fresh, bench_block;
+	const void          *data;
+	size_t               size;
+	unsigned             i;
+
+	for (i = 0; i < TEST_BENCH_NR_PROPERTIES; i++) {
+		snprintf(key, sizeof(key), "ID_PROPERTY_%u", i);
+		snprintf(value, sizeof(value), "value_of_property_%u", i);
+		_set(ucmd_ctx, key, value);
+	}
+
+	bench_init(&bench_fresh, "udev_export_fresh");
+	bench_start(&bench_fresh);
+	for (i = 0; i < TEST_BENCH_NR_REPLIES; i++) {
+		assert_int_equal(sid_buffer_rewind(ucmd_ctx->res_buf, 0, SID_BUFFER_POS_ABS), 0);
+		_build_fresh(ucmd_ctx, ucmd_ctx->res_buf);
+	}
+	bench_stop(&bench_fresh, TEST_BENCH_NR_REPLIES);
+	assert_int_equal(bench_report(&bench_fresh), 0);
+
+	bench_init(&bench_block, "udev_export_block");
+	bench_start(&bench_block);
+	for (i = 0; i < TEST_BENCH_NR_REPLIES; i++) {
+		assert_int_equal(sid_buffer_rewind(ucmd_ctx->res_buf, 0, SID_BUFFER_POS_ABS), 0);
+		assert_int_equal(sid_buffer_add(ucmd_ctx->res_buf, ucmd_ctx->udev_exp.block, ucmd_ctx->udev_exp.size, NULL, NULL),
+		                 0);
+	}
+	bench_stop(&bench_block, TEST_BENCH_NR_REPLIES);
+	assert_int_equal(bench_report(&bench_block), 0);
+
+	/* both ways give the same result */
+	assert_int_equal(sid_buffer_get_data(ucmd_ctx->res_buf, &data, &size), 0);
+	assert_int_equal(size, ucmd_ctx->udev_exp.size);
+	_assert_block_matches(ucmd_ctx);
+
+	print_message("udev export: %u properties, %zu bytes, %.0f ns per reply from scratch, %.0f ns per reply from block\n",
+	              TEST_BENCH_NR_PROPERTIES,
+	              size,
+	              (double) bench_fresh.nsec / TEST_BENCH_NR_REPLIES,
+	              (double) bench_block.nsec / TEST_BENCH_NR_REPLIES);
+
+	bench_destroy(&bench_fresh);
+	bench_destroy(&bench_block);
+}
+
+static int setup(void **state)
+{
+	sid_resource_t *res;
+
+	res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                          &sid_resource_type_fake_cmd,
+	                          SID_RESOURCE_NO_FLAGS,
+	                          "fakecmd",
+	                          SID_RESOURCE_NO_PARAMS,
+	                          SID_RESOURCE_PRIO_NORMAL,
+	                          SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(res);
+	*state = res;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	sid_resource_unref(*state);
+	return 0;
+}
+
+#define setup_test(func) cmocka_unit_test_setup_teardown((func), setup, teardown)
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		setup_test(test_udev_export_patch),
+		setup_test(test_udev_export_random),
+		setup_test(test_udev_export_bench),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
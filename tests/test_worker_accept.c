@@ -0,0 +1,544 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+/* define __USE_GNU for ucred definition */
+#define __USE_GNU
+#include "../src/internal/mem.c"
+#include "../src/resource/kv-store.c"
+#include "../src/resource/ubridge.c"
+#include "ucmd_fixture.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <cmocka.h>
+
+#define TEST_PATH_SIZE         64
+#define TEST_MAX_WORKERS       128
+#define TEST_NR_CONNECTIONS    32
+#define TEST_POLL_TIMEOUT_MSEC 10
+
+/* Worker process, each with its own copy of common context like after fork. */
+struct test_worker {
+	char                        id[16];
+	sid_resource_t             *proxy_res; /* worker representation in main process */
+	sid_resource_t             *res;       /* worker resource with event loop */
+	struct sid_ucmd_common_ctx *common_ctx;
+	bool                        yielded;
+};
+
+static struct {
+	struct ubridge     ubridge;
+	sid_resource_t    *ubridge_res;
+	sid_resource_t    *worker_control_res;
+	struct test_worker workers[TEST_MAX_WORKERS];
+	unsigned           nr_workers;
+	uint64_t           sync_gen;
+	char               path[TEST_PATH_SIZE];
+	size_t             path_len;
+	int                client_fds[TEST_NR_CONNECTIONS];
+	unsigned           nr_clients;
+	int                served_by[TEST_NR_CONNECTIONS]; /* worker which served the connection, -1 if none */
+	unsigned           served[TEST_NR_CONNECTIONS];    /* number of times the connection was served */
+} t;
+
+static const sid_resource_type_t test_event_loop_resource_type = {
+	.name            = "test event loop",
+	.short_name      = "tel",
+	.with_event_loop = 1,
+};
+
+static int _init_test_ubridge(sid_resource_t *res, const void *kickstart_data, void **data)
+{
+	*data = (void *) kickstart_data;
+	return 0;
+}
+
+static const sid_resource_type_t test_ubridge_resource_type = {
+	.name       = "test ubridge",
+	.short_name = "tub",
+	.init       = _init_test_ubridge,
+};
+
+static struct test_worker *_find_worker(sid_resource_t *res)
+{
+	unsigned i;
+
+	for (i = 0; i < t.nr_workers; i++)
+		if (t.workers[i].proxy_res == res || t.workers[i].res == res)
+			return &t.workers[i];
+
+	fail_msg("unknown worker resource");
+	return NULL;
+}
+
+/* Record the client served by worker, the client sent its index right after connecting. */
+static void _serve(struct test_worker *worker, int fd)
+{
+	unsigned idx;
+
+	assert_int_equal(read(fd, &idx, sizeof(idx)), sizeof(idx));
+	assert_true(idx < t.nr_clients);
+
+	t.served[idx]++;
+	t.served_by[idx] = worker - t.workers;
+}
+
+int __wrap_worker_control_channel_send(sid_resource_t *res, const char *channel_id, struct worker_data_spec *data_spec)
+{
+	struct test_worker        *worker = _find_worker(res);
+	struct internal_msg_header int_msg;
+	struct worker_data_spec    spec;
+
+	memcpy(&int_msg, data_spec->data, sizeof(int_msg));
+
+	/* worker -> main */
+	if (res == worker->res) {
+		assert_int_equal(int_msg.cat, MSG_CATEGORY_SYSTEM);
+		assert_int_equal(int_msg.header.cmd, SYSTEM_CMD_ACCEPTED);
+
+		/* the fd is passed over the channel, so main process gets its own copy */
+		spec = *data_spec;
+		if (spec.ext.used)
+			assert_true((spec.ext.socket.fd_pass = dup(data_spec->ext.socket.fd_pass)) >= 0);
+
+		return _worker_proxy_recv_system_cmd_accepted(worker->proxy_res, &spec, t.ubridge.common_ctx);
+	}
+
+	/* main -> worker */
+	if (int_msg.cat == MSG_CATEGORY_CLIENT) {
+		assert_true(data_spec->ext.used);
+		_serve(worker, data_spec->ext.socket.fd_pass);
+		return 0;
+	}
+
+	assert_int_equal(int_msg.cat, MSG_CATEGORY_SYSTEM);
+
+	switch (int_msg.header.cmd) {
+		case SYSTEM_CMD_ACCEPT_TOKEN:
+			return _worker_recv_system_cmd_accept_token(worker->res, worker->common_ctx);
+		case SYSTEM_CMD_ACCEPT_REVOKE:
+			return _worker_recv_system_cmd_accept_revoke(worker->res, worker->common_ctx);
+		default:
+			fail_msg("unexpected command %d sent to worker", int_msg.header.cmd);
+	}
+
+	return -1;
+}
+
+sid_resource_t *__wrap_worker_control_find_worker(sid_resource_t *res, const char *id)
+{
+	unsigned i;
+
+	assert_ptr_equal(res, t.worker_control_res);
+
+	for (i = 0; i < t.nr_workers; i++)
+		if (!strcmp(t.workers[i].id, id))
+			return t.workers[i].proxy_res;
+
+	return NULL;
+}
+
+const char *__wrap_worker_control_get_worker_id(sid_resource_t *res)
+{
+	return _find_worker(res)->id;
+}
+
+int __wrap_worker_control_recv_pending(sid_resource_t *worker_control_res)
+{
+	return 0;
+}
+
+sid_resource_t *__wrap_worker_control_get_idle_worker(sid_resource_t *worker_control_res)
+{
+	return NULL;
+}
+
+/* Create new worker, as if forked from main process at this point. */
+int __wrap_worker_control_get_new_worker(sid_resource_t       *worker_control_res,
+                                        struct worker_params *params,
+                                        sid_resource_t      **res_p)
+{
+	struct test_worker *worker = &t.workers[t.nr_workers];
+
+	assert_true(t.nr_workers < TEST_MAX_WORKERS);
+	snprintf(worker->id, sizeof(worker->id), "worker-%u", t.nr_workers++);
+
+	assert_non_null(worker->proxy_res = sid_resource_create(worker_control_res,
+	                                                        &sid_resource_type_aggregate,
+	                                                        SID_RESOURCE_NO_FLAGS,
+	                                                        worker->id,
+	                                                        SID_RESOURCE_NO_PARAMS,
+	                                                        SID_RESOURCE_PRIO_NORMAL,
+	                                                        SID_RESOURCE_NO_SERVICE_LINKS));
+	assert_non_null(worker->res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                                  &test_event_loop_resource_type,
+	                                                  SID_RESOURCE_NO_FLAGS,
+	                                                  worker->id,
+	                                                  SID_RESOURCE_NO_PARAMS,
+	                                                  SID_RESOURCE_PRIO_NORMAL,
+	                                                  SID_RESOURCE_NO_SERVICE_LINKS));
+
+	worker->common_ctx      = ucmd_fixture_common_ctx_create();
+	worker->common_ctx->res = sid_resource_create(worker->res,
+	                                              &sid_resource_type_aggregate,
+	                                              SID_RESOURCE_NO_FLAGS,
+	                                              "testcommon",
+	                                              SID_RESOURCE_NO_PARAMS,
+	                                              SID_RESOURCE_PRIO_NORMAL,
+	                                              SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(worker->common_ctx->res);
+
+	/* what the worker inherits from main process, see _worker_init_fn */
+	worker->common_ctx->worker_accept.enabled   = true;
+	worker->common_ctx->worker_accept.sync_gen  = &t.sync_gen;
+	worker->common_ctx->worker_accept.fork_gen  = t.ubridge.common_ctx->worker_accept.fork_gen;
+	worker->common_ctx->worker_accept.socket_fd = dup(t.ubridge.socket_fd);
+	worker->common_ctx->worker_accept.watch_fd  = -1;
+	list_init(&worker->common_ctx->worker_accept.bounced);
+	assert_true(worker->common_ctx->worker_accept.socket_fd >= 0);
+
+	*res_p = worker->proxy_res;
+	return 0;
+}
+
+int __wrap_worker_control_worker_yield(sid_resource_t *res)
+{
+	_find_worker(res)->yielded = true;
+	return 0;
+}
+
+sid_resource_t *__real_sid_resource_create(sid_resource_t                 *parent_res,
+                                           const sid_resource_type_t      *type,
+                                           sid_resource_flags_t            flags,
+                                           const char                     *id,
+                                           const void                     *kickstart_data,
+                                           int64_t                         prio,
+                                           sid_resource_service_link_def_t service_link_defs[]);
+
+/* Connection resources are not created, only recorded, closing the connection right away. */
+sid_resource_t *__wrap_sid_resource_create(sid_resource_t                 *parent_res,
+                                           const sid_resource_type_t      *type,
+                                           sid_resource_flags_t            flags,
+                                           const char                     *id,
+                                           const void                     *kickstart_data,
+                                           int64_t                         prio,
+                                           sid_resource_service_link_def_t service_link_defs[])
+{
+	const struct worker_data_spec *data_spec = kickstart_data;
+
+	if (type != &sid_resource_type_ubridge_connection)
+		return __real_sid_resource_create(parent_res, type, flags, id, kickstart_data, prio, service_link_defs);
+
+	_serve(_find_worker(parent_res), data_spec->ext.socket.fd_pass);
+	(void) close(data_spec->ext.socket.fd_pass);
+
+	return parent_res;
+}
+
+/* Connect new client, it sends its index so the connection can be identified when served. */
+static unsigned _connect(void)
+{
+	unsigned idx = t.nr_clients;
+	int      fd;
+
+	assert_true(idx < TEST_NR_CONNECTIONS);
+	assert_true((fd = sid_comms_unix_init(t.path, t.path_len, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0);
+
+	t.client_fds[t.nr_clients++] = fd;
+	assert_int_equal(write(fd, &idx, sizeof(idx)), sizeof(idx));
+
+	return idx;
+}
+
+static bool _has_pending(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLIN};
+
+	return poll(&pfd, 1, TEST_POLL_TIMEOUT_MSEC) > 0;
+}
+
+/* Main process event to hand over the accept token. */
+static void _run_main(void)
+{
+	assert_int_equal(_on_worker_accept_event(NULL, t.ubridge_res), 0);
+	assert_true(t.ubridge.common_ctx->worker_accept.enabled);
+}
+
+/* Dispatch listening socket watch in each worker which has it. Returns number of workers dispatched. */
+static unsigned _run_workers(void)
+{
+	struct test_worker *worker;
+	unsigned            i, n = 0;
+
+	for (i = 0; i < t.nr_workers; i++) {
+		worker = &t.workers[i];
+
+		if (worker->common_ctx->worker_accept.watch_fd < 0 || !_has_pending(worker->common_ctx->worker_accept.watch_fd))
+			continue;
+
+		assert_int_equal(_on_worker_accept_watch_event(worker->common_ctx->worker_accept.watch_es,
+		                                               worker->common_ctx->worker_accept.watch_fd,
+		                                               EPOLLIN,
+		                                               worker->common_ctx),
+		                 0);
+		n++;
+	}
+
+	return n;
+}
+
+/* Take the token back as if a worker export arrived. */
+static void _revoke(void)
+{
+	__atomic_add_fetch(&t.sync_gen, 1, __ATOMIC_RELEASE);
+	_revoke_accept_token(t.worker_control_res, t.ubridge.common_ctx);
+}
+
+static const char *_token_id(void)
+{
+	return t.ubridge.common_ctx->worker_accept.token_id;
+}
+
+static bool _watching(unsigned worker)
+{
+	return t.workers[worker].common_ctx->worker_accept.watch_es != NULL;
+}
+
+static void _assert_served_once(void)
+{
+	unsigned i;
+
+	for (i = 0; i < t.nr_clients; i++)
+		assert_int_equal(t.served[i], 1);
+}
+
+static void test_worker_accept_token_holder(void **state)
+{
+	unsigned a, b;
+
+	/* token goes to new worker, only one token exists at a time */
+	_run_main();
+	assert_int_equal(t.nr_workers, 1);
+	assert_string_equal(_token_id(), "worker-0");
+	assert_true(_watching(0));
+	_run_main();
+	assert_int_equal(t.nr_workers, 1);
+
+	/* the token holder accepts and the token is used up */
+	a = _connect();
+	assert_int_equal(_run_workers(), 1);
+	assert_int_equal(t.served_by[a], 0);
+	assert_null(_token_id());
+	assert_false(_watching(0));
+	assert_false(t.workers[0].yielded);
+
+	/* without the token, next connection waits in the backlog */
+	b = _connect();
+	assert_int_equal(_run_workers(), 0);
+	assert_true(_has_pending(t.ubridge.socket_fd));
+
+	/* until the token is handed over to another worker */
+	_run_main();
+	assert_int_equal(t.nr_workers, 2);
+	assert_string_equal(_token_id(), "worker-1");
+	assert_false(_watching(0));
+	assert_true(_watching(1));
+	assert_int_equal(_run_workers(), 1);
+	assert_int_equal(t.served_by[b], 1);
+
+	_assert_served_once();
+}
+
+static void test_worker_accept_token_revoke(void **state)
+{
+	unsigned a;
+
+	_run_main();
+	assert_string_equal(_token_id(), "worker-0");
+
+	/* revoked token stops the holder watching the socket, the holder exits */
+	_revoke();
+	assert_null(_token_id());
+	assert_false(_watching(0));
+	assert_true(t.workers[0].yielded);
+
+	a = _connect();
+	assert_int_equal(_run_workers(), 0);
+	assert_true(_has_pending(t.ubridge.socket_fd));
+
+	/* new worker gets the token with current generation and accepts */
+	_run_main();
+	assert_string_equal(_token_id(), "worker-1");
+	assert_int_equal(t.workers[1].common_ctx->worker_accept.fork_gen, t.sync_gen);
+	assert_int_equal(_run_workers(), 1);
+	assert_int_equal(t.served_by[a], 1);
+	assert_false(t.workers[1].yielded);
+
+	/* revoking used token does not stop the worker serving the connection */
+	_revoke();
+	assert_false(t.workers[1].yielded);
+
+	_assert_served_once();
+}
+
+static void test_worker_accept_token_bounce(void **state)
+{
+	unsigned a;
+
+	_run_main();
+	assert_string_equal(_token_id(), "worker-0");
+
+	/* export arrives, but the holder accepts before the revoke reaches it */
+	__atomic_add_fetch(&t.sync_gen, 1, __ATOMIC_RELEASE);
+	a = _connect();
+	assert_int_equal(_run_workers(), 1);
+
+	/* stale holder does not serve the connection, it hands it back and exits */
+	assert_int_equal(t.served[a], 0);
+	assert_true(t.workers[0].yielded);
+	assert_null(_token_id());
+	assert_false(list_is_empty(&t.ubridge.common_ctx->worker_accept.bounced));
+
+	/* late revoke finds no token to take back */
+	_revoke_accept_token(t.worker_control_res, t.ubridge.common_ctx);
+	assert_null(_token_id());
+
+	/* bounced connection goes to new worker, next one gets the token */
+	_run_main();
+	assert_true(list_is_empty(&t.ubridge.common_ctx->worker_accept.bounced));
+	assert_int_equal(t.served_by[a], 1);
+	assert_string_equal(_token_id(), "worker-2");
+	assert_int_equal(_run_workers(), 0);
+
+	_assert_served_once();
+}
+
+static void test_worker_accept_no_loss(void **state)
+{
+	unsigned i, rounds;
+
+	/*
+	 * Connections arrive with the token handed over, revoked or going stale in between.
+	 * The listening socket has minimal backlog, so each one is served before next one.
+	 */
+	for (i = 0; i < TEST_NR_CONNECTIONS; i++) {
+		_run_main();
+
+		switch (i % 4) {
+			case 1:
+				_revoke();
+				break;
+			case 2:
+				__atomic_add_fetch(&t.sync_gen, 1, __ATOMIC_RELEASE);
+				break;
+		}
+
+		(void) _connect();
+
+		for (rounds = 0; rounds < 4 && _has_pending(t.ubridge.socket_fd); rounds++) {
+			(void) _run_workers();
+			_run_main();
+		}
+
+		assert_false(_has_pending(t.ubridge.socket_fd));
+	}
+
+	_run_main();
+	assert_true(list_is_empty(&t.ubridge.common_ctx->worker_accept.bounced));
+	_assert_served_once();
+}
+
+static int setup(void **state)
+{
+	const struct worker_channel_spec            channel_specs[]       = {NULL_WORKER_CHANNEL_SPEC};
+	const struct worker_control_resource_params worker_control_params = {.worker_type   = WORKER_TYPE_INTERNAL,
+	                                                                     .channel_specs = channel_specs};
+	struct sid_ucmd_common_ctx                 *common_ctx;
+	sid_resource_t                             *internal_res;
+	unsigned                                    i;
+
+	memset(&t, 0, sizeof(t));
+	for (i = 0; i < TEST_NR_CONNECTIONS; i++)
+		t.served_by[i] = -1;
+
+	/* abstract socket, nothing to clean up in the filesystem */
+	t.path_len = 1 + snprintf(t.path + 1, sizeof(t.path) - 1, "sid-test-worker-accept-%d", getpid());
+
+	common_ctx                          = ucmd_fixture_common_ctx_create();
+	common_ctx->worker_accept.enabled   = true;
+	common_ctx->worker_accept.sync_gen  = &t.sync_gen;
+	common_ctx->worker_accept.socket_fd = -1;
+	common_ctx->worker_accept.watch_fd  = -1;
+	list_init(&common_ctx->worker_accept.bounced);
+
+	t.ubridge.common_ctx = common_ctx;
+	t.ubridge.socket_fd  = sid_comms_unix_create(t.path, t.path_len, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC);
+	assert_true(t.ubridge.socket_fd >= 0);
+
+	t.ubridge_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                    &test_ubridge_resource_type,
+	                                    SID_RESOURCE_NO_FLAGS,
+	                                    "testubridge",
+	                                    &t.ubridge,
+	                                    SID_RESOURCE_PRIO_NORMAL,
+	                                    SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(t.ubridge_res);
+	internal_res = sid_resource_create(t.ubridge_res,
+	                                   &sid_resource_type_aggregate,
+	                                   SID_RESOURCE_NO_FLAGS,
+	                                   "testinternal",
+	                                   SID_RESOURCE_NO_PARAMS,
+	                                   SID_RESOURCE_PRIO_NORMAL,
+	                                   SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(internal_res);
+	t.ubridge.internal_res = internal_res;
+	t.worker_control_res   = sid_resource_create(internal_res,
+	                                             &sid_resource_type_worker_control,
+	                                             SID_RESOURCE_NO_FLAGS,
+	                                             "testworkercontrol",
+	                                             &worker_control_params,
+	                                             SID_RESOURCE_PRIO_NORMAL,
+	                                             SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(t.worker_control_res);
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct test_worker *worker;
+	unsigned            i;
+
+	for (i = 0; i < t.nr_workers; i++) {
+		worker = &t.workers[i];
+		_destroy_worker_accept(worker->common_ctx);
+		ucmd_fixture_common_ctx_destroy(worker->common_ctx);
+		sid_resource_unref(worker->res);
+	}
+
+	_destroy_worker_accept(t.ubridge.common_ctx);
+	ucmd_fixture_common_ctx_destroy(t.ubridge.common_ctx);
+	sid_resource_unref(t.ubridge_res);
+	(void) close(t.ubridge.socket_fd);
+
+	for (i = 0; i < t.nr_clients; i++)
+		(void) close(t.client_fds[i]);
+
+	return 0;
+}
+
+#define setup_test(func) cmocka_unit_test_setup_teardown((func), setup, teardown)
+
+int main(void)
+{
+	cmocka_set_message_output(CM_OUTPUT_STDOUT);
+	const struct CMUnitTest tests[] = {
+		setup_test(test_worker_accept_token_holder),
+		setup_test(test_worker_accept_token_revoke),
+		setup_test(test_worker_accept_token_bounce),
+		setup_test(test_worker_accept_no_loss),
+	};
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,25 @@
+#include "ucmd_fixture.h"
+
+#include <limits.h>
+
+struct module;
+
+/* Module names double as fake module handles. */
+const char *__wrap_module_get_full_name(struct module *module)
+{
+	return (const char *) module;
+}
+
+struct sid_buffer *ucmd_fixture_buffer_create(void)
+{
+	struct sid_buffer *buf;
+
+	buf = sid_buffer_create(&((struct sid_buffer_spec) {.backend = SID_BUFFER_BACKEND_MALLOC,
+	                                                    .type    = SID_BUFFER_TYPE_LINEAR,
+	                                                    .mode    = SID_BUFFER_MODE_PLAIN}),
+	                        &((struct sid_buffer_init) {.size = 0, .alloc_step = PATH_MAX, .limit = 0}),
+	                        NULL);
+	assert_non_null(buf);
+
+	return buf;
+}
@@ -0,0 +1,90 @@
+#ifndef _SID_TESTS_UCMD_FIXTURE_H
+#define _SID_TESTS_UCMD_FIXTURE_H
+
+/*
+ * Fixture for tests which include ubridge.c to test its internals.
+ *
+ * Tests linked with -Wl,--wrap=module_get_full_name use module name
+ * strings as fake module handles.
+ *
+ * Context helpers access ubridge internals, so they are only available
+ * if ubridge.c is included before this header.
+ */
+
+#include "base/buffer.h"
+
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cmocka.h>
+
+struct sid_buffer *ucmd_fixture_buffer_create(void);
+
+#ifdef MAIN_KV_STORE_NAME
+static inline struct sid_ucmd_common_ctx *ucmd_fixture_common_ctx_create(void)
+{
+	struct sid_ucmd_common_ctx *common_ctx;
+
+	assert_non_null(common_ctx = mem_zalloc(sizeof(*common_ctx)));
+	common_ctx->kv_store_res = sid_resource_create(SID_RESOURCE_NO_PARENT,
+	                                               &sid_resource_type_kv_store,
+	                                               SID_RESOURCE_RESTRICT_WALK_UP,
+	                                               "testkvstore",
+	                                               &main_kv_store_res_params,
+	                                               SID_RESOURCE_PRIO_NORMAL,
+	                                               SID_RESOURCE_NO_SERVICE_LINKS);
+	assert_non_null(common_ctx->kv_store_res);
+	common_ctx->gen_buf = ucmd_fixture_buffer_create();
+	common_ctx->gennum  = 1;
+	list_init(&common_ctx->sync.queue);
+	list_init(&common_ctx->spec_scan.list);
+	list_init(&common_ctx->scan_memo.list);
+
+	return common_ctx;
+}
+
+static inline void ucmd_fixture_common_ctx_destroy(struct sid_ucmd_common_ctx *common_ctx)
+{
+	sid_resource_unref(common_ctx->kv_store_res);
+	sid_buffer_destroy(common_ctx->gen_buf);
+	free(common_ctx);
+}
+
+/* Initialize command context which is part of a bigger structure. */
+static inline void ucmd_fixture_ctx_init(struct sid_ucmd_ctx *ucmd_ctx, struct sid_ucmd_common_ctx *common_ctx)
+{
+	ucmd_ctx->common  = common_ctx;
+	ucmd_ctx->res_buf = ucmd_fixture_buffer_create();
+}
+
+static inline void ucmd_fixture_ctx_cleanup(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	if (ucmd_ctx->exp_buf)
+		sid_buffer_destroy(ucmd_ctx->exp_buf);
+	sid_buffer_destroy(ucmd_ctx->res_buf);
+	_foreign_kv_cache_destroy(ucmd_ctx);
+	_udev_exp_destroy(ucmd_ctx);
+}
+
+/* Create command context with its own common context. */
+static inline struct sid_ucmd_ctx *ucmd_fixture_ctx_create(void)
+{
+	struct sid_ucmd_ctx *ucmd_ctx;
+
+	assert_non_null(ucmd_ctx = mem_zalloc(sizeof(*ucmd_ctx)));
+	ucmd_fixture_ctx_init(ucmd_ctx, ucmd_fixture_common_ctx_create());
+
+	return ucmd_ctx;
+}
+
+static inline void ucmd_fixture_ctx_destroy(struct sid_ucmd_ctx *ucmd_ctx)
+{
+	ucmd_fixture_ctx_cleanup(ucmd_ctx);
+	ucmd_fixture_common_ctx_destroy(ucmd_ctx->common);
+	free(ucmd_ctx);
+}
+#endif
+
+#endif